@@ -45,6 +45,7 @@
 	#include <circle/synchronize.h>
 	#include <circle/machineinfo.h>
 	#include <circle/memio.h>
+	#include <circle/new.h>
 	#include <circle/sched/scheduler.h>
 #else
 	#include "mmc.h"
@@ -95,6 +96,12 @@
 // Required for QEMU
 #define EMMC_ALLOW_OLD_SDHCI
 
+// Use ADMA2 for read/write block transfers, if supported by the host controller
+// (EMMC2 on the Raspberry Pi 4 only, the EMMC of earlier models has no usable DMA)
+#if RASPPI >= 4
+	#define EMMC_USE_DMA
+#endif
+
 #if RASPPI <= 3
 	#define EMMC_BASE	ARM_EMMC_BASE
 #else
@@ -120,6 +127,8 @@
 #define EMMC_CAPABILITIES_0	(EMMC_BASE + 0x40)
 #define EMMC_CAPABILITIES_1	(EMMC_BASE + 0x44)
 #define EMMC_FORCE_IRPT		(EMMC_BASE + 0x50)
+#define EMMC_ADMA_ERR_STAT	(EMMC_BASE + 0x54)
+#define EMMC_ADMA_SYS_ADDR	(EMMC_BASE + 0x58)
 #define EMMC_BOOT_TIMEOUT	(EMMC_BASE + 0x70)
 #define EMMC_DBG_SEL		(EMMC_BASE + 0x74)
 #define EMMC_EXRDFIFO_CFG	(EMMC_BASE + 0x80)
@@ -191,6 +200,24 @@
 #define SD_CARD_INSERTION       (1 << 6)
 #define SD_CARD_REMOVAL         (1 << 7)
 #define SD_CARD_INTERRUPT       (1 << 8)
+#define SD_ERROR_INTERRUPTS	0xffff0000
+
+#define SD_CONTROL0_DMA_SEL_MASK	(3 << 3)
+#define SD_CONTROL0_DMA_SEL_ADMA2	(2 << 3)	// 32-bit address
+
+#define SD_CAPS0_ADMA2			(1 << 19)
+
+// ADMA2 descriptor (HCSS 1.13.4)
+#define ADMA2_VALID		(1 << 0)
+#define ADMA2_END		(1 << 1)
+#define ADMA2_INT		(1 << 2)
+#define ADMA2_ACT_TRAN		(2 << 4)
+#define ADMA2_ACT_LINK		(3 << 4)
+
+#define ADMA2_MAX_LENGTH	0x8000		// bytes per descriptor
+#define ADMA2_DESCRIPTORS	(0xFFFF * SD_BLOCK_SIZE / ADMA2_MAX_LENGTH + 1)
+
+#define DMA_TIMEOUT_PER_BLOCK	1000		// us, added to the command timeout
 
 #endif
 
@@ -476,16 +503,25 @@ const u32 CEMMCDevice::sd_acommands[] =
 
 #define SD_BLOCK_SIZE		512
 
+#define EMMC_MAX_MERGE_SIZE	0x40000		// adjacent requests are merged up to this size
+
 CEMMCDevice::CEMMCDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer, CActLED *pActLED)
 :	m_pInterruptSystem (pInterruptSystem),
 	m_pTimer (pTimer),
 	m_pActLED (pActLED),
 	m_ullOffset (0),
+	m_RequestQueue (SD_BLOCK_SIZE, EMMC_MAX_MERGE_SIZE, TransferHandler, this),
 	m_pPartitionManager (0),
 #ifdef USE_SDHOST
 	m_Host (pInterruptSystem, pTimer),
 #else
 	m_hci_ver (0),
+	m_pADMA2Table (0),
+	m_nDMAMemoryStart (0),
+	m_nDMAMemoryEnd (0),
+	m_nDMABusAddress (0),
+	m_bDMATransfer (FALSE),
+	m_bDMAInterrupt (FALSE),
 #endif
 	m_pSCR (0)
 {
@@ -521,6 +557,15 @@ CEMMCDevice::~CEMMCDevice (void)
 {
 #ifdef USE_SDHOST
 	m_Host.Reset ();
+#else
+	if (m_pADMA2Table != 0)
+	{
+		write32 (EMMC_IRPT_EN, 0);
+		m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_ARASANSDIO);
+
+		delete [] m_pADMA2Table;
+		m_pADMA2Table = 0;
+	}
 #endif
 
 	delete m_pSCR;
@@ -565,6 +610,41 @@ boolean CEMMCDevice::Initialize (void)
 		return FALSE;
 	}
 
+#ifdef EMMC_USE_DMA
+	// the EMMC2 bus address mapping differs between BCM2711B0 (0xC0000000 for the
+	// first GB) and C0 (1:1), use DMA only, if it is known from the DTB
+	TMemoryWindow DMAMemory = CMachineInfo::Get ()->GetEMMC2DMAMemory ();
+	if (   DMAMemory.Size != 0
+	    && DMAMemory.CPUAddress == 0			// must include HEAP_DMA30
+	    && DMAMemory.Size >= 0x40000000
+	    && DMAMemory.BusAddress + DMAMemory.Size <= 0x100000000ULL)	// 32-bit ADMA2
+	{
+		m_nDMAMemoryStart = (uintptr) DMAMemory.CPUAddress;
+		m_nDMAMemoryEnd = (uintptr) (DMAMemory.CPUAddress + DMAMemory.Size);
+		m_nDMABusAddress = (u32) DMAMemory.BusAddress;
+	}
+	else
+	{
+		LogWrite (LogDebug, "EMMC2 DMA address mapping unknown, using PIO");
+	}
+
+	if (   m_nDMAMemoryEnd != 0
+	    && m_hci_ver >= 2
+	    && (read32 (EMMC_CAPABILITIES_0) & SD_CAPS0_ADMA2))
+	{
+		assert (m_pADMA2Table == 0);
+		m_pADMA2Table = new (HEAP_DMA30) TEMMCADMA2Descriptor[ADMA2_DESCRIPTORS];
+		assert (m_pADMA2Table != 0);
+
+		// only the completion of DMA transfers is signaled with an interrupt
+		write32 (EMMC_IRPT_EN, 0);
+		assert (m_pInterruptSystem != 0);
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_ARASANSDIO, InterruptStub, this);
+
+		LogWrite (LogDebug, "Using ADMA2 for data transfers");
+	}
+#endif
+
 	PeripheralExit ();
 
 	const char DeviceName[] = "emmc1";
@@ -584,48 +664,33 @@ boolean CEMMCDevice::Initialize (void)
 
 int CEMMCDevice::Read (void *pBuffer, size_t nCount)
 {
-	if (m_ullOffset % SD_BLOCK_SIZE != 0)
-	{
-		return -1;
-	}
-	u32 nBlock = m_ullOffset / SD_BLOCK_SIZE;
-
-	if (m_pActLED != 0)
-	{
-		m_pActLED->On ();
-	}
-
-	PeripheralEntry ();
-
-	if (DoRead ((u8 *) pBuffer, nCount, nBlock) != (int) nCount)
-	{
-		PeripheralExit ();
-
-		if (m_pActLED != 0)
-		{
-			m_pActLED->Off ();
-		}
-
-		return -1;
-	}
+	return m_RequestQueue.Transfer (BlockRequestRead, pBuffer, nCount, m_ullOffset);
+}
 
-	PeripheralExit ();
+int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
+{
+	return m_RequestQueue.Transfer (BlockRequestWrite, (void *) pBuffer, nCount, m_ullOffset);
+}
 
-	if (m_pActLED != 0)
-	{
-		m_pActLED->Off ();
-	}
+u64 CEMMCDevice::Seek (u64 ullOffset)
+{
+	m_ullOffset = ullOffset;
+	
+	return m_ullOffset;
+}
 
-	return nCount;
+boolean CEMMCDevice::SubmitRequest (CBlockRequest *pRequest)
+{
+	return m_RequestQueue.Submit (pRequest);
 }
 
-int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
+int CEMMCDevice::Transfer (TBlockRequestType Type, void *pBuffer, size_t nCount, u64 ullOffset)
 {
-	if (m_ullOffset % SD_BLOCK_SIZE != 0)
+	if (ullOffset % SD_BLOCK_SIZE != 0)
 	{
 		return -1;
 	}
-	u32 nBlock = m_ullOffset / SD_BLOCK_SIZE;
+	u32 nBlock = ullOffset / SD_BLOCK_SIZE;
 
 	if (m_pActLED != 0)
 	{
@@ -634,16 +699,14 @@ int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
 
 	PeripheralEntry ();
 
-	if (DoWrite ((u8 *) pBuffer, nCount, nBlock) != (int) nCount)
+	int nResult;
+	if (Type == BlockRequestRead)
 	{
-		PeripheralExit ();
-
-		if (m_pActLED != 0)
-		{
-			m_pActLED->Off ();
-		}
-
-		return -1;
+		nResult = DoRead ((u8 *) pBuffer, nCount, nBlock);
+	}
+	else
+	{
+		nResult = DoWrite ((u8 *) pBuffer, nCount, nBlock);
 	}
 
 	PeripheralExit ();
@@ -653,14 +716,16 @@ int CEMMCDevice::Write (const void *pBuffer, size_t nCount)
 		m_pActLED->Off ();
 	}
 
-	return nCount;
+	return nResult == (int) nCount ? (int) nCount : -1;
 }
 
-u64 CEMMCDevice::Seek (u64 ullOffset)
+int CEMMCDevice::TransferHandler (TBlockRequestType Type, void *pBuffer, size_t nCount,
+				  u64 ullOffset, void *pParam)
 {
-	m_ullOffset = ullOffset;
-	
-	return m_ullOffset;
+	CEMMCDevice *pThis = (CEMMCDevice *) pParam;
+	assert (pThis != 0);
+
+	return pThis->Transfer (Type, pBuffer, nCount, ullOffset);
 }
 
 #ifndef USE_SDHOST
@@ -913,6 +978,16 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 	u32 blksizecnt = m_block_size | (m_blocks_to_transfer << 16);
 	write32 (EMMC_BLKSIZECNT, blksizecnt);
 
+#ifdef EMMC_USE_DMA
+	if (   m_bDMATransfer
+	    && (cmd_reg & SD_CMD_ISDATA))
+	{
+		SetupDMA ();
+
+		cmd_reg |= SD_CMD_DMA;
+	}
+#endif
+
 	// Set argument 1 reg
 	write32 (EMMC_ARG1, argument);
 
@@ -958,6 +1033,27 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 		break;
 	}
 
+#ifdef EMMC_USE_DMA
+	// With DMA, wait for transfer complete, without polling the controller
+	if (cmd_reg & SD_CMD_DMA)
+	{
+		if (!WaitForDMA (timeout + m_blocks_to_transfer * DMA_TIMEOUT_PER_BLOCK))
+		{
+			return;
+		}
+
+		if (cmd_reg & SD_CMD_DAT_DIR_CH)
+		{
+			CleanAndInvalidateDataCacheRange ((uintptr) m_buf,
+							  m_blocks_to_transfer * m_block_size);
+		}
+
+		m_last_cmd_success = 1;
+
+		return;
+	}
+#endif
+
 	// If with data, wait for the appropriate interrupt
 	if (cmd_reg & SD_CMD_ISDATA)
 	{
@@ -1193,6 +1289,119 @@ void CEMMCDevice::HandleInterrupts (void)
 	write32 (EMMC_INTERRUPT, reset_mask);
 }
 
+#ifdef EMMC_USE_DMA
+
+void CEMMCDevice::SetupDMA (void)
+{
+	uintptr nAddress = (uintptr) m_buf;
+	size_t nLength = m_blocks_to_transfer * m_block_size;
+	assert ((nAddress & 3) == 0);
+	assert (nAddress >= m_nDMAMemoryStart);
+	assert (nAddress + nLength <= m_nDMAMemoryEnd);
+
+	CleanAndInvalidateDataCacheRange (nAddress, nLength);
+
+	assert (m_pADMA2Table != 0);
+	TEMMCADMA2Descriptor *pDesc = m_pADMA2Table;
+	while (nLength > 0)
+	{
+		assert (pDesc < &m_pADMA2Table[ADMA2_DESCRIPTORS]);
+
+		size_t nDescLength = nLength < ADMA2_MAX_LENGTH ? nLength : ADMA2_MAX_LENGTH;
+		nLength -= nDescLength;
+
+		pDesc->nAttributes = ADMA2_VALID | ADMA2_ACT_TRAN | (nLength == 0 ? ADMA2_END : 0);
+		pDesc->nLength = (u16) nDescLength;
+		pDesc->nAddress = (u32) (nAddress - m_nDMAMemoryStart) + m_nDMABusAddress;
+
+		nAddress += nDescLength;
+		pDesc++;
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pADMA2Table,
+					  (pDesc - m_pADMA2Table) * sizeof (TEMMCADMA2Descriptor));
+
+	write32 (EMMC_ADMA_SYS_ADDR,
+		 (u32) ((uintptr) m_pADMA2Table - m_nDMAMemoryStart) + m_nDMABusAddress);
+
+	u32 control0 = read32 (EMMC_CONTROL0);
+	control0 &= ~SD_CONTROL0_DMA_SEL_MASK;
+	control0 |= SD_CONTROL0_DMA_SEL_ADMA2;
+	write32 (EMMC_CONTROL0, control0);
+
+	m_bDMAInterrupt = FALSE;
+#ifdef NO_BUSY_WAIT
+	m_DMAEvent.Clear ();
+#endif
+}
+
+boolean CEMMCDevice::WaitForDMA (unsigned usec)
+{
+	// Signal transfer complete and errors to the ARM, the interrupt handler
+	// only disables the signals again and wakes us up
+	write32 (EMMC_IRPT_EN, SD_TRANSFER_COMPLETE | SD_ERROR_INTERRUPTS);
+
+#ifdef NO_BUSY_WAIT
+	m_DMAEvent.WaitWithTimeout (usec);
+#else
+	assert (m_pTimer != 0);
+	unsigned nStartTicks = m_pTimer->GetClockTicks ();
+	unsigned nTimeoutTicks = usec * (CLOCKHZ / 1000000);
+
+	while (   !m_bDMAInterrupt
+	       && m_pTimer->GetClockTicks () - nStartTicks < nTimeoutTicks)
+	{
+		// just wait
+	}
+#endif
+
+	write32 (EMMC_IRPT_EN, 0);
+
+	u32 irpts = read32 (EMMC_INTERRUPT);
+	write32 (EMMC_INTERRUPT, SD_ERROR_INTERRUPTS | SD_TRANSFER_COMPLETE | SD_DMA_INTERRUPT);
+
+	// Transfer complete overrides data timeout: HCSS 2.2.17
+	if (   ((irpts & 0xffff0002) != 2)
+	    && ((irpts & 0xffff0002) != 0x100002))
+	{
+#ifdef EMMC_DEBUG
+		LogWrite (LogWarning, "DMA transfer failed (intr %08x, ADMA error %02x)",
+			  irpts, read32 (EMMC_ADMA_ERR_STAT));
+#endif
+		m_last_error = irpts & 0xffff0000;
+		m_last_interrupt = irpts;
+
+		// Stop the DMA engine
+		ResetCmd ();
+		ResetDat ();
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CEMMCDevice::InterruptHandler (void)
+{
+	// The interrupt status is evaluated and cleared in WaitForDMA()
+	write32 (EMMC_IRPT_EN, 0);
+
+	m_bDMAInterrupt = TRUE;
+#ifdef NO_BUSY_WAIT
+	m_DMAEvent.Set ();
+#endif
+}
+
+void CEMMCDevice::InterruptStub (void *pParam)
+{
+	CEMMCDevice *pThis = (CEMMCDevice *) pParam;
+	assert (pThis != 0);
+
+	pThis->InterruptHandler ();
+}
+
+#endif
+
 #else	// #ifndef USE_SDHOST
 
 void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
@@ -2323,6 +2532,36 @@ int CEMMCDevice::DoDataCommand (int is_write, u8 *buf, size_t buf_size, u32 bloc
 	}
 	m_buf = buf;
 
+#ifdef EMMC_USE_DMA
+	// DMA requires a buffer in the DMA memory window, which is cache-aligned for reads
+	u8 *pDMABuffer = 0;
+	if (m_pADMA2Table != 0)
+	{
+		m_bDMATransfer = TRUE;
+
+		if (   (uintptr) buf < m_nDMAMemoryStart
+		    || (uintptr) buf + buf_size > m_nDMAMemoryEnd
+		    || ((uintptr) buf & 3) != 0
+		    || (!is_write && !IS_CACHE_ALIGNED (buf, buf_size)))
+		{
+			pDMABuffer = new (HEAP_DMA30) u8[buf_size];
+			if (pDMABuffer != 0)
+			{
+				if (is_write)
+				{
+					memcpy (pDMABuffer, buf, buf_size);
+				}
+
+				m_buf = pDMABuffer;
+			}
+			else
+			{
+				m_bDMATransfer = FALSE;		// fall back to PIO
+			}
+		}
+	}
+#endif
+
 	// Decide on the command to use
 	int command;
 	if (is_write)
@@ -2372,6 +2611,21 @@ int CEMMCDevice::DoDataCommand (int is_write, u8 *buf, size_t buf_size, u32 bloc
 		}
 	}
 
+#ifdef EMMC_USE_DMA
+	m_bDMATransfer = FALSE;
+
+	if (pDMABuffer != 0)
+	{
+		if (   !is_write
+		    && retry_count < max_retries)
+		{
+			memcpy (buf, pDMABuffer, buf_size);
+		}
+
+		delete [] pDMABuffer;
+	}
+#endif
+
 	if (retry_count == max_retries)
 	{
 		m_card_rca = CARD_RCA_INVALID;
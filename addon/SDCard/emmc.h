@@ -30,6 +30,7 @@
 #define _SDCard_emmc_h
 
 #include <circle/device.h>
+#include <circle/blockrequestqueue.h>
 #include <circle/interrupt.h>
 #include <circle/timer.h>
 #include <circle/actled.h>
@@ -40,6 +41,9 @@
 #include <circle/sysconfig.h>
 #ifdef USE_SDHOST
 	#include <SDCard/sdhost.h>
+#else
+	#include <circle/sched/synchronizationevent.h>
+	#include <circle/macros.h>
 #endif
 
 struct TSCR			// SD configuration register
@@ -49,6 +53,18 @@ struct TSCR			// SD configuration register
 	int	sd_version;
 };
 
+#ifndef USE_SDHOST
+
+struct TEMMCADMA2Descriptor	// 32-bit address
+{
+	u16	nAttributes;
+	u16	nLength;		// 0 is 65536 bytes
+	u32	nAddress;
+}
+PACKED;
+
+#endif
+
 class CEMMCDevice : public CDevice
 {
 public:
@@ -64,9 +80,15 @@ public:
 
 	u64 Seek (u64 ullOffset);
 
+	boolean SubmitRequest (CBlockRequest *pRequest);
+
 	const u32 *GetID (void);
 
 private:
+	int Transfer (TBlockRequestType Type, void *pBuffer, size_t nCount, u64 ullOffset);
+	static int TransferHandler (TBlockRequestType Type, void *pBuffer, size_t nCount,
+				    u64 ullOffset, void *pParam);
+
 #ifndef USE_SDHOST
 	int PowerOn (void);
 	void PowerOff (void);
@@ -83,6 +105,11 @@ private:
 #ifndef USE_SDHOST
 	void HandleCardInterrupt (void);
 	void HandleInterrupts (void);
+
+	void SetupDMA (void);
+	boolean WaitForDMA (unsigned usec);
+	void InterruptHandler (void);
+	static void InterruptStub (void *pParam);
 #endif
 	boolean IssueCommand (u32 command, u32 argument, int timeout = 500000);
 
@@ -116,12 +143,24 @@ private:
 
 	u64 m_ullOffset;
 
+	CBlockRequestQueue m_RequestQueue;
+
 	CPartitionManager *m_pPartitionManager;
 
 #ifdef USE_SDHOST
 	CSDHOSTDevice m_Host;
 #else
 	u32 m_hci_ver;
+
+	TEMMCADMA2Descriptor *m_pADMA2Table;	// 0 if DMA is not used
+	uintptr m_nDMAMemoryStart;		// ARM-side memory window of the EMMC2
+	uintptr m_nDMAMemoryEnd;
+	u32 m_nDMABusAddress;			// bus address of m_nDMAMemoryStart
+	boolean m_bDMATransfer;			// next data command uses DMA
+	volatile boolean m_bDMAInterrupt;
+#ifdef NO_BUSY_WAIT
+	CSynchronizationEvent m_DMAEvent;
+#endif
 #endif
 
 	// was: struct emmc_block_dev
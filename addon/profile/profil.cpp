@@ -68,7 +68,7 @@ profil_count (uintptr_t pc)
 void __profil_counter (void)
 {
   if (samples != NULL)
-    profil_count (IRQReturnAddress);
+    profil_count (IRQReturnAddress[0]);
 }
 
 #endif
@@ -5,7 +5,7 @@
 //	Copyright (C) 2021  Stephane Damo
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -25,7 +25,9 @@
 
 #include <circle/screen.h>
 #include <circle/chargenerator.h>
+#include <circle/types.h>
 
+#define C2DGRAPHICS_MAX_DIRTY_RECTS	16	// more rects are merged into existing ones
 
 class C2DGraphics /// Software graphics library with VSync and hardware-accelerated double buffering
 {
@@ -144,6 +146,30 @@ public:
 	/// \param PixelBuffer Pointer to the pixels
 	/// \param TransparentColor Color to use for transparency
 	void DrawImageRectTransparent (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, TScreenColor *PixelBuffer, TScreenColor TransparentColor);
+
+	/// \brief Draws an image from a pixel buffer, blended with the screen contents
+	/// \param nX Image X coordinate
+	/// \param nY Image Y coordinate
+	/// \param nWidth Image width
+	/// \param nHeight Image height
+	/// \param PixelBuffer Pointer to the pixels
+	/// \param uchAlpha Opacity of the image (0: invisible, 255: opaque)
+	/// \note With DEPTH 8 the image is drawn opaque, if uchAlpha >= 128, and not at all otherwise.
+	void DrawImageBlended (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, TScreenColor *PixelBuffer, u8 uchAlpha);
+
+	/// \brief Draws an area of an image from a pixel buffer, blended with the screen contents
+	/// \param nX Image X coordinate
+	/// \param nY Image Y coordinate
+	/// \param nWidth Image width
+	/// \param nHeight Image height
+	/// \param nSourceX Source X coordinate in the pixel buffer
+	/// \param nSourceY Source Y coordinate in the pixel buffer
+	/// \param nSourceWidth Source image width
+	/// \param nSourceHeight Source image height
+	/// \param PixelBuffer Pointer to the pixels
+	/// \param uchAlpha Opacity of the image (0: invisible, 255: opaque)
+	/// \note With DEPTH 8 the image is drawn opaque, if uchAlpha >= 128, and not at all otherwise.
+	void DrawImageRectBlended (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, TScreenColor *PixelBuffer, u8 uchAlpha);
 	
 	/// \brief Draws a single pixel. If you need to draw a lot of pixels, consider using GetBuffer() for better speed
 	/// \param nX Pixel X coordinate
@@ -162,14 +188,36 @@ public:
 	void DrawText (unsigned nX, unsigned nY, TScreenColor Color, const char *pText, TTextAlign Align = AlignLeft);
 
 	/// \brief Gets raw access to the drawing buffer
+	/// \param bMarkDirty Does the caller report modified areas using MarkDirty()?
 	/// \return Pointer to the buffer
-	TScreenColor *GetBuffer ();
+	/// \note Without VSync the whole screen is copied on each UpdateDisplay() from now on,\n
+	///	  unless bMarkDirty is TRUE. The pointer remains valid until Resize().
+	TScreenColor *GetBuffer (boolean bMarkDirty = FALSE);
+
+	/// \brief Reports an area, which has been modified using the raw buffer
+	/// \param nX Start X coordinate
+	/// \param nY Start Y coordinate
+	/// \param nWidth Area width
+	/// \param nHeight Area height
+	/// \note Only required without VSync, after GetBuffer (TRUE) has been called
+	void MarkDirty (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight);
 	
 	/// \brief Once everything has been drawn, updates the display to show the contents on screen
 	/// \brief If VSync is enabled, this method is blocking until the screen refresh signal is received (every 16ms for 60FPS refresh rate)
+	/// \note Without VSync only the areas, which have been drawn since the last call, are copied.
 	void UpdateDisplay();
 
 private:
+	void AddDirtyRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight);
+	void CopyDirtyRects (void);
+
+private:
+	struct TDirtyRect
+	{
+		unsigned nX1, nY1;	// top left corner
+		unsigned nX2, nY2;	// bottom right corner (exclusive)
+	};
+
 	unsigned m_nWidth;
 	unsigned m_nHeight;
 	unsigned m_nDisplay;
@@ -178,6 +226,14 @@ private:
 	TScreenColor *m_Buffer;
 	boolean m_bVSync;
 	boolean m_bBufferSwapped;
+	boolean m_bRawAccess;			// copy whole screen, GetBuffer() was called
+
+	TDirtyRect m_DirtyRect[C2DGRAPHICS_MAX_DIRTY_RECTS];	// not used with VSync
+	unsigned m_nDirtyRects;
+
+#ifdef SCREEN_DMA_BURST_LENGTH
+	CDMAChannel m_DMAChannel;
+#endif
 
 	CCharGenerator m_Font;
 };
@@ -2,7 +2,7 @@
 // alloc.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -34,6 +34,9 @@ void *calloc (size_t nBlocks, size_t nSize);
 void *realloc (void *pBlock, size_t nSize);
 
 void *palloc (void);			// returns aligned page (AArch32: 4K, AArch64: 64K)
+// returns physically contiguous pages, aligned to nAlign (0 for page size) and to
+// nSize rounded up to a power of 2 pages, to be freed with pfree()
+void *palloc_contiguous (size_t nSize, size_t nAlign);
 void pfree (void *pPage);
 
 #ifdef __cplusplus
@@ -2,7 +2,7 @@
 // armv8mmu.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -122,6 +122,9 @@ struct TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR
 PACKED;
 
 #define ARMV8MMU_LEVEL3_PAGE_SIZE	0x10000
+
+// number of adjacent page descriptors, which can be marked as contiguous (2MB)
+#define ARMV8MMU_LEVEL3_CONTIGUOUS_ENTRIES	32
 #define ARMV8MMUL3PAGEADDR(addr)	(((addr) >> 16) & 0xFFFFFFFF)
 #define ARMV8MMUL3PAGEPTR(page)		((void *) ((page) << 16))
 
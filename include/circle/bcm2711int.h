@@ -2,7 +2,7 @@
 // bcm2711int.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,6 +29,10 @@
 // IRQs
 #define ARM_IRQLOCAL0_CNTPNS	GIC_PPI (14)
 
+#define ARM_IRQ_PMU0		GIC_SPI (16)	// one for each core
+#define ARM_IRQ_PMU1		GIC_SPI (17)
+#define ARM_IRQ_PMU2		GIC_SPI (18)
+#define ARM_IRQ_PMU3		GIC_SPI (19)
 #define ARM_IRQ_ARM_DOORBELL_0	GIC_SPI (34)
 #define ARM_IRQ_TIMER1		GIC_SPI (65)
 #define ARM_IRQ_USB		GIC_SPI (73)
@@ -53,6 +57,7 @@
 #define ARM_IRQ_GPIO1		GIC_SPI (114)
 #define ARM_IRQ_GPIO2		GIC_SPI (115)
 #define ARM_IRQ_GPIO3		GIC_SPI (116)
+#define ARM_IRQ_I2C		GIC_SPI (117)
 #define ARM_IRQ_UART		GIC_SPI (121)
 #define ARM_IRQ_ARASANSDIO	GIC_SPI (126)
 #define ARM_IRQ_PCIE_HOST_INTA	GIC_SPI (143)
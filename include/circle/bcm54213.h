@@ -8,7 +8,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #define _circle_bcm54213_h
 
 #include <circle/netdevice.h>
+#include <circle/net/netbuffer.h>
 #include <circle/macaddress.h>
 #include <circle/timer.h>
 #include <circle/spinlock.h>
@@ -38,6 +39,7 @@ struct TGEnetCB				// buffer control block
 {
 	uintptr		bd_addr;	// address of HW buffer descriptor
 	u8		*buffer;	// pointer to frame buffer (DMA address)
+	CNetBuffer	*net_buffer;	// Rx: net buffer, which contains the frame buffer
 };
 
 struct TGEnetTxRing			// ring of Tx buffers
@@ -66,6 +68,7 @@ struct TGEnetRxRing			// ring of Rx buffers
 	unsigned	cb_ptr;		// Rx ring initial CB ptr
 	unsigned	end_ptr;	// Rx ring end CB ptr
 	unsigned	old_discards;
+	unsigned	pending_bds;	// # of processed bds, not returned to HW yet
  	void		(*int_enable)(TGEnetRxRing *);
 };
 
@@ -79,6 +82,9 @@ public:
 
 	const CMACAddress *GetMACAddress (void) const;
 
+	// zero-copy Rx and Rx checksum offload are supported
+	u32 GetFeatures (void);
+
 	// returns TRUE if TX ring has currently free buffers
 	boolean IsSendFrameAdvisable (void);
 
@@ -87,6 +93,12 @@ public:
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
 
+	// hands over the Rx DMA buffer, the caller has to release it
+	boolean ReceiveFrameBuffer (CNetBuffer **ppBuffer);
+
+	// handler is called on Rx and Tx DMA completion
+	boolean RegisterEventHandler (TNetDeviceEventHandler *pHandler, void *pParam);
+
 	// returns TRUE if PHY link is up
 	boolean IsLinkUp (void);
 
@@ -111,6 +123,8 @@ private:
 	static void tx_ring16_int_enable(TGEnetTxRing *ring);
 	static void tx_ring_int_enable(TGEnetTxRing *ring);
 	static void rx_ring16_int_enable(TGEnetRxRing *ring);
+	static void rx_ring_int_enable(TGEnetRxRing *ring);
+	void rx_intr_reenable(void);
 
 	// address and mode setting
 	int set_hw_addr(void);
@@ -119,6 +133,12 @@ private:
 
 	// HW filter block
 	void hfb_init(void);
+	void hfb_add_filter(unsigned f_index, const u8 *pattern, const u8 *mask,
+			    unsigned length, unsigned rx_ring);
+	void hfb_setup(void);
+
+	// Rx checksum offload
+	void set_rx_csum(bool enable);
 
 	// net enable and start
 	void netif_start(void);
@@ -140,8 +160,11 @@ private:
 	int init_rx_ring(unsigned index, unsigned size, unsigned start_ptr, unsigned end_ptr);
 	int alloc_rx_buffers(TGEnetRxRing *ring);
 	void free_rx_buffers(void);
-	u8 *rx_refill(TGEnetCB *cb);
-	u8 *free_rx_cb(TGEnetCB *cb);
+	CNetBuffer *rx_refill(TGEnetCB *cb);
+	CNetBuffer *free_rx_cb(TGEnetCB *cb);
+	boolean rx_poll(CNetBuffer **ppBuffer, void *pBuffer, unsigned *pResultLength);
+	boolean rx_ring_poll(TGEnetRxRing *ring, CNetBuffer **ppBuffer,
+			     void *pBuffer, unsigned *pResultLength);
 
 	// Helpers
 	void dmadesc_set(uintptr d, u8 *addr, u32 value);
@@ -176,6 +199,9 @@ private:
 	CMACAddress m_MACAddress;
 	boolean m_bInterruptConnected;
 
+	TNetDeviceEventHandler *volatile m_pEventHandler;
+	void *m_pEventParam;
+
 	TGEnetCB *m_tx_cbs;				// Tx control blocks
 	TGEnetTxRing m_tx_rings[GENET_DESC_INDEX+1];	// Tx rings
 
@@ -183,6 +209,7 @@ private:
 	TGEnetRxRing m_rx_rings[GENET_DESC_INDEX+1];	// Rx rings
 
 	boolean m_crc_fwd_en;		// has FCS to be removed?
+	boolean m_rx_csum_en;		// is Rx checksum offload enabled?
 
 	// PHY status
 	int m_phy_id;			// probed address of this PHY
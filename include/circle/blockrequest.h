@@ -0,0 +1,105 @@
+//
+// blockrequest.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_blockrequest_h
+#define _circle_blockrequest_h
+
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef NO_BUSY_WAIT
+	#include <circle/sched/synchronizationevent.h>
+#endif
+
+enum TBlockRequestType
+{
+	BlockRequestRead,
+	BlockRequestWrite,
+	BlockRequestUnknown
+};
+
+class CBlockRequest;
+class CBlockRequestQueue;
+
+typedef void TBlockRequestCompletionRoutine (CBlockRequest *pRequest, void *pParam);
+
+class CBlockRequest	/// Asynchronous read or write request to a block device
+{
+public:
+	/// \param Type Read or write request
+	/// \param pBuffer Data buffer, which must remain valid until completion
+	/// \param nCount Number of bytes to be transferred (multiple of the block size)
+	/// \param ullOffset Byte offset on the device (multiple of the block size)
+	CBlockRequest (TBlockRequestType Type, void *pBuffer, size_t nCount, u64 ullOffset);
+	~CBlockRequest (void);
+
+	TBlockRequestType GetType (void) const	{ return m_Type; }
+	void *GetBuffer (void) const		{ return m_pBuffer; }
+	size_t GetCount (void) const		{ return m_nCount; }
+	/// \note The offset is relative to the start of the device, after the request\n
+	///	  has been submitted to a partition.
+	u64 GetOffset (void) const		{ return m_ullOffset; }
+	void SetOffset (u64 ullOffset)		{ m_ullOffset = ullOffset; }
+
+	/// \param pRoutine Routine, which is called, when the request has been completed
+	/// \param pParam Parameter handed over to the completion routine
+	/// \note The completion routine may be called from a different task, or before\n
+	///	  CDevice::SubmitRequest() returns. It must not wait for other requests.
+	void SetCompletionRoutine (TBlockRequestCompletionRoutine *pRoutine, void *pParam = 0);
+
+	/// \return Has the request been completed?
+	boolean IsCompleted (void) const	{ return m_bCompleted; }
+	/// \return Number of transferred bytes or < 0 on failure (valid after completion)
+	int GetResult (void) const		{ return m_nResult; }
+
+	/// \brief Wait for the completion of the request
+	/// \return Number of transferred bytes or < 0 on failure
+	/// \note With NO_BUSY_WAIT the calling task is blocked meanwhile, otherwise\n
+	///	  queued requests are executed in the context of the caller.
+	int Wait (void);
+
+	/// \brief Mark the request as completed and call the completion routine
+	/// \param nResult Number of transferred bytes or < 0 on failure
+	/// \note Called by the device driver
+	void Complete (int nResult);
+
+private:
+	TBlockRequestType m_Type;
+	void		*m_pBuffer;
+	size_t		 m_nCount;
+	u64		 m_ullOffset;
+
+	TBlockRequestCompletionRoutine *m_pCompletionRoutine;
+	void		*m_pCompletionParam;
+
+	volatile boolean m_bCompleted;
+	int		 m_nResult;
+
+	// used by CBlockRequestQueue
+	CBlockRequestQueue *m_pQueue;
+	CBlockRequest	*m_pNext;
+	unsigned	 m_nSequence;
+	friend class CBlockRequestQueue;
+
+#ifdef NO_BUSY_WAIT
+	CSynchronizationEvent m_Event;
+#endif
+};
+
+#endif
@@ -0,0 +1,102 @@
+//
+// blockrequestqueue.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_blockrequestqueue_h
+#define _circle_blockrequestqueue_h
+
+#include <circle/blockrequest.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef NO_BUSY_WAIT
+	#include <circle/sched/synchronizationevent.h>
+#endif
+
+/// \param Type Read or write request
+/// \param pBuffer Data buffer
+/// \param nCount Number of bytes to be transferred
+/// \param ullOffset Byte offset on the device
+/// \param pParam Parameter handed over to CBlockRequestQueue::CBlockRequestQueue()
+/// \return Number of transferred bytes or < 0 on failure
+typedef int TBlockTransferHandler (TBlockRequestType Type, void *pBuffer, size_t nCount,
+				   u64 ullOffset, void *pParam);
+
+class CBlockRequestTask;
+
+class CBlockRequestQueue	/// Sorts, merges and executes the requests to a block device
+{
+public:
+	/// \param nBlockSize Block size of the device in bytes
+	/// \param nMaxTransferSize Adjacent requests are merged up to this size in bytes
+	/// \param pHandler Synchronous transfer routine of the device driver
+	/// \param pParam Parameter handed over to the transfer routine
+	CBlockRequestQueue (unsigned nBlockSize, size_t nMaxTransferSize,
+			    TBlockTransferHandler *pHandler, void *pParam = 0);
+	/// \note Pending requests are completed with an error
+	~CBlockRequestQueue (void);
+
+	/// \param pRequest Request to be executed asynchronously
+	/// \return Operation successful? (FALSE for invalid requests)
+	/// \note With NO_BUSY_WAIT the requests are executed by a worker task,\n
+	///	  otherwise when CBlockRequest::Wait() or Flush() is called.
+	boolean Submit (CBlockRequest *pRequest);
+
+	/// \brief Execute a synchronous transfer through the queue
+	/// \return Number of transferred bytes or < 0 on failure
+	int Transfer (TBlockRequestType Type, void *pBuffer, size_t nCount, u64 ullOffset);
+
+	/// \brief Wait until all submitted requests have been completed
+	void Flush (void);
+
+	/// \brief Execute the next (possibly merged) request
+	/// \return FALSE if no request was pending
+	boolean ProcessNext (void);
+
+private:
+	CBlockRequest *GetNext (void);		// returns list of requests to be merged
+	boolean IsBlocked (CBlockRequest *pRequest) const;
+	void Remove (CBlockRequest *pRequest);
+	void Execute (CBlockRequest *pFirst);
+
+	static boolean Overlaps (const CBlockRequest *pRequest1, const CBlockRequest *pRequest2);
+
+private:
+	unsigned m_nBlockSize;
+	size_t m_nMaxTransferSize;
+	TBlockTransferHandler *m_pHandler;
+	void *m_pParam;
+
+	CBlockRequest *m_pList;			// sorted by offset
+	unsigned m_nSequence;
+	u64 m_ullNextOffset;			// for the elevator
+
+	u8 *m_pMergeBuffer;
+
+	CSpinLock m_SpinLock;
+
+#ifdef NO_BUSY_WAIT
+	CBlockRequestTask *m_pTask;
+	CSynchronizationEvent m_Event;		// set on submit
+	CSynchronizationEvent m_IdleEvent;	// set, when the queue is empty
+	friend class CBlockRequestTask;
+#endif
+};
+
+#endif
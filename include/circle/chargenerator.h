@@ -2,7 +2,7 @@
 // chargenerator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -34,6 +34,9 @@ public:
 	
 	boolean GetPixel (char chAscii, unsigned nPosX, unsigned nPosY) const;
 
+	// returns all pixels of one line of a character (bit (GetCharWidth()-1) is the left pixel)
+	u32 GetPixelLine (char chAscii, unsigned nPosY) const;
+
 private:
 	unsigned m_nCharWidth;
 };
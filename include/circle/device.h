@@ -2,7 +2,7 @@
 // device.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_device_h
 
 #include <circle/ptrlist.h>
+#include <circle/blockrequest.h>
 #include <circle/types.h>
 
 class CDevice;
@@ -52,6 +53,13 @@ public:
 	/// \note Supported by block devices only
 	virtual u64 GetSize (void) const;
 
+	/// \param pRequest Read or write request to be executed asynchronously
+	/// \return Operation successful? (FALSE if the request is invalid)
+	/// \note Supported by block devices only
+	/// \note The default implementation executes the request synchronously,\n
+	///	  before this method returns.
+	virtual boolean SubmitRequest (CBlockRequest *pRequest);
+
 	/// \param ulCmd The IOCtl command to invoke
 	/// \param pData Depends on command, used to return command specific data
 	/// \return Zero on success, or error code on failure
@@ -2,7 +2,7 @@
 // dmachannel.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -68,13 +68,32 @@ public:
 			     size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
 			     unsigned nBurstLength = 0);
 
+	// scatter-gather transfer, see CDMAChannel for the description
+	void SetupChain (unsigned nMaxSegments);
+	unsigned AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+			     unsigned nBurstLength = 0, boolean bCached = TRUE);
+	unsigned AddIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ,
+			    boolean bWordWrites = FALSE);
+	unsigned AddIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ);
+	void SetCyclic (boolean bCyclic = TRUE);
+
 	void SetCompletionRoutine (TDMACompletionRoutine *pRoutine, void *pParam);
+	void SetSegmentRoutine (TDMASegmentRoutine *pRoutine, void *pParam);
 
 	void Start (void);
 	boolean Wait (void);		// for synchronous call without completion routine
 	boolean GetStatus (void);
+	void Cancel (void);
+
+	uintptr GetDestinationAddress (void);	// of the running transfer
 
 private:
+	TDMA4ControlBlock *AddSegment (void);
+	void AllocateChain (unsigned nMaxSegments);
+	void ConnectIRQ (void);
+
+	void CompleteSegments (unsigned nEndSegment);
+
 	void InterruptHandler (void);
 	static void InterruptStub (void *pParam);
 
@@ -82,7 +101,12 @@ private:
 	unsigned m_nChannel;
 
 	u8 *m_pControlBlockBuffer;
-	TDMA4ControlBlock *m_pControlBlock;
+	TDMA4ControlBlock *m_pControlBlock;	// array of m_nMaxSegments entries
+	TDMASegmentInfo *m_pSegmentInfo;
+	unsigned m_nMaxSegments;
+	unsigned m_nSegments;
+	unsigned m_nNextSegment;		// next segment to be completed
+	boolean m_bCyclic;
 
 	CInterruptSystem *m_pInterruptSystem;
 	boolean m_bIRQConnected;
@@ -90,10 +114,10 @@ private:
 	TDMACompletionRoutine *m_pCompletionRoutine;
 	void *m_pCompletionParam;
 
-	boolean m_bStatus;
+	TDMASegmentRoutine *m_pSegmentRoutine;
+	void *m_pSegmentParam;
 
-	uintptr m_nDestinationAddress;
-	size_t m_nBufferLength;
+	boolean m_bStatus;
 };
 
 #endif
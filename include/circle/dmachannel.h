@@ -2,7 +2,7 @@
 // dmachannel.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,6 +49,11 @@ PACKED;
 ///	  SetCompletionRoutine() and Start(), and is completed using Wait()
 ///	  or GetStatus() from the completion routine.
 
+/// \note A scatter-gather transfer is initiated using SetupChain(), a number of
+///	  Add*() calls (one per segment), optionally SetCyclic(), SetSegmentRoutine()
+///	  and SetCompletionRoutine() and Start(). The control blocks are linked in
+///	  hardware, so that the segments are transferred without CPU intervention.
+
 class CDMAChannel	/// Platform DMA controller support
 {
 public:
@@ -97,6 +102,64 @@ public:
 			     size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
 			     unsigned nBurstLength = 0);
 
+	/// \brief Prepare a chain of control blocks (scatter-gather transfer)
+	/// \param nMaxSegments Maximum number of segments, which will be added
+	/// \note The segments are added using the Add*() methods afterwards.
+	void SetupChain (unsigned nMaxSegments);
+
+	/// \brief Add a memory copy segment to the chain
+	/// \param pDestination Pointer to the destination buffer
+	/// \param pSource	Pointer to the source buffer
+	/// \param nLength	Number of bytes to be transferred
+	/// \param nBurstLength Number of words to be transferred at once (0 = single transfer)
+	/// \param bCached	Are the destination and source buffers in cached memory regions
+	/// \return Index of the segment in the chain
+	unsigned AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+			     unsigned nBurstLength = 0, boolean bCached = TRUE);
+
+	/// \brief Add an I/O read segment to the chain
+	/// \param pDestination Pointer to the destination buffer
+	/// \param nIOAddress	I/O address to be read from (ARM-side or bus address)
+	/// \param nLength	Number of bytes to be transferred
+	/// \param DREQ		DREQ line for pacing the transfer (see dmacommon.h)
+	/// \param bWordWrites	Write the destination in 32-bit units instead of bursts?
+	/// \return Index of the segment in the chain
+	/// \note With bWordWrites received words are not held back in the DMA engine and
+	///	  GetDestinationAddress() reflects the progress of the transfer.
+	unsigned AddIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ,
+			    boolean bWordWrites = FALSE);
+
+	/// \brief Add an I/O write segment to the chain
+	/// \param nIOAddress	I/O address to be written (ARM-side or bus address)
+	/// \param pSource	Pointer to the source buffer
+	/// \param nLength	Number of bytes to be transferred
+	/// \param DREQ		DREQ line for pacing the transfer (see dmacommon.h)
+	/// \return Index of the segment in the chain
+	unsigned AddIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ);
+
+	/// \brief Link the last segment of the chain back to the first one
+	/// \param bCyclic Repeat the chain until Cancel() is called?
+	/// \note A cyclic transfer requires a segment routine and at least two segments.\n
+	///	  The segment progress is derived from the current control block address,
+	///	  so the segment routines have to be called, before the DMA controller
+	///	  returns to the same segment. A cycle, which is handled one or more full
+	///	  cycles late, is not detected and its segments are not reported again.
+	void SetCyclic (boolean bCyclic = TRUE);
+
+	/// \brief Set routine to be called, when a segment of the chain has been transferred
+	/// \param pRoutine Pointer to the segment routine
+	/// \param pParam   User parameter
+	/// \note The destination buffer of the segment is valid in the routine. The source
+	///	  buffer of the segment can be refilled in the routine of a cyclic transfer.
+	void SetSegmentRoutine (TDMASegmentRoutine *pRoutine, void *pParam);
+
+	/// \brief Stop a running (e.g. cyclic) transfer immediately
+	void Cancel (void);
+
+	/// \return Current destination address of the running transfer (ARM-side address)
+	/// \note Can be used to determine the progress of a cyclic I/O read transfer.
+	uintptr GetDestinationAddress (void);
+
 	/// \brief Set completion routine to be called, when the transfer is finished
 	/// \param pRoutine Pointer to the completion routine
 	/// \param pParam   User parameter
@@ -115,6 +178,12 @@ public:
 	boolean GetStatus (void);
 
 private:
+	TDMAControlBlock *AddSegment (void);
+	void AllocateChain (unsigned nMaxSegments);
+	void ConnectIRQ (void);
+
+	void CompleteSegments (unsigned nEndSegment);
+
 	void InterruptHandler (void);
 	static void InterruptStub (void *pParam);
 
@@ -122,7 +191,12 @@ private:
 	unsigned m_nChannel;
 
 	u8 *m_pControlBlockBuffer;
-	TDMAControlBlock *m_pControlBlock;
+	TDMAControlBlock *m_pControlBlock;	// array of m_nMaxSegments entries
+	TDMASegmentInfo *m_pSegmentInfo;
+	unsigned m_nMaxSegments;
+	unsigned m_nSegments;
+	unsigned m_nNextSegment;		// next segment to be completed
+	boolean m_bCyclic;
 
 	CInterruptSystem *m_pInterruptSystem;
 	boolean m_bIRQConnected;
@@ -130,10 +204,10 @@ private:
 	TDMACompletionRoutine *m_pCompletionRoutine;
 	void *m_pCompletionParam;
 
-	boolean m_bStatus;
+	TDMASegmentRoutine *m_pSegmentRoutine;
+	void *m_pSegmentParam;
 
-	uintptr m_nDestinationAddress;
-	size_t m_nBufferLength;
+	boolean m_bStatus;
 
 #if RASPPI >= 4
 	CDMA4Channel *m_pDMA4Channel;
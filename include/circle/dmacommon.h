@@ -2,7 +2,7 @@
 /// \file dmacommon.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -48,6 +48,17 @@ enum TDREQ
 
 typedef void TDMACompletionRoutine (unsigned nChannel, boolean bStatus, void *pParam);
 
+// called from interrupt context, when a segment of a control block chain has been transferred
+typedef void TDMASegmentRoutine (unsigned nChannel, unsigned nSegment, void *pParam);
+
+struct TDMASegmentInfo			// cache maintenance info for a segment
+{
+	uintptr	nDestinationAddress;	// invalidated after transfer (0 for none)
+	size_t	nDestinationLength;
+	uintptr	nSourceAddress;		// cleaned before transfer (0 for none)
+	size_t	nSourceLength;
+};
+
 //
 // Legacy platform DMA controller
 //
@@ -2,7 +2,7 @@
 // exceptionstub.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_exceptionstub_h
 
 #include <circle/macros.h>
+#include <circle/sysconfig.h>
 #include <circle/types.h>
 
 #ifdef __cplusplus
@@ -147,7 +148,7 @@ PACKED;
 
 extern TFIQData FIQData;
 
-extern uintptr IRQReturnAddress;		// for profiling
+extern uintptr IRQReturnAddress[CORES];	// for profiling, one entry per core
 
 #ifdef __cplusplus
 }
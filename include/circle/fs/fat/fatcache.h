@@ -2,7 +2,7 @@
 // fatcache.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,25 +22,51 @@
 
 #include <circle/fs/fat/fatfsdef.h>
 #include <circle/device.h>
+#include <circle/blockrequest.h>
 #include <circle/genericlock.h>
-#include <circle/synchronize.h>
+#include <circle/types.h>
 
-struct TFATBuffer
+struct TFATBlock;
+
+struct TFATBuffer			// one sector in a cache block
 {
 	unsigned	 nMagic;
-	TFATBuffer	*pNext;
-	TFATBuffer	*pPrev;
 	unsigned	 nSector;
+	unsigned char	*Data;		// FAT_SECTOR_SIZE bytes
+	TFATBlock	*pBlock;
+};
+
+struct TFATBlock			// consecutive sectors, aligned to the data area
+{
+	unsigned	 nMagic;
+	TFATBlock	*pNext;		// LRU list
+	TFATBlock	*pPrev;
+	TFATBlock	*pHashNext;	// hash chain
+	unsigned	 nBlock;	// (first sector + block offset) / sectors per block
 	unsigned	 nUseCount;
-	int		 bDirty;
+	u32		 nValidMask;	// sectors with valid data (bit 0 is first sector)
+	u32		 nDirtyMask;	// sectors to be written back
+	CBlockRequest	*pReadAhead;	// pending read-ahead request (or 0)
+	u32		 nReadAheadMask; // sectors valid after completion of pReadAhead
+	unsigned char	*pData;
+	TFATBuffer	 Sector[FAT_CACHE_MAX_BLOCK_SECTORS];
+};
 
-	DMA_BUFFER (unsigned char, Data, FAT_SECTOR_SIZE);
+struct TFATBlockList
+{
+	TFATBlock *pFirst;
+	TFATBlock *pLast;
 };
 
-struct TFATBufferList
+struct TFATCacheStatistics
 {
-	TFATBuffer *pFirst;
-	TFATBuffer *pLast;
+	unsigned	nHits;		// sector found in cache (or being read ahead)
+	unsigned	nMisses;	// sector had to be read from disk
+	unsigned	nReadAheads;	// blocks read ahead
+	unsigned	nReads;		// read requests to the disk
+	unsigned	nWrites;	// write requests to the disk
+	unsigned	nSectorsRead;
+	unsigned	nSectorsWritten;
 };
 
 class CFATCache
@@ -72,6 +98,26 @@ public:
 	 * Returns: none
 	 */
 	void Flush (void);
+
+	/*
+	 * Set the size of the cache blocks (e.g. to the cluster size),
+	 * all sectors must have been freed before. The blocks are aligned
+	 * to nAlignSector (e.g. the first sector of the data area), so that
+	 * a cluster does not span two blocks.
+	 *
+	 * Params:  nSectors	 Sectors per block (will be limited to FAT_CACHE_MAX_BLOCK_SECTORS)
+	 *	    nAlignSector Sector number, which starts a block
+	 * Returns: Nonzero on success
+	 */
+	int SetBlockSize (unsigned nSectors, unsigned nAlignSector = 0);
+
+	/*
+	 * Get cache statistics
+	 *
+	 * Params:  pStatistics	Statistics will be returned here
+	 * Returns: none
+	 */
+	void GetStatistics (TFATCacheStatistics *pStatistics) const;
 	
 	/*
 	 * Get sector from buffer cache
@@ -101,16 +147,48 @@ public:
 	void MarkDirty (TFATBuffer *pBuffer);
 
 private:
-	void MoveBufferFirst (TFATBuffer *pBuffer);
-	void MoveBufferLast (TFATBuffer *pBuffer);
+	int AllocateBlocks (unsigned nBlockSectors);
+	void FreeBlocks (void);
+
+	TFATBlock *LookupBlock (unsigned nBlock);
+	TFATBlock *GetFreeBlock (unsigned nBlock, boolean bForReadAhead);
+	void InsertHash (TFATBlock *pBlock);
+	void RemoveHash (TFATBlock *pBlock);
+
+	unsigned GetFirstSector (unsigned nBlock) const;	// sector number of index 0
+	unsigned GetFirstIndex (unsigned nBlock) const;		// first existing sector
+	unsigned GetBlockSectors (unsigned nBlock) const;	// end index, limited by partition size
+
+	int ReadSectors (TFATBlock *pBlock, unsigned nIndex, unsigned nCount);
+	int WriteBack (TFATBlock *pBlock);
+	void ReadAhead (unsigned nBlock);
+	int CompleteReadAhead (TFATBlock *pBlock);
+
+	void MoveBlockFirst (TFATBlock *pBlock);
+	void MoveBlockLast (TFATBlock *pBlock);
 
 	void Fault (unsigned nCode);
 
 private:
 	CDevice		*m_pPartition;
-	TFATBufferList	 m_BufferList;
+	unsigned	 m_nPartitionSectors;
+
+	unsigned	 m_nBlockSectors;
+	unsigned	 m_nBlockOffset;	// added to the sector number to get aligned blocks
+	unsigned	 m_nBlocks;
+	TFATBlock	*m_pBlocks;
+	unsigned char	*m_pDataArea;
+
+	TFATBlockList	 m_BlockList;
+
+	TFATBlock	**m_ppHashTable;
+	unsigned	 m_nHashMask;
+
+	unsigned	 m_nLastBlock;		// for detection of sequential access
+
+	TFATCacheStatistics m_Statistics;
 
-	CGenericLock m_BufferListLock;
+	CGenericLock m_BlockListLock;
 	CGenericLock m_DiskLock;
 };
 
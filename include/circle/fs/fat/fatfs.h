@@ -2,7 +2,7 @@
 // fatfs.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -154,6 +154,14 @@ public:
 	*/
 	int FileDelete (const char *pTitle);
 
+	/*
+	* Get buffer cache statistics
+	*
+	* Params:  pStatistics	Pointer to structure to be filled
+	* Returns: none
+	*/
+	void GetCacheStatistics (TFATCacheStatistics *pStatistics) const;
+
 private:
 	CFATCache	m_Cache;
 	CFATInfo	m_FATInfo;
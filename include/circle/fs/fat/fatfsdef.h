@@ -9,9 +9,15 @@
 
 #define FAT_SECTOR_SIZE		512
 
-#define FAT_BUFFERS		100
 #define FAT_FILES		40
 
+#ifndef FAT_CACHE_SIZE
+#define FAT_CACHE_SIZE		0x80000		// size of the buffer cache in bytes
+#endif
+#define FAT_CACHE_MIN_BLOCKS	(FAT_FILES+16)	// cache size is increased, if needed
+#define FAT_CACHE_MAX_BLOCK_SECTORS 32		// cache block is cluster-sized, up to this
+#define FAT_CACHE_READ_AHEAD	2		// blocks read ahead on sequential access
+
 #define FAT_MAX_FILESIZE	0xFFFFFFFF
 
 struct TFATBPBStruct
@@ -2,7 +2,7 @@
 // partition.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,6 +35,10 @@ public:
 
 	u64 Seek (u64 ullOffset);
 
+	u64 GetSize (void) const;
+
+	boolean SubmitRequest (CBlockRequest *pRequest);
+
 private:
 	CDevice *m_pDevice;
 	unsigned m_nFirstSector;
@@ -2,7 +2,7 @@
 // heapallocator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,13 +29,28 @@
 
 //#define HEAP_DEBUG
 
-ASSERT_STATIC (DATA_CACHE_LINE_LENGTH_MAX >= 16);
+ASSERT_STATIC (DATA_CACHE_LINE_LENGTH_MAX >= 32);
 
 #define HEAP_BLOCK_ALIGN	DATA_CACHE_LINE_LENGTH_MAX
 #define HEAP_ALIGN_MASK		(HEAP_BLOCK_ALIGN-1)
 
 #define HEAP_BLOCK_MAX_BUCKETS	20
 
+// Blocks bigger than the largest bucket size are managed by a two-level segregated
+// fit (TLSF) allocator, which coalesces physically adjacent free blocks
+#define HEAP_LARGE_SL_SHIFT	4				// second level: 16 lists per power of 2
+#define HEAP_LARGE_SL_COUNT	(1 << HEAP_LARGE_SL_SHIFT)
+#define HEAP_LARGE_FL_SHIFT	10				// first level: 1 KByte minimum
+#define HEAP_LARGE_FL_COUNT	(31 - HEAP_LARGE_FL_SHIFT)	// up to 2 GByte
+#define HEAP_LARGE_MIN_SIZE	(1U << HEAP_LARGE_FL_SHIFT)
+#define HEAP_LARGE_MAX_SIZE	(1U << 31)
+
+#if defined (ARM_ALLOW_MULTI_CORE) && HEAP_CORE_CACHE_MAX_SIZE > 0
+	#define HEAP_CORE_CACHE
+
+	ASSERT_STATIC (HEAP_CORE_CACHE_BLOCKS >= 2);
+#endif
+
 struct THeapBlockHeader
 {
 	u32			 nMagic;
@@ -45,11 +60,22 @@ struct THeapBlockHeader
 #if AARCH == 32
 	u32			 nPadding;
 #endif
-	u8			 Align[HEAP_BLOCK_ALIGN-16];
+	// used for large blocks only
+	THeapBlockHeader	*pPrevPhys;		// physically preceding block (or 0)
+	THeapBlockHeader	*pPrevFree;		// previous block on free list (or 0)
+	u32			 nFlags;
+#define HEAP_BLOCK_FLAG_FREE	BIT (0)			// large block is on a free list
+#if AARCH == 32
+	u8			 Align[HEAP_BLOCK_ALIGN-28];
+#else
+	u8			 Align[HEAP_BLOCK_ALIGN-36];
+#endif
 	u8			 Data[0];
 }
 PACKED;
 
+ASSERT_STATIC (sizeof (THeapBlockHeader) == HEAP_BLOCK_ALIGN);
+
 struct THeapBlockBucket
 {
 	u32			 nSize;
@@ -60,6 +86,21 @@ struct THeapBlockBucket
 	THeapBlockHeader	*pFreeList;
 };
 
+#ifdef HEAP_CORE_CACHE
+
+struct THeapCoreCache		// free blocks of the small buckets, owned by one core
+{
+	struct
+	{
+		unsigned		 nCount;
+		THeapBlockHeader	*pFreeList;
+	}
+	Bucket[HEAP_BLOCK_MAX_BUCKETS];
+}
+CACHE_ALIGN;		// avoid false sharing between cores
+
+#endif
+
 class CHeapAllocator	/// Allocates blocks from a flat memory region
 {
 public:
@@ -90,14 +131,32 @@ public:
 	void *ReAllocate (void *pBlock, size_t nSize);
 
 	/// \param pBlock Memory block to be freed
-	/// \note Memory space of blocks, which are bigger than the largest bucket size,\n
-	///	  cannot be returned to a free list and is lost.
+	/// \note Blocks, which are bigger than the largest bucket size, are coalesced with\n
+	///	  adjacent free blocks and are returned to the free region, if possible.
 	void Free (void *pBlock);
 
 #ifdef HEAP_DEBUG
+	/// \brief Dumps the bucket usage, the large block fragmentation and the high-water mark
 	void DumpStatus (void);
 #endif
 
+private:
+	// large block allocator (must be called with spin lock acquired)
+	THeapBlockHeader *LargeAllocate (size_t nSize);
+	void LargeFree (THeapBlockHeader *pBlockHeader);
+
+	void LargeInsert (THeapBlockHeader *pBlockHeader);
+	void LargeRemove (THeapBlockHeader *pBlockHeader);
+
+	THeapBlockHeader *NextPhys (THeapBlockHeader *pBlockHeader) const;
+
+	static void LargeMapping (size_t nSize, unsigned *pFL, unsigned *pSL);
+
+#ifdef HEAP_CORE_CACHE
+	void *CacheAllocate (unsigned nBucket);
+	void CacheFree (unsigned nBucket, THeapBlockHeader *pBlockHeader);
+#endif
+
 private:
 	const char	*m_pHeapName;
 	u8		*m_pNext;
@@ -106,6 +165,24 @@ private:
 	THeapBlockBucket m_Bucket[HEAP_BLOCK_MAX_BUCKETS+1];
 	CSpinLock	 m_SpinLock;
 
+	THeapBlockHeader *m_pLast;		// block allocated last from the free region
+	u32		 m_nLargeFLBitmap;
+	u32		 m_nLargeSLBitmap[HEAP_LARGE_FL_COUNT];
+	THeapBlockHeader *m_pLargeFreeList[HEAP_LARGE_FL_COUNT][HEAP_LARGE_SL_COUNT];
+
+#ifdef HEAP_DEBUG
+	u8		*m_pBase;
+	u8		*m_pHighWater;		// maximum of m_pNext
+	size_t		 m_nLargeUsed;		// bytes in allocated large blocks
+	size_t		 m_nLargeMaxUsed;
+	unsigned	 m_nLargeCount;		// number of allocated large blocks
+#endif
+
+#ifdef HEAP_CORE_CACHE
+	unsigned	 m_nCachedBuckets;
+	THeapCoreCache	 m_CoreCache[CORES];
+#endif
+
 	static u32 s_nBucketSize[];
 };
 
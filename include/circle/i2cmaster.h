@@ -2,7 +2,7 @@
 /// \file i2cmaster.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,6 +20,8 @@
 #ifndef _circle_i2cmaster_h
 #define _circle_i2cmaster_h
 
+#include <circle/i2ctransaction.h>
+#include <circle/interrupt.h>
 #include <circle/gpiopin.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
@@ -38,6 +40,16 @@
 /// 4         | GPIO6  GPIO7  | GPIO8  GPIO9  |               | Raspberry Pi 4 only
 /// 5         | GPIO10 GPIO11 | GPIO12 GPIO13 |               | Raspberry Pi 4 only
 /// 6         | GPIO22 GPIO23 |               |               | Raspberry Pi 4 only
+///
+/// With an interrupt system the transactions are queued and the FIFO is serviced from
+/// the interrupt handler (see Submit()). The BSC controllers do not have DREQ lines,
+/// so DMA cannot be used here.
+
+#if RASPPI < 4
+	#define I2C_MASTER_DEVICES	2
+#else
+	#define I2C_MASTER_DEVICES	7
+#endif
 
 // returned by Read/Write as negative value
 #define I2C_MASTER_INALID_PARM	1	///< Invalid parameter
@@ -51,7 +63,11 @@ public:
 	/// \param nDevice   Device number (see: GPIO pin mapping)
 	/// \param bFastMode Use I2C fast mode (400 KHz) or standard mode (100 KHz) otherwise
 	/// \param nConfig   GPIO mapping configuration (see: GPIO pin mapping)
-	CI2CMaster (unsigned nDevice, boolean bFastMode = FALSE, unsigned nConfig = 0);
+	/// \param pInterruptSystem Pointer to interrupt system object (or 0 for polling driver)
+	CI2CMaster (unsigned nDevice, boolean bFastMode = FALSE, unsigned nConfig = 0,
+		    CInterruptSystem *pInterruptSystem = 0);
+
+	/// \note Pending transactions are completed with an error
 
 	~CI2CMaster (void);
 
@@ -85,6 +101,20 @@ public:
 				    const void *pWriteBuffer, unsigned nWriteCount,
 				    void *pReadBuffer, unsigned nReadCount);
 
+	/// \param pTransaction Transaction to be executed asynchronously
+	/// \return Operation successful? (FALSE for invalid parameters)
+	/// \note The transactions are executed one after another in submission order.\n
+	///	  With the polling driver the transaction is executed, before this returns.
+	/// \note With the interrupt driver Read(), Write() and WriteReadRepeatedStart()\n
+	///	  submit a transaction and wait for it, so they must not be called\n
+	///	  from interrupt context or from a completion routine.
+	boolean Submit (CI2CTransaction *pTransaction);
+
+private:
+	void StartTransaction (void);
+	void InterruptHandler (void);
+	static void InterruptStub (void *pParam);
+
 private:
 	unsigned m_nDevice;
 	uintptr  m_nBaseAddress;
@@ -98,7 +128,22 @@ private:
 	unsigned m_nCoreClockRate;
 	unsigned m_nClockSpeed;
 
+	CInterruptSystem *m_pInterruptSystem;
+
+	CI2CTransaction *m_pFirst;		// queue of pending transactions
+	CI2CTransaction *m_pLast;
+	CI2CTransaction *m_pCurrent;		// running transaction
+	const u8 *m_pWriteData;
+	unsigned  m_nWriteCount;		// bytes not yet written to FIFO
+	u8	 *m_pReadData;
+	unsigned  m_nReadCount;			// bytes not yet read from FIFO
+	boolean   m_bTxInterrupt;		// C_INTT enabled
+
 	CSpinLock m_SpinLock;
+
+	static unsigned s_nInterruptUseCount;
+	static CInterruptSystem *s_pInterruptSystem;
+	static CI2CMaster *s_pThis[I2C_MASTER_DEVICES];
 };
 
 #endif
@@ -0,0 +1,97 @@
+//
+// i2ctransaction.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_i2ctransaction_h
+#define _circle_i2ctransaction_h
+
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef NO_BUSY_WAIT
+	#include <circle/sched/synchronizationevent.h>
+#endif
+
+class CI2CTransaction;
+class CI2CMaster;
+
+typedef void TI2CCompletionRoutine (CI2CTransaction *pTransaction, void *pParam);
+
+class CI2CTransaction	/// Asynchronous transaction on an I2C master device
+{
+public:
+	/// \param ucAddress I2C slave address of target device
+	/// \param pWriteBuffer Write data (0 for read only)
+	/// \param nWriteCount Number of bytes to be written (max. 16 if followed by read)
+	/// \param pReadBuffer Read data will be stored here (0 for write only)
+	/// \param nReadCount Number of bytes to be read
+	/// \note If both counts are > 0, the read follows the write with repeated start.
+	/// \note The buffers must remain valid until completion.
+	CI2CTransaction (u8 ucAddress,
+			 const void *pWriteBuffer, unsigned nWriteCount,
+			 void *pReadBuffer = 0, unsigned nReadCount = 0);
+	~CI2CTransaction (void);
+
+	u8 GetAddress (void) const		{ return m_ucAddress; }
+
+	/// \param pRoutine Routine, which is called, when the transaction has been completed
+	/// \param pParam Parameter handed over to the completion routine
+	/// \note The completion routine may be called from interrupt context, or before\n
+	///	  CI2CMaster::Submit() returns. It must not wait for other transactions,\n
+	///	  but may submit new ones.
+	void SetCompletionRoutine (TI2CCompletionRoutine *pRoutine, void *pParam = 0);
+
+	/// \return Has the transaction been completed?
+	boolean IsCompleted (void) const	{ return m_bCompleted; }
+	/// \return Number of read (or written, if write only) bytes or < 0 on failure\n
+	///	    (valid after completion, see i2cmaster.h for error codes)
+	int GetResult (void) const		{ return m_nResult; }
+
+	/// \brief Wait for the completion of the transaction
+	/// \return Number of read (or written, if write only) bytes or < 0 on failure
+	/// \note With NO_BUSY_WAIT the calling task is blocked meanwhile.
+	int Wait (void);
+
+	/// \brief Mark the transaction as completed and call the completion routine
+	/// \param nResult Number of transferred bytes or < 0 on failure
+	/// \note Called by the device driver
+	void Complete (int nResult);
+
+private:
+	u8		 m_ucAddress;
+	const void	*m_pWriteBuffer;
+	unsigned	 m_nWriteCount;
+	void		*m_pReadBuffer;
+	unsigned	 m_nReadCount;
+
+	TI2CCompletionRoutine *m_pCompletionRoutine;
+	void		*m_pCompletionParam;
+
+	volatile boolean m_bCompleted;
+	int		 m_nResult;
+
+	// used by CI2CMaster
+	CI2CTransaction	*m_pNext;
+	friend class CI2CMaster;
+
+#ifdef NO_BUSY_WAIT
+	CSynchronizationEvent m_Event;
+#endif
+};
+
+#endif
@@ -2,7 +2,7 @@
 // machineinfo.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -135,6 +135,10 @@ public:
 	void FetchDTB (void);
 
 	TMemoryWindow GetPCIeDMAMemory (void) const;
+
+	// DMA address window of the EMMC2 controller, depends on the SoC stepping
+	// (B0 or C0) and is taken from the DTB, Size is 0 if the DTB is not available
+	TMemoryWindow GetEMMC2DMAMemory (void) const;
 #endif
 
 	static CMachineInfo *Get (void);
@@ -2,7 +2,7 @@
 // memory.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -143,6 +143,8 @@ public:
 	}
 
 	static void *PageAllocate (void)	{ return s_pThis->m_Pager.Allocate (); }
+	static void *PageAllocate (size_t nSize, size_t nAlign)
+						{ return s_pThis->m_Pager.Allocate (nSize, nAlign); }
 	static void PageFree (void *pPage)	{ s_pThis->m_Pager.Free (pPage); }
 
 	static void DumpStatus (void)
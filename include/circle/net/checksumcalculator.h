@@ -2,7 +2,7 @@
 // checksumcalculator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -47,9 +47,23 @@ public:
 	void SetDestinationAddress (const CIPAddress &rDestIP);
 	
 	u16 Calculate (const void *pBuffer, unsigned nLength);
+	// the sum of the data, which follows the header, is known (e.g. from CopyAndSum())
+	u16 Calculate (const void *pHeader, unsigned nHeaderLength, u32 nDataSum, unsigned nDataLength);
 
 	static u16 SimpleCalculate (const void *pBuffer, unsigned nLength);
 
+	// partial sums (16-bit, not complemented) of data blocks
+	static u32 Sum (const void *pBuffer, unsigned nLength);
+	// copies the data and returns its sum in one pass
+	static u32 CopyAndSum (void *pDest, const void *pSource, unsigned nLength);
+	// adds the sum of a block, which starts at nOffset in the packet
+	static u32 AddSum (u32 nSum, u32 nBlockSum, unsigned nOffset);
+
+	// incremental update of a checksum field according to RFC 1624,
+	// if a field in the packet changes (all values as stored in the packet)
+	static u16 Update (u16 nChecksum, u16 nOldValue, u16 nNewValue);
+	static u16 Update32 (u16 nChecksum, u32 nOldValue, u32 nNewValue);
+
 private:
 	static u32 CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum);
 
@@ -4,7 +4,7 @@
 // Definitions common to HTTP client and server
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -56,7 +56,10 @@ enum THTTPStatus
 	HTTPConnectionReset	  = 550,
 	HTTPInvalidResponseCode	  = 551,
 	HTTPInvalidChunkHeader	  = 552,
-	HTTPContentBufferTooSmall = 553
+	HTTPContentBufferTooSmall = 553,
+
+	// self defined codes (for the server only)
+	HTTPContentNotStreamed	  = 560		// GetContentStream() is not used for this request
 };
 
 #endif
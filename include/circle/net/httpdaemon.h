@@ -2,7 +2,7 @@
 // httpdaemon.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,18 +21,29 @@
 #define _circle_net_httpdaemon_h
 
 #include <circle/sched/task.h>
+#include <circle/sched/semaphore.h>
 #include <circle/net/netsubsystem.h>
 #include <circle/net/http.h>
 #include <circle/net/socket.h>
 #include <circle/net/ipaddress.h>
+#include <circle/netdevice.h>
+#include <circle/string.h>
 #include <circle/types.h>
 
+#define HTTPD_MAX_WORKERS	10		// number of worker tasks
+#define HTTPD_MAX_PENDING	10		// accepted connections waiting for a worker
+
+// The listener creates up to HTTPD_MAX_WORKERS worker tasks on demand, which are kept
+// in a pool and serve one connection after the other. Connections are persistent
+// (HTTP/1.1 keep-alive) and requests can be pipelined by the client. A connection,
+// which is idle for a while, is closed, when other clients are waiting for a worker.
+
 class CHTTPDaemon : public CTask
 {
 public:
 	CHTTPDaemon (CNetSubSystem *pNetSubSystem,
 		     CSocket	   *pSocket	    = 0,	// is 0 for 1st created instance (listener)
-		     unsigned	    nMaxContentSize = 0,	// buffer size for worker
+		     unsigned	    nMaxContentSize = 0,	// buffer size for worker (GetContent())
 		     u16	    nPort	    = HTTP_PORT,
 		     unsigned	    nMaxMultipartSize = 0);	// buffer size for multipart form data
 	~CHTTPDaemon (void);
@@ -50,6 +61,15 @@ public:
 				        unsigned    *pLength,	// in: buffer size, out: content length
 				        const char **ppContentType) = 0; // set this if not "text/html"
 
+	// overwrite this to stream your content of unknown or large size, it is called
+	// before GetContent(), return HTTPContentNotStreamed to use GetContent() instead
+	// call SendContent() to send the content, which uses chunked transfer encoding,
+	// an error status other than HTTPOK can be returned before the first SendContent() only
+	virtual THTTPStatus GetContentStream (const char  *pPath,	// path of the file to be sent
+					      const char  *pParams,	// parameters to GET ("" for none)
+					      const char  *pFormData,	// form data from POST ("" for none)
+					      const char **ppContentType); // set this if not "text/html"
+
 	// overwrite this to implement your own access logging
 	virtual void WriteAccessLog (const CIPAddress	&rRemoteIP,
 				     THTTPRequestMethod	 RequestMethod,
@@ -64,9 +84,29 @@ protected:
 				      const u8	 **ppData,	// returns pointer to part data
 				      unsigned	  *pLength);	// returns part data length
 
+	// sends the next part of the content from GetContentStream() (TRUE on success)
+	// the content type has to be set before the first call
+	boolean SendContent (const void *pData, unsigned nLength);
+
 private:
-	void Listener (void);			// accepts incoming connections and creates worker task
-	void Worker (void);			// processes a connection
+	void Listener (void);			// accepts incoming connections and hands them over to workers
+	void Worker (void);			// processes connections handed over by the listener
+
+	void AddConnection (CSocket *pConnection);	// called by listener
+	CSocket *GetConnection (void);			// called by worker, blocks until available
+
+	void ProcessConnection (void);
+	boolean WaitForRequest (void);			// returns FALSE to close connection
+	boolean ProcessRequest (boolean bKeepAlive);	// returns TRUE to keep connection open
+
+	boolean SendResponse (THTTPStatus Status, const char *pContentType,
+			      const u8 *pContent, unsigned nContentLength);
+	boolean SendStreamHeader (void);
+	void FormatHeader (CString *pHeader, THTTPStatus Status, const char *pContentType,
+			   unsigned nContentLength, boolean bChunked);
+	boolean FlushChunk (boolean bLast);
+
+	static const char *GetStatusMessage (THTTPStatus Status);
 
 	THTTPStatus ParseRequest (void);
 	THTTPStatus ParseMethod (char *pLine);
@@ -82,7 +122,34 @@ private:
 	u16	       m_nPort;
 	unsigned       m_nMaxMultipartSize;
 	
-	u8 *m_pContentBuffer;
+	u8 *m_pContentBuffer;				// with room for the header in front
+
+	CHTTPDaemon *m_pListener;			// the listener (worker only)
+
+	// listener only
+	unsigned m_nWorkers;				// number of created workers
+	unsigned m_nIdleWorkers;			// workers waiting for a connection
+	CSocket *m_pPendingConnection[HTTPD_MAX_PENDING];
+	unsigned m_nPendingIn;
+	unsigned m_nPendingOut;
+	unsigned m_nPendingCount;
+	CSemaphore m_PendingSemaphore;
+
+	// receive buffer, may hold the beginning of the next (pipelined) request
+	u8 m_RxBuffer[FRAME_BUFFER_SIZE];
+	unsigned m_nRxOffset;
+	unsigned m_nRxLength;
+
+	boolean m_bKeepAlive;				// keep connection open after this response
+
+	// streamed content
+	boolean m_bStreamActive;			// GetContentStream() is running
+	boolean m_bStreamHeaderSent;
+	boolean m_bStreamFailed;
+	const char **m_ppStreamContentType;
+	u8 *m_pChunkBuffer;
+	unsigned m_nChunkLength;
+	unsigned m_nStreamLength;			// total content length
 
 	// from request
 	THTTPRequestMethod m_RequestMethod;
@@ -91,6 +158,7 @@ private:
 	char m_RequestPath[HTTP_MAX_PATH+1];		// the path without parameters
 	char m_RequestParams[HTTP_MAX_PARAMS+1];	// the parameters from URI
 
+	boolean m_bConnectionClose;			// "Connection: close" requested
 	boolean m_bRequestFormDataAvailable;		// form data is available
 	unsigned m_nRequestContentLength;		// length of form data from POST request
 	char m_RequestFormData[HTTP_MAX_FORM_DATA+1];	// form data from POST request
@@ -100,8 +168,6 @@ private:
 	unsigned m_nMultipartContentLength;		// total length of multipart form data
 	char *m_pMultipartBuffer;			// pointer to allocated multipart buffer
 	char *m_pMultipartPointer;			// pointer into allocated multipart buffer
-
-	static unsigned s_nInstanceCount;
 };
 
 #endif
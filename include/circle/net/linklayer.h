@@ -2,7 +2,7 @@
 // linklayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #include <circle/net/ipaddress.h>
 #include <circle/macaddress.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/macros.h>
 #include <circle/types.h>
 
@@ -59,6 +60,12 @@ public:
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean Receive (void *pBuffer, unsigned *pResultLength);
 
+	// the Ethernet header is pushed in front of the IP packet, takes over the reference
+	boolean Send (const CIPAddress &rReceiver, CNetBuffer *pNetBuffer);
+
+	// without copying the IP packet, the caller has to release *ppNetBuffer
+	boolean Receive (CNetBuffer **ppNetBuffer);
+
 public:
 	boolean SendRaw (const void *pFrame, unsigned nLength);
 
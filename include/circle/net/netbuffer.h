@@ -0,0 +1,89 @@
+//
+// netbuffer.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_netbuffer_h
+#define _circle_net_netbuffer_h
+
+#include <circle/netdevice.h>
+#include <circle/spinlock.h>
+#include <circle/synchronize.h>
+#include <circle/macros.h>
+#include <circle/types.h>
+
+// space for the Ethernet, IP and TCP headers (with options) in front of the data,
+// must be a multiple of the cache line size, because frames are received with DMA
+#define NET_BUFFER_HEADROOM	128
+
+#define NET_BUFFER_SIZE		(NET_BUFFER_HEADROOM + FRAME_BUFFER_SIZE)
+
+// number of free buffers, which are kept for reuse
+#define NET_BUFFER_POOL_MAX	64
+
+class CNetBuffer	/// Reference counted buffer, which holds one frame (or packet) of the network stack
+{
+public:
+	// the data is initially empty and starts after the headroom
+	CNetBuffer (void);
+
+	void AddRef (void);
+	void Release (void);		// deletes the buffer with the last reference
+
+	u8 *GetData (void)			{ return m_pData; }
+	const u8 *GetData (void) const		{ return m_pData; }
+	unsigned GetLength (void) const		{ return m_nLength; }
+
+	// set length of the data (e.g. after receiving a frame into it)
+	void SetLength (unsigned nLength);
+
+	// prepend nBytes to the data (for a header), returns the new start of data
+	u8 *Push (unsigned nBytes);
+	// remove nBytes from the start of the data (a header), returns the new start of data
+	u8 *Pull (unsigned nBytes);
+	// cut the data to nLength (e.g. to remove padding)
+	void Trim (unsigned nLength);
+
+	// the net device has verified the TCP/UDP checksum of the received frame
+	void SetChecksumVerified (void)		{ m_bChecksumVerified = TRUE; }
+	boolean IsChecksumVerified (void) const	{ return m_bChecksumVerified; }
+
+	// allocate and free from a pool of free buffers
+	void *operator new (size_t nSize);
+	void operator delete (void *pBlock, size_t nSize);
+
+private:
+	~CNetBuffer (void);		// use Release()
+
+private:
+	u8 m_Buffer[NET_BUFFER_SIZE] CACHE_ALIGN;	// must be the first member
+
+	u8	 *m_pData;
+	unsigned  m_nLength;
+	volatile int m_nRefCount;
+	boolean   m_bChecksumVerified;
+
+	CNetBuffer *m_pNext;		// in CNetQueue or in the pool
+	void	   *m_pParam;		// private data of CNetQueue
+	friend class CNetQueue;
+
+	static CNetBuffer *s_pPool;
+	static unsigned s_nPoolCount;
+	static CSpinLock s_PoolSpinLock;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // netconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -44,6 +44,7 @@ public:
 
 	const u8 *GetForeignIP (void) const;
 	u16 GetOwnPort (void) const;
+	u16 GetForeignPort (void) const;
 	int GetProtocol (void) const;
 
 	virtual int Connect (void) = 0;
@@ -60,11 +61,16 @@ public:
 
 	virtual boolean IsConnected (void) const = 0;
 	virtual boolean IsTerminated (void) const = 0;
+
+	// returns TRUE if packets from any foreign endpoint may be accepted
+	// (e.g. listening TCP connection, bound UDP connection)
+	virtual boolean IsWildcard (void) const = 0;
 	
 	virtual void Process (void) = 0;
 
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	virtual int PacketReceived (const void *pPacket, unsigned nLength,
+	// the reference to pNetBuffer remains with the caller, call AddRef() to hold it
+	virtual int PacketReceived (CNetBuffer *pNetBuffer,
 				    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol) = 0;
 
 	// returns: 0: not to me, 1: notification consumed
@@ -83,6 +89,13 @@ protected:
 	int m_nProtocol;
 
 	CChecksumCalculator m_Checksum;
+
+private:
+	friend class CTransportLayer;
+
+	// demultiplexing hash index, maintained by CTransportLayer
+	CNetConnection *m_pHashNext;
+	CNetConnection **m_ppHashBucket;	// 0 if not in index
 };
 
 #endif
@@ -2,7 +2,7 @@
 // netdevlayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,9 +23,12 @@
 #include <circle/net/netconfig.h>
 #include <circle/netdevice.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/bcm54213.h>
 #include <circle/types.h>
 
+#define NET_DEVICE_RX_BUDGET	64		// max. frames received per Process() call
+
 class CNetDeviceLayer
 {
 public:
@@ -42,8 +45,23 @@ public:
 	void Send (const void *pBuffer, unsigned nLength);
 	boolean Receive (void *pBuffer, unsigned *pResultLength);
 
+	// without copying the frame, takes over the reference to pNetBuffer
+	void Send (CNetBuffer *pNetBuffer);
+	// without copying the frame, the caller has to release *ppNetBuffer
+	boolean Receive (CNetBuffer **ppNetBuffer);
+
 	boolean IsRunning (void) const;			// is net device available?
 
+	// does the net device signal events, so that it has not to be polled?
+	boolean IsEventDriven (void) const;
+	// has the Rx budget been exhausted in the last Process() call?
+	boolean IsRxPending (void) const;
+
+private:
+	void AttachDevice (void);
+
+	static void EventHandler (void *pParam);
+
 private:
 	TNetDeviceType m_DeviceType;
 	CNetConfig *m_pNetConfig;
@@ -52,6 +70,12 @@ private:
 	CNetQueue m_TxQueue;
 	CNetQueue m_RxQueue;
 
+	CNetBuffer *m_pRxBuffer;	// next frame will be received into this buffer
+
+	boolean m_bEventDriven;
+	boolean m_bRxPending;
+	boolean m_bNetBuffers;		// device supports ReceiveFrameBuffer()
+
 #if RASPPI >= 4
 	CBcm54213Device m_Bcm54213;
 #endif
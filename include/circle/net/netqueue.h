@@ -2,7 +2,7 @@
 // netqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,11 +20,17 @@
 #ifndef _circle_net_netqueue_h
 #define _circle_net_netqueue_h
 
+#include <circle/net/netbuffer.h>
+#include <circle/ringbuffer.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
-struct TNetQueueEntry;
+// number of net buffers, which can be queued without taking the spin lock
+#define NET_QUEUE_RING_SIZE	64
 
+// Multiple tasks (or cores) may enqueue concurrently, only one may dequeue at a time.
+// Net buffers are passed through a lock-free ring buffer. If it is full, they are
+// appended to an overflow list, which is protected by a spin lock.
 class CNetQueue
 {
 public:
@@ -35,14 +41,23 @@ public:
 	
 	void Flush (void);
 	
+	// copies the data into a new net buffer
 	void Enqueue (const void *pBuffer, unsigned nLength, void *pParam = 0);
 
 	// returns length (0 if queue is empty)
 	unsigned Dequeue (void *pBuffer, void **ppParam = 0);
 
+	// takes over the reference to the net buffer, the data is not copied
+	void Enqueue (CNetBuffer *pNetBuffer, void *pParam = 0);
+
+	// returns length (0 if queue is empty), the caller has to release *ppNetBuffer
+	unsigned Dequeue (CNetBuffer **ppNetBuffer, void **ppParam = 0);
+
 private:
-	volatile TNetQueueEntry *m_pFirst;
-	volatile TNetQueueEntry *m_pLast;
+	CMPSCRingBuffer<CNetBuffer *> m_Ring;
+
+	CNetBuffer * volatile m_pFirst;		// overflow list
+	CNetBuffer *m_pLast;
 
 	CSpinLock m_SpinLock;
 };
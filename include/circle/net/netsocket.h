@@ -2,7 +2,7 @@
 // netsocket.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_net_netsocket_h
 
 #include <circle/net/ipaddress.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/types.h>
 
 class CNetSubSystem;
@@ -104,6 +105,30 @@ public:
 	/// \return Status (0 success, < 0 on error)
 	virtual int SetOptionBroadcast (boolean bAllowed) { return -1; }
 
+	/// \brief Set the size of the send window (send buffer) of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param nBytes Size of the window in bytes (0 for default)
+	/// \return Status (0 success, < 0 on error)
+	virtual int SetOptionSendWindow (unsigned nBytes) { return -1; }
+
+	/// \brief Set the size of the receive window (receive buffer) of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param nBytes Size of the window in bytes (0 for default)
+	/// \return Status (0 success, < 0 on error)
+	/// \note Windows larger than 65535 bytes require the Window Scale option (RFC 7323)
+	virtual int SetOptionReceiveWindow (unsigned nBytes) { return -1; }
+
+	/// \brief Select the congestion control algorithm of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param Algorithm TCPCongestionControlNewReno (default) or TCPCongestionControlCubic
+	/// \return Status (0 success, < 0 on error)
+	virtual int SetOptionCongestionControl (TTCPCongestionControl Algorithm) { return -1; }
+
+	/// \brief Get the counters of a connected TCP socket (e.g. for tuning)
+	/// \param pStatistics Pointer to the structure, which will be filled
+	/// \return Status (0 success, < 0 on error)
+	virtual int GetStatistics (TTCPStatistics *pStatistics) const { return -1; }
+
 	/// \brief Get IP address of connected remote host
 	/// \return Pointer to IP address (four bytes, 0-pointer if not connected)
 	virtual const u8 *GetForeignIP (void) const = 0;
@@ -2,7 +2,7 @@
 // netsubsystem.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -25,11 +25,14 @@
 #include <circle/net/linklayer.h>
 #include <circle/net/networklayer.h>
 #include <circle/net/transportlayer.h>
+#include <circle/sched/synchronizationevent.h>
 #include <circle/string.h>
 #include <circle/types.h>
 
 #define DEFAULT_HOSTNAME	"raspberrypi"
 
+#define NET_IDLE_TIMEOUT_MS	100		// max. time the net task waits for an event
+
 class CDHCPClient;
 
 class CNetSubSystem
@@ -47,6 +50,13 @@ public:
 
 	void Process (void);
 
+	// waits for an event from the net device, a timer or an application,
+	// if the net device supports events, yields otherwise
+	void WaitForWork (void);
+
+	// wakes the net task to call Process() again, can be called from interrupt context
+	void WakeUp (void);
+
 	CNetConfig *GetConfig (void);
 	CNetDeviceLayer *GetNetDeviceLayer (void);
 	CLinkLayer *GetLinkLayer (void);
@@ -68,6 +78,8 @@ private:
 	boolean		m_bUseDHCP;
 	CDHCPClient    *m_pDHCPClient;
 
+	CSynchronizationEvent m_Event;
+
 	static CNetSubSystem *s_pThis;
 };
 
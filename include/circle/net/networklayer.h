@@ -2,7 +2,7 @@
 // networklayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/net/netconfig.h>
 #include <circle/net/linklayer.h>
 #include <circle/net/netqueue.h>
+#include <circle/net/netbuffer.h>
 #include <circle/net/ipaddress.h>
 #include <circle/net/icmphandler.h>
 #include <circle/net/routecache.h>
@@ -79,6 +80,13 @@ public:
 	boolean Receive (void *pBuffer, unsigned *pResultLength,
 			 CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
 
+	// the IP header is pushed in front of the packet, takes over the reference
+	boolean Send (const CIPAddress &rReceiver, CNetBuffer *pNetBuffer, int nProtocol);
+
+	// without copying the packet, the caller has to release *ppNetBuffer
+	boolean Receive (CNetBuffer **ppNetBuffer,
+			 CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol);
+
 	boolean ReceiveNotification (TICMPNotificationType *pType,
 				     CIPAddress *pSender, CIPAddress *pReceiver,
 				     u16 *pSendPort, u16 *pReceivePort,
@@ -2,7 +2,7 @@
 // retransmissionqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 
 #include <circle/types.h>
 
+#define RETRANS_SACK_BLOCKS	8	// maximum number of SACK'ed ranges, which are remembered
+
 class CRetransmissionQueue
 {
 public:
@@ -34,12 +36,26 @@ public:
 	void Write (const void *pBuffer, unsigned nLength);
 
 	unsigned GetBytesAvailable (void) const;
-	void Read (void *pBuffer, unsigned nLength);
-	void Advance (unsigned nBytes);
-	void Reset (void);
+	// returns the partial checksum of the data (see CChecksumCalculator::Sum())
+	u32 Read (void *pBuffer, unsigned nLength);
+	// copy bytes at nOffset from the first unacknowledged byte, without removing them,
+	// returns the number of bytes copied
+	unsigned Peek (void *pBuffer, unsigned nLength, unsigned nOffset) const;
+	void Skip (unsigned nBytes);			// skip bytes, which have not to be sent again
+	void Advance (unsigned nBytes);			// bytes have been acknowledged
+	void Reset (void);				// send all unacknowledged bytes again
 
 	void Flush (void);
 
+	// the following offsets are relative to the first unacknowledged byte
+	void SetSACKed (unsigned nOffset, unsigned nLength);
+	// returns the number of SACK'ed bytes at nOffset (0 if not SACK'ed)
+	unsigned GetSACKed (unsigned nOffset) const;
+	// returns the number of not SACK'ed bytes at nOffset, until the next SACK'ed range
+	unsigned GetNotSACKed (unsigned nOffset) const;
+	// forget all SACK information (e.g. the receiver may have discarded the data)
+	void ClearSACKed (void);
+
 private:
 	unsigned m_nSize;
 
@@ -48,6 +64,14 @@ private:
 	unsigned m_nInPtr;
 	unsigned m_nOutPtr;
 	unsigned m_nPreOutPtr;
+
+	struct TSACKBlock
+	{
+		unsigned nStart;			// offsets relative to m_nOutPtr
+		unsigned nEnd;				// first byte after the range
+	}
+	m_SACKBlock[RETRANS_SACK_BLOCKS];		// sorted by nStart, not overlapping
+	unsigned m_nSACKBlocks;
 };
 
 #endif
@@ -2,7 +2,7 @@
 // retranstimeoutcalc.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -31,6 +31,7 @@ public:
 	~CRetransmissionTimeoutCalculator (void);
 
 	unsigned GetRTO (void) const;
+	unsigned GetSRTT (void) const;		// returns 0, if not measured yet
 
 	void Initialize (u32 nISN);
 
@@ -38,6 +39,7 @@ public:
 	void SegmentAcknowledged (u32 nAcknowledgmentNumber);		// called for valid ACKs only
 
 	void RetransmissionTimerExpired (void);
+	void SegmentRetransmitted (void);	// without timeout (e.g. fast retransmit)
 
 private:
 	void Calculate (unsigned nRTT);
@@ -55,6 +57,7 @@ private:
 	boolean m_bMeasurementRuns;
 	unsigned m_nStartTicks;
 	unsigned m_nRetransmissions;
+	boolean m_bRetransmitted;		// no RTT sample until the next ACK (Karn)
 
 	CSpinLock m_SpinLock;
 };
@@ -2,7 +2,7 @@
 // socket.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -74,7 +74,8 @@ public:
 	/// \param nLength Size of the message buffer in bytes\n
 	/// Should be at least FRAME_BUFFER_SIZE, otherwise data may get lost
 	/// \param nFlags MSG_DONTWAIT (non-blocking operation) or 0 (blocking operation)
-	/// \return Length of received message (0 with MSG_DONTWAIT if no message available, < 0 on error)
+	/// \return Length of received message (0 with MSG_DONTWAIT if no message available\n
+	///	    or if the receive timeout elapsed, < 0 on error)
 	int Receive (void *pBuffer, unsigned nLength, int nFlags);
 
 	/// \brief Send a message to a specific remote host
@@ -104,6 +105,35 @@ public:
 	/// \return Status (0 success, < 0 on error)
 	int SetOptionBroadcast (boolean bAllowed);
 
+	/// \brief Set the size of the send window (send buffer) of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param nBytes Size of the window in bytes (0 for default)
+	/// \return Status (0 success, < 0 on error)
+	int SetOptionSendWindow (unsigned nBytes);
+
+	/// \brief Set the size of the receive window (receive buffer) of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param nBytes Size of the window in bytes (0 for default)
+	/// \return Status (0 success, < 0 on error)
+	/// \note Windows larger than 65535 bytes require the Window Scale option (RFC 7323)
+	int SetOptionReceiveWindow (unsigned nBytes);
+
+	/// \brief Select the congestion control algorithm of a TCP socket,\n
+	/// must be called before Connect() or Listen()
+	/// \param Algorithm TCPCongestionControlNewReno (default) or TCPCongestionControlCubic
+	/// \return Status (0 success, < 0 on error)
+	int SetOptionCongestionControl (TTCPCongestionControl Algorithm);
+
+	/// \brief Set the timeout of a blocking Receive() on a connected TCP socket
+	/// \param nMicroSeconds Timeout in microseconds (0 to wait forever, default)
+	/// \return Status (0 success, < 0 on error)
+	int SetOptionReceiveTimeout (unsigned nMicroSeconds);
+
+	/// \brief Get the counters of a connected TCP socket (e.g. for tuning)
+	/// \param pStatistics Pointer to the structure, which will be filled
+	/// \return Status (0 success, < 0 on error)
+	int GetStatistics (TTCPStatistics *pStatistics) const;
+
 	/// \brief Get IP address of connected remote host
 	/// \return Pointer to IP address (four bytes, 0-pointer if not connected)
 	const u8 *GetForeignIP (void) const;
@@ -121,6 +151,10 @@ private:
 
 	unsigned m_nBackLog;
 	int m_hListenConnection[SOCKET_MAX_LISTEN_BACKLOG];
+
+	unsigned m_nSendWindow;
+	unsigned m_nReceiveWindow;
+	TTCPCongestionControl m_CongestionControl;
 };
 
 #endif
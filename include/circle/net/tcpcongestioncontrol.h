@@ -0,0 +1,109 @@
+//
+// tcpcongestioncontrol.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_tcpcongestioncontrol_h
+#define _circle_net_tcpcongestioncontrol_h
+
+#include <circle/types.h>
+
+enum TTCPCongestionControl
+{
+	TCPCongestionControlNewReno,		// RFC 5681 and RFC 6582
+	TCPCongestionControlCubic,		// RFC 9438
+	TCPCongestionControlUnknown
+};
+
+#define TCP_CONGESTION_CONTROL_DEFAULT	TCPCongestionControlNewReno
+
+struct TTCPStatistics			// counters of a TCP connection
+{
+	unsigned nCongestionWindow;	// cwnd in bytes
+	unsigned nSlowStartThreshold;	// ssthresh in bytes
+	unsigned nSendWindow;		// last window advertised by the peer in bytes
+	unsigned nReceiveWindow;	// own window in bytes
+	unsigned nSendMSS;		// maximum segment size to be sent
+	unsigned nSmoothedRTT;		// in milliseconds (0 if not measured yet)
+	unsigned nRTO;			// retransmission timeout in milliseconds
+
+	u64 nBytesSent;			// payload, without retransmissions
+	u64 nBytesReceived;		// payload, delivered in order
+	unsigned nSegmentsSent;		// including retransmissions and pure ACKs
+	unsigned nSegmentsReceived;
+	unsigned nRetransmissions;	// data segments sent again
+	unsigned nFastRetransmits;	// on the third duplicate ACK
+	unsigned nTimeouts;		// retransmission timer expired
+	unsigned nDuplicateACKs;
+	unsigned nRecoveries;		// fast recovery phases entered
+};
+
+class CTCPCongestionControl	// base class of the TCP congestion control algorithms
+{
+public:
+	CTCPCongestionControl (void);
+	virtual ~CTCPCongestionControl (void);
+
+	// returns 0 if the algorithm is not supported
+	static CTCPCongestionControl *Create (TTCPCongestionControl Algorithm);
+
+	virtual const char *GetName (void) const = 0;
+
+	// call when the connection has been established
+	void Initialize (unsigned nMSS);
+
+	unsigned GetWindow (void) const			{ return m_nCWND; }
+	unsigned GetSlowStartThreshold (void) const	{ return m_nSSThresh; }
+
+	// new data has been acknowledged outside of fast recovery
+	void DataAcknowledged (unsigned nBytesAcked);
+
+	// the third duplicate ACK has been received (RFC 5681 section 3.2)
+	void EnterRecovery (unsigned nFlightSize);
+	// another duplicate ACK has been received during fast recovery
+	void DuplicateACK (void);
+	// an ACK, which does not cover the recovery point (RFC 6582 section 3.2 step 5)
+	void PartialACK (unsigned nBytesAcked);
+	// the recovery point has been acknowledged (RFC 6582 section 3.2 step 6)
+	void ExitRecovery (unsigned nFlightSize);
+
+	// the retransmission timer has expired
+	void RetransmissionTimeout (unsigned nFlightSize);
+
+	// the RTT is required by some algorithms, in milliseconds (0 if unknown)
+	void SetRTT (unsigned nRTT)			{ m_nRTT = nRTT; }
+
+protected:
+	// increases m_nCWND by nBytesAcked during congestion avoidance
+	virtual void CongestionAvoidance (unsigned nBytesAcked) = 0;
+
+	// sets m_nSSThresh on loss, m_nCWND still holds the window before the loss
+	virtual void CongestionEvent (unsigned nFlightSize) = 0;
+
+	// ends the current congestion avoidance phase on timeout
+	virtual void Reset (void) {}
+
+protected:
+	unsigned m_nMSS;
+	unsigned m_nCWND;
+	unsigned m_nSSThresh;
+	unsigned m_nRTT;
+
+	unsigned m_nBytesAcked;		// counter for byte counting (RFC 3465)
+};
+
+#endif
@@ -2,7 +2,7 @@
 // tcpconnection.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include <circle/net/netqueue.h>
 #include <circle/net/retransmissionqueue.h>
 #include <circle/net/retranstimeoutcalc.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/sched/synchronizationevent.h>
 #include <circle/timer.h>
 #include <circle/spinlock.h>
@@ -55,19 +56,29 @@ enum TTCPTimer
 	TCPTimerUnknown
 };
 
+#define TCP_MAX_SACK_BLOCKS	4		// SACK blocks in one segment (without timestamps)
+#define TCP_MAX_OUT_OF_ORDER	32		// segments received out of order, which are kept
+
 struct TTCPHeader;
 
 class CTCPConnection : public CNetConnection
 {
 public:
+	// nSendWindow and nReceiveWindow are the buffer sizes in bytes (0 for default)
 	CTCPConnection (CNetConfig	*pNetConfig,		// active OPEN
 			CNetworkLayer	*pNetworkLayer,
 			CIPAddress	&rForeignIP,
 			u16		 nForeignPort,
-			u16		 nOwnPort);
+			u16		 nOwnPort,
+			unsigned	 nSendWindow = 0,
+			unsigned	 nReceiveWindow = 0,
+			TTCPCongestionControl CongestionControl = TCP_CONGESTION_CONTROL_DEFAULT);
 	CTCPConnection (CNetConfig	*pNetConfig,		// passive OPEN
 			CNetworkLayer	*pNetworkLayer,
-			u16		 nOwnPort);
+			u16		 nOwnPort,
+			unsigned	 nSendWindow = 0,
+			unsigned	 nReceiveWindow = 0,
+			TTCPCongestionControl CongestionControl = TCP_CONGESTION_CONTROL_DEFAULT);
 	~CTCPConnection (void);
 
 	int Connect (void);
@@ -84,11 +95,16 @@ public:
 
 	boolean IsConnected (void) const;
 	boolean IsTerminated (void) const;
+	boolean IsWildcard (void) const;
+
+	void GetStatistics (TTCPStatistics *pStatistics) const;
+
+	void SetOptionReceiveTimeout (unsigned nMicroSeconds);	// 0 for none
 	
 	void Process (void);
 	
 	// returns: -1: invalid packet, 0: not to me, 1: packet consumed
-	int PacketReceived (const void *pPacket, unsigned nLength,
+	int PacketReceived (CNetBuffer *pNetBuffer,
 			    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol);
 
 	// returns: 0: not to me, 1: notification consumed
@@ -100,8 +116,32 @@ public:
 private:
 	boolean SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber = 0,
 			     const void *pData = 0, unsigned nDataLength = 0);
+	// the TCP header is pushed in front of the data, takes over the reference
+	boolean SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
+			     CNetBuffer *pNetBuffer);
+	// nDataSum is the partial checksum of the data (see CChecksumCalculator::Sum())
+	boolean SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
+			     CNetBuffer *pNetBuffer, u32 nDataSum);
+
+	// queue the segment data for the user without copying it
+	void EnqueueData (CNetBuffer *pNetBuffer, unsigned nDataOffset, unsigned nDataLength);
+
+	void QueueOutOfOrder (CNetBuffer *pNetBuffer, u32 nSequence,
+			      unsigned nDataOffset, unsigned nDataLength);
+	boolean DeliverOutOfOrder (void);		// returns TRUE if data has been delivered
+	void FlushOutOfOrder (void);
+	unsigned GetSACKBlocks (u32 *pBlocks);		// returns the number of blocks
 
 	void ScanOptions (TTCPHeader *pHeader);
+	void SetupOptions (void);			// after a SYN has been received
+	void ProcessSACK (void);
+
+	void DuplicateACKReceived (void);
+	void FastRetransmit (void);			// send the first unacknowledged segment again
+	unsigned GetFlightSize (void) const;
+
+	void UpdateReceiveWindow (void);
+	static unsigned GetWindowScale (u32 nWindow);
 	
 	u32 CalculateISN (void);
 	
@@ -124,6 +164,17 @@ private:
 
 	CNetQueue m_TxQueue;
 	CNetQueue m_RxQueue;
+	volatile int m_nRxQueued;		// bytes in m_RxQueue
+	unsigned m_nReceiveTimeout;		// micro seconds (0 for none)
+
+	struct TOutOfOrderSegment
+	{
+		u32	    nSequence;
+		CNetBuffer *pNetBuffer;		// holds the data only
+	}
+	m_OutOfOrder[TCP_MAX_OUT_OF_ORDER];	// sorted by sequence number
+	unsigned m_nOutOfOrder;
+	u32 m_nLastOutOfOrder;			// sequence number of the latest one
 
 	CRetransmissionQueue m_RetransmissionQueue;
 	volatile boolean m_bRetransmit;		// reset m_RetransmissionQueue and send
@@ -158,9 +209,33 @@ private:
 
 	// Other Variables
 	u16 m_nSND_MSS;		// send maximum segment size
+	u32 m_nSND_MAX;		// highest sequence number sent + 1
+	u32 m_nRCV_BUF;		// receive buffer size (maximum receive window)
+
+	unsigned m_nReceiveWindow;		// configured receive buffer size
+
+	// RFC 7323 window scaling
+	unsigned m_nSND_WScale;			// shift count for received windows
+	unsigned m_nRCV_WScale;			// shift count for sent windows
+	boolean m_bPeerWindowScale;		// peer sent Window Scale option in SYN
+	unsigned m_nPeerWScale;
+
+	// RFC 2018 selective acknowledgment
+	boolean m_bSACKPermitted;		// both sides agreed to use SACK
+	boolean m_bPeerSACKPermitted;		// peer sent SACK-Permitted option in SYN
+	u32 m_SACKReceived[TCP_MAX_SACK_BLOCKS * 2];	// left and right edges from last segment
+	unsigned m_nSACKReceived;
 
 	CRetransmissionTimeoutCalculator m_RTOCalculator;
 
+	// congestion control
+	CTCPCongestionControl *m_pCongestionControl;
+	unsigned m_nDupACKs;			// consecutive duplicate ACKs
+	boolean m_bInRecovery;			// in fast recovery
+	u32 m_nRecover;				// RFC 6582 "recover"
+
+	TTCPStatistics m_Statistics;
+
 	static unsigned s_nConnections;
 };
 
@@ -0,0 +1,57 @@
+//
+// tcpcubic.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_tcpcubic_h
+#define _circle_net_tcpcubic_h
+
+#include <circle/net/tcpcongestioncontrol.h>
+#include <circle/timer.h>
+#include <circle/types.h>
+
+class CTCPCubic : public CTCPCongestionControl		// RFC 9438 (without HyStart)
+{
+public:
+	CTCPCubic (void);
+	~CTCPCubic (void);
+
+	const char *GetName (void) const;
+
+private:
+	void CongestionAvoidance (unsigned nBytesAcked);
+	void CongestionEvent (unsigned nFlightSize);
+	void Reset (void);
+
+	// returns W_cubic(t) in bytes, t in milliseconds since start of epoch
+	unsigned GetCubicWindow (unsigned nTime) const;
+
+	static u64 CubeRoot (u64 ulValue);
+
+private:
+	CTimer *m_pTimer;
+
+	boolean m_bEpochStarted;
+	unsigned m_nEpochStart;		// in HZ units
+	unsigned m_nWMax;		// window before the last reduction in bytes (0 if none)
+	unsigned m_nOriginPoint;	// W_max or cwnd at start of epoch
+	unsigned m_nK;			// milliseconds until the origin point is reached
+	unsigned m_nWEst;		// Reno-friendly window in bytes
+	u64 m_ulRemainder;		// fractions of increments, not applied yet
+};
+
+#endif
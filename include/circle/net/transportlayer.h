@@ -2,7 +2,7 @@
 // transportlayer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,12 +24,19 @@
 #include <circle/net/networklayer.h>
 #include <circle/net/netconnection.h>
 #include <circle/net/tcprejector.h>
+#include <circle/net/tcpcongestioncontrol.h>
 #include <circle/net/ipaddress.h>
 #include <circle/net/netqueue.h>
 #include <circle/ptrarray.h>
 #include <circle/spinlock.h>
 #include <circle/types.h>
 
+#define TRANSPORT_HASH_SIZE		256	// must be a power of 2
+#define TRANSPORT_PORT_HASH_SIZE	64	// must be a power of 2
+
+#define TRANSPORT_OWN_PORT_MIN		60000	// range for dynamic port assignment
+#define TRANSPORT_OWN_PORT_MAX		60999
+
 class CTransportLayer
 {
 public:
@@ -44,9 +51,14 @@ public:
 	int Bind (u16 nOwnPort, int nProtocol);
 
 	// nOwnPort may be 0 (dynamic port assignment)
-	int Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, int nProtocol);
-
-	int Listen (u16 nOwnPort, int nProtocol);
+	// nSendWindow, nReceiveWindow and CongestionControl are used for TCP only (0 for default)
+	int Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, int nProtocol,
+		     unsigned nSendWindow = 0, unsigned nReceiveWindow = 0,
+		     TTCPCongestionControl CongestionControl = TCP_CONGESTION_CONTROL_DEFAULT);
+
+	int Listen (u16 nOwnPort, int nProtocol,
+		    unsigned nSendWindow = 0, unsigned nReceiveWindow = 0,
+		    TTCPCongestionControl CongestionControl = TCP_CONGESTION_CONTROL_DEFAULT);
 	int Accept (CIPAddress *pForeignIP, u16 *pForeignPort, int hConnection);
 
 	int Disconnect (int hConnection);
@@ -68,6 +80,27 @@ public:
 	boolean IsConnected (int hConnection) const;
 	const u8 *GetForeignIP (int hConnection) const;		// returns 0 if not connected
 
+	int GetStatistics (TTCPStatistics *pStatistics, int hConnection) const;	// TCP only
+	int SetOptionReceiveTimeout (unsigned nMicroSeconds, int hConnection);	// TCP only
+
+private:
+	// returns TRUE if the packet has been consumed by a connection
+	boolean PacketReceived (CNetBuffer *pNetBuffer, CIPAddress &rSenderIP,
+				CIPAddress &rReceiverIP, int nProtocol);
+
+	// must be called with m_SpinLock acquired
+	void AddConnection (CNetConnection *pConnection);
+	void RemoveConnection (CNetConnection *pConnection);
+
+	// re-hash connection, if its foreign endpoint or listen state has changed
+	void UpdateConnection (CNetConnection *pConnection);
+	CNetConnection **GetHashBucket (CNetConnection *pConnection);
+
+	u16 *GetPortUsers (u16 nOwnPort, int nProtocol);
+
+	static unsigned HashFull (int nProtocol, u16 nOwnPort, u32 nForeignIP, u16 nForeignPort);
+	static unsigned HashPort (int nProtocol, u16 nOwnPort);
+
 private:
 	CNetConfig    *m_pNetConfig;
 	CNetworkLayer *m_pNetworkLayer;
@@ -76,6 +109,14 @@ private:
 	u16 m_nOwnPort;
 	CSpinLock m_SpinLock;
 
+	// connections with known foreign endpoint, hashed by protocol and 4-tuple
+	CNetConnection *m_pFullHash[TRANSPORT_HASH_SIZE];
+	// wildcard connections (listening TCP, bound UDP), hashed by protocol and own port
+	CNetConnection *m_pPortHash[TRANSPORT_PORT_HASH_SIZE];
+
+	// number of connections using a dynamic port, for TCP and UDP
+	u16 m_nPortUsers[2][TRANSPORT_OWN_PORT_MAX-TRANSPORT_OWN_PORT_MIN+1];
+
 	CTCPRejector m_TCPRejector;
 };
 
@@ -2,7 +2,7 @@
 // netdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,14 @@
 
 #define MAX_NET_DEVICES		5
 
+// features of a net device (returned by GetFeatures())
+#define NET_DEVICE_FEATURE_NET_BUFFER	(1 << 0)	// supports ReceiveFrameBuffer()
+#define NET_DEVICE_FEATURE_RX_CHECKSUM	(1 << 1)	// verifies TCP/UDP checksums of Rx frames
+
+typedef void TNetDeviceEventHandler (void *pParam);
+
+class CNetBuffer;
+
 enum TNetDeviceType
 {
 	NetDeviceTypeEthernet,
@@ -54,6 +62,9 @@ public:
 	/// \return Type of this net device
 	virtual TNetDeviceType GetType (void)		{ return NetDeviceTypeEthernet; }
 
+	/// \return Features of this net device (NET_DEVICE_FEATURE_* bit mask)
+	virtual u32 GetFeatures (void)			{ return 0; }
+
 	/// \return Pointer to a MAC address object, which holds our own address
 	virtual const CMACAddress *GetMACAddress (void) const = 0;
 
@@ -73,6 +84,23 @@ public:
 	/// \return TRUE if a frame is returned in buffer, FALSE if nothing has been received
 	virtual boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength) = 0;
 
+	/// \brief Poll for a received Ethernet frame, without copying it
+	/// \param ppBuffer Pointer to variable, which receives a net buffer holding the frame
+	/// \return TRUE if a frame is returned, FALSE if nothing has been received
+	/// \note The caller has to release the net buffer.
+	/// \note Only supported with the feature NET_DEVICE_FEATURE_NET_BUFFER.
+	virtual boolean ReceiveFrameBuffer (CNetBuffer **ppBuffer)	{ return FALSE; }
+
+	/// \brief Register a handler, which is called, when a frame has been received or sent
+	/// \param pHandler Pointer to the handler (0 to unregister)
+	/// \param pParam User parameter, which is handed over to the handler
+	/// \return FALSE if not supported (device has to be polled then)
+	/// \note The handler may be called from interrupt context.
+	/// \note After a receive event, the handler may not be called again,\n
+	///	  before ReceiveFrame() has returned FALSE once.
+	virtual boolean RegisterEventHandler (TNetDeviceEventHandler *pHandler, void *pParam)
+							{ return FALSE; }
+
 	/// \return TRUE if PHY link is up
 	virtual boolean IsLinkUp (void)			{ return TRUE; }
 
@@ -2,7 +2,7 @@
 // pageallocator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,17 +24,42 @@
 #include <circle/spinlock.h>
 #include <circle/macros.h>
 #include <circle/types.h>
+#include <assert.h>
 
 //#define PAGE_DEBUG
 
+// maximum block size of the buddy allocator is (PAGE_SIZE << PAGE_MAX_ORDER)
+#define PAGE_MAX_ORDER		10
+
+// maximum number of pages in the memory region
+#define PAGE_MAX_PAGES		(PAGE_RESERVE / PAGE_SIZE)
+
+#if defined (ARM_ALLOW_MULTI_CORE) && PAGE_CORE_CACHE_PAGES > 0
+	#define PAGE_CORE_CACHE
+
+	ASSERT_STATIC (PAGE_CORE_CACHE_PAGES >= 2);
+#endif
+
 struct TFreePage
 {
 	u32		 nMagic;
 #define FREEPAGE_MAGIC	0x50474D43
 	TFreePage	*pNext;
+	TFreePage	*pPrev;
 };
 
-class CPageAllocator	/// Allocates aligned pages from a flat memory region
+#ifdef PAGE_CORE_CACHE
+
+struct TPageCoreCache		// free single pages, owned by one core
+{
+	unsigned	 nCount;
+	void		*pPage[PAGE_CORE_CACHE_PAGES];
+}
+CACHE_ALIGN;		// avoid false sharing between cores
+
+#endif
+
+class CPageAllocator	/// Allocates aligned (contiguous) pages from a flat memory region
 {
 public:
 	CPageAllocator (void);
@@ -45,14 +70,20 @@ public:
 	void Setup (uintptr nBase, size_t nSize) NOOPT;
 
 	/// \return Free space of the memory region, which is not allocated by pages
-	/// \note Unused pages on the free list do not count here.
+	/// \note Pages in the per-core caches do not count here.
 	size_t GetFreeSpace (void) const;
 
 	/// \return Pointer to a page with a size of PAGE_SIZE
 	/// \note Resulting page is always aligned to PAGE_SIZE
 	void *Allocate (void);
 
-	/// \param pPage Memory page to be freed
+	/// \param nSize Size of the requested memory block (is rounded up to 2^n pages)
+	/// \param nAlign Alignment of the memory block (power of 2, 0 for PAGE_SIZE)
+	/// \return Pointer to physically contiguous pages, 0 if not available
+	/// \note Resulting block is always aligned to its (rounded up) size too
+	void *Allocate (size_t nSize, size_t nAlign = 0);
+
+	/// \param pPage Memory page (or block of pages) to be freed
 	void Free (void *pPage);
 
 #ifdef PAGE_DEBUG
@@ -60,13 +91,48 @@ public:
 #endif
 
 private:
-	u8		*m_pNext;
-	u8		*m_pLimit;
+	void *AllocateBlock (unsigned nOrder);
+	void FreeBlock (uintptr nPageNumber);
+
+	void InsertFree (uintptr nPageNumber, unsigned nOrder);
+	void RemoveFree (uintptr nPageNumber, unsigned nOrder);
+
+#ifdef PAGE_CORE_CACHE
+	void *CacheAllocate (void);
+	void CacheFree (void *pPage);
+#endif
+
+	TFreePage *GetPage (uintptr nPageNumber) const
+	{
+		return (TFreePage *) (nPageNumber * PAGE_SIZE);
+	}
+
+	u8 &State (uintptr nPageNumber)
+	{
+		return m_PageState[nPageNumber - m_nFirstPage];
+	}
+
+private:
+	uintptr		 m_nFirstPage;		// page numbers (address / PAGE_SIZE)
+	uintptr		 m_nEndPage;
+	size_t		 m_nFreePages;
 #ifdef PAGE_DEBUG
 	unsigned	 m_nCount;
 	unsigned	 m_nMaxCount;
 #endif
-	TFreePage	*m_pFreeList;
+	TFreePage	*m_pFreeList[PAGE_MAX_ORDER+1];		// per order
+
+	// state of each page: order of the block, which starts here (if any)
+	u8		 m_PageState[PAGE_MAX_PAGES];
+#define PAGE_STATE_ORDER_MASK	0x0F
+#define PAGE_STATE_CACHED	0x20	// single page is in a per-core cache
+#define PAGE_STATE_HEAD		0x40	// first page of a block
+#define PAGE_STATE_FREE		0x80	// block is on a free list
+
+#ifdef PAGE_CORE_CACHE
+	TPageCoreCache	 m_CoreCache[CORES];
+#endif
+
 	CSpinLock	 m_SpinLock;
 };
 
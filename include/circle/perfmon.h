@@ -0,0 +1,97 @@
+//
+// perfmon.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_perfmon_h
+#define _circle_perfmon_h
+
+#include <circle/types.h>
+
+enum TPerfEvent
+{
+	PerfEventInstructions,		///< Instructions executed
+	PerfEventL1DCacheAccess,	///< Level 1 data cache accesses
+	PerfEventL1DCacheMiss,		///< Level 1 data cache refills
+	PerfEventL1ICacheMiss,		///< Level 1 instruction cache refills
+	PerfEventL2CacheMiss,		///< Level 2 cache refills (not on Raspberry Pi 1)
+	PerfEventBranches,		///< Branches executed (predicted on ARMv7/ARMv8)
+	PerfEventBranchMiss,		///< Mispredicted branches
+	PerfEventCPUCycles,		///< CPU cycles (not on Raspberry Pi 1)
+	PerfEventUnknown
+};
+
+#define PERF_CYCLE_COUNTER	31	///< Counter index of the cycle counter
+
+/// \note The PMU registers exist once per CPU core. All methods work on the PMU of the core,\n
+///	  on which they are called. Each core, which is measured, has to call Initialize().
+
+class CPerformanceMonitor	/// Driver for the performance monitor unit (PMU) of the ARM CPU
+{
+public:
+	CPerformanceMonitor (void);
+	~CPerformanceMonitor (void);
+
+	/// \brief Enable the PMU of this core, stop and reset all counters
+	void Initialize (void);
+
+	/// \return Number of event counters (0..GetEventCounters()-1), without the cycle counter
+	unsigned GetEventCounters (void) const;
+
+	/// \brief Assign an event to an event counter
+	/// \param nCounter Event counter index
+	/// \param Event Event to be counted
+	/// \return Operation successful? (FALSE, if event is not supported by the CPU)
+	boolean SetEvent (unsigned nCounter, TPerfEvent Event);
+	/// \brief Assign an event number, as defined in the CPU manual, to an event counter
+	/// \param nCounter Event counter index
+	/// \param nEventNumber Event number
+	void SetRawEvent (unsigned nCounter, unsigned nEventNumber);
+
+	/// \brief Start all counters (event counters and cycle counter)
+	void Start (void);
+	/// \brief Stop all counters
+	void Stop (void);
+	/// \brief Set all counters to zero and clear the overflow flags
+	void Reset (void);
+
+	/// \return CPU cycles counted, wraps after 32 bits on AArch32
+	u64 GetCycleCount (void) const;
+	/// \param nCounter Event counter index or PERF_CYCLE_COUNTER (lower 32 bits only)
+	/// \return Events counted
+	u32 GetEventCount (unsigned nCounter) const;
+	/// \param nCounter Event counter index or PERF_CYCLE_COUNTER (lower 32 bits only)
+	/// \param nValue Counter value to be set (counter overflows after 0xFFFFFFFF)
+	void SetEventCount (unsigned nCounter, u32 nValue);
+
+	/// \brief Trigger an interrupt on counter overflow
+	/// \param nCounter Event counter index or PERF_CYCLE_COUNTER
+	/// \param bEnable Enable or disable the interrupt
+	/// \note The interrupt itself has to be connected by the caller.
+	void EnableOverflowInterrupt (unsigned nCounter, boolean bEnable = TRUE);
+	/// \return Overflow flags (bit set for each counter, bit 31 for the cycle counter)
+	u32 GetOverflowStatus (void) const;
+	/// \param nMask Overflow flags to be cleared (as returned by GetOverflowStatus())
+	void ClearOverflowStatus (u32 nMask);
+
+private:
+	unsigned m_nEventCounters;
+
+	static const unsigned s_EventNumber[PerfEventUnknown];
+};
+
+#endif
@@ -0,0 +1,372 @@
+//
+// ringbuffer.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_ringbuffer_h
+#define _circle_ringbuffer_h
+
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <circle/types.h>
+#include <assert.h>
+
+// Lock-free ring buffers with a power-of-two capacity
+//
+// The head (write) and tail (read) indices are free-running counters, which are
+// masked with (capacity-1) to access an item. They are kept in different cache
+// lines, so that producer and consumer on different cores do not interfere.
+// The item type T must be copyable with memcpy().
+//
+// The capacity can be limited to a smaller value (e.g. to bound the latency of
+// a sound queue), the storage is allocated with the next power of two then.
+
+#define RING_BUFFER_PAD		(DATA_CACHE_LINE_LENGTH_MAX - sizeof (unsigned))
+
+template <typename T>
+class CSPSCRingBuffer	/// Ring buffer with one producer and one consumer (no locking)
+{
+public:
+	CSPSCRingBuffer (void)
+	:	m_pBuffer (0), m_nMask (0), m_nLimit (0), m_nHead (0), m_nTail (0)
+	{
+	}
+
+	/// \param nCapacity Maximum number of items in the ring buffer
+	CSPSCRingBuffer (unsigned nCapacity)
+	:	m_pBuffer (0), m_nMask (0), m_nLimit (0), m_nHead (0), m_nTail (0)
+	{
+		Initialize (nCapacity);
+	}
+
+	~CSPSCRingBuffer (void)
+	{
+		delete [] m_pBuffer;
+		m_pBuffer = 0;
+	}
+
+	/// \param nCapacity Maximum number of items in the ring buffer
+	/// \return Operation successful?
+	boolean Initialize (unsigned nCapacity)
+	{
+		assert (m_pBuffer == 0);
+		assert (nCapacity > 0);
+
+		unsigned nSize = 1;
+		while (nSize < nCapacity)
+		{
+			nSize <<= 1;
+		}
+
+		m_pBuffer = new T[nSize];
+		if (m_pBuffer == 0)
+		{
+			return FALSE;
+		}
+
+		m_nMask = nSize-1;
+		m_nLimit = nCapacity;
+
+		return TRUE;
+	}
+
+	/// \return Maximum number of items in the ring buffer
+	unsigned GetCapacity (void) const	{ return m_nLimit; }
+
+	/// \return Number of items in the ring buffer
+	/// \note Can be called from any core, but the result is only a snapshot then.
+	unsigned GetCount (void) const
+	{
+		// load the tail first, so that the head cannot be behind it
+		unsigned nTail = __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE);
+		unsigned nCount = __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE) - nTail;
+
+		// both may have moved on between the loads
+		return nCount <= m_nLimit ? nCount : m_nLimit;
+	}
+
+	/// \return Number of free item slots in the ring buffer
+	unsigned GetFree (void) const		{ return m_nLimit - GetCount (); }
+
+	boolean IsEmpty (void) const		{ return GetCount () == 0 ? TRUE : FALSE; }
+
+	/// \brief Called from the producer only
+	/// \return FALSE if the ring buffer is full
+	boolean Enqueue (const T &Item)
+	{
+		return Enqueue (&Item, 1) == 1 ? TRUE : FALSE;
+	}
+
+	/// \brief Called from the producer only
+	/// \return Number of items enqueued (less than nCount, if the ring buffer is full)
+	unsigned Enqueue (const T *pItems, unsigned nCount)
+	{
+		assert (m_pBuffer != 0);
+
+		unsigned nHead = m_nHead;
+		unsigned nFree = m_nLimit - (nHead - __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE));
+		if (nCount > nFree)
+		{
+			nCount = nFree;
+		}
+
+		CopyIn (m_pBuffer, nHead, pItems, nCount);
+
+		__atomic_store_n (&m_nHead, nHead + nCount, __ATOMIC_RELEASE);
+
+		return nCount;
+	}
+
+	/// \brief Called from the consumer only
+	/// \return FALSE if the ring buffer is empty
+	boolean Dequeue (T *pItem)
+	{
+		return Dequeue (pItem, 1) == 1 ? TRUE : FALSE;
+	}
+
+	/// \brief Called from the consumer only
+	/// \return Number of items dequeued (less than nCount, if not available)
+	unsigned Dequeue (T *pItems, unsigned nCount)
+	{
+		assert (m_pBuffer != 0);
+
+		unsigned nTail = m_nTail;
+		unsigned nAvail = __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE) - nTail;
+		if (nCount > nAvail)
+		{
+			nCount = nAvail;
+		}
+
+		CopyOut (pItems, m_pBuffer, nTail, nCount);
+
+		__atomic_store_n (&m_nTail, nTail + nCount, __ATOMIC_RELEASE);
+
+		return nCount;
+	}
+
+	/// \brief Called from the consumer only, removes all items
+	void Flush (void)
+	{
+		__atomic_store_n (&m_nTail, __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE),
+				  __ATOMIC_RELEASE);
+	}
+
+private:
+	void CopyIn (T *pBuffer, unsigned nIndex, const T *pItems, unsigned nCount)
+	{
+		unsigned nFirst = m_nMask+1 - (nIndex & m_nMask);	// until end of storage
+		if (nFirst > nCount)
+		{
+			nFirst = nCount;
+		}
+
+		memcpy (&pBuffer[nIndex & m_nMask], pItems, nFirst * sizeof (T));
+		memcpy (pBuffer, pItems + nFirst, (nCount - nFirst) * sizeof (T));
+	}
+
+	void CopyOut (T *pItems, const T *pBuffer, unsigned nIndex, unsigned nCount)
+	{
+		unsigned nFirst = m_nMask+1 - (nIndex & m_nMask);
+		if (nFirst > nCount)
+		{
+			nFirst = nCount;
+		}
+
+		memcpy (pItems, &pBuffer[nIndex & m_nMask], nFirst * sizeof (T));
+		memcpy (pItems + nFirst, pBuffer, (nCount - nFirst) * sizeof (T));
+	}
+
+private:
+	T	*m_pBuffer;
+	unsigned m_nMask;
+	unsigned m_nLimit;
+
+	u8	 m_Pad0[DATA_CACHE_LINE_LENGTH_MAX];
+	unsigned m_nHead;			// written by the producer
+	u8	 m_Pad1[RING_BUFFER_PAD];
+	unsigned m_nTail;			// written by the consumer
+	u8	 m_Pad2[RING_BUFFER_PAD];
+};
+
+template <typename T>
+class CMPSCRingBuffer	/// Ring buffer with multiple producers and one consumer (no locking)
+{
+public:
+	CMPSCRingBuffer (void)
+	:	m_pSlots (0), m_nMask (0), m_nHead (0), m_nTail (0)
+	{
+	}
+
+	/// \param nCapacity Maximum number of items in the ring buffer (rounded up to 2^n)
+	CMPSCRingBuffer (unsigned nCapacity)
+	:	m_pSlots (0), m_nMask (0), m_nHead (0), m_nTail (0)
+	{
+		Initialize (nCapacity);
+	}
+
+	~CMPSCRingBuffer (void)
+	{
+		delete [] m_pSlots;
+		m_pSlots = 0;
+	}
+
+	/// \param nCapacity Maximum number of items in the ring buffer (rounded up to 2^n)
+	/// \return Operation successful?
+	boolean Initialize (unsigned nCapacity)
+	{
+		assert (m_pSlots == 0);
+		assert (nCapacity > 0);
+
+		unsigned nSize = 1;
+		while (nSize < nCapacity)
+		{
+			nSize <<= 1;
+		}
+
+		m_pSlots = new TSlot[nSize];
+		if (m_pSlots == 0)
+		{
+			return FALSE;
+		}
+
+		// the sequence number of a slot is equal to the index of the item,
+		// which can be written next into it
+		for (unsigned i = 0; i < nSize; i++)
+		{
+			m_pSlots[i].nSequence = i;
+		}
+
+		m_nMask = nSize-1;
+
+		return TRUE;
+	}
+
+	/// \return Maximum number of items in the ring buffer
+	unsigned GetCapacity (void) const	{ return m_nMask+1; }
+
+	/// \return Number of items in the ring buffer (incl. items, which are currently written)
+	/// \note Can be called from any core, but the result is only a snapshot then.
+	unsigned GetCount (void) const
+	{
+		// load the tail first, so that the head cannot be behind it
+		unsigned nTail = __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE);
+		unsigned nCount = __atomic_load_n (&m_nHead, __ATOMIC_ACQUIRE) - nTail;
+
+		// both may have moved on between the loads
+		return nCount <= m_nMask+1 ? nCount : m_nMask+1;
+	}
+
+	boolean IsEmpty (void) const		{ return GetCount () == 0 ? TRUE : FALSE; }
+
+	/// \brief Can be called from multiple producers concurrently (also from IRQ handlers)
+	/// \return FALSE if the ring buffer is full
+	boolean Enqueue (const T &Item)
+	{
+		return Enqueue (&Item, 1) == 1 ? TRUE : FALSE;
+	}
+
+	/// \brief Can be called from multiple producers concurrently (also from IRQ handlers)
+	/// \return Number of items enqueued (less than nCount, if the ring buffer is full)
+	/// \note The items are enqueued in one contiguous sequence.
+	unsigned Enqueue (const T *pItems, unsigned nCount)
+	{
+		assert (m_pSlots != 0);
+
+		// reserve nCount slots by advancing the head index
+		unsigned nRequested = nCount;
+		unsigned nHead = __atomic_load_n (&m_nHead, __ATOMIC_RELAXED);
+		do
+		{
+			unsigned nFree =   m_nMask+1
+					 - (nHead - __atomic_load_n (&m_nTail, __ATOMIC_ACQUIRE));
+			nCount = nRequested < nFree ? nRequested : nFree;
+			if (nCount == 0)
+			{
+				return 0;
+			}
+		}
+		while (!__atomic_compare_exchange_n (&m_nHead, &nHead, nHead + nCount, true,
+						     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+		// fill and publish the reserved slots
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			TSlot *pSlot = &m_pSlots[(nHead + i) & m_nMask];
+			assert (__atomic_load_n (&pSlot->nSequence, __ATOMIC_ACQUIRE) == nHead + i);
+
+			memcpy (&pSlot->Item, &pItems[i], sizeof (T));
+
+			__atomic_store_n (&pSlot->nSequence, nHead + i + 1, __ATOMIC_RELEASE);
+		}
+
+		return nCount;
+	}
+
+	/// \brief Called from the consumer only
+	/// \return FALSE if the ring buffer is empty
+	/// \note An item, which is currently written by a producer, is not returned yet.
+	boolean Dequeue (T *pItem)
+	{
+		return Dequeue (pItem, 1) == 1 ? TRUE : FALSE;
+	}
+
+	/// \brief Called from the consumer only
+	/// \return Number of items dequeued (less than nCount, if not available)
+	unsigned Dequeue (T *pItems, unsigned nCount)
+	{
+		assert (m_pSlots != 0);
+
+		unsigned nTail = m_nTail;
+
+		unsigned i;
+		for (i = 0; i < nCount; i++)
+		{
+			TSlot *pSlot = &m_pSlots[(nTail + i) & m_nMask];
+			if (__atomic_load_n (&pSlot->nSequence, __ATOMIC_ACQUIRE) != nTail + i + 1)
+			{
+				break;		// not written yet
+			}
+
+			memcpy (&pItems[i], &pSlot->Item, sizeof (T));
+
+			// release slot for the next round
+			__atomic_store_n (&pSlot->nSequence, nTail + i + m_nMask+1, __ATOMIC_RELEASE);
+		}
+
+		__atomic_store_n (&m_nTail, nTail + i, __ATOMIC_RELEASE);
+
+		return i;
+	}
+
+private:
+	struct TSlot
+	{
+		unsigned nSequence;
+		T	 Item;
+	};
+
+	TSlot	*m_pSlots;
+	unsigned m_nMask;
+
+	u8	 m_Pad0[DATA_CACHE_LINE_LENGTH_MAX];
+	unsigned m_nHead;			// written by the producers
+	u8	 m_Pad1[RING_BUFFER_PAD];
+	unsigned m_nTail;			// written by the consumer
+	u8	 m_Pad2[RING_BUFFER_PAD];
+};
+
+#endif
@@ -0,0 +1,111 @@
+//
+// sampleprofiler.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sampleprofiler_h
+#define _circle_sampleprofiler_h
+
+#include <circle/interrupt.h>
+#include <circle/perfmon.h>
+#include <circle/timer.h>
+#include <circle/device.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+extern u8 _start, _etext;
+
+enum TSampleSource
+{
+	SampleSourcePMU,		///< Overflow interrupt of a PMU event counter (not on RPi 1)
+	SampleSourceTimer,		///< High-resolution kernel timer (core 0 only, e.g. in QEMU)
+	SampleSourceUnknown
+};
+
+/// \note With SampleSourcePMU the highest event counter of the PMU is used by the profiler.
+
+class CSampleProfiler	/// Sampling profiler, records a histogram of the interrupted program counter per core
+{
+public:
+	/// \param pInterruptSystem Pointer to the interrupt system object
+	/// \param Source Source of the sample interrupt
+	/// \param nGranularityShift Addresses are recorded in buckets of 2^nGranularityShift bytes
+	/// \param nTextStart Start address of the code to be profiled
+	/// \param nTextEnd End address of the code to be profiled
+	CSampleProfiler (CInterruptSystem *pInterruptSystem,
+			 TSampleSource Source = SampleSourcePMU,
+			 unsigned nGranularityShift = 4,
+			 uintptr nTextStart = (uintptr) &_start,
+			 uintptr nTextEnd = (uintptr) &_etext);
+
+	~CSampleProfiler (void);
+
+	/// \brief Start sampling on the calling core
+	/// \param nPeriod Sample period in CPU cycles (SampleSourcePMU) or microseconds (timer)
+	/// \return Operation successful?
+	/// \note With SampleSourcePMU this has to be called on each core, which should be profiled.
+	boolean Start (unsigned nPeriod);
+	/// \brief Stop sampling on the calling core
+	void Stop (void);
+
+	/// \param nCore Core number (0..CORES-1)
+	/// \return Number of samples taken on this core
+	unsigned GetSamples (unsigned nCore) const;
+	/// \param nCore Core number (0..CORES-1)
+	/// \return Number of samples on this core, which were outside of the profiled code
+	unsigned GetMissed (unsigned nCore) const;
+
+	/// \brief Write the histograms in the "folded stacks" format of the FlameGraph tools,\n
+	///	   one line per address bucket: "core<n>;0x<address> <samples>"
+	/// \param pTarget Device to write to (e.g. serial device)
+	/// \note The addresses can be resolved to function names with addr2line on the host.
+	void Dump (CDevice *pTarget);
+
+private:
+	void Sample (unsigned nCore);
+
+	void PMUInterruptHandler (void);
+	static void PMUInterruptStub (void *pParam);
+
+	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
+
+private:
+	CInterruptSystem *m_pInterruptSystem;
+	TSampleSource	  m_Source;
+	unsigned	  m_nGranularityShift;
+	uintptr		  m_nTextStart;
+	uintptr		  m_nTextEnd;
+	unsigned	  m_nBuckets;
+
+	unsigned	  m_nPeriod;
+
+	CPerformanceMonitor m_PMU;
+	unsigned	  m_nCounter;			// PMU event counter used
+	unsigned	  m_nCoresConnected;
+
+	TKernelTimerHandle m_hTimer;
+
+	u32		 *m_pHistogram[CORES];
+	volatile boolean  m_bActive[CORES];
+	volatile unsigned m_nSamples[CORES];
+	volatile unsigned m_nMissed[CORES];
+
+	CSpinLock	  m_SpinLock;
+};
+
+#endif
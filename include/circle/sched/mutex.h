@@ -2,7 +2,7 @@
 // mutex.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2024  R. Stange <rsta2@o2online.de>
 //
 // This class was developed by:
 //	Brad Robinson <contact@toptensoftware.com>
@@ -36,13 +36,18 @@ public:
 
 	/// \brief Acquire the mutex; task blocks, if another task already acquired the mutex
 	/// \note This mutex can be acquired multiple times by the same task.
+	/// \note The mutex can be used by tasks, which run on different CPU cores.
 	void Acquire (void);
 
 	/// \brief Release the mutex; wake another task, which was waiting for the mutex
 	void Release (void);
 
 private:
-	CTask* m_pOwningTask;
+	static boolean IsReleased (void *pParam);
+
+private:
+	volatile int m_nLocked;
+	CTask* volatile m_pOwningTask;
 	int m_iReentrancyCount;
 	CSynchronizationEvent m_event;
 };
@@ -0,0 +1,57 @@
+//
+// readyqueue.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_readyqueue_h
+#define _circle_sched_readyqueue_h
+
+#include <circle/sched/task.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+class CReadyQueue	/// Per-priority FIFO queues of tasks, which are ready to run
+{
+public:
+	CReadyQueue (void);
+	~CReadyQueue (void);
+
+	/// \param pTask Task to be appended to the queue of its priority
+	/// \note Does nothing, if the task is already queued.
+	void Enqueue (CTask *pTask);
+
+	/// \return Task with the highest priority, which was queued first (0 if empty)
+	CTask *Dequeue (void);
+
+#ifdef SCHED_MULTI_CORE
+	/// \param pCurrent Task, which is currently running on the calling core
+	/// \param bMigratableOnly Regard only tasks, which are not pinned to a core?
+	/// \return Task with the highest priority, which was queued first and which\n
+	///	    is not (still) running on another core (0 if none)
+	CTask *Dequeue (CTask *pCurrent, boolean bMigratableOnly);
+#endif
+
+	/// \return Is no task queued?
+	boolean IsEmpty (void) const		{ return m_nBitmap == 0; }
+
+private:
+	u32    m_nBitmap;			// bit n set: queue for priority n is not empty
+	CTask *m_pHead[TASK_PRIORITIES];
+	CTask *m_pTail[TASK_PRIORITIES];
+};
+
+#endif
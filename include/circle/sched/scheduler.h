@@ -2,7 +2,7 @@
 /// \file scheduler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,14 +21,29 @@
 #define _circle_sched_scheduler_h
 
 #include <circle/sched/task.h>
+#include <circle/sched/readyqueue.h>
+#include <circle/sched/sleepqueue.h>
 #include <circle/spinlock.h>
 #include <circle/device.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
 
+#ifdef SCHED_MULTI_CORE
+	#include <circle/multicore.h>
+
+	#define SCHED_CORES	CORES
+#else
+	#define SCHED_CORES	1
+#endif
+
 typedef void TSchedulerTaskHandler (CTask *pTask);
 
-/// \note This scheduler uses the round-robin policy, without priorities.
+// returns TRUE, if the task does not need to block (any more)
+typedef boolean TSchedulerWakeCondition (void *pParam);
+
+/// \note This scheduler uses the round-robin policy, without priorities,\n
+///	  or strict priorities with the system option SCHED_READY_QUEUES.
+/// \note With the system option SCHED_MULTI_CORE tasks run on all CPU cores.
 
 class CScheduler /// Cooperative non-preemtive scheduler, which controls which task runs at a time
 {
@@ -78,6 +93,14 @@ public:
 	/// \param pTarget Device to be used for output
 	void ListTasks (CDevice *pTarget);
 
+#ifdef SCHED_MULTI_CORE
+	/// \brief Run tasks on the calling secondary CPU core
+	/// \note Call this from CMultiCoreSupport::Run() on the cores 1..CORES-1.\n
+	///	  The calling context becomes the task "coreN", which blocks forever.
+	/// \note Does not return.
+	void RunSecondaryCore (void);
+#endif
+
 	/// \return Pointer to the only scheduler object in the system
 	static CScheduler *Get (void);
 
@@ -92,20 +115,54 @@ private:
 	void AddTask (CTask *pTask);
 	friend class CTask;
 
-	boolean BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds);
+	// blocks, unless pWakeCondition returns TRUE (called with spin lock acquired)
+	boolean BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds,
+			   TSchedulerWakeCondition *pWakeCondition = 0, void *pParam = 0);
 	void WakeTasks (CTask **ppWaitListHead); // can be called from interrupt context
 	friend class CSynchronizationEvent;
 
+	boolean IsRunning (CTask *pTask) const;	// is task the current task of any core?
+
 	void RemoveTask (CTask *pTask);
+#ifndef SCHED_READY_QUEUES
 	unsigned GetNextTask (void); // returns index into m_pTask or MAX_TASKS if no task was found
+#else
+	void ReadyTask (CTask *pTask);		// task may have become ready to run
+	void WakeSleepingTasks (void);		// must be called with spin lock acquired
+	void DeleteTerminatedTasks (void);
+	void FinishTaskSwitch (void);		// must be called after each task switch
+	void EnqueueTask (CTask *pTask);	// must be called with spin lock acquired
+	CTask *DequeueTask (unsigned nCore, CTask *pCurrent); // with spin lock acquired
+#endif
+
+	static unsigned ThisCore (void)
+	{
+#ifdef SCHED_MULTI_CORE
+		return CMultiCoreSupport::ThisCore ();
+#else
+		return 0;
+#endif
+	}
 
 private:
+#ifndef SCHED_READY_QUEUES
 	CTask *m_pTask[MAX_TASKS];
+#else
+	CTask **m_pTask;	// dynamically sized task table
+	unsigned m_nTaskTableSize;
+#endif
 	unsigned m_nTasks;
 
-	CTask *m_pCurrent;
+	CTask *m_pCurrent[SCHED_CORES];
 	unsigned m_nCurrent;	// index into m_pTask
 
+#ifdef SCHED_READY_QUEUES
+	CTask *m_pPrevious[SCHED_CORES];	// task switched away from (until finished)
+	CReadyQueue m_ReadyQueue[SCHED_CORES];
+	CSleepQueue m_SleepQueue;
+	CTask *m_pTerminated;	// list of terminated tasks to be deleted
+#endif
+
 	TSchedulerTaskHandler *m_pTaskSwitchHandler;
 	TSchedulerTaskHandler *m_pTaskTerminationHandler;
 
@@ -2,7 +2,7 @@
 // semaphore.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -35,6 +35,7 @@ public:
 	unsigned GetState (void) const;
 
 	/// \brief Decrement semaphore count; block task, if count is already 0
+	/// \note The semaphore can be used by tasks, which run on different CPU cores.
 	void Down (void);
 
 	/// \brief Increment semaphore count; wake another waiting task, if count was 0
@@ -45,6 +46,9 @@ public:
 	/// \return Operation successful?
 	boolean TryDown (void);
 
+private:
+	static boolean IsAvailable (void *pParam);
+
 private:
 	volatile int m_nCount;
 
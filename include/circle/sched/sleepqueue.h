@@ -0,0 +1,59 @@
+//
+// sleepqueue.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_sleepqueue_h
+#define _circle_sched_sleepqueue_h
+
+#include <circle/sched/task.h>
+#include <circle/ptrarray.h>
+#include <circle/types.h>
+
+class CSleepQueue	/// Min-heap of tasks, which wait for a wake time
+{
+public:
+	CSleepQueue (void);
+	~CSleepQueue (void);
+
+	/// \param pTask Task to be inserted, ordered by its wake ticks
+	void Insert (CTask *pTask);
+
+	/// \param pTask Task to be removed (must be in the queue)
+	void Remove (CTask *pTask);
+
+	/// \param nTicks Current value of the system clock (CTimer::GetClockTicks())
+	/// \return Removed task with the earliest wake ticks, if they have been reached (or 0)
+	CTask *GetExpired (unsigned nTicks);
+
+	/// \return Is no task queued?
+	boolean IsEmpty (void) const		{ return m_Heap.GetCount () == 0; }
+
+private:
+	CTask *Get (unsigned nIndex) const	{ return (CTask *) m_Heap[nIndex]; }
+	void Set (unsigned nIndex, CTask *pTask);
+
+	void SiftUp (unsigned nIndex);
+	void SiftDown (unsigned nIndex);
+
+	static boolean Earlier (CTask *pTask1, CTask *pTask2);
+
+private:
+	CPtrArray m_Heap;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // synchronizationevent.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -56,7 +56,12 @@ public:
 
 private:
 	void Pulse (void);	// wakes all waiting tasks without actually setting the event
+	// blocks the calling task, unless pWakeCondition returns TRUE
+	void WaitUnless (boolean (*pWakeCondition) (void *pParam), void *pParam);
 	friend class CMutex;
+	friend class CSemaphore;
+
+	static boolean IsSet (void *pParam);
 
 private:
 	volatile boolean m_bState;
@@ -2,7 +2,7 @@
 /// task.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -37,6 +37,13 @@ enum TTaskState
 	TaskStateUnknown
 };
 
+#define TASK_PRIORITY_LOWEST	0
+#define TASK_PRIORITY_DEFAULT	3
+#define TASK_PRIORITY_HIGHEST	7
+#define TASK_PRIORITIES		(TASK_PRIORITY_HIGHEST+1)
+
+#define TASK_AFFINITY_ANY	((unsigned) -1)
+
 class CScheduler;
 
 class CTask	/// Overload this class, define the Run() method, and call new on it to start it.
@@ -69,6 +76,24 @@ public:
 	/// \note Callable from other task only
 	void WaitForTermination (void);
 
+	/// \param nPriority Scheduling priority (TASK_PRIORITY_LOWEST..TASK_PRIORITY_HIGHEST)
+	/// \note Priorities are only regarded with the system option SCHED_READY_QUEUES.\n
+	///	  A ready task always runs before ready tasks with a lower priority then.
+	void SetPriority (unsigned nPriority);
+	/// \return Scheduling priority of this task
+	unsigned GetPriority (void) const	{ return m_nPriority; }
+
+	/// \param nCore CPU core, on which this task is allowed to run (0..CORES-1),\n
+	///	   or TASK_AFFINITY_ANY to allow the task to migrate between cores
+	/// \note Only regarded with the system option SCHED_MULTI_CORE. A new task is\n
+	///	  pinned to the core, which created it, by default. Tasks may only be\n
+	///	  allowed to migrate, if they do not use classes, which are not safe for\n
+	///	  concurrent use from multiple cores (see doc/multicore.txt).
+	/// \note The new affinity is applied, when the task is scheduled the next time.
+	void SetAffinity (unsigned nCore);
+	/// \return CPU core, on which this task is allowed to run, or TASK_AFFINITY_ANY
+	unsigned GetAffinity (void) const	{ return m_nAffinity; }
+
 	/// \brief Set a specific name for this task
 	/// \param pName Name string for this task
 	void SetName (const char *pName);
@@ -99,6 +124,8 @@ private:
 	TTaskRegisters *GetRegs (void)		{ return &m_Regs; }
 
 	friend class CScheduler;
+	friend class CReadyQueue;
+	friend class CSleepQueue;
 
 private:
 	void InitializeRegs (void);
@@ -116,6 +143,17 @@ private:
 	void		   *m_pUserData[TASK_USER_DATA_SLOTS];
 	CSynchronizationEvent m_Event;
 	CTask		   *m_pWaitListNext;	// next in list of tasks waiting on an event
+
+	unsigned	    m_nPriority;
+	CTask		   *m_pQueueNext;	// next in ready queue (or list of terminated tasks)
+	unsigned	    m_nQueuePriority;	// priority at the time of enqueuing
+	boolean		    m_bQueued;		// in ready queue?
+	unsigned	    m_nSleepIndex;	// index in sleep queue
+#define TASK_NOT_SLEEPING	((unsigned) -1)
+
+	unsigned	    m_nAffinity;
+	unsigned	    m_nCore;		// core, which runs (or ran) this task last
+	volatile boolean    m_bOnCPU;		// registers have not been saved yet
 };
 
 #endif
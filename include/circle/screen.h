@@ -2,7 +2,7 @@
 // screen.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -148,6 +148,23 @@ struct TScreenStatus
 	boolean		bUpdated;
 };
 
+#ifdef SCREEN_CONSOLE_MODE
+
+struct TScreenCell		// shadow of one character cell
+{
+	char		chChar;
+	TScreenColor	Color;
+	TScreenColor	BackgroundColor;
+};
+
+struct TScreenDirtyRange	// columns of one cell row, which have to be repainted
+{
+	unsigned	nStart;
+	unsigned	nEnd;		// nStart >= nEnd: row is clean
+};
+
+#endif
+
 class CScreenDevice : public CDevice	/// Writing characters to screen
 {
 public:
@@ -189,6 +206,7 @@ public:
 	TScreenStatus GetStatus (void);
 	/// \param Status Screen status previously returned from GetStatus()
 	/// \return FALSE on failure (screen is currently updated and cannot be written)
+	/// \note Not supported with SCREEN_CONSOLE_MODE (returns FALSE)
 	boolean SetStatus (const TScreenStatus &Status);
 #endif
 
@@ -248,6 +266,27 @@ private:
 	void DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TScreenColor Color);
 	void EraseChar (unsigned nPosX, unsigned nPosY);
 	void InvertCursor (void);
+
+	boolean InitializeFrameBuffer (boolean bVirtualHeight);
+
+	TScreenColor *GetPixelAddress (unsigned nPosX, unsigned nPosY);
+	void RenderChar (TScreenColor *pTarget, char chChar, TScreenColor Color,
+			 TScreenColor BackgroundColor, boolean bCursor) MAXOPT;
+
+#ifdef SCREEN_CONSOLE_MODE
+	boolean InitializeConsole (void);
+
+	void SetCell (unsigned nPosX, unsigned nPosY, char chChar,
+		      TScreenColor Color, TScreenColor BackgroundColor);
+	void ClearCells (unsigned nCellRow, unsigned nStart, unsigned nEnd);
+	void SetDirty (unsigned nCellRow, unsigned nStart, unsigned nEnd);
+	void SetCursorDirty (void);
+	unsigned GetCellRow (unsigned nPosY) const;
+
+	void ScrollConsole (void);
+	void UpdateConsole (boolean bTaskLevel);
+	void PaintConsole (void) MAXOPT;
+#endif
 #endif
 
 private:
@@ -266,6 +305,7 @@ private:
 	TScreenColor  	*m_pBuffer;
 	unsigned	 m_nSize;
 	unsigned	 m_nPitch;
+	boolean		 m_bWordAccess;		// render characters with 32-bit writes
 #endif
 	unsigned	 m_nWidth;
 	unsigned	 m_nHeight;
@@ -289,6 +329,18 @@ private:
 	CDMAChannel	 m_DMAChannel;
 #endif
 	CSpinLock	 m_SpinLock;
+
+#ifdef SCREEN_CONSOLE_MODE
+	boolean		 m_bConsoleMode;
+	boolean		 m_bHWScroll;		// scrolling by moving the virtual offset
+	unsigned	 m_nColumns;
+	unsigned	 m_nRows;
+	TScreenCell	*m_pCells;		// m_nRows * m_nColumns, rows are a ring
+	TScreenDirtyRange *m_pDirty;		// one entry per cell row
+	unsigned	 m_nTopRow;		// cell row, which is displayed on top
+	unsigned	 m_nDisplayRow;		// character row in frame buffer shown on top
+	unsigned	 m_nPendingScroll;	// number of rows scrolled since last update
+#endif
 #endif
 };
 
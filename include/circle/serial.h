@@ -2,7 +2,7 @@
 /// \file serial.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <circle/device.h>
 #include <circle/interrupt.h>
+#include <circle/dmachannel.h>
 #include <circle/gpiopin.h>
 #include <circle/spinlock.h>
 #include <circle/sysconfig.h>
@@ -44,6 +45,9 @@
 /// GPIO32/33 and GPIO36/37 can be selected with system option SERIAL_GPIO_SELECT.\n
 /// GPIO0/1 are normally reserved for ID EEPROM.\n
 /// Handshake lines CTS and RTS are not supported.
+///
+/// The interrupt driver for device 0 can optionally transfer the data using DMA
+/// (see Configure()). This reduces the interrupt load at high baud rates.
 
 #if RASPPI < 4
 	#define SERIAL_DEVICES		1
@@ -51,7 +55,7 @@
 	#define SERIAL_DEVICES		6
 #endif
 
-#define SERIAL_BUF_SIZE		2048			// must be a power of 2
+#define SERIAL_BUF_SIZE		2048			// default, must be a power of 2
 #define SERIAL_BUF_MASK		(SERIAL_BUF_SIZE-1)
 
 // serial options
@@ -63,6 +67,16 @@
 #define SERIAL_ERROR_FRAMING	3
 #define SERIAL_ERROR_PARITY	4
 
+struct TSerialStatistics
+{
+	unsigned nFIFOOverruns;		///< Receive FIFO overruns reported by the UART
+	unsigned nBufferOverruns;	///< Characters lost, because the receive buffer was full
+	unsigned nBreaks;		///< Break conditions received
+	unsigned nFramingErrors;	///< Characters received with framing error
+	unsigned nParityErrors;		///< Characters received with parity error
+	unsigned nTxDropped;		///< Characters not sent, because the send buffer was full
+};
+
 class CSerialDevice : public CDevice
 {
 public:
@@ -83,6 +97,14 @@ public:
 		       unsigned nDevice = 0);
 
 	~CSerialDevice (void);
+
+	/// \brief Set buffer sizes and transfer mode, must be called before Initialize()
+	/// \param nRxBufferSize Size of the receive buffer in bytes (must be a power of 2)
+	/// \param nTxBufferSize Size of the send buffer in bytes (must be a power of 2)
+	/// \param bUseDMA Transfer the data using DMA
+	/// \note DMA is used with the interrupt driver for device 0 only and is silently
+	///	  ignored otherwise.
+	void Configure (unsigned nRxBufferSize, unsigned nTxBufferSize, boolean bUseDMA = FALSE);
 #endif
 
 	/// \param nBaudrate Baud rate in bits per second
@@ -121,6 +143,10 @@ public:
 	/// \note Does only work with interrupt driver.
 	void RegisterMagicReceivedHandler (const char *pMagic, TMagicReceivedHandler *pHandler);
 
+	/// \param pStatistics Pointer to buffer, which receives the error statistics
+	/// \note The receive errors are counted with the interrupt driver only.
+	void GetStatistics (TSerialStatistics *pStatistics);
+
 protected:
 	/// \return Number of bytes buffer space available for Write()
 	/// \note Does only work with interrupt driver.
@@ -140,6 +166,17 @@ protected:
 private:
 	boolean Write (u8 uchChar);
 
+	boolean ReceiveChar (u32 nDR);			// returns TRUE, if magic received
+
+	void StartTxDMA (void);
+	void TxDMACompletionHandler (boolean bStatus);
+	static void TxDMACompletionStub (unsigned nChannel, boolean bStatus, void *pParam);
+
+	boolean SyncRxDMA (void);			// returns TRUE, if magic received
+	boolean ReceiveDMA (unsigned nEndPtr);		// returns TRUE, if magic received
+	void RxDMASegmentHandler (unsigned nSegment);
+	static void RxDMASegmentStub (unsigned nChannel, unsigned nSegment, void *pParam);
+
 	void InterruptHandler (void);
 	static void InterruptStub (void *pParam);
 
@@ -157,15 +194,29 @@ private:
 	CGPIOPin m_TxDPin;
 	CGPIOPin m_RxDPin;
 
-	u8 m_RxBuffer[SERIAL_BUF_SIZE];
+	u8 *m_pRxBuffer;
+	unsigned m_nRxBufferMask;
 	volatile unsigned m_nRxInPtr;
 	volatile unsigned m_nRxOutPtr;
 	volatile int m_nRxStatus;
 
-	u8 m_TxBuffer[SERIAL_BUF_SIZE];
+	u8 *m_pTxBuffer;
+	unsigned m_nTxBufferMask;
 	volatile unsigned m_nTxInPtr;
 	volatile unsigned m_nTxOutPtr;
 
+	boolean m_bUseDMA;
+
+	CDMAChannel *m_pTxDMAChannel;
+	u32 *m_pTxDMABuffer;			// one word per character
+	volatile boolean m_bTxDMAActive;
+
+	CDMAChannel *m_pRxDMAChannel;
+	u32 *m_pRxDMABuffer;			// cyclic, one word per character
+	unsigned m_nRxDMAOutPtr;		// next word to be processed
+
+	TSerialStatistics m_Statistics;
+
 	unsigned m_nOptions;
 
 	const char *m_pMagic;
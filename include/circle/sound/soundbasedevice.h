@@ -2,7 +2,7 @@
 // soundbasedevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,7 +22,7 @@
 
 #include <circle/device.h>
 #include <circle/sound/soundcontroller.h>
-#include <circle/spinlock.h>
+#include <circle/ringbuffer.h>
 #include <circle/types.h>
 #include <assert.h>
 
@@ -91,6 +91,14 @@ public:
 		    unsigned nHWTXChannels, unsigned nHWRXChannels,
 		    boolean bSwapChannels);
 
+	/// \return Sound format used by the hardware
+	/// \note Can be called on any core.
+	TSoundFormat GetHWFormat (void) const;
+
+	/// \return Sample rate in Hz
+	/// \note Can be called on any core.
+	unsigned GetSampleRate (void) const;
+
 	/// \return Number of hardware output channels
 	/// \note Can be called on any core.
 	unsigned GetHWTXChannels (void) const;
@@ -142,7 +150,7 @@ public:
 	/// \param nCount  Size of the buffer in bytes (multiple of frame size)
 	/// \return Number of bytes consumed
 	/// \note Not used, if GetChunk() is overloaded.
-	/// \note Can be called on any core.
+	/// \note Can be called on any core, but from one task at a time only.
 	int Write (const void *pBuffer, size_t nCount);
 
 	/// \return Queue size in number of frames
@@ -161,6 +169,11 @@ public:
 	/// \note Not used, if GetChunk() is overloaded.
 	void RegisterNeedDataCallback (TSoundDataCallback *pCallback, void *pParam);
 
+	/// \return Number of times the queue ran empty, while data was transmitted
+	/// \note Not used, if GetChunk() is overloaded.
+	/// \note Can be called on any core.
+	unsigned GetUnderruns (void) const;
+
 	/// \return TRUE: Have to write right channel first into buffer in GetChunk()
 	boolean AreChannelsSwapped (void) const;
 
@@ -187,7 +200,7 @@ public:
 	/// \param nCount  Size of the buffer in bytes (multiple of frame size)
 	/// \return Number of bytes returned
 	/// \note Not used, if PutChunk() is overloaded.
-	/// \note Can be called on any core.
+	/// \note Can be called on any core, but from one task at a time only.
 	int Read (void *pBuffer, size_t nCount);
 
 	/// \return Read queue size in number of frames
@@ -274,14 +287,13 @@ private:
 	unsigned m_nWriteSampleSize;
 	unsigned m_nWriteFrameSize;
 
-	u8 *m_pQueue;			// Ring buffer
-	unsigned m_nInPtr;
-	unsigned m_nOutPtr;
+	CSPSCRingBuffer<u8> m_Queue;	// written by Write(), read by GetChunk()
 
 	TSoundDataCallback *m_pCallback;
 	void *m_pCallbackParam;
 
-	CSpinLock m_SpinLock;
+	volatile unsigned m_nUnderruns;
+	boolean m_bQueueEmpty;
 
 	u8 m_uchIEC958Status[IEC958_STATUS_BYTES];
 
@@ -296,14 +308,10 @@ private:
 	unsigned m_nReadSampleSize;
 	unsigned m_nReadFrameSize;
 
-	u8 *m_pReadQueue;		// Ring buffer
-	unsigned m_nReadInPtr;
-	unsigned m_nReadOutPtr;
+	CSPSCRingBuffer<u8> m_ReadQueue; // written by PutChunk(), read by Read()
 
 	TSoundDataCallback *m_pReadCallback;
 	void *m_pReadCallbackParam;
-
-	CSpinLock m_ReadSpinLock;
 };
 
 #endif
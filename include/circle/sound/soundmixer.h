@@ -0,0 +1,154 @@
+//
+// soundmixer.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sound_soundmixer_h
+#define _circle_sound_soundmixer_h
+
+#include <circle/sound/soundbasedevice.h>
+#include <circle/ringbuffer.h>
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+#define SOUND_MIXER_MAX_STREAMS		8
+#define SOUND_MIXER_CHUNK_FRAMES	256		// number of frames mixed at once
+
+#define SOUND_MIXER_GAIN_UNITY		0x10000		// original volume of a stream
+
+/// \note The mixer writes to the queue of the sound device from its need data callback,
+///	  which is called from interrupt context. The NEON unit is used there only, if the
+///	  system option SAVE_VFP_REGS_ON_IRQ is defined.
+
+/// \note In a multi-core environment all methods, except if otherwise noted,
+///	  have to be called on core 0.
+
+class CSoundMixer	/// Mixes multiple sound streams with individual gain and sample rate to one sound device
+{
+public:
+	/// \param pDevice	 Pointer to the sound device (PWM, I2S, HDMI or USB), not started yet
+	/// \param nLatencyMsecs Size of the device queue in milliseconds (maximum output latency)
+	CSoundMixer (CSoundBaseDevice *pDevice, unsigned nLatencyMsecs = 20);
+
+	/// \note The output must have been cancelled and the device must be inactive.\n
+	///	  The device cannot be started again afterwards (need data callback remains set).
+	~CSoundMixer (void);
+
+	/// \brief Sets up the sound device and starts the output
+	/// \return Operation successful?
+	/// \note Silence is output, while no stream has data.
+	boolean Start (void);
+
+	/// \brief Cancels the output
+	void Cancel (void);
+
+	/// \brief Adds an input stream
+	/// \param Format      Format of the sound data (SoundFormatUnsigned8, SoundFormatSigned16,\n
+	///		       SoundFormatSigned24 or SoundFormatSigned24_32)
+	/// \param nChannels   1 or 2 channels
+	/// \param nSampleRate Sample rate of the stream in Hz (converted to the device sample rate)
+	/// \param nQueueMsecs Size of the stream queue in milliseconds duration of the stream
+	/// \return Stream number (>= 0), or < 0 on failure
+	int AddStream (TSoundFormat Format, unsigned nChannels, unsigned nSampleRate,
+		       unsigned nQueueMsecs = 100);
+
+	/// \brief Removes an input stream, queued data is discarded
+	/// \param nStream Stream number returned from AddStream()
+	void RemoveStream (unsigned nStream);
+
+	/// \param nStream Stream number returned from AddStream()
+	/// \param nGain   0 (muted) .. SOUND_MIXER_GAIN_UNITY (original volume)
+	/// \note Can be called on any core.
+	void SetGain (unsigned nStream, unsigned nGain);
+
+	/// \param nStream Stream number returned from AddStream()
+	/// \param pBuffer Contains the samples
+	/// \param nCount  Size of the buffer in bytes (multiple of frame size)
+	/// \return Number of bytes consumed
+	/// \note Can be called on any core, but from one task at a time per stream only.
+	int Write (unsigned nStream, const void *pBuffer, size_t nCount);
+
+	/// \param nStream Stream number returned from AddStream()
+	/// \return Number of frames available in the stream queue waiting to be mixed
+	/// \note Can be called on any core.
+	unsigned GetQueueFramesAvail (unsigned nStream) const;
+
+	/// \param nStream   Stream number returned from AddStream()
+	/// \param pCallback Callback which is called, when more sound data is needed
+	/// \param pParam    User parameter to be handed over to the callback
+	/// \note Is called from interrupt context, when at least half of the stream queue is empty
+	void RegisterNeedDataCallback (unsigned nStream, TSoundDataCallback *pCallback, void *pParam);
+
+	/// \param nStream Stream number returned from AddStream()
+	/// \return Number of times the stream queue ran empty, while the stream was playing
+	/// \note Can be called on any core.
+	unsigned GetUnderruns (unsigned nStream) const;
+
+	/// \return Number of times the device queue ran empty (mixer was too late)
+	/// \note Can be called on any core.
+	unsigned GetDeviceUnderruns (void) const;
+
+private:
+	struct TStream;
+
+	void Mix (void);
+	void MixStream (TStream *pStream, unsigned nFrames);
+
+	static void NeedDataHandler (void *pParam);
+
+private:
+	struct TStream
+	{
+		TSoundFormat	Format;
+		unsigned	nChannels;
+		unsigned	nSampleSize;
+		unsigned	nFrameSize;
+
+		CSPSCRingBuffer<u8> Queue;		// written by Write(), read by Mix()
+		unsigned	nNeedDataThreshold;
+		TSoundDataCallback *pCallback;
+		void		*pCallbackParam;
+
+		volatile s32	nGain;			// Q31 fixed point
+		u32		nStep;			// input frames per output frame (Q16)
+		u32		nPhase;			// position between Prev and Next (Q16)
+		s32		Prev[2];		// last two input frames (left, right)
+		s32		Next[2];
+
+		boolean		bStarved;
+		volatile unsigned nUnderruns;
+	};
+
+	CSoundBaseDevice *m_pDevice;
+	unsigned m_nLatencyMsecs;
+	unsigned m_nSampleRate;
+	boolean m_bQueueAllocated;
+
+	TSoundFormat m_WriteFormat;		// written to the device
+	unsigned m_nWriteFrameSize;
+
+	TStream *m_pStream[SOUND_MIXER_MAX_STREAMS];
+	CSpinLock m_SpinLock;			// protects m_pStream[]
+
+	s32 m_MixBuffer[SOUND_MIXER_CHUNK_FRAMES * 2];		// full scale, interleaved stereo
+	s32 m_StreamBuffer[SOUND_MIXER_CHUNK_FRAMES * 2];
+	s32 m_InputBuffer[SOUND_MIXER_CHUNK_FRAMES * 2];
+	u32 m_RawBuffer[SOUND_MIXER_CHUNK_FRAMES * 2];		// stream format
+	u32 m_WriteBuffer[SOUND_MIXER_CHUNK_FRAMES * 2];		// device write format
+};
+
+#endif
@@ -4,7 +4,7 @@
 // Configurable system options
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -75,8 +75,9 @@
 // (buckets). Each free list contains blocks of a specific size. On
 // block allocation the requested block size is rounded up to the
 // size of next available bucket size. If the requested size is greater
-// than the largest available bucket size, the block can be allocated,
-// but the memory space is lost, if the block will be freed later.
+// than the largest available bucket size, the block is allocated from
+// a separate free list for large blocks, where freed blocks are
+// coalesced with adjacent free blocks.
 // Because the block buckets have to be walked through on each allocate
 // and free operation, it is preferable to have only a few buckets.
 // With this option you can configure the bucket sizes, so that they
@@ -88,6 +89,38 @@
 #define HEAP_BLOCK_BUCKET_SIZES	0x40,0x400,0x1000,0x4000,0x10000,0x40000,0x80000
 #endif
 
+// HEAP_CORE_CACHE_MAX_SIZE is the largest bucket size, for which the
+// heap allocator manages a per-core cache of free blocks in multi-core
+// applications (with ARM_ALLOW_MULTI_CORE defined). Allocating and
+// freeing blocks of a bucket size up to this value does not take the
+// global heap spin lock then, as long as the cache of the respective
+// core can serve the request. Only refilling an empty cache and
+// draining a full cache access the shared free lists. Set this to 0
+// to disable the per-core caches.
+
+#ifndef HEAP_CORE_CACHE_MAX_SIZE
+#define HEAP_CORE_CACHE_MAX_SIZE	0x400
+#endif
+
+// HEAP_CORE_CACHE_BLOCKS is the maximum number of free blocks, which
+// are held in the cache of each core for each cached bucket size. Half
+// of them is moved from or to the shared free list on refill or drain.
+
+#ifndef HEAP_CORE_CACHE_BLOCKS
+#define HEAP_CORE_CACHE_BLOCKS		32
+#endif
+
+// PAGE_CORE_CACHE_PAGES is the maximum number of free single pages,
+// which are held in a per-core cache of the page allocator in multi-core
+// applications (with ARM_ALLOW_MULTI_CORE defined). palloc() and pfree()
+// of single pages do not take the global page allocator spin lock then,
+// as long as the cache of the respective core can serve the request.
+// Set this to 0 to disable the per-core caches.
+
+#ifndef PAGE_CORE_CACHE_PAGES
+#define PAGE_CORE_CACHE_PAGES		8
+#endif
+
 ///////////////////////////////////////////////////////////////////////
 //
 // Raspberry Pi 1, Zero (W) and Zero 2 W
@@ -241,6 +274,18 @@
 #define SCREEN_DMA_BURST_LENGTH	2
 #endif
 
+// SCREEN_CONSOLE_MODE enables a faster text output mode of the class
+// CScreenDevice. It keeps a shadow buffer of the character cells and
+// repaints only the modified cells, once at the end of each Write()
+// call. Scrolling the whole screen moves the visible window inside a
+// virtual frame buffer (about twice the screen height) using
+// CBcmFrameBuffer::SetVirtualOffset(), instead of copying the screen
+// contents. Pixels set with CScreenDevice::SetPixel() may be overwritten,
+// when the text around them is repainted, and SetStatus() is not
+// supported in this mode.
+
+//#define SCREEN_CONSOLE_MODE
+
 // CALIBRATE_DELAY activates the calibration of the delay loop. Because
 // this loop is normally not used any more in Circle, the only use of
 // this option is that the "SpeedFactor" of your system is displayed.
@@ -250,13 +295,34 @@
 #define CALIBRATE_DELAY
 #endif
 
+// KERNEL_TIMERS is the number of kernel timer objects, which are
+// allocated at once by CTimer. Starting and cancelling a kernel timer
+// does not use the heap, as long as not more timers are active at the
+// same time. Otherwise another block of timer objects is allocated.
+
+#ifndef KERNEL_TIMERS
+#define KERNEL_TIMERS		128
+#endif
+
+// TIMER_TICKLESS stops the periodic timer interrupt (HZ times per
+// second), while no kernel timer elapses and no periodic timer handler
+// is registered. The interrupt is still triggered once per second to
+// update the system time. CTimer::GetTicks() returns the correct value
+// anyway. High-resolution timers (CTimer::StartHighResTimer()) work
+// with and without this option. This option cannot be used together
+// with ARM_ALLOW_MULTI_CORE.
+
+//#define TIMER_TICKLESS
+
 ///////////////////////////////////////////////////////////////////////
 //
 // Scheduler
 //
 ///////////////////////////////////////////////////////////////////////
 
-// MAX_TASKS is the maximum number of tasks in the system.
+// MAX_TASKS is the maximum number of tasks in the system. With
+// SCHED_READY_QUEUES defined, this is the initial size of the task table,
+// which grows dynamically.
 
 #ifndef MAX_TASKS
 #define MAX_TASKS		20
@@ -268,6 +334,40 @@
 #define TASK_STACK_SIZE		0x8000
 #endif
 
+// SCHED_READY_QUEUES selects an alternative scheduling mode. The ready
+// tasks are held in FIFO queues, one for each task priority, and the
+// sleeping tasks (and tasks waiting with timeout) in a heap, which is
+// ordered by the wake time. This makes the cost of a task switch
+// independent of the number of tasks. Priorities are strict in this
+// mode: A task yields the CPU only to ready tasks of the same or a
+// higher priority (see CTask::SetPriority()). Tasks with a higher
+// priority have to block or sleep regularly, so that tasks with a lower
+// priority can run at all. Without this option the round-robin policy
+// without priorities is used.
+
+//#define SCHED_READY_QUEUES
+
+// SCHED_MULTI_CORE enables the scheduler to run tasks on all CPU cores.
+// Each core has its own ready queue. A core, which has no ready task,
+// steals a ready task from the queue of another core, unless this task
+// is pinned to its core with CTask::SetAffinity(). New tasks are pinned
+// to the core, which created them, by default, because most drivers and
+// the network stack expect that tasks do not run concurrently. The
+// secondary cores have to call CScheduler::RunSecondaryCore() from
+// CMultiCoreSupport::Run() to join the scheduler. This option requires
+// ARM_ALLOW_MULTI_CORE and implies SCHED_READY_QUEUES.
+
+//#define SCHED_MULTI_CORE
+
+#ifdef SCHED_MULTI_CORE
+	#ifndef ARM_ALLOW_MULTI_CORE
+		#error SCHED_MULTI_CORE requires ARM_ALLOW_MULTI_CORE
+	#endif
+	#ifndef SCHED_READY_QUEUES
+		#define SCHED_READY_QUEUES
+	#endif
+#endif
+
 // NO_BUSY_WAIT deactivates busy waiting in the EMMC, SDHOST and USB
 // drivers, while waiting for the completion of a synchronous transfer.
 // This requires the scheduler in the system and transfers must not be
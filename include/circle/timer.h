@@ -2,7 +2,7 @@
 /// \file timer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -31,6 +31,9 @@
 
 #define MSEC2HZ(msec)	((msec) * HZ / 1000)
 
+struct TKernelTimer;
+struct TKernelTimerBlock;
+
 typedef uintptr TKernelTimerHandle;
 
 typedef void TKernelTimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext);
@@ -111,9 +114,23 @@ public:
 					     TKernelTimerHandler *pHandler,
 					     void *pParam   = 0,
 					     void *pContext = 0);
+	/// \brief Starts a high-resolution kernel timer which elapses after a given delay,\n
+	/// a timer handler gets called then
+	/// \param nMicroSeconds Timer elapses after nMicroSeconds from now
+	/// \param pHandler	The handler to be called when the timer elapses
+	/// \param pParam	First user defined parameter to hand over to the handler
+	/// \param pContext	Second user defined parameter to hand over to the handler
+	/// \return Timer handle (cannot be 0), can be cancelled with CancelKernelTimer()
+	/// \note The timer is independent from the HZ tick and the handler is called from IRQ.\n
+	///	  If started on a secondary core, the timer may elapse with the next tick only.
+	TKernelTimerHandle StartHighResTimer (unsigned nMicroSeconds,
+					      TKernelTimerHandler *pHandler,
+					      void *pParam   = 0,
+					      void *pContext = 0);
 	/// \brief Cancel a running kernel timer,\n
 	/// The timer will not elapse any more.
 	/// \param hTimer	Timer handle
+	/// \note Cancelling a timer, which has elapsed or was cancelled already, does nothing.
 	void CancelKernelTimer (TKernelTimerHandle hTimer);
 
 	/// When a CTimer object is available better use this instead of SimpleMsDelay()\n
@@ -144,7 +161,21 @@ public:
 	void RegisterPeriodicHandler (TPeriodicTimerHandler *pHandler);
 
 private:
+	TKernelTimer *AllocateKernelTimer (void);
+	void FreeKernelTimer (TKernelTimer *pTimer);
+	TKernelTimer *GetKernelTimer (TKernelTimerHandle hTimer);
+
+	void InsertKernelTimer (TKernelTimer *pTimer);
+	void RemoveKernelTimer (TKernelTimer *pTimer);
+	void CascadeKernelTimers (unsigned nLevel, unsigned nIndex);
+
 	void PollKernelTimers (void);
+	void PollHighResTimers (void);
+
+	u64 GetCounter (void) const;
+	void SetCompare (u64 nCompare);
+	void ScheduleInterrupt (void);
+	unsigned GetPendingTicks (void) const;
 
 	void InterruptHandler (void);
 	static void InterruptHandler (void *pParam);
@@ -158,9 +189,10 @@ public:
 private:
 	CInterruptSystem	*m_pInterruptSystem;
 
-#if defined (USE_PHYSICAL_COUNTER) && AARCH == 64
-	u32			 m_nClockTicksPerHZTick;
-#endif
+	u32			 m_nCounterFrequency;
+	u32			 m_nCounterTicksPerHZTick;
+	u64			 m_nNextTickAt;			// counter value
+	u64			 m_nCompareAt;
 
 	volatile unsigned	 m_nTicks;
 	volatile unsigned	 m_nUptime;
@@ -169,7 +201,17 @@ private:
 
 	int			 m_nMinutesDiff;		// diff to UTC
 
-	CPtrList		 m_KernelTimerList;
+#define KERNEL_TIMER_WHEEL_LEVELS	4
+#define KERNEL_TIMER_WHEEL_BITS		6
+#define KERNEL_TIMER_WHEEL_SLOTS	(1 << KERNEL_TIMER_WHEEL_BITS)
+	TKernelTimer		*m_pWheel[KERNEL_TIMER_WHEEL_LEVELS][KERNEL_TIMER_WHEEL_SLOTS];
+	u64			 m_nWheelMask[KERNEL_TIMER_WHEEL_LEVELS];	// non-empty slots
+	unsigned		 m_nWheelTicks;			// next tick to be processed
+
+	TKernelTimer		*m_pHighResList;		// sorted by elapse time
+
+	TKernelTimerBlock	*m_pTimerBlocks;
+	TKernelTimer		*m_pFreeTimers;
 	CSpinLock		 m_KernelTimerSpinLock;
 
 	unsigned		 m_nMsDelay;
@@ -2,7 +2,7 @@
 // translationtable64.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -40,6 +40,15 @@ public:
 private:
 	TARMV8MMU_LEVEL3_DESCRIPTOR *CreateLevel3Table (uintptr nBaseAddress) NOOPT;
 
+	// returns TRUE, if the whole level 2 entry can be mapped with a block descriptor
+	boolean IsUniformBlock (uintptr nBaseAddress) const NOOPT;
+
+	void SetPageDescriptor (TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc,
+				uintptr nBaseAddress) const NOOPT;
+
+	static boolean HasSameAttributes (const TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc1,
+					  const TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc2) NOOPT;
+
 private:
 	size_t m_nMemSize;
 
@@ -2,7 +2,7 @@
 // usbmassdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/usb/usbfunction.h>
 #include <circle/usb/usbendpoint.h>
 #include <circle/fs/partitionmanager.h>
+#include <circle/blockrequestqueue.h>
 #include <circle/numberpool.h>
 #include <circle/types.h>
 
@@ -32,6 +33,8 @@
 
 #define UMSD_MAX_OFFSET		0x1FFFFFFFFFFULL		// 2TB
 
+#define UMSD_MAX_MERGE_SIZE	0x10000		// adjacent requests are merged up to this size
+
 class CUSBBulkOnlyMassStorageDevice : public CUSBFunction
 {
 public:
@@ -45,12 +48,19 @@ public:
 
 	u64 Seek (u64 ullOffset);
 
+	boolean SubmitRequest (CBlockRequest *pRequest);
+
 	u64 GetSize (void) const;		// in bytes
 	unsigned GetCapacity (void) const;	// in blocks
 
 private:
-	int TryRead (void *pBuffer, size_t nCount);
-	int TryWrite (const void *pBuffer, size_t nCount);
+	int DoRead (void *pBuffer, size_t nCount, u64 ullOffset);
+	int DoWrite (const void *pBuffer, size_t nCount, u64 ullOffset);
+	static int TransferHandler (TBlockRequestType Type, void *pBuffer, size_t nCount,
+				    u64 ullOffset, void *pParam);
+
+	int TryRead (void *pBuffer, size_t nCount, u64 ullOffset);
+	int TryWrite (const void *pBuffer, size_t nCount, u64 ullOffset);
 
 	int Command (void *pCmdBlk, size_t nCmdBlkLen, void *pBuffer, size_t nBufLen, boolean bIn);
 
@@ -64,6 +74,8 @@ private:
 	unsigned m_nBlockCount;
 	u64 m_ullOffset;
 
+	CBlockRequestQueue m_RequestQueue;
+
 	CPartitionManager *m_pPartitionManager;
 
 	static CNumberPool s_DeviceNumberPool;
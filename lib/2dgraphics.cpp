@@ -5,7 +5,7 @@
 //	Copyright (C) 2021  Stephane Damo
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,6 +24,49 @@
 #include <circle/screen.h>
 #include <circle/bcmpropertytags.h>
 #include <circle/util.h>
+#include <assert.h>
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+	#include <arm_neon.h>
+	#define GRAPHICS_NEON
+
+	#if DEPTH == 8
+		typedef uint8x16_t	TPixelVector;
+		typedef uint8_t		TPixelLane;
+		#define VECTOR_DUP	vdupq_n_u8
+		#define VECTOR_LOAD	vld1q_u8
+		#define VECTOR_STORE	vst1q_u8
+		#define VECTOR_CMPEQ	vceqq_u8
+		#define VECTOR_SELECT	vbslq_u8
+	#elif DEPTH == 16
+		typedef uint16x8_t	TPixelVector;
+		typedef uint16_t	TPixelLane;
+		#define VECTOR_DUP	vdupq_n_u16
+		#define VECTOR_LOAD	vld1q_u16
+		#define VECTOR_STORE	vst1q_u16
+		#define VECTOR_CMPEQ	vceqq_u16
+		#define VECTOR_SELECT	vbslq_u16
+	#elif DEPTH == 32
+		typedef uint32x4_t	TPixelVector;
+		typedef uint32_t	TPixelLane;
+		#define VECTOR_DUP	vdupq_n_u32
+		#define VECTOR_LOAD	vld1q_u32
+		#define VECTOR_STORE	vst1q_u32
+		#define VECTOR_CMPEQ	vceqq_u32
+		#define VECTOR_SELECT	vbslq_u32
+	#endif
+
+	#define VECTOR_PIXELS	(sizeof (TPixelVector) / sizeof (TScreenColor))
+#endif
+
+#define DMA_MIN_BYTES		4096		// smaller updates are copied by the CPU
+
+static void FillPixels (TScreenColor *pDest, TScreenColor Color, unsigned nCount);
+static void CopyPixels (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount);
+static void CopyPixelsKeyed (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount,
+			     TScreenColor KeyColor);
+static void BlendPixels (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount,
+			 unsigned nAlpha);
 
 C2DGraphics::C2DGraphics (unsigned nWidth, unsigned nHeight, boolean bVSync, unsigned nDisplay)
 : 	m_nWidth(nWidth),
@@ -32,7 +75,12 @@ C2DGraphics::C2DGraphics (unsigned nWidth, unsigned nHeight, boolean bVSync, uns
 	m_pFrameBuffer(0),
 	m_Buffer(0),
 	m_bVSync(bVSync),
-	m_bBufferSwapped(TRUE)
+	m_bBufferSwapped(TRUE),
+	m_bRawAccess (FALSE),
+	m_nDirtyRects (0)
+#ifdef SCREEN_DMA_BURST_LENGTH
+	, m_DMAChannel (DMA_CHANNEL_NORMAL)
+#endif
 {
 
 }
@@ -77,6 +125,9 @@ boolean C2DGraphics::Initialize (void)
 	m_nWidth = m_pFrameBuffer->GetWidth();
 	m_nHeight = m_pFrameBuffer->GetHeight();
 	m_Buffer = m_baseBuffer + m_nWidth * m_nHeight;
+
+	m_bRawAccess = FALSE;
+	m_nDirtyRects = 0;
 	
 	return TRUE;
 }
@@ -116,13 +167,22 @@ void C2DGraphics::DrawRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned
 	{
 		return;
 	}
+
+	AddDirtyRect (nX, nY, nWidth, nHeight);
+
+	TScreenColor *pBuffer = &m_Buffer[nY * m_nWidth + nX];
+
+	// full lines are filled at once
+	if (nWidth == m_nWidth)
+	{
+		FillPixels (pBuffer, Color, nWidth * nHeight);
+
+		return;
+	}
 	
-	for(unsigned i = nY; i < nY + nHeight; i++)
+	for(unsigned i = 0; i < nHeight; i++, pBuffer += m_nWidth)
 	{
-		for(unsigned j = nX; j < nX + nWidth; j++)
-		{
-			m_Buffer[i * m_nWidth + j] = Color;
-		}
+		FillPixels (pBuffer, Color, nWidth);
 	}
 }
 
@@ -155,6 +215,8 @@ void C2DGraphics::DrawLine (unsigned nX1, unsigned nY1, unsigned nX2, unsigned n
 	int x = dyabs >> 1;
 	int y = dxabs >> 1;
 
+	AddDirtyRect (nX1 < nX2 ? nX1 : nX2, nY1 < nY2 ? nY1 : nY2, dxabs + 1, dyabs + 1);
+
 	m_Buffer[m_nWidth * nY1 + nX1] = Color;
 
 	if(dxabs >= dyabs)
@@ -194,6 +256,8 @@ void C2DGraphics::DrawCircle (unsigned nX, unsigned nY, unsigned nRadius, TScree
 		return;
 	}
 	
+	AddDirtyRect (nX - nRadius, nY - nRadius, 2 * nRadius + 1, 2 * nRadius + 1);
+
 	int r2 = nRadius * nRadius;
 	unsigned area = r2 << 2;
 	unsigned rr = nRadius << 1;
@@ -217,6 +281,8 @@ void C2DGraphics::DrawCircleOutline (unsigned nX, unsigned nY, unsigned nRadius,
 		return;
 	}
 
+	AddDirtyRect (nX - nRadius, nY - nRadius, 2 * nRadius + 1, 2 * nRadius + 1);
+
 	m_Buffer[m_nWidth * (nY) + nRadius + nX] = Color;
 
 	if (nRadius > 0)
@@ -279,13 +345,15 @@ void C2DGraphics::DrawImageRect (unsigned nX, unsigned nY, unsigned nWidth, unsi
 	{
 		return;
 	}
+
+	AddDirtyRect (nX, nY, nWidth, nHeight);
+
+	TScreenColor *pDest = &m_Buffer[nY * m_nWidth + nX];
+	const TScreenColor *pSource = &PixelBuffer[nSourceY * nWidth + nSourceX];
 	
-	for(unsigned i=0; i<nHeight; i++)
+	for(unsigned i=0; i<nHeight; i++, pDest += m_nWidth, pSource += nWidth)
 	{
-		for(unsigned j=0; j<nWidth; j++)
-		{
-			m_Buffer[(nY + i) * m_nWidth + j + nX] = PixelBuffer[(nSourceY + i) * nWidth + j + nSourceX];
-		}
+		CopyPixels (pDest, pSource, nWidth);
 	}
 }
 
@@ -295,17 +363,46 @@ void C2DGraphics::DrawImageRectTransparent (unsigned nX, unsigned nY, unsigned n
 	{
 		return;
 	}
+
+	AddDirtyRect (nX, nY, nWidth, nHeight);
+
+	TScreenColor *pDest = &m_Buffer[nY * m_nWidth + nX];
+	const TScreenColor *pSource = &PixelBuffer[nSourceY * nSourceWidth + nSourceX];
 	
-	for(unsigned i=0; i<nHeight; i++)
+	for(unsigned i=0; i<nHeight; i++, pDest += m_nWidth, pSource += nSourceWidth)
 	{
-		for(unsigned j=0; j<nWidth; j++)
-		{
-			TScreenColor sourcePixel = PixelBuffer[(nSourceY + i) * nSourceWidth + j + nSourceX];
-			if(sourcePixel != TransparentColor)
-			{
-				m_Buffer[(nY + i) * m_nWidth + j + nX] = sourcePixel;
-			}
-		}
+		CopyPixelsKeyed (pDest, pSource, nWidth, TransparentColor);
+	}
+}
+
+void C2DGraphics::DrawImageBlended (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, TScreenColor *PixelBuffer, u8 uchAlpha)
+{
+	DrawImageRectBlended(nX, nY, nWidth, nHeight, 0, 0, nWidth, nHeight, PixelBuffer, uchAlpha);
+}
+
+void C2DGraphics::DrawImageRectBlended (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, TScreenColor *PixelBuffer, u8 uchAlpha)
+{
+	if(nX + nWidth > m_nWidth || nY + nHeight > m_nHeight || nSourceX + nWidth > nSourceWidth || nSourceY + nHeight > nSourceHeight)
+	{
+		return;
+	}
+
+	if (uchAlpha == 0)
+	{
+		return;
+	}
+
+	AddDirtyRect (nX, nY, nWidth, nHeight);
+
+	TScreenColor *pDest = &m_Buffer[nY * m_nWidth + nX];
+	const TScreenColor *pSource = &PixelBuffer[nSourceY * nSourceWidth + nSourceX];
+
+	// map 0..255 to 0..256, so that 255 gives the source pixel unchanged
+	unsigned nAlpha = uchAlpha + (uchAlpha >> 7);
+
+	for(unsigned i=0; i<nHeight; i++, pDest += m_nWidth, pSource += nSourceWidth)
+	{
+		BlendPixels (pDest, pSource, nWidth, nAlpha);
 	}
 }
 
@@ -315,6 +412,8 @@ void C2DGraphics::DrawPixel (unsigned nX, unsigned nY, TScreenColor Color)
 	{
 		return;
 	}
+
+	AddDirtyRect (nX, nY, 1, 1);
 	
 	m_Buffer[m_nWidth * nY + nX] = Color;
 }
@@ -339,6 +438,8 @@ void C2DGraphics::DrawText (unsigned nX, unsigned nY, TScreenColor Color,
 		return;
 	}
 
+	AddDirtyRect (nX, nY, nWidth, m_Font.GetUnderline ());
+
 	for (; *pText != '\0'; pText++, nX += m_Font.GetCharWidth ())
 	{
 		for (unsigned y = 0; y < m_Font.GetUnderline (); y++)
@@ -354,11 +455,38 @@ void C2DGraphics::DrawText (unsigned nX, unsigned nY, TScreenColor Color,
 	}
 }
 
-TScreenColor* C2DGraphics::GetBuffer ()
+TScreenColor* C2DGraphics::GetBuffer (boolean bMarkDirty)
 {
+	// we do not know, what will be modified, the caller may keep the pointer
+	if (!bMarkDirty)
+	{
+		m_bRawAccess = TRUE;
+	}
+
 	return m_Buffer;
 }
 
+void C2DGraphics::MarkDirty (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight)
+{
+	if (   nX >= m_nWidth
+	    || nY >= m_nHeight)
+	{
+		return;
+	}
+
+	if (nWidth > m_nWidth - nX)
+	{
+		nWidth = m_nWidth - nX;
+	}
+
+	if (nHeight > m_nHeight - nY)
+	{
+		nHeight = m_nHeight - nY;
+	}
+
+	AddDirtyRect (nX, nY, nWidth, nHeight);
+}
+
 void C2DGraphics::UpdateDisplay()
 {
 	
@@ -371,7 +499,303 @@ void C2DGraphics::UpdateDisplay()
 	}
 	else
 	{
-		memcpy(m_baseBuffer, m_Buffer, m_nWidth * m_nHeight * sizeof(TScreenColor));
+		if (m_bRawAccess)
+		{
+			AddDirtyRect (0, 0, m_nWidth, m_nHeight);
+		}
+
+		CopyDirtyRects ();
 	}
 	
 }
+
+void C2DGraphics::AddDirtyRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight)
+{
+	if (   m_bVSync
+	    || nWidth == 0
+	    || nHeight == 0)
+	{
+		return;
+	}
+
+	TDirtyRect Rect = {nX, nY, nX + nWidth, nY + nHeight};
+	assert (Rect.nX2 <= m_nWidth);
+	assert (Rect.nY2 <= m_nHeight);
+
+	// merge with the rect, which grows least by the union, if this does not
+	// add more area than the two rects have together, or if the list is full
+	unsigned nBestIndex = m_nDirtyRects;
+	u64 nBestGrowth = (u64) -1;
+	for (unsigned i = 0; i < m_nDirtyRects; i++)
+	{
+		const TDirtyRect &Dirty = m_DirtyRect[i];
+
+		unsigned nX1 = Dirty.nX1 < Rect.nX1 ? Dirty.nX1 : Rect.nX1;
+		unsigned nY1 = Dirty.nY1 < Rect.nY1 ? Dirty.nY1 : Rect.nY1;
+		unsigned nX2 = Dirty.nX2 > Rect.nX2 ? Dirty.nX2 : Rect.nX2;
+		unsigned nY2 = Dirty.nY2 > Rect.nY2 ? Dirty.nY2 : Rect.nY2;
+
+		u64 nUnion = (u64) (nX2 - nX1) * (nY2 - nY1);
+		u64 nSum =   (u64) (Dirty.nX2 - Dirty.nX1) * (Dirty.nY2 - Dirty.nY1)
+			   + (u64) nWidth * nHeight;
+
+		if (nUnion <= nSum)
+		{
+			nBestIndex = i;
+
+			break;
+		}
+
+		if (   m_nDirtyRects == C2DGRAPHICS_MAX_DIRTY_RECTS
+		    && nUnion - nSum < nBestGrowth)
+		{
+			nBestIndex = i;
+			nBestGrowth = nUnion - nSum;
+		}
+	}
+
+	if (nBestIndex == m_nDirtyRects)
+	{
+		assert (m_nDirtyRects < C2DGRAPHICS_MAX_DIRTY_RECTS);
+		m_DirtyRect[m_nDirtyRects++] = Rect;
+
+		return;
+	}
+
+	TDirtyRect &Dirty = m_DirtyRect[nBestIndex];
+	if (Rect.nX1 < Dirty.nX1)	Dirty.nX1 = Rect.nX1;
+	if (Rect.nY1 < Dirty.nY1)	Dirty.nY1 = Rect.nY1;
+	if (Rect.nX2 > Dirty.nX2)	Dirty.nX2 = Rect.nX2;
+	if (Rect.nY2 > Dirty.nY2)	Dirty.nY2 = Rect.nY2;
+}
+
+void C2DGraphics::CopyDirtyRects (void)
+{
+	if (m_nDirtyRects == 0)
+	{
+		return;
+	}
+
+#ifdef SCREEN_DMA_BURST_LENGTH
+	size_t nBytes = 0;
+	unsigned nSegments = 0;
+	for (unsigned i = 0; i < m_nDirtyRects; i++)
+	{
+		const TDirtyRect &Dirty = m_DirtyRect[i];
+		unsigned nWidth = Dirty.nX2 - Dirty.nX1;
+		unsigned nHeight = Dirty.nY2 - Dirty.nY1;
+
+		nBytes += nWidth * nHeight * sizeof (TScreenColor);
+		nSegments += nWidth == m_nWidth ? 1 : nHeight;	// full lines are copied at once
+	}
+
+	if (nBytes >= DMA_MIN_BYTES)
+	{
+		m_DMAChannel.SetupChain (nSegments);
+
+		for (unsigned i = 0; i < m_nDirtyRects; i++)
+		{
+			const TDirtyRect &Dirty = m_DirtyRect[i];
+			unsigned nWidth = Dirty.nX2 - Dirty.nX1;
+			unsigned nHeight = Dirty.nY2 - Dirty.nY1;
+			unsigned nOffset = Dirty.nY1 * m_nWidth + Dirty.nX1;
+
+			if (nWidth == m_nWidth)
+			{
+				m_DMAChannel.AddMemCopy (m_baseBuffer + nOffset, m_Buffer + nOffset,
+							 nWidth * nHeight * sizeof (TScreenColor),
+							 SCREEN_DMA_BURST_LENGTH, FALSE);
+
+				continue;
+			}
+
+			for (unsigned y = 0; y < nHeight; y++, nOffset += m_nWidth)
+			{
+				m_DMAChannel.AddMemCopy (m_baseBuffer + nOffset, m_Buffer + nOffset,
+							 nWidth * sizeof (TScreenColor),
+							 SCREEN_DMA_BURST_LENGTH, FALSE);
+			}
+		}
+
+		m_DMAChannel.Start ();
+		m_DMAChannel.Wait ();
+
+		m_nDirtyRects = 0;
+
+		return;
+	}
+#endif
+
+	for (unsigned i = 0; i < m_nDirtyRects; i++)
+	{
+		const TDirtyRect &Dirty = m_DirtyRect[i];
+		unsigned nWidth = Dirty.nX2 - Dirty.nX1;
+		unsigned nHeight = Dirty.nY2 - Dirty.nY1;
+		unsigned nOffset = Dirty.nY1 * m_nWidth + Dirty.nX1;
+
+		if (nWidth == m_nWidth)
+		{
+			CopyPixels (m_baseBuffer + nOffset, m_Buffer + nOffset, nWidth * nHeight);
+
+			continue;
+		}
+
+		for (unsigned y = 0; y < nHeight; y++, nOffset += m_nWidth)
+		{
+			CopyPixels (m_baseBuffer + nOffset, m_Buffer + nOffset, nWidth);
+		}
+	}
+
+	m_nDirtyRects = 0;
+}
+
+static void FillPixels (TScreenColor *pDest, TScreenColor Color, unsigned nCount)
+{
+#ifdef GRAPHICS_NEON
+	TPixelVector Vector = VECTOR_DUP (Color);
+
+	for (; nCount >= 2*VECTOR_PIXELS; nCount -= 2*VECTOR_PIXELS, pDest += 2*VECTOR_PIXELS)
+	{
+		VECTOR_STORE ((TPixelLane *) pDest, Vector);
+		VECTOR_STORE ((TPixelLane *) pDest + VECTOR_PIXELS, Vector);
+	}
+#endif
+
+	while (nCount--)
+	{
+		*pDest++ = Color;
+	}
+}
+
+static void CopyPixels (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount)
+{
+#ifdef GRAPHICS_NEON
+	for (; nCount >= 2*VECTOR_PIXELS; nCount -= 2*VECTOR_PIXELS,
+					  pDest += 2*VECTOR_PIXELS, pSource += 2*VECTOR_PIXELS)
+	{
+		TPixelVector Vector0 = VECTOR_LOAD ((const TPixelLane *) pSource);
+		TPixelVector Vector1 = VECTOR_LOAD ((const TPixelLane *) pSource + VECTOR_PIXELS);
+
+		VECTOR_STORE ((TPixelLane *) pDest, Vector0);
+		VECTOR_STORE ((TPixelLane *) pDest + VECTOR_PIXELS, Vector1);
+	}
+#endif
+
+	while (nCount--)
+	{
+		*pDest++ = *pSource++;
+	}
+}
+
+static void CopyPixelsKeyed (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount,
+			     TScreenColor KeyColor)
+{
+#ifdef GRAPHICS_NEON
+	TPixelVector Key = VECTOR_DUP (KeyColor);
+
+	for (; nCount >= VECTOR_PIXELS; nCount -= VECTOR_PIXELS,
+					pDest += VECTOR_PIXELS, pSource += VECTOR_PIXELS)
+	{
+		TPixelVector Source = VECTOR_LOAD ((const TPixelLane *) pSource);
+		TPixelVector Dest = VECTOR_LOAD ((const TPixelLane *) pDest);
+
+		// keep the destination, where the source has the key color
+		TPixelVector Mask = VECTOR_CMPEQ (Source, Key);
+		VECTOR_STORE ((TPixelLane *) pDest, VECTOR_SELECT (Mask, Dest, Source));
+	}
+#endif
+
+	for (; nCount > 0; nCount--, pDest++, pSource++)
+	{
+		if (*pSource != KeyColor)
+		{
+			*pDest = *pSource;
+		}
+	}
+}
+
+#if DEPTH != 8
+
+// nAlpha is 0..256 here, channels are blended with (Source*nAlpha + Dest*(256-nAlpha)) / 256
+static inline TScreenColor BlendPixel (TScreenColor Source, TScreenColor Dest, unsigned nAlpha)
+{
+	unsigned nInvAlpha = 256 - nAlpha;
+
+#if DEPTH == 16
+	unsigned nRed   = ((Source >> 11)         * nAlpha + (Dest >> 11)         * nInvAlpha) >> 8;
+	unsigned nGreen = (((Source >> 5) & 0x3F) * nAlpha + ((Dest >> 5) & 0x3F) * nInvAlpha) >> 8;
+	unsigned nBlue  = ((Source & 0x1F)        * nAlpha + (Dest & 0x1F)        * nInvAlpha) >> 8;
+
+	return (TScreenColor) (nRed << 11 | nGreen << 5 | nBlue);
+#elif DEPTH == 32
+	// two channels at once, the products do not overlap
+	u32 nEven = ((Source & 0xFF00FF)        * nAlpha + (Dest & 0xFF00FF)        * nInvAlpha) >> 8;
+	u32 nOdd  = (((Source >> 8) & 0xFF00FF) * nAlpha + ((Dest >> 8) & 0xFF00FF) * nInvAlpha) >> 8;
+
+	return (nEven & 0xFF00FF) | (nOdd & 0xFF00FF) << 8;
+#endif
+}
+
+#endif
+
+static void BlendPixels (TScreenColor *pDest, const TScreenColor *pSource, unsigned nCount, unsigned nAlpha)
+{
+	assert (nAlpha <= 256);
+
+#if DEPTH == 8
+	// palette indices cannot be blended
+	if (nAlpha >= 128)
+	{
+		CopyPixels (pDest, pSource, nCount);
+	}
+
+	return;
+#else
+#ifdef GRAPHICS_NEON
+	uint16x8_t Alpha = vdupq_n_u16 (nAlpha);
+	uint16x8_t InvAlpha = vdupq_n_u16 (256 - nAlpha);
+
+	for (; nCount >= VECTOR_PIXELS; nCount -= VECTOR_PIXELS,
+					pDest += VECTOR_PIXELS, pSource += VECTOR_PIXELS)
+	{
+#if DEPTH == 16
+		uint16x8_t Source = vld1q_u16 ((const uint16_t *) pSource);
+		uint16x8_t Dest = vld1q_u16 ((const uint16_t *) pDest);
+
+		uint16x8_t Red = vmlaq_u16 (vmulq_u16 (vshrq_n_u16 (Source, 11), Alpha),
+					    vshrq_n_u16 (Dest, 11), InvAlpha);
+
+		uint16x8_t Mask6 = vdupq_n_u16 (0x3F);
+		uint16x8_t Green = vmlaq_u16 (vmulq_u16 (vandq_u16 (vshrq_n_u16 (Source, 5), Mask6), Alpha),
+					      vandq_u16 (vshrq_n_u16 (Dest, 5), Mask6), InvAlpha);
+
+		uint16x8_t Mask5 = vdupq_n_u16 (0x1F);
+		uint16x8_t Blue = vmlaq_u16 (vmulq_u16 (vandq_u16 (Source, Mask5), Alpha),
+					     vandq_u16 (Dest, Mask5), InvAlpha);
+
+		uint16x8_t Result = vorrq_u16 (vshlq_n_u16 (vshrq_n_u16 (Red, 8), 11),
+					       vorrq_u16 (vshlq_n_u16 (vshrq_n_u16 (Green, 8), 5),
+							  vshrq_n_u16 (Blue, 8)));
+
+		vst1q_u16 ((uint16_t *) pDest, Result);
+#else
+		// all four channels are blended the same way
+		uint8x16_t Source = vld1q_u8 ((const uint8_t *) pSource);
+		uint8x16_t Dest = vld1q_u8 ((const uint8_t *) pDest);
+
+		uint16x8_t Low = vmlaq_u16 (vmulq_u16 (vmovl_u8 (vget_low_u8 (Source)), Alpha),
+					    vmovl_u8 (vget_low_u8 (Dest)), InvAlpha);
+		uint16x8_t High = vmlaq_u16 (vmulq_u16 (vmovl_u8 (vget_high_u8 (Source)), Alpha),
+					     vmovl_u8 (vget_high_u8 (Dest)), InvAlpha);
+
+		vst1q_u8 ((uint8_t *) pDest, vcombine_u8 (vshrn_n_u16 (Low, 8), vshrn_n_u16 (High, 8)));
+#endif
+	}
+#endif
+
+	for (; nCount > 0; nCount--, pDest++, pSource++)
+	{
+		*pDest = BlendPixel (*pSource, *pDest, nAlpha);
+	}
+#endif
+}
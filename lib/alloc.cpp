@@ -2,7 +2,7 @@
 // alloc.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -67,6 +67,11 @@ void *palloc (void)
 	return CMemorySystem::PageAllocate ();
 }
 
+void *palloc_contiguous (size_t nSize, size_t nAlign)
+{
+	return CMemorySystem::PageAllocate (nSize, nAlign);
+}
+
 void pfree (void *pPage)
 {
 	CMemorySystem::PageFree (pPage);
@@ -16,7 +16,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,8 +49,8 @@
 // HW params for GENET_V5
 #define TX_QUEUES			4
 #define TX_BDS_PER_Q			32	// buffer descriptors per Tx queue
-#define RX_QUEUES			0	// not implemented
-#define RX_BDS_PER_Q			0	// buffer descriptors per Rx queue
+#define RX_QUEUES			2	// priority Rx queues, fed by the HW filter block
+#define RX_BDS_PER_Q			32	// buffer descriptors per Rx queue
 #define HFB_FILTER_CNT			48
 #define HFB_FILTER_SIZE			128
 #define QTAG_MASK			0x3F
@@ -60,7 +60,8 @@
 #define TDMA_OFFSET			0x4000
 #define WORDS_PER_BD			3	// word per buffer descriptor
 
-#define RX_BUF_LENGTH			2048
+#define RX_BUF_LENGTH			FRAME_BUFFER_SIZE	// data area of a CNetBuffer
+#define RX_CONS_INDEX_BATCH		8	// return Rx BDs to HW in batches of this size
 
 // DMA descriptors
 #define TOTAL_DESC			256	// number of buffer descriptors (same for Rx/Tx)
@@ -80,6 +81,12 @@
 
 #define TX_RING_INDEX			1	// using highest TX priority queue
 
+// Rx queues, which are fed by the HW filter block (see hfb_setup())
+#define RX_RING_ARP			0	// ARP frames
+#define RX_RING_UDP			1	// IPv4 UDP frames (incl. DHCP, DNS, NTP)
+
+#define RX_QUEUES_INTR_MASK		((BIT(RX_QUEUES) - 1) << UMAC_IRQ1_RX_INTR_SHIFT)
+
 // Tx/Rx DMA register offset, skip 256 descriptors
 #define GENET_TDMA_REG_OFF		(TDMA_OFFSET + TOTAL_DESC * DMA_DESC_SIZE)
 #define GENET_RDMA_REG_OFF		(RDMA_OFFSET + TOTAL_DESC * DMA_DESC_SIZE)
@@ -580,6 +587,8 @@ static const char FromBcm54213[] = "genet";
 CBcm54213Device::CBcm54213Device (void)
 :	m_pTimer (CTimer::Get ()),
 	m_bInterruptConnected (FALSE),
+	m_pEventHandler (0),
+	m_pEventParam (0),
 	m_tx_cbs (0),
 	m_rx_cbs (0)
 {
@@ -607,6 +616,14 @@ CBcm54213Device::~CBcm54213Device (void)
 		free_rx_buffers ();
 	}
 
+	if (m_tx_cbs != 0)
+	{
+		for (unsigned i = 0; i < TOTAL_DESC; i++)
+		{
+			free_tx_cb (&m_tx_cbs[i]);
+		}
+	}
+
 	delete [] m_tx_cbs;
 	delete [] m_rx_cbs;
 }
@@ -644,6 +661,7 @@ boolean CBcm54213Device::Initialize (void)
 
 	reg = umac_readl(UMAC_CMD);		// make sure we reflect the value of CRC_CMD_FWD
 	m_crc_fwd_en = !!(reg & CMD_CRC_FWD);
+	m_rx_csum_en = FALSE;
 
 	int ret = set_hw_addr();
 	if (ret)
@@ -666,6 +684,9 @@ boolean CBcm54213Device::Initialize (void)
 	enable_dma(dma_ctrl);			// always enable ring 16 - descriptor ring
 
 	hfb_init();
+	hfb_setup();				// distribute frames to the Rx priority queues
+
+	set_rx_csum(true);
 
 	assert (!m_bInterruptConnected);
 	CInterruptSystem::Get ()->ConnectIRQ (ARM_IRQ_BCM54213_0, InterruptStub0, this);
@@ -698,6 +719,11 @@ const CMACAddress *CBcm54213Device::GetMACAddress (void) const
 	return &m_MACAddress;
 }
 
+u32 CBcm54213Device::GetFeatures (void)
+{
+	return NET_DEVICE_FEATURE_NET_BUFFER | NET_DEVICE_FEATURE_RX_CHECKSUM;
+}
+
 boolean CBcm54213Device::IsSendFrameAdvisable (void)
 {
 	unsigned index = TX_RING_INDEX;			// see SendFrame() for mapping strategy
@@ -739,22 +765,31 @@ boolean CBcm54213Device::SendFrame (const void *pBuffer, unsigned nLength)
 		return FALSE;
 	}
 
-	u8 *pTxBuffer = new u8[ENET_MAX_MTU_SIZE];	// allocate and fill DMA buffer
-	memcpy (pTxBuffer, pBuffer, nLength);
+	TGEnetCB *tx_cb_ptr = get_txcb (ring);		// get Tx control block from ring
+	assert (tx_cb_ptr != 0);
+
+	// the DMA buffer is allocated on first use of the Tx control block and kept,
+	// when the control block is reclaimed, so that it can be reused
+	u8 *pTxBuffer = tx_cb_ptr->buffer;
+	if (pTxBuffer == 0)
+	{
+		pTxBuffer = new u8[ENET_MAX_MTU_SIZE];
+		assert (pTxBuffer != 0);
+
+		tx_cb_ptr->buffer = pTxBuffer;		// set DMA buffer in Tx control block
+	}
+
+	assert (nLength <= ENET_MAX_MTU_SIZE);
+	memcpy (pTxBuffer, pBuffer, nLength);		// fill DMA buffer
 	if (nLength < ETH_ZLEN)				// pad frame if necessary
 	{
 		memset (pTxBuffer+nLength, 0, ETH_ZLEN-nLength);
 		nLength = ETH_ZLEN;
 	}
 
-	TGEnetCB *tx_cb_ptr = get_txcb (ring);		// get Tx control block from ring
-	assert (tx_cb_ptr != 0);
-
 	// prepare for DMA
 	CleanAndInvalidateDataCacheRange ((u32) (uintptr) pTxBuffer, nLength);
 
-	tx_cb_ptr->buffer = pTxBuffer;			// set DMA buffer in Tx control block
-
 	// set DMA descriptor and start transfer
 	dmadesc_set (tx_cb_ptr->bd_addr, pTxBuffer,   (nLength << DMA_BUFLENGTH_SHIFT)
 						    | (QTAG_MASK << DMA_TX_QTAG_SHIFT)
@@ -778,110 +813,35 @@ boolean CBcm54213Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 	assert (pBuffer != 0);
 	assert (pResultLength != 0);
 
-	TGEnetRxRing *ring = &m_rx_rings[GENET_DESC_INDEX];	// the only supported Rx queue
+	return rx_poll (0, pBuffer, pResultLength);
+}
 
-	// clear status before servicing to reduce spurious interrupts
-	// NOTE: Rx interrupts are not used
-	//intrl2_0_writel (UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_CLEAR);
+boolean CBcm54213Device::ReceiveFrameBuffer (CNetBuffer **ppBuffer)
+{
+	assert (ppBuffer != 0);
 
-	unsigned p_index = rdma_ring_readl (ring->index, RDMA_PROD_INDEX);
+	return rx_poll (ppBuffer, 0, 0);
+}
 
-	unsigned discards =   (p_index >> DMA_P_INDEX_DISCARD_CNT_SHIFT)
-			    & DMA_P_INDEX_DISCARD_CNT_MASK;
-	if (discards > ring->old_discards)
-	{
-		discards = discards - ring->old_discards;
-		ring->old_discards += discards;
+boolean CBcm54213Device::RegisterEventHandler (TNetDeviceEventHandler *pHandler, void *pParam)
+{
+	assert (m_bInterruptConnected);
 
-		// clear HW register when we reach 75% of maximum 0xFFFF
-		if (ring->old_discards >= 0xC000)
-		{
-			ring->old_discards = 0;
-			rdma_ring_writel (ring->index, 0, RDMA_PROD_INDEX);
-		}
+	if (pHandler == 0)
+	{
+		intrl2_0_writel (UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_MASK_SET);
+		intrl2_1_writel (RX_QUEUES_INTR_MASK, INTRL2_CPU_MASK_SET);
 	}
 
-	p_index &= DMA_P_INDEX_MASK;
+	m_pEventParam = pParam;
+	m_pEventHandler = pHandler;
 
-	boolean bResult = FALSE;
-
-	unsigned rxpkttoprocess = (p_index - ring->c_index) & DMA_C_INDEX_MASK;
-	if (rxpkttoprocess > 0)
+	if (pHandler != 0)
 	{
-		u32 dma_length_status;
-		u32 dma_flag;
-		int nLength;
-
-		TGEnetCB *cb = &m_rx_cbs[ring->read_ptr];
-
-		u8 *pRxBuffer = rx_refill (cb);
-		if (pRxBuffer == 0)
-		{
-			CLogger::Get ()->Write (FromBcm54213, LogWarning, "Missing RX buffer!");
-
-			goto out;
-		}
-
-		dma_length_status = dmadesc_get_length_status (cb->bd_addr);
-		dma_flag = dma_length_status & 0xFFFF;
-		nLength = dma_length_status >> DMA_BUFLENGTH_SHIFT;
-
-		if (   !(dma_flag & DMA_EOP)
-		    || !(dma_flag & DMA_SOP))
-		{
-			CLogger::Get ()->Write (FromBcm54213, LogWarning,
-						"Dropping fragmented RX packet!");
-
-			delete [] pRxBuffer;
-
-			goto out;
-		}
-
-		// report errors
-		if (dma_flag & (DMA_RX_CRC_ERROR | DMA_RX_OV | DMA_RX_NO | DMA_RX_LG | DMA_RX_RXER))
-		{
-			CLogger::Get ()->Write (FromBcm54213, LogWarning, "RX error (0x%x)",
-						(unsigned) dma_flag);
-
-			delete [] pRxBuffer;
-
-			goto out;
-		}
-
-#define LEADING_PAD	2
-		nLength -= LEADING_PAD;		// remove HW 2 bytes added for IP alignment
-
-		if (m_crc_fwd_en)
-		{
-			nLength -= ETH_FCS_LEN;
-		}
-
-
-		assert (nLength > 0);
-		assert (nLength <= FRAME_BUFFER_SIZE);
-		memcpy (pBuffer, pRxBuffer+LEADING_PAD, nLength);
-
-		*pResultLength = nLength;
-
-		delete [] pRxBuffer;
-
-		bResult = TRUE;
-
-out:
-		if (ring->read_ptr < ring->end_ptr)
-		{
-			ring->read_ptr++;
-		}
-		else
-		{
-			ring->read_ptr = ring->cb_ptr;
-		}
-
-		ring->c_index = (ring->c_index + 1) & DMA_C_INDEX_MASK;
-		rdma_ring_writel (ring->index, ring->c_index, RDMA_CONS_INDEX);
+		rx_intr_reenable ();
 	}
 
-	return bResult;
+	return TRUE;
 }
 
 boolean CBcm54213Device::IsLinkUp (void)
@@ -1012,10 +972,26 @@ void CBcm54213Device::enable_tx_intr(void)
 
 void CBcm54213Device::enable_rx_intr(void)
 {
-	TGEnetRxRing *ring = &m_rx_rings[GENET_DESC_INDEX];
+	TGEnetRxRing *ring;
+	for (unsigned i = 0; i < RX_QUEUES; ++i)
+	{
+		ring = &m_rx_rings[i];
+		ring->int_enable(ring);
+	}
+
+	ring = &m_rx_rings[GENET_DESC_INDEX];
 	ring->int_enable(ring);
 }
 
+// clear pending Rx interrupts and unmask them
+void CBcm54213Device::rx_intr_reenable(void)
+{
+	intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_CLEAR);
+	intrl2_1_writel(RX_QUEUES_INTR_MASK, INTRL2_CPU_CLEAR);
+
+	enable_rx_intr();
+}
+
 void CBcm54213Device::link_intr_enable(void)
 {
 	intrl2_0_writel(UMAC_IRQ_LINK_EVENT, INTRL2_CPU_MASK_CLEAR);
@@ -1036,6 +1012,11 @@ void CBcm54213Device::rx_ring16_int_enable(TGEnetRxRing *ring)
 	intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_MASK_CLEAR);
 }
 
+void CBcm54213Device::rx_ring_int_enable(TGEnetRxRing *ring)
+{
+	intrl2_1_writel(1 << (UMAC_IRQ1_RX_INTR_SHIFT + ring->index), INTRL2_CPU_MASK_CLEAR);
+}
+
 int CBcm54213Device::set_hw_addr(void)
 {
 	CBcmPropertyTags Tags;
@@ -1128,6 +1109,114 @@ void CBcm54213Device::hfb_init(void)
 		hfb_writel(0, i * sizeof(u32));
 }
 
+// Program HW filter f_index to match length bytes of pattern (compared with mask)
+// at the start of the Ethernet frame and to direct matching frames to rx_ring.
+// Each filter word holds two frame bytes in bits 15:8 and 7:0, and the
+// respective byte enables in bits 19:18 and 17:16.
+void CBcm54213Device::hfb_add_filter(unsigned f_index, const u8 *pattern, const u8 *mask,
+				     unsigned length, unsigned rx_ring)
+{
+	assert (f_index < HFB_FILTER_CNT);
+	assert (length <= HFB_FILTER_SIZE * 2);
+	assert (rx_ring < RX_QUEUES);
+
+	for (unsigned offset = 0; offset < length; offset += 2)
+	{
+		u32 reg = 0;
+		for (unsigned i = 0; i < 2 && offset + i < length; i++)
+		{
+			if (!mask[offset + i])
+				continue;
+
+			if (i == 0)
+				reg |= (pattern[offset] << 8) | 0xC0000;
+			else
+				reg |= pattern[offset + 1] | 0x30000;
+		}
+
+		hfb_writel(reg, (f_index * HFB_FILTER_SIZE + offset / 2) * sizeof(u32));
+	}
+
+	// set filter length (in bytes, rounded up to an even number)
+	u32 reg_offset = HFB_FLT_LEN_V3PLUS + ((HFB_FILTER_CNT - 1 - f_index) / 4) * sizeof(u32);
+	u32 reg = hfb_reg_readl(reg_offset);
+	reg &= ~(RBUF_FLTR_LEN_MASK << (RBUF_FLTR_LEN_SHIFT * (f_index % 4)));
+	reg |= ((length + 1) & ~1) << (RBUF_FLTR_LEN_SHIFT * (f_index % 4));
+	hfb_reg_writel(reg, reg_offset);
+
+	// map filter to Rx queue (0 is the default queue 16, n is Rx ring n-1)
+	reg = rdma_readl(DMA_INDEX2RING_0 + f_index / 8);
+	reg &= ~(0xF << ((f_index % 8) * 4));
+	reg |= (rx_ring + 1) << ((f_index % 8) * 4);
+	rdma_writel(reg, DMA_INDEX2RING_0 + f_index / 8);
+
+	// enable filter
+	reg_offset = HFB_FLT_ENABLE_V3PLUS + (f_index < 32 ? sizeof(u32) : 0);
+	reg = hfb_reg_readl(reg_offset);
+	reg |= 1 << (f_index % 32);
+	hfb_reg_writel(reg, reg_offset);
+
+	reg = hfb_reg_readl(HFB_CTRL);
+	reg |= RBUF_HFB_EN;
+	hfb_reg_writel(reg, HFB_CTRL);
+}
+
+// ARP and IPv4 UDP frames are received on own Rx queues, so that they are not
+// delayed (or dropped) behind bulk TCP traffic, which uses the default queue 16
+void CBcm54213Device::hfb_setup(void)
+{
+	static const u8 arp_pattern[] =
+	{
+		0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0,		// MAC addresses
+		0x08, 0x06					// EtherType ARP
+	};
+	static const u8 arp_mask[] =
+	{
+		0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0,
+		0xFF, 0xFF
+	};
+
+	static const u8 udp_pattern[] =
+	{
+		0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0,		// MAC addresses
+		0x08, 0x00,					// EtherType IPv4
+		0, 0, 0, 0, 0, 0, 0, 0, 0,			// IP header
+		0x11						// protocol UDP
+	};
+	static const u8 udp_mask[] =
+	{
+		0, 0, 0, 0, 0, 0,  0, 0, 0, 0, 0, 0,
+		0xFF, 0xFF,
+		0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0xFF
+	};
+
+	hfb_add_filter(0, arp_pattern, arp_mask, sizeof arp_pattern, RX_RING_ARP);
+	hfb_add_filter(1, udp_pattern, udp_mask, sizeof udp_pattern, RX_RING_UDP);
+}
+
+// The HW verifies the TCP/UDP checksums of received frames and
+// sets DMA_RX_CHK_V3PLUS in the Rx descriptor, if it is correct.
+void CBcm54213Device::set_rx_csum(bool enable)
+{
+	u32 reg = rbuf_readl(RBUF_CHK_CTRL);
+	if (enable)
+		reg |= RBUF_RXCHK_EN;
+	else
+		reg &= ~RBUF_RXCHK_EN;
+
+	// If UniMAC forwards CRC, we need to skip over it to get
+	// a valid CHK bit to be set in the per-packet status word
+	if (enable && m_crc_fwd_en)
+		reg |= RBUF_SKIP_FCS;
+	else
+		reg &= ~RBUF_SKIP_FCS;
+
+	rbuf_writel(reg, RBUF_CHK_CTRL);
+
+	m_rx_csum_en = enable;
+}
+
 // Start the network engine
 void CBcm54213Device::netif_start(void)
 {
@@ -1375,7 +1464,7 @@ unsigned CBcm54213Device::tx_reclaim(TGEnetTxRing *ring)
 	// Reclaim transmitted buffers
 	unsigned txbds_processed = 0;
 	while (txbds_processed < txbds_ready) {
-		free_tx_cb(&m_tx_cbs[ring->clean_ptr]);
+		// the DMA buffer of the Tx control block is kept for reuse
 		txbds_processed++;
 		if (ring->clean_ptr < ring->end_ptr)
 			ring->clean_ptr++;
@@ -1399,9 +1488,16 @@ void CBcm54213Device::free_tx_cb(TGEnetCB *cb)
 	}
 }
 
-// Initialize Rx queue
-// Queue 0-15 are not available
-// Queue 16 is the default Rx queue with GENET_Q16_RX_BD_CNT descriptors.
+// Initialize Rx queues
+//
+// Queues 0-1 are priority-based, each one has 32 descriptors,
+// and are fed by the HW filter block (see hfb_setup()).
+//
+// Queue 16 is the default Rx queue with
+// GENET_Q16_RX_BD_CNT = 256 - 2 * 32 = 192 descriptors.
+//
+// The receive control block pool is partitioned like the
+// transmit control block pool (see init_tx_queues()).
 int CBcm54213Device::init_rx_queues(void)
 {
 	u32 dma_ctrl = rdma_readl(DMA_CTRL);
@@ -1412,8 +1508,20 @@ int CBcm54213Device::init_rx_queues(void)
 	dma_ctrl = 0;
 	u32 ring_cfg = 0;
 
+	int ret;
+
+	// Initialize Rx priority queues
+	for (unsigned i = 0; i < RX_QUEUES; i++) {
+		ret = init_rx_ring(i, RX_BDS_PER_Q, i * RX_BDS_PER_Q, (i + 1) * RX_BDS_PER_Q);
+		if (ret)
+			return ret;
+
+		ring_cfg |= (1 << i);
+		dma_ctrl |= (1 << (i + DMA_RING_BUF_EN_SHIFT));
+	}
+
 	// Initialize Rx default queue 16
-	int ret = init_rx_ring(GENET_DESC_INDEX, GENET_Q16_RX_BD_CNT,
+	ret = init_rx_ring(GENET_DESC_INDEX, GENET_Q16_RX_BD_CNT,
 			       RX_QUEUES * RX_BDS_PER_Q, TOTAL_DESC);
 	if (ret)
 		return ret;
@@ -1440,8 +1548,10 @@ int CBcm54213Device::init_rx_ring(unsigned index, unsigned size,
 
 	ring->index = index;
 
-	assert (index == GENET_DESC_INDEX);
-	ring->int_enable = rx_ring16_int_enable;
+	if (index == GENET_DESC_INDEX)
+		ring->int_enable = rx_ring16_int_enable;
+	else
+		ring->int_enable = rx_ring_int_enable;
 
 	ring->cbs = m_rx_cbs + start_ptr;
 	ring->size = size;
@@ -1450,6 +1560,7 @@ int CBcm54213Device::init_rx_ring(unsigned index, unsigned size,
 	ring->cb_ptr = start_ptr;
 	ring->end_ptr = end_ptr - 1;
 	ring->old_discards = 0;
+	ring->pending_bds = 0;
 
 	int ret = alloc_rx_buffers(ring);
 	if (ret)
@@ -1458,6 +1569,7 @@ int CBcm54213Device::init_rx_ring(unsigned index, unsigned size,
 	rdma_ring_writel(index, 0, RDMA_PROD_INDEX);
 	rdma_ring_writel(index, 0, RDMA_CONS_INDEX);
 	rdma_ring_writel(index, ((size << DMA_RING_SIZE_SHIFT) | RX_BUF_LENGTH), DMA_RING_BUF_SIZE);
+	rdma_ring_writel(index, 1, DMA_MBUF_DONE_THRESH);	// Rx interrupt for each frame
 	rdma_ring_writel(index,   (DMA_FC_THRESH_LO << DMA_XOFF_THRESHOLD_SHIFT)
 				|  DMA_FC_THRESH_HI, RDMA_XON_XOFF_THRESH);
 
@@ -1477,7 +1589,7 @@ int CBcm54213Device::alloc_rx_buffers(TGEnetRxRing *ring)
 	for (unsigned i = 0; i < ring->size; i++) {
 		TGEnetCB *cb = ring->cbs + i;
 		rx_refill(cb);
-		if (!cb->buffer)
+		if (!cb->net_buffer)
 			return -1;
 	}
 
@@ -1489,25 +1601,30 @@ void CBcm54213Device::free_rx_buffers(void)
 	for (unsigned i = 0; i < TOTAL_DESC; i++)
 	{
 		TGEnetCB *cb = &m_rx_cbs[i];
-		u8 *buffer = free_rx_cb(cb);
-		delete [] buffer;
+		CNetBuffer *net_buffer = free_rx_cb(cb);
+		if (net_buffer)
+			net_buffer->Release();
 	}
 }
 
-u8 *CBcm54213Device::rx_refill(struct TGEnetCB *cb)
+CNetBuffer *CBcm54213Device::rx_refill(struct TGEnetCB *cb)
 {
-	// Allocate a new Rx DMA buffer
-	u8 *buffer = new u8[RX_BUF_LENGTH];
-	if (!buffer)
+	// Allocate a new Rx DMA buffer, the frame is received into the data area
+	// of a net buffer, so that it can be handed over to the network stack
+	CNetBuffer *net_buffer = new CNetBuffer;
+	if (!net_buffer)
 		return 0;
 
+	u8 *buffer = net_buffer->GetData();
+
 	// prepare buffer for DMA
 	CleanAndInvalidateDataCacheRange ((u32) (uintptr) buffer, RX_BUF_LENGTH);
 
 	// Grab the current Rx buffer from the ring and DMA-unmap it
-	u8 *rx_buffer = free_rx_cb(cb);
+	CNetBuffer *rx_buffer = free_rx_cb(cb);
 
 	// Put the new Rx buffer on the ring
+	cb->net_buffer = net_buffer;
 	cb->buffer = buffer;
 	dmadesc_set_addr(cb->bd_addr, buffer);
 
@@ -1515,14 +1632,186 @@ u8 *CBcm54213Device::rx_refill(struct TGEnetCB *cb)
 	return rx_buffer;
 }
 
-u8 *CBcm54213Device::free_rx_cb(TGEnetCB *cb)
+CNetBuffer *CBcm54213Device::free_rx_cb(TGEnetCB *cb)
 {
-	u8 *buffer = cb->buffer;
+	// the received frame has been invalidated in rx_ring_poll() already
+	CNetBuffer *net_buffer = cb->net_buffer;
+
+	cb->net_buffer = 0;
 	cb->buffer = 0;
 
-	CleanAndInvalidateDataCacheRange ((u32) (uintptr) buffer, RX_BUF_LENGTH);
+	return net_buffer;
+}
+
+// Poll the Rx queues in the order of their priority, the default queue 16 last.
+// The frame is either handed over in a net buffer (ppBuffer != 0) or copied to pBuffer.
+boolean CBcm54213Device::rx_poll(CNetBuffer **ppBuffer, void *pBuffer, unsigned *pResultLength)
+{
+	for (unsigned i = 0; i <= RX_QUEUES; i++)
+	{
+		TGEnetRxRing *ring = &m_rx_rings[i < RX_QUEUES ? i : GENET_DESC_INDEX];
+
+		if (rx_ring_poll (ring, ppBuffer, pBuffer, pResultLength))
+		{
+			return TRUE;
+		}
+	}
+
+	if (m_pEventHandler != 0)
+	{
+		// Rx rings are empty, re-enable the Rx interrupts, which have been masked in
+		// the interrupt handlers, and check for a frame, which arrived in the meantime
+		rx_intr_reenable ();
 
-	return buffer;
+		for (unsigned i = 0; i <= RX_QUEUES; i++)
+		{
+			TGEnetRxRing *ring = &m_rx_rings[i < RX_QUEUES ? i : GENET_DESC_INDEX];
+
+			unsigned p_index =   rdma_ring_readl (ring->index, RDMA_PROD_INDEX)
+					   & DMA_P_INDEX_MASK;
+			if (p_index != ring->c_index)
+			{
+				(*m_pEventHandler) (m_pEventParam);
+
+				break;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+// Returns the next valid frame from an Rx ring, erroneous frames are dropped.
+// Processed BDs are returned to the HW in batches of RX_CONS_INDEX_BATCH BDs,
+// or when the ring has been drained.
+boolean CBcm54213Device::rx_ring_poll(TGEnetRxRing *ring, CNetBuffer **ppBuffer,
+				      void *pBuffer, unsigned *pResultLength)
+{
+	unsigned p_index = rdma_ring_readl (ring->index, RDMA_PROD_INDEX);
+
+	unsigned discards =   (p_index >> DMA_P_INDEX_DISCARD_CNT_SHIFT)
+			    & DMA_P_INDEX_DISCARD_CNT_MASK;
+	if (discards > ring->old_discards)
+	{
+		discards = discards - ring->old_discards;
+		ring->old_discards += discards;
+
+		// clear HW register when we reach 75% of maximum 0xFFFF
+		if (ring->old_discards >= 0xC000)
+		{
+			ring->old_discards = 0;
+			rdma_ring_writel (ring->index, 0, RDMA_PROD_INDEX);
+		}
+	}
+
+	p_index &= DMA_P_INDEX_MASK;
+
+	boolean bResult = FALSE;
+
+	while (   !bResult
+	       && p_index != ring->c_index)
+	{
+		TGEnetCB *cb = &m_rx_cbs[ring->read_ptr];
+		assert (cb->net_buffer != 0);
+
+		u32 dma_length_status = dmadesc_get_length_status (cb->bd_addr);
+		u32 dma_flag = dma_length_status & 0xFFFF;
+		int nLength = dma_length_status >> DMA_BUFLENGTH_SHIFT;
+
+		boolean bRecycle = TRUE;		// keep the buffer in the ring?
+
+		if (   !(dma_flag & DMA_EOP)
+		    || !(dma_flag & DMA_SOP))
+		{
+			CLogger::Get ()->Write (FromBcm54213, LogWarning,
+						"Dropping fragmented RX packet!");
+		}
+		else if (dma_flag & (DMA_RX_CRC_ERROR | DMA_RX_OV | DMA_RX_NO | DMA_RX_LG | DMA_RX_RXER))
+		{
+			// report errors
+			CLogger::Get ()->Write (FromBcm54213, LogWarning, "RX error (0x%x)",
+						(unsigned) dma_flag);
+		}
+		else
+		{
+			// the CPU may have fetched lines of the buffer speculatively during DMA,
+			// the frame must be read from memory, before it is copied or handed over
+			CleanAndInvalidateDataCacheRange ((u32) (uintptr) cb->buffer, nLength);
+
+#define LEADING_PAD	2
+			nLength -= LEADING_PAD;		// remove HW 2 bytes added for IP alignment
+
+			if (m_crc_fwd_en)
+			{
+				nLength -= ETH_FCS_LEN;
+			}
+
+			assert (nLength > 0);
+			assert (nLength <= FRAME_BUFFER_SIZE);
+
+			if (ppBuffer != 0)
+			{
+				// hand over the buffer and put a new one on the ring
+				CNetBuffer *pNetBuffer = rx_refill (cb);
+				if (pNetBuffer != 0)
+				{
+					pNetBuffer->SetLength (LEADING_PAD + nLength);
+					pNetBuffer->Pull (LEADING_PAD);
+
+					if (   m_rx_csum_en
+					    && (dma_flag & DMA_RX_CHK_V3PLUS))
+					{
+						pNetBuffer->SetChecksumVerified ();
+					}
+
+					*ppBuffer = pNetBuffer;
+
+					bRecycle = FALSE;
+					bResult = TRUE;
+				}
+				else
+				{
+					// the frame is dropped, the buffer stays on the ring
+					CLogger::Get ()->Write (FromBcm54213, LogWarning,
+								"Missing RX buffer!");
+				}
+			}
+			else
+			{
+				memcpy (pBuffer, cb->buffer+LEADING_PAD, nLength);
+
+				*pResultLength = nLength;
+
+				bResult = TRUE;
+			}
+		}
+
+		if (bRecycle)
+		{
+			// prepare buffer for next DMA
+			CleanAndInvalidateDataCacheRange ((u32) (uintptr) cb->buffer, RX_BUF_LENGTH);
+		}
+
+		if (ring->read_ptr < ring->end_ptr)
+		{
+			ring->read_ptr++;
+		}
+		else
+		{
+			ring->read_ptr = ring->cb_ptr;
+		}
+
+		ring->c_index = (ring->c_index + 1) & DMA_C_INDEX_MASK;
+
+		if (   ++ring->pending_bds >= RX_CONS_INDEX_BATCH
+		    || ring->c_index == p_index)
+		{
+			rdma_ring_writel (ring->index, ring->c_index, RDMA_CONS_INDEX);
+			ring->pending_bds = 0;
+		}
+	}
+
+	return bResult;
 }
 
 // Combined address + length/status setter
@@ -1564,6 +1853,11 @@ void CBcm54213Device::InterruptHandler0 (void)
 	// clear interrupts
 	intrl2_0_writel(status, INTRL2_CPU_CLEAR);
 
+	if (status & UMAC_IRQ_RXDMA_DONE) {
+		// mask Rx interrupt, until the Rx rings have been drained in rx_poll()
+		intrl2_0_writel(UMAC_IRQ_RXDMA_DONE, INTRL2_CPU_MASK_SET);
+	}
+
 	if (status & UMAC_IRQ_TXDMA_DONE) {
 		m_TxSpinLock.Acquire ();
 
@@ -1572,6 +1866,11 @@ void CBcm54213Device::InterruptHandler0 (void)
 
 		m_TxSpinLock.Release ();
 	}
+
+	if (   (status & (UMAC_IRQ_RXDMA_DONE | UMAC_IRQ_TXDMA_DONE))
+	    && m_pEventHandler != 0) {
+		(*m_pEventHandler) (m_pEventParam);
+	}
 }
 
 // handle Rx and Tx priority queues
@@ -1596,6 +1895,16 @@ void CBcm54213Device::InterruptHandler1 (void)
 	}
 
 	m_TxSpinLock.Release ();
+
+	if (status & RX_QUEUES_INTR_MASK) {
+		// mask Rx interrupts, until the Rx rings have been drained in rx_poll()
+		intrl2_1_writel(RX_QUEUES_INTR_MASK, INTRL2_CPU_MASK_SET);
+	}
+
+	if (   (status & (UMAC_IRQ1_TX_INTR_MASK | RX_QUEUES_INTR_MASK))
+	    && m_pEventHandler != 0) {
+		(*m_pEventHandler) (m_pEventParam);
+	}
 }
 
 void CBcm54213Device::InterruptStub0 (void *pParam)
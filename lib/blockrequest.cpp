@@ -0,0 +1,91 @@
+//
+// blockrequest.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/blockrequest.h>
+#include <circle/blockrequestqueue.h>
+#include <assert.h>
+
+CBlockRequest::CBlockRequest (TBlockRequestType Type, void *pBuffer, size_t nCount, u64 ullOffset)
+:	m_Type (Type),
+	m_pBuffer (pBuffer),
+	m_nCount (nCount),
+	m_ullOffset (ullOffset),
+	m_pCompletionRoutine (0),
+	m_pCompletionParam (0),
+	m_bCompleted (FALSE),
+	m_nResult (-1),
+	m_pQueue (0),
+	m_pNext (0),
+	m_nSequence (0)
+{
+	assert (m_Type < BlockRequestUnknown);
+	assert (m_pBuffer != 0);
+}
+
+CBlockRequest::~CBlockRequest (void)
+{
+	m_pCompletionRoutine = 0;
+	m_pBuffer = 0;
+}
+
+void CBlockRequest::SetCompletionRoutine (TBlockRequestCompletionRoutine *pRoutine, void *pParam)
+{
+	assert (!m_bCompleted);
+
+	m_pCompletionRoutine = pRoutine;
+	m_pCompletionParam = pParam;
+}
+
+int CBlockRequest::Wait (void)
+{
+#ifdef NO_BUSY_WAIT
+	m_Event.Wait ();
+#else
+	while (!m_bCompleted)
+	{
+		// the request has to be submitted before
+		assert (m_pQueue != 0);
+		m_pQueue->ProcessNext ();
+	}
+#endif
+
+	return m_nResult;
+}
+
+void CBlockRequest::Complete (int nResult)
+{
+	assert (!m_bCompleted);
+
+	// the request may be deleted by the completion routine or the waiting task
+	TBlockRequestCompletionRoutine *pRoutine = m_pCompletionRoutine;
+	void *pParam = m_pCompletionParam;
+
+	m_nResult = nResult;
+	m_pQueue = 0;
+	m_bCompleted = TRUE;
+
+#ifdef NO_BUSY_WAIT
+	m_Event.Set ();
+#endif
+
+	if (pRoutine != 0)
+	{
+		(*pRoutine) (this, pParam);
+	}
+}
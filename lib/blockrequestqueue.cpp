@@ -0,0 +1,408 @@
+//
+// blockrequestqueue.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/blockrequestqueue.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#ifdef NO_BUSY_WAIT
+
+#include <circle/sched/task.h>
+
+class CBlockRequestTask : public CTask	// executes the requests of one queue
+{
+public:
+	CBlockRequestTask (CBlockRequestQueue *pQueue)
+	:	m_pQueue (pQueue),
+		m_bTerminate (FALSE)
+	{
+		SetName ("blockio");
+	}
+
+	void Run (void)
+	{
+		assert (m_pQueue != 0);
+
+		while (!m_bTerminate)
+		{
+			m_pQueue->m_Event.Clear ();
+
+			if (!m_pQueue->ProcessNext ())
+			{
+				m_pQueue->m_IdleEvent.Set ();
+
+				m_pQueue->m_Event.Wait ();
+			}
+		}
+	}
+
+	void Stop (void)
+	{
+		m_bTerminate = TRUE;
+		m_pQueue->m_Event.Set ();
+
+		WaitForTermination ();
+	}
+
+private:
+	CBlockRequestQueue *m_pQueue;
+	volatile boolean m_bTerminate;
+};
+
+#endif
+
+CBlockRequestQueue::CBlockRequestQueue (unsigned nBlockSize, size_t nMaxTransferSize,
+					TBlockTransferHandler *pHandler, void *pParam)
+:	m_nBlockSize (nBlockSize),
+	m_nMaxTransferSize (nMaxTransferSize),
+	m_pHandler (pHandler),
+	m_pParam (pParam),
+	m_pList (0),
+	m_nSequence (0),
+	m_ullNextOffset (0),
+	m_pMergeBuffer (0),
+	m_SpinLock (TASK_LEVEL)
+#ifdef NO_BUSY_WAIT
+	, m_pTask (0),
+	m_IdleEvent (TRUE)
+#endif
+{
+	assert (m_nBlockSize > 0);
+	assert (m_nMaxTransferSize >= m_nBlockSize);
+	assert (m_pHandler != 0);
+}
+
+CBlockRequestQueue::~CBlockRequestQueue (void)
+{
+#ifdef NO_BUSY_WAIT
+	if (m_pTask != 0)
+	{
+		m_pTask->Stop ();		// the task is deleted by the scheduler
+		m_pTask = 0;
+	}
+#endif
+
+	while (m_pList != 0)
+	{
+		CBlockRequest *pRequest = m_pList;
+		m_pList = pRequest->m_pNext;
+
+		pRequest->Complete (-1);
+	}
+
+	delete [] m_pMergeBuffer;
+	m_pMergeBuffer = 0;
+
+	m_pHandler = 0;
+}
+
+boolean CBlockRequestQueue::Submit (CBlockRequest *pRequest)
+{
+	assert (pRequest != 0);
+
+	if (   pRequest->m_Type >= BlockRequestUnknown
+	    || pRequest->m_nCount == 0
+	    || pRequest->m_nCount % m_nBlockSize != 0
+	    || pRequest->m_ullOffset % m_nBlockSize != 0)
+	{
+		return FALSE;
+	}
+
+	pRequest->m_bCompleted = FALSE;
+	pRequest->m_nResult = -1;
+	pRequest->m_pQueue = this;
+#ifdef NO_BUSY_WAIT
+	pRequest->m_Event.Clear ();
+#endif
+
+	m_SpinLock.Acquire ();
+
+	pRequest->m_nSequence = m_nSequence++;
+
+	// insert sorted by offset, behind requests with the same offset
+	CBlockRequest **ppPrev = &m_pList;
+	while (   *ppPrev != 0
+	       && (*ppPrev)->m_ullOffset <= pRequest->m_ullOffset)
+	{
+		ppPrev = &(*ppPrev)->m_pNext;
+	}
+
+	pRequest->m_pNext = *ppPrev;
+	*ppPrev = pRequest;
+
+	m_SpinLock.Release ();
+
+#ifdef NO_BUSY_WAIT
+	if (m_pTask == 0)
+	{
+		m_pTask = new CBlockRequestTask (this);
+		assert (m_pTask != 0);
+	}
+
+	m_IdleEvent.Clear ();
+	m_Event.Set ();
+#endif
+
+	return TRUE;
+}
+
+int CBlockRequestQueue::Transfer (TBlockRequestType Type, void *pBuffer, size_t nCount,
+				  u64 ullOffset)
+{
+	CBlockRequest Request (Type, pBuffer, nCount, ullOffset);
+	if (!Submit (&Request))
+	{
+		return -1;
+	}
+
+	return Request.Wait ();
+}
+
+void CBlockRequestQueue::Flush (void)
+{
+#ifdef NO_BUSY_WAIT
+	m_IdleEvent.Wait ();
+#else
+	while (ProcessNext ())
+	{
+		// just continue
+	}
+#endif
+}
+
+boolean CBlockRequestQueue::ProcessNext (void)
+{
+	CBlockRequest *pFirst = GetNext ();
+	if (pFirst == 0)
+	{
+		return FALSE;
+	}
+
+	Execute (pFirst);
+
+	return TRUE;
+}
+
+CBlockRequest *CBlockRequestQueue::GetNext (void)
+{
+	m_SpinLock.Acquire ();
+
+	// C-LOOK elevator: continue upwards from the end of the last transfer,
+	// restart from the lowest offset, if there is no request above it
+	CBlockRequest *pFirst = 0;
+	for (CBlockRequest *pRequest = m_pList; pRequest != 0; pRequest = pRequest->m_pNext)
+	{
+		if (   pRequest->m_ullOffset >= m_ullNextOffset
+		    && !IsBlocked (pRequest))
+		{
+			pFirst = pRequest;
+
+			break;
+		}
+	}
+
+	if (pFirst == 0)
+	{
+		for (CBlockRequest *pRequest = m_pList; pRequest != 0; pRequest = pRequest->m_pNext)
+		{
+			if (!IsBlocked (pRequest))
+			{
+				pFirst = pRequest;
+
+				break;
+			}
+		}
+
+		if (pFirst == 0)
+		{
+			// the oldest request is never blocked, so the list must be empty
+			assert (m_pList == 0);
+
+			m_SpinLock.Release ();
+
+			return 0;
+		}
+	}
+
+	Remove (pFirst);
+
+	// append adjacent requests of the same type
+	CBlockRequest *pLast = pFirst;
+	size_t nTotal = pFirst->m_nCount;
+	u64 ullEnd = pFirst->m_ullOffset + pFirst->m_nCount;
+
+	CBlockRequest *pNext;
+	for (CBlockRequest *pRequest = m_pList; pRequest != 0; pRequest = pNext)
+	{
+		pNext = pRequest->m_pNext;
+
+		if (pRequest->m_ullOffset > ullEnd)
+		{
+			break;
+		}
+
+		if (   pRequest->m_ullOffset == ullEnd
+		    && pRequest->m_Type == pFirst->m_Type
+		    && nTotal + pRequest->m_nCount <= m_nMaxTransferSize
+		    && !IsBlocked (pRequest))
+		{
+			Remove (pRequest);
+
+			pLast->m_pNext = pRequest;
+			pLast = pRequest;
+
+			nTotal += pRequest->m_nCount;
+			ullEnd += pRequest->m_nCount;
+		}
+	}
+
+	m_ullNextOffset = ullEnd;
+
+	m_SpinLock.Release ();
+
+	return pFirst;
+}
+
+// A request must not overtake an older request for an overlapping range,
+// if one of them is a write request.
+boolean CBlockRequestQueue::IsBlocked (CBlockRequest *pRequest) const
+{
+	assert (pRequest != 0);
+
+	for (const CBlockRequest *pOther = m_pList; pOther != 0; pOther = pOther->m_pNext)
+	{
+		if (   pOther != pRequest
+		    && (int) (pOther->m_nSequence - pRequest->m_nSequence) < 0
+		    && (   pOther->m_Type == BlockRequestWrite
+			|| pRequest->m_Type == BlockRequestWrite)
+		    && Overlaps (pOther, pRequest))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CBlockRequestQueue::Remove (CBlockRequest *pRequest)
+{
+	CBlockRequest **ppPrev = &m_pList;
+	while (*ppPrev != pRequest)
+	{
+		assert (*ppPrev != 0);
+		ppPrev = &(*ppPrev)->m_pNext;
+	}
+
+	*ppPrev = pRequest->m_pNext;
+	pRequest->m_pNext = 0;
+}
+
+void CBlockRequestQueue::Execute (CBlockRequest *pFirst)
+{
+	assert (pFirst != 0);
+	assert (m_pHandler != 0);
+
+	TBlockRequestType Type = pFirst->m_Type;
+
+	// are the buffers of merged requests contiguous in memory?
+	size_t nTotal = 0;
+	boolean bContiguous = TRUE;
+	for (CBlockRequest *pRequest = pFirst; pRequest != 0; pRequest = pRequest->m_pNext)
+	{
+		if ((u8 *) pRequest->m_pBuffer != (u8 *) pFirst->m_pBuffer + nTotal)
+		{
+			bContiguous = FALSE;
+		}
+
+		nTotal += pRequest->m_nCount;
+	}
+
+	u8 *pBuffer = (u8 *) pFirst->m_pBuffer;
+	if (!bContiguous)
+	{
+		if (m_pMergeBuffer == 0)
+		{
+			m_pMergeBuffer = new u8[m_nMaxTransferSize];
+		}
+
+		if (m_pMergeBuffer == 0)
+		{
+			// execute the requests one by one
+			CBlockRequest *pNext;
+			for (CBlockRequest *pRequest = pFirst; pRequest != 0; pRequest = pNext)
+			{
+				pNext = pRequest->m_pNext;
+
+				pRequest->Complete ((*m_pHandler) (Type, pRequest->m_pBuffer,
+								   pRequest->m_nCount,
+								   pRequest->m_ullOffset, m_pParam));
+			}
+
+			return;
+		}
+
+		assert (nTotal <= m_nMaxTransferSize);
+		pBuffer = m_pMergeBuffer;
+
+		if (Type == BlockRequestWrite)
+		{
+			u8 *p = pBuffer;
+			for (CBlockRequest *pRequest = pFirst; pRequest != 0; pRequest = pRequest->m_pNext)
+			{
+				memcpy (p, pRequest->m_pBuffer, pRequest->m_nCount);
+				p += pRequest->m_nCount;
+			}
+		}
+	}
+
+	int nResult = (*m_pHandler) (Type, pBuffer, nTotal, pFirst->m_ullOffset, m_pParam);
+
+	CBlockRequest *pNext;
+	for (CBlockRequest *pRequest = pFirst; pRequest != 0; pRequest = pNext)
+	{
+		pNext = pRequest->m_pNext;
+
+		if (nResult == (int) nTotal)
+		{
+			if (   !bContiguous
+			    && Type == BlockRequestRead)
+			{
+				memcpy (pRequest->m_pBuffer, pBuffer, pRequest->m_nCount);
+			}
+
+			pBuffer += pRequest->m_nCount;
+
+			pRequest->Complete (pRequest->m_nCount);
+		}
+		else
+		{
+			pRequest->Complete (-1);
+		}
+	}
+}
+
+boolean CBlockRequestQueue::Overlaps (const CBlockRequest *pRequest1,
+				      const CBlockRequest *pRequest2)
+{
+	assert (pRequest1 != 0);
+	assert (pRequest2 != 0);
+
+	return    pRequest1->m_ullOffset < pRequest2->m_ullOffset + pRequest2->m_nCount
+	       && pRequest2->m_ullOffset < pRequest1->m_ullOffset + pRequest1->m_nCount;
+}
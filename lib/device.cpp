@@ -2,7 +2,7 @@
 // device.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -66,6 +66,29 @@ u64 CDevice::GetSize (void) const
 	return (u64) -1;
 }
 
+boolean CDevice::SubmitRequest (CBlockRequest *pRequest)
+{
+	assert (pRequest != 0);
+	if (Seek (pRequest->GetOffset ()) != pRequest->GetOffset ())
+	{
+		return FALSE;
+	}
+
+	int nResult;
+	if (pRequest->GetType () == BlockRequestRead)
+	{
+		nResult = Read (pRequest->GetBuffer (), pRequest->GetCount ());
+	}
+	else
+	{
+		nResult = Write (pRequest->GetBuffer (), pRequest->GetCount ());
+	}
+
+	pRequest->Complete (nResult);
+
+	return TRUE;
+}
+
 int CDevice::IOCtl (unsigned long ulCmd, void *pData)
 {
 	return -1;
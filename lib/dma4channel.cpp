@@ -2,7 +2,7 @@
 // dmachannel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -102,10 +102,17 @@ CDMA4Channel::CDMA4Channel (unsigned nChannel, CInterruptSystem *pInterruptSyste
 :	m_nChannel (nChannel),
 	m_pControlBlockBuffer (0),
 	m_pControlBlock (0),
+	m_pSegmentInfo (0),
+	m_nMaxSegments (0),
+	m_nSegments (0),
+	m_nNextSegment (0),
+	m_bCyclic (FALSE),
 	m_pInterruptSystem (pInterruptSystem),
 	m_bIRQConnected (FALSE),
 	m_pCompletionRoutine (0),
 	m_pCompletionParam (0),
+	m_pSegmentRoutine (0),
+	m_pSegmentParam (0),
 	m_bStatus (FALSE)
 {
 	PeripheralEntry();
@@ -115,11 +122,7 @@ CDMA4Channel::CDMA4Channel (unsigned nChannel, CInterruptSystem *pInterruptSyste
 	assert (   (read32 (ARM_DMA4CHAN_DEBUG (m_nChannel)) & DEBUG4_VERSION_MASK)
 		>> DEBUG4_VERSION_SHIFT == DMA4_VERSION);
 
-	m_pControlBlockBuffer = new (HEAP_ANY) u8[sizeof (TDMA4ControlBlock) + 31];
-	assert (m_pControlBlockBuffer != 0);
-
-	m_pControlBlock = (TDMA4ControlBlock *) (((uintptr) m_pControlBlockBuffer + 31) & ~31);
-	m_pControlBlock->nReserved = 0;
+	AllocateChain (1);
 
 	write32 (ARM_DMA4CHAN_CONBLK_AD (m_nChannel), 0);
 	write32 (ARM_DMA_ENABLE, read32 (ARM_DMA_ENABLE) | (1 << m_nChannel));
@@ -142,6 +145,7 @@ CDMA4Channel::~CDMA4Channel (void)
 	write32 (ARM_DMA_ENABLE, read32 (ARM_DMA_ENABLE) & ~(1 << m_nChannel));
 
 	m_pCompletionRoutine = 0;
+	m_pSegmentRoutine = 0;
 
 	if (m_pInterruptSystem != 0)
 	{
@@ -158,50 +162,122 @@ CDMA4Channel::~CDMA4Channel (void)
 
 	delete [] m_pControlBlockBuffer;
 	m_pControlBlockBuffer = 0;
+
+	delete [] m_pSegmentInfo;
+	m_pSegmentInfo = 0;
 }
 
 void CDMA4Channel::SetupMemCopy (void *pDestination, const void *pSource, size_t nLength,
 				unsigned nBurstLength, boolean bCached)
+{
+	SetupChain (1);
+	AddMemCopy (pDestination, pSource, nLength, nBurstLength, bCached);
+}
+
+void CDMA4Channel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ)
+{
+	SetupChain (1);
+	AddIORead (pDestination, nIOAddress, nLength, DREQ);
+}
+
+void CDMA4Channel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
+{
+	SetupChain (1);
+	AddIOWrite (nIOAddress, pSource, nLength, DREQ);
+}
+
+void CDMA4Channel::SetupMemCopy2D (void *pDestination, const void *pSource,
+				  size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
+				  unsigned nBurstLength)
 {
 	assert (pDestination != 0);
 	assert (pSource != 0);
-	assert (nLength > 0);
+	assert (nBlockLength > 0);
+	assert (nBlockLength <= LEN4_XLENGTH_2D_MAX);
+	assert (nBlockCount > 0);
+	assert (nBlockCount <= LEN4_YLENGTH_MAX);
+	assert (nBlockStride <= DEST4_STRIDE_MAX);
 	assert (nBurstLength <= BURST4_MAX);
 
-	assert (m_pControlBlock != 0);
+	SetupChain (1);
+	TDMA4ControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   TI4_WAIT_RD_RESP
+						  | TI4_WAIT_RESP
+						  | TI4_TDMODE;
+	pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
+	pControlBlock->nSourceInformation	=   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
+						  | SOURCE4_INC
+						  | (nBurstLength << SOURCE4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pSource)
+						    << SOURCE4_ADDR_SHIFT);
+	pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
+	pControlBlock->nDestinationInformation  =   (nBlockStride << DEST4_STRIDE_SHIFT)
+						  | (SIZE4_128 << DEST4_SIZE_SHIFT)
+						  | DEST4_INC
+						  | (nBurstLength << DEST4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pDestination)
+						    << DEST4_ADDR_SHIFT);
+	pControlBlock->nTransferLength          =   ((nBlockCount-1) << LEN4_YLENGTH_SHIFT)
+						  | (nBlockLength << LEN4_XLENGTH_SHIFT);
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[0];
+	pInfo->nSourceAddress = (uintptr) pSource;
+	pInfo->nSourceLength = nBlockLength*nBlockCount;
+}
+
+void CDMA4Channel::SetupChain (unsigned nMaxSegments)
+{
+	assert (nMaxSegments > 0);
+	if (nMaxSegments > m_nMaxSegments)
+	{
+		AllocateChain (nMaxSegments);
+	}
+
+	m_nSegments = 0;
+	m_bCyclic = FALSE;
+}
+
+unsigned CDMA4Channel::AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+				   unsigned nBurstLength, boolean bCached)
+{
+	assert (pDestination != 0);
+	assert (pSource != 0);
+	assert (nLength > 0);
+	assert (nBurstLength <= BURST4_MAX);
 	assert (nLength <= LEN4_XLENGTH_MAX);
 
-	m_pControlBlock->nTransferInformation     =   0;
-	m_pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
-	m_pControlBlock->nSourceInformation	  =   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
-						    | SOURCE4_INC
-						    | (nBurstLength << SOURCE4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pSource)
-						      << SOURCE4_ADDR_SHIFT);
-	m_pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
-	m_pControlBlock->nDestinationInformation  =   (SIZE4_128 << DEST4_SIZE_SHIFT)
-						    | DEST4_INC
-						    | (nBurstLength << DEST4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pDestination)
-						      << DEST4_ADDR_SHIFT);
-	m_pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
-	m_pControlBlock->nNextControlBlockAddress = 0;
+	TDMA4ControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   0;
+	pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
+	pControlBlock->nSourceInformation	=   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
+						  | SOURCE4_INC
+						  | (nBurstLength << SOURCE4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pSource)
+						    << SOURCE4_ADDR_SHIFT);
+	pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
+	pControlBlock->nDestinationInformation  =   (SIZE4_128 << DEST4_SIZE_SHIFT)
+						  | DEST4_INC
+						  | (nBurstLength << DEST4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pDestination)
+						    << DEST4_ADDR_SHIFT);
+	pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
 
 	if (bCached)
 	{
-		m_nDestinationAddress = (uintptr) pDestination;
-		m_nBufferLength = nLength;
-
-		CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
-		CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
-	}
-	else
-	{
-		m_nDestinationAddress = 0;
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+		pInfo->nDestinationAddress = (uintptr) pDestination;
+		pInfo->nDestinationLength = nLength;
+		pInfo->nSourceAddress = (uintptr) pSource;
+		pInfo->nSourceLength = nLength;
 	}
+
+	return m_nSegments-1;
 }
 
-void CDMA4Channel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ)
+unsigned CDMA4Channel::AddIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ,
+				   boolean bWordWrites)
 {
 	assert (pDestination != 0);
 	assert (nLength > 0);
@@ -211,31 +287,33 @@ void CDMA4Channel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLeng
 	assert (nIOAddress != 0);
 	nIOAddress += GPU_IO_BASE;
 
-	assert (m_pControlBlock != 0);
-	m_pControlBlock->nTransferInformation     =   TI4_SRC_DREQ
-						    | (DREQ << TI4_PERMAP_SHIFT)
-						    | TI4_WAIT_RD_RESP
-						    | TI4_WAIT_RESP;
-	m_pControlBlock->nSourceAddress           = nIOAddress;
-	m_pControlBlock->nSourceInformation	  =   (SIZE4_32 << SOURCE4_SIZE_SHIFT)
-						    | (BURST4_DEFAULT << SOURCE4_BURST_LEN_SHIFT)
-						    | (FULL35_ADDR_OFFSET << SOURCE4_ADDR_SHIFT);
-	m_pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
-	m_pControlBlock->nDestinationInformation  =   (SIZE4_128 << DEST4_SIZE_SHIFT)
-						    | DEST4_INC
-						    | (BURST4_DEFAULT << DEST4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pDestination)
-						      << DEST4_ADDR_SHIFT);
-	m_pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = (uintptr) pDestination;
-	m_nBufferLength = nLength;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
+	TDMA4ControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   TI4_SRC_DREQ
+						  | (DREQ << TI4_PERMAP_SHIFT)
+						  | TI4_WAIT_RD_RESP
+						  | TI4_WAIT_RESP;
+	pControlBlock->nSourceAddress           = nIOAddress;
+	pControlBlock->nSourceInformation	=   (SIZE4_32 << SOURCE4_SIZE_SHIFT)
+						  | (BURST4_DEFAULT << SOURCE4_BURST_LEN_SHIFT)
+						  | (FULL35_ADDR_OFFSET << SOURCE4_ADDR_SHIFT);
+	pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
+	pControlBlock->nDestinationInformation  =   ((bWordWrites ? SIZE4_32 : SIZE4_128)
+						     << DEST4_SIZE_SHIFT)
+						  | DEST4_INC
+						  | (BURST4_DEFAULT << DEST4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pDestination)
+						    << DEST4_ADDR_SHIFT);
+	pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+	pInfo->nDestinationAddress = (uintptr) pDestination;
+	pInfo->nDestinationLength = nLength;
+
+	return m_nSegments-1;
 }
 
-void CDMA4Channel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
+unsigned CDMA4Channel::AddIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
 {
 	assert (pSource != 0);
 	assert (nLength > 0);
@@ -245,82 +323,39 @@ void CDMA4Channel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLe
 	assert (nIOAddress != 0);
 	nIOAddress += GPU_IO_BASE;
 
-	assert (m_pControlBlock != 0);
-	m_pControlBlock->nTransferInformation     =   TI4_DEST_DREQ
-						    | (DREQ << TI4_PERMAP_SHIFT)
-						    | TI4_WAIT_RD_RESP
-						    | TI4_WAIT_RESP;
-	m_pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
-	m_pControlBlock->nSourceInformation	  =   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
-						    | SOURCE4_INC
-						    | (BURST4_DEFAULT << SOURCE4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pSource)
-						      << SOURCE4_ADDR_SHIFT);
-	m_pControlBlock->nDestinationAddress      = nIOAddress;
-	m_pControlBlock->nDestinationInformation  =   (SIZE4_32 << DEST4_SIZE_SHIFT)
-						    | (BURST4_DEFAULT << DEST4_BURST_LEN_SHIFT)
-						    | (FULL35_ADDR_OFFSET << DEST4_ADDR_SHIFT);
-	m_pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = 0;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
+	TDMA4ControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   TI4_DEST_DREQ
+						  | (DREQ << TI4_PERMAP_SHIFT)
+						  | TI4_WAIT_RD_RESP
+						  | TI4_WAIT_RESP;
+	pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
+	pControlBlock->nSourceInformation	=   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
+						  | SOURCE4_INC
+						  | (BURST4_DEFAULT << SOURCE4_BURST_LEN_SHIFT)
+						  |    (ADDRESS4_HIGH (pSource)
+						    << SOURCE4_ADDR_SHIFT);
+	pControlBlock->nDestinationAddress      = nIOAddress;
+	pControlBlock->nDestinationInformation  =   (SIZE4_32 << DEST4_SIZE_SHIFT)
+						  | (BURST4_DEFAULT << DEST4_BURST_LEN_SHIFT)
+						  | (FULL35_ADDR_OFFSET << DEST4_ADDR_SHIFT);
+	pControlBlock->nTransferLength          = nLength << LEN4_XLENGTH_SHIFT;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+	pInfo->nSourceAddress = (uintptr) pSource;
+	pInfo->nSourceLength = nLength;
+
+	return m_nSegments-1;
 }
 
-void CDMA4Channel::SetupMemCopy2D (void *pDestination, const void *pSource,
-				  size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
-				  unsigned nBurstLength)
+void CDMA4Channel::SetCyclic (boolean bCyclic)
 {
-	assert (pDestination != 0);
-	assert (pSource != 0);
-	assert (nBlockLength > 0);
-	assert (nBlockLength <= LEN4_XLENGTH_2D_MAX);
-	assert (nBlockCount > 0);
-	assert (nBlockCount <= LEN4_YLENGTH_MAX);
-	assert (nBlockStride <= DEST4_STRIDE_MAX);
-	assert (nBurstLength <= BURST4_MAX);
-
-	assert (m_pControlBlock != 0);
-
-	m_pControlBlock->nTransferInformation     =   TI4_WAIT_RD_RESP
-						    | TI4_WAIT_RESP
-						    | TI4_TDMODE;
-	m_pControlBlock->nSourceAddress           = ADDRESS4_LOW (pSource);
-	m_pControlBlock->nSourceInformation	  =   (SIZE4_128 << SOURCE4_SIZE_SHIFT)
-						    | SOURCE4_INC
-						    | (nBurstLength << SOURCE4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pSource)
-						      << SOURCE4_ADDR_SHIFT);
-	m_pControlBlock->nDestinationAddress      = ADDRESS4_LOW (pDestination);
-	m_pControlBlock->nDestinationInformation  =   (nBlockStride << DEST4_STRIDE_SHIFT)
-						    | (SIZE4_128 << DEST4_SIZE_SHIFT)
-						    | DEST4_INC
-						    | (nBurstLength << DEST4_BURST_LEN_SHIFT)
-						    |    (ADDRESS4_HIGH (pDestination)
-						      << DEST4_ADDR_SHIFT);
-	m_pControlBlock->nTransferLength          =   ((nBlockCount-1) << LEN4_YLENGTH_SHIFT)
-						    | (nBlockLength << LEN4_XLENGTH_SHIFT);
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = 0;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pSource, nBlockLength*nBlockCount);
+	m_bCyclic = bCyclic;
 }
 
 void CDMA4Channel::SetCompletionRoutine (TDMACompletionRoutine *pRoutine, void *pParam)
 {
-	assert (m_nChannel >= DMA4_CHANNEL_MIN);
-	assert (m_nChannel <= DMA4_CHANNEL_MAX);
-	assert (m_pInterruptSystem != 0);
-
-	if (!m_bIRQConnected)
-	{
-		assert (m_nChannel >= 11);
-		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_DMA11+m_nChannel-11, InterruptStub, this);
-
-		m_bIRQConnected = TRUE;
-	}
+	ConnectIRQ ();
 
 	m_pCompletionRoutine = pRoutine;
 	assert (m_pCompletionRoutine != 0);
@@ -328,19 +363,68 @@ void CDMA4Channel::SetCompletionRoutine (TDMACompletionRoutine *pRoutine, void *
 	m_pCompletionParam = pParam;
 }
 
+void CDMA4Channel::SetSegmentRoutine (TDMASegmentRoutine *pRoutine, void *pParam)
+{
+	ConnectIRQ ();
+
+	m_pSegmentRoutine = pRoutine;
+	assert (m_pSegmentRoutine != 0);
+
+	m_pSegmentParam = pParam;
+}
+
 void CDMA4Channel::Start (void)
 {
 	assert (m_nChannel >= DMA4_CHANNEL_MIN);
 	assert (m_nChannel <= DMA4_CHANNEL_MAX);
 	assert (m_pControlBlock != 0);
+	assert (m_nSegments > 0);
+	assert (!m_bCyclic || m_pSegmentRoutine != 0);
+	assert (!m_bCyclic || m_nSegments >= 2);	// see SetCyclic()
 
-	if (m_pCompletionRoutine != 0)
+	// link the control blocks and do the cache maintenance for the source buffers
+	for (unsigned i = 0; i < m_nSegments; i++)
 	{
-		assert (m_pInterruptSystem != 0);
-		assert (m_bIRQConnected);
-		m_pControlBlock->nTransferInformation |= TI4_INTEN;
+		TDMA4ControlBlock *pControlBlock = &m_pControlBlock[i];
+
+		if (i < m_nSegments-1)
+		{
+			pControlBlock->nNextControlBlockAddress =
+				(uintptr) &m_pControlBlock[i+1] >> CONBLK_AD4_ADDR_SHIFT;
+		}
+		else
+		{
+			pControlBlock->nNextControlBlockAddress =
+				m_bCyclic ? (uintptr) &m_pControlBlock[0] >> CONBLK_AD4_ADDR_SHIFT : 0;
+		}
+
+		if (   m_pSegmentRoutine != 0
+		    || (   m_pCompletionRoutine != 0
+			&& i == m_nSegments-1))
+		{
+			assert (m_pInterruptSystem != 0);
+			assert (m_bIRQConnected);
+			pControlBlock->nTransferInformation |= TI4_INTEN;
+		}
+
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[i];
+		if (pInfo->nSourceAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nSourceAddress, pInfo->nSourceLength);
+		}
+
+		if (pInfo->nDestinationAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nDestinationAddress,
+							  pInfo->nDestinationLength);
+		}
 	}
 
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock,
+					  m_nSegments * sizeof (TDMA4ControlBlock));
+
+	m_nNextSegment = 0;
+
 	PeripheralEntry ();
 
 	assert (!(read32 (ARM_DMA4CHAN_CS (m_nChannel)) & CS4_INT));
@@ -349,8 +433,6 @@ void CDMA4Channel::Start (void)
 	write32 (ARM_DMA4CHAN_CONBLK_AD (m_nChannel),
 		 (uintptr) m_pControlBlock >> CONBLK_AD4_ADDR_SHIFT);
 
-	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock, sizeof *m_pControlBlock);
-
 	write32 (ARM_DMA4CHAN_CS (m_nChannel),   CS4_WAIT_FOR_OUTSTANDING_WRITES
 					      | (DEFAULT_PANIC_QOS4 << CS4_PANIC_QOS_SHIFT)
 					      | (DEFAULT_QOS4 << CS4_QOS_SHIFT)
@@ -364,6 +446,8 @@ boolean CDMA4Channel::Wait (void)
 	assert (m_nChannel >= DMA4_CHANNEL_MIN);
 	assert (m_nChannel <= DMA4_CHANNEL_MAX);
 	assert (m_pCompletionRoutine == 0);
+	assert (m_pSegmentRoutine == 0);
+	assert (!m_bCyclic);
 
 	PeripheralEntry ();
 
@@ -375,10 +459,7 @@ boolean CDMA4Channel::Wait (void)
 
 	m_bStatus = nCS & CS4_ERROR ? FALSE : TRUE;
 
-	if (m_nDestinationAddress != 0)
-	{
-		CleanAndInvalidateDataCacheRange (m_nDestinationAddress, m_nBufferLength);
-	}
+	CompleteSegments (m_nSegments);
 
 	PeripheralExit();
 
@@ -394,13 +475,134 @@ boolean CDMA4Channel::GetStatus (void)
 	return m_bStatus;
 }
 
-void CDMA4Channel::InterruptHandler (void)
+void CDMA4Channel::Cancel (void)
+{
+	assert (m_nChannel >= DMA4_CHANNEL_MIN);
+	assert (m_nChannel <= DMA4_CHANNEL_MAX);
+
+	PeripheralEntry ();
+
+	write32 (ARM_DMA4CHAN_DEBUG (m_nChannel), DEBUG4_RESET);
+	CTimer::SimpleusDelay (1000);
+
+	write32 (ARM_DMA4CHAN_CS (m_nChannel), CS4_INT);
+	write32 (ARM_DMA_INT_STATUS, 1 << m_nChannel);
+
+	PeripheralExit ();
+
+	m_bCyclic = FALSE;
+	m_bStatus = FALSE;
+}
+
+uintptr CDMA4Channel::GetDestinationAddress (void)
 {
-	if (m_nDestinationAddress != 0)
+	assert (m_nChannel >= DMA4_CHANNEL_MIN);
+	assert (m_nChannel <= DMA4_CHANNEL_MAX);
+
+	PeripheralEntry ();
+
+	uintptr nAddress = read32 (ARM_DMA4CHAN_DEST_AD (m_nChannel));
+#if AARCH == 64
+	nAddress |=   (uintptr) (  (read32 (ARM_DMA4CHAN_DEST_INFO (m_nChannel)) >> DEST4_ADDR_SHIFT)
+				 & 0xFF)
+		    << 32;
+#endif
+
+	PeripheralExit ();
+
+	return nAddress;
+}
+
+TDMA4ControlBlock *CDMA4Channel::AddSegment (void)
+{
+	assert (m_pControlBlock != 0);
+	assert (m_nSegments < m_nMaxSegments);
+
+	TDMA4ControlBlock *pControlBlock = &m_pControlBlock[m_nSegments];
+	pControlBlock->nNextControlBlockAddress = 0;
+	pControlBlock->nReserved                = 0;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments];
+	pInfo->nDestinationAddress = 0;
+	pInfo->nDestinationLength  = 0;
+	pInfo->nSourceAddress      = 0;
+	pInfo->nSourceLength       = 0;
+
+	m_nSegments++;
+
+	return pControlBlock;
+}
+
+void CDMA4Channel::AllocateChain (unsigned nMaxSegments)
+{
+	delete [] m_pControlBlockBuffer;
+	delete [] m_pSegmentInfo;
+
+	// control blocks must be 32 bytes aligned
+	m_pControlBlockBuffer = new (HEAP_ANY) u8[nMaxSegments * sizeof (TDMA4ControlBlock) + 31];
+	assert (m_pControlBlockBuffer != 0);
+
+	m_pControlBlock = (TDMA4ControlBlock *) (((uintptr) m_pControlBlockBuffer + 31) & ~31);
+
+	m_pSegmentInfo = new TDMASegmentInfo[nMaxSegments];
+	assert (m_pSegmentInfo != 0);
+
+	m_nMaxSegments = nMaxSegments;
+	m_nSegments = 0;
+}
+
+void CDMA4Channel::ConnectIRQ (void)
+{
+	assert (m_nChannel >= DMA4_CHANNEL_MIN);
+	assert (m_nChannel <= DMA4_CHANNEL_MAX);
+	assert (m_pInterruptSystem != 0);
+
+	if (!m_bIRQConnected)
 	{
-		CleanAndInvalidateDataCacheRange (m_nDestinationAddress, m_nBufferLength);
+		assert (m_nChannel >= 11);
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_DMA11+m_nChannel-11, InterruptStub, this);
+
+		m_bIRQConnected = TRUE;
+	}
+}
+
+void CDMA4Channel::CompleteSegments (unsigned nEndSegment)
+{
+	while (m_nNextSegment != nEndSegment)
+	{
+		if (m_nNextSegment == m_nSegments)	// wrap in cyclic mode
+		{
+			m_nNextSegment = 0;
+
+			continue;
+		}
+
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nNextSegment];
+		if (pInfo->nDestinationAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nDestinationAddress,
+							  pInfo->nDestinationLength);
+		}
+
+		if (m_pSegmentRoutine != 0)
+		{
+			(*m_pSegmentRoutine) (m_nChannel, m_nNextSegment, m_pSegmentParam);
+
+			// the source buffer may have been refilled for the next cycle
+			if (   m_bCyclic
+			    && pInfo->nSourceAddress != 0)
+			{
+				CleanAndInvalidateDataCacheRange (pInfo->nSourceAddress,
+								  pInfo->nSourceLength);
+			}
+		}
+
+		m_nNextSegment++;
 	}
+}
 
+void CDMA4Channel::InterruptHandler (void)
+{
 	assert (m_nChannel >= DMA4_CHANNEL_MIN);
 	assert (m_nChannel <= DMA4_CHANNEL_MAX);
 
@@ -411,15 +613,47 @@ void CDMA4Channel::InterruptHandler (void)
 	assert (nIntStatus & nIntMask);
 	write32 (ARM_DMA_INT_STATUS, nIntMask);
 
+	// reset CS4_INT, keep the channel running
 	u32 nCS = read32 (ARM_DMA4CHAN_CS (m_nChannel));
 	assert (nCS & CS4_INT);
-	assert (!(nCS & CS4_ACTIVE));
-	write32 (ARM_DMA4CHAN_CS (m_nChannel), CS4_INT);
+	write32 (ARM_DMA4CHAN_CS (m_nChannel),   CS4_WAIT_FOR_OUTSTANDING_WRITES
+					      | (DEFAULT_PANIC_QOS4 << CS4_PANIC_QOS_SHIFT)
+					      | (DEFAULT_QOS4 << CS4_QOS_SHIFT)
+					      | (nCS & CS4_ACTIVE)
+					      | CS4_INT);
+
+	// the control block address is read after resetting CS4_INT, so that a segment,
+	// which completes in between, is reported now and with the following interrupt
+	u32 nControlBlockAddress = read32 (ARM_DMA4CHAN_CONBLK_AD (m_nChannel));
 
 	m_bStatus = nCS & CS4_ERROR ? FALSE : TRUE;
 
-	assert (m_pCompletionRoutine != 0);
-	(*m_pCompletionRoutine) (m_nChannel, m_bStatus, m_pCompletionParam);
+	if (nControlBlockAddress == 0)
+	{
+		assert (!m_bCyclic);
+
+		if (m_nNextSegment == m_nSegments)
+		{
+			return;		// already reported with the previous interrupt
+		}
+
+		// chain finished
+		CompleteSegments (m_nSegments);
+
+		if (m_pCompletionRoutine != 0)
+		{
+			(*m_pCompletionRoutine) (m_nChannel, m_bStatus, m_pCompletionParam);
+		}
+
+		return;
+	}
+
+	// the currently loaded control block has not been transferred yet
+	unsigned nSegment =   (nControlBlockAddress - ((uintptr) m_pControlBlock >> CONBLK_AD4_ADDR_SHIFT))
+			    * (1 << CONBLK_AD4_ADDR_SHIFT) / sizeof (TDMA4ControlBlock);
+	assert (nSegment < m_nSegments);
+
+	CompleteSegments (nSegment);
 }
 
 void CDMA4Channel::InterruptStub (void *pParam)
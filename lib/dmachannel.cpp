@@ -2,7 +2,7 @@
 // dmachannel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -32,10 +32,17 @@ CDMAChannel::CDMAChannel (unsigned nChannel, CInterruptSystem *pInterruptSystem)
 :	m_nChannel (CMachineInfo::Get ()->AllocateDMAChannel (nChannel)),
 	m_pControlBlockBuffer (0),
 	m_pControlBlock (0),
+	m_pSegmentInfo (0),
+	m_nMaxSegments (0),
+	m_nSegments (0),
+	m_nNextSegment (0),
+	m_bCyclic (FALSE),
 	m_pInterruptSystem (pInterruptSystem),
 	m_bIRQConnected (FALSE),
 	m_pCompletionRoutine (0),
 	m_pCompletionParam (0),
+	m_pSegmentRoutine (0),
+	m_pSegmentParam (0),
 	m_bStatus (FALSE)
 {
 #if RASPPI >= 4
@@ -57,12 +64,7 @@ CDMAChannel::CDMAChannel (unsigned nChannel, CInterruptSystem *pInterruptSystem)
 	assert (m_nChannel != DMA_CHANNEL_NONE);
 	assert (m_nChannel < DMA_CHANNELS);
 
-	m_pControlBlockBuffer = new (HEAP_DMA30) u8[sizeof (TDMAControlBlock) + 31];
-	assert (m_pControlBlockBuffer != 0);
-
-	m_pControlBlock = (TDMAControlBlock *) (((uintptr) m_pControlBlockBuffer + 31) & ~31);
-	m_pControlBlock->nReserved[0] = 0;
-	m_pControlBlock->nReserved[1] = 0;
+	AllocateChain (1);
 
 	write32 (ARM_DMA_ENABLE, read32 (ARM_DMA_ENABLE) | (1 << m_nChannel));
 	CTimer::SimpleusDelay (1000);
@@ -108,6 +110,7 @@ CDMAChannel::~CDMAChannel (void)
 	PeripheralExit ();
 
 	m_pCompletionRoutine = 0;
+	m_pSegmentRoutine = 0;
 
 	if (m_pInterruptSystem != 0)
 	{
@@ -126,6 +129,9 @@ CDMAChannel::~CDMAChannel (void)
 
 	delete [] m_pControlBlockBuffer;
 	m_pControlBlockBuffer = 0;
+
+	delete [] m_pSegmentInfo;
+	m_pSegmentInfo = 0;
 }
 
 void CDMAChannel::SetupMemCopy (void *pDestination, const void *pSource, size_t nLength,
@@ -140,49 +146,157 @@ void CDMAChannel::SetupMemCopy (void *pDestination, const void *pSource, size_t
 	}
 #endif
 
+	SetupChain (1);
+	AddMemCopy (pDestination, pSource, nLength, nBurstLength, bCached);
+}
+
+void CDMAChannel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		m_pDMA4Channel->SetupIORead (pDestination, nIOAddress, nLength, DREQ);
+
+		return;
+	}
+#endif
+
+	SetupChain (1);
+	AddIORead (pDestination, nIOAddress, nLength, DREQ);
+}
+
+void CDMAChannel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		m_pDMA4Channel->SetupIOWrite (nIOAddress, pSource, nLength, DREQ);
+
+		return;
+	}
+#endif
+
+	SetupChain (1);
+	AddIOWrite (nIOAddress, pSource, nLength, DREQ);
+}
+
+void CDMAChannel::SetupMemCopy2D (void *pDestination, const void *pSource,
+				  size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
+				  unsigned nBurstLength)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		m_pDMA4Channel->SetupMemCopy2D (pDestination, pSource, nBlockLength,
+						nBlockCount, nBlockStride, nBurstLength);
+
+		return;
+	}
+#endif
+
+	assert (pDestination != 0);
+	assert (pSource != 0);
+	assert (nBlockLength > 0);
+	assert (nBlockLength <= 0xFFFF);
+	assert (nBlockCount > 0);
+	assert (nBlockCount <= 0x3FFF);
+	assert (nBlockStride <= 0xFFFF);
+	assert (nBurstLength <= 15);
+
+	assert (!(read32 (ARM_DMACHAN_DEBUG (m_nChannel)) & DEBUG_LITE));
+
+	SetupChain (1);
+	TDMAControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   (nBurstLength << TI_BURST_LENGTH_SHIFT)
+						  | TI_SRC_WIDTH
+						  | TI_SRC_INC
+						  | TI_DEST_WIDTH
+						  | TI_DEST_INC
+						  | TI_TDMODE;
+	pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
+	pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
+	pControlBlock->nTransferLength          =   ((nBlockCount-1) << TXFR_LEN_YLENGTH_SHIFT)
+						  | (nBlockLength << TXFR_LEN_XLENGTH_SHIFT);
+	pControlBlock->n2DModeStride            = nBlockStride << STRIDE_DEST_SHIFT;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[0];
+	pInfo->nSourceAddress = (uintptr) pSource;
+	pInfo->nSourceLength = nBlockLength*nBlockCount;
+}
+
+void CDMAChannel::SetupChain (unsigned nMaxSegments)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		m_pDMA4Channel->SetupChain (nMaxSegments);
+
+		return;
+	}
+#endif
+
+	assert (nMaxSegments > 0);
+	if (nMaxSegments > m_nMaxSegments)
+	{
+		AllocateChain (nMaxSegments);
+	}
+
+	m_nSegments = 0;
+	m_bCyclic = FALSE;
+}
+
+unsigned CDMAChannel::AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+				  unsigned nBurstLength, boolean bCached)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		return m_pDMA4Channel->AddMemCopy (pDestination, pSource, nLength,
+						   nBurstLength, bCached);
+	}
+#endif
+
 	assert (pDestination != 0);
 	assert (pSource != 0);
 	assert (nLength > 0);
 	assert (nBurstLength <= 15);
 
-	assert (m_pControlBlock != 0);
 	assert (nLength <= TXFR_LEN_MAX);
 	assert (   !(read32 (ARM_DMACHAN_DEBUG (m_nChannel)) & DEBUG_LITE)
 		|| nLength <= TXFR_LEN_MAX_LITE);
 
-	m_pControlBlock->nTransferInformation     =   (nBurstLength << TI_BURST_LENGTH_SHIFT)
-						    | TI_SRC_WIDTH
-						    | TI_SRC_INC
-						    | TI_DEST_WIDTH
-						    | TI_DEST_INC;
-	m_pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
-	m_pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
-	m_pControlBlock->nTransferLength          = nLength;
-	m_pControlBlock->n2DModeStride            = 0;
-	m_pControlBlock->nNextControlBlockAddress = 0;
+	TDMAControlBlock *pControlBlock = AddSegment ();
 
-	if (bCached)
-	{
-		m_nDestinationAddress = (uintptr) pDestination;
-		m_nBufferLength = nLength;
+	pControlBlock->nTransferInformation     =   (nBurstLength << TI_BURST_LENGTH_SHIFT)
+						  | TI_SRC_WIDTH
+						  | TI_SRC_INC
+						  | TI_DEST_WIDTH
+						  | TI_DEST_INC;
+	pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
+	pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
+	pControlBlock->nTransferLength          = nLength;
 
-		CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
-		CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
-	}
-	else
+	if (bCached)
 	{
-		m_nDestinationAddress = 0;
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+		pInfo->nDestinationAddress = (uintptr) pDestination;
+		pInfo->nDestinationLength = nLength;
+		pInfo->nSourceAddress = (uintptr) pSource;
+		pInfo->nSourceLength = nLength;
 	}
+
+	return m_nSegments-1;
 }
 
-void CDMAChannel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ)
+unsigned CDMAChannel::AddIORead (void *pDestination, u32 nIOAddress, size_t nLength, TDREQ DREQ,
+				  boolean bWordWrites)
 {
 #if RASPPI >= 4
 	if (m_pDMA4Channel != 0)
 	{
-		m_pDMA4Channel->SetupIORead (pDestination, nIOAddress, nLength, DREQ);
-
-		return;
+		return m_pDMA4Channel->AddIORead (pDestination, nIOAddress, nLength, DREQ,
+						  bWordWrites);
 	}
 #endif
 
@@ -196,33 +310,31 @@ void CDMAChannel::SetupIORead (void *pDestination, u32 nIOAddress, size_t nLengt
 	assert (nIOAddress != 0);
 	nIOAddress += GPU_IO_BASE;
 
-	assert (m_pControlBlock != 0);
-	m_pControlBlock->nTransferInformation     =   (DREQ << TI_PERMAP_SHIFT)
-						    | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
-						    | TI_SRC_DREQ
-						    | TI_DEST_WIDTH
-						    | TI_DEST_INC
-						    | TI_WAIT_RESP;
-	m_pControlBlock->nSourceAddress           = nIOAddress;
-	m_pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
-	m_pControlBlock->nTransferLength          = nLength;
-	m_pControlBlock->n2DModeStride            = 0;
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = (uintptr) pDestination;
-	m_nBufferLength = nLength;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
+	TDMAControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   (DREQ << TI_PERMAP_SHIFT)
+						  | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+						  | TI_SRC_DREQ
+						  | (bWordWrites ? 0 : TI_DEST_WIDTH)
+						  | TI_DEST_INC
+						  | TI_WAIT_RESP;
+	pControlBlock->nSourceAddress           = nIOAddress;
+	pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
+	pControlBlock->nTransferLength          = nLength;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+	pInfo->nDestinationAddress = (uintptr) pDestination;
+	pInfo->nDestinationLength = nLength;
+
+	return m_nSegments-1;
 }
 
-void CDMAChannel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
+unsigned CDMAChannel::AddIOWrite (u32 nIOAddress, const void *pSource, size_t nLength, TDREQ DREQ)
 {
 #if RASPPI >= 4
 	if (m_pDMA4Channel != 0)
 	{
-		m_pDMA4Channel->SetupIOWrite (nIOAddress, pSource, nLength, DREQ);
-
-		return;
+		return m_pDMA4Channel->AddIOWrite (nIOAddress, pSource, nLength, DREQ);
 	}
 #endif
 
@@ -236,67 +348,37 @@ void CDMAChannel::SetupIOWrite (u32 nIOAddress, const void *pSource, size_t nLen
 	assert (nIOAddress != 0);
 	nIOAddress += GPU_IO_BASE;
 
-	assert (m_pControlBlock != 0);
-	m_pControlBlock->nTransferInformation     =   (DREQ << TI_PERMAP_SHIFT)
-						    | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
-						    | TI_SRC_WIDTH
-						    | TI_SRC_INC
-						    | TI_DEST_DREQ
-						    | TI_WAIT_RESP;
-	m_pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
-	m_pControlBlock->nDestinationAddress      = nIOAddress;
-	m_pControlBlock->nTransferLength          = nLength;
-	m_pControlBlock->n2DModeStride            = 0;
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = 0;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
+	TDMAControlBlock *pControlBlock = AddSegment ();
+
+	pControlBlock->nTransferInformation     =   (DREQ << TI_PERMAP_SHIFT)
+						  | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+						  | TI_SRC_WIDTH
+						  | TI_SRC_INC
+						  | TI_DEST_DREQ
+						  | TI_WAIT_RESP;
+	pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
+	pControlBlock->nDestinationAddress      = nIOAddress;
+	pControlBlock->nTransferLength          = nLength;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments-1];
+	pInfo->nSourceAddress = (uintptr) pSource;
+	pInfo->nSourceLength = nLength;
+
+	return m_nSegments-1;
 }
 
-void CDMAChannel::SetupMemCopy2D (void *pDestination, const void *pSource,
-				  size_t nBlockLength, unsigned nBlockCount, size_t nBlockStride,
-				  unsigned nBurstLength)
+void CDMAChannel::SetCyclic (boolean bCyclic)
 {
 #if RASPPI >= 4
 	if (m_pDMA4Channel != 0)
 	{
-		m_pDMA4Channel->SetupMemCopy2D (pDestination, pSource, nBlockLength,
-						nBlockCount, nBlockStride, nBurstLength);
+		m_pDMA4Channel->SetCyclic (bCyclic);
 
 		return;
 	}
 #endif
 
-	assert (pDestination != 0);
-	assert (pSource != 0);
-	assert (nBlockLength > 0);
-	assert (nBlockLength <= 0xFFFF);
-	assert (nBlockCount > 0);
-	assert (nBlockCount <= 0x3FFF);
-	assert (nBlockStride <= 0xFFFF);
-	assert (nBurstLength <= 15);
-
-	assert (!(read32 (ARM_DMACHAN_DEBUG (m_nChannel)) & DEBUG_LITE));
-
-	assert (m_pControlBlock != 0);
-
-	m_pControlBlock->nTransferInformation     =   (nBurstLength << TI_BURST_LENGTH_SHIFT)
-						    | TI_SRC_WIDTH
-						    | TI_SRC_INC
-						    | TI_DEST_WIDTH
-						    | TI_DEST_INC
-						    | TI_TDMODE;
-	m_pControlBlock->nSourceAddress           = BUS_ADDRESS ((uintptr) pSource);
-	m_pControlBlock->nDestinationAddress      = BUS_ADDRESS ((uintptr) pDestination);
-	m_pControlBlock->nTransferLength          =   ((nBlockCount-1) << TXFR_LEN_YLENGTH_SHIFT)
-						    | (nBlockLength << TXFR_LEN_XLENGTH_SHIFT);
-	m_pControlBlock->n2DModeStride            = nBlockStride << STRIDE_DEST_SHIFT;
-	m_pControlBlock->nNextControlBlockAddress = 0;
-
-	m_nDestinationAddress = 0;
-
-	CleanAndInvalidateDataCacheRange ((uintptr) pSource, nBlockLength*nBlockCount);
+	m_bCyclic = bCyclic;
 }
 
 void CDMAChannel::SetCompletionRoutine (TDMACompletionRoutine *pRoutine, void *pParam)
@@ -310,20 +392,31 @@ void CDMAChannel::SetCompletionRoutine (TDMACompletionRoutine *pRoutine, void *p
 	}
 #endif
 
-	assert (m_nChannel <= DMA_CHANNELS);
-	assert (m_pInterruptSystem != 0);
+	ConnectIRQ ();
 
-	if (!m_bIRQConnected)
+	m_pCompletionRoutine = pRoutine;
+	assert (m_pCompletionRoutine != 0);
+
+	m_pCompletionParam = pParam;
+}
+
+void CDMAChannel::SetSegmentRoutine (TDMASegmentRoutine *pRoutine, void *pParam)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
 	{
-		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_DMA0+m_nChannel, InterruptStub, this);
+		m_pDMA4Channel->SetSegmentRoutine (pRoutine, pParam);
 
-		m_bIRQConnected = TRUE;
+		return;
 	}
+#endif
 
-	m_pCompletionRoutine = pRoutine;
-	assert (m_pCompletionRoutine != 0);
+	ConnectIRQ ();
 
-	m_pCompletionParam = pParam;
+	m_pSegmentRoutine = pRoutine;
+	assert (m_pSegmentRoutine != 0);
+
+	m_pSegmentParam = pParam;
 }
 
 void CDMAChannel::Start (void)
@@ -339,14 +432,53 @@ void CDMAChannel::Start (void)
 
 	assert (m_nChannel < DMA_CHANNELS);
 	assert (m_pControlBlock != 0);
+	assert (m_nSegments > 0);
+	assert (!m_bCyclic || m_pSegmentRoutine != 0);
+	assert (!m_bCyclic || m_nSegments >= 2);	// see SetCyclic()
 
-	if (m_pCompletionRoutine != 0)
+	// link the control blocks and do the cache maintenance for the source buffers
+	for (unsigned i = 0; i < m_nSegments; i++)
 	{
-		assert (m_pInterruptSystem != 0);
-		assert (m_bIRQConnected);
-		m_pControlBlock->nTransferInformation |= TI_INTEN;
+		TDMAControlBlock *pControlBlock = &m_pControlBlock[i];
+
+		if (i < m_nSegments-1)
+		{
+			pControlBlock->nNextControlBlockAddress =
+				BUS_ADDRESS ((uintptr) &m_pControlBlock[i+1]);
+		}
+		else
+		{
+			pControlBlock->nNextControlBlockAddress =
+				m_bCyclic ? BUS_ADDRESS ((uintptr) &m_pControlBlock[0]) : 0;
+		}
+
+		if (   m_pSegmentRoutine != 0
+		    || (   m_pCompletionRoutine != 0
+			&& i == m_nSegments-1))
+		{
+			assert (m_pInterruptSystem != 0);
+			assert (m_bIRQConnected);
+			pControlBlock->nTransferInformation |= TI_INTEN;
+		}
+
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[i];
+		if (pInfo->nSourceAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nSourceAddress, pInfo->nSourceLength);
+		}
+
+		if (pInfo->nDestinationAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nDestinationAddress,
+							  pInfo->nDestinationLength);
+		}
 	}
 
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock,
+					  m_nSegments * sizeof (TDMAControlBlock));
+
+	m_nNextSegment = 0;
+
 	PeripheralEntry ();
 
 	assert (!(read32 (ARM_DMACHAN_CS (m_nChannel)) & CS_INT));
@@ -354,8 +486,6 @@ void CDMAChannel::Start (void)
 
 	write32 (ARM_DMACHAN_CONBLK_AD (m_nChannel), BUS_ADDRESS ((uintptr) m_pControlBlock));
 
-	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock, sizeof *m_pControlBlock);
-
 	write32 (ARM_DMACHAN_CS (m_nChannel),   CS_WAIT_FOR_OUTSTANDING_WRITES
 					      | (DEFAULT_PANIC_PRIORITY << CS_PANIC_PRIORITY_SHIFT)
 					      | (DEFAULT_PRIORITY << CS_PRIORITY_SHIFT)
@@ -375,6 +505,8 @@ boolean CDMAChannel::Wait (void)
 
 	assert (m_nChannel < DMA_CHANNELS);
 	assert (m_pCompletionRoutine == 0);
+	assert (m_pSegmentRoutine == 0);
+	assert (!m_bCyclic);
 
 	PeripheralEntry ();
 
@@ -386,10 +518,7 @@ boolean CDMAChannel::Wait (void)
 
 	m_bStatus = nCS & CS_ERROR ? FALSE : TRUE;
 
-	if (m_nDestinationAddress != 0)
-	{
-		CleanAndInvalidateDataCacheRange (m_nDestinationAddress, m_nBufferLength);
-	}
+	CompleteSegments (m_nSegments);
 
 	PeripheralExit ();
 
@@ -411,15 +540,147 @@ boolean CDMAChannel::GetStatus (void)
 	return m_bStatus;
 }
 
-void CDMAChannel::InterruptHandler (void)
+void CDMAChannel::Cancel (void)
 {
-	if (m_nDestinationAddress != 0)
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
 	{
-		CleanAndInvalidateDataCacheRange (m_nDestinationAddress, m_nBufferLength);
+		m_pDMA4Channel->Cancel ();
+
+		return;
 	}
+#endif
+
+	assert (m_nChannel < DMA_CHANNELS);
 
 	PeripheralEntry ();
 
+	write32 (ARM_DMACHAN_CS (m_nChannel), CS_RESET);
+	while (read32 (ARM_DMACHAN_CS (m_nChannel)) & CS_RESET)
+	{
+		// do nothing
+	}
+
+	write32 (ARM_DMA_INT_STATUS, 1 << m_nChannel);
+
+	PeripheralExit ();
+
+	m_bCyclic = FALSE;
+	m_bStatus = FALSE;
+}
+
+uintptr CDMAChannel::GetDestinationAddress (void)
+{
+#if RASPPI >= 4
+	if (m_pDMA4Channel != 0)
+	{
+		return m_pDMA4Channel->GetDestinationAddress ();
+	}
+#endif
+
+	assert (m_nChannel < DMA_CHANNELS);
+
+	PeripheralEntry ();
+
+	u32 nAddress = read32 (ARM_DMACHAN_DEST_AD (m_nChannel));
+
+	PeripheralExit ();
+
+	return nAddress & ~0xC0000000;		// reverse BUS_ADDRESS()
+}
+
+TDMAControlBlock *CDMAChannel::AddSegment (void)
+{
+	assert (m_pControlBlock != 0);
+	assert (m_nSegments < m_nMaxSegments);
+
+	TDMAControlBlock *pControlBlock = &m_pControlBlock[m_nSegments];
+	pControlBlock->n2DModeStride            = 0;
+	pControlBlock->nNextControlBlockAddress = 0;
+	pControlBlock->nReserved[0]             = 0;
+	pControlBlock->nReserved[1]             = 0;
+
+	TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nSegments];
+	pInfo->nDestinationAddress = 0;
+	pInfo->nDestinationLength  = 0;
+	pInfo->nSourceAddress      = 0;
+	pInfo->nSourceLength       = 0;
+
+	m_nSegments++;
+
+	return pControlBlock;
+}
+
+void CDMAChannel::AllocateChain (unsigned nMaxSegments)
+{
+	delete [] m_pControlBlockBuffer;
+	delete [] m_pSegmentInfo;
+
+	// control blocks must be 32 bytes aligned
+	m_pControlBlockBuffer = new (HEAP_DMA30) u8[nMaxSegments * sizeof (TDMAControlBlock) + 31];
+	assert (m_pControlBlockBuffer != 0);
+
+	m_pControlBlock = (TDMAControlBlock *) (((uintptr) m_pControlBlockBuffer + 31) & ~31);
+
+	m_pSegmentInfo = new TDMASegmentInfo[nMaxSegments];
+	assert (m_pSegmentInfo != 0);
+
+	m_nMaxSegments = nMaxSegments;
+	m_nSegments = 0;
+}
+
+void CDMAChannel::ConnectIRQ (void)
+{
+	assert (m_nChannel <= DMA_CHANNELS);
+	assert (m_pInterruptSystem != 0);
+
+	if (!m_bIRQConnected)
+	{
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_DMA0+m_nChannel, InterruptStub, this);
+
+		m_bIRQConnected = TRUE;
+	}
+}
+
+void CDMAChannel::CompleteSegments (unsigned nEndSegment)
+{
+	while (m_nNextSegment != nEndSegment)
+	{
+		if (m_nNextSegment == m_nSegments)	// wrap in cyclic mode
+		{
+			m_nNextSegment = 0;
+
+			continue;
+		}
+
+		TDMASegmentInfo *pInfo = &m_pSegmentInfo[m_nNextSegment];
+		if (pInfo->nDestinationAddress != 0)
+		{
+			CleanAndInvalidateDataCacheRange (pInfo->nDestinationAddress,
+							  pInfo->nDestinationLength);
+		}
+
+		if (m_pSegmentRoutine != 0)
+		{
+			(*m_pSegmentRoutine) (m_nChannel, m_nNextSegment, m_pSegmentParam);
+
+			// the source buffer may have been refilled for the next cycle
+			if (   m_bCyclic
+			    && pInfo->nSourceAddress != 0)
+			{
+				CleanAndInvalidateDataCacheRange (pInfo->nSourceAddress,
+								  pInfo->nSourceLength);
+			}
+		}
+
+		m_nNextSegment++;
+	}
+}
+
+void CDMAChannel::InterruptHandler (void)
+{
+	PeripheralEntry ();
+
 	assert (m_nChannel < DMA_CHANNELS);
 
 #ifndef NDEBUG
@@ -431,15 +692,42 @@ void CDMAChannel::InterruptHandler (void)
 
 	u32 nCS = read32 (ARM_DMACHAN_CS (m_nChannel));
 	assert (nCS & CS_INT);
-	assert (!(nCS & CS_ACTIVE));
-	write32 (ARM_DMACHAN_CS (m_nChannel), CS_INT); 
+	write32 (ARM_DMACHAN_CS (m_nChannel), nCS);	// reset CS_INT, keep CS_ACTIVE
+
+	// the control block address is read after resetting CS_INT, so that a segment,
+	// which completes in between, is reported now and with the following interrupt
+	u32 nControlBlockAddress = read32 (ARM_DMACHAN_CONBLK_AD (m_nChannel));
 
 	PeripheralExit ();
 
 	m_bStatus = nCS & CS_ERROR ? FALSE : TRUE;
 
-	assert (m_pCompletionRoutine != 0);
-	(*m_pCompletionRoutine) (m_nChannel, m_bStatus, m_pCompletionParam);
+	if (nControlBlockAddress == 0)
+	{
+		assert (!m_bCyclic);
+
+		if (m_nNextSegment == m_nSegments)
+		{
+			return;		// already reported with the previous interrupt
+		}
+
+		// chain finished
+		CompleteSegments (m_nSegments);
+
+		if (m_pCompletionRoutine != 0)
+		{
+			(*m_pCompletionRoutine) (m_nChannel, m_bStatus, m_pCompletionParam);
+		}
+
+		return;
+	}
+
+	// the currently loaded control block has not been transferred yet
+	unsigned nSegment =   (nControlBlockAddress - BUS_ADDRESS ((uintptr) m_pControlBlock))
+			    / sizeof (TDMAControlBlock);
+	assert (nSegment < m_nSegments);
+
+	CompleteSegments (nSegment);
 }
 
 void CDMAChannel::InterruptStub (void *pParam)
@@ -2,7 +2,7 @@
 // fatcache.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,65 +20,75 @@
 #include <circle/fs/fat/fatcache.h>
 #include <circle/logger.h>
 #include <circle/new.h>
+#include <circle/util.h>
 #include <assert.h>
 
 #define BUFFER_MAGIC		0x4641544D
-#define BUFFER_NOSECTOR		0xFFFFFFFF
+#define BLOCK_MAGIC		0x46415442
+#define NO_BLOCK		0xFFFFFFFF
+
+#define INITIAL_BLOCK_SECTORS	8		// until the cluster size is known
+
+#define FLUSH_BATCH		32		// write requests submitted at once
 
 #define FAULT_NO_BUFFER		0x1501
 #define FAULT_READ_ERROR	0x1502
 #define FAULT_WRITE_ERROR	0x1503
 
+static inline u32 SectorMask (unsigned nIndex, unsigned nCount)
+{
+	assert (nIndex + nCount <= 32);
+	return (nCount < 32 ? (1U << nCount) - 1 : 0xFFFFFFFF) << nIndex;
+}
+
 CFATCache::CFATCache (void)
-:	m_pPartition (0)
+:	m_pPartition (0),
+	m_nPartitionSectors (0),
+	m_nBlockSectors (0),
+	m_nBlockOffset (0),
+	m_nBlocks (0),
+	m_pBlocks (0),
+	m_pDataArea (0),
+	m_ppHashTable (0),
+	m_nHashMask (0),
+	m_nLastBlock (NO_BLOCK)
 {
-	m_BufferList.pFirst = 0;
-	m_BufferList.pLast = 0;
+	m_BlockList.pFirst = 0;
+	m_BlockList.pLast = 0;
+
+	memset (&m_Statistics, 0, sizeof m_Statistics);
 }
 
 CFATCache::~CFATCache (void)
 {
+	FreeBlocks ();
 }
 
 int CFATCache::Open (CDevice *pPartition)
 {
-	TFATBuffer *pBuffer;
-	TFATBuffer *pPrevBuffer = 0;
-	int i;
-	
 	assert (m_pPartition == 0);
 	m_pPartition = pPartition;
 	assert (m_pPartition != 0);
 
-	for (i = 1; i <= FAT_BUFFERS; i++)
+	u64 ullSize = m_pPartition->GetSize ();
+	if (   ullSize == (u64) -1
+	    || ullSize / FAT_SECTOR_SIZE > 0xFFFFFFFF)
 	{
-		pBuffer = new (HEAP_DMA30) TFATBuffer;
-		if (pBuffer == 0)
-		{
-			return 0;
-		}
+		m_nPartitionSectors = 0xFFFFFFFF;	// unknown, reads are retried sector-wise
+	}
+	else
+	{
+		m_nPartitionSectors = ullSize / FAT_SECTOR_SIZE;
+	}
 
-		pBuffer->nMagic    = BUFFER_MAGIC;
-		pBuffer->pNext     = 0;
-		pBuffer->pPrev     = pPrevBuffer;
-		pBuffer->nSector   = BUFFER_NOSECTOR;
-		pBuffer->nUseCount = 0;
+	m_nLastBlock = NO_BLOCK;
+	memset (&m_Statistics, 0, sizeof m_Statistics);
 
-		if (pPrevBuffer != 0)
-		{
-			pPrevBuffer->pNext = pBuffer;
-		}
+	if (!AllocateBlocks (INITIAL_BLOCK_SECTORS))
+	{
+		m_pPartition = 0;
 
-		pPrevBuffer = pBuffer;
-		
-		if (i == 1)
-		{
-			m_BufferList.pFirst = pBuffer;
-		}
-		else if (i == FAT_BUFFERS)
-		{
-			m_BufferList.pLast = pBuffer;
-		}
+		return 0;
 	}
 
 	return 1;
@@ -86,216 +96,664 @@ int CFATCache::Open (CDevice *pPartition)
 
 void CFATCache::Close (void)
 {
-	TFATBuffer *pBuffer;
-	TFATBuffer *pNextBuffer;
-
 	Flush ();
 
-	for (pBuffer = m_BufferList.pFirst; pBuffer != 0; pBuffer = pNextBuffer)
+	for (TFATBlock *pBlock = m_BlockList.pFirst; pBlock != 0; pBlock = pBlock->pNext)
 	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
-
-		pNextBuffer = pBuffer->pNext;
+		assert (pBlock->nMagic == BLOCK_MAGIC);
 
-		pBuffer->nMagic = 0;
-
-		delete [] pBuffer;
+		if (pBlock->pReadAhead != 0)
+		{
+			CompleteReadAhead (pBlock);
+		}
 	}
 
-	m_BufferList.pFirst = 0;
-	m_BufferList.pLast = 0;
+	FreeBlocks ();
+
+	m_pPartition = 0;
 }
 
 void CFATCache::Flush (void)
 {
-	TFATBuffer *pBuffer;
+	CBlockRequest *pRequests[FLUSH_BATCH];
+	unsigned nRequests = 0;
 
-	m_BufferListLock.Acquire ();
+	m_BlockListLock.Acquire ();
 
-	for (pBuffer = m_BufferList.pFirst; pBuffer != 0; pBuffer = pBuffer->pNext)
+	// submit the dirty runs of all blocks at once, so that the request queue
+	// of the device can sort and merge adjacent runs into larger transfers
+	for (TFATBlock *pBlock = m_BlockList.pFirst; pBlock != 0; pBlock = pBlock->pNext)
 	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
+		assert (pBlock->nMagic == BLOCK_MAGIC);
 
-		if (pBuffer->nSector != BUFFER_NOSECTOR)
+		unsigned nIndex = 0;
+		while (pBlock->nDirtyMask != 0)
 		{
-			if (pBuffer->bDirty)
+			while (!(pBlock->nDirtyMask & (1U << nIndex)))
 			{
-				m_DiskLock.Acquire ();
+				nIndex++;
+			}
+
+			unsigned nCount = 1;
+			while (   nIndex + nCount < m_nBlockSectors
+			       && (pBlock->nDirtyMask & (1U << (nIndex + nCount))))
+			{
+				nCount++;
+			}
 
-				m_pPartition->Seek (pBuffer->nSector * FAT_SECTOR_SIZE);
-				if (m_pPartition->Write (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
+			pBlock->nDirtyMask &= ~SectorMask (nIndex, nCount);
+
+			if (nRequests == FLUSH_BATCH)
+			{
+				for (unsigned i = 0; i < nRequests; i++)
 				{
-					Fault (FAULT_WRITE_ERROR);
+					if (pRequests[i]->Wait () != (int) pRequests[i]->GetCount ())
+					{
+						Fault (FAULT_WRITE_ERROR);
+					}
+
+					delete pRequests[i];
 				}
 
-				m_DiskLock.Release ();
+				nRequests = 0;
+			}
+
+			u64 ullOffset = (u64) (GetFirstSector (pBlock->nBlock) + nIndex) * FAT_SECTOR_SIZE;
+			CBlockRequest *pRequest =
+				new CBlockRequest (BlockRequestWrite, pBlock->pData + nIndex * FAT_SECTOR_SIZE,
+						   nCount * FAT_SECTOR_SIZE, ullOffset);
+			assert (pRequest != 0);
 
-				pBuffer->bDirty = 0;
+			if (!m_pPartition->SubmitRequest (pRequest))
+			{
+				Fault (FAULT_WRITE_ERROR);
+
+				delete pRequest;
 			}
+			else
+			{
+				pRequests[nRequests++] = pRequest;
+			}
+
+			m_Statistics.nWrites++;
+			m_Statistics.nSectorsWritten += nCount;
+
+			nIndex += nCount;
 		}
 	}
 
-	m_BufferListLock.Release ();
+	for (unsigned i = 0; i < nRequests; i++)
+	{
+		if (pRequests[i]->Wait () != (int) pRequests[i]->GetCount ())
+		{
+			Fault (FAULT_WRITE_ERROR);
+		}
+
+		delete pRequests[i];
+	}
+
+	m_BlockListLock.Release ();
 }
 
-TFATBuffer *CFATCache::GetSector (unsigned nSector, int bWriteOnly)
+int CFATCache::SetBlockSize (unsigned nSectors, unsigned nAlignSector)
 {
-	TFATBuffer *pBuffer;
+	if (nSectors > FAT_CACHE_MAX_BLOCK_SECTORS)
+	{
+		nSectors = FAT_CACHE_MAX_BLOCK_SECTORS;
+	}
+	else if (nSectors == 0)
+	{
+		nSectors = 1;
+	}
 
-	m_BufferListLock.Acquire ();
+	// sectors are shifted by this, so that nAlignSector starts a block
+	unsigned nOffset = (nSectors - nAlignSector % nSectors) % nSectors;
 
-	for (pBuffer = m_BufferList.pFirst; pBuffer != 0; pBuffer = pBuffer->pNext)
+	if (   nSectors == m_nBlockSectors
+	    && nOffset == m_nBlockOffset)
 	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
+		return 1;
+	}
+
+	Flush ();
 
-		if (pBuffer->nSector == nSector)
+	m_BlockListLock.Acquire ();
+
+	for (TFATBlock *pBlock = m_BlockList.pFirst; pBlock != 0; pBlock = pBlock->pNext)
+	{
+		assert (pBlock->nMagic == BLOCK_MAGIC);
+		assert (pBlock->nUseCount == 0);
+
+		if (pBlock->pReadAhead != 0)
 		{
-			break;
+			CompleteReadAhead (pBlock);
 		}
 	}
 
-	if (pBuffer != 0)
+	FreeBlocks ();
+
+	int nResult = AllocateBlocks (nSectors);
+	if (nResult)
 	{
-		MoveBufferFirst (pBuffer);
+		m_nBlockOffset = nOffset;
+	}
+
+	m_nLastBlock = NO_BLOCK;
+
+	m_BlockListLock.Release ();
+
+	return nResult;
+}
+
+void CFATCache::GetStatistics (TFATCacheStatistics *pStatistics) const
+{
+	assert (pStatistics != 0);
+	*pStatistics = m_Statistics;
+}
 
-		pBuffer->nUseCount++;
+TFATBuffer *CFATCache::GetSector (unsigned nSector, int bWriteOnly)
+{
+	m_BlockListLock.Acquire ();
 
-		m_BufferListLock.Release ();
+	assert (m_nBlockSectors > 0);
+	unsigned nBlock = (nSector + m_nBlockOffset) / m_nBlockSectors;
+	unsigned nIndex = (nSector + m_nBlockOffset) % m_nBlockSectors;
+	u32 nMask = 1U << nIndex;
 
-		return pBuffer;
+	TFATBlock *pBlock = LookupBlock (nBlock);
+	if (pBlock == 0)
+	{
+		pBlock = GetFreeBlock (nBlock, FALSE);
+		if (pBlock == 0)
+		{
+			Fault (FAULT_NO_BUFFER);
+			m_BlockListLock.Release ();
+			return 0;
+		}
+	}
+	else if (pBlock->pReadAhead != 0)
+	{
+		CompleteReadAhead (pBlock);
 	}
 
+	if (pBlock->nValidMask & nMask)
+	{
+		m_Statistics.nHits++;
+	}
+	else if (bWriteOnly)
+	{
+		m_Statistics.nHits++;
 
-	for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+		pBlock->nValidMask |= nMask;
+	}
+	else
 	{
-		assert (pBuffer->nMagic == BUFFER_MAGIC);
+		m_Statistics.nMisses++;
 
-		if (pBuffer->nSector == BUFFER_NOSECTOR)
+		// read up to the next valid sector or to the end of the block
+		unsigned nBlockSectors = GetBlockSectors (nBlock);
+		unsigned nCount = 1;
+		while (   nIndex + nCount < nBlockSectors
+		       && !(pBlock->nValidMask & (1U << (nIndex + nCount))))
 		{
-			break;
+			nCount++;
+		}
+
+		if (!ReadSectors (pBlock, nIndex, nCount))
+		{
+			Fault (FAULT_READ_ERROR);
+			m_BlockListLock.Release ();
+			return 0;
 		}
 	}
 
-	if (pBuffer == 0)
+	pBlock->nUseCount++;
+
+	MoveBlockFirst (pBlock);
+
+	// read ahead, when the previous block has been accessed before
+	if (nBlock != m_nLastBlock)
 	{
-		for (pBuffer = m_BufferList.pLast; pBuffer != 0; pBuffer = pBuffer->pPrev)
+		if (   !bWriteOnly
+		    && nBlock == m_nLastBlock + 1)
 		{
-			assert (pBuffer->nMagic == BUFFER_MAGIC);
-
-			if (pBuffer->nUseCount == 0)
+			for (unsigned i = 1; i <= FAT_CACHE_READ_AHEAD; i++)
 			{
-				break;
+				ReadAhead (nBlock + i);
 			}
 		}
 
-		if (pBuffer == 0)
+		m_nLastBlock = nBlock;
+	}
+
+	m_BlockListLock.Release ();
+
+	TFATBuffer *pBuffer = &pBlock->Sector[nIndex];
+	assert (pBuffer->nMagic == BUFFER_MAGIC);
+	assert (pBuffer->nSector == nSector);
+
+	return pBuffer;
+}
+
+void CFATCache::FreeSector (TFATBuffer *pBuffer, int bCritical)
+{
+	assert (pBuffer->nMagic == BUFFER_MAGIC);
+	TFATBlock *pBlock = pBuffer->pBlock;
+	assert (pBlock != 0);
+	assert (pBlock->nMagic == BLOCK_MAGIC);
+
+	m_BlockListLock.Acquire ();
+
+	assert (pBlock->nUseCount > 0);
+	if (   --pBlock->nUseCount == 0
+	    && !bCritical)
+	{
+		MoveBlockLast (pBlock);		// file data is likely not used again soon
+	}
+
+	m_BlockListLock.Release ();
+}
+
+void CFATCache::MarkDirty (TFATBuffer *pBuffer)
+{
+	assert (pBuffer->nMagic == BUFFER_MAGIC);
+	TFATBlock *pBlock = pBuffer->pBlock;
+	assert (pBlock != 0);
+	assert (pBlock->nUseCount > 0);
+
+	unsigned nIndex = pBuffer - pBlock->Sector;
+	assert (nIndex < m_nBlockSectors);
+
+	m_BlockListLock.Acquire ();
+
+	pBlock->nDirtyMask |= 1U << nIndex;
+
+	m_BlockListLock.Release ();
+}
+
+int CFATCache::AllocateBlocks (unsigned nBlockSectors)
+{
+	assert (m_pBlocks == 0);
+	assert (0 < nBlockSectors && nBlockSectors <= FAT_CACHE_MAX_BLOCK_SECTORS);
+	m_nBlockSectors = nBlockSectors;
+
+	unsigned nBlockSize = m_nBlockSectors * FAT_SECTOR_SIZE;
+	m_nBlocks = FAT_CACHE_SIZE / nBlockSize;
+	if (m_nBlocks < FAT_CACHE_MIN_BLOCKS)
+	{
+		m_nBlocks = FAT_CACHE_MIN_BLOCKS;
+	}
+
+	unsigned nHashSize = 1;
+	while (nHashSize < m_nBlocks)
+	{
+		nHashSize <<= 1;
+	}
+	m_nHashMask = nHashSize-1;
+
+	m_pBlocks = new TFATBlock[m_nBlocks];
+	m_pDataArea = new (HEAP_DMA30) unsigned char[m_nBlocks * nBlockSize];
+	m_ppHashTable = new TFATBlock *[nHashSize];
+	if (   m_pBlocks == 0
+	    || m_pDataArea == 0
+	    || m_ppHashTable == 0)
+	{
+		FreeBlocks ();
+
+		return 0;
+	}
+
+	for (unsigned i = 0; i < nHashSize; i++)
+	{
+		m_ppHashTable[i] = 0;
+	}
+
+	TFATBlock *pPrevBlock = 0;
+	for (unsigned i = 0; i < m_nBlocks; i++)
+	{
+		TFATBlock *pBlock = &m_pBlocks[i];
+
+		pBlock->nMagic         = BLOCK_MAGIC;
+		pBlock->pNext          = 0;
+		pBlock->pPrev          = pPrevBlock;
+		pBlock->pHashNext      = 0;
+		pBlock->nBlock         = NO_BLOCK;
+		pBlock->nUseCount      = 0;
+		pBlock->nValidMask     = 0;
+		pBlock->nDirtyMask     = 0;
+		pBlock->pReadAhead     = 0;
+		pBlock->nReadAheadMask = 0;
+		pBlock->pData          = m_pDataArea + i * nBlockSize;
+
+		for (unsigned j = 0; j < m_nBlockSectors; j++)
 		{
-			Fault (FAULT_NO_BUFFER);
-			m_BufferListLock.Release ();
-			return 0;
+			TFATBuffer *pBuffer = &pBlock->Sector[j];
+
+			pBuffer->nMagic  = BUFFER_MAGIC;
+			pBuffer->nSector = NO_BLOCK;
+			pBuffer->Data    = pBlock->pData + j * FAT_SECTOR_SIZE;
+			pBuffer->pBlock  = pBlock;
 		}
 
-		if (pBuffer->bDirty)
+		if (pPrevBlock != 0)
 		{
-			m_DiskLock.Acquire ();
+			pPrevBlock->pNext = pBlock;
+		}
+		else
+		{
+			m_BlockList.pFirst = pBlock;
+		}
 
-			m_pPartition->Seek (pBuffer->nSector * FAT_SECTOR_SIZE);
-			if (m_pPartition->Write (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
-			{
-				Fault (FAULT_WRITE_ERROR);
-				m_DiskLock.Release ();
-				m_BufferListLock.Release ();
-				return 0;
-			}
+		pPrevBlock = pBlock;
+	}
 
-			m_DiskLock.Release ();
+	m_BlockList.pLast = pPrevBlock;
+
+	return 1;
+}
+
+void CFATCache::FreeBlocks (void)
+{
+	delete [] m_ppHashTable;
+	m_ppHashTable = 0;
+
+	delete [] m_pDataArea;
+	m_pDataArea = 0;
+
+	if (m_pBlocks != 0)
+	{
+		for (unsigned i = 0; i < m_nBlocks; i++)
+		{
+			assert (m_pBlocks[i].pReadAhead == 0);
+			m_pBlocks[i].nMagic = 0;
 		}
 
-		pBuffer->nSector = BUFFER_NOSECTOR;
-		assert (pBuffer->nUseCount == 0);
+		delete [] m_pBlocks;
+		m_pBlocks = 0;
 	}
 
-	pBuffer->nUseCount = 1;
-	assert (pBuffer->nSector == BUFFER_NOSECTOR);
-	pBuffer->nSector = nSector;
-	pBuffer->bDirty = 0;
+	m_nBlocks = 0;
+	m_nBlockSectors = 0;
+	m_nBlockOffset = 0;
 
-	if (!bWriteOnly)
+	m_BlockList.pFirst = 0;
+	m_BlockList.pLast = 0;
+}
+
+TFATBlock *CFATCache::LookupBlock (unsigned nBlock)
+{
+	assert (m_ppHashTable != 0);
+	for (TFATBlock *pBlock = m_ppHashTable[nBlock & m_nHashMask]; pBlock != 0;
+	     pBlock = pBlock->pHashNext)
 	{
-		m_DiskLock.Acquire ();
+		assert (pBlock->nMagic == BLOCK_MAGIC);
 
-		m_pPartition->Seek (nSector * FAT_SECTOR_SIZE);
-		if (m_pPartition->Read (pBuffer->Data, FAT_SECTOR_SIZE) != FAT_SECTOR_SIZE)
+		if (pBlock->nBlock == nBlock)
 		{
-			pBuffer->nUseCount--;
-			pBuffer->nSector = BUFFER_NOSECTOR;
+			return pBlock;
+		}
+	}
 
-			Fault (FAULT_READ_ERROR);
-			m_DiskLock.Release ();
-			m_BufferListLock.Release ();
-			return 0;
+	return 0;
+}
+
+TFATBlock *CFATCache::GetFreeBlock (unsigned nBlock, boolean bForReadAhead)
+{
+	// least recently used blocks are at the end of the list
+	TFATBlock *pBlock;
+	for (pBlock = m_BlockList.pLast; pBlock != 0; pBlock = pBlock->pPrev)
+	{
+		assert (pBlock->nMagic == BLOCK_MAGIC);
+
+		if (   pBlock->nUseCount == 0
+		    && (   !bForReadAhead
+			|| (   pBlock->nDirtyMask == 0
+			    && pBlock->pReadAhead == 0)))
+		{
+			break;
 		}
+	}
 
-		m_DiskLock.Release ();
+	if (pBlock == 0)
+	{
+		return 0;
 	}
 
-	MoveBufferFirst (pBuffer);
+	if (pBlock->pReadAhead != 0)
+	{
+		CompleteReadAhead (pBlock);
+	}
 
-	m_BufferListLock.Release ();
+	if (   pBlock->nDirtyMask != 0
+	    && !WriteBack (pBlock))
+	{
+		return 0;
+	}
 
-	return pBuffer;
+	if (pBlock->nBlock != NO_BLOCK)
+	{
+		RemoveHash (pBlock);
+	}
+
+	pBlock->nBlock = nBlock;
+	pBlock->nValidMask = 0;
+	assert (pBlock->nDirtyMask == 0);
+
+	// the first sectors of block 0 do not exist, if the blocks are shifted
+	for (unsigned i = 0; i < m_nBlockSectors; i++)
+	{
+		pBlock->Sector[i].nSector = GetFirstSector (nBlock) + i;
+	}
+
+	InsertHash (pBlock);
+
+	return pBlock;
 }
 
-void CFATCache::FreeSector (TFATBuffer *pBuffer, int bCritical)
+void CFATCache::InsertHash (TFATBlock *pBlock)
 {
-	assert (pBuffer->nMagic == BUFFER_MAGIC);
-	assert (pBuffer->nUseCount > 0);
-	pBuffer->nUseCount--;
-	if (pBuffer->nUseCount > 0)
+	assert (pBlock != 0);
+	TFATBlock **ppHead = &m_ppHashTable[pBlock->nBlock & m_nHashMask];
+
+	pBlock->pHashNext = *ppHead;
+	*ppHead = pBlock;
+}
+
+void CFATCache::RemoveHash (TFATBlock *pBlock)
+{
+	assert (pBlock != 0);
+	TFATBlock **ppLink = &m_ppHashTable[pBlock->nBlock & m_nHashMask];
+
+	while (*ppLink != pBlock)
 	{
-		return;
+		assert (*ppLink != 0);
+		ppLink = &(*ppLink)->pHashNext;
 	}
 
-	if (bCritical)
+	*ppLink = pBlock->pHashNext;
+	pBlock->pHashNext = 0;
+}
+
+unsigned CFATCache::GetFirstSector (unsigned nBlock) const
+{
+	// wraps around for block 0, if the blocks are shifted, but the sector
+	// number of each existing sector in the block (+ nIndex) is correct
+	return nBlock * m_nBlockSectors - m_nBlockOffset;
+}
+
+unsigned CFATCache::GetFirstIndex (unsigned nBlock) const
+{
+	return nBlock == 0 ? m_nBlockOffset : 0;
+}
+
+unsigned CFATCache::GetBlockSectors (unsigned nBlock) const
+{
+	s64 nSectors = (s64) m_nPartitionSectors - ((s64) nBlock * m_nBlockSectors - m_nBlockOffset);
+	if (nSectors <= 0)
 	{
-#if 0
-		if (pBuffer->bDirty)
-		{
-			m_DiskLock.Acquire ();
+		return 0;
+	}
 
-			m_pPartition->Seek (pBuffer->nSector * FAT_SECTOR_SIZE);
-			if (m_pPartition->Write (pBuffer->Data, FAT_SECTOR_SIZE) == FAT_SECTOR_SIZE)
-			{
-				pBuffer->bDirty = 0;
-			}
+	return nSectors < m_nBlockSectors ? (unsigned) nSectors : m_nBlockSectors;
+}
+
+int CFATCache::ReadSectors (TFATBlock *pBlock, unsigned nIndex, unsigned nCount)
+{
+	assert (pBlock != 0);
+	assert (nCount > 0);
+	assert (nIndex + nCount <= m_nBlockSectors);
 
+	m_DiskLock.Acquire ();
+
+	unsigned nSector = GetFirstSector (pBlock->nBlock) + nIndex;
+	unsigned nBytes = nCount * FAT_SECTOR_SIZE;
+
+	m_Statistics.nReads++;
+
+	m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+	if (m_pPartition->Read (pBlock->pData + nIndex * FAT_SECTOR_SIZE, nBytes) != (int) nBytes)
+	{
+		// the partition size may be unknown, retry with the requested sector only
+		nCount = 1;
+		nBytes = FAT_SECTOR_SIZE;
+
+		m_Statistics.nReads++;
+
+		m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+		if (m_pPartition->Read (pBlock->pData + nIndex * FAT_SECTOR_SIZE, nBytes) != (int) nBytes)
+		{
 			m_DiskLock.Release ();
+
+			return 0;
 		}
-#endif
 	}
-	else
+
+	m_DiskLock.Release ();
+
+	m_Statistics.nSectorsRead += nCount;
+
+	pBlock->nValidMask |= SectorMask (nIndex, nCount);
+
+	return 1;
+}
+
+int CFATCache::WriteBack (TFATBlock *pBlock)
+{
+	assert (pBlock != 0);
+
+	int nResult = 1;
+
+	m_DiskLock.Acquire ();
+
+	unsigned nIndex = 0;
+	while (pBlock->nDirtyMask != 0)
 	{
-		m_BufferListLock.Acquire ();
+		while (!(pBlock->nDirtyMask & (1U << nIndex)))
+		{
+			nIndex++;
+		}
+
+		unsigned nCount = 1;
+		while (   nIndex + nCount < m_nBlockSectors
+		       && (pBlock->nDirtyMask & (1U << (nIndex + nCount))))
+		{
+			nCount++;
+		}
+
+		pBlock->nDirtyMask &= ~SectorMask (nIndex, nCount);
 
-		MoveBufferLast (pBuffer);
+		unsigned nSector = GetFirstSector (pBlock->nBlock) + nIndex;
+		unsigned nBytes = nCount * FAT_SECTOR_SIZE;
 
-		m_BufferListLock.Release ();
+		m_Statistics.nWrites++;
+		m_Statistics.nSectorsWritten += nCount;
+
+		m_pPartition->Seek ((u64) nSector * FAT_SECTOR_SIZE);
+		if (m_pPartition->Write (pBlock->pData + nIndex * FAT_SECTOR_SIZE, nBytes) != (int) nBytes)
+		{
+			Fault (FAULT_WRITE_ERROR);
+
+			nResult = 0;
+		}
+
+		nIndex += nCount;
 	}
+
+	m_DiskLock.Release ();
+
+	return nResult;
 }
 
-void CFATCache::MarkDirty (TFATBuffer *pBuffer)
+void CFATCache::ReadAhead (unsigned nBlock)
 {
-	assert (pBuffer->nMagic == BUFFER_MAGIC);
-	assert (pBuffer->nUseCount > 0);
-	pBuffer->bDirty = 1;
+	unsigned nIndex = GetFirstIndex (nBlock);
+	unsigned nEnd = GetBlockSectors (nBlock);
+	if (   nEnd <= nIndex
+	    || LookupBlock (nBlock) != 0)
+	{
+		return;
+	}
+
+	unsigned nSectors = nEnd - nIndex;
+
+	TFATBlock *pBlock = GetFreeBlock (nBlock, TRUE);
+	if (pBlock == 0)
+	{
+		return;
+	}
+
+	u64 ullOffset = (u64) (GetFirstSector (nBlock) + nIndex) * FAT_SECTOR_SIZE;
+	CBlockRequest *pRequest = new CBlockRequest (BlockRequestRead,
+						     pBlock->pData + nIndex * FAT_SECTOR_SIZE,
+						     nSectors * FAT_SECTOR_SIZE, ullOffset);
+	if (   pRequest == 0
+	    || !m_pPartition->SubmitRequest (pRequest))
+	{
+		delete pRequest;
+
+		RemoveHash (pBlock);
+		pBlock->nBlock = NO_BLOCK;
+
+		MoveBlockLast (pBlock);
+
+		return;
+	}
+
+	pBlock->pReadAhead = pRequest;
+	pBlock->nReadAheadMask = SectorMask (nIndex, nSectors);
+
+	MoveBlockFirst (pBlock);
+
+	m_Statistics.nReadAheads++;
+	m_Statistics.nReads++;
+	m_Statistics.nSectorsRead += nSectors;
+}
+
+int CFATCache::CompleteReadAhead (TFATBlock *pBlock)
+{
+	assert (pBlock != 0);
+	CBlockRequest *pRequest = pBlock->pReadAhead;
+	assert (pRequest != 0);
+
+	int nResult = pRequest->Wait () == (int) pRequest->GetCount ();
+	if (nResult)
+	{
+		pBlock->nValidMask |= pBlock->nReadAheadMask;
+	}
+
+	delete pRequest;
+	pBlock->pReadAhead = 0;
+	pBlock->nReadAheadMask = 0;
+
+	return nResult;
 }
 
-void CFATCache::MoveBufferFirst (TFATBuffer *pBuffer)
+void CFATCache::MoveBlockFirst (TFATBlock *pBlock)
 {
-	if (m_BufferList.pFirst != pBuffer)
+	if (m_BlockList.pFirst != pBlock)
 	{
-		TFATBuffer *pNext = pBuffer->pNext;
-		TFATBuffer *pPrev = pBuffer->pPrev;
+		TFATBlock *pNext = pBlock->pNext;
+		TFATBlock *pPrev = pBlock->pPrev;
 
 		pPrev->pNext = pNext;
 
@@ -305,22 +763,22 @@ void CFATCache::MoveBufferFirst (TFATBuffer *pBuffer)
 		}
 		else
 		{
-			m_BufferList.pLast = pPrev;
+			m_BlockList.pLast = pPrev;
 		}
 
-		m_BufferList.pFirst->pPrev = pBuffer;
-		pBuffer->pNext = m_BufferList.pFirst;
-		m_BufferList.pFirst = pBuffer;
-		pBuffer->pPrev = 0;
+		m_BlockList.pFirst->pPrev = pBlock;
+		pBlock->pNext = m_BlockList.pFirst;
+		m_BlockList.pFirst = pBlock;
+		pBlock->pPrev = 0;
 	}
 }
 
-void CFATCache::MoveBufferLast (TFATBuffer *pBuffer)
+void CFATCache::MoveBlockLast (TFATBlock *pBlock)
 {
-	if (m_BufferList.pLast != pBuffer)
+	if (m_BlockList.pLast != pBlock)
 	{
-		TFATBuffer *pNext = pBuffer->pNext;
-		TFATBuffer *pPrev = pBuffer->pPrev;
+		TFATBlock *pNext = pBlock->pNext;
+		TFATBlock *pPrev = pBlock->pPrev;
 
 		pNext->pPrev = pPrev;
 
@@ -330,13 +788,13 @@ void CFATCache::MoveBufferLast (TFATBuffer *pBuffer)
 		}
 		else
 		{
-			m_BufferList.pFirst = pNext;
+			m_BlockList.pFirst = pNext;
 		}
 
-		m_BufferList.pLast->pNext = pBuffer;
-		pBuffer->pPrev = m_BufferList.pLast;
-		m_BufferList.pLast = pBuffer;
-		pBuffer->pNext = 0;
+		m_BlockList.pLast->pNext = pBlock;
+		pBlock->pPrev = m_BlockList.pLast;
+		m_BlockList.pLast = pBlock;
+		pBlock->pNext = 0;
 	}
 }
 
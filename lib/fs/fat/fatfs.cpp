@@ -2,7 +2,7 @@
 // fatfs.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -41,7 +41,9 @@ int CFATFileSystem::Mount (CDevice *pPartition)
 		return 0;
 	}
 
-	if (!m_FATInfo.Initialize ())
+	if (   !m_FATInfo.Initialize ()
+	    || !m_Cache.SetBlockSize (m_FATInfo.GetSectorsPerCluster (),
+				      m_FATInfo.GetFirstSector (2)))	// first data cluster
 	{
 		m_Cache.Close ();
 		return 0;
@@ -64,6 +66,11 @@ void CFATFileSystem::Synchronize (void)
 	m_Cache.Flush ();
 }
 
+void CFATFileSystem::GetCacheStatistics (TFATCacheStatistics *pStatistics) const
+{
+	m_Cache.GetStatistics (pStatistics);
+}
+
 unsigned CFATFileSystem::RootFindFirst (TDirentry *pEntry, TFindCurrentEntry *pCurrentEntry)
 {
 	return m_Root.FindFirst (pEntry, pCurrentEntry) ? 1 : 0;
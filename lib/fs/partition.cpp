@@ -2,7 +2,7 @@
 // partition.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -97,3 +97,29 @@ u64 CPartition::Seek (u64 ullOffset)
 
 	return m_ullOffset;
 }
+
+u64 CPartition::GetSize (void) const
+{
+	return (u64) m_nNumberOfSectors << FS_BLOCK_SHIFT;
+}
+
+boolean CPartition::SubmitRequest (CBlockRequest *pRequest)
+{
+	assert (pRequest != 0);
+	u64 ullOffset = pRequest->GetOffset ();
+
+	u64 ullTransferEnd = ullOffset + pRequest->GetCount () + FS_BLOCK_SIZE-1;
+	ullTransferEnd >>= FS_BLOCK_SHIFT;
+	if (   (ullOffset & FS_BLOCK_MASK) != 0
+	    || ullTransferEnd > m_nNumberOfSectors)
+	{
+		return FALSE;
+	}
+
+	u64 ullDeviceOffset = m_nFirstSector;
+	ullDeviceOffset <<= FS_BLOCK_SHIFT;
+	pRequest->SetOffset (ullDeviceOffset + ullOffset);
+
+	assert (m_pDevice != 0);
+	return m_pDevice->SubmitRequest (pRequest);
+}
@@ -2,7 +2,7 @@
 // heapallocator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,6 +18,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/heapallocator.h>
+#include <circle/multicore.h>
 #include <circle/logger.h>
 #include <circle/util.h>
 #include <assert.h>
@@ -28,9 +29,20 @@ CHeapAllocator::CHeapAllocator (const char *pHeapName)
 :	m_pHeapName (pHeapName),
 	m_pNext (0),
 	m_pLimit (0),
-	m_nReserve (0)
+	m_nReserve (0),
+	m_pLast (0),
+	m_nLargeFLBitmap (0)
+#ifdef HEAP_DEBUG
+	, m_pBase (0),
+	m_pHighWater (0),
+	m_nLargeUsed (0),
+	m_nLargeMaxUsed (0),
+	m_nLargeCount (0)
+#endif
 {
 	memset (m_Bucket, 0, sizeof m_Bucket);
+	memset (m_nLargeSLBitmap, 0, sizeof m_nLargeSLBitmap);
+	memset (m_pLargeFreeList, 0, sizeof m_pLargeFreeList);
 
 	unsigned nBuckets = sizeof s_nBucketSize / sizeof s_nBucketSize[0];
 	if (nBuckets > HEAP_BLOCK_MAX_BUCKETS)
@@ -42,6 +54,18 @@ CHeapAllocator::CHeapAllocator (const char *pHeapName)
 	{
 		m_Bucket[i].nSize = s_nBucketSize[i];
 	}
+
+#ifdef HEAP_CORE_CACHE
+	memset (m_CoreCache, 0, sizeof m_CoreCache);
+
+	for (m_nCachedBuckets = 0; m_nCachedBuckets < nBuckets; m_nCachedBuckets++)
+	{
+		if (m_Bucket[m_nCachedBuckets].nSize > HEAP_CORE_CACHE_MAX_SIZE)
+		{
+			break;
+		}
+	}
+#endif
 }
 
 CHeapAllocator::~CHeapAllocator (void)
@@ -53,6 +77,11 @@ void CHeapAllocator::Setup (uintptr nBase, size_t nSize, size_t nReserve)
 	m_pNext = (u8 *) nBase;
 	m_pLimit = (u8 *) (nBase + nSize);
 	m_nReserve = nReserve;
+
+#ifdef HEAP_DEBUG
+	m_pBase = m_pNext;
+	m_pHighWater = m_pNext;
+#endif
 }
 
 size_t CHeapAllocator::GetFreeSpace (void) const
@@ -67,6 +96,22 @@ void *CHeapAllocator::Allocate (size_t nSize)
 		return 0;
 	}
 
+#ifdef HEAP_CORE_CACHE
+	for (unsigned nBucket = 0; nBucket < m_nCachedBuckets; nBucket++)
+	{
+		if (nSize <= m_Bucket[nBucket].nSize)
+		{
+			void *pResult = CacheAllocate (nBucket);
+			if (pResult != 0)
+			{
+				return pResult;
+			}
+
+			break;		// cache is empty, allocate new block below
+		}
+	}
+#endif
+
 	m_SpinLock.Acquire ();
 
 	THeapBlockBucket *pBucket;
@@ -87,14 +132,32 @@ void *CHeapAllocator::Allocate (size_t nSize)
 		}
 	}
 
-	THeapBlockHeader *pBlockHeader;
-	if (   pBucket->nSize > 0
-	    && (pBlockHeader = pBucket->pFreeList) != 0)
+	THeapBlockHeader *pBlockHeader = 0;
+	if (pBucket->nSize > 0)
 	{
-		assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
-		pBucket->pFreeList = pBlockHeader->pNext;
+		if ((pBlockHeader = pBucket->pFreeList) != 0)
+		{
+			assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+			pBucket->pFreeList = pBlockHeader->pNext;
+		}
 	}
 	else
+	{
+		// large block, the following block starts directly behind its data
+		if (nSize < HEAP_LARGE_MIN_SIZE)
+		{
+			nSize = HEAP_LARGE_MIN_SIZE;
+		}
+
+		nSize = (nSize + HEAP_BLOCK_ALIGN-1) & ~HEAP_ALIGN_MASK;
+
+		if (nSize < HEAP_LARGE_MAX_SIZE)
+		{
+			pBlockHeader = LargeAllocate (nSize);
+		}
+	}
+
+	if (pBlockHeader == 0)
 	{
 		pBlockHeader = (THeapBlockHeader *) m_pNext;
 
@@ -102,7 +165,8 @@ void *CHeapAllocator::Allocate (size_t nSize)
 		pNextBlock += (sizeof (THeapBlockHeader) + nSize + HEAP_BLOCK_ALIGN-1) & ~HEAP_ALIGN_MASK;
 
 		if (   pNextBlock <= m_pNext			// may have wrapped
-		    || pNextBlock > m_pLimit-m_nReserve)
+		    || pNextBlock > m_pLimit-m_nReserve
+		    || nSize >= HEAP_LARGE_MAX_SIZE)
 		{
 			if (m_nReserve == 0)
 			{
@@ -132,8 +196,31 @@ void *CHeapAllocator::Allocate (size_t nSize)
 
 		pBlockHeader->nMagic = HEAP_BLOCK_MAGIC;
 		pBlockHeader->nSize = (u32) nSize;
+		pBlockHeader->pPrevPhys = m_pLast;
+		pBlockHeader->pPrevFree = 0;
+		pBlockHeader->nFlags = 0;
+
+		m_pLast = pBlockHeader;
+
+#ifdef HEAP_DEBUG
+		if (m_pNext > m_pHighWater)
+		{
+			m_pHighWater = m_pNext;
+		}
+#endif
 	}
 
+#ifdef HEAP_DEBUG
+	if (pBucket->nSize == 0)
+	{
+		m_nLargeCount++;
+		if ((m_nLargeUsed += pBlockHeader->nSize) > m_nLargeMaxUsed)
+		{
+			m_nLargeMaxUsed = m_nLargeUsed;
+		}
+	}
+#endif
+
 	m_SpinLock.Release ();
 
 	pBlockHeader->pNext = 0;
@@ -190,6 +277,18 @@ void CHeapAllocator::Free (void *pBlock)
 		(THeapBlockHeader *) ((uintptr) pBlock - sizeof (THeapBlockHeader));
 	assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
 
+#ifdef HEAP_CORE_CACHE
+	for (unsigned nBucket = 0; nBucket < m_nCachedBuckets; nBucket++)
+	{
+		if (pBlockHeader->nSize == m_Bucket[nBucket].nSize)
+		{
+			CacheFree (nBucket, pBlockHeader);
+
+			return;
+		}
+	}
+#endif
+
 	for (THeapBlockBucket *pBucket = m_Bucket; pBucket->nSize > 0; pBucket++)
 	{
 		if (pBlockHeader->nSize == pBucket->nSize)
@@ -209,12 +308,323 @@ void CHeapAllocator::Free (void *pBlock)
 		}
 	}
 
+	m_SpinLock.Acquire ();
+
+#ifdef HEAP_DEBUG
+	assert (m_nLargeCount > 0);
+	m_nLargeCount--;
+	m_nLargeUsed -= pBlockHeader->nSize;
+#endif
+
+	LargeFree (pBlockHeader);
+
+	m_SpinLock.Release ();
+}
+
+THeapBlockHeader *CHeapAllocator::LargeAllocate (size_t nSize)
+{
+	assert (nSize >= HEAP_LARGE_MIN_SIZE);
+	assert (nSize < HEAP_LARGE_MAX_SIZE);
+
+	// round up to the next list, so that each block on the found list is big enough
+	unsigned nFL, nSL;
+	LargeMapping (nSize + (1U << (31 - __builtin_clz (nSize) - HEAP_LARGE_SL_SHIFT)) - 1,
+		      &nFL, &nSL);
+	if (nFL >= HEAP_LARGE_FL_COUNT)
+	{
+		return 0;
+	}
+
+	u32 nSLMap = m_nLargeSLBitmap[nFL] & (~0U << nSL);
+	if (nSLMap == 0)
+	{
+		u32 nFLMap = m_nLargeFLBitmap & (~0U << (nFL+1));
+		if (nFLMap == 0)
+		{
+			return 0;
+		}
+
+		nFL = __builtin_ctz (nFLMap);
+		nSLMap = m_nLargeSLBitmap[nFL];
+		assert (nSLMap != 0);
+	}
+
+	nSL = __builtin_ctz (nSLMap);
+
+	THeapBlockHeader *pBlockHeader = m_pLargeFreeList[nFL][nSL];
+	assert (pBlockHeader != 0);
+	assert (pBlockHeader->nSize >= nSize);
+	LargeRemove (pBlockHeader);
+
+	// split off the remaining space, if it is big enough for a free block
+	if (pBlockHeader->nSize >= nSize + sizeof (THeapBlockHeader) + HEAP_LARGE_MIN_SIZE)
+	{
+		THeapBlockHeader *pRemain = (THeapBlockHeader *) (pBlockHeader->Data + nSize);
+		pRemain->nMagic = HEAP_BLOCK_MAGIC;
+		pRemain->nSize = pBlockHeader->nSize - nSize - sizeof (THeapBlockHeader);
+		pRemain->pPrevPhys = pBlockHeader;
+
+		pBlockHeader->nSize = (u32) nSize;
+
+		// a free block is never the last block, so there is always a next block
+		THeapBlockHeader *pNext = NextPhys (pRemain);
+		assert (pNext != 0);
+		pNext->pPrevPhys = pRemain;
+
+		LargeInsert (pRemain);
+	}
+
+	return pBlockHeader;
+}
+
+void CHeapAllocator::LargeFree (THeapBlockHeader *pBlockHeader)
+{
+	assert (pBlockHeader != 0);
+	assert (!(pBlockHeader->nFlags & HEAP_BLOCK_FLAG_FREE));
+
+	// coalesce with the following block
+	THeapBlockHeader *pNext = NextPhys (pBlockHeader);
+	if (   pNext != 0
+	    && (pNext->nFlags & HEAP_BLOCK_FLAG_FREE)
+	    && (size_t) pBlockHeader->nSize + sizeof (THeapBlockHeader) + pNext->nSize
+		< HEAP_LARGE_MAX_SIZE)
+	{
+		LargeRemove (pNext);
+
+		pBlockHeader->nSize += sizeof (THeapBlockHeader) + pNext->nSize;
+		pNext->nMagic = 0;
+	}
+
+	// coalesce with the preceding block
+	THeapBlockHeader *pPrev = pBlockHeader->pPrevPhys;
+	if (   pPrev != 0
+	    && (pPrev->nFlags & HEAP_BLOCK_FLAG_FREE)
+	    && (size_t) pPrev->nSize + sizeof (THeapBlockHeader) + pBlockHeader->nSize
+		< HEAP_LARGE_MAX_SIZE)
+	{
+		assert (pPrev->nMagic == HEAP_BLOCK_MAGIC);
+		LargeRemove (pPrev);
+
+		pPrev->nSize += sizeof (THeapBlockHeader) + pBlockHeader->nSize;
+		pBlockHeader->nMagic = 0;
+
+		pBlockHeader = pPrev;
+	}
+
+	pNext = NextPhys (pBlockHeader);
+	if (pNext != 0)
+	{
+		pNext->pPrevPhys = pBlockHeader;
+
+		LargeInsert (pBlockHeader);
+	}
+	else
+	{
+		// last block, return it to the free region
+		m_pLast = pBlockHeader->pPrevPhys;
+		m_pNext = (u8 *) pBlockHeader;
+
+		pBlockHeader->nMagic = 0;
+	}
+}
+
+void CHeapAllocator::LargeInsert (THeapBlockHeader *pBlockHeader)
+{
+	unsigned nFL, nSL;
+	LargeMapping (pBlockHeader->nSize, &nFL, &nSL);
+	assert (nFL < HEAP_LARGE_FL_COUNT);
+
+	THeapBlockHeader *pHead = m_pLargeFreeList[nFL][nSL];
+	if (pHead != 0)
+	{
+		pHead->pPrevFree = pBlockHeader;
+	}
+
+	pBlockHeader->pNext = pHead;
+	pBlockHeader->pPrevFree = 0;
+	pBlockHeader->nFlags |= HEAP_BLOCK_FLAG_FREE;
+
+	m_pLargeFreeList[nFL][nSL] = pBlockHeader;
+	m_nLargeFLBitmap |= 1U << nFL;
+	m_nLargeSLBitmap[nFL] |= 1U << nSL;
+}
+
+void CHeapAllocator::LargeRemove (THeapBlockHeader *pBlockHeader)
+{
+	assert (pBlockHeader->nFlags & HEAP_BLOCK_FLAG_FREE);
+
+	unsigned nFL, nSL;
+	LargeMapping (pBlockHeader->nSize, &nFL, &nSL);
+	assert (nFL < HEAP_LARGE_FL_COUNT);
+
+	if (pBlockHeader->pNext != 0)
+	{
+		pBlockHeader->pNext->pPrevFree = pBlockHeader->pPrevFree;
+	}
+
+	if (pBlockHeader->pPrevFree != 0)
+	{
+		pBlockHeader->pPrevFree->pNext = pBlockHeader->pNext;
+	}
+	else
+	{
+		assert (m_pLargeFreeList[nFL][nSL] == pBlockHeader);
+		m_pLargeFreeList[nFL][nSL] = pBlockHeader->pNext;
+
+		if (m_pLargeFreeList[nFL][nSL] == 0)
+		{
+			m_nLargeSLBitmap[nFL] &= ~(1U << nSL);
+			if (m_nLargeSLBitmap[nFL] == 0)
+			{
+				m_nLargeFLBitmap &= ~(1U << nFL);
+			}
+		}
+	}
+
+	pBlockHeader->pNext = 0;
+	pBlockHeader->pPrevFree = 0;
+	pBlockHeader->nFlags &= ~HEAP_BLOCK_FLAG_FREE;
+}
+
+THeapBlockHeader *CHeapAllocator::NextPhys (THeapBlockHeader *pBlockHeader) const
+{
+	u8 *pNext = pBlockHeader->Data + pBlockHeader->nSize;
+	if (pNext >= m_pNext)
+	{
+		return 0;
+	}
+
+	assert (((THeapBlockHeader *) pNext)->nMagic == HEAP_BLOCK_MAGIC);
+
+	return (THeapBlockHeader *) pNext;
+}
+
+void CHeapAllocator::LargeMapping (size_t nSize, unsigned *pFL, unsigned *pSL)
+{
+	assert (nSize >= HEAP_LARGE_MIN_SIZE);
+	assert (nSize <= 0xFFFFFFFFU);
+
+	unsigned nMSB = 31 - __builtin_clz ((u32) nSize);
+
+	*pSL = ((u32) nSize >> (nMSB - HEAP_LARGE_SL_SHIFT)) & (HEAP_LARGE_SL_COUNT-1);
+	*pFL = nMSB - HEAP_LARGE_FL_SHIFT;
+}
+
+#ifdef HEAP_CORE_CACHE
+
+// The cache of a core is only accessed from this core. Disabling the IRQs
+// locally is sufficient to protect it against concurrent use from an IRQ
+// handler. The global spin lock is only taken to refill or drain a cache.
+
+void *CHeapAllocator::CacheAllocate (unsigned nBucket)
+{
+	assert (nBucket < m_nCachedBuckets);
+
+	EnterCritical (IRQ_LEVEL);
+
+	THeapCoreCache *pCache = &m_CoreCache[CMultiCoreSupport::ThisCore ()];
+	unsigned &rCount = pCache->Bucket[nBucket].nCount;
+	THeapBlockHeader *&rpFreeList = pCache->Bucket[nBucket].pFreeList;
+
+	if (rpFreeList == 0)
+	{
+		// refill the cache with up to half of its capacity from the global free list
+		THeapBlockBucket *pBucket = &m_Bucket[nBucket];
+
+		m_SpinLock.Acquire ();
+
+		THeapBlockHeader *pBlockHeader;
+		while (   rCount < HEAP_CORE_CACHE_BLOCKS / 2
+		       && (pBlockHeader = pBucket->pFreeList) != 0)
+		{
+			assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+			pBucket->pFreeList = pBlockHeader->pNext;
+
+			pBlockHeader->pNext = rpFreeList;
+			rpFreeList = pBlockHeader;
+			rCount++;
+		}
+
 #ifdef HEAP_DEBUG
-	CLogger::Get ()->Write (m_pHeapName, LogDebug, "Trying to free large block (size %u)",
-				pBlockHeader->nSize);
+		if ((pBucket->nCount += rCount) > pBucket->nMaxCount)
+		{
+			pBucket->nMaxCount = pBucket->nCount;
+		}
 #endif
+
+		m_SpinLock.Release ();
+
+		if (rpFreeList == 0)
+		{
+			LeaveCritical ();
+
+			return 0;
+		}
+	}
+
+	THeapBlockHeader *pBlockHeader = rpFreeList;
+	assert (pBlockHeader->nMagic == HEAP_BLOCK_MAGIC);
+	rpFreeList = pBlockHeader->pNext;
+	assert (rCount > 0);
+	rCount--;
+
+	LeaveCritical ();
+
+	pBlockHeader->pNext = 0;
+
+	void *pResult = pBlockHeader->Data;
+	assert (((uintptr) pResult & HEAP_ALIGN_MASK) == 0);
+
+	return pResult;
+}
+
+void CHeapAllocator::CacheFree (unsigned nBucket, THeapBlockHeader *pBlockHeader)
+{
+	assert (nBucket < m_nCachedBuckets);
+	assert (pBlockHeader != 0);
+
+	EnterCritical (IRQ_LEVEL);
+
+	THeapCoreCache *pCache = &m_CoreCache[CMultiCoreSupport::ThisCore ()];
+	unsigned &rCount = pCache->Bucket[nBucket].nCount;
+	THeapBlockHeader *&rpFreeList = pCache->Bucket[nBucket].pFreeList;
+
+	pBlockHeader->pNext = rpFreeList;
+	rpFreeList = pBlockHeader;
+
+	if (++rCount >= HEAP_CORE_CACHE_BLOCKS)
+	{
+		// drain half of the cache to the global free list
+		THeapBlockHeader *pFirst = rpFreeList;
+		THeapBlockHeader *pLast = pFirst;
+		for (unsigned i = 1; i < HEAP_CORE_CACHE_BLOCKS / 2; i++)
+		{
+			pLast = pLast->pNext;
+			assert (pLast != 0);
+		}
+
+		rpFreeList = pLast->pNext;
+		rCount -= HEAP_CORE_CACHE_BLOCKS / 2;
+
+		THeapBlockBucket *pBucket = &m_Bucket[nBucket];
+
+		m_SpinLock.Acquire ();
+
+		pLast->pNext = pBucket->pFreeList;
+		pBucket->pFreeList = pFirst;
+
+#ifdef HEAP_DEBUG
+		pBucket->nCount -= HEAP_CORE_CACHE_BLOCKS / 2;
+#endif
+
+		m_SpinLock.Release ();
+	}
+
+	LeaveCritical ();
 }
 
+#endif
+
 #ifdef HEAP_DEBUG
 
 void CHeapAllocator::DumpStatus (void)
@@ -224,6 +634,54 @@ void CHeapAllocator::DumpStatus (void)
 		CLogger::Get ()->Write (m_pHeapName, LogDebug, "malloc(%lu): %u blocks (max %u)",
 					pBucket->nSize, pBucket->nCount, pBucket->nMaxCount);
 	}
+
+	size_t nLargeFree = 0;
+	size_t nLargeMaxFree = 0;
+	unsigned nLargeFreeCount = 0;
+	for (unsigned nFL = 0; nFL < HEAP_LARGE_FL_COUNT; nFL++)
+	{
+		for (unsigned nSL = 0; nSL < HEAP_LARGE_SL_COUNT; nSL++)
+		{
+			for (THeapBlockHeader *pBlockHeader = m_pLargeFreeList[nFL][nSL];
+			     pBlockHeader != 0;
+			     pBlockHeader = pBlockHeader->pNext)
+			{
+				nLargeFree += pBlockHeader->nSize;
+				nLargeFreeCount++;
+
+				if (pBlockHeader->nSize > nLargeMaxFree)
+				{
+					nLargeMaxFree = pBlockHeader->nSize;
+				}
+			}
+		}
+	}
+
+	CLogger::Get ()->Write (m_pHeapName, LogDebug, "Large: %u blocks with %lu bytes (max %lu)",
+				m_nLargeCount, m_nLargeUsed, m_nLargeMaxUsed);
+
+	// fragmentation is the part of free large block space, which is not in the biggest block
+	CLogger::Get ()->Write (m_pHeapName, LogDebug,
+				"Large: %u free blocks with %lu bytes (biggest %lu, fragmentation %u%%)",
+				nLargeFreeCount, nLargeFree, nLargeMaxFree,
+				nLargeFree > 0 ? (unsigned) (100 - nLargeMaxFree * 100 / nLargeFree) : 0);
+
+	CLogger::Get ()->Write (m_pHeapName, LogDebug, "High-water mark: %lu of %lu bytes",
+				(size_t) (m_pHighWater - m_pBase), (size_t) (m_pLimit - m_pBase));
+
+#ifdef HEAP_CORE_CACHE
+	for (unsigned nBucket = 0; nBucket < m_nCachedBuckets; nBucket++)
+	{
+		unsigned nCached = 0;
+		for (unsigned nCore = 0; nCore < CORES; nCore++)
+		{
+			nCached += m_CoreCache[nCore].Bucket[nBucket].nCount;
+		}
+
+		CLogger::Get ()->Write (m_pHeapName, LogDebug, "malloc(%lu): %u blocks cached",
+					m_Bucket[nBucket].nSize, nCached);
+	}
+#endif
 }
 
 #endif
@@ -2,7 +2,7 @@
 // i2cmaster.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // Large portions are:
 //	Copyright (C) 2011-2013 Mike McCauley
@@ -29,11 +29,7 @@
 #include <circle/timer.h>
 #include <assert.h>
 
-#if RASPPI < 4
-	#define DEVICES		2
-#else
-	#define DEVICES		7
-#endif
+#define DEVICES			I2C_MASTER_DEVICES
 
 #define CONFIGS			3
 
@@ -102,7 +98,12 @@ static unsigned s_GPIOConfig[DEVICES][CONFIGS][GPIOS] =
 					    ? GPIOModeAlternateFunction0	\
 					    : GPIOModeAlternateFunction5))
 
-CI2CMaster::CI2CMaster (unsigned nDevice, boolean bFastMode, unsigned nConfig)
+unsigned CI2CMaster::s_nInterruptUseCount = 0;
+CInterruptSystem *CI2CMaster::s_pInterruptSystem = 0;
+CI2CMaster *CI2CMaster::s_pThis[DEVICES] = {0};
+
+CI2CMaster::CI2CMaster (unsigned nDevice, boolean bFastMode, unsigned nConfig,
+			CInterruptSystem *pInterruptSystem)
 :	m_nDevice (nDevice),
 	m_nBaseAddress (0),
 	m_bFastMode (bFastMode),
@@ -110,7 +111,16 @@ CI2CMaster::CI2CMaster (unsigned nDevice, boolean bFastMode, unsigned nConfig)
 	m_bValid (FALSE),
 	m_nCoreClockRate (CMachineInfo::Get ()->GetClockRate (CLOCK_ID_CORE)),
 	m_nClockSpeed (0),
-	m_SpinLock (TASK_LEVEL)
+	m_pInterruptSystem (pInterruptSystem),
+	m_pFirst (0),
+	m_pLast (0),
+	m_pCurrent (0),
+	m_pWriteData (0),
+	m_nWriteCount (0),
+	m_pReadData (0),
+	m_nReadCount (0),
+	m_bTxInterrupt (FALSE),
+	m_SpinLock (pInterruptSystem != 0 ? IRQ_LEVEL : TASK_LEVEL)
 {
 	if (   m_nDevice >= DEVICES
 	    || m_nConfig >= CONFIGS
@@ -137,6 +147,54 @@ CI2CMaster::CI2CMaster (unsigned nDevice, boolean bFastMode, unsigned nConfig)
 
 CI2CMaster::~CI2CMaster (void)
 {
+	if (   m_bValid
+	    && m_pInterruptSystem != 0
+	    && s_pThis[m_nDevice] == this)
+	{
+		m_SpinLock.Acquire ();
+
+		PeripheralEntry ();
+		write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, C_CLEAR);
+		write32 (m_nBaseAddress + ARM_BSC_S__OFFSET, S_CLKT | S_ERR | S_DONE);
+		PeripheralExit ();
+
+		CI2CTransaction *pList = m_pCurrent;
+		if (pList != 0)
+		{
+			pList->m_pNext = m_pFirst;
+		}
+		else
+		{
+			pList = m_pFirst;
+		}
+
+		m_pCurrent = 0;
+		m_pFirst = 0;
+		m_pLast = 0;
+
+		// remove device from interrupt handling
+		s_pThis[m_nDevice] = 0;
+		DataSyncBarrier ();
+
+		m_SpinLock.Release ();
+
+		// disconnect interrupt, if this is the last device, which uses interrupts
+		if (--s_nInterruptUseCount == 0)
+		{
+			assert (s_pInterruptSystem != 0);
+			s_pInterruptSystem->DisconnectIRQ (ARM_IRQ_I2C);
+			s_pInterruptSystem = 0;
+		}
+
+		while (pList != 0)
+		{
+			CI2CTransaction *pTransaction = pList;
+			pList = pTransaction->m_pNext;
+
+			pTransaction->Complete (-I2C_MASTER_DATA_LEFT);
+		}
+	}
+
 	if (m_bValid)
 	{
 		m_SDA.SetMode (GPIOModeInput);
@@ -157,6 +215,28 @@ boolean CI2CMaster::Initialize (void)
 
 	SetClock (m_bFastMode ? 400000 : 100000);
 
+	if (m_pInterruptSystem != 0)
+	{
+		// the interrupt is shared by all BSC masters
+		if (s_nInterruptUseCount > 0)
+		{
+			if (m_pInterruptSystem != s_pInterruptSystem)
+			{
+				return FALSE;
+			}
+		}
+
+		assert (s_pThis[m_nDevice] == 0);
+		s_pThis[m_nDevice] = this;
+		DataSyncBarrier ();
+
+		if (s_nInterruptUseCount++ == 0)
+		{
+			s_pInterruptSystem = m_pInterruptSystem;
+			s_pInterruptSystem->ConnectIRQ (ARM_IRQ_I2C, InterruptStub, 0);
+		}
+	}
+
 	return TRUE;
 }
 
@@ -189,6 +269,17 @@ int CI2CMaster::Read (u8 ucAddress, void *pBuffer, unsigned nCount)
 		return -I2C_MASTER_INALID_PARM;
 	}
 
+	if (m_pInterruptSystem != 0)
+	{
+		CI2CTransaction Transaction (ucAddress, 0, 0, pBuffer, nCount);
+		if (!Submit (&Transaction))
+		{
+			return -I2C_MASTER_INALID_PARM;
+		}
+
+		return Transaction.Wait ();
+	}
+
 	m_SpinLock.Acquire ();
 
 	u8 *pData = (u8 *) pBuffer;
@@ -269,6 +360,17 @@ int CI2CMaster::Write (u8 ucAddress, const void *pBuffer, unsigned nCount)
 		return -I2C_MASTER_INALID_PARM;
 	}
 
+	if (m_pInterruptSystem != 0)
+	{
+		CI2CTransaction Transaction (ucAddress, pBuffer, nCount);
+		if (!Submit (&Transaction))
+		{
+			return -I2C_MASTER_INALID_PARM;
+		}
+
+		return Transaction.Wait ();
+	}
+
 	m_SpinLock.Acquire ();
 
 	u8 *pData = (u8 *) pBuffer;
@@ -354,6 +456,18 @@ int CI2CMaster::WriteReadRepeatedStart (u8 ucAddress,
 		return -I2C_MASTER_INALID_PARM;
 	}
 
+	if (m_pInterruptSystem != 0)
+	{
+		CI2CTransaction Transaction (ucAddress, pWriteBuffer, nWriteCount,
+					     pReadBuffer, nReadCount);
+		if (!Submit (&Transaction))
+		{
+			return -I2C_MASTER_INALID_PARM;
+		}
+
+		return Transaction.Wait ();
+	}
+
 	m_SpinLock.Acquire ();
 
 	u8 *pWriteData = (u8 *) pWriteBuffer;
@@ -444,3 +558,262 @@ int CI2CMaster::WriteReadRepeatedStart (u8 ucAddress,
 
 	return nResult;
 }
+
+boolean CI2CMaster::Submit (CI2CTransaction *pTransaction)
+{
+	assert (m_bValid);
+	assert (pTransaction != 0);
+
+	if (   pTransaction->m_ucAddress >= 0x80
+	    || (pTransaction->m_nWriteCount != 0 && pTransaction->m_pWriteBuffer == 0)
+	    || (pTransaction->m_nReadCount != 0 && pTransaction->m_pReadBuffer == 0)
+	    || (pTransaction->m_nReadCount != 0 && pTransaction->m_nWriteCount > FIFO_SIZE))
+	{
+		return FALSE;
+	}
+
+	pTransaction->m_bCompleted = FALSE;
+	pTransaction->m_nResult = -1;
+	pTransaction->m_pNext = 0;
+#ifdef NO_BUSY_WAIT
+	pTransaction->m_Event.Clear ();
+#endif
+
+	if (m_pInterruptSystem == 0)
+	{
+		// polling driver, execute the transaction immediately
+		int nResult;
+		if (pTransaction->m_nReadCount == 0)
+		{
+			nResult = Write (pTransaction->m_ucAddress, pTransaction->m_pWriteBuffer,
+					 pTransaction->m_nWriteCount);
+		}
+		else if (pTransaction->m_nWriteCount == 0)
+		{
+			nResult = Read (pTransaction->m_ucAddress, pTransaction->m_pReadBuffer,
+					pTransaction->m_nReadCount);
+		}
+		else
+		{
+			nResult = WriteReadRepeatedStart (pTransaction->m_ucAddress,
+							  pTransaction->m_pWriteBuffer,
+							  pTransaction->m_nWriteCount,
+							  pTransaction->m_pReadBuffer,
+							  pTransaction->m_nReadCount);
+		}
+
+		pTransaction->Complete (nResult);
+
+		return TRUE;
+	}
+
+	assert (s_pThis[m_nDevice] == this);	// Initialize() must have been called
+
+	m_SpinLock.Acquire ();
+
+	if (m_pLast != 0)
+	{
+		m_pLast->m_pNext = pTransaction;
+	}
+	else
+	{
+		m_pFirst = pTransaction;
+	}
+
+	m_pLast = pTransaction;
+
+	if (m_pCurrent == 0)
+	{
+		StartTransaction ();
+	}
+
+	m_SpinLock.Release ();
+
+	return TRUE;
+}
+
+// m_SpinLock must be acquired
+void CI2CMaster::StartTransaction (void)
+{
+	assert (m_pCurrent == 0);
+
+	CI2CTransaction *pTransaction = m_pFirst;
+	if (pTransaction == 0)
+	{
+		return;
+	}
+
+	m_pFirst = pTransaction->m_pNext;
+	if (m_pFirst == 0)
+	{
+		m_pLast = 0;
+	}
+
+	m_pCurrent = pTransaction;
+
+	m_pWriteData = (const u8 *) pTransaction->m_pWriteBuffer;
+	m_nWriteCount = pTransaction->m_nWriteCount;
+	m_pReadData = (u8 *) pTransaction->m_pReadBuffer;
+	m_nReadCount = pTransaction->m_nReadCount;
+	m_bTxInterrupt = FALSE;
+
+	PeripheralEntry ();
+
+	// setup transfer
+	write32 (m_nBaseAddress + ARM_BSC_A__OFFSET, pTransaction->m_ucAddress);
+
+	write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, C_CLEAR);
+	write32 (m_nBaseAddress + ARM_BSC_S__OFFSET, S_CLKT | S_ERR | S_DONE);
+
+	if (   m_nWriteCount > 0
+	    || m_nReadCount == 0)
+	{
+		write32 (m_nBaseAddress + ARM_BSC_DLEN__OFFSET, m_nWriteCount);
+
+		// fill FIFO
+		for (unsigned i = 0; m_nWriteCount > 0 && i < FIFO_SIZE; i++)
+		{
+			write32 (m_nBaseAddress + ARM_BSC_FIFO__OFFSET, *m_pWriteData++);
+
+			m_nWriteCount--;
+		}
+
+		if (m_nReadCount == 0)
+		{
+			// start transfer, refill FIFO from interrupt handler
+			m_bTxInterrupt = m_nWriteCount > 0;
+			write32 (m_nBaseAddress + ARM_BSC_C__OFFSET,
+				 C_I2CEN | C_ST | C_INTD | (m_bTxInterrupt ? C_INTT : 0));
+
+			PeripheralExit ();
+
+			return;
+		}
+
+		// start transfer
+		write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, C_I2CEN | C_ST);
+
+		// poll for transfer has started (takes a few microseconds only),
+		// the read has to be set up, before the write has been completed
+		while (!(read32 (m_nBaseAddress + ARM_BSC_S__OFFSET) & S_TA))
+		{
+			if (read32 (m_nBaseAddress + ARM_BSC_S__OFFSET) & S_DONE)
+			{
+				break;
+			}
+		}
+	}
+
+	write32 (m_nBaseAddress + ARM_BSC_DLEN__OFFSET, m_nReadCount);
+
+	write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, C_I2CEN | C_ST | C_READ | C_INTR | C_INTD);
+
+	PeripheralExit ();
+}
+
+void CI2CMaster::InterruptHandler (void)
+{
+	m_SpinLock.Acquire ();
+
+	// the interrupt is shared, there may be nothing to do for this device
+	CI2CTransaction *pTransaction = m_pCurrent;
+	if (pTransaction == 0)
+	{
+		m_SpinLock.Release ();
+
+		return;
+	}
+
+	PeripheralEntry ();
+
+	while (   m_nWriteCount > 0
+	       && (read32 (m_nBaseAddress + ARM_BSC_S__OFFSET) & S_TXD))
+	{
+		write32 (m_nBaseAddress + ARM_BSC_FIFO__OFFSET, *m_pWriteData++);
+
+		m_nWriteCount--;
+	}
+
+	if (   m_bTxInterrupt
+	    && m_nWriteCount == 0)
+	{
+		write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, C_I2CEN | C_INTD);
+
+		m_bTxInterrupt = FALSE;
+	}
+
+	while (   m_nReadCount > 0
+	       && (read32 (m_nBaseAddress + ARM_BSC_S__OFFSET) & S_RXD))
+	{
+		*m_pReadData++ = read32 (m_nBaseAddress + ARM_BSC_FIFO__OFFSET) & FIFO__MASK;
+
+		m_nReadCount--;
+	}
+
+	u32 nStatus = read32 (m_nBaseAddress + ARM_BSC_S__OFFSET);
+	if (!(nStatus & S_DONE))
+	{
+		PeripheralExit ();
+
+		m_SpinLock.Release ();
+
+		return;
+	}
+
+	// transfer has finished, grab any remaining stuff from FIFO
+	while (   m_nReadCount > 0
+	       && (read32 (m_nBaseAddress + ARM_BSC_S__OFFSET) & S_RXD))
+	{
+		*m_pReadData++ = read32 (m_nBaseAddress + ARM_BSC_FIFO__OFFSET) & FIFO__MASK;
+
+		m_nReadCount--;
+	}
+
+	int nResult;
+	if (nStatus & S_ERR)
+	{
+		nResult = -I2C_MASTER_ERROR_NACK;
+	}
+	else if (nStatus & S_CLKT)
+	{
+		nResult = -I2C_MASTER_ERROR_CLKT;
+	}
+	else if (   m_nWriteCount > 0
+		 || m_nReadCount > 0)
+	{
+		nResult = -I2C_MASTER_DATA_LEFT;
+	}
+	else if (pTransaction->m_nReadCount > 0)
+	{
+		nResult = pTransaction->m_nReadCount;
+	}
+	else
+	{
+		nResult = pTransaction->m_nWriteCount;
+	}
+
+	// disable interrupts and acknowledge status
+	write32 (m_nBaseAddress + ARM_BSC_C__OFFSET, 0);
+	write32 (m_nBaseAddress + ARM_BSC_S__OFFSET, S_CLKT | S_ERR | S_DONE);
+
+	PeripheralExit ();
+
+	m_pCurrent = 0;
+	StartTransaction ();
+
+	m_SpinLock.Release ();
+
+	pTransaction->Complete (nResult);
+}
+
+void CI2CMaster::InterruptStub (void *pParam)
+{
+	for (unsigned i = 0; i < DEVICES; i++)
+	{
+		CI2CMaster *pThis = s_pThis[i];
+		if (pThis != 0)
+		{
+			pThis->InterruptHandler ();
+		}
+	}
+}
@@ -0,0 +1,91 @@
+//
+// i2ctransaction.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/i2ctransaction.h>
+#include <circle/synchronize.h>
+#include <assert.h>
+
+CI2CTransaction::CI2CTransaction (u8 ucAddress,
+				  const void *pWriteBuffer, unsigned nWriteCount,
+				  void *pReadBuffer, unsigned nReadCount)
+:	m_ucAddress (ucAddress),
+	m_pWriteBuffer (pWriteBuffer),
+	m_nWriteCount (nWriteCount),
+	m_pReadBuffer (pReadBuffer),
+	m_nReadCount (nReadCount),
+	m_pCompletionRoutine (0),
+	m_pCompletionParam (0),
+	m_bCompleted (FALSE),
+	m_nResult (-1),
+	m_pNext (0)
+{
+}
+
+CI2CTransaction::~CI2CTransaction (void)
+{
+	m_pCompletionRoutine = 0;
+	m_pWriteBuffer = 0;
+	m_pReadBuffer = 0;
+}
+
+void CI2CTransaction::SetCompletionRoutine (TI2CCompletionRoutine *pRoutine, void *pParam)
+{
+	assert (!m_bCompleted);
+
+	m_pCompletionRoutine = pRoutine;
+	m_pCompletionParam = pParam;
+}
+
+int CI2CTransaction::Wait (void)
+{
+#ifdef NO_BUSY_WAIT
+	m_Event.Wait ();
+#else
+	while (!m_bCompleted)
+	{
+		// the transaction is completed from interrupt context
+	}
+
+	DataMemBarrier ();		// read m_nResult after m_bCompleted
+#endif
+
+	return m_nResult;
+}
+
+void CI2CTransaction::Complete (int nResult)
+{
+	assert (!m_bCompleted);
+
+	// the transaction may be deleted by the completion routine or the waiting task
+	TI2CCompletionRoutine *pRoutine = m_pCompletionRoutine;
+	void *pParam = m_pCompletionParam;
+
+	m_nResult = nResult;
+	DataMemBarrier ();		// m_nResult must be visible before m_bCompleted
+	m_bCompleted = TRUE;
+
+#ifdef NO_BUSY_WAIT
+	m_Event.Set ();
+#endif
+
+	if (pRoutine != 0)
+	{
+		(*pRoutine) (this, pParam);
+	}
+}
@@ -2,7 +2,7 @@
 // interrupt.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -45,6 +45,12 @@
 				   ? ARM_IC_DISABLE_IRQS_2	\
 				   : ARM_IC_DISABLE_BASIC_IRQS))
 #define ARM_IRQ_MASK(irq)	(1 << ((irq) & (ARM_IRQS_PER_REG-1)))
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define THIS_CORE()	CMultiCoreSupport::ThisCore ()
+#else
+	#define THIS_CORE()	0
+#endif
 				   
 CInterruptSystem *CInterruptSystem::s_pThis = 0;
 
@@ -73,6 +79,7 @@ CInterruptSystem::~CInterruptSystem (void)
 
 #if RASPPI >= 2
 	write32 (ARM_LOCAL_TIMER_INT_CONTROL0, 0);
+	write32 (ARM_LOCAL_PM_ROUTING_CLR, 0xFF);
 #endif
 
 	PeripheralExit ();
@@ -103,6 +110,7 @@ boolean CInterruptSystem::Initialize (void)
 
 #if RASPPI >= 2
 	write32 (ARM_LOCAL_TIMER_INT_CONTROL0, 0);
+	write32 (ARM_LOCAL_PM_ROUTING_CLR, 0xFF);
 #endif
 
 	PeripheralExit ();
@@ -173,9 +181,17 @@ void CInterruptSystem::EnableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)
+		{
+			// the PMU interrupt is enabled for the calling core only
+			write32 (ARM_LOCAL_PM_ROUTING_SET, 1 << THIS_CORE ());
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -197,9 +213,16 @@ void CInterruptSystem::DisableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)
+		{
+			write32 (ARM_LOCAL_PM_ROUTING_CLR, 1 << THIS_CORE ());
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -259,13 +282,21 @@ void CInterruptSystem::InterruptHandler (void)
 
 #if RASPPI >= 2
 	u32 nLocalPending = read32 (ARM_LOCAL_IRQ_PENDING0);
-	assert (!(nLocalPending & ~(1 << 1 | 0xF << 4 | 1 << 8)));
-	if (nLocalPending & (1 << 1))		// the only implemented local IRQ so far
+	assert (!(nLocalPending & ~(1 << 1 | 0xF << 4 | 1 << 8 | 1 << 9)));
+	if (nLocalPending & (1 << 1))
 	{
 		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_CNTPNS);
 
 		return;
 	}
+
+	// the PMU interrupt is handled on the core, which has triggered it
+	if (read32 (ARM_LOCAL_IRQ_PENDING0 + 4 * THIS_CORE ()) & (1 << 9))
+	{
+		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_PMU);
+
+		return;
+	}
 #endif
 
 #ifdef ARM_ALLOW_MULTI_CORE
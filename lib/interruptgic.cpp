@@ -4,7 +4,7 @@
 // Driver for the GIC-400 interrupt controller of the Raspberry Pi 4
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -155,6 +155,12 @@ boolean CInterruptSystem::Initialize (void)
 						| GICD_ITARGETSR_CORE0 << 24);
 	}
 
+	// the PMU interrupts belong to the core, which triggers them (one byte per interrupt)
+	write32 (GICD_ITARGETSR0 + ARM_IRQ_PMU0,   GICD_ITARGETSR_CORE0
+						 | GICD_ITARGETSR_CORE0 << 1 << 8
+						 | GICD_ITARGETSR_CORE0 << 2 << 16
+						 | GICD_ITARGETSR_CORE0 << 3 << 24);
+
 	// set all interrupts to level triggered
 	for (unsigned n = 0; n < IRQ_LINES/16; n++)
 	{
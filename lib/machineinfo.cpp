@@ -2,7 +2,7 @@
 // machineinfo.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -616,6 +616,42 @@ TMemoryWindow CMachineInfo::GetPCIeDMAMemory (void) const
 	return Result;
 }
 
+TMemoryWindow CMachineInfo::GetEMMC2DMAMemory (void) const
+{
+	assert (s_pThis != 0);
+	if (s_pThis != this)
+	{
+		return s_pThis->GetEMMC2DMAMemory ();
+	}
+
+	TMemoryWindow Result;
+	Result.BusAddress = 0;
+	Result.CPUAddress = 0;
+	Result.Size = 0;
+
+	// BCM2711B0: <0x0 0xC0000000  0x0 0x00000000  0x40000000>
+	// BCM2711C0: <0x0 0x00000000  0x0 0x00000000  0xFC000000> (set by the firmware)
+	if (m_pDTB != 0)
+	{
+		const TDeviceTreeNode *pBus = m_pDTB->FindNode ("/emmc2bus");
+		if (pBus != 0)
+		{
+			const TDeviceTreeProperty *pDMA = m_pDTB->FindProperty (pBus, "dma-ranges");
+			if (   pDMA != 0
+			    && m_pDTB->GetPropertyValueLength (pDMA) == sizeof (u32)*5)
+			{
+				Result.BusAddress = (u64) m_pDTB->GetPropertyValueWord (pDMA, 0) << 32
+							| m_pDTB->GetPropertyValueWord (pDMA, 1);
+				Result.CPUAddress = (u64) m_pDTB->GetPropertyValueWord (pDMA, 2) << 32
+							| m_pDTB->GetPropertyValueWord (pDMA, 3);
+				Result.Size	  = m_pDTB->GetPropertyValueWord (pDMA, 4);
+			}
+		}
+	}
+
+	return Result;
+}
+
 #endif
 
 CMachineInfo *CMachineInfo::Get (void)
@@ -2,7 +2,7 @@
 // arphandler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +19,7 @@
 //
 #include <circle/net/arphandler.h>
 #include <circle/net/linklayer.h>
+#include <circle/net/netsubsystem.h>
 #include <circle/util.h>
 #include <circle/macros.h>
 #include <assert.h>
@@ -435,4 +436,6 @@ void CARPHandler::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *p
 	}
 
 	pThis->m_SpinLock.Release ();
+
+	CNetSubSystem::Get ()->WakeUp ();
 }
@@ -2,7 +2,7 @@
 // checksumcalculator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,17 @@
 #include <circle/util.h>
 #include <assert.h>
 
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CHECKSUM_NEON
+#endif
+
+#define NEON_MIN_LENGTH		64		// shorter blocks are summed up without NEON
+#define NEON_MAX_ITERATIONS	16384		// before the 32-bit lanes may overflow
+
+static u32 SumBlock (const u8 *pBuffer, unsigned nLength);
+static u32 CopyAndSumBlock (u8 *pDest, const u8 *pSource, unsigned nLength);
+
 CChecksumCalculator::CChecksumCalculator (const CIPAddress &rSourceIP, int nProtocol)
 :	m_bDestAddressSet (FALSE)
 {
@@ -69,6 +80,23 @@ u16 CChecksumCalculator::Calculate (const void *pBuffer, unsigned nLength)
 	return ~FoldResult (nChecksum);
 }
 
+u16 CChecksumCalculator::Calculate (const void *pHeader, unsigned nHeaderLength,
+				     u32 nDataSum, unsigned nDataLength)
+{
+	assert (m_bDestAddressSet);
+
+	m_Header.nTCPLength = le2be16 (nHeaderLength + nDataLength);
+	u32 nChecksum = CalculateChunk (&m_Header, sizeof m_Header, 0);
+
+	assert (pHeader != 0);
+	assert (nHeaderLength > 0);
+	nChecksum = CalculateChunk (pHeader, nHeaderLength, nChecksum);
+
+	nChecksum = AddSum (FoldResult (nChecksum), nDataSum, nHeaderLength);
+
+	return ~FoldResult (nChecksum);
+}
+
 u16 CChecksumCalculator::SimpleCalculate (const void *pBuffer, unsigned nLength)
 {
 	assert (pBuffer != 0);
@@ -78,25 +106,65 @@ u16 CChecksumCalculator::SimpleCalculate (const void *pBuffer, unsigned nLength)
 	return ~FoldResult (nChecksum);
 }
 
-u32 CChecksumCalculator::CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum)
+u32 CChecksumCalculator::Sum (const void *pBuffer, unsigned nLength)
 {
-	u16 *pBuffer16 = (u16 *) pBuffer;
-	assert (pBuffer16 != 0);
-	assert (nLength > 0);
+	if (nLength == 0)
+	{
+		return 0;
+	}
 
-	while (nLength >= 2)
+	return FoldResult (CalculateChunk (pBuffer, nLength, 0));
+}
+
+u32 CChecksumCalculator::CopyAndSum (void *pDest, const void *pSource, unsigned nLength)
+{
+	if (nLength == 0)
 	{
-		nChecksum += *pBuffer16++;
-		nLength -= 2;
+		return 0;
 	}
 
-	assert (nLength <= 1);
-	if (nLength != 0)
+	assert (pDest != 0);
+	assert (pSource != 0);
+	return CopyAndSumBlock ((u8 *) pDest, (const u8 *) pSource, nLength);
+}
+
+u32 CChecksumCalculator::AddSum (u32 nSum, u32 nBlockSum, unsigned nOffset)
+{
+	assert (nBlockSum <= 0xFFFF);
+
+	// a block at an odd offset has its bytes in the other half of the 16-bit words
+	if (nOffset & 1)
 	{
-		nChecksum += *(u8 *) pBuffer16;
+		nBlockSum = ((nBlockSum & 0xFF) << 8) | (nBlockSum >> 8);
 	}
-	
-	return nChecksum;
+
+	return FoldResult (FoldResult (nSum) + nBlockSum);
+}
+
+u16 CChecksumCalculator::Update (u16 nChecksum, u16 nOldValue, u16 nNewValue)
+{
+	// RFC 1624 equation 3: HC' = ~(~HC + ~m + m')
+	u32 nSum = (u16) ~nChecksum + (u32) (u16) ~nOldValue + nNewValue;
+
+	return ~FoldResult (nSum);
+}
+
+u16 CChecksumCalculator::Update32 (u16 nChecksum, u32 nOldValue, u32 nNewValue)
+{
+	u32 nSum =   (u16) ~nChecksum
+		   + (u32) (u16) ~(nOldValue & 0xFFFF) + (u32) (u16) ~(nOldValue >> 16)
+		   + (nNewValue & 0xFFFF) + (nNewValue >> 16);
+
+	return ~FoldResult (nSum);
+}
+
+u32 CChecksumCalculator::CalculateChunk (const void *pBuffer, unsigned nLength, u32 nChecksum)
+{
+	assert (pBuffer != 0);
+	assert (nLength > 0);
+
+	// the result is not folded, but must not overflow
+	return FoldResult (nChecksum) + SumBlock ((const u8 *) pBuffer, nLength);
 }
 
 u16 CChecksumCalculator::FoldResult (u32 nChecksum)
@@ -112,3 +180,230 @@ u16 CChecksumCalculator::FoldResult (u32 nChecksum)
 	
 	return (u16) nChecksum;
 }
+
+static inline u32 Fold64 (u64 ulSum)
+{
+	ulSum = (ulSum & 0xFFFFFFFF) + (ulSum >> 32);
+	ulSum = (ulSum & 0xFFFFFFFF) + (ulSum >> 32);
+
+	u32 nSum = (u32) ulSum;
+	nSum = (nSum & 0xFFFF) + (nSum >> 16);
+	nSum = (nSum & 0xFFFF) + (nSum >> 16);
+
+	return nSum;
+}
+
+static inline u32 SwapBytes16 (u32 nSum)
+{
+	return ((nSum & 0xFF) << 8) | (nSum >> 8);
+}
+
+#ifdef CHECKSUM_NEON
+
+// sums up 32 bytes per iteration, pSource must be 2-byte aligned
+static u64 SumNEON (const u8 **ppSource, unsigned *pLength, u8 **ppDest)
+{
+	const u8 *pSource = *ppSource;
+	u8 *pDest = ppDest != 0 ? *ppDest : 0;
+	unsigned nLength = *pLength;
+
+	u64 ulSum = 0;
+	while (nLength >= 32)
+	{
+		uint32x4_t vSum0 = vdupq_n_u32 (0);
+		uint32x4_t vSum1 = vdupq_n_u32 (0);
+
+		unsigned nIterations = nLength / 32;
+		if (nIterations > NEON_MAX_ITERATIONS)
+		{
+			nIterations = NEON_MAX_ITERATIONS;
+		}
+
+		nLength -= nIterations * 32;
+
+		if (pDest == 0)
+		{
+			while (nIterations--)
+			{
+				vSum0 = vpadalq_u16 (vSum0, vld1q_u16 ((const u16 *) pSource));
+				vSum1 = vpadalq_u16 (vSum1, vld1q_u16 ((const u16 *) (pSource + 16)));
+
+				pSource += 32;
+			}
+		}
+		else
+		{
+			while (nIterations--)
+			{
+				uint8x16_t v0 = vld1q_u8 (pSource);
+				uint8x16_t v1 = vld1q_u8 (pSource + 16);
+
+				vst1q_u8 (pDest, v0);
+				vst1q_u8 (pDest + 16, v1);
+
+				vSum0 = vpadalq_u16 (vSum0, vreinterpretq_u16_u8 (v0));
+				vSum1 = vpadalq_u16 (vSum1, vreinterpretq_u16_u8 (v1));
+
+				pSource += 32;
+				pDest += 32;
+			}
+		}
+
+		uint64x2_t vSum = vaddq_u64 (vpaddlq_u32 (vSum0), vpaddlq_u32 (vSum1));
+		ulSum += vgetq_lane_u64 (vSum, 0);
+		ulSum += vgetq_lane_u64 (vSum, 1);
+	}
+
+	*ppSource = pSource;
+	*pLength = nLength;
+	if (ppDest != 0)
+	{
+		*ppDest = pDest;
+	}
+
+	return ulSum;
+}
+
+#endif
+
+// returns the 16-bit sum of a block, which starts at an even offset in the packet
+static u32 SumBlock (const u8 *pBuffer, unsigned nLength)
+{
+	u64 ulSum = 0;
+
+	// an odd address is summed up with swapped bytes, which is corrected at the end
+	boolean bOdd = (uintptr) pBuffer & 1;
+	if (   bOdd
+	    && nLength > 0)
+	{
+		ulSum = (u32) *pBuffer++ << 8;
+		nLength--;
+	}
+
+	// align to 8 bytes
+	while (   ((uintptr) pBuffer & 7)
+	       && nLength >= 2)
+	{
+		ulSum += *(const u16 *) pBuffer;
+		pBuffer += 2;
+		nLength -= 2;
+	}
+
+#ifdef CHECKSUM_NEON
+	if (nLength >= NEON_MIN_LENGTH)
+	{
+		ulSum += SumNEON (&pBuffer, &nLength, 0);
+	}
+#endif
+
+#if AARCH == 64
+	// 64-bit words with end-around carry
+	u64 ulCarry = 0;
+	while (nLength >= 32)
+	{
+		const u64 *p = (const u64 *) pBuffer;
+		u64 w0 = p[0], w1 = p[1], w2 = p[2], w3 = p[3];
+
+		ulSum += w0; ulCarry += ulSum < w0;
+		ulSum += w1; ulCarry += ulSum < w1;
+		ulSum += w2; ulCarry += ulSum < w2;
+		ulSum += w3; ulCarry += ulSum < w3;
+
+		pBuffer += 32;
+		nLength -= 32;
+	}
+
+	ulSum = Fold64 (ulSum) + Fold64 (ulCarry);
+#else
+	// 32-bit words into a 64-bit accumulator, cannot overflow
+	while (nLength >= 16)
+	{
+		const u32 *p = (const u32 *) pBuffer;
+		ulSum += (u64) p[0] + p[1];
+		ulSum += (u64) p[2] + p[3];
+
+		pBuffer += 16;
+		nLength -= 16;
+	}
+#endif
+
+	while (nLength >= 4)
+	{
+		ulSum += *(const u32 *) pBuffer;
+		pBuffer += 4;
+		nLength -= 4;
+	}
+
+	if (nLength >= 2)
+	{
+		ulSum += *(const u16 *) pBuffer;
+		pBuffer += 2;
+		nLength -= 2;
+	}
+
+	if (nLength != 0)
+	{
+		ulSum += *pBuffer;
+	}
+
+	u32 nSum = Fold64 (ulSum);
+
+	return bOdd ? SwapBytes16 (nSum) : nSum;
+}
+
+// the addresses may have any alignment
+static u32 CopyAndSumBlock (u8 *pDest, const u8 *pSource, unsigned nLength)
+{
+	u64 ulSum = 0;
+
+	// the data is read in 16-bit units, so an odd address is handled like in SumBlock()
+	boolean bOdd = (uintptr) pSource & 1;
+	if (bOdd)
+	{
+		ulSum = (u32) *pSource << 8;
+		*pDest++ = *pSource++;
+		nLength--;
+	}
+
+#ifdef CHECKSUM_NEON
+	if (nLength >= NEON_MIN_LENGTH)
+	{
+		ulSum += SumNEON (&pSource, &nLength, &pDest);
+	}
+#endif
+
+	while (nLength >= 8)
+	{
+		u32 w[2];
+		memcpy (w, pSource, 8);
+		memcpy (pDest, w, 8);
+
+		ulSum += (u64) w[0] + w[1];
+
+		pSource += 8;
+		pDest += 8;
+		nLength -= 8;
+	}
+
+	while (nLength >= 2)
+	{
+		u16 w = *(const u16 *) pSource;
+		memcpy (pDest, &w, 2);
+
+		ulSum += w;
+
+		pSource += 2;
+		pDest += 2;
+		nLength -= 2;
+	}
+
+	if (nLength != 0)
+	{
+		ulSum += *pSource;
+		*pDest = *pSource;
+	}
+
+	u32 nSum = Fold64 (ulSum);
+
+	return bOdd ? SwapBytes16 (nSum) : nSum;
+}
@@ -4,7 +4,7 @@
 // A simple HTTP webserver
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,24 +21,28 @@
 //
 #include <circle/net/httpdaemon.h>
 #include <circle/net/in.h>
-#include <circle/netdevice.h>
 #include <circle/sysconfig.h>
 #include <circle/logger.h>
-#include <circle/string.h>
 #include <circle/util.h>
 #include <assert.h>
 
-#define HTTPD_VERSION		"0.02"
+#define HTTPD_VERSION		"0.03"
 #define SERVER			"CHTTPDaemon/" HTTPD_VERSION " (Circle)"
 
-#define MAX_CLIENTS		10
+#define KEEP_ALIVE_TIMEOUT	10		// seconds
+#define KEEP_ALIVE_MAX_REQUESTS	100		// per connection
+#define KEEP_ALIVE_POLL_MS	100		// check for waiting clients this often
+
+#define HEADER_ROOM		512		// in front of the content in m_pContentBuffer
+
+#define CHUNK_SIZE		8192		// maximum size of a chunk of streamed content
+#define CHUNK_PREFIX		10		// room for the chunk size line
+#define CHUNK_SUFFIX		7		// room for "\r\n" and the last chunk "0\r\n\r\n"
 
 #define HTTPD_STACK_SIZE	TASK_STACK_SIZE
 
 static const char FromHTTPDaemon[] = "httpd";
 
-unsigned CHTTPDaemon::s_nInstanceCount = 0;
-
 CHTTPDaemon::CHTTPDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket,
 			  unsigned nMaxContentSize, u16 nPort, unsigned nMaxMultipartSize)
 :	CTask (HTTPD_STACK_SIZE),
@@ -47,22 +51,38 @@ CHTTPDaemon::CHTTPDaemon (CNetSubSystem *pNetSubSystem, CSocket *pSocket,
 	m_nMaxContentSize (nMaxContentSize),
 	m_nPort (nPort),
 	m_nMaxMultipartSize (nMaxMultipartSize),
-	m_pContentBuffer (0)
+	m_pContentBuffer (0),
+	m_pListener (0),
+	m_nWorkers (0),
+	m_nIdleWorkers (0),
+	m_nPendingIn (0),
+	m_nPendingOut (0),
+	m_nPendingCount (0),
+	m_PendingSemaphore (0),
+	m_nRxOffset (0),
+	m_nRxLength (0),
+	m_bKeepAlive (FALSE),
+	m_bStreamActive (FALSE),
+	m_bStreamHeaderSent (FALSE),
+	m_bStreamFailed (FALSE),
+	m_ppStreamContentType (0),
+	m_pChunkBuffer (0),
+	m_nChunkLength (0),
+	m_nStreamLength (0),
+	m_pMultipartBuffer (0)
 {
-	s_nInstanceCount++;
-
-	if (m_nMaxContentSize > 0)
-	{
-		m_pContentBuffer = new u8[m_nMaxContentSize];
-		assert (m_pContentBuffer != 0);
-	}
-
 	if (pSocket == 0)
 	{
 		SetName (FromHTTPDaemon);
 	}
 	else
 	{
+		if (m_nMaxContentSize > 0)
+		{
+			m_pContentBuffer = new u8[HEADER_ROOM + m_nMaxContentSize];
+			assert (m_pContentBuffer != 0);
+		}
+
 		CString TaskName;
 		TaskName.Format ("httpd@%lp", this);
 
@@ -74,12 +94,14 @@ CHTTPDaemon::~CHTTPDaemon (void)
 {
 	assert (m_pSocket == 0);
 
-	delete m_pContentBuffer;
+	delete [] m_pChunkBuffer;
+	m_pChunkBuffer = 0;
+
+	delete [] m_pContentBuffer;
 	m_pContentBuffer = 0;
 
+	m_pListener = 0;
 	m_pNetSubSystem = 0;
-
-	s_nInstanceCount--;
 }
 
 void CHTTPDaemon::Run (void)
@@ -94,6 +116,12 @@ void CHTTPDaemon::Run (void)
 	}
 }
 
+THTTPStatus CHTTPDaemon::GetContentStream (const char *pPath, const char *pParams,
+					   const char *pFormData, const char **ppContentType)
+{
+	return HTTPContentNotStreamed;
+}
+
 void CHTTPDaemon::WriteAccessLog (const CIPAddress &rRemoteIP, THTTPRequestMethod RequestMethod,
 				  const char *pRequestURI, THTTPStatus Status,
 				  unsigned nContentLength)
@@ -132,7 +160,7 @@ void CHTTPDaemon::Listener (void)
 		return;
 	}
 
-	if (m_pSocket->Listen (MAX_CLIENTS) < 0)
+	if (m_pSocket->Listen (HTTPD_MAX_WORKERS) < 0)
 	{
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot listen on socket");
 
@@ -154,134 +182,500 @@ void CHTTPDaemon::Listener (void)
 			continue;
 		}
 
-		if (s_nInstanceCount >= MAX_CLIENTS+1)
-		{
-			CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Too many clients");
+		AddConnection (pConnection);
+	}
+}
 
-			delete pConnection;
+void CHTTPDaemon::AddConnection (CSocket *pConnection)
+{
+	assert (pConnection != 0);
 
-			continue;
-		}
+	// create a new worker, if all existing workers are busy
+	if (   m_nPendingCount >= m_nIdleWorkers
+	    && m_nWorkers < HTTPD_MAX_WORKERS)
+	{
+		CHTTPDaemon *pWorker = CreateWorker (m_pNetSubSystem, pConnection);
+		assert (pWorker != 0);
+
+		// the worker task does not run before we block
+		pWorker->m_pListener = this;
+
+		m_nWorkers++;
+
+		return;
+	}
+
+	if (m_nPendingCount >= HTTPD_MAX_PENDING)
+	{
+		CLogger::Get ()->Write (FromHTTPDaemon, LogWarning, "Too many clients");
+
+		delete pConnection;
+
+		return;
+	}
+
+	m_pPendingConnection[m_nPendingIn] = pConnection;
+	if (++m_nPendingIn == HTTPD_MAX_PENDING)
+	{
+		m_nPendingIn = 0;
+	}
+
+	m_nPendingCount++;
 
-		CreateWorker (m_pNetSubSystem, pConnection);
+	m_PendingSemaphore.Up ();
+}
+
+CSocket *CHTTPDaemon::GetConnection (void)
+{
+	m_nIdleWorkers++;
+	m_PendingSemaphore.Down ();
+	m_nIdleWorkers--;
+
+	assert (m_nPendingCount > 0);
+	m_nPendingCount--;
+
+	CSocket *pConnection = m_pPendingConnection[m_nPendingOut];
+	assert (pConnection != 0);
+
+	if (++m_nPendingOut == HTTPD_MAX_PENDING)
+	{
+		m_nPendingOut = 0;
 	}
+
+	return pConnection;
 }
 
 void CHTTPDaemon::Worker (void)
+{
+	while (1)
+	{
+		ProcessConnection ();
+
+		assert (m_pListener != 0);
+		m_pSocket = m_pListener->GetConnection ();
+	}
+}
+
+void CHTTPDaemon::ProcessConnection (void)
 {
 	assert (m_pSocket != 0);
 
-	// parse HTTP request
-	THTTPStatus Status = ParseRequest ();
-	if (Status == HTTPUnknownError)		// unknown error cannot be reported to client
+	m_nRxOffset = 0;
+	m_nRxLength = 0;
+
+	unsigned nRequest = 1;
+	while (   WaitForRequest ()
+	       && ProcessRequest (nRequest < KEEP_ALIVE_MAX_REQUESTS))
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		nRequest++;
+	}
 
-		return;
+	delete m_pSocket;		// closes connection
+	m_pSocket = 0;
+}
+
+// Waits for the first bytes of the next request in short periods, so that an idle
+// connection can be given up, when other clients are waiting for a worker. Otherwise
+// all workers could be blocked by idle keep-alive connections for KEEP_ALIVE_TIMEOUT.
+boolean CHTTPDaemon::WaitForRequest (void)
+{
+	assert (m_pSocket != 0);
+	assert (m_pListener != 0);
+
+	if (m_nRxOffset < m_nRxLength)		// pipelined request received already?
+	{
+		return TRUE;
 	}
 
-	// process HTTP request
-	unsigned nContentLength = m_nMaxContentSize;
-	const char *pContentType = "text/html";
+	m_pSocket->SetOptionReceiveTimeout (KEEP_ALIVE_POLL_MS * 1000);
+
+	// a new connection gets at least one period, even if other clients are waiting
+	int nResult;
+	unsigned nWaited = 0;
+	do
+	{
+		nResult = m_pSocket->Receive (m_RxBuffer, sizeof m_RxBuffer, 0);
 
-	const char *pStatusMsg = "OK";
+		nWaited += KEEP_ALIVE_POLL_MS;
+	}
+	while (   nResult == 0			// timed out
+	       && nWaited < KEEP_ALIVE_TIMEOUT * 1000
+	       && m_pListener->m_nPendingCount == 0);
 
-	if (Status == HTTPOK)
+	if (nResult <= 0)
 	{
-		// get content
-		assert (m_pContentBuffer != 0);
-		Status = GetContent (m_RequestPath, m_RequestParams, m_RequestFormData,
-				     m_pContentBuffer, &nContentLength, &pContentType);
-		assert (nContentLength <= m_nMaxContentSize);
-		assert (pContentType != 0);
+		return FALSE;
+	}
+
+	m_nRxOffset = 0;
+	m_nRxLength = nResult;
+
+	// the remaining request must arrive within the normal timeout
+	m_pSocket->SetOptionReceiveTimeout (KEEP_ALIVE_TIMEOUT * 1000000);
+
+	return TRUE;
+}
+
+boolean CHTTPDaemon::ProcessRequest (boolean bKeepAlive)
+{
+	assert (m_pSocket != 0);
 
+	// parse HTTP request
+	THTTPStatus Status = ParseRequest ();
+	if (Status == HTTPUnknownError)		// unknown error cannot be reported to client
+	{
 		delete [] m_pMultipartBuffer;
 		m_pMultipartBuffer = 0;
+
+		return FALSE;
 	}
 
-	if (Status != HTTPOK)
+	const u8 *pClientIP = m_pSocket->GetForeignIP ();
+	if (pClientIP == 0)			// connection closed in the meantime?
+	{
+		delete [] m_pMultipartBuffer;
+		m_pMultipartBuffer = 0;
+
+		return FALSE;
+	}
+	CIPAddress ClientIP (pClientIP);
+
+	// after an error the request may not have been read completely
+	m_bKeepAlive = bKeepAlive && !m_bConnectionClose && Status == HTTPOK;
+
+	// process HTTP request
+	boolean bOK = TRUE;
+	unsigned nContentLength = 0;
+
+	m_bStreamHeaderSent = FALSE;
+	if (Status == HTTPOK)
 	{
-		switch (Status)
+		const char *pContentType = "text/html";
+
+		m_bStreamActive = TRUE;
+		m_bStreamFailed = FALSE;
+		m_ppStreamContentType = &pContentType;
+		m_nChunkLength = 0;
+		m_nStreamLength = 0;
+
+		Status = GetContentStream (m_RequestPath, m_RequestParams, m_RequestFormData,
+					   &pContentType);
+
+		m_bStreamActive = FALSE;
+
+		if (m_bStreamHeaderSent)
 		{
-		case HTTPBadRequest:		pStatusMsg = "Bad Request";			break;
-		case HTTPNotFound:		pStatusMsg = "Not Found";			break;
-		case HTTPRequestEntityTooLarge:	pStatusMsg = "Request Entity Too Large";	break;
-		case HTTPRequestURITooLong:	pStatusMsg = "Request-URI Too Long";		break;
-		case HTTPInternalServerError:	pStatusMsg = "Internal Server Error";		break;
-		case HTTPMethodNotImplemented:	pStatusMsg = "Method Not Implemented";		break;
-		case HTTPVersionNotSupported:	pStatusMsg = "Version Not Supported";		break;
-		default:			pStatusMsg = "Unknown Error";			break;
+			// the status line has been sent already, an error aborts the connection
+			bOK = Status == HTTPOK && FlushChunk (TRUE);
+			nContentLength = m_nStreamLength;
+		}
+		else if (Status == HTTPOK)		// streamed content is empty
+		{
+			bOK = SendStreamHeader () && FlushChunk (TRUE);
+		}
+		else if (Status == HTTPContentNotStreamed)
+		{
+			// get content
+			if (m_pContentBuffer != 0)
+			{
+				nContentLength = m_nMaxContentSize;
+				pContentType = "text/html";
+
+				u8 *pContent = m_pContentBuffer + HEADER_ROOM;
+				Status = GetContent (m_RequestPath, m_RequestParams, m_RequestFormData,
+						     pContent, &nContentLength, &pContentType);
+				assert (nContentLength <= m_nMaxContentSize);
+				assert (pContentType != 0);
+
+				if (Status == HTTPOK)
+				{
+					bOK = SendResponse (Status, pContentType, pContent, nContentLength);
+				}
+			}
+			else
+			{
+				Status = HTTPInternalServerError;
+			}
 		}
+	}
 
+	delete [] m_pMultipartBuffer;
+	m_pMultipartBuffer = 0;
+
+	if (   Status != HTTPOK
+	    && !m_bStreamHeaderSent)
+	{
 		CString ErrorPage;
 		ErrorPage.Format ("<!DOCTYPE html>\n"
 				  "<html>\n"
 				  "<head><title>%u %s</title></head>\n"
 				  "<body><h1>%s</h1></body>\n"
-				  "</html>\n", Status, pStatusMsg, pStatusMsg);
+				  "</html>\n", Status, GetStatusMessage (Status), GetStatusMessage (Status));
 
 		nContentLength = ErrorPage.GetLength ();
-		if (nContentLength > m_nMaxContentSize)
+
+		bOK = SendResponse (Status, "text/html", (const u8 *) (const char *) ErrorPage,
+				    nContentLength);
+	}
+
+	// write access log
+	WriteAccessLog (ClientIP, m_RequestMethod, m_RequestURI, Status, nContentLength);
+
+	return bOK && m_bKeepAlive;
+}
+
+boolean CHTTPDaemon::SendResponse (THTTPStatus Status, const char *pContentType,
+				   const u8 *pContent, unsigned nContentLength)
+{
+	CString Header;
+	FormatHeader (&Header, Status, pContentType, nContentLength, FALSE);
+	unsigned nHeaderLength = Header.GetLength ();
+
+	if (m_RequestMethod == HTTPRequestMethodHead)
+	{
+		nContentLength = 0;
+	}
+
+	// send header and content in one go, if the header fits in front of the content
+	assert (m_pSocket != 0);
+	if (   m_pContentBuffer != 0
+	    && pContent == m_pContentBuffer + HEADER_ROOM
+	    && nHeaderLength <= HEADER_ROOM)
+	{
+		u8 *pResponse = m_pContentBuffer + HEADER_ROOM - nHeaderLength;
+		memcpy (pResponse, (const char *) Header, nHeaderLength);
+
+		if (m_pSocket->Send (pResponse, nHeaderLength + nContentLength, MSG_DONTWAIT) < 0)
 		{
-			nContentLength = m_nMaxContentSize;
+			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+
+			return FALSE;
 		}
 
-		assert (m_pContentBuffer != 0);
-		memcpy (m_pContentBuffer, (const char *) ErrorPage, nContentLength);
-		pContentType = "text/html";	// may has been changed by GetContent()
+		return TRUE;
 	}
 
-	// write access log
-	const u8 *pClientIP = m_pSocket->GetForeignIP ();
-	if (pClientIP == 0)			// connection closed in the meantime?
+	if (m_pSocket->Send ((const char *) Header, nHeaderLength, MSG_DONTWAIT) < 0)
 	{
-		delete m_pSocket;
-		m_pSocket = 0;
+		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response header");
 
-		return;
+		return FALSE;
 	}
-	CIPAddress ClientIP (pClientIP);
 
-	WriteAccessLog (ClientIP, m_RequestMethod, m_RequestURI, Status, nContentLength);
+	if (nContentLength > 0)
+	{
+		assert (pContent != 0);
+		if (m_pSocket->Send (pContent, nContentLength, MSG_DONTWAIT) < 0)
+		{
+			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CHTTPDaemon::SendStreamHeader (void)
+{
+	assert (!m_bStreamHeaderSent);
+	m_bStreamHeaderSent = TRUE;
+
+	assert (m_ppStreamContentType != 0);
+	assert (*m_ppStreamContentType != 0);
 
-	// send HTTP response header
 	CString Header;
-	Header.Format ("HTTP/1.1 %u %s\r\n"
-		       "Server: " SERVER "\r\n"
-		       "Content-Type: %s\r\n"
-		       "Content-Length: %u\r\n"
-		       "Connection: close\r\n"
-		       "\r\n", Status, pStatusMsg, pContentType, nContentLength);
+	FormatHeader (&Header, HTTPOK, *m_ppStreamContentType, 0, TRUE);
 
+	assert (m_pSocket != 0);
 	if (m_pSocket->Send ((const char *) Header, Header.GetLength (), MSG_DONTWAIT) < 0)
 	{
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response header");
 
-		delete m_pSocket;
-		m_pSocket = 0;
+		m_bStreamFailed = TRUE;
 
-		return;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CHTTPDaemon::SendContent (const void *pData, unsigned nLength)
+{
+	assert (m_bStreamActive);
+
+	if (m_bStreamFailed)
+	{
+		return FALSE;
+	}
+
+	if (   !m_bStreamHeaderSent
+	    && !SendStreamHeader ())
+	{
+		return FALSE;
 	}
 
-	// send response
-	if (   m_RequestMethod != HTTPRequestMethodHead
-	    && nContentLength > 0)
+	m_nStreamLength += nLength;
+
+	if (m_RequestMethod == HTTPRequestMethodHead)
 	{
-		assert (m_pContentBuffer != 0);
-		if (m_pSocket->Send (m_pContentBuffer, nContentLength, MSG_DONTWAIT) < 0)
+		return TRUE;
+	}
+
+	if (m_pChunkBuffer == 0)
+	{
+		m_pChunkBuffer = new u8[CHUNK_PREFIX + CHUNK_SIZE + CHUNK_SUFFIX];
+		if (m_pChunkBuffer == 0)
 		{
-			CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Cannot send response");
+			m_bStreamFailed = TRUE;
 
-			delete m_pSocket;
-			m_pSocket = 0;
+			return FALSE;
+		}
+	}
 
-			return;
+	const u8 *pBuffer = (const u8 *) pData;
+	while (nLength > 0)
+	{
+		unsigned nCopy = CHUNK_SIZE - m_nChunkLength;
+		if (nCopy > nLength)
+		{
+			nCopy = nLength;
+		}
+
+		assert (pBuffer != 0);
+		memcpy (m_pChunkBuffer + CHUNK_PREFIX + m_nChunkLength, pBuffer, nCopy);
+
+		m_nChunkLength += nCopy;
+		pBuffer += nCopy;
+		nLength -= nCopy;
+
+		if (   m_nChunkLength == CHUNK_SIZE
+		    && !FlushChunk (FALSE))
+		{
+			return FALSE;
 		}
 	}
 
-	delete m_pSocket;		// closes connection
-	m_pSocket = 0;
+	return TRUE;
+}
+
+boolean CHTTPDaemon::FlushChunk (boolean bLast)
+{
+	if (m_bStreamFailed)
+	{
+		return FALSE;
+	}
+
+	if (m_RequestMethod == HTTPRequestMethodHead)
+	{
+		return TRUE;
+	}
+
+	static const char LastChunk[] = "0\r\n\r\n";
+	assert (sizeof LastChunk-1 + 2 <= CHUNK_SUFFIX);
+
+	assert (m_pSocket != 0);
+	if (m_pChunkBuffer == 0)
+	{
+		assert (m_nChunkLength == 0);
+
+		if (   bLast
+		    && m_pSocket->Send (LastChunk, sizeof LastChunk-1, 0) < 0)
+		{
+			m_bStreamFailed = TRUE;
+
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	// the chunk size line is written in front of the data, the trailer behind it
+	u8 *pStart = m_pChunkBuffer + CHUNK_PREFIX;
+	u8 *pEnd = pStart + m_nChunkLength;
+
+	if (m_nChunkLength > 0)
+	{
+		CString Size;
+		Size.Format ("%X\r\n", m_nChunkLength);
+
+		assert (Size.GetLength () <= CHUNK_PREFIX);
+		pStart -= Size.GetLength ();
+		memcpy (pStart, (const char *) Size, Size.GetLength ());
+
+		memcpy (pEnd, "\r\n", 2);
+		pEnd += 2;
+
+		m_nChunkLength = 0;
+	}
+
+	if (bLast)
+	{
+		memcpy (pEnd, LastChunk, sizeof LastChunk-1);
+		pEnd += sizeof LastChunk-1;
+	}
+
+	// blocking send, so that the content is not queued completely
+	if (   pEnd > pStart
+	    && m_pSocket->Send (pStart, pEnd - pStart, 0) < 0)
+	{
+		m_bStreamFailed = TRUE;
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CHTTPDaemon::FormatHeader (CString *pHeader, THTTPStatus Status, const char *pContentType,
+				unsigned nContentLength, boolean bChunked)
+{
+	CString Length;
+	if (bChunked)
+	{
+		Length = "Transfer-Encoding: chunked\r\n";
+	}
+	else
+	{
+		Length.Format ("Content-Length: %u\r\n", nContentLength);
+	}
+
+	CString Connection;
+	if (m_bKeepAlive)
+	{
+		Connection.Format ("Keep-Alive: timeout=%u\r\n", KEEP_ALIVE_TIMEOUT);
+	}
+	else
+	{
+		Connection = "Connection: close\r\n";
+	}
+
+	assert (pHeader != 0);
+	assert (pContentType != 0);
+	pHeader->Format ("HTTP/1.1 %u %s\r\n"
+			 "Server: " SERVER "\r\n"
+			 "Content-Type: %s\r\n"
+			 "%s"
+			 "%s"
+			 "\r\n", Status, GetStatusMessage (Status), pContentType,
+			 (const char *) Length, (const char *) Connection);
+}
+
+const char *CHTTPDaemon::GetStatusMessage (THTTPStatus Status)
+{
+	switch (Status)
+	{
+	case HTTPOK:			return "OK";
+	case HTTPBadRequest:		return "Bad Request";
+	case HTTPNotFound:		return "Not Found";
+	case HTTPRequestTimeout:	return "Request Timeout";
+	case HTTPRequestEntityTooLarge:	return "Request Entity Too Large";
+	case HTTPRequestURITooLong:	return "Request-URI Too Long";
+	case HTTPInternalServerError:	return "Internal Server Error";
+	case HTTPMethodNotImplemented:	return "Method Not Implemented";
+	case HTTPVersionNotSupported:	return "Version Not Supported";
+	default:			return "Unknown Error";
+	}
 }
 
 THTTPStatus CHTTPDaemon::ParseRequest (void)
@@ -292,6 +686,7 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 	m_RequestURI[0] = '\0';
 	m_RequestPath[0] = '\0';
 	m_RequestParams[0] = '\0';
+	m_bConnectionClose = FALSE;
 	m_bRequestFormDataAvailable = FALSE;
 	m_nRequestContentLength = 0;
 	m_RequestFormData[0] = '\0';
@@ -300,9 +695,8 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 	m_nMultipartContentLength = 0;
 	m_pMultipartBuffer = 0;
 
-	char Buffer[FRAME_BUFFER_SIZE];
 	char Line[HTTP_MAX_REQUEST_LINE+1];
-#if HTTP_MAX_REQUEST_LINE+FRAME_BUFFER_SIZE+2000 > HTTPD_STACK_SIZE
+#if HTTP_MAX_REQUEST_LINE+2000 > HTTPD_STACK_SIZE
 	#error Increase HTTPD_STACK_SIZE!
 #endif
 
@@ -310,15 +704,28 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 	unsigned nLine = 0;
 	unsigned nChar = 0;
 
-	int nResult;
+	int nResult = 1;
 
 	assert (m_pSocket != 0);
-	while (   nState < 3
-	       && (nResult = m_pSocket->Receive (Buffer, sizeof Buffer, 0)) > 0)
+	while (nState < 3)
 	{
-		for (unsigned i = 0; i < (unsigned) nResult; i++)
+		// bytes of a pipelined request may be left from the previous call
+		if (m_nRxOffset == m_nRxLength)
+		{
+			nResult = m_pSocket->Receive (m_RxBuffer, sizeof m_RxBuffer, 0);
+			if (nResult <= 0)
+			{
+				break;
+			}
+
+			m_nRxOffset = 0;
+			m_nRxLength = nResult;
+		}
+
+		while (   nState < 3
+		       && m_nRxOffset < m_nRxLength)
 		{
-			char chChar = Buffer[i];
+			char chChar = (char) m_RxBuffer[m_nRxOffset++];
 
 			if (nState == 0)
 			{
@@ -331,6 +738,11 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 				{
 					if (nChar == 0)		// empty line is end of header
 					{
+						if (nLine == 0)	// ignore empty lines before request
+						{
+							continue;
+						}
+
 						if (   m_bRequestFormDataAvailable
 						    && m_nRequestContentLength > 0)
 						{
@@ -435,8 +847,20 @@ THTTPStatus CHTTPDaemon::ParseRequest (void)
 		}
 	}
 
-	if (nResult < 0)
+	if (nResult <= 0)
 	{
+		// connection closed or timed out before a new request arrived
+		if (   nLine == 0
+		    && nChar == 0)
+		{
+			return HTTPUnknownError;
+		}
+
+		if (nResult == 0)
+		{
+			return HTTPRequestTimeout;
+		}
+
 		CLogger::Get ()->Write (FromHTTPDaemon, LogError, "Receive failed");
 
 		return HTTPUnknownError;
@@ -594,6 +1018,16 @@ THTTPStatus CHTTPDaemon::ParseHeaderField (char *pLine)
 
 		m_nRequestContentLength = nAccu;
 	}
+	else if (strcasecmp (pToken, "Connection") == 0)
+	{
+		while ((pToken = strtok_r (0, " ,", &pSavePtr)) != 0)
+		{
+			if (strcasecmp (pToken, "close") == 0)
+			{
+				m_bConnectionClose = TRUE;
+			}
+		}
+	}
 
 	return HTTPOK;
 }
@@ -2,7 +2,7 @@
 // icmphandler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -111,11 +111,14 @@ void CICMPHandler::Process (void)
 		{
 			if (pICMPHeader->nCode == ICMP_CODE_ECHO)
 			{
-				// packet will be used in place to send it back
+				// packet will be used in place to send it back, the checksum
+				// is updated for the changed type only (RFC 1624)
+				u16 nOldTypeCode = *(u16 *) pICMPHeader;
 				pICMPHeader->nType     = ICMP_TYPE_ECHO_REPLY;
 				pICMPHeader->nCode     = ICMP_CODE_ECHO;
-				pICMPHeader->nChecksum = 0;
-				pICMPHeader->nChecksum = CChecksumCalculator::SimpleCalculate (Buffer, nLength);
+				pICMPHeader->nChecksum = CChecksumCalculator::Update (pICMPHeader->nChecksum,
+										      nOldTypeCode,
+										      *(u16 *) pICMPHeader);
 
 				assert (m_pNetworkLayer != 0);
 				m_pNetworkLayer->Send (SourceIP, Buffer, nLength, IPPROTO_ICMP);
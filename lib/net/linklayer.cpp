@@ -2,7 +2,7 @@
 // linklayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -74,35 +74,41 @@ void CLinkLayer::Process (void)
 	}
 
 	assert (m_pNetDevLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nLength;
-	while (m_pNetDevLayer->Receive (Buffer, &nLength))
+	CNetBuffer *pNetBuffer;
+	while (m_pNetDevLayer->Receive (&pNetBuffer))
 	{
+		assert (pNetBuffer != 0);
+		unsigned nLength = pNetBuffer->GetLength ();
 		assert (nLength <= FRAME_BUFFER_SIZE);
 		if (nLength <= sizeof (TEthernetHeader))
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
-		TEthernetHeader *pHeader = (TEthernetHeader *) Buffer;
+		TEthernetHeader *pHeader = (TEthernetHeader *) pNetBuffer->GetData ();
 
 		CMACAddress MACAddressReceiver (pHeader->MACReceiver);
 		if (    MACAddressReceiver != *pOwnMACAddress
 		    && !MACAddressReceiver.IsBroadcast ())
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
 
-		nLength -= sizeof (TEthernetHeader);
-		assert (nLength > 0);
+		// the header remains accessible via pHeader
+		pNetBuffer->Pull (sizeof (TEthernetHeader));
+		assert (pNetBuffer->GetLength () > 0);
 		
 		switch (pHeader->nProtocolType)
 		{
 		case BE (ETH_PROT_IP):
-			m_IPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_IPRxQueue.Enqueue (pNetBuffer);
 			break;
 
 		case BE (ETH_PROT_ARP):
-			m_ARPRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader), nLength);
+			m_ARPRxQueue.Enqueue (pNetBuffer);
 			break;
 
 		default:
@@ -112,8 +118,11 @@ void CLinkLayer::Process (void)
 				assert (pParam != 0);
 				memcpy (pParam->MACSender, pHeader->MACSender, MAC_ADDRESS_SIZE);
 
-				m_RawRxQueue.Enqueue (Buffer+sizeof (TEthernetHeader),
-						      nLength, pParam);
+				m_RawRxQueue.Enqueue (pNetBuffer, pParam);
+			}
+			else
+			{
+				pNetBuffer->Release ();
 			}
 			break;
 		}
@@ -132,8 +141,29 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 		return FALSE;
 	}
 
-	u8 FrameBuffer[nFrameLength];
-	TEthernetHeader *pHeader = (TEthernetHeader *) FrameBuffer;
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nLength);
+
+	assert (pIPPacket != 0);
+	memcpy (pNetBuffer->GetData (), pIPPacket, nLength);
+
+	return Send (rReceiver, pNetBuffer);
+}
+
+boolean CLinkLayer::Send (const CIPAddress &rReceiver, CNetBuffer *pNetBuffer)
+{
+	assert (pNetBuffer != 0);
+	unsigned nFrameLength = sizeof (TEthernetHeader) + pNetBuffer->GetLength ();
+	if (   nFrameLength <= sizeof (TEthernetHeader)
+	    || nFrameLength > FRAME_BUFFER_SIZE)
+	{
+		pNetBuffer->Release ();
+
+		return FALSE;
+	}
+
+	TEthernetHeader *pHeader = (TEthernetHeader *) pNetBuffer->Push (sizeof (TEthernetHeader));
 
 	assert (m_pNetDevLayer != 0);
 	const CMACAddress *pOwnMACAddress = m_pNetDevLayer->GetMACAddress ();
@@ -142,10 +172,6 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 
 	pHeader->nProtocolType = BE (ETH_PROT_IP);
 
-	assert (pIPPacket != 0);
-	assert (nLength > 0);
-	memcpy (FrameBuffer+sizeof (TEthernetHeader), pIPPacket, nLength);
-
 	assert (m_pNetConfig != 0);
 	assert (m_pARPHandler != 0);
 	CMACAddress MACAddressReceiver;
@@ -155,14 +181,16 @@ boolean CLinkLayer::Send (const CIPAddress &rReceiver, const void *pIPPacket, un
 		MACAddressReceiver.SetBroadcast ();
 	}
 	else if (!m_pARPHandler->Resolve (rReceiver, &MACAddressReceiver,
-					  FrameBuffer, nFrameLength))
+					  pNetBuffer->GetData (), nFrameLength))
 	{
+		pNetBuffer->Release ();
+
 		return TRUE;		// packet will be retransmitted by ARP handler
 	}
 
 	MACAddressReceiver.CopyTo (pHeader->MACReceiver);
 
-	m_pNetDevLayer->Send (FrameBuffer, nFrameLength);
+	m_pNetDevLayer->Send (pNetBuffer);
 
 	return TRUE;
 }
@@ -176,6 +204,11 @@ boolean CLinkLayer::Receive (void *pBuffer, unsigned *pResultLength)
 	return *pResultLength != 0 ? TRUE : FALSE;
 }
 
+boolean CLinkLayer::Receive (CNetBuffer **ppNetBuffer)
+{
+	return m_IPRxQueue.Dequeue (ppNetBuffer) != 0 ? TRUE : FALSE;
+}
+
 boolean CLinkLayer::SendRaw (const void *pFrame, unsigned nLength)
 {
 	assert (pFrame != 0);
@@ -0,0 +1,141 @@
+//
+// netbuffer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/netbuffer.h>
+#include <circle/atomic.h>
+#include <assert.h>
+
+CNetBuffer *CNetBuffer::s_pPool = 0;
+unsigned CNetBuffer::s_nPoolCount = 0;
+CSpinLock CNetBuffer::s_PoolSpinLock (TASK_LEVEL);
+
+CNetBuffer::CNetBuffer (void)
+:	m_pData (m_Buffer + NET_BUFFER_HEADROOM),
+	m_nLength (0),
+	m_nRefCount (1),
+	m_bChecksumVerified (FALSE),
+	m_pNext (0),
+	m_pParam (0)
+{
+}
+
+CNetBuffer::~CNetBuffer (void)
+{
+	assert (m_nRefCount == 0);
+	m_pData = 0;
+}
+
+void CNetBuffer::AddRef (void)
+{
+	assert (m_nRefCount > 0);
+	AtomicIncrement (&m_nRefCount);
+}
+
+void CNetBuffer::Release (void)
+{
+	assert (m_nRefCount > 0);
+	if (AtomicDecrement (&m_nRefCount) == 0)
+	{
+		delete this;
+	}
+}
+
+void CNetBuffer::SetLength (unsigned nLength)
+{
+	assert (m_pData + nLength <= m_Buffer + NET_BUFFER_SIZE);
+	m_nLength = nLength;
+}
+
+u8 *CNetBuffer::Push (unsigned nBytes)
+{
+	assert (m_pData - nBytes >= m_Buffer);
+	m_pData -= nBytes;
+	m_nLength += nBytes;
+
+	return m_pData;
+}
+
+u8 *CNetBuffer::Pull (unsigned nBytes)
+{
+	assert (nBytes <= m_nLength);
+	m_pData += nBytes;
+	m_nLength -= nBytes;
+
+	return m_pData;
+}
+
+void CNetBuffer::Trim (unsigned nLength)
+{
+	if (nLength < m_nLength)
+	{
+		m_nLength = nLength;
+	}
+}
+
+void *CNetBuffer::operator new (size_t nSize)
+{
+	assert (nSize == sizeof (CNetBuffer));
+
+	s_PoolSpinLock.Acquire ();
+
+	CNetBuffer *pBuffer = s_pPool;
+	if (pBuffer != 0)
+	{
+		s_pPool = pBuffer->m_pNext;
+
+		assert (s_nPoolCount > 0);
+		s_nPoolCount--;
+	}
+
+	s_PoolSpinLock.Release ();
+
+	if (pBuffer == 0)
+	{
+		pBuffer = (CNetBuffer *) ::operator new (nSize);
+		assert (pBuffer != 0);
+	}
+
+	return pBuffer;
+}
+
+void CNetBuffer::operator delete (void *pBlock, size_t nSize)
+{
+	assert (pBlock != 0);
+	assert (nSize == sizeof (CNetBuffer));
+
+	s_PoolSpinLock.Acquire ();
+
+	if (s_nPoolCount < NET_BUFFER_POOL_MAX)
+	{
+		CNetBuffer *pBuffer = (CNetBuffer *) pBlock;
+		pBuffer->m_pNext = s_pPool;
+		s_pPool = pBuffer;
+
+		s_nPoolCount++;
+
+		pBlock = 0;
+	}
+
+	s_PoolSpinLock.Release ();
+
+	if (pBlock != 0)
+	{
+		::operator delete (pBlock);
+	}
+}
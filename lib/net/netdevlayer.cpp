@@ -2,7 +2,7 @@
 // netdevlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,6 +18,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/netdevlayer.h>
+#include <circle/net/netsubsystem.h>
 #include <circle/net/phytask.h>
 #include <circle/logger.h>
 #include <circle/timer.h>
@@ -30,12 +31,28 @@ const char FromNetDev[] = "netdev";
 CNetDeviceLayer::CNetDeviceLayer (CNetConfig *pNetConfig, TNetDeviceType DeviceType)
 :	m_DeviceType (DeviceType),
 	m_pNetConfig (pNetConfig),
-	m_pDevice (0)
+	m_pDevice (0),
+	m_pRxBuffer (0),
+	m_bEventDriven (FALSE),
+	m_bRxPending (FALSE),
+	m_bNetBuffers (FALSE)
 {
 }
 
 CNetDeviceLayer::~CNetDeviceLayer (void)
 {
+	if (m_bEventDriven)
+	{
+		assert (m_pDevice != 0);
+		m_pDevice->RegisterEventHandler (0, 0);
+	}
+
+	if (m_pRxBuffer != 0)
+	{
+		m_pRxBuffer->Release ();
+		m_pRxBuffer = 0;
+	}
+
 	m_pDevice = 0;
 	m_pNetConfig = 0;
 }
@@ -63,7 +80,7 @@ boolean CNetDeviceLayer::Initialize (boolean bWaitForActivate)
 		return FALSE;
 	}
 
-	new CPHYTask (m_pDevice);
+	AttachDevice ();
 
 	// wait for Ethernet PHY to come up
 	unsigned nStartTicks = CTimer::Get ()->GetTicks ();
@@ -98,15 +115,20 @@ void CNetDeviceLayer::Process (void)
 			return;
 		}
 
-		new CPHYTask (m_pDevice);
+		AttachDevice ();
 	}
 
-	DMA_BUFFER (u8, Buffer, FRAME_BUFFER_SIZE);
+	// the frames are passed by reference, the data of a net buffer is cache-line aligned
+	CNetBuffer *pNetBuffer;
 	unsigned nLength;
 	while (   m_pDevice->IsSendFrameAdvisable ()
-	       && (nLength = m_TxQueue.Dequeue (Buffer)) > 0)
+	       && (nLength = m_TxQueue.Dequeue (&pNetBuffer)) > 0)
 	{
-		if (!m_pDevice->SendFrame (Buffer, nLength))
+		boolean bOK = m_pDevice->SendFrame (pNetBuffer->GetData (), nLength);
+
+		pNetBuffer->Release ();
+
+		if (!bOK)
 		{
 			CLogger::Get ()->Write (FromNetDev, LogWarning, "Frame dropped");
 
@@ -114,10 +136,46 @@ void CNetDeviceLayer::Process (void)
 		}
 	}
 
-	while (m_pDevice->ReceiveFrame (Buffer, &nLength))
+	m_bRxPending = FALSE;
+
+	for (unsigned nFrames = 0; 1; nFrames++)
 	{
+		if (nFrames >= NET_DEVICE_RX_BUDGET)
+		{
+			m_bRxPending = TRUE;	// continue with next call
+
+			break;
+		}
+
+		if (m_bNetBuffers)
+		{
+			// the device hands over its Rx DMA buffer, the frame is not copied
+			if (!m_pDevice->ReceiveFrameBuffer (&pNetBuffer))
+			{
+				break;
+			}
+
+			m_RxQueue.Enqueue (pNetBuffer);
+
+			continue;
+		}
+
+		if (m_pRxBuffer == 0)
+		{
+			m_pRxBuffer = new CNetBuffer;
+			assert (m_pRxBuffer != 0);
+		}
+
+		if (!m_pDevice->ReceiveFrame (m_pRxBuffer->GetData (), &nLength))
+		{
+			break;
+		}
+
 		assert (nLength > 0);
-		m_RxQueue.Enqueue (Buffer, nLength);
+		m_pRxBuffer->SetLength (nLength);
+		m_RxQueue.Enqueue (m_pRxBuffer);
+
+		m_pRxBuffer = 0;
 	}
 }
 
@@ -134,6 +192,8 @@ const CMACAddress *CNetDeviceLayer::GetMACAddress (void) const
 void CNetDeviceLayer::Send (const void *pBuffer, unsigned nLength)
 {
 	m_TxQueue.Enqueue (pBuffer, nLength);
+
+	CNetSubSystem::Get ()->WakeUp ();
 }
 
 boolean CNetDeviceLayer::Receive (void *pBuffer, unsigned *pResultLength)
@@ -150,7 +210,48 @@ boolean CNetDeviceLayer::Receive (void *pBuffer, unsigned *pResultLength)
 	return TRUE;
 }
 
+void CNetDeviceLayer::Send (CNetBuffer *pNetBuffer)
+{
+	m_TxQueue.Enqueue (pNetBuffer);
+
+	CNetSubSystem::Get ()->WakeUp ();
+}
+
+boolean CNetDeviceLayer::Receive (CNetBuffer **ppNetBuffer)
+{
+	return m_RxQueue.Dequeue (ppNetBuffer) > 0 ? TRUE : FALSE;
+}
+
 boolean CNetDeviceLayer::IsRunning (void) const
 {
 	return m_pDevice != 0;
 }
+
+boolean CNetDeviceLayer::IsEventDriven (void) const
+{
+	return m_bEventDriven;
+}
+
+boolean CNetDeviceLayer::IsRxPending (void) const
+{
+	return m_bRxPending;
+}
+
+void CNetDeviceLayer::AttachDevice (void)
+{
+	assert (m_pDevice != 0);
+	new CPHYTask (m_pDevice);
+
+	m_bNetBuffers = m_pDevice->GetFeatures () & NET_DEVICE_FEATURE_NET_BUFFER ? TRUE : FALSE;
+
+	m_bEventDriven = m_pDevice->RegisterEventHandler (EventHandler, this);
+	if (m_bEventDriven)
+	{
+		CLogger::Get ()->Write (FromNetDev, LogDebug, "Using device events");
+	}
+}
+
+void CNetDeviceLayer::EventHandler (void *pParam)
+{
+	CNetSubSystem::Get ()->WakeUp ();
+}
@@ -2,7 +2,7 @@
 // netqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,17 +22,9 @@
 #include <circle/util.h>
 #include <assert.h>
 
-struct TNetQueueEntry
-{
-	volatile TNetQueueEntry *pPrev;
-	volatile TNetQueueEntry *pNext;
-	unsigned		 nLength;
-	unsigned char		 Buffer[FRAME_BUFFER_SIZE];
-	void			*pParam;
-};
-
 CNetQueue::CNetQueue (void)
-:	m_pFirst (0),
+:	m_Ring (NET_QUEUE_RING_SIZE),
+	m_pFirst (0),
 	m_pLast (0),
 	m_SpinLock (TASK_LEVEL)
 {
@@ -45,106 +37,126 @@ CNetQueue::~CNetQueue (void)
 
 boolean CNetQueue::IsEmpty (void) const
 {
-	return m_pFirst == 0 ? TRUE : FALSE;
+	return m_Ring.IsEmpty () && m_pFirst == 0 ? TRUE : FALSE;
 }
 
 void CNetQueue::Flush (void)
 {
-	while (m_pFirst != 0)
+	CNetBuffer *pNetBuffer;
+	while (Dequeue (&pNetBuffer) > 0)
 	{
-		m_SpinLock.Acquire ();
-
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
-
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
-		{
-			m_pFirst->pPrev = 0;
-		}
-		else
-		{
-			assert (m_pLast == pEntry);
-			m_pLast = 0;
-		}
-
-		m_SpinLock.Release ();
-
-		delete pEntry;
+		pNetBuffer->Release ();
 	}
 }
 	
 void CNetQueue::Enqueue (const void *pBuffer, unsigned nLength, void *pParam)
 {
-	TNetQueueEntry *pEntry = new TNetQueueEntry;
-	assert (pEntry != 0);
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
 
 	assert (nLength > 0);
 	assert (nLength <= FRAME_BUFFER_SIZE);
-	pEntry->nLength = nLength;
+	pNetBuffer->SetLength (nLength);
 
 	assert (pBuffer != 0);
-	memcpy (pEntry->Buffer, pBuffer, nLength);
+	memcpy (pNetBuffer->GetData (), pBuffer, nLength);
 
-	pEntry->pParam = pParam;
+	Enqueue (pNetBuffer, pParam);
+}
 
-	m_SpinLock.Acquire ();
+unsigned CNetQueue::Dequeue (void *pBuffer, void **ppParam)
+{
+	CNetBuffer *pNetBuffer;
+	unsigned nResult = Dequeue (&pNetBuffer, ppParam);
+	if (nResult > 0)
+	{
+		assert (pBuffer != 0);
+		memcpy (pBuffer, pNetBuffer->GetData (), nResult);
+
+		pNetBuffer->Release ();
+	}
+
+	return nResult;
+}
+
+void CNetQueue::Enqueue (CNetBuffer *pNetBuffer, void *pParam)
+{
+	assert (pNetBuffer != 0);
+	assert (pNetBuffer->GetLength () > 0);
+	assert (pNetBuffer->GetLength () <= FRAME_BUFFER_SIZE);
 
-	pEntry->pPrev = m_pLast;
-	pEntry->pNext = 0;
+	pNetBuffer->m_pNext = 0;
+	pNetBuffer->m_pParam = pParam;
+
+	// The ring buffer is only used, while the overflow list is empty. This keeps
+	// the order of the net buffers, which are enqueued by the same producer.
+	if (   m_pFirst == 0
+	    && m_Ring.Enqueue (pNetBuffer))
+	{
+		return;
+	}
+
+	m_SpinLock.Acquire ();
 
 	if (m_pFirst == 0)
 	{
-		m_pFirst = pEntry;
+		m_pFirst = pNetBuffer;
 	}
 	else
 	{
 		assert (m_pLast != 0);
-		assert (m_pLast->pNext == 0);
-		m_pLast->pNext = pEntry;
+		assert (m_pLast->m_pNext == 0);
+		m_pLast->m_pNext = pNetBuffer;
 	}
-	m_pLast = pEntry;
+	m_pLast = pNetBuffer;
 
 	m_SpinLock.Release ();
 }
 
-unsigned CNetQueue::Dequeue (void *pBuffer, void **ppParam)
+unsigned CNetQueue::Dequeue (CNetBuffer **ppNetBuffer, void **ppParam)
 {
-	unsigned nResult = 0;
-	
-	if (m_pFirst != 0)
+	CNetBuffer *pNetBuffer;
+	if (!m_Ring.Dequeue (&pNetBuffer))
 	{
-		m_SpinLock.Acquire ();
+		// the overflow list holds newer net buffers only, check it, when the ring is empty
+		if (m_pFirst == 0)
+		{
+			return 0;
+		}
 
-		volatile TNetQueueEntry *pEntry = m_pFirst;
-		assert (pEntry != 0);
+		m_SpinLock.Acquire ();
 
-		m_pFirst = pEntry->pNext;
-		if (m_pFirst != 0)
+		pNetBuffer = m_pFirst;
+		if (pNetBuffer == 0)
 		{
-			m_pFirst->pPrev = 0;
+			m_SpinLock.Release ();
+
+			return 0;
 		}
-		else
+
+		m_pFirst = pNetBuffer->m_pNext;
+		if (m_pFirst == 0)
 		{
-			assert (m_pLast == pEntry);
+			assert (m_pLast == pNetBuffer);
 			m_pLast = 0;
 		}
 
 		m_SpinLock.Release ();
+	}
 
-		nResult = pEntry->nLength;
-		assert (nResult > 0);
-		assert (nResult <= FRAME_BUFFER_SIZE);
-
-		memcpy (pBuffer, (const void *) pEntry->Buffer, nResult);
+	pNetBuffer->m_pNext = 0;
 
-		if (ppParam != 0)
-		{
-			*ppParam = pEntry->pParam;
-		}
+	unsigned nResult = pNetBuffer->GetLength ();
+	assert (nResult > 0);
+	assert (nResult <= FRAME_BUFFER_SIZE);
 
-		delete pEntry;
+	if (ppParam != 0)
+	{
+		*ppParam = pNetBuffer->m_pParam;
 	}
 
+	assert (ppNetBuffer != 0);
+	*ppNetBuffer = pNetBuffer;
+
 	return nResult;
 }
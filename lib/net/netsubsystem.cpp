@@ -2,7 +2,7 @@
 // netsubsystem.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -126,6 +126,9 @@ void CNetSubSystem::Process (void)
 		assert (m_pDHCPClient != 0);
 	}
 
+	// events, which occur from now on, cause another call
+	m_Event.Clear ();
+
 	m_NetDevLayer.Process ();
 
 	m_LinkLayer.Process ();
@@ -135,6 +138,24 @@ void CNetSubSystem::Process (void)
 	m_TransportLayer.Process ();
 }
 
+void CNetSubSystem::WaitForWork (void)
+{
+	if (   m_NetDevLayer.IsEventDriven ()
+	    && !m_NetDevLayer.IsRxPending ())
+	{
+		m_Event.WaitWithTimeout (NET_IDLE_TIMEOUT_MS * 1000);
+	}
+	else
+	{
+		CScheduler::Get ()->Yield ();
+	}
+}
+
+void CNetSubSystem::WakeUp (void)
+{
+	m_Event.Set ();
+}
+
 CNetConfig *CNetSubSystem::GetConfig (void)
 {
 	return &m_Config;
@@ -2,7 +2,7 @@
 // nettask.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,7 +18,6 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/nettask.h>
-#include <circle/sched/scheduler.h>
 #include <assert.h>
 
 CNetTask::CNetTask (CNetSubSystem *pNetSubSystem)
@@ -39,6 +38,6 @@ void CNetTask::Run (void)
 		assert (m_pNetSubSystem != 0);
 		m_pNetSubSystem->Process ();
 
-		CScheduler::Get ()->Yield ();
+		m_pNetSubSystem->WaitForWork ();
 	}
 }
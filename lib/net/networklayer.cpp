@@ -2,7 +2,7 @@
 // networklayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -56,32 +56,41 @@ void CNetworkLayer::Process (void)
 	const CIPAddress *pOwnIPAddress = m_pNetConfig->GetIPAddress ();
 	assert (pOwnIPAddress != 0);
 
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	unsigned nResultLength;
+	CNetBuffer *pNetBuffer;
 	assert (m_pLinkLayer != 0);
-	while (m_pLinkLayer->Receive (Buffer, &nResultLength))
+	while (m_pLinkLayer->Receive (&pNetBuffer))
 	{
+		assert (pNetBuffer != 0);
+		unsigned nResultLength = pNetBuffer->GetLength ();
 		if (nResultLength <= sizeof (TIPHeader))
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
-		TIPHeader *pHeader = (TIPHeader *) Buffer;
+		TIPHeader *pHeader = (TIPHeader *) pNetBuffer->GetData ();
 
 		unsigned nHeaderLength = pHeader->nVersionIHL & 0xF;
 		if (   nHeaderLength < IP_HEADER_LENGTH_DWORD_MIN
 		    || nHeaderLength > IP_HEADER_LENGTH_DWORD_MAX)
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
 		nHeaderLength *= 4;
 		if (nResultLength <= nHeaderLength)
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
 
 		if (   CChecksumCalculator::SimpleCalculate (pHeader, nHeaderLength) != CHECKSUM_OK
 		    || (pHeader->nVersionIHL >> 4) != IP_VERSION)
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
 
@@ -92,6 +101,8 @@ void CNetworkLayer::Process (void)
 			    && !IPAddressDestination.IsBroadcast ()
 			    && *m_pNetConfig->GetBroadcastAddress () != IPAddressDestination)
 			{
+				pNetBuffer->Release ();
+
 				continue;
 			}
 		}
@@ -99,6 +110,8 @@ void CNetworkLayer::Process (void)
 		{
 			if (!IPAddressDestination.IsBroadcast ())
 			{
+				pNetBuffer->Release ();
+
 				continue;
 			}
 		}
@@ -107,15 +120,20 @@ void CNetworkLayer::Process (void)
 		    ||    IP_FRAGMENT_OFFSET (le2be16 (pHeader->nFlagsFragmentOffset))
 		       != IP_FRAGMENT_OFFSET_FIRST)
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
 		
 		unsigned nTotalLength = le2be16 (pHeader->nTotalLength);
-		if (nResultLength < nTotalLength)
+		if (   nResultLength < nTotalLength
+		    || nTotalLength <= nHeaderLength)
 		{
+			pNetBuffer->Release ();
+
 			continue;
 		}
-		nResultLength = nTotalLength;		// ignore padding
+		pNetBuffer->Trim (nTotalLength);	// ignore padding
 
 		TNetworkPrivateData *pParam = new TNetworkPrivateData;
 		assert (pParam != 0);
@@ -123,15 +141,16 @@ void CNetworkLayer::Process (void)
 		memcpy (pParam->SourceAddress, pHeader->SourceAddress, IP_ADDRESS_SIZE);
 		memcpy (pParam->DestinationAddress, pHeader->DestinationAddress, IP_ADDRESS_SIZE);
 
-		nResultLength -= nHeaderLength;
+		// the header remains accessible via pHeader
+		pNetBuffer->Pull (nHeaderLength);
 
 		if (pHeader->nProtocol == IPPROTO_ICMP)
 		{
-			m_ICMPRxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_ICMPRxQueue.Enqueue (pNetBuffer, pParam);
 		}
 		else
 		{
-			m_RxQueue.Enqueue (Buffer+nHeaderLength, nResultLength, pParam);
+			m_RxQueue.Enqueue (pNetBuffer, pParam);
 		}
 	}
 
@@ -148,8 +167,29 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 		return FALSE;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TIPHeader *pHeader = (TIPHeader *) PacketBuffer;
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nLength);
+
+	assert (pPacket != 0);
+	memcpy (pNetBuffer->GetData (), pPacket, nLength);
+
+	return Send (rReceiver, pNetBuffer, nProtocol);
+}
+
+boolean CNetworkLayer::Send (const CIPAddress &rReceiver, CNetBuffer *pNetBuffer, int nProtocol)
+{
+	assert (pNetBuffer != 0);
+	unsigned nPacketLength = sizeof (TIPHeader) + pNetBuffer->GetLength ();
+	if (   nPacketLength <= sizeof (TIPHeader)
+	    || nPacketLength > FRAME_BUFFER_SIZE)
+	{
+		pNetBuffer->Release ();
+
+		return FALSE;
+	}
+
+	TIPHeader *pHeader = (TIPHeader *) pNetBuffer->Push (sizeof (TIPHeader));
 
 	pHeader->nVersionIHL          = IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN;
 	pHeader->nTypeOfService       = IP_TOS_ROUTINE;
@@ -170,14 +210,11 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 	pHeader->nHeaderChecksum = 0;
 	pHeader->nHeaderChecksum = CChecksumCalculator::SimpleCalculate (pHeader, sizeof (TIPHeader));
 
-	assert (pPacket != 0);
-	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TIPHeader), pPacket, nLength);
-
 	if (   pOwnIPAddress->IsNull ()
 	    && !rReceiver.IsBroadcast ())
 	{
-		SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+		SendFailed (ICMP_CODE_DEST_NET_UNREACH, pHeader, nPacketLength);
+		pNetBuffer->Release ();
 
 		return FALSE;
 	}
@@ -198,7 +235,8 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 			pNextHop = m_pNetConfig->GetDefaultGateway ();
 			if (pNextHop->IsNull ())
 			{
-				SendFailed (ICMP_CODE_DEST_NET_UNREACH, PacketBuffer, nPacketLength);
+				SendFailed (ICMP_CODE_DEST_NET_UNREACH, pHeader, nPacketLength);
+				pNetBuffer->Release ();
 
 				return FALSE;
 			}
@@ -207,7 +245,7 @@ boolean CNetworkLayer::Send (const CIPAddress &rReceiver, const void *pPacket, u
 	
 	assert (m_pLinkLayer != 0);
 	assert (pNextHop != 0);
-	return m_pLinkLayer->Send (*pNextHop, PacketBuffer, nPacketLength);
+	return m_pLinkLayer->Send (*pNextHop, pNetBuffer);
 }
 
 boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
@@ -240,6 +278,33 @@ boolean CNetworkLayer::Receive (void *pBuffer, unsigned *pResultLength,
 	return TRUE;
 }
 
+boolean CNetworkLayer::Receive (CNetBuffer **ppNetBuffer,
+				CIPAddress *pSender, CIPAddress *pReceiver, int *pProtocol)
+{
+	void *pParam;
+	assert (ppNetBuffer != 0);
+	if (m_RxQueue.Dequeue (ppNetBuffer, &pParam) == 0)
+	{
+		return FALSE;
+	}
+	
+	TNetworkPrivateData *pData = (TNetworkPrivateData *) pParam;
+	assert (pData != 0);
+
+	assert (pProtocol != 0);
+	*pProtocol = pData->nProtocol;
+
+	assert (pSender != 0);
+	pSender->Set (pData->SourceAddress);
+
+	assert (pReceiver != 0);
+	pReceiver->Set (pData->DestinationAddress);
+
+	delete pData;
+	
+	return TRUE;
+}
+
 boolean CNetworkLayer::ReceiveNotification (TICMPNotificationType *pType,
 					    CIPAddress *pSender, CIPAddress *pReceiver,
 					    u16 *pSendPort, u16 *pReceivePort,
@@ -2,7 +2,7 @@
 // retransmissionqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,6 +18,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/retransmissionqueue.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/util.h>
 #include <assert.h>
 
 CRetransmissionQueue::CRetransmissionQueue (unsigned nSize)
@@ -25,7 +27,8 @@ CRetransmissionQueue::CRetransmissionQueue (unsigned nSize)
 	m_pBuffer (0),
 	m_nInPtr (0),
 	m_nOutPtr (0),
-	m_nPreOutPtr (0)
+	m_nPreOutPtr (0),
+	m_nSACKBlocks (0)
 {
 	assert (m_nSize > 1);
 
@@ -35,7 +38,7 @@ CRetransmissionQueue::CRetransmissionQueue (unsigned nSize)
 
 CRetransmissionQueue::~CRetransmissionQueue (void)
 {
-	delete m_pBuffer;
+	delete [] m_pBuffer;
 	m_pBuffer = 0;
 	
 	m_nSize = 0;
@@ -65,13 +68,25 @@ void CRetransmissionQueue::Write (const void *pBuffer, unsigned nLength)
 	assert (nLength > 0);
 	assert (GetFreeSpace () >= nLength);
 
-	unsigned char *p = (unsigned char *) pBuffer;
+	const u8 *p = (const u8 *) pBuffer;
 	assert (p != 0);
 	assert (m_pBuffer != 0);
 
-	while (nLength--)
+	// copy in up to two chunks, because of the wrap around
+	while (nLength > 0)
 	{
-		m_pBuffer[m_nInPtr++] = *p++;
+		unsigned nChunk = m_nSize-m_nInPtr;
+		if (nChunk > nLength)
+		{
+			nChunk = nLength;
+		}
+
+		memcpy (m_pBuffer+m_nInPtr, p, nChunk);
+
+		p += nChunk;
+		nLength -= nChunk;
+
+		m_nInPtr += nChunk;
 		m_nInPtr %= m_nSize;
 	}
 }
@@ -90,20 +105,91 @@ unsigned CRetransmissionQueue::GetBytesAvailable (void) const
 	return m_nInPtr-m_nPreOutPtr;
 }
 
-void CRetransmissionQueue::Read (void *pBuffer, unsigned nLength)
+u32 CRetransmissionQueue::Read (void *pBuffer, unsigned nLength)
 {
 	assert (nLength > 0);
 	assert (GetBytesAvailable () >= nLength);
 
-	unsigned char *p = (unsigned char *) pBuffer;
+	u8 *p = (u8 *) pBuffer;
 	assert (p != 0);
 	assert (m_pBuffer != 0);
 
-	while (nLength--)
+	// the checksum is calculated while copying the data
+	u32 nSum = 0;
+	unsigned nOffset = 0;
+
+	while (nLength > 0)
 	{
-		*p++ = m_pBuffer[m_nPreOutPtr++];
+		unsigned nChunk = m_nSize-m_nPreOutPtr;
+		if (nChunk > nLength)
+		{
+			nChunk = nLength;
+		}
+
+		u32 nChunkSum = CChecksumCalculator::CopyAndSum (p, m_pBuffer+m_nPreOutPtr, nChunk);
+		nSum = CChecksumCalculator::AddSum (nSum, nChunkSum, nOffset);
+
+		p += nChunk;
+		nLength -= nChunk;
+		nOffset += nChunk;
+
+		m_nPreOutPtr += nChunk;
 		m_nPreOutPtr %= m_nSize;
 	}
+
+	return nSum;
+}
+
+unsigned CRetransmissionQueue::Peek (void *pBuffer, unsigned nLength, unsigned nOffset) const
+{
+	assert (m_nSize > 1);
+	assert (m_nInPtr < m_nSize);
+	assert (m_nOutPtr < m_nSize);
+
+	unsigned nBytesQueued = (m_nSize+m_nInPtr-m_nOutPtr) % m_nSize;
+	if (nOffset >= nBytesQueued)
+	{
+		return 0;
+	}
+
+	if (nLength > nBytesQueued-nOffset)
+	{
+		nLength = nBytesQueued-nOffset;
+	}
+
+	u8 *p = (u8 *) pBuffer;
+	assert (p != 0);
+	assert (m_pBuffer != 0);
+
+	unsigned nPtr = (m_nOutPtr+nOffset) % m_nSize;
+	unsigned nResult = nLength;
+
+	while (nLength > 0)
+	{
+		unsigned nChunk = m_nSize-nPtr;
+		if (nChunk > nLength)
+		{
+			nChunk = nLength;
+		}
+
+		memcpy (p, m_pBuffer+nPtr, nChunk);
+
+		p += nChunk;
+		nLength -= nChunk;
+
+		nPtr += nChunk;
+		nPtr %= m_nSize;
+	}
+
+	return nResult;
+}
+
+void CRetransmissionQueue::Skip (unsigned nBytes)
+{
+	assert (GetBytesAvailable () >= nBytes);
+
+	m_nPreOutPtr += nBytes;
+	m_nPreOutPtr %= m_nSize;
 }
 
 void CRetransmissionQueue::Advance (unsigned nBytes)
@@ -111,9 +197,34 @@ void CRetransmissionQueue::Advance (unsigned nBytes)
 	assert (m_nSize > 1);
 	assert (m_nOutPtr < m_nSize);
 	assert (m_nPreOutPtr < m_nSize);
+
+	// bytes, which have been read, but are not acknowledged yet
+	unsigned nBytesSent = (m_nSize+m_nPreOutPtr-m_nOutPtr) % m_nSize;
 	
 	m_nOutPtr += nBytes;
 	m_nOutPtr %= m_nSize;
+
+	// more bytes acknowledged than read after Reset()?
+	if (nBytes > nBytesSent)
+	{
+		m_nPreOutPtr = m_nOutPtr;
+	}
+
+	// rebase the SACK'ed ranges and remove the acknowledged ones
+	unsigned j = 0;
+	for (unsigned i = 0; i < m_nSACKBlocks; i++)
+	{
+		if (m_SACKBlock[i].nEnd <= nBytes)
+		{
+			continue;
+		}
+
+		m_SACKBlock[j].nStart = m_SACKBlock[i].nStart > nBytes ? m_SACKBlock[i].nStart-nBytes : 0;
+		m_SACKBlock[j].nEnd = m_SACKBlock[i].nEnd-nBytes;
+		j++;
+	}
+
+	m_nSACKBlocks = j;
 }
 
 void CRetransmissionQueue::Reset (void)
@@ -126,4 +237,103 @@ void CRetransmissionQueue::Flush (void)
 	m_nInPtr = 0;
 	m_nOutPtr = 0;
 	m_nPreOutPtr = 0;
+
+	m_nSACKBlocks = 0;
+}
+
+void CRetransmissionQueue::SetSACKed (unsigned nOffset, unsigned nLength)
+{
+	if (nLength == 0)
+	{
+		return;
+	}
+
+	unsigned nStart = nOffset;
+	unsigned nEnd = nOffset+nLength;
+
+	// merge with all overlapping or adjacent ranges
+	unsigned j = 0;
+	unsigned i;
+	for (i = 0; i < m_nSACKBlocks; i++)
+	{
+		if (   m_SACKBlock[i].nEnd < nStart
+		    || m_SACKBlock[i].nStart > nEnd)
+		{
+			m_SACKBlock[j++] = m_SACKBlock[i];
+
+			continue;
+		}
+
+		if (m_SACKBlock[i].nStart < nStart)
+		{
+			nStart = m_SACKBlock[i].nStart;
+		}
+
+		if (m_SACKBlock[i].nEnd > nEnd)
+		{
+			nEnd = m_SACKBlock[i].nEnd;
+		}
+	}
+
+	m_nSACKBlocks = j;
+
+	// insert sorted, the range with the highest offset is lost, if the list is full
+	for (i = 0; i < m_nSACKBlocks; i++)
+	{
+		if (m_SACKBlock[i].nStart > nStart)
+		{
+			break;
+		}
+	}
+
+	if (i >= RETRANS_SACK_BLOCKS)
+	{
+		return;
+	}
+
+	if (m_nSACKBlocks == RETRANS_SACK_BLOCKS)
+	{
+		m_nSACKBlocks--;
+	}
+
+	for (j = m_nSACKBlocks; j > i; j--)
+	{
+		m_SACKBlock[j] = m_SACKBlock[j-1];
+	}
+
+	m_SACKBlock[i].nStart = nStart;
+	m_SACKBlock[i].nEnd = nEnd;
+	m_nSACKBlocks++;
+}
+
+unsigned CRetransmissionQueue::GetSACKed (unsigned nOffset) const
+{
+	for (unsigned i = 0; i < m_nSACKBlocks; i++)
+	{
+		if (   m_SACKBlock[i].nStart <= nOffset
+		    && nOffset < m_SACKBlock[i].nEnd)
+		{
+			return m_SACKBlock[i].nEnd-nOffset;
+		}
+	}
+
+	return 0;
+}
+
+unsigned CRetransmissionQueue::GetNotSACKed (unsigned nOffset) const
+{
+	for (unsigned i = 0; i < m_nSACKBlocks; i++)
+	{
+		if (m_SACKBlock[i].nStart > nOffset)
+		{
+			return m_SACKBlock[i].nStart-nOffset;
+		}
+	}
+
+	return (unsigned) -1;
+}
+
+void CRetransmissionQueue::ClearSACKed (void)
+{
+	m_nSACKBlocks = 0;
 }
@@ -4,7 +4,7 @@
 // Calculating TCP retransmission timeout according to RFC 6298
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -46,7 +46,8 @@ CRetransmissionTimeoutCalculator::CRetransmissionTimeoutCalculator (void)
 	m_nRTO (INITIAL_RTO),
 	m_bFirstMeasurement (TRUE),
 	m_bMeasurementRuns (FALSE),
-	m_nRetransmissions (0)
+	m_nRetransmissions (0),
+	m_bRetransmitted (FALSE)
 {
 	assert (m_pTimer != 0);
 }
@@ -61,6 +62,11 @@ unsigned CRetransmissionTimeoutCalculator::GetRTO (void) const
 	return m_nRTO;
 }
 
+unsigned CRetransmissionTimeoutCalculator::GetSRTT (void) const
+{
+	return m_bFirstMeasurement ? 0 : m_nSRTT;
+}
+
 void CRetransmissionTimeoutCalculator::Initialize (u32 nISN)
 {
 	m_SpinLock.Acquire ();
@@ -74,6 +80,7 @@ void CRetransmissionTimeoutCalculator::Initialize (u32 nISN)
 	m_bFirstMeasurement = TRUE;
 	m_bMeasurementRuns = FALSE;
 	m_nRetransmissions = 0;
+	m_bRetransmitted = FALSE;
 
 	m_SpinLock.Release ();
 }
@@ -88,7 +95,8 @@ void CRetransmissionTimeoutCalculator::SegmentSent (u32 nSequenceNumber, u32 nLe
 #endif
 
 	if (   !m_bMeasurementRuns
-	    && m_nRetransmissions == 0)
+	    && m_nRetransmissions == 0
+	    && !m_bRetransmitted)
 	{
 		m_bMeasurementRuns = TRUE;
 
@@ -111,7 +119,8 @@ void CRetransmissionTimeoutCalculator::SegmentAcknowledged (u32 nAcknowledgmentN
 	// do not need to check nAcknowledgmentNumber because this is called only for valid ACKs
 
 	if (   m_bMeasurementRuns
-	    && m_nRetransmissions == 0)
+	    && m_nRetransmissions == 0
+	    && !m_bRetransmitted)
 	{
 		assert (m_pTimer != 0);
 		Calculate (m_pTimer->GetTicks () - m_nStartTicks);
@@ -119,6 +128,7 @@ void CRetransmissionTimeoutCalculator::SegmentAcknowledged (u32 nAcknowledgmentN
 
 	m_bMeasurementRuns = FALSE;
 	m_nRetransmissions = 0;
+	m_bRetransmitted = FALSE;
 
 	m_SpinLock.Release ();
 }
@@ -151,6 +161,22 @@ void CRetransmissionTimeoutCalculator::RetransmissionTimerExpired (void)
 	m_SpinLock.Release ();
 }
 
+// The ACK may be for the original or for the retransmitted segment, so the running
+// measurement is discarded (Karn's algorithm), but the RTO is not backed off.
+void CRetransmissionTimeoutCalculator::SegmentRetransmitted (void)
+{
+	m_SpinLock.Acquire ();
+
+#ifdef RTO_DEBUG
+	CLogger::Get ()->Write (FromRTO, LogDebug, "Segment retransmitted");
+#endif
+
+	m_bMeasurementRuns = FALSE;
+	m_bRetransmitted = TRUE;
+
+	m_SpinLock.Release ();
+}
+
 void CRetransmissionTimeoutCalculator::Calculate (unsigned nRTT)
 {
 	if (m_bFirstMeasurement)
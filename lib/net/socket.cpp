@@ -2,7 +2,7 @@
 // socket.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -30,7 +30,10 @@ CSocket::CSocket (CNetSubSystem *pNetSubSystem, int nProtocol)
 	m_nProtocol (nProtocol),
 	m_nOwnPort (0),
 	m_hConnection (-1),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_nSendWindow (0),
+	m_nReceiveWindow (0),
+	m_CongestionControl (TCP_CONGESTION_CONTROL_DEFAULT)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -43,7 +46,10 @@ CSocket::CSocket (CSocket &rSocket, int hConnection)
 	m_nProtocol (rSocket.m_nProtocol),
 	m_nOwnPort (rSocket.m_nOwnPort),
 	m_hConnection (hConnection),
-	m_nBackLog (0)
+	m_nBackLog (0),
+	m_nSendWindow (rSocket.m_nSendWindow),
+	m_nReceiveWindow (rSocket.m_nReceiveWindow),
+	m_CongestionControl (rSocket.m_CongestionControl)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pTransportLayer != 0);
@@ -130,7 +136,9 @@ int CSocket::Connect (CIPAddress &rForeignIP, u16 nForeignPort)
 		return -1;
 	}
 
-	m_hConnection = m_pTransportLayer->Connect (rForeignIP, nForeignPort, m_nOwnPort, m_nProtocol);
+	m_hConnection = m_pTransportLayer->Connect (rForeignIP, nForeignPort, m_nOwnPort, m_nProtocol,
+						    m_nSendWindow, m_nReceiveWindow,
+						    m_CongestionControl);
 
 	return m_hConnection >= 0 ? 0 : m_hConnection;
 }
@@ -161,7 +169,9 @@ int CSocket::Listen (unsigned nBackLog)
 
 	for (unsigned i = 0; i < m_nBackLog; i++)
 	{
-		m_hListenConnection[i] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
+		m_hListenConnection[i] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol,
+								    m_nSendWindow, m_nReceiveWindow,
+								    m_CongestionControl);
 		assert (m_hListenConnection[i] >= 0);
 	}
 
@@ -216,7 +226,9 @@ CSocket *CSocket::Accept (CIPAddress *pForeignIP, u16 *pForeignPort)
 	}
 
 	// replace the returned connection with a new listening one
-	m_hListenConnection[nIndex] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol);
+	m_hListenConnection[nIndex] = m_pTransportLayer->Listen (m_nOwnPort, m_nProtocol,
+								 m_nSendWindow, m_nReceiveWindow,
+								 m_CongestionControl);
 	assert (m_hListenConnection[nIndex] >= 0);
 
 	return pNewSocket;
@@ -348,6 +360,73 @@ int CSocket::SetOptionBroadcast (boolean bAllowed)
 	return m_pTransportLayer->SetOptionBroadcast (bAllowed, m_hConnection);
 }
 
+int CSocket::SetOptionSendWindow (unsigned nBytes)
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection >= 0
+	    || m_nBackLog > 0)
+	{
+		return -1;
+	}
+
+	m_nSendWindow = nBytes;
+
+	return 0;
+}
+
+int CSocket::SetOptionReceiveWindow (unsigned nBytes)
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection >= 0
+	    || m_nBackLog > 0)
+	{
+		return -1;
+	}
+
+	m_nReceiveWindow = nBytes;
+
+	return 0;
+}
+
+int CSocket::SetOptionCongestionControl (TTCPCongestionControl Algorithm)
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection >= 0
+	    || m_nBackLog > 0
+	    || Algorithm >= TCPCongestionControlUnknown)
+	{
+		return -1;
+	}
+
+	m_CongestionControl = Algorithm;
+
+	return 0;
+}
+
+int CSocket::SetOptionReceiveTimeout (unsigned nMicroSeconds)
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection < 0)
+	{
+		return -1;
+	}
+
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->SetOptionReceiveTimeout (nMicroSeconds, m_hConnection);
+}
+
+int CSocket::GetStatistics (TTCPStatistics *pStatistics) const
+{
+	if (   m_nProtocol != IPPROTO_TCP
+	    || m_hConnection < 0)
+	{
+		return -1;
+	}
+
+	assert (m_pTransportLayer != 0);
+	return m_pTransportLayer->GetStatistics (pStatistics, m_hConnection);
+}
+
 const u8 *CSocket::GetForeignIP (void) const
 {
 	if (m_hConnection < 0)
@@ -0,0 +1,137 @@
+//
+// tcpcongestioncontrol.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpcongestioncontrol.h>
+#include <circle/net/tcpnewreno.h>
+#include <circle/net/tcpcubic.h>
+#include <assert.h>
+
+#define MAX_WINDOW		0x40000000
+#define INITIAL_SSTHRESH	MAX_WINDOW		// RFC 5681 section 3.1
+
+#define min(n, m)		((n) <= (m) ? (n) : (m))
+#define max(n, m)		((n) >= (m) ? (n) : (m))
+
+CTCPCongestionControl::CTCPCongestionControl (void)
+:	m_nMSS (536),
+	m_nCWND (536),
+	m_nSSThresh (INITIAL_SSTHRESH),
+	m_nRTT (0),
+	m_nBytesAcked (0)
+{
+}
+
+CTCPCongestionControl::~CTCPCongestionControl (void)
+{
+}
+
+CTCPCongestionControl *CTCPCongestionControl::Create (TTCPCongestionControl Algorithm)
+{
+	CTCPCongestionControl *pResult = 0;
+
+	switch (Algorithm)
+	{
+	case TCPCongestionControlNewReno:
+		pResult = new CTCPNewReno;
+		break;
+
+	case TCPCongestionControlCubic:
+		pResult = new CTCPCubic;
+		break;
+
+	default:
+		break;
+	}
+
+	return pResult;
+}
+
+void CTCPCongestionControl::Initialize (unsigned nMSS)
+{
+	assert (nMSS > 0);
+	m_nMSS = nMSS;
+
+	// RFC 6928 section 2
+	m_nCWND = min (10 * m_nMSS, max (2 * m_nMSS, 14600));
+	m_nSSThresh = INITIAL_SSTHRESH;
+	m_nBytesAcked = 0;
+
+	Reset ();
+}
+
+void CTCPCongestionControl::DataAcknowledged (unsigned nBytesAcked)
+{
+	if (m_nCWND < m_nSSThresh)
+	{
+		// slow start, RFC 5681 section 3.1
+		m_nCWND += min (nBytesAcked, m_nMSS);
+	}
+	else
+	{
+		CongestionAvoidance (nBytesAcked);
+	}
+
+	m_nCWND = min (m_nCWND, MAX_WINDOW);
+}
+
+void CTCPCongestionControl::EnterRecovery (unsigned nFlightSize)
+{
+	CongestionEvent (nFlightSize);
+	assert (m_nSSThresh >= 2 * m_nMSS);
+
+	m_nCWND = m_nSSThresh + 3 * m_nMSS;		// inflated by the segments, which have left
+	m_nBytesAcked = 0;
+}
+
+void CTCPCongestionControl::DuplicateACK (void)
+{
+	m_nCWND += m_nMSS;
+	m_nCWND = min (m_nCWND, MAX_WINDOW);
+}
+
+void CTCPCongestionControl::PartialACK (unsigned nBytesAcked)
+{
+	// deflate the window by the amount of new data acknowledged
+	m_nCWND = m_nCWND > nBytesAcked ? m_nCWND - nBytesAcked : 0;
+
+	if (nBytesAcked >= m_nMSS)
+	{
+		m_nCWND += m_nMSS;
+	}
+
+	m_nCWND = max (m_nCWND, m_nMSS);
+}
+
+void CTCPCongestionControl::ExitRecovery (unsigned nFlightSize)
+{
+	// RFC 6582 section 3.2 step 6 option (1)
+	m_nCWND = min (m_nSSThresh, max (nFlightSize, m_nMSS) + m_nMSS);
+	m_nBytesAcked = 0;
+}
+
+void CTCPCongestionControl::RetransmissionTimeout (unsigned nFlightSize)
+{
+	CongestionEvent (nFlightSize);
+	assert (m_nSSThresh >= 2 * m_nMSS);
+
+	m_nCWND = m_nMSS;				// loss window, RFC 5681 section 3.1
+	m_nBytesAcked = 0;
+
+	Reset ();
+}
@@ -2,18 +2,20 @@
 // tcpconnection.cpp
 //
 // This implements RFC 793 with some changes in RFC 1122 and RFC 6298.
+// Window scaling is implemented according to RFC 7323, selective acknowledgment
+// according to RFC 2018, congestion control according to RFC 5681 and RFC 6582.
 //
 // Non-implemented features:
-//	dynamic receive window
 //	URG flag and urgent pointer
 //	delayed ACK
-//	queueing out-of-order TCP segments
+//	timestamps
+//	limited transmit
 //	security/compartment
 //	precedence
 //	user timeout
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -29,10 +31,12 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/tcpconnection.h>
+#include <circle/net/netsubsystem.h>
 #include <circle/macros.h>
 #include <circle/util.h>
 #include <circle/logger.h>
 #include <circle/net/in.h>
+#include <circle/atomic.h>
 #include <assert.h>
 
 //#define TCP_DEBUG
@@ -43,11 +47,15 @@
 #define MSS_S				1480	// maximum segment size to be send to network layer
 
 #define TCP_CONFIG_MSS			(MSS_R - 20)
-#define TCP_CONFIG_WINDOW		(TCP_CONFIG_MSS * 10)
+#define TCP_CONFIG_WINDOW		0x20000		// default receive window (buffer) size
 
-#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x10000	// should be greater than maximum send window size
+#define TCP_CONFIG_RETRANS_BUFFER_SIZE	0x20000	// default send window (buffer) size
+
+#define TCP_MIN_WINDOW			(TCP_CONFIG_MSS * 2)	// for both directions
+#define TCP_MAX_BUFFER			0x1000000
 
 #define TCP_MAX_WINDOW			((u16) -1)	// without Window extension option
+#define TCP_MAX_WINDOW_SCALE		14	// RFC 7323 section 2.3
 #define TCP_QUIET_TIME			30	// seconds after crash before another connection starts
 
 #define HZ_TIMEWAIT			(60 * HZ)
@@ -90,6 +98,7 @@ struct TTCPOption
 #define TCP_OPTION_MSS		2	//	Maximum segment size (2 byte)
 #define TCP_OPTION_WINDOW_SCALE	3	//	Shift count (1 byte)
 #define TCP_OPTION_SACK_PERM	4	//	None
+#define TCP_OPTION_SACK		5	//	Left and right edges of blocks (n*2*4 byte)
 #define TCP_OPTION_TIMESTAMP	8	//	Timestamp value, Timestamp echo reply (2*4 byte)
 	u8	nLength;
 	u8	Data[];
@@ -124,18 +133,38 @@ PACKED;
 
 unsigned CTCPConnection::s_nConnections = 0;
 
+static unsigned GetSendBufferSize (unsigned nSendWindow)
+{
+	if (nSendWindow == 0)
+	{
+		nSendWindow = TCP_CONFIG_RETRANS_BUFFER_SIZE;
+	}
+
+	nSendWindow = max (nSendWindow, TCP_MIN_WINDOW);
+	nSendWindow = min (nSendWindow, TCP_MAX_BUFFER);
+
+	// one byte of the ring buffer cannot be used
+	return nSendWindow + 1;
+}
+
 static const char FromTCP[] = "tcp";
 
 CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 				CNetworkLayer	*pNetworkLayer,
 				CIPAddress	&rForeignIP,
 				u16		 nForeignPort,
-				u16		 nOwnPort)
+				u16		 nOwnPort,
+				unsigned	 nSendWindow,
+				unsigned	 nReceiveWindow,
+				TTCPCongestionControl CongestionControl)
 :	CNetConnection (pNetConfig, pNetworkLayer, rForeignIP, nForeignPort, nOwnPort, IPPROTO_TCP),
 	m_bActiveOpen (TRUE),
 	m_State (TCPStateClosed),
 	m_nErrno (0),
-	m_RetransmissionQueue (TCP_CONFIG_RETRANS_BUFFER_SIZE),
+	m_nRxQueued (0),
+	m_nReceiveTimeout (0),
+	m_nOutOfOrder (0),
+	m_RetransmissionQueue (GetSendBufferSize (nSendWindow)),
 	m_bRetransmit (FALSE),
 	m_bSendSYN (FALSE),
 	m_bFINQueued (FALSE),
@@ -145,12 +174,38 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nSND_WND (TCP_CONFIG_WINDOW),
 	m_nSND_UP (0),
 	m_nRCV_NXT (0),
-	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_nSND_MAX (0),
+	m_nReceiveWindow (nReceiveWindow != 0 ? nReceiveWindow : TCP_CONFIG_WINDOW),
+	m_nSND_WScale (0),
+	m_bPeerWindowScale (FALSE),
+	m_nPeerWScale (0),
+	m_bSACKPermitted (FALSE),
+	m_bPeerSACKPermitted (FALSE),
+	m_nSACKReceived (0),
+	m_pCongestionControl (0),
+	m_nDupACKs (0),
+	m_bInRecovery (FALSE),
+	m_nRecover (0)
 {
 	s_nConnections++;
 
+	memset (&m_Statistics, 0, sizeof m_Statistics);
+
+	m_pCongestionControl = CTCPCongestionControl::Create (CongestionControl);
+	if (m_pCongestionControl == 0)
+	{
+		m_pCongestionControl = CTCPCongestionControl::Create (TCP_CONGESTION_CONTROL_DEFAULT);
+	}
+	assert (m_pCongestionControl != 0);
+
+	m_nReceiveWindow = max (m_nReceiveWindow, TCP_MIN_WINDOW);
+	m_nReceiveWindow = min (m_nReceiveWindow, TCP_MAX_BUFFER);
+	m_nRCV_BUF = m_nReceiveWindow;
+	m_nRCV_WND = m_nRCV_BUF;
+	m_nRCV_WScale = GetWindowScale (m_nRCV_BUF);
+
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
 	{
 		m_hTimer[nTimer] = 0;
@@ -161,6 +216,8 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 
 	m_nSND_UNA = m_nISS;
 	m_nSND_NXT = m_nISS+1;
+	m_nSND_MAX = m_nSND_NXT;
+	m_nRecover = m_nISS;
 
 	if (SendSegment (TCP_FLAG_SYN, m_nISS))
 	{
@@ -173,12 +230,18 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 
 CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 				CNetworkLayer	*pNetworkLayer,
-				u16		 nOwnPort)
+				u16		 nOwnPort,
+				unsigned	 nSendWindow,
+				unsigned	 nReceiveWindow,
+				TTCPCongestionControl CongestionControl)
 :	CNetConnection (pNetConfig, pNetworkLayer, nOwnPort, IPPROTO_TCP),
 	m_bActiveOpen (FALSE),
 	m_State (TCPStateListen),
 	m_nErrno (0),
-	m_RetransmissionQueue (TCP_CONFIG_RETRANS_BUFFER_SIZE),
+	m_nRxQueued (0),
+	m_nReceiveTimeout (0),
+	m_nOutOfOrder (0),
+	m_RetransmissionQueue (GetSendBufferSize (nSendWindow)),
 	m_bRetransmit (FALSE),
 	m_bSendSYN (FALSE),
 	m_bFINQueued (FALSE),
@@ -188,12 +251,38 @@ CTCPConnection::CTCPConnection (CNetConfig	*pNetConfig,
 	m_nSND_WND (TCP_CONFIG_WINDOW),
 	m_nSND_UP (0),
 	m_nRCV_NXT (0),
-	m_nRCV_WND (TCP_CONFIG_WINDOW),
 	m_nIRS (0),
-	m_nSND_MSS (536)	// RFC 1122 section 4.2.2.6
+	m_nSND_MSS (536),	// RFC 1122 section 4.2.2.6
+	m_nSND_MAX (0),
+	m_nReceiveWindow (nReceiveWindow != 0 ? nReceiveWindow : TCP_CONFIG_WINDOW),
+	m_nSND_WScale (0),
+	m_bPeerWindowScale (FALSE),
+	m_nPeerWScale (0),
+	m_bSACKPermitted (FALSE),
+	m_bPeerSACKPermitted (FALSE),
+	m_nSACKReceived (0),
+	m_pCongestionControl (0),
+	m_nDupACKs (0),
+	m_bInRecovery (FALSE),
+	m_nRecover (0)
 {
 	s_nConnections++;
 
+	memset (&m_Statistics, 0, sizeof m_Statistics);
+
+	m_pCongestionControl = CTCPCongestionControl::Create (CongestionControl);
+	if (m_pCongestionControl == 0)
+	{
+		m_pCongestionControl = CTCPCongestionControl::Create (TCP_CONGESTION_CONTROL_DEFAULT);
+	}
+	assert (m_pCongestionControl != 0);
+
+	m_nReceiveWindow = max (m_nReceiveWindow, TCP_MIN_WINDOW);
+	m_nReceiveWindow = min (m_nReceiveWindow, TCP_MAX_BUFFER);
+	m_nRCV_BUF = m_nReceiveWindow;
+	m_nRCV_WND = m_nRCV_BUF;
+	m_nRCV_WScale = GetWindowScale (m_nRCV_BUF);
+
 	for (unsigned nTimer = TCPTimerUser; nTimer < TCPTimerUnknown; nTimer++)
 	{
 		m_hTimer[nTimer] = 0;
@@ -213,6 +302,11 @@ CTCPConnection::~CTCPConnection (void)
 		StopTimer (nTimer);
 	}
 
+	FlushOutOfOrder ();
+
+	delete m_pCongestionControl;
+	m_pCongestionControl = 0;
+
 	// ensure no task is waiting any more
 	m_Event.Set ();
 	m_TxEvent.Set ();
@@ -451,14 +545,32 @@ int CTCPConnection::Receive (void *pBuffer, int nFlags)
 		}
 
 		m_Event.Clear ();
-		m_Event.Wait ();
+
+		boolean bTimedOut = FALSE;
+		if (m_nReceiveTimeout == 0)
+		{
+			m_Event.Wait ();
+		}
+		else
+		{
+			bTimedOut = m_Event.WaitWithTimeout (m_nReceiveTimeout);
+		}
 
 		if (m_nErrno < 0)
 		{
 			return m_nErrno;
 		}
+
+		if (   bTimedOut
+		    && m_RxQueue.IsEmpty ())
+		{
+			return 0;
+		}
 	}
 
+	// the receive window is opened again in Process()
+	AtomicSub (&m_nRxQueued, nLength);
+
 	return nLength;
 }
 
@@ -503,6 +615,31 @@ boolean CTCPConnection::IsTerminated (void) const
 	return m_State == TCPStateClosed;
 }
 
+boolean CTCPConnection::IsWildcard (void) const
+{
+	return m_State == TCPStateListen;
+}
+
+void CTCPConnection::GetStatistics (TTCPStatistics *pStatistics) const
+{
+	assert (pStatistics != 0);
+	*pStatistics = m_Statistics;
+
+	assert (m_pCongestionControl != 0);
+	pStatistics->nCongestionWindow = m_pCongestionControl->GetWindow ();
+	pStatistics->nSlowStartThreshold = m_pCongestionControl->GetSlowStartThreshold ();
+	pStatistics->nSendWindow = m_nSND_WND;
+	pStatistics->nReceiveWindow = m_nRCV_WND;
+	pStatistics->nSendMSS = m_nSND_MSS;
+	pStatistics->nSmoothedRTT = m_RTOCalculator.GetSRTT () * 1000 / HZ;
+	pStatistics->nRTO = m_RTOCalculator.GetRTO () * 1000 / HZ;
+}
+
+void CTCPConnection::SetOptionReceiveTimeout (unsigned nMicroSeconds)
+{
+	m_nReceiveTimeout = nMicroSeconds;
+}
+
 void CTCPConnection::Process (void)
 {
 	if (m_bTimedOut)
@@ -517,10 +654,13 @@ void CTCPConnection::Process (void)
 	{
 	case TCPStateClosed:
 	case TCPStateListen:
-	case TCPStateFinWait2:
 	case TCPStateTimeWait:
 		return;
 
+	case TCPStateFinWait2:
+		UpdateReceiveWindow ();
+		return;
+
 	case TCPStateSynSent:
 	case TCPStateSynReceived:
 		if (m_bSendSYN)
@@ -551,23 +691,28 @@ void CTCPConnection::Process (void)
 			SendSegment (TCP_FLAG_FIN | TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 			m_RTOCalculator.SegmentSent (m_nSND_NXT);
 			m_nSND_NXT++;
+			m_nSND_MAX = m_nSND_NXT;
 			NEW_STATE (m_StateAfterFIN);
 			m_bFINQueued = FALSE;
 			StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
 		}
+		UpdateReceiveWindow ();
 		break;
 	}
 
-	u8 TempBuffer[FRAME_BUFFER_SIZE];
+	CNetBuffer *pNetBuffer;
 	unsigned nLength;
 	while (    m_RetransmissionQueue.GetFreeSpace () >= FRAME_BUFFER_SIZE
-		&& (nLength = m_TxQueue.Dequeue (TempBuffer)) > 0)
+		&& (nLength = m_TxQueue.Dequeue (&pNetBuffer)) > 0)
 	{
 #ifdef TCP_DEBUG
 		CLogger::Get ()->Write (FromTCP, LogDebug, "Transfering %u bytes into RT buffer", nLength);
 #endif
 
-		m_RetransmissionQueue.Write (TempBuffer, nLength);
+		assert (pNetBuffer != 0);
+		m_RetransmissionQueue.Write (pNetBuffer->GetData (), nLength);
+
+		pNetBuffer->Release ();
 	}
 
 	// pacing transmit
@@ -586,13 +731,57 @@ void CTCPConnection::Process (void)
 		m_bRetransmit = FALSE;
 		m_RetransmissionQueue.Reset ();
 		m_nSND_NXT = m_nSND_UNA;
+
+		// the receiver may have discarded SACK'ed data, if the retransmission
+		// timer expires again (RFC 2018 section 8)
+		if (m_nRetransmissionCount < MAX_RETRANSMISSIONS-1)
+		{
+			m_RetransmissionQueue.ClearSACKed ();
+		}
+		else
+		{
+			// the window is reduced on the first timeout only (RFC 5681 section 3.1)
+			assert (m_pCongestionControl != 0);
+			m_pCongestionControl->RetransmissionTimeout (GetFlightSize ());
+		}
+
+		// RFC 6582 section 3.2 step 4
+		m_bInRecovery = FALSE;
+		m_nRecover = m_nSND_MAX;
+		m_nDupACKs = 0;
+
+		m_Statistics.nTimeouts++;
 	}
 
+	// the usable window is limited by the congestion window (RFC 5681 section 3.1)
+	assert (m_pCongestionControl != 0);
+	u32 nWindow = min (m_nSND_WND, m_pCongestionControl->GetWindow ());
+
 	u32 nBytesAvail;
 	u32 nWindowLeft;
 	while (   (nBytesAvail = m_RetransmissionQueue.GetBytesAvailable ()) > 0
-	       && (nWindowLeft = m_nSND_UNA+m_nSND_WND-m_nSND_NXT) > 0)
+	       && lt (m_nSND_NXT, m_nSND_UNA+nWindow))
 	{
+		nWindowLeft = m_nSND_UNA+nWindow-m_nSND_NXT;
+
+		// send only the holes again, when retransmitting after SACK
+		if (lt (m_nSND_NXT, m_nSND_MAX))
+		{
+			unsigned nOffset = m_nSND_NXT-m_nSND_UNA;
+
+			unsigned nSACKed = m_RetransmissionQueue.GetSACKed (nOffset);
+			if (nSACKed > 0)
+			{
+				nSACKed = min (nSACKed, nBytesAvail);
+				m_RetransmissionQueue.Skip (nSACKed);
+				m_nSND_NXT += nSACKed;
+
+				continue;
+			}
+
+			nBytesAvail = min (nBytesAvail, m_RetransmissionQueue.GetNotSACKed (nOffset));
+		}
+
 		nLength = min (nBytesAvail, nWindowLeft);
 		nLength = min (nLength, m_nSND_MSS);
 
@@ -601,7 +790,10 @@ void CTCPConnection::Process (void)
 #endif
 
 		assert (nLength <= FRAME_BUFFER_SIZE);
-		m_RetransmissionQueue.Read (TempBuffer, nLength);
+		pNetBuffer = new CNetBuffer;
+		assert (pNetBuffer != 0);
+		pNetBuffer->SetLength (nLength);
+		u32 nDataSum = m_RetransmissionQueue.Read (pNetBuffer->GetData (), nLength);
 
 		unsigned nFlags = TCP_FLAG_ACK;
 		if (m_TxQueue.IsEmpty ())
@@ -609,15 +801,27 @@ void CTCPConnection::Process (void)
 			nFlags |= TCP_FLAG_PUSH;
 		}
 
-		SendSegment (nFlags, m_nSND_NXT, m_nRCV_NXT, TempBuffer, nLength);
+		if (lt (m_nSND_NXT, m_nSND_MAX))
+		{
+			m_Statistics.nRetransmissions++;
+		}
+		else
+		{
+			m_Statistics.nBytesSent += nLength;
+		}
+
+		SendSegment (nFlags, m_nSND_NXT, m_nRCV_NXT, pNetBuffer, nDataSum);
 		m_RTOCalculator.SegmentSent (m_nSND_NXT, nLength);
 		m_nSND_NXT += nLength;
+		if (gt (m_nSND_NXT, m_nSND_MAX))
+		{
+			m_nSND_MAX = m_nSND_NXT;
+		}
 		StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
 	}
 }
 
-int CTCPConnection::PacketReceived (const void	*pPacket,
-				    unsigned	 nLength,
+int CTCPConnection::PacketReceived (CNetBuffer	*pNetBuffer,
 				    CIPAddress	&rSenderIP,
 				    CIPAddress	&rReceiverIP,
 				    int		 nProtocol)
@@ -627,6 +831,10 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		return 0;
 	}
 
+	assert (pNetBuffer != 0);
+	const void *pPacket = pNetBuffer->GetData ();
+	unsigned nLength = pNetBuffer->GetLength ();
+
 	if (nLength < sizeof (TTCPHeader))
 	{
 		return -1;
@@ -658,11 +866,14 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		m_Checksum.SetDestinationAddress (rSenderIP);
 	}
 
-	if (m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
+	if (   !pNetBuffer->IsChecksumVerified ()
+	    && m_Checksum.Calculate (pPacket, nLength) != CHECKSUM_OK)
 	{
 		return 0;
 	}
 
+	m_Statistics.nSegmentsReceived++;
+
 	u16 nFlags = pHeader->nDataOffsetFlags;
 	u32 nDataOffset = TCP_DATA_OFFSET (pHeader->nDataOffsetFlags)*4;
 	u32 nDataLength = nLength-nDataOffset;
@@ -682,6 +893,10 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 	}
 	
 	u32 nSEG_WND = be2le16 (pHeader->nWindow);
+	if (!(nFlags & TCP_FLAG_SYN))
+	{
+		nSEG_WND <<= m_nSND_WScale;		// window in SYN is never scaled
+	}
 	//u16 nSEG_UP  = be2le16 (pHeader->nUrgentPointer);
 	//u32 nSEG_PRC;	// segment precedence value
 
@@ -705,6 +920,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 #endif
 
 	boolean bAcceptable = FALSE;
+	boolean bDuplicateACK;			// set in step 5
+	boolean bPartialACK;
 
 	// RFC 793 section 3.9 "SEGMENT ARRIVES"
 	switch (m_State)
@@ -764,12 +981,14 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_nSND_WND = nSEG_WND;
 			m_nSND_WL1 = nSEG_SEQ;
 			m_nSND_WL2 = nSEG_ACK;
+
+			SetupOptions ();
 	
 			assert (nSEG_LEN > 0);
 
 			if (nDataLength > 0)
 			{
-				m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+				EnqueueData (pNetBuffer, nDataOffset, nDataLength);
 			}
 
 			m_nISS = CalculateISN ();
@@ -783,7 +1002,9 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_RTOCalculator.SegmentSent (m_nISS);
 
 			m_nSND_NXT = m_nISS+1;
+			m_nSND_MAX = m_nSND_NXT;
 			m_nSND_UNA = m_nISS;
+			m_nRecover = m_nISS;
 			
 			NEW_STATE (TCPStateSynReceived);
 
@@ -834,6 +1055,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_nRCV_NXT = nSEG_SEQ+1;
 			m_nIRS = nSEG_SEQ;
 
+			SetupOptions ();
+
 			if (nFlags & TCP_FLAG_ACK)
 			{
 				m_RTOCalculator.SegmentAcknowledged (nSEG_ACK);
@@ -895,7 +1118,7 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 
 					if (nDataLength > 0)
 					{
-						m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+						EnqueueData (pNetBuffer, nDataOffset, nDataLength);
 					}
 
 					break;
@@ -979,6 +1202,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 				m_RetransmissionQueue.Flush ();
 				m_TxQueue.Flush ();
 				m_RxQueue.Flush ();
+				AtomicSet (&m_nRxQueued, 0);
+				FlushOutOfOrder ();
 				NEW_STATE (TCPStateClosed);
 				m_Event.Set ();
 				return 1;
@@ -1014,6 +1239,8 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			m_RetransmissionQueue.Flush ();
 			m_TxQueue.Flush ();
 			m_RxQueue.Flush ();
+			AtomicSet (&m_nRxQueued, 0);
+			FlushOutOfOrder ();
 			NEW_STATE (TCPStateClosed);
 			m_Event.Set ();
 			return 1;
@@ -1025,6 +1252,9 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			return 1;
 		}
 
+		bDuplicateACK = FALSE;
+		bPartialACK = FALSE;
+
 		switch (m_State)
 		{
 		case TCPStateSynReceived:
@@ -1055,19 +1285,25 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateFinWait2:
 		case TCPStateCloseWait:
 		case TCPStateClosing:
-			if (bwh (m_nSND_UNA, nSEG_ACK, m_nSND_NXT))
+			if (bwh (m_nSND_UNA, nSEG_ACK, m_nSND_MAX))
 			{
 				m_RTOCalculator.SegmentAcknowledged (nSEG_ACK);
 
 				unsigned nBytesAck = nSEG_ACK-m_nSND_UNA;
 				m_nSND_UNA = nSEG_ACK;
 
-				if (nSEG_ACK == m_nSND_NXT)	// all segments are acknowledged
+				// progress has been made, so the retry count starts again
+				m_nRetransmissionCount = MAX_RETRANSMISSIONS;
+
+				// data sent before retransmission has arrived?
+				if (lt (m_nSND_NXT, nSEG_ACK))
 				{
-					StopTimer (TCPTimerRetransmission);
+					m_nSND_NXT = nSEG_ACK;
+				}
 
-					// next transmission starts with this count
-					m_nRetransmissionCount = MAX_RETRANSMISSIONS;
+				if (nSEG_ACK == m_nSND_MAX)	// all segments are acknowledged
+				{
+					StopTimer (TCPTimerRetransmission);
 				}
 
 				if (   m_State == TCPStateFinWait1
@@ -1088,6 +1324,26 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					m_RetransmissionQueue.Advance (nBytesAck);
 				}
 
+				assert (m_pCongestionControl != 0);
+				m_pCongestionControl->SetRTT (m_RTOCalculator.GetSRTT () * 1000 / HZ);
+
+				if (!m_bInRecovery)
+				{
+					m_pCongestionControl->DataAcknowledged (nBytesAck);
+				}
+				else if (ge (nSEG_ACK, m_nRecover))	// full ACK
+				{
+					m_bInRecovery = FALSE;
+					m_pCongestionControl->ExitRecovery (GetFlightSize ());
+				}
+				else					// partial ACK
+				{
+					m_pCongestionControl->PartialACK (nBytesAck);
+					bPartialACK = TRUE;
+				}
+
+				m_nDupACKs = 0;
+
 				// update send window
 				if (   lt (m_nSND_WL1, nSEG_SEQ)
 				    || (   m_nSND_WL1 == nSEG_SEQ
@@ -1100,10 +1356,20 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			}
 			else if (le (nSEG_ACK, m_nSND_UNA))	// RFC 1122 section 4.2.2.20 (g)
 			{
+				// RFC 5681 section 2 (definition of DUPLICATE ACKNOWLEDGMENT)
+				if (   nSEG_ACK == m_nSND_UNA
+				    && nDataLength == 0
+				    && !(nFlags & (TCP_FLAG_SYN | TCP_FLAG_FIN))
+				    && nSEG_WND == m_nSND_WND
+				    && m_nSND_MAX != m_nSND_UNA)
+				{
+					bDuplicateACK = TRUE;
+				}
+
 				// ignore duplicate ACK ...
 				
 				// RFC 1122 section 4.2.2.20 (g)
-				if (bwlh (m_nSND_UNA, nSEG_ACK, m_nSND_NXT))
+				if (bwlh (m_nSND_UNA, nSEG_ACK, m_nSND_MAX))
 				{
 					// ... but update send window
 					if (   lt (m_nSND_WL1, nSEG_SEQ)
@@ -1116,11 +1382,26 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 					}
 				}
 			}
-			else if (gt (nSEG_ACK, m_nSND_NXT))
+			else if (gt (nSEG_ACK, m_nSND_MAX))
 			{
 				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 				return 1;
 			}
+
+			if (m_bSACKPermitted)
+			{
+				ProcessSACK ();
+			}
+
+			if (bPartialACK)
+			{
+				// RFC 6582 section 3.2 step 5
+				FastRetransmit ();
+			}
+			else if (bDuplicateACK)
+			{
+				DuplicateACKReceived ();
+			}
 			
 			switch (m_State)
 			{
@@ -1207,20 +1488,38 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 		case TCPStateEstablished:
 		case TCPStateFinWait1:
 		case TCPStateFinWait2:
+			// remove data, which has been received before
+			if (   lt (nSEG_SEQ, m_nRCV_NXT)
+			    && gt (nSEG_SEQ+nDataLength, m_nRCV_NXT)
+			    && !(nFlags & TCP_FLAG_SYN))
+			{
+				u32 nBytes = m_nRCV_NXT-nSEG_SEQ;
+				nDataOffset += nBytes;
+				nDataLength -= nBytes;
+				nSEG_SEQ = m_nRCV_NXT;
+			}
+
 			if (nSEG_SEQ == m_nRCV_NXT)
 			{
-				if (nDataLength > 0)
+				// remove data, which does not fit into the receive window
+				if (nDataLength > m_nRCV_WND)
 				{
-					m_RxQueue.Enqueue ((u8 *) pPacket+nDataOffset, nDataLength);
+					nDataLength = m_nRCV_WND;
+					nFlags &= ~TCP_FLAG_FIN;
+				}
 
-					m_nRCV_NXT += nDataLength;
+				if (nDataLength > 0)
+				{
+					EnqueueData (pNetBuffer, nDataOffset, nDataLength);
 
-					// m_nRCV_WND should be adjusted here (section 3.7)
+					// data received out of order before may follow now
+					boolean bDelivered = DeliverOutOfOrder ();
 
 					// following ACK could be piggybacked with data
 					SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 
-					if (nFlags & TCP_FLAG_PUSH)
+					if (   (nFlags & TCP_FLAG_PUSH)
+					    || bDelivered)
 					{
 						m_Event.Set ();
 					}
@@ -1228,6 +1527,14 @@ int CTCPConnection::PacketReceived (const void	*pPacket,
 			}
 			else
 			{
+				if (   nDataLength > 0
+				    && gt (nSEG_SEQ, m_nRCV_NXT)
+				    && !(nFlags & TCP_FLAG_SYN))
+				{
+					QueueOutOfOrder (pNetBuffer, nSEG_SEQ, nDataOffset, nDataLength);
+				}
+
+				// duplicate ACK, reports received data with SACK option
 				SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
 				return 1;
 			}
@@ -1355,47 +1662,136 @@ int CTCPConnection::NotificationReceived (TICMPNotificationType  Type,
 boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
 				     const void *pData, unsigned nDataLength)
 {
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nDataLength);
+
+	u32 nDataSum = 0;
+	if (nDataLength > 0)
+	{
+		assert (pData != 0);
+		nDataSum = CChecksumCalculator::CopyAndSum (pNetBuffer->GetData (), pData, nDataLength);
+	}
+
+	return SendSegment (nFlags, nSequenceNumber, nAcknowledgmentNumber, pNetBuffer, nDataSum);
+}
+
+boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
+				     CNetBuffer *pNetBuffer)
+{
+	assert (pNetBuffer != 0);
+	u32 nDataSum = CChecksumCalculator::Sum (pNetBuffer->GetData (), pNetBuffer->GetLength ());
+
+	return SendSegment (nFlags, nSequenceNumber, nAcknowledgmentNumber, pNetBuffer, nDataSum);
+}
+
+boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 nAcknowledgmentNumber,
+				     CNetBuffer *pNetBuffer, u32 nDataSum)
+{
+	assert (pNetBuffer != 0);
+	unsigned nDataLength = pNetBuffer->GetLength ();
+
+	// options in SYN: the SYN-ACK contains only the options, the peer has sent
+	boolean bWindowScale = !(nFlags & TCP_FLAG_ACK) || m_bPeerWindowScale;
+	boolean bSACKPermitted = !(nFlags & TCP_FLAG_ACK) || m_bPeerSACKPermitted;
+
+	// SACK option in pure ACKs, which would not fit into a full sized data segment
+	u32 SACKBlocks[TCP_MAX_SACK_BLOCKS * 2];
+	unsigned nSACKBlocks = 0;
+	if (   !(nFlags & TCP_FLAG_SYN)
+	    && (nFlags & TCP_FLAG_ACK)
+	    && nDataLength == 0
+	    && m_bSACKPermitted)
+	{
+		nSACKBlocks = GetSACKBlocks (SACKBlocks);
+	}
+
 	unsigned nDataOffset = 5;
 	assert (nDataOffset * 4 == sizeof (TTCPHeader));
 	if (nFlags & TCP_FLAG_SYN)
 	{
 		nDataOffset++;
+
+		if (bWindowScale)
+		{
+			nDataOffset++;
+		}
+
+		if (bSACKPermitted)
+		{
+			nDataOffset++;
+		}
+	}
+	else if (nSACKBlocks > 0)
+	{
+		nDataOffset += 1 + nSACKBlocks * 2;
 	}
 	unsigned nHeaderLength = nDataOffset * 4;
 	
-	unsigned nPacketLength = nHeaderLength + nDataLength;		// may wrap
-	assert (nPacketLength >= nHeaderLength);
+	assert (nHeaderLength + nDataLength >= nHeaderLength);		// may wrap
 	assert (nHeaderLength <= FRAME_BUFFER_SIZE);
 
-	u8 TxBuffer[FRAME_BUFFER_SIZE];
-	TTCPHeader *pHeader = (TTCPHeader *) TxBuffer;
+	TTCPHeader *pHeader = (TTCPHeader *) pNetBuffer->Push (nHeaderLength);
+
+	u32 nWindow = m_nRCV_WND >> m_nRCV_WScale;
+	if (nFlags & TCP_FLAG_SYN)
+	{
+		nWindow = min (m_nRCV_WND, TCP_MAX_WINDOW);	// never scaled
+	}
+	assert (nWindow <= TCP_MAX_WINDOW);
 
 	pHeader->nSourcePort	 	= le2be16 (m_nOwnPort);
 	pHeader->nDestPort	 	= le2be16 (m_nForeignPort);
 	pHeader->nSequenceNumber 	= le2be32 (nSequenceNumber);
 	pHeader->nAcknowledgmentNumber	= nFlags & TCP_FLAG_ACK ? le2be32 (nAcknowledgmentNumber) : 0;
 	pHeader->nDataOffsetFlags	= (nDataOffset << TCP_DATA_OFFSET_SHIFT) | nFlags;
-	pHeader->nWindow		= le2be16 (m_nRCV_WND);
+	pHeader->nWindow		= le2be16 ((u16) nWindow);
 	pHeader->nUrgentPointer		= le2be16 (m_nSND_UP);
 
+	u8 *pOption = (u8 *) pHeader->Options;
 	if (nFlags & TCP_FLAG_SYN)
 	{
-		TTCPOption *pOption = (TTCPOption *) pHeader->Options;
+		*pOption++ = TCP_OPTION_MSS;
+		*pOption++ = 4;
+		*pOption++ = TCP_CONFIG_MSS >> 8;
+		*pOption++ = TCP_CONFIG_MSS & 0xFF;
 
-		pOption->nKind   = TCP_OPTION_MSS;
-		pOption->nLength = 4;
-		pOption->Data[0] = TCP_CONFIG_MSS >> 8;
-		pOption->Data[1] = TCP_CONFIG_MSS & 0xFF;
-	}
+		if (bWindowScale)
+		{
+			*pOption++ = TCP_OPTION_NOP;
+			*pOption++ = TCP_OPTION_WINDOW_SCALE;
+			*pOption++ = 3;
+			*pOption++ = (u8) m_nRCV_WScale;
+		}
 
-	if (nDataLength > 0)
+		if (bSACKPermitted)
+		{
+			*pOption++ = TCP_OPTION_NOP;
+			*pOption++ = TCP_OPTION_NOP;
+			*pOption++ = TCP_OPTION_SACK_PERM;
+			*pOption++ = 2;
+		}
+	}
+	else if (nSACKBlocks > 0)
 	{
-		assert (pData != 0);
-		memcpy (TxBuffer+nHeaderLength, pData, nDataLength);
+		*pOption++ = TCP_OPTION_NOP;
+		*pOption++ = TCP_OPTION_NOP;
+		*pOption++ = TCP_OPTION_SACK;
+		*pOption++ = 2 + nSACKBlocks * 8;
+
+		for (unsigned i = 0; i < nSACKBlocks * 2; i++)
+		{
+			u32 nEdge = le2be32 (SACKBlocks[i]);
+			memcpy (pOption, &nEdge, sizeof nEdge);
+			pOption += sizeof nEdge;
+		}
 	}
+	assert (pOption == (u8 *) pHeader + nHeaderLength);
 
 	pHeader->nChecksum = 0;		// must be 0 for calculation
-	pHeader->nChecksum = m_Checksum.Calculate (TxBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.Calculate (pHeader, nHeaderLength, nDataSum, nDataLength);
+
+	m_Statistics.nSegmentsSent++;
 
 #ifdef TCP_DEBUG
 	CLogger::Get ()->Write (FromTCP, LogDebug,
@@ -1413,7 +1809,191 @@ boolean CTCPConnection::SendSegment (unsigned nFlags, u32 nSequenceNumber, u32 n
 #endif
 
 	assert (m_pNetworkLayer != 0);
-	return m_pNetworkLayer->Send (m_ForeignIP, TxBuffer, nPacketLength, IPPROTO_TCP);
+	return m_pNetworkLayer->Send (m_ForeignIP, pNetBuffer, IPPROTO_TCP);
+}
+
+void CTCPConnection::EnqueueData (CNetBuffer *pNetBuffer, unsigned nDataOffset, unsigned nDataLength)
+{
+	assert (pNetBuffer != 0);
+	assert (nDataLength > 0);
+
+	// never beyond the right edge of the receive window
+	if (nDataLength > m_nRCV_WND)
+	{
+		nDataLength = m_nRCV_WND;
+		if (nDataLength == 0)
+		{
+			return;
+		}
+	}
+
+	// the buffer is consumed by this connection, so the header can be removed in place
+	pNetBuffer->Pull (nDataOffset);
+	pNetBuffer->Trim (nDataLength);
+
+	pNetBuffer->AddRef ();
+	m_RxQueue.Enqueue (pNetBuffer);
+
+	AtomicAdd (&m_nRxQueued, nDataLength);
+	m_Statistics.nBytesReceived += nDataLength;
+	m_nRCV_NXT += nDataLength;
+	m_nRCV_WND -= nDataLength;
+}
+
+void CTCPConnection::QueueOutOfOrder (CNetBuffer *pNetBuffer, u32 nSequence,
+				      unsigned nDataOffset, unsigned nDataLength)
+{
+	assert (pNetBuffer != 0);
+	assert (nDataLength > 0);
+	assert (gt (nSequence, m_nRCV_NXT));
+
+	u32 nWindowEnd = m_nRCV_NXT+m_nRCV_WND;
+	if (!lt (nSequence, nWindowEnd))
+	{
+		return;
+	}
+
+	if (gt (nSequence+nDataLength, nWindowEnd))
+	{
+		nDataLength = nWindowEnd-nSequence;
+	}
+
+	// find the position, segments overlapping with a queued one are ignored
+	unsigned i;
+	for (i = 0; i < m_nOutOfOrder; i++)
+	{
+		u32 nStart = m_OutOfOrder[i].nSequence;
+		u32 nEnd = nStart + m_OutOfOrder[i].pNetBuffer->GetLength ();
+
+		if (   lt (nSequence, nEnd)
+		    && gt (nSequence+nDataLength, nStart))
+		{
+			return;
+		}
+
+		if (lt (nSequence, nStart))
+		{
+			break;
+		}
+	}
+
+	if (m_nOutOfOrder >= TCP_MAX_OUT_OF_ORDER)
+	{
+		return;
+	}
+
+	for (unsigned j = m_nOutOfOrder; j > i; j--)
+	{
+		m_OutOfOrder[j] = m_OutOfOrder[j-1];
+	}
+
+	pNetBuffer->Pull (nDataOffset);
+	pNetBuffer->Trim (nDataLength);
+	pNetBuffer->AddRef ();
+
+	m_OutOfOrder[i].nSequence = nSequence;
+	m_OutOfOrder[i].pNetBuffer = pNetBuffer;
+	m_nOutOfOrder++;
+
+	m_nLastOutOfOrder = nSequence;
+}
+
+boolean CTCPConnection::DeliverOutOfOrder (void)
+{
+	boolean bDelivered = FALSE;
+
+	unsigned nCount = 0;
+	while (   nCount < m_nOutOfOrder
+	       && le (m_OutOfOrder[nCount].nSequence, m_nRCV_NXT))
+	{
+		CNetBuffer *pNetBuffer = m_OutOfOrder[nCount].pNetBuffer;
+		assert (pNetBuffer != 0);
+
+		u32 nEnd = m_OutOfOrder[nCount].nSequence + pNetBuffer->GetLength ();
+		if (gt (nEnd, m_nRCV_NXT))
+		{
+			EnqueueData (pNetBuffer, m_nRCV_NXT-m_OutOfOrder[nCount].nSequence,
+				     nEnd-m_nRCV_NXT);
+
+			bDelivered = TRUE;
+		}
+
+		pNetBuffer->Release ();
+
+		nCount++;
+	}
+
+	if (nCount > 0)
+	{
+		m_nOutOfOrder -= nCount;
+		for (unsigned i = 0; i < m_nOutOfOrder; i++)
+		{
+			m_OutOfOrder[i] = m_OutOfOrder[i+nCount];
+		}
+	}
+
+	return bDelivered;
+}
+
+void CTCPConnection::FlushOutOfOrder (void)
+{
+	for (unsigned i = 0; i < m_nOutOfOrder; i++)
+	{
+		assert (m_OutOfOrder[i].pNetBuffer != 0);
+		m_OutOfOrder[i].pNetBuffer->Release ();
+	}
+
+	m_nOutOfOrder = 0;
+}
+
+unsigned CTCPConnection::GetSACKBlocks (u32 *pBlocks)
+{
+	assert (pBlocks != 0);
+
+	// coalesce adjacent segments into blocks
+	u32 Blocks[TCP_MAX_OUT_OF_ORDER * 2];
+	unsigned nBlocks = 0;
+	for (unsigned i = 0; i < m_nOutOfOrder; i++)
+	{
+		u32 nStart = m_OutOfOrder[i].nSequence;
+		u32 nEnd = nStart + m_OutOfOrder[i].pNetBuffer->GetLength ();
+
+		if (   nBlocks > 0
+		    && Blocks[nBlocks*2-1] == nStart)
+		{
+			Blocks[nBlocks*2-1] = nEnd;
+		}
+		else
+		{
+			Blocks[nBlocks*2] = nStart;
+			Blocks[nBlocks*2+1] = nEnd;
+			nBlocks++;
+		}
+	}
+
+	// the first block must contain the latest received segment (RFC 2018 section 4)
+	unsigned nFirst = 0;
+	for (unsigned i = 0; i < nBlocks; i++)
+	{
+		if (bwl (Blocks[i*2], m_nLastOutOfOrder, Blocks[i*2+1]))
+		{
+			nFirst = i;
+
+			break;
+		}
+	}
+
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < nBlocks && nResult < TCP_MAX_SACK_BLOCKS; i++)
+	{
+		unsigned nBlock = i == 0 ? nFirst : (i <= nFirst ? i-1 : i);
+
+		pBlocks[nResult*2] = Blocks[nBlock*2];
+		pBlocks[nResult*2+1] = Blocks[nBlock*2+1];
+		nResult++;
+	}
+
+	return nResult;
 }
 
 void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
@@ -1422,6 +2002,15 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 	unsigned nDataOffset = TCP_DATA_OFFSET (pHeader->nDataOffsetFlags)*4;
 	u8 *pHeaderEnd = (u8 *) pHeader+nDataOffset;
 
+	boolean bSYN = pHeader->nDataOffsetFlags & TCP_FLAG_SYN ? TRUE : FALSE;
+	if (bSYN)
+	{
+		m_bPeerWindowScale = FALSE;
+		m_bPeerSACKPermitted = FALSE;
+	}
+
+	m_nSACKReceived = 0;
+
 	TTCPOption *pOption = (TTCPOption *) pHeader->Options;
 	while ((u8 *) pOption+2 <= pHeaderEnd)
 	{
@@ -1448,15 +2037,227 @@ void CTCPConnection::ScanOptions (TTCPHeader *pHeader)
 					m_nSND_MSS = (u16) nMSS;
 				}
 			}
-			// fall through
+			goto NextOption;
+
+		case TCP_OPTION_WINDOW_SCALE:
+			if (   pOption->nLength == 3
+			    && (u8 *) pOption+3 <= pHeaderEnd
+			    && bSYN)
+			{
+				m_bPeerWindowScale = TRUE;
+				m_nPeerWScale = min (pOption->Data[0], TCP_MAX_WINDOW_SCALE);
+			}
+			goto NextOption;
+
+		case TCP_OPTION_SACK_PERM:
+			if (   pOption->nLength == 2
+			    && bSYN)
+			{
+				m_bPeerSACKPermitted = TRUE;
+			}
+			goto NextOption;
+
+		case TCP_OPTION_SACK:
+			if (   pOption->nLength >= 2+8
+			    && (u8 *) pOption+pOption->nLength <= pHeaderEnd)
+			{
+				unsigned nBlocks = (pOption->nLength-2) / 8;
+				for (unsigned i = 0; i < nBlocks*2 && m_nSACKReceived < TCP_MAX_SACK_BLOCKS*2; i++)
+				{
+					u32 nEdge;
+					memcpy (&nEdge, pOption->Data + i*4, sizeof nEdge);
+					m_SACKReceived[m_nSACKReceived++] = be2le32 (nEdge);
+				}
+			}
+			goto NextOption;
 
 		default:
+		NextOption:
+			if (pOption->nLength < 2)	// invalid length
+			{
+				return;
+			}
+
 			pOption = (TTCPOption *) ((u8 *) pOption+pOption->nLength);
 			break;
 		}
 	}
 }
 
+void CTCPConnection::SetupOptions (void)
+{
+	m_nRCV_BUF = m_nReceiveWindow;
+
+	if (m_bPeerWindowScale)
+	{
+		m_nSND_WScale = m_nPeerWScale;
+		m_nRCV_WScale = GetWindowScale (m_nRCV_BUF);
+	}
+	else
+	{
+		m_nSND_WScale = 0;
+		m_nRCV_WScale = 0;
+
+		m_nRCV_BUF = min (m_nRCV_BUF, TCP_MAX_WINDOW);
+	}
+
+	m_nRCV_WND = m_nRCV_BUF;
+
+	m_bSACKPermitted = m_bPeerSACKPermitted;
+
+	// the MSS option has been scanned before
+	assert (m_pCongestionControl != 0);
+	m_pCongestionControl->Initialize (m_nSND_MSS);
+
+#ifdef TCP_DEBUG
+	CLogger::Get ()->Write (FromTCP, LogDebug, "Window scale %u/%u, SACK %s, CC %s",
+				m_nSND_WScale, m_nRCV_WScale, m_bSACKPermitted ? "on" : "off",
+				m_pCongestionControl->GetName ());
+#endif
+}
+
+void CTCPConnection::ProcessSACK (void)
+{
+	for (unsigned i = 0; i+1 < m_nSACKReceived; i += 2)
+	{
+		u32 nLeft = m_SACKReceived[i];
+		u32 nRight = m_SACKReceived[i+1];
+
+		// ignore invalid and old blocks (RFC 2883 D-SACK)
+		if (   !lt (nLeft, nRight)
+		    || !gt (nRight, m_nSND_UNA)
+		    || gt (nRight, m_nSND_MAX))
+		{
+			continue;
+		}
+
+		if (lt (nLeft, m_nSND_UNA))
+		{
+			nLeft = m_nSND_UNA;
+		}
+
+		m_RetransmissionQueue.SetSACKed (nLeft-m_nSND_UNA, nRight-nLeft);
+	}
+}
+
+void CTCPConnection::DuplicateACKReceived (void)
+{
+	m_Statistics.nDuplicateACKs++;
+
+	assert (m_pCongestionControl != 0);
+	if (m_bInRecovery)
+	{
+		// RFC 5681 section 3.2 step 4, new data may be sent in Process()
+		m_pCongestionControl->DuplicateACK ();
+
+		return;
+	}
+
+	if (++m_nDupACKs != 3)
+	{
+		return;
+	}
+
+	// RFC 6582 section 3.2 step 2, the loss has been handled before
+	if (lt (m_nSND_UNA, m_nRecover))
+	{
+		return;
+	}
+
+	m_nRecover = m_nSND_MAX;
+	m_bInRecovery = TRUE;
+
+	m_pCongestionControl->EnterRecovery (GetFlightSize ());
+
+	FastRetransmit ();
+
+	m_Statistics.nFastRetransmits++;
+	m_Statistics.nRecoveries++;
+}
+
+void CTCPConnection::FastRetransmit (void)
+{
+	unsigned nLength = m_nSND_MSS;
+
+	// with SACK send the first hole only
+	nLength = min (nLength, m_RetransmissionQueue.GetNotSACKed (0));
+	nLength = min (nLength, m_nSND_MAX-m_nSND_UNA);
+	if (nLength == 0)
+	{
+		return;
+	}
+
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nLength);
+
+	nLength = m_RetransmissionQueue.Peek (pNetBuffer->GetData (), nLength, 0);
+	if (nLength == 0)				// only FIN outstanding
+	{
+		pNetBuffer->Release ();
+
+		return;
+	}
+	pNetBuffer->SetLength (nLength);
+
+#ifdef TCP_DEBUG
+	CLogger::Get ()->Write (FromTCP, LogDebug, "Fast retransmit (una %u, len %u)",
+				m_nSND_UNA-m_nISS, nLength);
+#endif
+
+	SendSegment (TCP_FLAG_ACK, m_nSND_UNA, m_nRCV_NXT, pNetBuffer);
+	m_RTOCalculator.SegmentRetransmitted ();	// Karn's rule
+	StartTimer (TCPTimerRetransmission, m_RTOCalculator.GetRTO ());
+
+	m_Statistics.nRetransmissions++;
+}
+
+unsigned CTCPConnection::GetFlightSize (void) const
+{
+	return m_nSND_MAX-m_nSND_UNA;
+}
+
+void CTCPConnection::UpdateReceiveWindow (void)
+{
+	int nQueued = AtomicGet (&m_nRxQueued);
+	assert (nQueued >= 0);
+
+	u32 nWindow = 0;
+	if (m_nRCV_BUF > (u32) nQueued)
+	{
+		nWindow = m_nRCV_BUF - nQueued;
+	}
+
+	// RFC 1122 section 4.2.3.3 (receiver SWS avoidance)
+	if (   nWindow <= m_nRCV_WND
+	    || nWindow-m_nRCV_WND < min (m_nRCV_BUF / 2, TCP_CONFIG_MSS))
+	{
+		return;
+	}
+
+	// send a window update only, if the window was nearly closed
+	boolean bUpdate = m_nRCV_WND < m_nRCV_BUF / 2;
+
+	m_nRCV_WND = nWindow;
+
+	if (bUpdate)
+	{
+		SendSegment (TCP_FLAG_ACK, m_nSND_NXT, m_nRCV_NXT);
+	}
+}
+
+unsigned CTCPConnection::GetWindowScale (u32 nWindow)
+{
+	unsigned nShift = 0;
+	while (   (nWindow >> nShift) > TCP_MAX_WINDOW
+	       && nShift < TCP_MAX_WINDOW_SCALE)
+	{
+		nShift++;
+	}
+
+	return nShift;
+}
+
 u32 CTCPConnection::CalculateISN (void)
 {
 	assert (m_pTimer != 0);
@@ -1570,6 +2371,8 @@ void CTCPConnection::TimerStub (TKernelTimerHandle hTimer, void *pParam, void *p
 	assert (nTimer < TCPTimerUnknown);
 
 	pThis->TimerHandler (nTimer);
+
+	CNetSubSystem::Get ()->WakeUp ();
 }
 
 #ifndef NDEBUG
@@ -0,0 +1,166 @@
+//
+// tcpcubic.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpcubic.h>
+#include <assert.h>
+
+// constants from RFC 9438 section 4.1, scaled by 10
+#define C_CUBIC_10		4		// C = 0.4
+#define BETA_CUBIC_10		7		// beta = 0.7
+
+#define MAX_TIME_DELTA		60000		// milliseconds, to avoid overflows
+
+#define min(n, m)		((n) <= (m) ? (n) : (m))
+#define max(n, m)		((n) >= (m) ? (n) : (m))
+
+CTCPCubic::CTCPCubic (void)
+:	m_pTimer (CTimer::Get ()),
+	m_bEpochStarted (FALSE),
+	m_nWMax (0)
+{
+	assert (m_pTimer != 0);
+}
+
+CTCPCubic::~CTCPCubic (void)
+{
+	m_pTimer = 0;
+}
+
+const char *CTCPCubic::GetName (void) const
+{
+	return "cubic";
+}
+
+void CTCPCubic::CongestionAvoidance (unsigned nBytesAcked)
+{
+	assert (m_pTimer != 0);
+	unsigned nTicks = m_pTimer->GetTicks ();
+
+	if (!m_bEpochStarted)
+	{
+		// RFC 9438 section 4.2
+		m_bEpochStarted = TRUE;
+		m_nEpochStart = nTicks;
+		m_ulRemainder = 0;
+		m_nWEst = m_nCWND;
+
+		if (m_nCWND < m_nWMax)
+		{
+			// K = cubic_root ((W_max - cwnd_epoch) / C), in segments and seconds
+			u64 ulSegments1e9 = (u64) (m_nWMax - m_nCWND) * 1000000000 / m_nMSS;
+			m_nK = (unsigned) CubeRoot (ulSegments1e9 * 10 / C_CUBIC_10);
+			m_nOriginPoint = m_nWMax;
+		}
+		else
+		{
+			m_nK = 0;
+			m_nOriginPoint = m_nCWND;
+		}
+	}
+
+	unsigned nTime = (u64) (nTicks - m_nEpochStart) * 1000 / HZ;
+
+	// RFC 9438 section 4.3 (Reno-friendly region)
+	// alpha = 3 * (1 - beta) / (1 + beta) = 9 / 17
+	m_nWEst += (u64) nBytesAcked * m_nMSS * 9 / (17 * (u64) m_nCWND);
+
+	// the target is the window one RTT ahead, limited to 1.5 * cwnd (section 4.4)
+	unsigned nTarget = GetCubicWindow (nTime + m_nRTT);
+	nTarget = max (nTarget, m_nCWND);
+	nTarget = min (nTarget, m_nCWND + m_nCWND / 2);
+
+	if (GetCubicWindow (nTime) < m_nWEst)
+	{
+		m_nCWND = max (m_nCWND, m_nWEst);
+
+		return;
+	}
+
+	// RFC 9438 section 4.4 and 4.5 (concave and convex region)
+	u64 ulIncrement = (u64) (nTarget - m_nCWND) * nBytesAcked + m_ulRemainder;
+	m_nCWND += (unsigned) (ulIncrement / m_nCWND);
+	m_ulRemainder = ulIncrement % m_nCWND;
+}
+
+void CTCPCubic::CongestionEvent (unsigned nFlightSize)
+{
+	// RFC 9438 section 4.7 (fast convergence)
+	if (m_nCWND < m_nWMax)
+	{
+		m_nWMax = (u64) m_nCWND * (10 + BETA_CUBIC_10) / 20;
+	}
+	else
+	{
+		m_nWMax = m_nCWND;
+	}
+
+	// RFC 9438 section 4.6
+	m_nSSThresh = (u64) m_nCWND * BETA_CUBIC_10 / 10;
+	m_nSSThresh = max (m_nSSThresh, 2 * m_nMSS);
+
+	m_bEpochStarted = FALSE;
+}
+
+void CTCPCubic::Reset (void)
+{
+	m_bEpochStarted = FALSE;
+}
+
+unsigned CTCPCubic::GetCubicWindow (unsigned nTime) const
+{
+	// W_cubic(t) = C * (t - K)^3 + W_max (in segments and seconds)
+	int nDelta = (int) nTime - (int) m_nK;
+	nDelta = max (nDelta, -MAX_TIME_DELTA);
+	nDelta = min (nDelta, MAX_TIME_DELTA);
+
+	s64 nCube = (s64) nDelta * nDelta * nDelta;
+	s64 nOffset = nCube * C_CUBIC_10 * m_nMSS / 10000000000LL;
+
+	s64 nWindow = m_nOriginPoint + nOffset;
+	if (nWindow < (s64) m_nMSS)
+	{
+		return m_nMSS;
+	}
+
+	if (nWindow > 0x40000000)
+	{
+		return 0x40000000;
+	}
+
+	return (unsigned) nWindow;
+}
+
+u64 CTCPCubic::CubeRoot (u64 ulValue)
+{
+	// bitwise calculation of the integer cube root
+	u64 ulResult = 0;
+	for (int nShift = 63; nShift >= 0; nShift -= 3)
+	{
+		ulResult <<= 1;
+
+		u64 ulTest = 3 * ulResult * (ulResult + 1) + 1;
+		if ((ulValue >> nShift) >= ulTest)
+		{
+			ulValue -= ulTest << nShift;
+			ulResult++;
+		}
+	}
+
+	return ulResult;
+}
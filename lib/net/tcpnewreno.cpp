@@ -0,0 +1,55 @@
+//
+// tcpnewreno.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/net/tcpnewreno.h>
+#include <assert.h>
+
+CTCPNewReno::CTCPNewReno (void)
+{
+}
+
+CTCPNewReno::~CTCPNewReno (void)
+{
+}
+
+const char *CTCPNewReno::GetName (void) const
+{
+	return "newreno";
+}
+
+void CTCPNewReno::CongestionAvoidance (unsigned nBytesAcked)
+{
+	// one segment per RTT, with appropriate byte counting (RFC 3465)
+	m_nBytesAcked += nBytesAcked;
+	if (m_nBytesAcked >= m_nCWND)
+	{
+		m_nBytesAcked -= m_nCWND;
+		m_nCWND += m_nMSS;
+	}
+}
+
+void CTCPNewReno::CongestionEvent (unsigned nFlightSize)
+{
+	// RFC 5681 equation (4)
+	m_nSSThresh = nFlightSize / 2;
+	if (m_nSSThresh < 2 * m_nMSS)
+	{
+		m_nSSThresh = 2 * m_nMSS;
+	}
+}
@@ -4,7 +4,7 @@
 // Generates RESET response on any received TCP segment
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2017  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -66,7 +66,7 @@ CTCPRejector::~CTCPRejector (void)
 {
 }
 
-int CTCPRejector::PacketReceived (const void *pPacket, unsigned nLength,
+int CTCPRejector::PacketReceived (CNetBuffer *pNetBuffer,
 				  CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol)
 {
 	if (nProtocol != IPPROTO_TCP)
@@ -74,6 +74,10 @@ int CTCPRejector::PacketReceived (const void *pPacket, unsigned nLength,
 		return 0;
 	}
 
+	assert (pNetBuffer != 0);
+	const void *pPacket = pNetBuffer->GetData ();
+	unsigned nLength = pNetBuffer->GetLength ();
+
 	if (nLength < sizeof (TTCPHeader))
 	{
 		return -1;
@@ -2,7 +2,7 @@
 // transportlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,24 +18,27 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/net/transportlayer.h>
+#include <circle/net/netsubsystem.h>
 #include <circle/net/tcpconnection.h>
 #include <circle/net/udpconnection.h>
 #include <circle/net/in.h>
 #include <circle/macros.h>
+#include <circle/util.h>
 #include <assert.h>
 
-#define OWN_PORT_MIN	60000
-#define OWN_PORT_MAX	60999
-
 CTransportLayer::CTransportLayer (CNetConfig *pNetConfig, CNetworkLayer *pNetworkLayer)
 :	m_pNetConfig (pNetConfig),
 	m_pNetworkLayer (pNetworkLayer),
-	m_nOwnPort (OWN_PORT_MIN),
+	m_nOwnPort (TRANSPORT_OWN_PORT_MIN),
 	m_SpinLock (TASK_LEVEL),
 	m_TCPRejector (pNetConfig, pNetworkLayer)
 {
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
+
+	memset (m_pFullHash, 0, sizeof m_pFullHash);
+	memset (m_pPortHash, 0, sizeof m_pPortHash);
+	memset (m_nPortUsers, 0, sizeof m_nPortUsers);
 }
 
 CTransportLayer::~CTransportLayer (void)
@@ -51,35 +54,22 @@ boolean CTransportLayer::Initialize (void)
 
 void CTransportLayer::Process (void)
 {
-	unsigned nResultLength;
+	CNetBuffer *pNetBuffer;
 	CIPAddress Sender;
 	CIPAddress Receiver;
 	int nProtocol;
 	assert (m_pNetworkLayer != 0);
-	u8 Buffer[FRAME_BUFFER_SIZE];
-	while (m_pNetworkLayer->Receive (Buffer, &nResultLength, &Sender, &Receiver, &nProtocol))
+	while (m_pNetworkLayer->Receive (&pNetBuffer, &Sender, &Receiver, &nProtocol))
 	{
-		unsigned i;
-		for (i = 0; i < m_pConnection.GetCount (); i++)
-		{
-			if (m_pConnection[i] == 0)
-			{
-				continue;
-			}
+		assert (pNetBuffer != 0);
 
-			if (((CNetConnection *) m_pConnection[i])->PacketReceived (
-				Buffer, nResultLength, Sender, Receiver, nProtocol) != 0)
-			{
-				break;
-			}
-		}
-
-		if (i >= m_pConnection.GetCount ())
+		if (!PacketReceived (pNetBuffer, Sender, Receiver, nProtocol))
 		{
 			// send RESET on not consumed TCP segment
-			m_TCPRejector.PacketReceived (Buffer, nResultLength,
-						      Sender, Receiver, nProtocol);
+			m_TCPRejector.PacketReceived (pNetBuffer, Sender, Receiver, nProtocol);
 		}
+
+		pNetBuffer->Release ();
 	}
 
 	TICMPNotificationType Type;
@@ -106,15 +96,22 @@ void CTransportLayer::Process (void)
 
 	for (unsigned i = 0; i < m_pConnection.GetCount (); i++)
 	{
-		if (m_pConnection[i] != 0)
+		CNetConnection *pConnection = (CNetConnection *) m_pConnection[i];
+		if (pConnection != 0)
 		{
-			if (!((CNetConnection *) m_pConnection[i])->IsTerminated ())
+			if (!pConnection->IsTerminated ())
 			{			
-				((CNetConnection *) m_pConnection[i])->Process ();
+				pConnection->Process ();
+
+				UpdateConnection (pConnection);
 			}
 			else
 			{
-				delete (CNetConnection *) m_pConnection[i];
+				m_SpinLock.Acquire ();
+				RemoveConnection (pConnection);
+				m_SpinLock.Release ();
+
+				delete pConnection;
 				m_pConnection[i] = 0;
 			}
 		}
@@ -175,12 +172,16 @@ int CTransportLayer::Bind (u16 nOwnPort, int nProtocol)
 	m_pConnection[i] = new CUDPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
 }
 
-int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, int nProtocol)
+int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, int nProtocol,
+			       unsigned nSendWindow, unsigned nReceiveWindow,
+			       TTCPCongestionControl CongestionControl)
 {
 	m_SpinLock.Acquire ();
 
@@ -200,26 +201,27 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 
 	if (nOwnPort == 0)
 	{
-		unsigned j;
+		u16 *pPortUsers;
+		unsigned nTries = 0;
 		do
 		{
-			nOwnPort = m_nOwnPort;
-			if (++m_nOwnPort > OWN_PORT_MAX)
+			if (nTries++ > TRANSPORT_OWN_PORT_MAX-TRANSPORT_OWN_PORT_MIN)
 			{
-				m_nOwnPort = OWN_PORT_MIN;
+				m_SpinLock.Release ();
+
+				return -1;
 			}
 
-			for (j = 0; j < m_pConnection.GetCount (); j++)
+			nOwnPort = m_nOwnPort;
+			if (++m_nOwnPort > TRANSPORT_OWN_PORT_MAX)
 			{
-				if (   m_pConnection[j] != 0
-				    && ((CNetConnection *) m_pConnection[j])->GetOwnPort () == nOwnPort
-				    && ((CNetConnection *) m_pConnection[j])->GetProtocol () == nProtocol)
-				{
-					break;
-				}
+				m_nOwnPort = TRANSPORT_OWN_PORT_MIN;
 			}
+
+			pPortUsers = GetPortUsers (nOwnPort, nProtocol);
 		}
-		while (j < m_pConnection.GetCount ());
+		while (   pPortUsers != 0
+		       && *pPortUsers != 0);
 	}
 
 	assert (m_pNetConfig != 0);
@@ -227,7 +229,8 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 	switch (nProtocol)
 	{
 	case IPPROTO_TCP:
-		m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, rIPAddress, nPort, nOwnPort);
+		m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, rIPAddress, nPort, nOwnPort,
+						       nSendWindow, nReceiveWindow, CongestionControl);
 		break;
 
 	case IPPROTO_UDP:
@@ -239,9 +242,14 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 		return -1;
 	}
 
+	assert (m_pConnection[i] != 0);
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
-	assert (m_pConnection[i] != 0);
+	// the net task sends the SYN, while we are waiting
+	CNetSubSystem::Get ()->WakeUp ();
+
 	int nResult = ((CNetConnection *) m_pConnection[i])->Connect ();
 	if (nResult < 0)
 	{
@@ -251,7 +259,9 @@ int CTransportLayer::Connect (CIPAddress &rIPAddress, u16 nPort, u16 nOwnPort, i
 	return i;
 }
 
-int CTransportLayer::Listen (u16 nOwnPort, int nProtocol)
+int CTransportLayer::Listen (u16 nOwnPort, int nProtocol,
+			      unsigned nSendWindow, unsigned nReceiveWindow,
+			      TTCPCongestionControl CongestionControl)
 {
 	m_SpinLock.Acquire ();
 
@@ -285,9 +295,12 @@ int CTransportLayer::Listen (u16 nOwnPort, int nProtocol)
 
 	assert (m_pNetConfig != 0);
 	assert (m_pNetworkLayer != 0);
-	m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort);
+	m_pConnection[i] = new CTCPConnection (m_pNetConfig, m_pNetworkLayer, nOwnPort,
+					       nSendWindow, nReceiveWindow, CongestionControl);
 	assert (m_pConnection[i] != 0);
 
+	AddConnection ((CNetConnection *) m_pConnection[i]);
+
 	m_SpinLock.Release ();
 
 	return i;
@@ -316,6 +329,8 @@ int CTransportLayer::Disconnect (int hConnection)
 		return -1;
 	}
 
+	CNetSubSystem::Get ()->WakeUp ();
+
 	return ((CNetConnection *) m_pConnection[hConnection])->Close ();
 }
 
@@ -330,6 +345,10 @@ int CTransportLayer::Send (const void *pData, unsigned nLength, int nFlags, int
 
 	assert (pData != 0);
 	assert (nLength > 0);
+
+	// the net task runs, when the data has been queued
+	CNetSubSystem::Get ()->WakeUp ();
+
 	return ((CNetConnection *) m_pConnection[hConnection])->Send (pData, nLength, nFlags);
 }
 
@@ -343,7 +362,12 @@ int CTransportLayer::Receive (void *pBuffer, int nFlags, int hConnection)
 	}
 
 	assert (pBuffer != 0);
-	return ((CNetConnection *) m_pConnection[hConnection])->Receive (pBuffer, nFlags);
+	int nResult = ((CNetConnection *) m_pConnection[hConnection])->Receive (pBuffer, nFlags);
+
+	// the receive window may have to be updated
+	CNetSubSystem::Get ()->WakeUp ();
+
+	return nResult;
 }
 
 int CTransportLayer::SendTo (const void *pData, unsigned nLength, int nFlags,
@@ -412,3 +436,217 @@ const u8 *CTransportLayer::GetForeignIP (int hConnection) const
 
 	return ((CNetConnection *) m_pConnection[hConnection])->GetForeignIP ();
 }
+
+int CTransportLayer::GetStatistics (TTCPStatistics *pStatistics, int hConnection) const
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	CNetConnection *pConnection = (CNetConnection *) m_pConnection[hConnection];
+	if (pConnection->GetProtocol () != IPPROTO_TCP)
+	{
+		return -1;
+	}
+
+	assert (pStatistics != 0);
+	((CTCPConnection *) pConnection)->GetStatistics (pStatistics);
+
+	return 0;
+}
+
+int CTransportLayer::SetOptionReceiveTimeout (unsigned nMicroSeconds, int hConnection)
+{
+	assert (hConnection >= 0);
+	if (   hConnection >= (int) m_pConnection.GetCount ()
+	    || m_pConnection[hConnection] == 0)
+	{
+		return -1;
+	}
+
+	CNetConnection *pConnection = (CNetConnection *) m_pConnection[hConnection];
+	if (pConnection->GetProtocol () != IPPROTO_TCP)
+	{
+		return -1;
+	}
+
+	((CTCPConnection *) pConnection)->SetOptionReceiveTimeout (nMicroSeconds);
+
+	return 0;
+}
+
+boolean CTransportLayer::PacketReceived (CNetBuffer *pNetBuffer, CIPAddress &rSenderIP,
+					 CIPAddress &rReceiverIP, int nProtocol)
+{
+	if (   nProtocol != IPPROTO_TCP
+	    && nProtocol != IPPROTO_UDP)
+	{
+		return FALSE;
+	}
+
+	// TCP and UDP header start with source and destination port
+	assert (pNetBuffer != 0);
+	if (pNetBuffer->GetLength () < 4)
+	{
+		return TRUE;			// invalid packet, ignore it
+	}
+
+	const u8 *pPorts = (const u8 *) pNetBuffer->GetData ();
+	u16 nForeignPort = (u16) pPorts[0] << 8 | pPorts[1];
+	u16 nOwnPort = (u16) pPorts[2] << 8 | pPorts[3];
+	u32 nForeignIP = rSenderIP;
+
+	// exact match on the 4-tuple first
+	CNetConnection *pConnection;
+	for (pConnection = m_pFullHash[HashFull (nProtocol, nOwnPort, nForeignIP, nForeignPort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pHashNext)
+	{
+		if (   pConnection->m_nOwnPort == nOwnPort
+		    && pConnection->m_nForeignPort == nForeignPort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->m_ForeignIP == nForeignIP
+		    && pConnection->PacketReceived (pNetBuffer, rSenderIP, rReceiverIP, nProtocol) != 0)
+		{
+			UpdateConnection (pConnection);
+
+			return TRUE;
+		}
+	}
+
+	// then connections, which accept packets from any foreign endpoint
+	for (pConnection = m_pPortHash[HashPort (nProtocol, nOwnPort)];
+	     pConnection != 0;
+	     pConnection = pConnection->m_pHashNext)
+	{
+		if (   pConnection->m_nOwnPort == nOwnPort
+		    && pConnection->m_nProtocol == nProtocol
+		    && pConnection->PacketReceived (pNetBuffer, rSenderIP, rReceiverIP, nProtocol) != 0)
+		{
+			UpdateConnection (pConnection);
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CTransportLayer::AddConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	assert (pConnection->m_ppHashBucket == 0);
+
+	CNetConnection **ppBucket = GetHashBucket (pConnection);
+	assert (ppBucket != 0);
+
+	// append to the chain, so that older connections are found first
+	CNetConnection **ppLink = ppBucket;
+	while (*ppLink != 0)
+	{
+		ppLink = &(*ppLink)->m_pHashNext;
+	}
+
+	*ppLink = pConnection;
+	pConnection->m_pHashNext = 0;
+	pConnection->m_ppHashBucket = ppBucket;
+
+	u16 *pPortUsers = GetPortUsers (pConnection->m_nOwnPort, pConnection->m_nProtocol);
+	if (pPortUsers != 0)
+	{
+		++*pPortUsers;
+	}
+}
+
+void CTransportLayer::RemoveConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+
+	CNetConnection **ppLink = pConnection->m_ppHashBucket;
+	if (ppLink == 0)
+	{
+		return;
+	}
+
+	while (*ppLink != pConnection)
+	{
+		assert (*ppLink != 0);
+		ppLink = &(*ppLink)->m_pHashNext;
+	}
+
+	*ppLink = pConnection->m_pHashNext;
+	pConnection->m_pHashNext = 0;
+	pConnection->m_ppHashBucket = 0;
+
+	u16 *pPortUsers = GetPortUsers (pConnection->m_nOwnPort, pConnection->m_nProtocol);
+	if (pPortUsers != 0)
+	{
+		assert (*pPortUsers > 0);
+		--*pPortUsers;
+	}
+}
+
+void CTransportLayer::UpdateConnection (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	if (   pConnection->m_ppHashBucket == 0
+	    || pConnection->IsTerminated ()		// will be removed soon
+	    || pConnection->m_ppHashBucket == GetHashBucket (pConnection))
+	{
+		return;
+	}
+
+	m_SpinLock.Acquire ();
+
+	RemoveConnection (pConnection);
+	AddConnection (pConnection);
+
+	m_SpinLock.Release ();
+}
+
+CNetConnection **CTransportLayer::GetHashBucket (CNetConnection *pConnection)
+{
+	assert (pConnection != 0);
+	if (pConnection->IsWildcard ())
+	{
+		return &m_pPortHash[HashPort (pConnection->m_nProtocol, pConnection->m_nOwnPort)];
+	}
+
+	return &m_pFullHash[HashFull (pConnection->m_nProtocol, pConnection->m_nOwnPort,
+				      pConnection->m_ForeignIP, pConnection->m_nForeignPort)];
+}
+
+u16 *CTransportLayer::GetPortUsers (u16 nOwnPort, int nProtocol)
+{
+	if (   nOwnPort < TRANSPORT_OWN_PORT_MIN
+	    || nOwnPort > TRANSPORT_OWN_PORT_MAX)
+	{
+		return 0;
+	}
+
+	switch (nProtocol)
+	{
+	case IPPROTO_TCP:	return &m_nPortUsers[0][nOwnPort-TRANSPORT_OWN_PORT_MIN];
+	case IPPROTO_UDP:	return &m_nPortUsers[1][nOwnPort-TRANSPORT_OWN_PORT_MIN];
+	default:		return 0;
+	}
+}
+
+unsigned CTransportLayer::HashFull (int nProtocol, u16 nOwnPort, u32 nForeignIP, u16 nForeignPort)
+{
+	u32 nHash = nForeignIP ^ ((u32) nForeignPort << 16 | nOwnPort) ^ nProtocol;
+	nHash ^= nHash >> 16;
+	nHash *= 0x9E3779B1U;				// multiplicative hashing
+
+	return (nHash >> 16) & (TRANSPORT_HASH_SIZE-1);
+}
+
+unsigned CTransportLayer::HashPort (int nProtocol, u16 nOwnPort)
+{
+	u32 nHash = ((u32) nOwnPort ^ nProtocol) * 0x9E3779B1U;
+
+	return (nHash >> 16) & (TRANSPORT_PORT_HASH_SIZE-1);
+}
@@ -2,7 +2,7 @@
 // udpconnection.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -128,8 +128,10 @@ int CUDPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 		return -1;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TUDPHeader *pHeader = (TUDPHeader *) PacketBuffer;
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nPacketLength);
+	TUDPHeader *pHeader = (TUDPHeader *) pNetBuffer->GetData ();
 
 	pHeader->nSourcePort = le2be16 (m_nOwnPort);
 	pHeader->nDestPort   = le2be16 (m_nForeignPort);
@@ -138,14 +140,18 @@ int CUDPConnection::Send (const void *pData, unsigned nLength, int nFlags)
 	
 	assert (pData != 0);
 	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
+	u32 nDataSum = CChecksumCalculator::CopyAndSum (pHeader+1, pData, nLength);
 
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (m_ForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.Calculate (pHeader, sizeof (TUDPHeader), nDataSum, nLength);
+	if (pHeader->nChecksum == UDP_CHECKSUM_NONE)
+	{
+		pHeader->nChecksum = 0xFFFF;		// RFC 768
+	}
 
 	assert (m_pNetworkLayer != 0);
-	boolean bOK = m_pNetworkLayer->Send (m_ForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
+	boolean bOK = m_pNetworkLayer->Send (m_ForeignIP, pNetBuffer, IPPROTO_UDP);
 	
 	return bOK ? nLength : -1;
 }
@@ -233,8 +239,10 @@ int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 		return -1;
 	}
 
-	u8 PacketBuffer[nPacketLength];
-	TUDPHeader *pHeader = (TUDPHeader *) PacketBuffer;
+	CNetBuffer *pNetBuffer = new CNetBuffer;
+	assert (pNetBuffer != 0);
+	pNetBuffer->SetLength (nPacketLength);
+	TUDPHeader *pHeader = (TUDPHeader *) pNetBuffer->GetData ();
 
 	pHeader->nSourcePort = le2be16 (m_nOwnPort);
 	pHeader->nDestPort   = le2be16 (nForeignPort);
@@ -243,14 +251,18 @@ int CUDPConnection::SendTo (const void *pData, unsigned nLength, int nFlags,
 	
 	assert (pData != 0);
 	assert (nLength > 0);
-	memcpy (PacketBuffer+sizeof (TUDPHeader), pData, nLength);
+	u32 nDataSum = CChecksumCalculator::CopyAndSum (pHeader+1, pData, nLength);
 
 	m_Checksum.SetSourceAddress (*m_pNetConfig->GetIPAddress ());
 	m_Checksum.SetDestinationAddress (rForeignIP);
-	pHeader->nChecksum = m_Checksum.Calculate (PacketBuffer, nPacketLength);
+	pHeader->nChecksum = m_Checksum.Calculate (pHeader, sizeof (TUDPHeader), nDataSum, nLength);
+	if (pHeader->nChecksum == UDP_CHECKSUM_NONE)
+	{
+		pHeader->nChecksum = 0xFFFF;		// RFC 768
+	}
 
 	assert (m_pNetworkLayer != 0);
-	boolean bOK = m_pNetworkLayer->Send (rForeignIP, PacketBuffer, nPacketLength, IPPROTO_UDP);
+	boolean bOK = m_pNetworkLayer->Send (rForeignIP, pNetBuffer, IPPROTO_UDP);
 	
 	return bOK ? nLength : -1;
 }
@@ -323,12 +335,20 @@ boolean CUDPConnection::IsTerminated (void) const
 {
 	return !m_bOpen;
 }
+
+boolean CUDPConnection::IsWildcard (void) const
+{
+	assert (m_pNetConfig != 0);
+	return    !m_bActiveOpen
+	       || m_ForeignIP.IsBroadcast ()
+	       || m_ForeignIP == *m_pNetConfig->GetBroadcastAddress ();
+}
 	
 void CUDPConnection::Process (void)
 {
 }
 
-int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
+int CUDPConnection::PacketReceived (CNetBuffer *pNetBuffer,
 				    CIPAddress &rSenderIP, CIPAddress &rReceiverIP, int nProtocol)
 {
 	if (nProtocol != IPPROTO_UDP)
@@ -336,6 +356,10 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return 0;
 	}
 
+	assert (pNetBuffer != 0);
+	const void *pPacket = pNetBuffer->GetData ();
+	unsigned nLength = pNetBuffer->GetLength ();
+
 	if (nLength <= sizeof (TUDPHeader))
 	{
 		return -1;
@@ -370,7 +394,8 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return -1;
 	}
 	
-	if (pHeader->nChecksum != UDP_CHECKSUM_NONE)
+	if (   pHeader->nChecksum != UDP_CHECKSUM_NONE
+	    && !pNetBuffer->IsChecksumVerified ())
 	{
 		m_Checksum.SetSourceAddress (rSenderIP);
 		m_Checksum.SetDestinationAddress (rReceiverIP);
@@ -388,15 +413,16 @@ int CUDPConnection::PacketReceived (const void *pPacket, unsigned nLength,
 		return 1;
 	}
 
-	nLength -= sizeof (TUDPHeader);
-	assert (nLength > 0);
-
 	TUDPPrivateData *pData = new TUDPPrivateData;
 	assert (pData != 0);
 	rSenderIP.CopyTo (pData->SourceAddress);
 	pData->nSourcePort = nSourcePort;
 
-	m_RxQueue.Enqueue ((u8 *) pPacket + sizeof (TUDPHeader), nLength, pData);
+	pNetBuffer->Pull (sizeof (TUDPHeader));
+	assert (pNetBuffer->GetLength () > 0);
+
+	pNetBuffer->AddRef ();
+	m_RxQueue.Enqueue (pNetBuffer, pData);
 
 	m_Event.Set ();
 
@@ -2,7 +2,7 @@
 // pageallocator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,20 +18,41 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/pageallocator.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
 #include <circle/logger.h>
 #include <assert.h>
 
-#define PAGE_MASK	(PAGE_SIZE-1)
+// The page allocator is a binary buddy allocator. A block of order n consists
+// of 2^n pages and starts at a page number, which is a multiple of 2^n, so that
+// it is naturally aligned to its size. Free blocks of each order are kept on a
+// doubly linked list, which is stored in the first page of the block itself.
 
 CPageAllocator::CPageAllocator (void)
-:	m_pNext (0),
-	m_pLimit (0),
+:	m_nFirstPage (0),
+	m_nEndPage (0),
+	m_nFreePages (0)
 #ifdef PAGE_DEBUG
-	m_nCount (0),
-	m_nMaxCount (0),
+	, m_nCount (0),
+	m_nMaxCount (0)
 #endif
-	m_pFreeList (0)
 {
+	for (unsigned nOrder = 0; nOrder <= PAGE_MAX_ORDER; nOrder++)
+	{
+		m_pFreeList[nOrder] = 0;
+	}
+
+	for (unsigned i = 0; i < PAGE_MAX_PAGES; i++)
+	{
+		m_PageState[i] = 0;
+	}
+
+#ifdef PAGE_CORE_CACHE
+	for (unsigned i = 0; i < CORES; i++)
+	{
+		m_CoreCache[i].nCount = 0;
+	}
+#endif
 }
 
 CPageAllocator::~CPageAllocator (void)
@@ -40,52 +61,86 @@ CPageAllocator::~CPageAllocator (void)
 
 void CPageAllocator::Setup (uintptr nBase, size_t nSize)
 {
-	m_pNext = (u8 *) ((nBase + PAGE_SIZE-1) & ~PAGE_MASK);
-	m_pLimit = (u8 *) ((nBase + nSize) & ~PAGE_MASK);
+	m_nFirstPage = (nBase + PAGE_SIZE-1) / PAGE_SIZE;
+	m_nEndPage = (nBase + nSize) / PAGE_SIZE;
+	assert (m_nEndPage - m_nFirstPage <= PAGE_MAX_PAGES);
+
+	// split the region into the largest naturally aligned blocks
+	uintptr nPage = m_nFirstPage;
+	while (nPage < m_nEndPage)
+	{
+		unsigned nOrder = PAGE_MAX_ORDER;
+		while (   nOrder > 0
+		       && (   (nPage & ((1UL << nOrder)-1)) != 0
+			   || nPage + (1UL << nOrder) > m_nEndPage))
+		{
+			nOrder--;
+		}
+
+		InsertFree (nPage, nOrder);
+
+		m_nFreePages += 1UL << nOrder;
+		nPage += 1UL << nOrder;
+	}
 }
 
 size_t CPageAllocator::GetFreeSpace (void) const
 {
-	return m_pLimit - m_pNext;
+	return m_nFreePages * PAGE_SIZE;
 }
 
 void *CPageAllocator::Allocate (void)
 {
-	assert (m_pNext != 0);
-
-	m_SpinLock.Acquire ();
+	assert (m_nEndPage != 0);
 
-#ifdef PAGE_DEBUG
-	if (++m_nCount > m_nMaxCount)
+#ifdef PAGE_CORE_CACHE
+	void *pPage = CacheAllocate ();
+	if (pPage != 0)
 	{
-		m_nMaxCount = m_nCount;
+		return pPage;
 	}
 #endif
 
-	TFreePage *pFreePage;
-	if ((pFreePage = m_pFreeList) != 0)
+	m_SpinLock.Acquire ();
+
+	void *pResult = AllocateBlock (0);
+
+	m_SpinLock.Release ();
+
+	return pResult;		// TODO: system should panic on 0
+}
+
+void *CPageAllocator::Allocate (size_t nSize, size_t nAlign)
+{
+	assert (m_nEndPage != 0);
+	assert ((nAlign & (nAlign-1)) == 0);
+
+	if (nAlign > nSize)
 	{
-		assert (pFreePage->nMagic == FREEPAGE_MAGIC);
-		m_pFreeList = pFreePage->pNext;
-		pFreePage->nMagic = 0;
+		nSize = nAlign;		// blocks are aligned to their size
 	}
-	else
-	{
-		pFreePage = (TFreePage *) m_pNext;
-
-		m_pNext += PAGE_SIZE;
 
-		if (m_pNext > m_pLimit)
+	unsigned nOrder = 0;
+	while ((size_t) PAGE_SIZE << nOrder < nSize)
+	{
+		if (++nOrder > PAGE_MAX_ORDER)
 		{
-			m_SpinLock.Release ();
-
-			return 0;		// TODO: system should panic here
+			return 0;
 		}
 	}
 
+	if (nOrder == 0)
+	{
+		return Allocate ();
+	}
+
+	m_SpinLock.Acquire ();
+
+	void *pResult = AllocateBlock (nOrder);
+
 	m_SpinLock.Release ();
 
-	return pFreePage;
+	return pResult;
 }
 
 void CPageAllocator::Free (void *pPage)
@@ -95,22 +150,227 @@ void CPageAllocator::Free (void *pPage)
 		return;
 	}
 
-	TFreePage *pFreePage = (TFreePage *) pPage;
+	uintptr nPageNumber = (uintptr) pPage / PAGE_SIZE;
+	assert ((uintptr) pPage % PAGE_SIZE == 0);
+	assert (m_nFirstPage <= nPageNumber && nPageNumber < m_nEndPage);
+	assert (   (State (nPageNumber) & (PAGE_STATE_HEAD | PAGE_STATE_FREE | PAGE_STATE_CACHED))
+		== PAGE_STATE_HEAD);
+
+#ifdef PAGE_CORE_CACHE
+	if ((State (nPageNumber) & PAGE_STATE_ORDER_MASK) == 0)
+	{
+		CacheFree (pPage);
+
+		return;
+	}
+#endif
 
 	m_SpinLock.Acquire ();
 
-	pFreePage->nMagic = FREEPAGE_MAGIC;
+	FreeBlock (nPageNumber);
 
-	pFreePage->pNext = m_pFreeList;
-	m_pFreeList = pFreePage;
+	m_SpinLock.Release ();
+}
+
+// Must be called with the spin lock acquired
+void *CPageAllocator::AllocateBlock (unsigned nOrder)
+{
+	assert (nOrder <= PAGE_MAX_ORDER);
+
+	// find the smallest free block, which is big enough
+	unsigned nBlockOrder = nOrder;
+	while (m_pFreeList[nBlockOrder] == 0)
+	{
+		if (++nBlockOrder > PAGE_MAX_ORDER)
+		{
+			return 0;
+		}
+	}
+
+	TFreePage *pFreePage = m_pFreeList[nBlockOrder];
+	assert (pFreePage->nMagic == FREEPAGE_MAGIC);
+	uintptr nPageNumber = (uintptr) pFreePage / PAGE_SIZE;
+
+	RemoveFree (nPageNumber, nBlockOrder);
+
+	// split the block and put the upper halves on the free lists
+	while (nBlockOrder > nOrder)
+	{
+		nBlockOrder--;
+
+		InsertFree (nPageNumber + (1UL << nBlockOrder), nBlockOrder);
+	}
+
+	State (nPageNumber) = PAGE_STATE_HEAD | nOrder;
+	pFreePage->nMagic = 0;
+
+	m_nFreePages -= 1UL << nOrder;
 
 #ifdef PAGE_DEBUG
-	m_nCount--;
+	if ((m_nCount += 1U << nOrder) > m_nMaxCount)
+	{
+		m_nMaxCount = m_nCount;
+	}
 #endif
 
-	m_SpinLock.Release ();
+	return pFreePage;
 }
 
+// Must be called with the spin lock acquired
+void CPageAllocator::FreeBlock (uintptr nPageNumber)
+{
+	unsigned nOrder = State (nPageNumber) & PAGE_STATE_ORDER_MASK;
+	assert (nOrder <= PAGE_MAX_ORDER);
+
+	State (nPageNumber) = 0;
+
+	m_nFreePages += 1UL << nOrder;
+
+#ifdef PAGE_DEBUG
+	m_nCount -= 1U << nOrder;
+#endif
+
+	// merge with the buddy block, as long as it is free and has the same order
+	while (nOrder < PAGE_MAX_ORDER)
+	{
+		uintptr nBuddy = nPageNumber ^ (1UL << nOrder);
+		if (   nBuddy < m_nFirstPage
+		    || nBuddy + (1UL << nOrder) > m_nEndPage
+		    || State (nBuddy) != (PAGE_STATE_FREE | PAGE_STATE_HEAD | nOrder))
+		{
+			break;
+		}
+
+		RemoveFree (nBuddy, nOrder);
+
+		if (nBuddy < nPageNumber)
+		{
+			nPageNumber = nBuddy;
+		}
+
+		nOrder++;
+	}
+
+	InsertFree (nPageNumber, nOrder);
+}
+
+void CPageAllocator::InsertFree (uintptr nPageNumber, unsigned nOrder)
+{
+	TFreePage *pFreePage = GetPage (nPageNumber);
+
+	pFreePage->nMagic = FREEPAGE_MAGIC;
+	pFreePage->pPrev = 0;
+	pFreePage->pNext = m_pFreeList[nOrder];
+	if (pFreePage->pNext != 0)
+	{
+		pFreePage->pNext->pPrev = pFreePage;
+	}
+	m_pFreeList[nOrder] = pFreePage;
+
+	State (nPageNumber) = PAGE_STATE_FREE | PAGE_STATE_HEAD | nOrder;
+}
+
+void CPageAllocator::RemoveFree (uintptr nPageNumber, unsigned nOrder)
+{
+	TFreePage *pFreePage = GetPage (nPageNumber);
+	assert (pFreePage->nMagic == FREEPAGE_MAGIC);
+
+	if (pFreePage->pPrev != 0)
+	{
+		pFreePage->pPrev->pNext = pFreePage->pNext;
+	}
+	else
+	{
+		assert (m_pFreeList[nOrder] == pFreePage);
+		m_pFreeList[nOrder] = pFreePage->pNext;
+	}
+
+	if (pFreePage->pNext != 0)
+	{
+		pFreePage->pNext->pPrev = pFreePage->pPrev;
+	}
+
+	State (nPageNumber) = 0;
+}
+
+#ifdef PAGE_CORE_CACHE
+
+// The cache of a core is only accessed from this core. Disabling the IRQs
+// locally is sufficient to protect it against concurrent use from an IRQ
+// handler. The global spin lock is only taken to refill or drain a cache.
+// Cached pages remain allocated from the view of the buddy allocator, but are
+// marked with PAGE_STATE_CACHED, so that a double free of such a page is detected.
+
+void *CPageAllocator::CacheAllocate (void)
+{
+	EnterCritical (IRQ_LEVEL);
+
+	TPageCoreCache *pCache = &m_CoreCache[CMultiCoreSupport::ThisCore ()];
+
+	if (pCache->nCount == 0)
+	{
+		// refill the cache with half of its capacity
+		m_SpinLock.Acquire ();
+
+		void *pPage;
+		while (   pCache->nCount < PAGE_CORE_CACHE_PAGES / 2
+		       && (pPage = AllocateBlock (0)) != 0)
+		{
+			State ((uintptr) pPage / PAGE_SIZE) |= PAGE_STATE_CACHED;
+
+			pCache->pPage[pCache->nCount++] = pPage;
+		}
+
+		m_SpinLock.Release ();
+
+		if (pCache->nCount == 0)
+		{
+			LeaveCritical ();
+
+			return 0;
+		}
+	}
+
+	void *pResult = pCache->pPage[--pCache->nCount];
+
+	assert (State ((uintptr) pResult / PAGE_SIZE) == (PAGE_STATE_CACHED | PAGE_STATE_HEAD));
+	State ((uintptr) pResult / PAGE_SIZE) = PAGE_STATE_HEAD;
+
+	LeaveCritical ();
+
+	return pResult;
+}
+
+void CPageAllocator::CacheFree (void *pPage)
+{
+	assert (pPage != 0);
+
+	EnterCritical (IRQ_LEVEL);
+
+	TPageCoreCache *pCache = &m_CoreCache[CMultiCoreSupport::ThisCore ()];
+
+	if (pCache->nCount >= PAGE_CORE_CACHE_PAGES)
+	{
+		// drain half of the cache to the buddy allocator
+		m_SpinLock.Acquire ();
+
+		while (pCache->nCount > PAGE_CORE_CACHE_PAGES / 2)
+		{
+			FreeBlock ((uintptr) pCache->pPage[--pCache->nCount] / PAGE_SIZE);
+		}
+
+		m_SpinLock.Release ();
+	}
+
+	State ((uintptr) pPage / PAGE_SIZE) |= PAGE_STATE_CACHED;
+
+	pCache->pPage[pCache->nCount++] = pPage;
+
+	LeaveCritical ();
+}
+
+#endif
+
 #ifdef PAGE_DEBUG
 
 void CPageAllocator::DumpStatus (void)
@@ -0,0 +1,387 @@
+//
+// perfmon.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/perfmon.h>
+#include <circle/synchronize.h>
+#include <assert.h>
+
+#define EVENT_UNSUPPORTED	0xFFFF
+
+#if RASPPI == 1
+
+// ARM1176 performance monitor control register (PMNC)
+#define PMNC_E			(1 << 0)	// enable all counters
+#define PMNC_P			(1 << 1)	// reset count registers
+#define PMNC_C			(1 << 2)	// reset cycle counter
+#define PMNC_INT_PMN0		(1 << 4)
+#define PMNC_INT_PMN1		(1 << 5)
+#define PMNC_INT_CCNT		(1 << 6)
+#define PMNC_FLAG_PMN0		(1 << 8)	// write 1 to clear
+#define PMNC_FLAG_PMN1		(1 << 9)
+#define PMNC_FLAG_CCNT		(1 << 10)
+#define PMNC_FLAGS		(PMNC_FLAG_PMN0 | PMNC_FLAG_PMN1 | PMNC_FLAG_CCNT)
+#define PMNC_EVT_COUNT1__SHIFT	12
+#define PMNC_EVT_COUNT0__SHIFT	20
+#define PMNC_EVT_COUNT__MASK	0xFF
+
+#define PMU_EVENT_COUNTERS	2
+
+const unsigned CPerformanceMonitor::s_EventNumber[PerfEventUnknown] =
+{
+	0x07,			// PerfEventInstructions
+	0x09,			// PerfEventL1DCacheAccess
+	0x0B,			// PerfEventL1DCacheMiss
+	0x00,			// PerfEventL1ICacheMiss
+	EVENT_UNSUPPORTED,	// PerfEventL2CacheMiss
+	0x05,			// PerfEventBranches
+	0x06,			// PerfEventBranchMiss
+	EVENT_UNSUPPORTED	// PerfEventCPUCycles
+};
+
+static inline u32 ReadPMNC (void)
+{
+	u32 nValue;
+	asm volatile ("mrc p15, 0, %0, c15, c12, 0" : "=r" (nValue));
+
+	return nValue;
+}
+
+static inline void WritePMNC (u32 nValue)
+{
+	asm volatile ("mcr p15, 0, %0, c15, c12, 0" :: "r" (nValue));
+}
+
+#else
+
+// ARMv7/ARMv8 performance monitors control register (PMCR)
+#define PMCR_E			(1 << 0)	// enable all counters
+#define PMCR_P			(1 << 1)	// reset event counters
+#define PMCR_C			(1 << 2)	// reset cycle counter
+#define PMCR_N__SHIFT		11
+#define PMCR_N__MASK		0x1F
+
+#define CYCLE_COUNTER_MASK	(1U << PERF_CYCLE_COUNTER)
+
+// common architectural events
+const unsigned CPerformanceMonitor::s_EventNumber[PerfEventUnknown] =
+{
+	0x08,			// PerfEventInstructions (INST_RETIRED)
+	0x04,			// PerfEventL1DCacheAccess (L1D_CACHE)
+	0x03,			// PerfEventL1DCacheMiss (L1D_CACHE_REFILL)
+	0x01,			// PerfEventL1ICacheMiss (L1I_CACHE_REFILL)
+	0x17,			// PerfEventL2CacheMiss (L2D_CACHE_REFILL)
+	0x12,			// PerfEventBranches (BR_PRED)
+	0x10,			// PerfEventBranchMiss (BR_MIS_PRED)
+	0x11			// PerfEventCPUCycles (CPU_CYCLES)
+};
+
+#if AARCH == 32
+
+// CRm and opc2 of the PMU registers (CRn is c9)
+#define PMCR		"c12, 0"
+#define PMCNTENSET	"c12, 1"
+#define PMCNTENCLR	"c12, 2"
+#define PMOVSR		"c12, 3"
+#define PMSELR		"c12, 5"
+#define PMCCNTR		"c13, 0"
+#define PMXEVTYPER	"c13, 1"
+#define PMXEVCNTR	"c13, 2"
+#define PMINTENSET	"c14, 1"
+#define PMINTENCLR	"c14, 2"
+
+#define READ_REG(reg, value)	asm volatile ("mrc p15, 0, %0, c9, " reg : "=r" (value))
+#define WRITE_REG(reg, value)	asm volatile ("mcr p15, 0, %0, c9, " reg :: "r" ((u32) (value)))
+
+#else
+
+#define PMCR		"PMCR_EL0"
+#define PMCNTENSET	"PMCNTENSET_EL0"
+#define PMCNTENCLR	"PMCNTENCLR_EL0"
+#define PMOVSR		"PMOVSCLR_EL0"
+#define PMSELR		"PMSELR_EL0"
+#define PMCCNTR		"PMCCNTR_EL0"
+#define PMXEVTYPER	"PMXEVTYPER_EL0"
+#define PMXEVCNTR	"PMXEVCNTR_EL0"
+#define PMINTENSET	"PMINTENSET_EL1"
+#define PMINTENCLR	"PMINTENCLR_EL1"
+
+#define READ_REG(reg, value)	asm volatile ("mrs %0, " reg : "=r" (value))
+#define WRITE_REG(reg, value)	asm volatile ("msr " reg ", %0" :: "r" ((u64) (value)))
+
+#endif
+
+#endif
+
+CPerformanceMonitor::CPerformanceMonitor (void)
+:	m_nEventCounters (0)
+{
+}
+
+CPerformanceMonitor::~CPerformanceMonitor (void)
+{
+}
+
+void CPerformanceMonitor::Initialize (void)
+{
+#if RASPPI == 1
+	WritePMNC (PMNC_P | PMNC_C | PMNC_FLAGS);	// disabled, interrupts off
+
+	m_nEventCounters = PMU_EVENT_COUNTERS;
+#else
+	uintptr nPMCR;
+	READ_REG (PMCR, nPMCR);
+
+	m_nEventCounters = (nPMCR >> PMCR_N__SHIFT) & PMCR_N__MASK;
+
+	u32 nAllCounters = CYCLE_COUNTER_MASK | ((1U << m_nEventCounters) - 1);
+	WRITE_REG (PMCNTENCLR, nAllCounters);
+	WRITE_REG (PMINTENCLR, nAllCounters);
+	WRITE_REG (PMOVSR, nAllCounters);
+
+	// the cycle counter overflows after 32 bits on AArch64 too (PMCR.LC = 0)
+	WRITE_REG (PMCR, PMCR_E | PMCR_P | PMCR_C);
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+unsigned CPerformanceMonitor::GetEventCounters (void) const
+{
+	return m_nEventCounters;
+}
+
+boolean CPerformanceMonitor::SetEvent (unsigned nCounter, TPerfEvent Event)
+{
+	assert (Event < PerfEventUnknown);
+	unsigned nEventNumber = s_EventNumber[Event];
+	if (nEventNumber == EVENT_UNSUPPORTED)
+	{
+		return FALSE;
+	}
+
+	SetRawEvent (nCounter, nEventNumber);
+
+	return TRUE;
+}
+
+void CPerformanceMonitor::SetRawEvent (unsigned nCounter, unsigned nEventNumber)
+{
+	assert (nCounter < m_nEventCounters);
+
+#if RASPPI == 1
+	unsigned nShift = nCounter == 0 ? PMNC_EVT_COUNT0__SHIFT : PMNC_EVT_COUNT1__SHIFT;
+
+	u32 nPMNC = ReadPMNC () & ~PMNC_FLAGS;
+	nPMNC &= ~(PMNC_EVT_COUNT__MASK << nShift);
+	nPMNC |= (nEventNumber & PMNC_EVT_COUNT__MASK) << nShift;
+	WritePMNC (nPMNC);
+#else
+	WRITE_REG (PMSELR, nCounter);
+	InstructionSyncBarrier ();
+	WRITE_REG (PMXEVTYPER, nEventNumber);	// count in all modes
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+void CPerformanceMonitor::Start (void)
+{
+#if RASPPI == 1
+	WritePMNC ((ReadPMNC () & ~PMNC_FLAGS) | PMNC_E);
+#else
+	WRITE_REG (PMCNTENSET, CYCLE_COUNTER_MASK | ((1U << m_nEventCounters) - 1));
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+void CPerformanceMonitor::Stop (void)
+{
+#if RASPPI == 1
+	WritePMNC (ReadPMNC () & ~(PMNC_FLAGS | PMNC_E));
+#else
+	WRITE_REG (PMCNTENCLR, CYCLE_COUNTER_MASK | ((1U << m_nEventCounters) - 1));
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+void CPerformanceMonitor::Reset (void)
+{
+#if RASPPI == 1
+	WritePMNC (ReadPMNC () | PMNC_P | PMNC_C | PMNC_FLAGS);
+#else
+	uintptr nPMCR;
+	READ_REG (PMCR, nPMCR);
+	WRITE_REG (PMCR, nPMCR | PMCR_P | PMCR_C);
+
+	WRITE_REG (PMOVSR, CYCLE_COUNTER_MASK | ((1U << m_nEventCounters) - 1));
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+u64 CPerformanceMonitor::GetCycleCount (void) const
+{
+#if RASPPI == 1
+	u32 nCCNT;
+	asm volatile ("mrc p15, 0, %0, c15, c12, 1" : "=r" (nCCNT));
+
+	return nCCNT;
+#else
+	uintptr nPMCCNTR;
+	READ_REG (PMCCNTR, nPMCCNTR);
+
+	return nPMCCNTR;
+#endif
+}
+
+u32 CPerformanceMonitor::GetEventCount (unsigned nCounter) const
+{
+	u32 nValue;
+
+#if RASPPI == 1
+	switch (nCounter)
+	{
+	case 0:
+		asm volatile ("mrc p15, 0, %0, c15, c12, 2" : "=r" (nValue));
+		break;
+
+	case 1:
+		asm volatile ("mrc p15, 0, %0, c15, c12, 3" : "=r" (nValue));
+		break;
+
+	default:
+		assert (nCounter == PERF_CYCLE_COUNTER);
+		asm volatile ("mrc p15, 0, %0, c15, c12, 1" : "=r" (nValue));
+		break;
+	}
+#else
+	uintptr nRegValue;
+
+	if (nCounter == PERF_CYCLE_COUNTER)
+	{
+		READ_REG (PMCCNTR, nRegValue);
+	}
+	else
+	{
+		assert (nCounter < m_nEventCounters);
+
+		WRITE_REG (PMSELR, nCounter);
+		InstructionSyncBarrier ();
+		READ_REG (PMXEVCNTR, nRegValue);
+	}
+
+	nValue = (u32) nRegValue;
+#endif
+
+	return nValue;
+}
+
+void CPerformanceMonitor::SetEventCount (unsigned nCounter, u32 nValue)
+{
+#if RASPPI == 1
+	switch (nCounter)
+	{
+	case 0:
+		asm volatile ("mcr p15, 0, %0, c15, c12, 2" :: "r" (nValue));
+		break;
+
+	case 1:
+		asm volatile ("mcr p15, 0, %0, c15, c12, 3" :: "r" (nValue));
+		break;
+
+	default:
+		assert (nCounter == PERF_CYCLE_COUNTER);
+		asm volatile ("mcr p15, 0, %0, c15, c12, 1" :: "r" (nValue));
+		break;
+	}
+#else
+	if (nCounter == PERF_CYCLE_COUNTER)
+	{
+		WRITE_REG (PMCCNTR, nValue);
+	}
+	else
+	{
+		assert (nCounter < m_nEventCounters);
+
+		WRITE_REG (PMSELR, nCounter);
+		InstructionSyncBarrier ();
+		WRITE_REG (PMXEVCNTR, nValue);
+	}
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+void CPerformanceMonitor::EnableOverflowInterrupt (unsigned nCounter, boolean bEnable)
+{
+#if RASPPI == 1
+	u32 nMask =   nCounter == 0 ? PMNC_INT_PMN0
+		    : nCounter == 1 ? PMNC_INT_PMN1 : PMNC_INT_CCNT;
+	assert (nCounter < PMU_EVENT_COUNTERS || nCounter == PERF_CYCLE_COUNTER);
+
+	u32 nPMNC = ReadPMNC () & ~PMNC_FLAGS;
+	WritePMNC (bEnable ? nPMNC | nMask : nPMNC & ~nMask);
+#else
+	assert (nCounter < m_nEventCounters || nCounter == PERF_CYCLE_COUNTER);
+
+	if (bEnable)
+	{
+		WRITE_REG (PMINTENSET, 1U << nCounter);
+	}
+	else
+	{
+		WRITE_REG (PMINTENCLR, 1U << nCounter);
+	}
+#endif
+
+	InstructionSyncBarrier ();
+}
+
+u32 CPerformanceMonitor::GetOverflowStatus (void) const
+{
+#if RASPPI == 1
+	u32 nPMNC = ReadPMNC ();
+
+	return   (nPMNC & PMNC_FLAG_PMN0 ? 1 << 0 : 0)
+	       | (nPMNC & PMNC_FLAG_PMN1 ? 1 << 1 : 0)
+	       | (nPMNC & PMNC_FLAG_CCNT ? 1U << PERF_CYCLE_COUNTER : 0);
+#else
+	uintptr nPMOVSR;
+	READ_REG (PMOVSR, nPMOVSR);
+
+	return (u32) nPMOVSR;
+#endif
+}
+
+void CPerformanceMonitor::ClearOverflowStatus (u32 nMask)
+{
+#if RASPPI == 1
+	u32 nPMNC = ReadPMNC () & ~PMNC_FLAGS;
+	nPMNC |=   (nMask & (1 << 0) ? PMNC_FLAG_PMN0 : 0)
+		 | (nMask & (1 << 1) ? PMNC_FLAG_PMN1 : 0)
+		 | (nMask & (1U << PERF_CYCLE_COUNTER) ? PMNC_FLAG_CCNT : 0);
+	WritePMNC (nPMNC);
+#else
+	WRITE_REG (PMOVSR, nMask);
+#endif
+
+	InstructionSyncBarrier ();
+}
@@ -0,0 +1,299 @@
+//
+// sampleprofiler.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sampleprofiler.h>
+#include <circle/exceptionstub.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define THIS_CORE()	CMultiCoreSupport::ThisCore ()
+#else
+	#define THIS_CORE()	0
+#endif
+
+CSampleProfiler::CSampleProfiler (CInterruptSystem *pInterruptSystem, TSampleSource Source,
+				  unsigned nGranularityShift, uintptr nTextStart, uintptr nTextEnd)
+:	m_pInterruptSystem (pInterruptSystem),
+	m_Source (Source),
+	m_nGranularityShift (nGranularityShift),
+	m_nTextStart (nTextStart),
+	m_nTextEnd (nTextEnd),
+	m_nPeriod (0),
+	m_nCounter (0),
+	m_nCoresConnected (0),
+	m_hTimer (0)
+{
+	assert (m_Source < SampleSourceUnknown);
+	assert (m_nTextStart < m_nTextEnd);
+
+	m_nBuckets = ((m_nTextEnd - m_nTextStart) >> m_nGranularityShift) + 1;
+
+	for (unsigned nCore = 0; nCore < CORES; nCore++)
+	{
+		m_pHistogram[nCore] = 0;
+		m_bActive[nCore] = FALSE;
+		m_nSamples[nCore] = 0;
+		m_nMissed[nCore] = 0;
+	}
+}
+
+CSampleProfiler::~CSampleProfiler (void)
+{
+	if (m_bActive[THIS_CORE ()])
+	{
+		Stop ();
+	}
+
+	for (unsigned nCore = 0; nCore < CORES; nCore++)
+	{
+		assert (!m_bActive[nCore]);
+
+		delete [] m_pHistogram[nCore];
+		m_pHistogram[nCore] = 0;
+	}
+
+	m_pInterruptSystem = 0;
+}
+
+boolean CSampleProfiler::Start (unsigned nPeriod)
+{
+	unsigned nCore = THIS_CORE ();
+	assert (!m_bActive[nCore]);
+	assert (nPeriod > 0);
+
+	if (m_pHistogram[nCore] == 0)
+	{
+		m_pHistogram[nCore] = new u32[m_nBuckets];
+		if (m_pHistogram[nCore] == 0)
+		{
+			return FALSE;
+		}
+
+		memset (m_pHistogram[nCore], 0, m_nBuckets * sizeof (u32));
+	}
+
+	m_nPeriod = nPeriod;
+
+	if (m_Source == SampleSourceTimer)
+	{
+		// the timer interrupt is handled on core 0 only
+		if (nCore != 0)
+		{
+			return FALSE;
+		}
+
+		m_bActive[0] = TRUE;
+
+		m_hTimer = CTimer::Get ()->StartHighResTimer (m_nPeriod, TimerHandler, this);
+
+		return TRUE;
+	}
+
+	assert (m_Source == SampleSourcePMU);
+
+#if RASPPI == 1
+	return FALSE;		// the PMU interrupt is not connected
+#else
+	m_PMU.Initialize ();
+	if (m_PMU.GetEventCounters () == 0)
+	{
+		return FALSE;
+	}
+
+	m_nCounter = m_PMU.GetEventCounters () - 1;
+	m_PMU.SetEvent (m_nCounter, PerfEventCPUCycles);
+	m_PMU.SetEventCount (m_nCounter, -m_nPeriod);
+	m_PMU.EnableOverflowInterrupt (m_nCounter);
+
+	m_bActive[nCore] = TRUE;
+
+	assert (m_pInterruptSystem != 0);
+#if RASPPI >= 4
+	m_pInterruptSystem->ConnectIRQ (ARM_IRQ_PMU0 + nCore, PMUInterruptStub, this);
+#else
+	// all cores share one local IRQ number, EnableIRQ() enables it for the calling core
+	m_SpinLock.Acquire ();
+
+	if (m_nCoresConnected++ == 0)
+	{
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQLOCAL0_PMU, PMUInterruptStub, this);
+	}
+	else
+	{
+		CInterruptSystem::EnableIRQ (ARM_IRQLOCAL0_PMU);
+	}
+
+	m_SpinLock.Release ();
+#endif
+
+	m_PMU.Start ();
+
+	return TRUE;
+#endif
+}
+
+void CSampleProfiler::Stop (void)
+{
+	unsigned nCore = THIS_CORE ();
+	assert (m_bActive[nCore]);
+
+	if (m_Source == SampleSourceTimer)
+	{
+		// prevent the timer handler from running in between
+		EnterCritical (IRQ_LEVEL);
+
+		m_bActive[0] = FALSE;
+
+		CTimer::Get ()->CancelKernelTimer (m_hTimer);
+		m_hTimer = 0;
+
+		LeaveCritical ();
+
+		return;
+	}
+
+#if RASPPI >= 2
+	m_PMU.EnableOverflowInterrupt (m_nCounter, FALSE);
+	m_PMU.Stop ();
+
+	assert (m_pInterruptSystem != 0);
+#if RASPPI >= 4
+	m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_PMU0 + nCore);
+#else
+	m_SpinLock.Acquire ();
+
+	assert (m_nCoresConnected > 0);
+	if (--m_nCoresConnected == 0)
+	{
+		m_pInterruptSystem->DisconnectIRQ (ARM_IRQLOCAL0_PMU);
+	}
+	else
+	{
+		CInterruptSystem::DisableIRQ (ARM_IRQLOCAL0_PMU);
+	}
+
+	m_SpinLock.Release ();
+#endif
+
+	m_PMU.ClearOverflowStatus (1U << m_nCounter);
+#endif
+
+	m_bActive[nCore] = FALSE;
+}
+
+unsigned CSampleProfiler::GetSamples (unsigned nCore) const
+{
+	assert (nCore < CORES);
+	return m_nSamples[nCore];
+}
+
+unsigned CSampleProfiler::GetMissed (unsigned nCore) const
+{
+	assert (nCore < CORES);
+	return m_nMissed[nCore];
+}
+
+void CSampleProfiler::Dump (CDevice *pTarget)
+{
+	assert (pTarget != 0);
+
+	for (unsigned nCore = 0; nCore < CORES; nCore++)
+	{
+		u32 *pHistogram = m_pHistogram[nCore];
+		if (pHistogram == 0)
+		{
+			continue;
+		}
+
+		for (unsigned i = 0; i < m_nBuckets; i++)
+		{
+			if (pHistogram[i] == 0)
+			{
+				continue;
+			}
+
+			CString Line;
+			Line.Format ("core%u;0x%lx %u\n", nCore,
+				     (unsigned long) (m_nTextStart + (i << m_nGranularityShift)),
+				     pHistogram[i]);
+
+			pTarget->Write (Line, Line.GetLength ());
+		}
+	}
+}
+
+void CSampleProfiler::Sample (unsigned nCore)
+{
+	uintptr nPC = IRQReturnAddress[nCore];
+
+	if (   nPC >= m_nTextStart
+	    && nPC < m_nTextEnd)
+	{
+		assert (m_pHistogram[nCore] != 0);
+		m_pHistogram[nCore][(nPC - m_nTextStart) >> m_nGranularityShift]++;
+	}
+	else
+	{
+		m_nMissed[nCore]++;
+	}
+
+	m_nSamples[nCore]++;
+}
+
+void CSampleProfiler::PMUInterruptHandler (void)
+{
+	u32 nOverflow = m_PMU.GetOverflowStatus ();
+	m_PMU.ClearOverflowStatus (nOverflow);
+
+	unsigned nCore = THIS_CORE ();
+	if (   m_bActive[nCore]
+	    && (nOverflow & (1U << m_nCounter)))
+	{
+		m_PMU.SetEventCount (m_nCounter, -m_nPeriod);
+
+		Sample (nCore);
+	}
+}
+
+void CSampleProfiler::PMUInterruptStub (void *pParam)
+{
+	CSampleProfiler *pThis = (CSampleProfiler *) pParam;
+	assert (pThis != 0);
+
+	pThis->PMUInterruptHandler ();
+}
+
+void CSampleProfiler::TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext)
+{
+	CSampleProfiler *pThis = (CSampleProfiler *) pParam;
+	assert (pThis != 0);
+
+	if (!pThis->m_bActive[0])
+	{
+		return;
+	}
+
+	pThis->Sample (0);
+
+	pThis->m_hTimer = CTimer::Get ()->StartHighResTimer (pThis->m_nPeriod, TimerHandler, pThis);
+}
@@ -2,7 +2,7 @@
 // mutex.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This class was developed by:
 //	Brad Robinson <contact@toptensoftware.com>
@@ -25,10 +25,12 @@
 #include <circle/sched/task.h>
 #include <circle/synchronize.h>
 #include <circle/sysconfig.h>
+#include <circle/atomic.h>
 #include <assert.h>
 
 CMutex::CMutex (void)
-:   m_pOwningTask (0),
+:   m_nLocked (0),
+    m_pOwningTask (0),
     m_iReentrancyCount (0)
 {
 }
@@ -42,21 +44,22 @@ void CMutex::Acquire (void)
 {
     CTask* pTask = CScheduler::Get()->GetCurrentTask();
 
-    while (true)
+    // only this task can have set the owner to itself
+    if (m_pOwningTask == pTask)
     {
-        if (m_pOwningTask == nullptr)
-        {
-            m_pOwningTask = pTask;
-            m_iReentrancyCount = 1;
-            return;
-        }
-        else if (m_pOwningTask == pTask)
-        {
-            m_iReentrancyCount++;
-            return;
-        }
-        m_event.Wait();
+        m_iReentrancyCount++;
+        return;
     }
+
+    // the lock flag is taken atomically, because the mutex may be
+    // contended by tasks, which run on different cores
+    while (AtomicCompareExchange(&m_nLocked, 0, 1) != 0)
+    {
+        m_event.WaitUnless(IsReleased, this);
+    }
+
+    m_pOwningTask = pTask;
+    m_iReentrancyCount = 1;
 }
 
 void CMutex::Release (void)
@@ -66,7 +69,16 @@ void CMutex::Release (void)
     if (m_iReentrancyCount == 0)
     {
         m_pOwningTask = 0;
+        AtomicSet(&m_nLocked, 0);
         m_event.Pulse();
         CScheduler::Get()->Yield();
     }
 }
+
+boolean CMutex::IsReleased (void *pParam)
+{
+    CMutex* pThis = (CMutex*) pParam;
+    assert(pThis != 0);
+
+    return AtomicGet(&pThis->m_nLocked) == 0;
+}
@@ -0,0 +1,148 @@
+//
+// readyqueue.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sched/readyqueue.h>
+#include <assert.h>
+
+CReadyQueue::CReadyQueue (void)
+:	m_nBitmap (0)
+{
+	for (unsigned i = 0; i < TASK_PRIORITIES; i++)
+	{
+		m_pHead[i] = 0;
+		m_pTail[i] = 0;
+	}
+}
+
+CReadyQueue::~CReadyQueue (void)
+{
+	assert (m_nBitmap == 0);
+}
+
+void CReadyQueue::Enqueue (CTask *pTask)
+{
+	assert (pTask != 0);
+
+	if (pTask->m_bQueued)
+	{
+		return;
+	}
+
+	unsigned nPriority = pTask->GetPriority ();
+	assert (nPriority < TASK_PRIORITIES);
+
+	pTask->m_pQueueNext = 0;
+	pTask->m_nQueuePriority = nPriority;
+	pTask->m_bQueued = TRUE;
+
+	if (m_pTail[nPriority] != 0)
+	{
+		m_pTail[nPriority]->m_pQueueNext = pTask;
+	}
+	else
+	{
+		m_pHead[nPriority] = pTask;
+		m_nBitmap |= 1U << nPriority;
+	}
+
+	m_pTail[nPriority] = pTask;
+}
+
+CTask *CReadyQueue::Dequeue (void)
+{
+	if (m_nBitmap == 0)
+	{
+		return 0;
+	}
+
+	unsigned nPriority = 31 - __builtin_clz (m_nBitmap);
+	assert (nPriority < TASK_PRIORITIES);
+
+	CTask *pTask = m_pHead[nPriority];
+	assert (pTask != 0);
+	assert (pTask->m_bQueued);
+	assert (pTask->m_nQueuePriority == nPriority);
+
+	m_pHead[nPriority] = pTask->m_pQueueNext;
+	if (m_pHead[nPriority] == 0)
+	{
+		m_pTail[nPriority] = 0;
+		m_nBitmap &= ~(1U << nPriority);
+	}
+
+	pTask->m_pQueueNext = 0;
+	pTask->m_bQueued = FALSE;
+
+	return pTask;
+}
+
+#ifdef SCHED_MULTI_CORE
+
+CTask *CReadyQueue::Dequeue (CTask *pCurrent, boolean bMigratableOnly)
+{
+	u32 nBitmap = m_nBitmap;
+	while (nBitmap != 0)
+	{
+		unsigned nPriority = 31 - __builtin_clz (nBitmap);
+		assert (nPriority < TASK_PRIORITIES);
+		nBitmap &= ~(1U << nPriority);
+
+		CTask *pPrev = 0;
+		for (CTask *pTask = m_pHead[nPriority]; pTask != 0; pTask = pTask->m_pQueueNext)
+		{
+			assert (pTask->m_bQueued);
+
+			if (   (pTask->m_bOnCPU && pTask != pCurrent)
+			    || (bMigratableOnly && pTask->m_nAffinity != TASK_AFFINITY_ANY))
+			{
+				pPrev = pTask;
+
+				continue;
+			}
+
+			if (pPrev != 0)
+			{
+				pPrev->m_pQueueNext = pTask->m_pQueueNext;
+			}
+			else
+			{
+				m_pHead[nPriority] = pTask->m_pQueueNext;
+			}
+
+			if (m_pTail[nPriority] == pTask)
+			{
+				m_pTail[nPriority] = pPrev;
+			}
+
+			if (m_pHead[nPriority] == 0)
+			{
+				m_nBitmap &= ~(1U << nPriority);
+			}
+
+			pTask->m_pQueueNext = 0;
+			pTask->m_bQueued = FALSE;
+
+			return pTask;
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -2,7 +2,7 @@
 // scheduler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #include <circle/timer.h>
 #include <circle/logger.h>
 #include <circle/string.h>
+#include <circle/synchronize.h>
 #include <circle/util.h>
 #include <assert.h>
 
@@ -29,9 +30,16 @@ static const char FromScheduler[] = "sched";
 CScheduler *CScheduler::s_pThis = 0;
 
 CScheduler::CScheduler (void)
-:	m_nTasks (0),
-	m_pCurrent (0),
+:
+#ifdef SCHED_READY_QUEUES
+	m_pTask (0),
+	m_nTaskTableSize (0),
+#endif
+	m_nTasks (0),
 	m_nCurrent (0),
+#ifdef SCHED_READY_QUEUES
+	m_pTerminated (0),
+#endif
 	m_pTaskSwitchHandler (0),
 	m_pTaskTerminationHandler (0),
 	m_iSuspendNewTasks (0)
@@ -39,9 +47,23 @@ CScheduler::CScheduler (void)
 	assert (s_pThis == 0);
 	s_pThis = this;
 
-	m_pCurrent = new CTask (0);		// main task currently running
-	assert (m_pCurrent != 0);
-	m_pCurrent->SetName ("main");
+	for (unsigned i = 0; i < SCHED_CORES; i++)
+	{
+		m_pCurrent[i] = 0;
+#ifdef SCHED_READY_QUEUES
+		m_pPrevious[i] = 0;
+#endif
+	}
+
+#ifdef SCHED_READY_QUEUES
+	m_nTaskTableSize = MAX_TASKS;
+	m_pTask = new CTask *[m_nTaskTableSize];
+	assert (m_pTask != 0);
+#endif
+
+	m_pCurrent[0] = new CTask (0);		// main task currently running
+	assert (m_pCurrent[0] != 0);
+	m_pCurrent[0]->SetName ("main");
 }
 
 CScheduler::~CScheduler (void)
@@ -49,11 +71,17 @@ CScheduler::~CScheduler (void)
 	m_pTaskSwitchHandler = 0;
 	m_pTaskTerminationHandler = 0;
 
+#ifdef SCHED_READY_QUEUES
+	delete [] m_pTask;
+	m_pTask = 0;
+#endif
+
 	s_pThis = 0;
 }
 
 void CScheduler::Yield (void)
 {
+#ifndef SCHED_READY_QUEUES
 	while ((m_nCurrent = GetNextTask ()) == MAX_TASKS)	// no task is ready
 	{
 		assert (m_nTasks > 0);
@@ -62,23 +90,85 @@ void CScheduler::Yield (void)
 	assert (m_nCurrent < MAX_TASKS);
 	CTask *pNext = m_pTask[m_nCurrent];
 	assert (pNext != 0);
-	if (m_pCurrent == pNext)
+	CTask *pCurrent = m_pCurrent[0];
+	if (pCurrent == pNext)
 	{
 		return;
 	}
+
+	m_pCurrent[0] = pNext;
+#else
+	DeleteTerminatedTasks ();
+
+	m_SpinLock.Acquire ();
+
+	unsigned nCore = ThisCore ();
+	CTask *pCurrent = m_pCurrent[nCore];
+	assert (pCurrent != 0);
+
+	CTask *pNext;
+	while (1)
+	{
+		// a terminated task cannot be deleted here, because we are running on its stack,
+		// it will be added to the list of terminated tasks in FinishTaskSwitch().
+		// This is checked in each round, because WakeTasks() does not queue the current
+		// task, when it is woken from IRQ or from another core, while we wait below.
+		if (   pCurrent->GetState () == TaskStateReady
+		    && !pCurrent->IsSuspended ())
+		{
+			EnqueueTask (pCurrent);
+		}
+
+		WakeSleepingTasks ();
+
+		pNext = DequeueTask (nCore, pCurrent);
+		if (pNext == 0)				// no task is ready
+		{
+			m_SpinLock.Release ();		// allow IRQs to wake tasks
+
+			m_SpinLock.Acquire ();
+
+			continue;
+		}
+
+		assert (pNext->GetState () == TaskStateReady);
+		if (!pNext->IsSuspended ())
+		{
+			break;
+		}
+
+		// suspended tasks are dropped here and will be queued again by Start()
+	}
+
+	pNext->m_nCore = nCore;
+	pNext->m_bOnCPU = TRUE;
+	m_pCurrent[nCore] = pNext;
+
+	m_SpinLock.Release ();
+
+	if (pCurrent == pNext)
+	{
+		return;
+	}
+
+	m_pPrevious[nCore] = pCurrent;
+#endif
 	
-	TTaskRegisters *pOldRegs = m_pCurrent->GetRegs ();
-	m_pCurrent = pNext;
-	TTaskRegisters *pNewRegs = m_pCurrent->GetRegs ();
+	TTaskRegisters *pOldRegs = pCurrent->GetRegs ();
+	TTaskRegisters *pNewRegs = pNext->GetRegs ();
 
 	if (m_pTaskSwitchHandler != 0)
 	{
-		(*m_pTaskSwitchHandler) (m_pCurrent);
+		(*m_pTaskSwitchHandler) (pNext);
 	}
 
 	assert (pOldRegs != 0);
 	assert (pNewRegs != 0);
 	TaskSwitch (pOldRegs, pNewRegs);
+
+#ifdef SCHED_READY_QUEUES
+	FinishTaskSwitch ();
+#endif
 }
 
 void CScheduler::Sleep (unsigned nSeconds)
@@ -111,10 +201,19 @@ void CScheduler::usSleep (unsigned nMicroSeconds)
 
 		unsigned nStartTicks = CTimer::Get ()->GetClockTicks ();
 
-		assert (m_pCurrent != 0);
-		assert (m_pCurrent->GetState () == TaskStateReady);
-		m_pCurrent->SetWakeTicks (nStartTicks + nTicks);
-		m_pCurrent->SetState (TaskStateSleeping);
+		CTask *pCurrent = m_pCurrent[ThisCore ()];
+		assert (pCurrent != 0);
+		assert (pCurrent->GetState () == TaskStateReady);
+#ifdef SCHED_READY_QUEUES
+		m_SpinLock.Acquire ();
+#endif
+		pCurrent->SetWakeTicks (nStartTicks + nTicks);
+		pCurrent->SetState (TaskStateSleeping);
+#ifdef SCHED_READY_QUEUES
+		m_SleepQueue.Insert (pCurrent);
+
+		m_SpinLock.Release ();
+#endif
 
 		Yield ();
 	}
@@ -122,13 +221,15 @@ void CScheduler::usSleep (unsigned nMicroSeconds)
 
 CTask *CScheduler::GetCurrentTask (void)
 {
-	return m_pCurrent;
+	return m_pCurrent[ThisCore ()];
 }
 
 CTask *CScheduler::GetTask (const char *pTaskName)
 {
 	assert (pTaskName != 0);
 
+	m_SpinLock.Acquire ();
+
 	for (unsigned i = 0; i < m_nTasks; i++)
 	{
 		CTask *pTask = m_pTask[i];
@@ -136,22 +237,34 @@ CTask *CScheduler::GetTask (const char *pTaskName)
 		if (   pTask != 0
 		    && strcmp (pTask->GetName (), pTaskName) == 0)
 		{
+			m_SpinLock.Release ();
+
 			return pTask;
 		}
 	}
 
+	m_SpinLock.Release ();
+
 	return 0;
 }
 
 boolean CScheduler::IsValidTask (CTask *pTask)
 {
+	m_SpinLock.Acquire ();
+
 	unsigned i;
 	for (i = 0; i < m_nTasks; i++)
 	{
 		if (m_pTask[i] != 0 && m_pTask[i] == pTask)
+		{
+			m_SpinLock.Release ();
+
 			return TRUE;
+		}
 	}
 
+	m_SpinLock.Release ();
+
 	return FALSE;
 }
 
@@ -197,7 +310,7 @@ void CScheduler::ListTasks (CDevice *pTarget)
 {
 	assert (pTarget != 0);
 
-	static const char Header[] = "#  ADDR     STAT  FL NAME\n";
+	static const char Header[] = "#  ADDR     STAT  FL PR NAME\n";
 	pTarget->Write (Header, sizeof Header-1);
 
 	for (unsigned i = 0; i < m_nTasks; i++)
@@ -216,11 +329,12 @@ void CScheduler::ListTasks (CDevice *pTarget)
 			{"new", "ready", "block", "block", "sleep", "term"};
 
 		CString Line;
-		Line.Format ("%02u %08lX %-5s %c%c %s\n",
+		Line.Format ("%02u %08lX %-5s %c%c %2u %s\n",
 			     i, (uintptr) pTask,
-			     pTask == m_pCurrent ? "run" : StateNames[State],
+			     IsRunning (pTask) ? "run" : StateNames[State],
 			     pTask->IsSuspended () ? 'S' : ' ',
 			     State == TaskStateBlockedWithTimeout ? 'T' : ' ',
+			     pTask->GetPriority (),
 			     pTask->GetName ());
 
 		pTarget->Write (Line, Line.GetLength ());
@@ -236,6 +350,16 @@ void CScheduler::AddTask (CTask *pTask)
 		pTask->SetState(TaskStateNew);
 	}
 
+	m_SpinLock.Acquire ();
+
+#ifdef SCHED_READY_QUEUES
+	if (   pTask->m_nStackSize != 0		// not the main task (or a secondary core)
+	    && pTask->GetState () == TaskStateReady)
+	{
+		EnqueueTask (pTask);
+	}
+#endif
+
 	unsigned i;
 	for (i = 0; i < m_nTasks; i++)
 	{
@@ -243,20 +367,43 @@ void CScheduler::AddTask (CTask *pTask)
 		{
 			m_pTask[i] = pTask;
 
+			m_SpinLock.Release ();
+
 			return;
 		}
 	}
 
+#ifndef SCHED_READY_QUEUES
 	if (m_nTasks >= MAX_TASKS)
 	{
 		CLogger::Get ()->Write (FromScheduler, LogPanic, "System limit of tasks exceeded");
 	}
+#else
+	if (m_nTasks >= m_nTaskTableSize)
+	{
+		CTask **pNewTable = new CTask *[m_nTaskTableSize * 2];
+		if (pNewTable == 0)
+		{
+			CLogger::Get ()->Write (FromScheduler, LogPanic, "Cannot grow task table");
+		}
+
+		memcpy (pNewTable, m_pTask, m_nTaskTableSize * sizeof (CTask *));
+		m_nTaskTableSize *= 2;
+
+		delete [] m_pTask;
+		m_pTask = pNewTable;
+	}
+#endif
 
 	m_pTask[m_nTasks++] = pTask;
+
+	m_SpinLock.Release ();
 }
 
 void CScheduler::RemoveTask (CTask *pTask)
 {
+	m_SpinLock.Acquire ();
+
 	for (unsigned i = 0; i < m_nTasks; i++)
 	{
 		if (m_pTask[i] == pTask)
@@ -268,37 +415,56 @@ void CScheduler::RemoveTask (CTask *pTask)
 				m_nTasks--;
 			}
 
+			m_SpinLock.Release ();
+
 			return;
 		}
 	}
 
+	m_SpinLock.Release ();
+
 	assert (0);
 }
 
-boolean CScheduler::BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds)
+boolean CScheduler::BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds,
+			       TSchedulerWakeCondition *pWakeCondition, void *pParam)
 {
+	CTask *pCurrent = m_pCurrent[ThisCore ()];
 	assert (ppWaitListHead != 0);
-	assert (m_pCurrent->m_pWaitListNext == 0);
-	assert (m_pCurrent != 0);
-	assert (m_pCurrent->GetState () == TaskStateReady);
+	assert (pCurrent != 0);
+	assert (pCurrent->m_pWaitListNext == 0);
+	assert (pCurrent->GetState () == TaskStateReady);
 
 	m_SpinLock.Acquire ();
 
+	// The condition may have been satisfied from another core or from interrupt context
+	// in the meantime. This is checked here, so that the wake-up cannot get lost.
+	if (   pWakeCondition != 0
+	    && (*pWakeCondition) (pParam))
+	{
+		m_SpinLock.Release ();
+
+		return FALSE;
+	}
+
 	// Add current task to waiting task list
-	m_pCurrent->m_pWaitListNext = *ppWaitListHead;
-	*ppWaitListHead = m_pCurrent;
+	pCurrent->m_pWaitListNext = *ppWaitListHead;
+	*ppWaitListHead = pCurrent;
 
 	if (nMicroSeconds == 0)
 	{
-		m_pCurrent->SetState (TaskStateBlocked);
+		pCurrent->SetState (TaskStateBlocked);
 	}
 	else
 	{
 		unsigned nTicks = nMicroSeconds * (CLOCKHZ / 1000000);
 		unsigned nStartTicks = CTimer::Get ()->GetClockTicks ();
 
-		m_pCurrent->SetWakeTicks (nStartTicks + nTicks);
-		m_pCurrent->SetState (TaskStateBlockedWithTimeout);
+		pCurrent->SetWakeTicks (nStartTicks + nTicks);
+		pCurrent->SetState (TaskStateBlockedWithTimeout);
+#ifdef SCHED_READY_QUEUES
+		m_SleepQueue.Insert (pCurrent);
+#endif
 	}
 	
 	m_SpinLock.Release ();
@@ -314,7 +480,7 @@ boolean CScheduler::BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds)
 	CTask* p = *ppWaitListHead;
 	while (p)
 	{
-		if (p == m_pCurrent)
+		if (p == pCurrent)
 		{
 			if (pPrev)
 				pPrev->m_pWaitListNext = p->m_pWaitListNext;
@@ -324,12 +490,12 @@ boolean CScheduler::BlockTask (CTask **ppWaitListHead, unsigned nMicroSeconds)
 		pPrev = p;
 		p = p->m_pWaitListNext;
 	}
-	m_pCurrent->m_pWaitListNext = nullptr;
+	pCurrent->m_pWaitListNext = nullptr;
 
 	m_SpinLock.Release ();
 
 	// GetWakeTicks Will be zero if timeout expired, non-zero if event signalled
-	return m_pCurrent->GetWakeTicks() == 0;		
+	return pCurrent->GetWakeTicks() == 0;		
 }
 
 void CScheduler::WakeTasks (CTask **ppWaitListHead)
@@ -343,6 +509,18 @@ void CScheduler::WakeTasks (CTask **ppWaitListHead)
 
 	while (pTask)
 	{
+#ifdef SCHED_READY_QUEUES
+		// the timeout may have expired already, but the task has not run yet
+		if (pTask->GetState () == TaskStateReady)
+		{
+			CTask* pNext = pTask->m_pWaitListNext;
+			pTask->m_pWaitListNext = 0;
+			pTask = pNext;
+
+			continue;
+		}
+#endif
+
 #ifdef NDEBUG
 		if (   pTask == 0
 		    ||    (pTask->GetState () != TaskStateBlocked
@@ -356,8 +534,25 @@ void CScheduler::WakeTasks (CTask **ppWaitListHead)
 		        || pTask->GetState () == TaskStateBlockedWithTimeout);
 #endif
 
+#ifdef SCHED_READY_QUEUES
+		if (pTask->GetState () == TaskStateBlockedWithTimeout)
+		{
+			m_SleepQueue.Remove (pTask);
+		}
+#endif
+
 		pTask->SetState (TaskStateReady);
 
+#ifdef SCHED_READY_QUEUES
+		// a task, which is still the current task of any core, is queued again by
+		// Yield() on that core, which may be waiting for a ready task meanwhile
+		if (   !IsRunning (pTask)
+		    && !pTask->IsSuspended ())
+		{
+			EnqueueTask (pTask);
+		}
+#endif
+
 		CTask* pNext = pTask->m_pWaitListNext;
 		pTask->m_pWaitListNext = 0;
 		pTask = pNext;
@@ -366,6 +561,21 @@ void CScheduler::WakeTasks (CTask **ppWaitListHead)
 	m_SpinLock.Release ();
 }
 
+boolean CScheduler::IsRunning (CTask *pTask) const
+{
+	for (unsigned i = 0; i < SCHED_CORES; i++)
+	{
+		if (m_pCurrent[i] == pTask)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+#ifndef SCHED_READY_QUEUES
+
 unsigned CScheduler::GetNextTask (void)
 {
 	unsigned nTask = m_nCurrent < MAX_TASKS ? m_nCurrent : 0;
@@ -435,6 +645,185 @@ unsigned CScheduler::GetNextTask (void)
 	return MAX_TASKS;
 }
 
+#else
+
+void CScheduler::ReadyTask (CTask *pTask)
+{
+	assert (pTask != 0);
+
+	m_SpinLock.Acquire ();
+
+	if (   !IsRunning (pTask)
+	    && pTask->GetState () == TaskStateReady
+	    && !pTask->IsSuspended ())
+	{
+		EnqueueTask (pTask);
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CScheduler::WakeSleepingTasks (void)
+{
+	unsigned nTicks = CTimer::Get ()->GetClockTicks ();
+
+	CTask *pTask;
+	while ((pTask = m_SleepQueue.GetExpired (nTicks)) != 0)
+	{
+		switch (pTask->GetState ())
+		{
+		case TaskStateBlockedWithTimeout:
+			pTask->SetWakeTicks (0);	// Use as flag that timeout expired
+			break;
+
+		case TaskStateSleeping:
+			break;
+
+		default:
+			assert (0);
+			break;
+		}
+
+		pTask->SetState (TaskStateReady);
+
+		if (!pTask->IsSuspended ())
+		{
+			EnqueueTask (pTask);
+		}
+	}
+}
+
+void CScheduler::DeleteTerminatedTasks (void)
+{
+	while (1)
+	{
+		m_SpinLock.Acquire ();
+
+		// another core may have removed the last terminated task meanwhile
+		CTask *pTask = m_pTerminated;
+		if (pTask == 0)
+		{
+			m_SpinLock.Release ();
+
+			break;
+		}
+
+		assert (!IsRunning (pTask));
+		m_pTerminated = pTask->m_pQueueNext;
+
+		m_SpinLock.Release ();
+
+		assert (pTask->GetState () == TaskStateTerminated);
+		if (m_pTaskTerminationHandler != 0)
+		{
+			(*m_pTaskTerminationHandler) (pTask);
+		}
+
+		RemoveTask (pTask);
+		delete pTask;
+	}
+}
+
+void CScheduler::FinishTaskSwitch (void)
+{
+	unsigned nCore = ThisCore ();
+	CTask *pPrevious = m_pPrevious[nCore];
+	assert (pPrevious != 0);
+	m_pPrevious[nCore] = 0;
+
+	// must be read before releasing the task, which may run on another core then
+	boolean bTerminated = pPrevious->GetState () == TaskStateTerminated;
+
+#ifdef SCHED_MULTI_CORE
+	DataMemBarrier ();		// registers of the previous task have been saved
+#endif
+	pPrevious->m_bOnCPU = FALSE;
+
+	if (bTerminated)
+	{
+		// can be deleted now, because we are not running on its stack any more
+		m_SpinLock.Acquire ();
+
+		pPrevious->m_pQueueNext = m_pTerminated;
+		m_pTerminated = pPrevious;
+
+		m_SpinLock.Release ();
+	}
+}
+
+void CScheduler::EnqueueTask (CTask *pTask)
+{
+	assert (pTask != 0);
+	assert (pTask->m_nCore < SCHED_CORES);
+
+	m_ReadyQueue[pTask->m_nCore].Enqueue (pTask);
+}
+
+CTask *CScheduler::DequeueTask (unsigned nCore, CTask *pCurrent)
+{
+#ifndef SCHED_MULTI_CORE
+	return m_ReadyQueue[0].Dequeue ();
+#else
+	CTask *pTask;
+	while ((pTask = m_ReadyQueue[nCore].Dequeue (pCurrent, FALSE)) != 0)
+	{
+		if (   pTask->m_nAffinity == TASK_AFFINITY_ANY
+		    || pTask->m_nAffinity == nCore)
+		{
+			return pTask;
+		}
+
+		// the task has been pinned to another core in the meantime
+		assert (pTask->m_nAffinity < SCHED_CORES);
+		pTask->m_nCore = pTask->m_nAffinity;
+		EnqueueTask (pTask);
+	}
+
+	// no task is ready on this core, try to steal one from another core
+	for (unsigned i = 1; i < SCHED_CORES; i++)
+	{
+		pTask = m_ReadyQueue[(nCore + i) % SCHED_CORES].Dequeue (0, TRUE);
+		if (pTask != 0)
+		{
+			return pTask;
+		}
+	}
+
+	return 0;
+#endif
+}
+
+#endif
+
+#ifdef SCHED_MULTI_CORE
+
+void CScheduler::RunSecondaryCore (void)
+{
+	unsigned nCore = ThisCore ();
+	assert (0 < nCore && nCore < SCHED_CORES);
+	assert (m_pCurrent[nCore] == 0);
+
+	CTask *pTask = new CTask (0);		// represents the calling context
+	assert (pTask != 0);
+
+	CString Name;
+	Name.Format ("core%u", nCore);
+	pTask->SetName (Name);
+
+	m_SpinLock.Acquire ();
+
+	m_pCurrent[nCore] = pTask;
+	pTask->SetState (TaskStateBlocked);	// will never be woken
+
+	m_SpinLock.Release ();
+
+	Yield ();
+
+	assert (0);
+}
+
+#endif
+
 CScheduler *CScheduler::Get (void)
 {
 	assert (s_pThis != 0);
@@ -2,7 +2,7 @@
 // semaphore.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,8 +22,7 @@
 #include <assert.h>
 
 CSemaphore::CSemaphore (unsigned nInitialCount)
-:	m_nCount (nInitialCount),
-	m_Event (TRUE)
+:	m_nCount (nInitialCount)
 {
 	assert (m_nCount > 0);
 }
@@ -40,15 +39,11 @@ unsigned CSemaphore::GetState (void) const
 
 void CSemaphore::Down (void)
 {
-	while (AtomicGet (&m_nCount) == 0)
+	while (!TryDown ())
 	{
-		m_Event.Wait ();
-	}
-
-	if (AtomicDecrement (&m_nCount) == 0)
-	{
-		assert (m_Event.GetState ());
-		m_Event.Clear ();
+		// the count is checked again with the scheduler spin lock acquired,
+		// so that an Up() from another core or from IRQ cannot get lost
+		m_Event.WaitUnless (IsAvailable, this);
 	}
 }
 
@@ -56,30 +51,30 @@ void CSemaphore::Up (void)
 {
 	if (AtomicIncrement (&m_nCount) == 1)
 	{
-		assert (!m_Event.GetState ());
-		m_Event.Set ();
+		m_Event.Pulse ();
 	}
-#if NDEBUG
-	else
-	{
-		assert (m_Event.GetState ());
-	}
-#endif
-
 }
 
 boolean CSemaphore::TryDown (void)
 {
-	if (AtomicGet (&m_nCount) == 0)
+	int nCount;
+	do
 	{
-		return FALSE;
-	}
-
-	if (AtomicDecrement (&m_nCount) == 0)
-	{
-		assert (m_Event.GetState ());
-		m_Event.Clear ();
+		nCount = AtomicGet (&m_nCount);
+		if (nCount == 0)
+		{
+			return FALSE;
+		}
 	}
+	while (AtomicCompareExchange (&m_nCount, nCount, nCount-1) != nCount);
 
 	return TRUE;
 }
+
+boolean CSemaphore::IsAvailable (void *pParam)
+{
+	CSemaphore *pThis = (CSemaphore *) pParam;
+	assert (pThis != 0);
+
+	return AtomicGet (&pThis->m_nCount) > 0;
+}
@@ -0,0 +1,146 @@
+//
+// sleepqueue.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sched/sleepqueue.h>
+#include <assert.h>
+
+#define SLEEP_QUEUE_INITIAL_SIZE	32
+
+CSleepQueue::CSleepQueue (void)
+:	m_Heap (SLEEP_QUEUE_INITIAL_SIZE, SLEEP_QUEUE_INITIAL_SIZE)
+{
+}
+
+CSleepQueue::~CSleepQueue (void)
+{
+}
+
+void CSleepQueue::Insert (CTask *pTask)
+{
+	assert (pTask != 0);
+	assert (pTask->m_nSleepIndex == TASK_NOT_SLEEPING);
+
+	unsigned nIndex = m_Heap.Append (pTask);
+	pTask->m_nSleepIndex = nIndex;
+
+	SiftUp (nIndex);
+}
+
+void CSleepQueue::Remove (CTask *pTask)
+{
+	assert (pTask != 0);
+	unsigned nIndex = pTask->m_nSleepIndex;
+	assert (nIndex < m_Heap.GetCount ());
+	assert (Get (nIndex) == pTask);
+
+	unsigned nLast = m_Heap.GetCount ()-1;
+	if (nIndex != nLast)
+	{
+		Set (nIndex, Get (nLast));
+	}
+
+	m_Heap.RemoveLast ();
+	pTask->m_nSleepIndex = TASK_NOT_SLEEPING;
+
+	if (nIndex < nLast)
+	{
+		SiftUp (nIndex);
+		SiftDown (nIndex);
+	}
+}
+
+CTask *CSleepQueue::GetExpired (unsigned nTicks)
+{
+	if (m_Heap.GetCount () == 0)
+	{
+		return 0;
+	}
+
+	CTask *pTask = Get (0);
+	if ((int) (pTask->GetWakeTicks () - nTicks) > 0)
+	{
+		return 0;
+	}
+
+	Remove (pTask);
+
+	return pTask;
+}
+
+void CSleepQueue::Set (unsigned nIndex, CTask *pTask)
+{
+	m_Heap[nIndex] = pTask;
+	pTask->m_nSleepIndex = nIndex;
+}
+
+void CSleepQueue::SiftUp (unsigned nIndex)
+{
+	CTask *pTask = Get (nIndex);
+
+	while (nIndex > 0)
+	{
+		unsigned nParent = (nIndex-1) / 2;
+		if (!Earlier (pTask, Get (nParent)))
+		{
+			break;
+		}
+
+		Set (nIndex, Get (nParent));
+		nIndex = nParent;
+	}
+
+	Set (nIndex, pTask);
+}
+
+void CSleepQueue::SiftDown (unsigned nIndex)
+{
+	unsigned nCount = m_Heap.GetCount ();
+	CTask *pTask = Get (nIndex);
+
+	while (1)
+	{
+		unsigned nChild = 2*nIndex + 1;
+		if (nChild >= nCount)
+		{
+			break;
+		}
+
+		if (   nChild+1 < nCount
+		    && Earlier (Get (nChild+1), Get (nChild)))
+		{
+			nChild++;
+		}
+
+		if (!Earlier (Get (nChild), pTask))
+		{
+			break;
+		}
+
+		Set (nIndex, Get (nChild));
+		nIndex = nChild;
+	}
+
+	Set (nIndex, pTask);
+}
+
+boolean CSleepQueue::Earlier (CTask *pTask1, CTask *pTask2)
+{
+	// wake ticks may wrap around
+	return (int) (pTask1->GetWakeTicks () - pTask2->GetWakeTicks ()) < 0;
+}
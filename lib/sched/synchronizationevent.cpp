@@ -2,7 +2,7 @@
 // synchronizationevent.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -81,7 +81,7 @@ void CSynchronizationEvent::Wait (void)
 {
 	if (!m_bState)
 	{
-		CScheduler::Get ()->BlockTask (&m_pWaitListHead, 0);
+		CScheduler::Get ()->BlockTask (&m_pWaitListHead, 0, IsSet, this);
 	}
 }
 
@@ -93,6 +93,19 @@ boolean CSynchronizationEvent::WaitWithTimeout (unsigned nMicroSeconds)
 	}
 	else
 	{
-		return CScheduler::Get ()->BlockTask (&m_pWaitListHead, nMicroSeconds);
+		return CScheduler::Get ()->BlockTask (&m_pWaitListHead, nMicroSeconds, IsSet, this);
 	}
 }
+
+void CSynchronizationEvent::WaitUnless (boolean (*pWakeCondition) (void *pParam), void *pParam)
+{
+	CScheduler::Get ()->BlockTask (&m_pWaitListHead, 0, pWakeCondition, pParam);
+}
+
+boolean CSynchronizationEvent::IsSet (void *pParam)
+{
+	CSynchronizationEvent *pThis = (CSynchronizationEvent *) pParam;
+	assert (pThis != 0);
+
+	return pThis->m_bState;
+}
@@ -2,7 +2,7 @@
 // task.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,8 +27,17 @@ CTask::CTask (unsigned nStackSize, boolean bCreateSuspended)
 	m_bSuspended (FALSE),
 	m_nStackSize (nStackSize),
 	m_pStack (0),
-	m_pWaitListNext (0)
+	m_pWaitListNext (0),
+	m_nPriority (TASK_PRIORITY_DEFAULT),
+	m_pQueueNext (0),
+	m_nQueuePriority (TASK_PRIORITY_DEFAULT),
+	m_bQueued (FALSE),
+	m_nSleepIndex (TASK_NOT_SLEEPING),
+	m_nCore (CScheduler::ThisCore ()),
+	m_bOnCPU (nStackSize == 0)		// the main task is running already
 {
+	m_nAffinity = m_nCore;
+
 	for (unsigned i = 0; i < TASK_USER_DATA_SLOTS; i++)
 	{
 		m_pUserData[i] = 0;
@@ -73,6 +82,10 @@ void CTask::Start (void)
 		assert (m_bSuspended);
 		m_bSuspended = FALSE;
 	}
+
+#ifdef SCHED_READY_QUEUES
+	CScheduler::Get ()->ReadyTask (this);
+#endif
 }
 
 void CTask::Suspend (void)
@@ -109,11 +122,25 @@ void CTask::WaitForTermination (void)
 	m_Event.Wait ();
 }
 
+void CTask::SetPriority (unsigned nPriority)
+{
+	assert (nPriority < TASK_PRIORITIES);
+	m_nPriority = nPriority;
+}
+
 void CTask::SetName (const char *pName)
 {
 	m_Name = pName;
 }
 
+void CTask::SetAffinity (unsigned nCore)
+{
+#ifdef SCHED_MULTI_CORE
+	assert (nCore < CORES || nCore == TASK_AFFINITY_ANY);
+#endif
+	m_nAffinity = nCore;
+}
+
 const char *CTask::GetName (void) const
 {
 	return m_Name;
@@ -173,6 +200,10 @@ void CTask::TaskEntry (void *pParam)
 	CTask *pThis = (CTask *) pParam;
 	assert (pThis != 0);
 
+#ifdef SCHED_READY_QUEUES
+	CScheduler::Get ()->FinishTaskSwitch ();
+#endif
+
 	pThis->Run ();
 
 	pThis->m_State = TaskStateTerminated;
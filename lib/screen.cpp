@@ -2,7 +2,7 @@
 // screen.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #include <circle/devicenameservice.h>
 #include <circle/synchronize.h>
 #include <circle/util.h>
+#include <assert.h>
 
 static const char DevicePrefix[] = "tty";
 
@@ -28,6 +29,37 @@ static const char DevicePrefix[] = "tty";
 
 #ifndef SCREEN_HEADLESS
 
+// masks to select the foreground pixels in a 32-bit word of the frame buffer,
+// index is a group of pixel bits from CCharGenerator::GetPixelLine()
+#if DEPTH == 8
+	#define PIXELS_PER_WORD		4
+	#define EXPAND_COLOR(color)	((u32) (color) * 0x01010101U)
+
+	static const u32 s_PixelMask[16] =
+	{
+		0x00000000, 0xFF000000, 0x00FF0000, 0xFFFF0000,
+		0x0000FF00, 0xFF00FF00, 0x00FFFF00, 0xFFFFFF00,
+		0x000000FF, 0xFF0000FF, 0x00FF00FF, 0xFFFF00FF,
+		0x0000FFFF, 0xFF00FFFF, 0x00FFFFFF, 0xFFFFFFFF
+	};
+#elif DEPTH == 16
+	#define PIXELS_PER_WORD		2
+	#define EXPAND_COLOR(color)	((u32) (color) | (u32) (color) << 16)
+
+	static const u32 s_PixelMask[4] =
+	{
+		0x00000000, 0xFFFF0000, 0x0000FFFF, 0xFFFFFFFF
+	};
+#else
+	#define PIXELS_PER_WORD		1
+	#define EXPAND_COLOR(color)	((u32) (color))
+
+	static const u32 s_PixelMask[2] =
+	{
+		0x00000000, 0xFFFFFFFF
+	};
+#endif
+
 enum TScreenState
 {
 	ScreenStateStart,
@@ -48,6 +80,7 @@ CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtua
 	m_pFrameBuffer (0),
 	m_pCursorPixels (0),
 	m_pBuffer (0),
+	m_bWordAccess (FALSE),
 	m_nState (ScreenStateStart),
 	m_nScrollStart (0),
 	m_nCursorX (0),
@@ -65,6 +98,12 @@ CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtua
 #ifdef REALTIME
 	, m_SpinLock (TASK_LEVEL)
 #endif
+#ifdef SCREEN_CONSOLE_MODE
+	, m_bConsoleMode (FALSE),
+	m_bHWScroll (FALSE),
+	m_pCells (0),
+	m_pDirty (0)
+#endif
 {
 }
 
@@ -83,39 +122,30 @@ CScreenDevice::~CScreenDevice (void)
 
 	delete [] m_pCursorPixels;
 	m_pCursorPixels = 0;
+
+#ifdef SCREEN_CONSOLE_MODE
+	delete [] m_pCells;
+	m_pCells = 0;
+	delete [] m_pDirty;
+	m_pDirty = 0;
+#endif
 }
 
 boolean CScreenDevice::Initialize (void)
 {
 	if (!m_bVirtual)
 	{
-		m_pFrameBuffer = new CBcmFrameBuffer (m_nInitWidth, m_nInitHeight, DEPTH,
-						      0, 0, m_nDisplay);
-#if DEPTH == 8
-		m_pFrameBuffer->SetPalette (RED_COLOR, RED_COLOR16);
-		m_pFrameBuffer->SetPalette (GREEN_COLOR, GREEN_COLOR16);
-		m_pFrameBuffer->SetPalette (YELLOW_COLOR, YELLOW_COLOR16);
-		m_pFrameBuffer->SetPalette (BLUE_COLOR, BLUE_COLOR16);
-		m_pFrameBuffer->SetPalette (MAGENTA_COLOR, MAGENTA_COLOR16);
-		m_pFrameBuffer->SetPalette (CYAN_COLOR, CYAN_COLOR16);
-		m_pFrameBuffer->SetPalette (WHITE_COLOR, WHITE_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_BLACK_COLOR, BRIGHT_BLACK_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_RED_COLOR, BRIGHT_RED_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_GREEN_COLOR, BRIGHT_GREEN_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_YELLOW_COLOR, BRIGHT_YELLOW_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_BLUE_COLOR, BRIGHT_BLUE_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_MAGENTA_COLOR, BRIGHT_MAGENTA_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_CYAN_COLOR, BRIGHT_CYAN_COLOR16);
-		m_pFrameBuffer->SetPalette (BRIGHT_WHITE_COLOR, BRIGHT_WHITE_COLOR16);
+#ifdef SCREEN_CONSOLE_MODE
+		// try to get a virtual frame buffer for scrolling by hardware first
+		m_bConsoleMode = TRUE;
+		m_bHWScroll = InitializeFrameBuffer (TRUE);
+		if (!m_bHWScroll)
 #endif
-		if (!m_pFrameBuffer->Initialize ())
 		{
-			return FALSE;
-		}
-
-		if (m_pFrameBuffer->GetDepth () != DEPTH)
-		{
-			return FALSE;
+			if (!InitializeFrameBuffer (FALSE))
+			{
+				return FALSE;
+			}
 		}
 
 		m_pBuffer = (TScreenColor *) (uintptr) m_pFrameBuffer->GetBuffer ();
@@ -151,13 +181,32 @@ boolean CScreenDevice::Initialize (void)
 		m_pBuffer = new TScreenColor[m_nWidth * m_nHeight];
 	}
 
+	m_bWordAccess =    m_CharGen.GetCharWidth () % PIXELS_PER_WORD == 0
+			&& m_CharGen.GetCharWidth () <= 32
+			&& m_nPitch * sizeof (TScreenColor) % sizeof (u32) == 0;
+
 	m_nUsedHeight = m_nHeight / m_CharGen.GetCharHeight () * m_CharGen.GetCharHeight ();
 	m_nScrollEnd = m_nUsedHeight;
 
+#ifdef SCREEN_CONSOLE_MODE
+	if (   m_bConsoleMode
+	    && !InitializeConsole ())
+	{
+		return FALSE;
+	}
+#endif
+
 	CursorHome ();
 	ClearDisplayEnd ();
 	InvertCursor ();
 
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		UpdateConsole (FALSE);
+	}
+#endif
+
 	if (!CDeviceNameService::Get ()->GetDevice (DevicePrefix, m_nDisplay+1, FALSE))
 	{
 		CDeviceNameService::Get ()->AddDevice (DevicePrefix, m_nDisplay+1, this, FALSE);
@@ -166,6 +215,58 @@ boolean CScreenDevice::Initialize (void)
 	return TRUE;
 }
 
+boolean CScreenDevice::InitializeFrameBuffer (boolean bVirtualHeight)
+{
+	unsigned nWidth = m_nInitWidth;
+	unsigned nHeight = m_nInitHeight;
+	unsigned nVirtualWidth = 0;
+	unsigned nVirtualHeight = 0;
+
+	if (bVirtualHeight)
+	{
+		// the visible window moves down one character row on each scroll and wraps
+		// around after the last row, the rows above it are repeated below the
+		// used screen height, therefore the virtual height must be increased by it
+		CBcmFrameBuffer FrameBuffer (nWidth, nHeight, DEPTH, 0, 0, m_nDisplay);
+		nWidth = FrameBuffer.GetWidth ();
+		nHeight = FrameBuffer.GetHeight ();
+
+		nVirtualWidth = nWidth;
+		nVirtualHeight =   nHeight
+				 + nHeight / m_CharGen.GetCharHeight () * m_CharGen.GetCharHeight ();
+	}
+
+	m_pFrameBuffer = new CBcmFrameBuffer (nWidth, nHeight, DEPTH,
+					      nVirtualWidth, nVirtualHeight, m_nDisplay);
+#if DEPTH == 8
+	m_pFrameBuffer->SetPalette (RED_COLOR, RED_COLOR16);
+	m_pFrameBuffer->SetPalette (GREEN_COLOR, GREEN_COLOR16);
+	m_pFrameBuffer->SetPalette (YELLOW_COLOR, YELLOW_COLOR16);
+	m_pFrameBuffer->SetPalette (BLUE_COLOR, BLUE_COLOR16);
+	m_pFrameBuffer->SetPalette (MAGENTA_COLOR, MAGENTA_COLOR16);
+	m_pFrameBuffer->SetPalette (CYAN_COLOR, CYAN_COLOR16);
+	m_pFrameBuffer->SetPalette (WHITE_COLOR, WHITE_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_BLACK_COLOR, BRIGHT_BLACK_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_RED_COLOR, BRIGHT_RED_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_GREEN_COLOR, BRIGHT_GREEN_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_YELLOW_COLOR, BRIGHT_YELLOW_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_BLUE_COLOR, BRIGHT_BLUE_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_MAGENTA_COLOR, BRIGHT_MAGENTA_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_CYAN_COLOR, BRIGHT_CYAN_COLOR16);
+	m_pFrameBuffer->SetPalette (BRIGHT_WHITE_COLOR, BRIGHT_WHITE_COLOR16);
+#endif
+	if (   !m_pFrameBuffer->Initialize ()
+	    || m_pFrameBuffer->GetDepth () != DEPTH)
+	{
+		delete m_pFrameBuffer;
+		m_pFrameBuffer = 0;
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 boolean CScreenDevice::Resize (unsigned nWidth, unsigned nHeight)
 {
 	if (m_bVirtual)
@@ -177,6 +278,12 @@ boolean CScreenDevice::Resize (unsigned nWidth, unsigned nHeight)
 	m_pFrameBuffer = 0;
 	delete [] m_pCursorPixels;
 	m_pCursorPixels = 0;
+#ifdef SCREEN_CONSOLE_MODE
+	delete [] m_pCells;
+	m_pCells = 0;
+	delete [] m_pDirty;
+	m_pDirty = 0;
+#endif
 
 	m_nInitWidth = nWidth;
 	m_nInitHeight = nHeight;
@@ -246,6 +353,13 @@ TScreenStatus CScreenDevice::GetStatus (void)
 
 boolean CScreenDevice::SetStatus (const TScreenStatus &Status)
 {
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		return FALSE;
+	}
+#endif
+
 	if (   m_nSize  != Status.nSize
 	    || m_nPitch != m_nWidth)
 	{
@@ -294,6 +408,11 @@ int CScreenDevice::Write (const void *pBuffer, size_t nCount)
 	}
 #endif
 
+#ifdef SCREEN_CONSOLE_MODE
+	// the virtual offset can be set via the mailbox at TASK_LEVEL only
+	boolean bTaskLevel = CurrentExecutionLevel () == TASK_LEVEL;
+#endif
+
 	m_SpinLock.Acquire ();
 
 	m_bUpdated = TRUE;
@@ -311,6 +430,13 @@ int CScreenDevice::Write (const void *pBuffer, size_t nCount)
 	}
 
 	InvertCursor ();
+
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		UpdateConsole (bTaskLevel);
+	}
+#endif
 	
 	m_bUpdated = FALSE;
 
@@ -604,6 +730,19 @@ void CScreenDevice::CarriageReturn (void)
 void CScreenDevice::ClearDisplayEnd (void)
 {
 	ClearLineEnd ();
+
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		for (unsigned nPosY = m_nCursorY + m_CharGen.GetCharHeight ();
+		     nPosY < m_nUsedHeight; nPosY += m_CharGen.GetCharHeight ())
+		{
+			ClearCells (GetCellRow (nPosY), 0, m_nColumns);
+		}
+
+		return;
+	}
+#endif
 	
 	unsigned nPosY = m_nCursorY + m_CharGen.GetCharHeight ();
 	unsigned nOffset = nPosY * m_nPitch;
@@ -703,6 +842,14 @@ void CScreenDevice::DisplayChar (char chChar)
 	
 	if (' ' <= (unsigned char) chChar)
 	{
+#ifdef SCREEN_CONSOLE_MODE
+		if (m_bConsoleMode)
+		{
+			SetCell (m_nCursorX, m_nCursorY, chChar,
+				 GetTextColor (), GetTextBackgroundColor ());
+		}
+		else
+#endif
 		DisplayChar (chChar, m_nCursorX, m_nCursorY, GetTextColor ());
 
 		CursorRight ();
@@ -925,6 +1072,15 @@ void CScreenDevice::Tabulator (void)
 
 void CScreenDevice::Scroll (void)
 {
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		ScrollConsole ();
+
+		return;
+	}
+#endif
+
 	unsigned nLines = m_CharGen.GetCharHeight ();
 
 	u32 *pTo = (u32 *) (m_pBuffer + m_nScrollStart * m_nPitch);
@@ -958,6 +1114,16 @@ void CScreenDevice::Scroll (void)
 
 void CScreenDevice::DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TScreenColor Color)
 {
+	if (   nPosX + m_CharGen.GetCharWidth () <= m_nWidth
+	    && nPosY + m_CharGen.GetCharHeight () <= m_nHeight)
+	{
+		RenderChar (GetPixelAddress (nPosX, nPosY), chChar, Color,
+			    GetTextBackgroundColor (), FALSE);
+
+		return;
+	}
+
+	// clipped at the right or bottom border
 	for (unsigned y = 0; y < m_CharGen.GetCharHeight (); y++)
 	{
 		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
@@ -970,6 +1136,24 @@ void CScreenDevice::DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, TS
 
 void CScreenDevice::EraseChar (unsigned nPosX, unsigned nPosY)
 {
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		SetCell (nPosX, nPosY, ' ', m_BackgroundColor, m_BackgroundColor);
+
+		return;
+	}
+#endif
+
+	if (   nPosX + m_CharGen.GetCharWidth () <= m_nWidth
+	    && nPosY + m_CharGen.GetCharHeight () <= m_nHeight)
+	{
+		RenderChar (GetPixelAddress (nPosX, nPosY), ' ', m_BackgroundColor,
+			    m_BackgroundColor, FALSE);
+
+		return;
+	}
+
 	for (unsigned y = 0; y < m_CharGen.GetCharHeight (); y++)
 	{
 		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
@@ -986,6 +1170,18 @@ void CScreenDevice::InvertCursor (void)
 		return;
 	}
 
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		// the cursor is drawn, when the cursor cell is repainted
+		SetCursorDirty ();
+
+		m_bCursorVisible = !m_bCursorVisible;
+
+		return;
+	}
+#endif
+
 	TScreenColor *pPixelData = m_pCursorPixels;
 	for (unsigned y = m_CharGen.GetUnderline (); y < m_CharGen.GetCharHeight (); y++)
 	{
@@ -1016,7 +1212,18 @@ void CScreenDevice::SetPixel (unsigned nPosX, unsigned nPosY, TScreenColor Color
 	if (   nPosX < m_nWidth
 	    && nPosY < m_nHeight)
 	{
-		m_pBuffer[m_nPitch * nPosY + nPosX] = Color;
+		TScreenColor *pPixel = GetPixelAddress (nPosX, nPosY);
+		*pPixel = Color;
+
+#ifdef SCREEN_CONSOLE_MODE
+		// rows above the display row are repeated below the used screen height
+		if (   m_bConsoleMode
+		    && nPosY < m_nUsedHeight
+		    && pPixel < m_pBuffer + m_nDisplayRow * m_CharGen.GetCharHeight () * m_nPitch)
+		{
+			pPixel[m_nUsedHeight * m_nPitch] = Color;
+		}
+#endif
 	}
 }
 
@@ -1025,12 +1232,101 @@ TScreenColor CScreenDevice::GetPixel (unsigned nPosX, unsigned nPosY)
 	if (   nPosX < m_nWidth
 	    && nPosY < m_nHeight)
 	{
-		return m_pBuffer[m_nPitch * nPosY + nPosX];
+		return *GetPixelAddress (nPosX, nPosY);
 	}
 	
 	return m_BackgroundColor;
 }
 
+TScreenColor *CScreenDevice::GetPixelAddress (unsigned nPosX, unsigned nPosY)
+{
+	assert (nPosX < m_nWidth);
+	assert (nPosY < m_nHeight);
+
+#ifdef SCREEN_CONSOLE_MODE
+	if (m_bConsoleMode)
+	{
+		unsigned nCharHeight = m_CharGen.GetCharHeight ();
+		if (nPosY < m_nUsedHeight)
+		{
+			nPosY =   (m_nDisplayRow + nPosY / nCharHeight) % m_nRows * nCharHeight
+				+ nPosY % nCharHeight;
+		}
+		else
+		{
+			nPosY += m_nDisplayRow * nCharHeight;
+		}
+	}
+#endif
+
+	return m_pBuffer + m_nPitch * nPosY + nPosX;
+}
+
+void CScreenDevice::RenderChar (TScreenColor *pTarget, char chChar, TScreenColor Color,
+				TScreenColor BackgroundColor, boolean bCursor)
+{
+	assert (pTarget != 0);
+
+	unsigned nCharWidth = m_CharGen.GetCharWidth ();
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
+	unsigned nUnderline = bCursor ? m_CharGen.GetUnderline () : nCharHeight;
+
+	if (   m_bWordAccess
+	    && ((uintptr) pTarget & (sizeof (u32)-1)) == 0)
+	{
+		// write PIXELS_PER_WORD pixels at once, selected with a mask from the line bits
+		u32 nColor = EXPAND_COLOR (Color);
+		u32 nBackgroundColor = EXPAND_COLOR (BackgroundColor);
+		u32 nCursorColor = EXPAND_COLOR (m_Color);
+
+		for (unsigned y = 0; y < nCharHeight; y++)
+		{
+			u32 *pWord = (u32 *) pTarget;
+
+			if (y < nUnderline)
+			{
+				u32 nLine = m_CharGen.GetPixelLine (chChar, y);
+
+				for (unsigned x = nCharWidth; x > 0; x -= PIXELS_PER_WORD)
+				{
+					u32 nMask = s_PixelMask[  (nLine >> (x - PIXELS_PER_WORD))
+								& ((1 << PIXELS_PER_WORD)-1)];
+
+					*pWord++ = (nColor & nMask) | (nBackgroundColor & ~nMask);
+				}
+			}
+			else
+			{
+				for (unsigned x = 0; x < nCharWidth; x += PIXELS_PER_WORD)
+				{
+					*pWord++ = nCursorColor;
+				}
+			}
+
+			pTarget += m_nPitch;
+		}
+
+		return;
+	}
+
+	for (unsigned y = 0; y < nCharHeight; y++)
+	{
+		for (unsigned x = 0; x < nCharWidth; x++)
+		{
+			if (y >= nUnderline)
+			{
+				pTarget[x] = m_Color;
+			}
+			else
+			{
+				pTarget[x] = m_CharGen.GetPixel (chChar, x, y) ? Color : BackgroundColor;
+			}
+		}
+
+		pTarget += m_nPitch;
+	}
+}
+
 void CScreenDevice::Rotor (unsigned nIndex, unsigned nCount)
 {
 	static const char chChars[] = "-\\|/";
@@ -1043,6 +1339,281 @@ void CScreenDevice::Rotor (unsigned nIndex, unsigned nCount)
 	DisplayChar (chChars[nCount], nPosX, 0, HIGH_COLOR);
 }
 
+#ifdef SCREEN_CONSOLE_MODE
+
+boolean CScreenDevice::InitializeConsole (void)
+{
+	m_nColumns = GetColumns ();
+	m_nRows = GetRows ();
+	if (   m_nColumns == 0
+	    || m_nRows == 0)
+	{
+		return FALSE;
+	}
+
+	assert (m_pCells == 0);
+	m_pCells = new TScreenCell[m_nRows * m_nColumns];
+	assert (m_pDirty == 0);
+	m_pDirty = new TScreenDirtyRange[m_nRows];
+	if (   m_pCells == 0
+	    || m_pDirty == 0)
+	{
+		return FALSE;
+	}
+
+	m_nTopRow = 0;
+	m_nDisplayRow = 0;
+	m_nPendingScroll = 0;
+
+	for (unsigned nCellRow = 0; nCellRow < m_nRows; nCellRow++)
+	{
+		m_pDirty[nCellRow].nStart = m_nColumns;
+		m_pDirty[nCellRow].nEnd = 0;
+
+		ClearCells (nCellRow, 0, m_nColumns);
+	}
+
+	// clear the whole (virtual) frame buffer, the rows are painted on update
+	TScreenColor *pBuffer = m_pBuffer;
+	for (unsigned nSize = m_nSize / sizeof (TScreenColor); nSize > 0; nSize--)
+	{
+		*pBuffer++ = m_BackgroundColor;
+	}
+
+	if (   m_bHWScroll
+	    && !m_pFrameBuffer->SetVirtualOffset (0, 0))
+	{
+		m_bHWScroll = FALSE;
+	}
+
+	return TRUE;
+}
+
+void CScreenDevice::SetCell (unsigned nPosX, unsigned nPosY, char chChar,
+			     TScreenColor Color, TScreenColor BackgroundColor)
+{
+	unsigned nColumn = nPosX / m_CharGen.GetCharWidth ();
+	if (   nColumn >= m_nColumns
+	    || nPosY >= m_nUsedHeight)
+	{
+		return;
+	}
+
+	unsigned nCellRow = GetCellRow (nPosY);
+
+	TScreenCell *pCell = &m_pCells[nCellRow * m_nColumns + nColumn];
+	pCell->chChar = chChar;
+	pCell->Color = Color;
+	pCell->BackgroundColor = BackgroundColor;
+
+	SetDirty (nCellRow, nColumn, nColumn+1);
+}
+
+void CScreenDevice::ClearCells (unsigned nCellRow, unsigned nStart, unsigned nEnd)
+{
+	assert (nCellRow < m_nRows);
+	assert (nEnd <= m_nColumns);
+
+	TScreenCell *pCell = &m_pCells[nCellRow * m_nColumns + nStart];
+	for (unsigned nColumn = nStart; nColumn < nEnd; nColumn++)
+	{
+		pCell->chChar = ' ';
+		pCell->Color = m_BackgroundColor;
+		pCell->BackgroundColor = m_BackgroundColor;
+
+		pCell++;
+	}
+
+	SetDirty (nCellRow, nStart, nEnd);
+}
+
+void CScreenDevice::SetDirty (unsigned nCellRow, unsigned nStart, unsigned nEnd)
+{
+	assert (nCellRow < m_nRows);
+	TScreenDirtyRange *pDirty = &m_pDirty[nCellRow];
+
+	if (pDirty->nStart >= pDirty->nEnd)
+	{
+		pDirty->nStart = nStart;
+		pDirty->nEnd = nEnd;
+
+		return;
+	}
+
+	if (nStart < pDirty->nStart)
+	{
+		pDirty->nStart = nStart;
+	}
+
+	if (nEnd > pDirty->nEnd)
+	{
+		pDirty->nEnd = nEnd;
+	}
+}
+
+void CScreenDevice::SetCursorDirty (void)
+{
+	unsigned nColumn = m_nCursorX / m_CharGen.GetCharWidth ();
+	if (   nColumn < m_nColumns
+	    && m_nCursorY < m_nUsedHeight)
+	{
+		SetDirty (GetCellRow (m_nCursorY), nColumn, nColumn+1);
+	}
+}
+
+unsigned CScreenDevice::GetCellRow (unsigned nPosY) const
+{
+	assert (nPosY < m_nUsedHeight);
+
+	return (m_nTopRow + nPosY / m_CharGen.GetCharHeight ()) % m_nRows;
+}
+
+void CScreenDevice::ScrollConsole (void)
+{
+	unsigned nStartRow = m_nScrollStart / m_CharGen.GetCharHeight ();
+	unsigned nEndRow = m_nScrollEnd / m_CharGen.GetCharHeight ();
+	assert (nStartRow < nEndRow);
+	assert (nEndRow <= m_nRows);
+
+	if (   nStartRow == 0
+	    && nEndRow == m_nRows)
+	{
+		// the top row becomes the new bottom row, the display is moved on update
+		unsigned nCellRow = m_nTopRow;
+
+		if (++m_nTopRow == m_nRows)
+		{
+			m_nTopRow = 0;
+		}
+
+		ClearCells (nCellRow, 0, m_nColumns);
+
+		m_nPendingScroll++;
+
+		return;
+	}
+
+	// scroll region: move the cells and repaint the whole region
+	for (unsigned nRow = nStartRow; nRow+1 < nEndRow; nRow++)
+	{
+		unsigned nCellRow = (m_nTopRow + nRow) % m_nRows;
+
+		memcpy (&m_pCells[nCellRow * m_nColumns],
+			&m_pCells[(m_nTopRow + nRow+1) % m_nRows * m_nColumns],
+			m_nColumns * sizeof (TScreenCell));
+
+		SetDirty (nCellRow, 0, m_nColumns);
+	}
+
+	ClearCells ((m_nTopRow + nEndRow-1) % m_nRows, 0, m_nColumns);
+}
+
+void CScreenDevice::UpdateConsole (boolean bTaskLevel)
+{
+	unsigned nPrevDisplayRow = m_nDisplayRow;
+
+	if (m_nPendingScroll > 0)
+	{
+		if (   m_bHWScroll
+		    && bTaskLevel)
+		{
+			// the rows scrolled in are dirty, all others are already in place
+			m_nDisplayRow = (m_nDisplayRow + m_nPendingScroll) % m_nRows;
+		}
+		else
+		{
+			// the display cannot be moved, repaint everything
+			for (unsigned nCellRow = 0; nCellRow < m_nRows; nCellRow++)
+			{
+				SetDirty (nCellRow, 0, m_nColumns);
+			}
+		}
+
+		m_nPendingScroll = 0;
+	}
+
+	PaintConsole ();
+
+	if (m_nDisplayRow == nPrevDisplayRow)
+	{
+		return;
+	}
+
+	// the second copy of the display row is visible below the used screen height
+	// in parts, but is never painted, so clear these lines
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
+	TScreenColor *pBuffer = m_pBuffer + (m_nRows + m_nDisplayRow) * nCharHeight * m_nPitch;
+	for (unsigned nSize = (m_nHeight - m_nUsedHeight) * m_nPitch; nSize > 0; nSize--)
+	{
+		*pBuffer++ = m_BackgroundColor;
+	}
+
+	if (!m_pFrameBuffer->SetVirtualOffset (0, m_nDisplayRow * nCharHeight))
+	{
+		// display was not moved, continue without scrolling by hardware
+		m_bHWScroll = FALSE;
+		m_nDisplayRow = nPrevDisplayRow;
+
+		for (unsigned nCellRow = 0; nCellRow < m_nRows; nCellRow++)
+		{
+			SetDirty (nCellRow, 0, m_nColumns);
+		}
+
+		PaintConsole ();
+	}
+}
+
+void CScreenDevice::PaintConsole (void)
+{
+	unsigned nCharWidth = m_CharGen.GetCharWidth ();
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
+
+	unsigned nCursorColumn = m_nCursorX / nCharWidth;
+	unsigned nCursorRow = m_bCursorVisible ? m_nCursorY / nCharHeight : m_nRows;
+
+	for (unsigned nRow = 0; nRow < m_nRows; nRow++)
+	{
+		unsigned nCellRow = (m_nTopRow + nRow) % m_nRows;
+
+		TScreenDirtyRange *pDirty = &m_pDirty[nCellRow];
+		if (pDirty->nStart >= pDirty->nEnd)
+		{
+			continue;
+		}
+
+		unsigned nDisplayRow = (m_nDisplayRow + nRow) % m_nRows;
+		TScreenColor *pTarget = m_pBuffer + nDisplayRow * nCharHeight * m_nPitch;
+
+		// rows above the display row are visible a second time below the used height
+		TScreenColor *pTarget2 = 0;
+		if (nDisplayRow < m_nDisplayRow)
+		{
+			pTarget2 = pTarget + m_nUsedHeight * m_nPitch;
+		}
+
+		const TScreenCell *pCell = &m_pCells[nCellRow * m_nColumns];
+		for (unsigned nColumn = pDirty->nStart; nColumn < pDirty->nEnd; nColumn++)
+		{
+			boolean bCursor = nRow == nCursorRow && nColumn == nCursorColumn;
+
+			RenderChar (pTarget + nColumn * nCharWidth, pCell[nColumn].chChar,
+				    pCell[nColumn].Color, pCell[nColumn].BackgroundColor, bCursor);
+
+			if (pTarget2 != 0)
+			{
+				RenderChar (pTarget2 + nColumn * nCharWidth, pCell[nColumn].chChar,
+					    pCell[nColumn].Color, pCell[nColumn].BackgroundColor,
+					    bCursor);
+			}
+		}
+
+		pDirty->nStart = m_nColumns;
+		pDirty->nEnd = 0;
+	}
+}
+
+#endif	// #ifdef SCREEN_CONSOLE_MODE
+
 #else	// #ifndef SCREEN_HEADLESS
 
 CScreenDevice::CScreenDevice (unsigned nWidth, unsigned nHeight, boolean bVirtual, unsigned nDisplay)
@@ -2,7 +2,7 @@
 // serial.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,8 @@
 #include <circle/memio.h>
 #include <circle/machineinfo.h>
 #include <circle/synchronize.h>
+#include <circle/new.h>
+#include <circle/util.h>
 #include <assert.h>
 
 #ifndef USE_RPI_STUB_AT
@@ -47,6 +49,7 @@
 #define ARM_UART_RIS    	(m_nBaseAddress + 0x3C)
 #define ARM_UART_MIS    	(m_nBaseAddress + 0x40)
 #define ARM_UART_ICR    	(m_nBaseAddress + 0x44)
+#define ARM_UART_DMACR  	(m_nBaseAddress + 0x48)
 
 // Definitions from Raspberry PI Remote Serial Protocol.
 //     Copyright 2012 Jamie Iles, jamie@jamieiles.com.
@@ -105,6 +108,17 @@
 #define INT_DCDM		(1 << 2)
 #define INT_CTSM		(1 << 1)
 
+#define DMACR_DMAONERR_MASK	(1 << 2)
+#define DMACR_TXDMAE_MASK	(1 << 1)
+#define DMACR_RXDMAE_MASK	(1 << 0)
+
+// DMA mode
+#define TX_DMA_CHUNK		256			// max. characters per send transfer
+#define RX_DMA_SEGMENT		256			// characters per receive segment
+#define RX_DMA_SEGMENTS		4
+#define RX_DMA_SIZE		(RX_DMA_SEGMENT * RX_DMA_SEGMENTS)	// must be a power of 2
+#define RX_DMA_MASK		(RX_DMA_SIZE-1)
+
 static uintptr s_BaseAddress[SERIAL_DEVICES] =
 {
 	ARM_IO_BASE + 0x201000,
@@ -155,11 +169,22 @@ CSerialDevice::CSerialDevice (CInterruptSystem *pInterruptSystem, boolean bUseFI
 	m_nDevice (nDevice),
 	m_nBaseAddress (0),
 	m_bValid (FALSE),
+	m_pRxBuffer (0),
+	m_nRxBufferMask (SERIAL_BUF_MASK),
 	m_nRxInPtr (0),
 	m_nRxOutPtr (0),
 	m_nRxStatus (0),
+	m_pTxBuffer (0),
+	m_nTxBufferMask (SERIAL_BUF_MASK),
 	m_nTxInPtr (0),
 	m_nTxOutPtr (0),
+	m_bUseDMA (FALSE),
+	m_pTxDMAChannel (0),
+	m_pTxDMABuffer (0),
+	m_bTxDMAActive (FALSE),
+	m_pRxDMAChannel (0),
+	m_pRxDMABuffer (0),
+	m_nRxDMAOutPtr (0),
 	m_nOptions (SERIAL_OPTION_ONLCR),
 	m_pMagic (0),
 	m_SpinLock (bUseFIQ ? FIQ_LEVEL : IRQ_LEVEL)
@@ -167,6 +192,8 @@ CSerialDevice::CSerialDevice (CInterruptSystem *pInterruptSystem, boolean bUseFI
 	, m_LineSpinLock (TASK_LEVEL)
 #endif
 {
+	memset (&m_Statistics, 0, sizeof m_Statistics);
+
 	if (   m_nDevice >= SERIAL_DEVICES
 	    || s_GPIOConfig[nDevice][0][VALUE_PIN] >= GPIO_PINS)
 	{
@@ -198,6 +225,11 @@ CSerialDevice::CSerialDevice (CInterruptSystem *pInterruptSystem, boolean bUseFI
 	m_RxDPin.SetMode (ALT_FUNC (nDevice, GPIO_RXD));
 	m_RxDPin.SetPullMode (GPIOPullModeUp);
 
+	m_pRxBuffer = new u8[SERIAL_BUF_SIZE];
+	m_pTxBuffer = new u8[SERIAL_BUF_SIZE];
+	assert (m_pRxBuffer != 0);
+	assert (m_pTxBuffer != 0);
+
 	m_bValid = TRUE;
 }
 
@@ -205,6 +237,9 @@ CSerialDevice::~CSerialDevice (void)
 {
 	if (!m_bValid)
 	{
+		delete [] m_pRxBuffer;
+		delete [] m_pTxBuffer;
+
 		return;
 	}
 
@@ -217,8 +252,34 @@ CSerialDevice::~CSerialDevice (void)
 	PeripheralEntry ();
 	write32 (ARM_UART_IMSC, 0);
 	write32 (ARM_UART_CR, 0);
+	if (m_bUseDMA)
+	{
+		write32 (ARM_UART_DMACR, 0);
+	}
 	PeripheralExit ();
 
+	if (m_pRxDMAChannel != 0)
+	{
+		m_pRxDMAChannel->Cancel ();
+
+		delete m_pRxDMAChannel;
+		m_pRxDMAChannel = 0;
+	}
+
+	if (m_pTxDMAChannel != 0)
+	{
+		m_pTxDMAChannel->Cancel ();
+
+		delete m_pTxDMAChannel;
+		m_pTxDMAChannel = 0;
+	}
+
+	delete [] m_pRxDMABuffer;
+	m_pRxDMABuffer = 0;
+
+	delete [] m_pTxDMABuffer;
+	m_pTxDMABuffer = 0;
+
 	// disconnect interrupt, if this is the last device, which uses interrupts
 	if (   m_pInterruptSystem != 0
 	    && --s_nInterruptUseCount == 0)
@@ -242,6 +303,41 @@ CSerialDevice::~CSerialDevice (void)
 
 	s_pThis[m_nDevice] = 0;
 	m_bValid = FALSE;
+
+	delete [] m_pRxBuffer;
+	m_pRxBuffer = 0;
+
+	delete [] m_pTxBuffer;
+	m_pTxBuffer = 0;
+}
+
+void CSerialDevice::Configure (unsigned nRxBufferSize, unsigned nTxBufferSize, boolean bUseDMA)
+{
+	if (!m_bValid)
+	{
+		return;
+	}
+
+	assert (nRxBufferSize >= 2 && !(nRxBufferSize & (nRxBufferSize-1)));
+	assert (nTxBufferSize >= 2 && !(nTxBufferSize & (nTxBufferSize-1)));
+	assert (m_nTxInPtr == m_nTxOutPtr);
+
+	delete [] m_pRxBuffer;
+	m_pRxBuffer = new u8[nRxBufferSize];
+	assert (m_pRxBuffer != 0);
+	m_nRxBufferMask = nRxBufferSize-1;
+	m_nRxInPtr = 0;
+	m_nRxOutPtr = 0;
+
+	delete [] m_pTxBuffer;
+	m_pTxBuffer = new u8[nTxBufferSize];
+	assert (m_pTxBuffer != 0);
+	m_nTxBufferMask = nTxBufferSize-1;
+	m_nTxInPtr = 0;
+	m_nTxOutPtr = 0;
+
+	// only UART0 has DREQ lines
+	m_bUseDMA = bUseDMA && m_pInterruptSystem != 0 && m_nDevice == 0;
 }
 
 boolean CSerialDevice::Initialize (unsigned nBaudrate,
@@ -299,6 +395,40 @@ boolean CSerialDevice::Initialize (unsigned nBaudrate,
 		s_nInterruptUseCount++;
 	}
 
+	if (m_bUseDMA)
+	{
+		assert (m_pInterruptSystem != 0);
+
+		m_pTxDMAChannel = new CDMAChannel (DMA_CHANNEL_NORMAL, m_pInterruptSystem);
+		assert (m_pTxDMAChannel != 0);
+		m_pTxDMAChannel->SetCompletionRoutine (TxDMACompletionStub, this);
+
+		m_pTxDMABuffer = new (HEAP_DMA30) u32[TX_DMA_CHUNK];
+		assert (m_pTxDMABuffer != 0);
+
+		// the receive buffer is filled continuously, the segment routine
+		// moves the received characters into the receive ring buffer
+		m_pRxDMAChannel = new CDMAChannel (DMA_CHANNEL_NORMAL, m_pInterruptSystem);
+		assert (m_pRxDMAChannel != 0);
+
+		m_pRxDMABuffer = new (HEAP_DMA30) u32[RX_DMA_SIZE];
+		assert (m_pRxDMABuffer != 0);
+
+		m_pRxDMAChannel->SetupChain (RX_DMA_SEGMENTS);
+		for (unsigned i = 0; i < RX_DMA_SEGMENTS; i++)
+		{
+			m_pRxDMAChannel->AddIORead (&m_pRxDMABuffer[i * RX_DMA_SEGMENT],
+						    (u32) ARM_UART_DR,
+						    RX_DMA_SEGMENT * sizeof (u32),
+						    DREQSourceUARTRX, TRUE);
+		}
+
+		m_pRxDMAChannel->SetCyclic ();
+		m_pRxDMAChannel->SetSegmentRoutine (RxDMASegmentStub, this);
+
+		m_nRxDMAOutPtr = 0;
+	}
+
 	PeripheralEntry ();
 
 	write32 (ARM_UART_IMSC, 0);
@@ -349,7 +479,17 @@ boolean CSerialDevice::Initialize (unsigned nBaudrate,
 		write32 (ARM_UART_IFLS,   IFLS_IFSEL_1_4 << IFLS_TXIFSEL_SHIFT
 					| IFLS_IFSEL_1_4 << IFLS_RXIFSEL_SHIFT);
 		write32 (ARM_UART_LCRH, nLCRH);
-		write32 (ARM_UART_IMSC, INT_RX | INT_RT | INT_OE);
+
+		if (!m_bUseDMA)
+		{
+			write32 (ARM_UART_IMSC, INT_RX | INT_RT | INT_OE);
+		}
+		else
+		{
+			// the interrupts are used to detect the idle line and errors only
+			write32 (ARM_UART_DMACR, DMACR_TXDMAE_MASK | DMACR_RXDMAE_MASK);
+			write32 (ARM_UART_IMSC, INT_RT | INT_OE);
+		}
 
 		// add device to interrupt handling
 		s_nInterruptDeviceMask |= 1 << m_nDevice;
@@ -364,6 +504,11 @@ boolean CSerialDevice::Initialize (unsigned nBaudrate,
 
 	PeripheralExit ();
 
+	if (m_bUseDMA)
+	{
+		m_pRxDMAChannel->Start ();
+	}
+
 	CDeviceNameService::Get ()->AddDevice ("ttyS", m_nDevice+1, this, FALSE);
 
 	return TRUE;
@@ -392,6 +537,8 @@ int CSerialDevice::Write (const void *pBuffer, size_t nCount)
 	{
 		if (!Write (*pChar))
 		{
+			m_Statistics.nTxDropped += nCount+1;
+
 			break;
 		}
 
@@ -401,6 +548,8 @@ int CSerialDevice::Write (const void *pBuffer, size_t nCount)
 			{
 				if (!Write ('\r'))
 				{
+					m_Statistics.nTxDropped += nCount+1;
+
 					break;
 				}
 			}
@@ -415,7 +564,14 @@ int CSerialDevice::Write (const void *pBuffer, size_t nCount)
 	{
 		m_SpinLock.Acquire ();
 
-		if (m_nTxInPtr != m_nTxOutPtr)
+		if (m_bUseDMA)
+		{
+			if (!m_bTxDMAActive)
+			{
+				StartTxDMA ();
+			}
+		}
+		else if (m_nTxInPtr != m_nTxOutPtr)
 		{
 			PeripheralEntry ();
 
@@ -423,8 +579,8 @@ int CSerialDevice::Write (const void *pBuffer, size_t nCount)
 			{
 				if (!(read32 (ARM_UART_FR) & FR_TXFF_MASK))
 				{
-					write32 (ARM_UART_DR, m_TxBuffer[m_nTxOutPtr++]);
-					m_nTxOutPtr &= SERIAL_BUF_MASK;
+					write32 (ARM_UART_DR, m_pTxBuffer[m_nTxOutPtr++]);
+					m_nTxOutPtr &= m_nTxBufferMask;
 				}
 				else
 				{
@@ -454,8 +610,15 @@ int CSerialDevice::Read (void *pBuffer, size_t nCount)
 
 	if (m_pInterruptSystem != 0)
 	{
+		boolean bMagicReceived = FALSE;
+
 		m_SpinLock.Acquire ();
 
+		if (m_bUseDMA)
+		{
+			bMagicReceived = SyncRxDMA ();
+		}
+
 		if (m_nRxStatus < 0)
 		{
 			nResult = m_nRxStatus;
@@ -470,8 +633,8 @@ int CSerialDevice::Read (void *pBuffer, size_t nCount)
 					break;
 				}
 
-				*pChar++ = m_RxBuffer[m_nRxOutPtr++];
-				m_nRxOutPtr &= SERIAL_BUF_MASK;
+				*pChar++ = m_pRxBuffer[m_nRxOutPtr++];
+				m_nRxOutPtr &= m_nRxBufferMask;
 
 				nCount--;
 				nResult++;
@@ -479,6 +642,11 @@ int CSerialDevice::Read (void *pBuffer, size_t nCount)
 		}
 
 		m_SpinLock.Release ();
+
+		if (bMagicReceived)
+		{
+			(*m_pMagicReceivedHandler) ();
+		}
 	}
 	else
 	{
@@ -554,6 +722,18 @@ void CSerialDevice::RegisterMagicReceivedHandler (const char *pMagic, TMagicRece
 	m_pMagic = pMagic;		// enables the scanner
 }
 
+void CSerialDevice::GetStatistics (TSerialStatistics *pStatistics)
+{
+	assert (m_bValid);
+	assert (pStatistics != 0);
+
+	m_SpinLock.Acquire ();
+
+	*pStatistics = m_Statistics;
+
+	m_SpinLock.Release ();
+}
+
 unsigned CSerialDevice::AvailableForWrite (void)
 {
 	assert (m_bValid);
@@ -564,7 +744,7 @@ unsigned CSerialDevice::AvailableForWrite (void)
 	unsigned nResult;
 	if (m_nTxOutPtr <= m_nTxInPtr)
 	{
-		nResult = SERIAL_BUF_SIZE+m_nTxOutPtr-m_nTxInPtr-1;
+		nResult = m_nTxBufferMask+1+m_nTxOutPtr-m_nTxInPtr-1;
 	}
 	else
 	{
@@ -581,12 +761,19 @@ unsigned CSerialDevice::AvailableForRead (void)
 	assert (m_bValid);
 	assert (m_pInterruptSystem != 0);
 
+	boolean bMagicReceived = FALSE;
+
 	m_SpinLock.Acquire ();
 
+	if (m_bUseDMA)
+	{
+		bMagicReceived = SyncRxDMA ();
+	}
+
 	unsigned nResult;
 	if (m_nRxInPtr < m_nRxOutPtr)
 	{
-		nResult = SERIAL_BUF_SIZE+m_nRxInPtr-m_nRxOutPtr;
+		nResult = m_nRxBufferMask+1+m_nRxInPtr-m_nRxOutPtr;
 	}
 	else
 	{
@@ -595,6 +782,11 @@ unsigned CSerialDevice::AvailableForRead (void)
 
 	m_SpinLock.Release ();
 
+	if (bMagicReceived)
+	{
+		(*m_pMagicReceivedHandler) ();
+	}
+
 	return nResult;
 }
 
@@ -603,16 +795,28 @@ int CSerialDevice::Peek (void)
 	assert (m_bValid);
 	assert (m_pInterruptSystem != 0);
 
+	boolean bMagicReceived = FALSE;
+
 	m_SpinLock.Acquire ();
 
+	if (m_bUseDMA)
+	{
+		bMagicReceived = SyncRxDMA ();
+	}
+
 	int nResult = -1;
 	if (m_nRxInPtr != m_nRxOutPtr)
 	{
-		nResult = m_RxBuffer[m_nRxOutPtr];
+		nResult = m_pRxBuffer[m_nRxOutPtr];
 	}
 
 	m_SpinLock.Release ();
 
+	if (bMagicReceived)
+	{
+		(*m_pMagicReceivedHandler) ();
+	}
+
 	return nResult;
 }
 
@@ -636,10 +840,10 @@ boolean CSerialDevice::Write (u8 uchChar)
 	{
 		m_SpinLock.Acquire ();
 
-		if (((m_nTxInPtr+1) & SERIAL_BUF_MASK) != m_nTxOutPtr)
+		if (((m_nTxInPtr+1) & m_nTxBufferMask) != m_nTxOutPtr)
 		{
-			m_TxBuffer[m_nTxInPtr++] = uchChar;
-			m_nTxInPtr &= SERIAL_BUF_MASK;
+			m_pTxBuffer[m_nTxInPtr++] = uchChar;
+			m_nTxInPtr &= m_nTxBufferMask;
 		}
 		else
 		{
@@ -665,75 +869,250 @@ boolean CSerialDevice::Write (u8 uchChar)
 	return bOK;
 }
 
-void CSerialDevice::InterruptHandler (void)
+boolean CSerialDevice::ReceiveChar (u32 nDR)
 {
-	boolean bMagicReceived = FALSE;
+	if (nDR & DR_BE_MASK)
+	{
+		m_Statistics.nBreaks++;
 
-	m_SpinLock.Acquire ();
+		if (m_nRxStatus == 0)
+		{
+			m_nRxStatus = -SERIAL_ERROR_BREAK;
+		}
+	}
+	else if (nDR & DR_OE_MASK)
+	{
+		m_Statistics.nFIFOOverruns++;
 
-	PeripheralEntry ();
+		if (m_nRxStatus == 0)
+		{
+			m_nRxStatus = -SERIAL_ERROR_OVERRUN;
+		}
+	}
+	else if (nDR & DR_FE_MASK)
+	{
+		m_Statistics.nFramingErrors++;
 
-	// acknowledge pending interrupts
-	write32 (ARM_UART_ICR, read32 (ARM_UART_MIS));
+		if (m_nRxStatus == 0)
+		{
+			m_nRxStatus = -SERIAL_ERROR_FRAMING;
+		}
+	}
+	else if (nDR & DR_PE_MASK)
+	{
+		m_Statistics.nParityErrors++;
 
-	while (!(read32 (ARM_UART_FR) & FR_RXFE_MASK))
+		if (m_nRxStatus == 0)
+		{
+			m_nRxStatus = -SERIAL_ERROR_PARITY;
+		}
+	}
+
+	boolean bMagicReceived = FALSE;
+
+	if (m_pMagic != 0)
 	{
-		u32 nDR = read32 (ARM_UART_DR);
-		if (nDR & DR_BE_MASK)
+		if ((char) (nDR & 0xFF) == *m_pMagicPtr)
 		{
-			if (m_nRxStatus == 0)
+			if (*++m_pMagicPtr == '\0')
 			{
-				m_nRxStatus = -SERIAL_ERROR_BREAK;
+				bMagicReceived = TRUE;
 			}
 		}
-		else if (nDR & DR_OE_MASK)
+		else
 		{
-			if (m_nRxStatus == 0)
-			{
-				m_nRxStatus = -SERIAL_ERROR_OVERRUN;
-			}
+			m_pMagicPtr = m_pMagic;
 		}
-		else if (nDR & DR_FE_MASK)
+	}
+
+	if (((m_nRxInPtr+1) & m_nRxBufferMask) != m_nRxOutPtr)
+	{
+		m_pRxBuffer[m_nRxInPtr++] = nDR & 0xFF;
+		m_nRxInPtr &= m_nRxBufferMask;
+	}
+	else
+	{
+		m_Statistics.nBufferOverruns++;
+
+		if (m_nRxStatus == 0)
 		{
-			if (m_nRxStatus == 0)
-			{
-				m_nRxStatus = -SERIAL_ERROR_FRAMING;
-			}
+			m_nRxStatus = -SERIAL_ERROR_OVERRUN;
 		}
-		else if (nDR & DR_PE_MASK)
+	}
+
+	return bMagicReceived;
+}
+
+// m_SpinLock must be acquired
+void CSerialDevice::StartTxDMA (void)
+{
+	assert (m_pTxDMAChannel != 0);
+	assert (m_pTxDMABuffer != 0);
+	assert (!m_bTxDMAActive);
+
+	// the data register is written word-wise, one character per word
+	unsigned nCount = 0;
+	while (   m_nTxInPtr != m_nTxOutPtr
+	       && nCount < TX_DMA_CHUNK)
+	{
+		m_pTxDMABuffer[nCount++] = m_pTxBuffer[m_nTxOutPtr++];
+		m_nTxOutPtr &= m_nTxBufferMask;
+	}
+
+	if (nCount == 0)
+	{
+		return;
+	}
+
+	m_bTxDMAActive = TRUE;
+
+	m_pTxDMAChannel->SetupIOWrite ((u32) ARM_UART_DR, m_pTxDMABuffer,
+				       nCount * sizeof (u32), DREQSourceUARTTX);
+	m_pTxDMAChannel->Start ();
+}
+
+void CSerialDevice::TxDMACompletionHandler (boolean bStatus)
+{
+	m_SpinLock.Acquire ();
+
+	assert (m_bTxDMAActive);
+	m_bTxDMAActive = FALSE;
+
+	StartTxDMA ();
+
+	m_SpinLock.Release ();
+}
+
+void CSerialDevice::TxDMACompletionStub (unsigned nChannel, boolean bStatus, void *pParam)
+{
+	CSerialDevice *pThis = (CSerialDevice *) pParam;
+	assert (pThis != 0);
+
+	pThis->TxDMACompletionHandler (bStatus);
+}
+
+// m_SpinLock must be acquired
+boolean CSerialDevice::SyncRxDMA (void)
+{
+	assert (m_pRxDMAChannel != 0);
+	assert (m_pRxDMABuffer != 0);
+
+	// process the characters, which have been received in the current segment so far
+	uintptr nAddress = m_pRxDMAChannel->GetDestinationAddress ();
+	uintptr nBuffer = (uintptr) m_pRxDMABuffer;
+	if (   nAddress < nBuffer
+	    || nAddress > nBuffer + RX_DMA_SIZE * sizeof (u32))
+	{
+		return FALSE;
+	}
+
+	return ReceiveDMA (((nAddress - nBuffer) / sizeof (u32)) & RX_DMA_MASK);
+}
+
+// m_SpinLock must be acquired
+boolean CSerialDevice::ReceiveDMA (unsigned nEndPtr)
+{
+	assert (nEndPtr < RX_DMA_SIZE);
+
+	boolean bMagicReceived = FALSE;
+
+	unsigned nPtr = m_nRxDMAOutPtr;
+	unsigned nCount = (nEndPtr - nPtr) & RX_DMA_MASK;
+	while (nCount > 0)
+	{
+		unsigned nChunk = RX_DMA_SIZE - nPtr;
+		if (nChunk > nCount)
 		{
-			if (m_nRxStatus == 0)
-			{
-				m_nRxStatus = -SERIAL_ERROR_PARITY;
-			}
+			nChunk = nCount;
 		}
 
-		if (m_pMagic != 0)
+		// the cache lines may have been loaded before the DMA engine wrote to them
+		uintptr nStart =   (uintptr) &m_pRxDMABuffer[nPtr]
+				 & ~((uintptr) DATA_CACHE_LINE_LENGTH_MIN-1);
+		uintptr nEnd = (uintptr) &m_pRxDMABuffer[nPtr + nChunk];
+		CleanAndInvalidateDataCacheRange (nStart, nEnd - nStart);
+
+		nCount -= nChunk;
+		while (nChunk-- > 0)
 		{
-			if ((char) (nDR & 0xFF) == *m_pMagicPtr)
+			if (ReceiveChar (m_pRxDMABuffer[nPtr++]))
 			{
-				if (*++m_pMagicPtr == '\0')
-				{
-					bMagicReceived = TRUE;
-				}
-			}
-			else
-			{
-				m_pMagicPtr = m_pMagic;
+				bMagicReceived = TRUE;
 			}
 		}
 
-		if (((m_nRxInPtr+1) & SERIAL_BUF_MASK) != m_nRxOutPtr)
+		nPtr &= RX_DMA_MASK;
+	}
+
+	m_nRxDMAOutPtr = nPtr;
+
+	return bMagicReceived;
+}
+
+void CSerialDevice::RxDMASegmentHandler (unsigned nSegment)
+{
+	assert (nSegment < RX_DMA_SEGMENTS);
+	unsigned nEndPtr = ((nSegment+1) * RX_DMA_SEGMENT) & RX_DMA_MASK;
+
+	boolean bMagicReceived = FALSE;
+
+	m_SpinLock.Acquire ();
+
+	// the segment may have been processed by SyncRxDMA() already
+	if (((nEndPtr - m_nRxDMAOutPtr) & RX_DMA_MASK) <= RX_DMA_SEGMENT)
+	{
+		bMagicReceived = ReceiveDMA (nEndPtr);
+	}
+
+	m_SpinLock.Release ();
+
+	if (bMagicReceived)
+	{
+		(*m_pMagicReceivedHandler) ();
+	}
+}
+
+void CSerialDevice::RxDMASegmentStub (unsigned nChannel, unsigned nSegment, void *pParam)
+{
+	CSerialDevice *pThis = (CSerialDevice *) pParam;
+	assert (pThis != 0);
+
+	pThis->RxDMASegmentHandler (nSegment);
+}
+
+void CSerialDevice::InterruptHandler (void)
+{
+	boolean bMagicReceived = FALSE;
+
+	m_SpinLock.Acquire ();
+
+	PeripheralEntry ();
+
+	// acknowledge pending interrupts
+	write32 (ARM_UART_ICR, read32 (ARM_UART_MIS));
+
+	if (m_bUseDMA)
+	{
+		PeripheralExit ();
+
+		// receive timeout or error, flush the partially filled DMA segment
+		bMagicReceived = SyncRxDMA ();
+
+		m_SpinLock.Release ();
+
+		if (bMagicReceived)
 		{
-			m_RxBuffer[m_nRxInPtr++] = nDR & 0xFF;
-			m_nRxInPtr &= SERIAL_BUF_MASK;
+			(*m_pMagicReceivedHandler) ();
 		}
-		else
+
+		return;
+	}
+
+	while (!(read32 (ARM_UART_FR) & FR_RXFE_MASK))
+	{
+		if (ReceiveChar (read32 (ARM_UART_DR)))
 		{
-			if (m_nRxStatus == 0)
-			{
-				m_nRxStatus = -SERIAL_ERROR_OVERRUN;
-			}
+			bMagicReceived = TRUE;
 		}
 	}
 
@@ -741,8 +1120,8 @@ void CSerialDevice::InterruptHandler (void)
 	{
 		if (m_nTxInPtr != m_nTxOutPtr)
 		{
-			write32 (ARM_UART_DR, m_TxBuffer[m_nTxOutPtr++]);
-			m_nTxOutPtr &= SERIAL_BUF_MASK;
+			write32 (ARM_UART_DR, m_pTxBuffer[m_nTxOutPtr++]);
+			m_nTxOutPtr &= m_nTxBufferMask;
 		}
 		else
 		{
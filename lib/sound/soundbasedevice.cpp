@@ -2,7 +2,7 @@
 // soundbasedevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -28,17 +28,13 @@ CSoundBaseDevice::CSoundBaseDevice (void)
 	m_nNeedDataThreshold (0),
 	m_WriteFormat (SoundFormatUnknown),
 	m_nWriteChannels (0),
-	m_pQueue (0),
-	m_nInPtr (0),
-	m_nOutPtr (0),
 	m_pCallback (0),
+	m_nUnderruns (0),
+	m_bQueueEmpty (TRUE),
 	m_nReadQueueSize (0),
 	m_nHaveDataThreshold (0),
 	m_ReadFormat (SoundFormatUnknown),
 	m_nReadChannels (0),
-	m_pReadQueue (0),
-	m_nReadInPtr (0),
-	m_nReadOutPtr (0),
 	m_pReadCallback (0),
 	m_pReadCallbackParam (0)
 {
@@ -51,17 +47,13 @@ CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigne
 	m_nNeedDataThreshold (0),
 	m_WriteFormat (SoundFormatUnknown),
 	m_nWriteChannels (0),
-	m_pQueue (0),
-	m_nInPtr (0),
-	m_nOutPtr (0),
 	m_pCallback (0),
+	m_nUnderruns (0),
+	m_bQueueEmpty (TRUE),
 	m_nReadQueueSize (0),
 	m_nHaveDataThreshold (0),
 	m_ReadFormat (SoundFormatUnknown),
 	m_nReadChannels (0),
-	m_pReadQueue (0),
-	m_nReadInPtr (0),
-	m_nReadOutPtr (0),
 	m_pReadCallback (0),
 	m_pReadCallbackParam (0)
 {
@@ -72,11 +64,6 @@ CSoundBaseDevice::~CSoundBaseDevice (void)
 {
 	m_pCallback = 0;
 	m_pReadCallback = 0;
-
-	delete [] m_pQueue;
-	m_pQueue = 0;
-	delete [] m_pReadQueue;
-	m_pReadQueue = 0;
 }
 
 void CSoundBaseDevice::Setup (TSoundFormat HWFormat, u32 nRange32, unsigned nSampleRate,
@@ -166,6 +153,16 @@ void CSoundBaseDevice::Setup (TSoundFormat HWFormat, u32 nRange32, unsigned nSam
 	}
 }
 
+TSoundFormat CSoundBaseDevice::GetHWFormat (void) const
+{
+	return m_HWFormat;
+}
+
+unsigned CSoundBaseDevice::GetSampleRate (void) const
+{
+	return m_nSampleRate;
+}
+
 unsigned CSoundBaseDevice::GetHWTXChannels (void) const
 {
 	return m_nHWTXChannels;
@@ -190,15 +187,16 @@ int CSoundBaseDevice::GetRangeMax (void) const
 
 boolean CSoundBaseDevice::AllocateQueue (unsigned nSizeMsecs)
 {
-	assert (m_pQueue == 0);
+	assert (m_nQueueSize == 0);
 	assert (1 <= nSizeMsecs && nSizeMsecs <= 1000);
 
 	// 1 byte remains free
 	m_nQueueSize = (m_nHWTXFrameSize*m_nSampleRate*nSizeMsecs + 999) / 1000 + 1;
 
-	m_pQueue = new u8[m_nQueueSize];
-	if (m_pQueue == 0)
+	if (!m_Queue.Initialize (m_nQueueSize-1))
 	{
+		m_nQueueSize = 0;
+
 		return FALSE;
 	}
 
@@ -209,15 +207,16 @@ boolean CSoundBaseDevice::AllocateQueue (unsigned nSizeMsecs)
 
 boolean CSoundBaseDevice::AllocateQueueFrames (unsigned nSizeFrames)
 {
-	assert (m_pQueue == 0);
+	assert (m_nQueueSize == 0);
 	assert (1 <= nSizeFrames && nSizeFrames <= m_nSampleRate);
 
 	// 1 byte remains free
 	m_nQueueSize = m_nHWTXFrameSize*nSizeFrames + 1;
 
-	m_pQueue = new u8[m_nQueueSize];
-	if (m_pQueue == 0)
+	if (!m_Queue.Initialize (m_nQueueSize-1))
 	{
+		m_nQueueSize = 0;
+
 		return FALSE;
 	}
 
@@ -269,8 +268,6 @@ int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
 
 	int nResult = 0;
 
-	m_SpinLock.Acquire ();
-
 	if (   m_HWFormat == m_WriteFormat
 	    && m_nWriteChannels == m_nHWTXChannels
 	    && !m_bSwapChannels)
@@ -372,8 +369,6 @@ int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
 		}
 	}
 
-	m_SpinLock.Release ();
-
 	return nResult;
 }
 
@@ -387,12 +382,8 @@ unsigned CSoundBaseDevice::GetQueueFramesAvail (void)
 {
 	assert (m_nQueueSize > 0);
 
-	m_SpinLock.Acquire ();
-
 	unsigned nQueueBytesAvail = GetQueueBytesAvail ();
 
-	m_SpinLock.Release ();
-
 	return nQueueBytesAvail / m_nHWTXFrameSize;
 }
 
@@ -405,6 +396,11 @@ void CSoundBaseDevice::RegisterNeedDataCallback (TSoundDataCallback *pCallback,
 	m_pCallbackParam = pParam;
 }
 
+unsigned CSoundBaseDevice::GetUnderruns (void) const
+{
+	return m_nUnderruns;
+}
+
 boolean CSoundBaseDevice::AreChannelsSwapped (void) const
 {
 	return m_bSwapChannels;
@@ -414,15 +410,16 @@ boolean CSoundBaseDevice::AreChannelsSwapped (void) const
 
 boolean CSoundBaseDevice::AllocateReadQueue (unsigned nSizeMsecs)
 {
-	assert (m_pReadQueue == 0);
+	assert (m_nReadQueueSize == 0);
 	assert (1 <= nSizeMsecs && nSizeMsecs <= 1000);
 
 	// 1 byte remains free
 	m_nReadQueueSize = (m_nHWRXFrameSize*m_nSampleRate*nSizeMsecs + 999) / 1000 + 1;
 
-	m_pReadQueue = new u8[m_nReadQueueSize];
-	if (m_pReadQueue == 0)
+	if (!m_ReadQueue.Initialize (m_nReadQueueSize-1))
 	{
+		m_nReadQueueSize = 0;
+
 		return FALSE;
 	}
 
@@ -433,15 +430,16 @@ boolean CSoundBaseDevice::AllocateReadQueue (unsigned nSizeMsecs)
 
 boolean CSoundBaseDevice::AllocateReadQueueFrames (unsigned nSizeFrames)
 {
-	assert (m_pReadQueue == 0);
+	assert (m_nReadQueueSize == 0);
 	assert (1 <= nSizeFrames && nSizeFrames <= m_nSampleRate);
 
 	// 1 byte remains free
 	m_nReadQueueSize = m_nHWRXFrameSize*nSizeFrames + 1;
 
-	m_pReadQueue = new u8[m_nReadQueueSize];
-	if (m_pReadQueue == 0)
+	if (!m_ReadQueue.Initialize (m_nReadQueueSize-1))
 	{
+		m_nReadQueueSize = 0;
+
 		return FALSE;
 	}
 
@@ -495,8 +493,6 @@ int CSoundBaseDevice::Read (void *pBuffer, size_t nCount)
 
 	int nResult = 0;
 
-	m_ReadSpinLock.Acquire ();
-
 	if (   m_HWFormat == m_ReadFormat
 	    && m_nReadChannels == m_nHWRXChannels)
 	{
@@ -595,8 +591,6 @@ int CSoundBaseDevice::Read (void *pBuffer, size_t nCount)
 		}
 	}
 
-	m_ReadSpinLock.Release ();
-
 	return nResult;
 }
 
@@ -610,12 +604,8 @@ unsigned CSoundBaseDevice::GetReadQueueFramesAvail (void)
 {
 	assert (m_nReadQueueSize > 0);
 
-	m_ReadSpinLock.Acquire ();
-
 	unsigned nReadQueueBytesAvail = GetReadQueueBytesAvail ();
 
-	m_ReadSpinLock.Release ();
-
 	return nReadQueueBytesAvail / m_nHWRXFrameSize;
 }
 
@@ -760,8 +750,6 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 	assert (nChunkSize % m_nHWTXChannels == 0);
 	unsigned nChunkSizeBytes = nChunkSize * m_nHWSampleSize;
 
-	m_SpinLock.Acquire ();
-
 	unsigned nQueueBytesAvail = GetQueueBytesAvail ();
 	unsigned nBytes = nQueueBytesAvail;
 	if (nBytes > nChunkSizeBytes)
@@ -777,7 +765,20 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 		nQueueBytesAvail -= nBytes;
 	}
 
-	m_SpinLock.Release ();
+	// count it once, when the queue runs empty after data has been sent
+	if (nBytes < nChunkSizeBytes)
+	{
+		if (!m_bQueueEmpty)
+		{
+			m_nUnderruns++;
+
+			m_bQueueEmpty = TRUE;
+		}
+	}
+	else
+	{
+		m_bQueueEmpty = FALSE;
+	}
 
 	while (nBytes < nChunkSizeBytes)
 	{
@@ -838,65 +839,35 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 unsigned CSoundBaseDevice::GetQueueBytesFree (void)
 {
 	assert (m_nQueueSize > 1);
-	assert (m_nInPtr < m_nQueueSize);
-	assert (m_nOutPtr < m_nQueueSize);
 
-	if (m_nOutPtr <= m_nInPtr)
-	{
-		return m_nQueueSize+m_nOutPtr-m_nInPtr-1;
-	}
-
-	return m_nOutPtr-m_nInPtr-1;
+	return m_Queue.GetFree ();
 }
 
 unsigned CSoundBaseDevice::GetQueueBytesAvail (void)
 {
 	assert (m_nQueueSize > 1);
-	assert (m_nInPtr < m_nQueueSize);
-	assert (m_nOutPtr < m_nQueueSize);
 
-	if (m_nInPtr < m_nOutPtr)
-	{
-		return m_nQueueSize+m_nInPtr-m_nOutPtr;
-	}
-
-	return m_nInPtr-m_nOutPtr;
+	return m_Queue.GetCount ();
 }
 
 void CSoundBaseDevice::Enqueue (const void *pBuffer, unsigned nCount)
 {
-	const u8 *p = static_cast<const u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pQueue != 0);
-
+	assert (pBuffer != 0);
 	assert (nCount > 0);
-	while (nCount-- > 0)
-	{
-		m_pQueue[m_nInPtr] = *p++;
 
-		if (++m_nInPtr == m_nQueueSize)
-		{
-			m_nInPtr = 0;
-		}
-	}
+	unsigned nResult = m_Queue.Enqueue (static_cast<const u8 *> (pBuffer), nCount);
+	assert (nResult == nCount);
+	(void) nResult;
 }
 
 void CSoundBaseDevice::Dequeue (void *pBuffer, unsigned nCount)
 {
-	u8 *p = static_cast<u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pQueue != 0);
-
+	assert (pBuffer != 0);
 	assert (nCount > 0);
-	while (nCount-- > 0)
-	{
-		*p++ = m_pQueue[m_nOutPtr];
 
-		if (++m_nOutPtr == m_nQueueSize)
-		{
-			m_nOutPtr = 0;
-		}
-	}
+	unsigned nResult = m_Queue.Dequeue (static_cast<u8 *> (pBuffer), nCount);
+	assert (nResult == nCount);
+	(void) nResult;
 }
 
 // Input //////////////////////////////////////////////////////////////
@@ -925,8 +896,6 @@ void CSoundBaseDevice::PutChunkInternal (const void *pBuffer, unsigned nChunkSiz
 	assert (nChunkSize % m_nHWRXChannels == 0);
 	unsigned nChunkSizeBytes = nChunkSize * m_nHWSampleSize;
 
-	m_ReadSpinLock.Acquire ();
-
 	unsigned nReadQueueBytesFree = GetReadQueueBytesFree ();
 	unsigned nBytes = nReadQueueBytesFree;
 	if (nBytes > nChunkSizeBytes)
@@ -941,8 +910,6 @@ void CSoundBaseDevice::PutChunkInternal (const void *pBuffer, unsigned nChunkSiz
 		nReadQueueBytesFree -= nBytes;
 	}
 
-	m_ReadSpinLock.Release ();
-
 	if (   m_pReadCallback != 0
 	    && nReadQueueBytesFree < m_nHaveDataThreshold)
 	{
@@ -1005,63 +972,33 @@ void CSoundBaseDevice::ConvertReadSoundFormat (void *pTo, const void *pFrom)
 unsigned CSoundBaseDevice::GetReadQueueBytesFree (void)
 {
 	assert (m_nReadQueueSize > 1);
-	assert (m_nReadInPtr < m_nReadQueueSize);
-	assert (m_nReadOutPtr < m_nReadQueueSize);
-
-	if (m_nReadOutPtr <= m_nReadInPtr)
-	{
-		return m_nReadQueueSize+m_nReadOutPtr-m_nReadInPtr-1;
-	}
 
-	return m_nReadOutPtr-m_nReadInPtr-1;
+	return m_ReadQueue.GetFree ();
 }
 
 unsigned CSoundBaseDevice::GetReadQueueBytesAvail (void)
 {
 	assert (m_nReadQueueSize > 1);
-	assert (m_nReadInPtr < m_nReadQueueSize);
-	assert (m_nReadOutPtr < m_nReadQueueSize);
-
-	if (m_nReadInPtr < m_nReadOutPtr)
-	{
-		return m_nReadQueueSize+m_nReadInPtr-m_nReadOutPtr;
-	}
 
-	return m_nReadInPtr-m_nReadOutPtr;
+	return m_ReadQueue.GetCount ();
 }
 
 void CSoundBaseDevice::ReadEnqueue (const void *pBuffer, unsigned nCount)
 {
-	const u8 *p = static_cast<const u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pReadQueue != 0);
-
+	assert (pBuffer != 0);
 	assert (nCount > 0);
-	while (nCount-- > 0)
-	{
-		m_pReadQueue[m_nReadInPtr] = *p++;
 
-		if (++m_nReadInPtr == m_nReadQueueSize)
-		{
-			m_nReadInPtr = 0;
-		}
-	}
+	unsigned nResult = m_ReadQueue.Enqueue (static_cast<const u8 *> (pBuffer), nCount);
+	assert (nResult == nCount);
+	(void) nResult;
 }
 
 void CSoundBaseDevice::ReadDequeue (void *pBuffer, unsigned nCount)
 {
-	u8 *p = static_cast<u8 *> (pBuffer);
-	assert (p != 0);
-	assert (m_pReadQueue != 0);
-
+	assert (pBuffer != 0);
 	assert (nCount > 0);
-	while (nCount-- > 0)
-	{
-		*p++ = m_pReadQueue[m_nReadOutPtr];
 
-		if (++m_nReadOutPtr == m_nReadQueueSize)
-		{
-			m_nReadOutPtr = 0;
-		}
-	}
+	unsigned nResult = m_ReadQueue.Dequeue (static_cast<u8 *> (pBuffer), nCount);
+	assert (nResult == nCount);
+	(void) nResult;
 }
@@ -0,0 +1,618 @@
+//
+// soundmixer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sound/soundmixer.h>
+#include <circle/sysconfig.h>
+#include <circle/util.h>
+#include <assert.h>
+
+// The NEON registers are saved on IRQ only with this option, and the mixer runs in IRQ context
+#if (defined (__ARM_NEON) || defined (__ARM_NEON__)) && defined (SAVE_VFP_REGS_ON_IRQ)
+	#include <arm_neon.h>
+	#define MIXER_NEON
+#endif
+
+#define PHASE_ONE	0x10000			// 1.0 in Q16
+
+static void ConvertFromFormat (s32 *pTo, const void *pFrom, unsigned nFrames,
+			       TSoundFormat Format, unsigned nChannels);
+static void ConvertToFormat (void *pTo, const s32 *pFrom, unsigned nSamples, TSoundFormat Format);
+static void MixSamples (s32 *pMix, const s32 *pSamples, unsigned nSamples, s32 nGain);
+
+CSoundMixer::CSoundMixer (CSoundBaseDevice *pDevice, unsigned nLatencyMsecs)
+:	m_pDevice (pDevice),
+	m_nLatencyMsecs (nLatencyMsecs),
+	m_nSampleRate (0),
+	m_bQueueAllocated (FALSE),
+	m_WriteFormat (SoundFormatSigned24_32),
+	m_nWriteFrameSize (2 * sizeof (s32))
+{
+	assert (m_pDevice != 0);
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		m_pStream[i] = 0;
+	}
+}
+
+CSoundMixer::~CSoundMixer (void)
+{
+	assert (m_pDevice != 0);
+	assert (!m_pDevice->IsActive ());
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		delete m_pStream[i];
+		m_pStream[i] = 0;
+	}
+
+	m_pDevice = 0;
+}
+
+boolean CSoundMixer::Start (void)
+{
+	assert (m_pDevice != 0);
+	m_nSampleRate = m_pDevice->GetSampleRate ();
+
+	if (!m_bQueueAllocated)
+	{
+		// a signed 16-bit device gets the data as is, all others get 24-bit samples
+		if (m_pDevice->GetHWFormat () == SoundFormatSigned16)
+		{
+			m_WriteFormat = SoundFormatSigned16;
+			m_nWriteFrameSize = 2 * sizeof (s16);
+		}
+
+		m_pDevice->SetWriteFormat (m_WriteFormat, 2);
+
+		assert (1 <= m_nLatencyMsecs && m_nLatencyMsecs <= 1000);
+		unsigned nQueueFrames = (m_nSampleRate * m_nLatencyMsecs + 999) / 1000;
+		if (!m_pDevice->AllocateQueueFrames (nQueueFrames))
+		{
+			return FALSE;
+		}
+
+		m_bQueueAllocated = TRUE;
+
+		m_pDevice->RegisterNeedDataCallback (NeedDataHandler, this);
+	}
+
+	Mix ();				// pre-fill the device queue
+
+	return m_pDevice->Start ();
+}
+
+void CSoundMixer::Cancel (void)
+{
+	assert (m_pDevice != 0);
+	m_pDevice->Cancel ();
+}
+
+int CSoundMixer::AddStream (TSoundFormat Format, unsigned nChannels, unsigned nSampleRate,
+			    unsigned nQueueMsecs)
+{
+	assert (m_pDevice != 0);
+	unsigned nDeviceRate = m_pDevice->GetSampleRate ();
+	assert (nDeviceRate > 0);
+
+	assert (nSampleRate > 0);
+	assert (1 <= nQueueMsecs && nQueueMsecs <= 1000);
+
+	TStream *pStream = new TStream;
+	if (pStream == 0)
+	{
+		return -1;
+	}
+
+	pStream->Format = Format;
+	switch (Format)
+	{
+	case SoundFormatUnsigned8:	pStream->nSampleSize = sizeof (u8);	break;
+	case SoundFormatSigned16:	pStream->nSampleSize = sizeof (s16);	break;
+	case SoundFormatSigned24:	pStream->nSampleSize = sizeof (u8)*3;	break;
+	case SoundFormatSigned24_32:	pStream->nSampleSize = sizeof (s32);	break;
+
+	default:
+		assert (0);
+		delete pStream;
+		return -1;
+	}
+
+	assert (nChannels == 1 || nChannels == 2);
+	pStream->nChannels = nChannels;
+	pStream->nFrameSize = nChannels * pStream->nSampleSize;
+
+	unsigned nQueueFrames = (nSampleRate * nQueueMsecs + 999) / 1000;
+	if (!pStream->Queue.Initialize (nQueueFrames * pStream->nFrameSize))
+	{
+		delete pStream;
+
+		return -1;
+	}
+
+	pStream->nNeedDataThreshold = nQueueFrames * pStream->nFrameSize / 2;
+	pStream->pCallback = 0;
+	pStream->pCallbackParam = 0;
+
+	pStream->nGain = 0x7FFFFFFF;
+	pStream->nStep = ((u64) nSampleRate << 16) / nDeviceRate;
+	assert (pStream->nStep > 0);
+	assert (pStream->nStep < SOUND_MIXER_CHUNK_FRAMES * PHASE_ONE);
+	pStream->nPhase = 2 * PHASE_ONE;	// fetch two frames before the first output
+	pStream->Prev[0] = pStream->Prev[1] = 0;
+	pStream->Next[0] = pStream->Next[1] = 0;
+
+	pStream->bStarved = TRUE;		// not playing yet
+	pStream->nUnderruns = 0;
+
+	m_SpinLock.Acquire ();
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		if (m_pStream[i] == 0)
+		{
+			m_pStream[i] = pStream;
+
+			m_SpinLock.Release ();
+
+			return i;
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	delete pStream;
+
+	return -1;
+}
+
+void CSoundMixer::RemoveStream (unsigned nStream)
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+
+	m_SpinLock.Acquire ();
+
+	TStream *pStream = m_pStream[nStream];
+	m_pStream[nStream] = 0;
+
+	m_SpinLock.Release ();
+
+	delete pStream;
+}
+
+void CSoundMixer::SetGain (unsigned nStream, unsigned nGain)
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+	TStream *pStream = m_pStream[nStream];
+	assert (pStream != 0);
+
+	assert (nGain <= SOUND_MIXER_GAIN_UNITY);
+	u32 nGain31 = nGain << 15;		// Q16 to Q31
+	if (nGain31 > 0x7FFFFFFF)
+	{
+		nGain31 = 0x7FFFFFFF;
+	}
+
+	pStream->nGain = (s32) nGain31;
+}
+
+int CSoundMixer::Write (unsigned nStream, const void *pBuffer, size_t nCount)
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+	TStream *pStream = m_pStream[nStream];
+	assert (pStream != 0);
+
+	assert (pBuffer != 0);
+
+	unsigned nBytes = pStream->Queue.GetFree ();
+	if (nBytes > nCount)
+	{
+		nBytes = nCount;
+	}
+	nBytes -= nBytes % pStream->nFrameSize;		// must be a multiple of frame size
+
+	if (nBytes == 0)
+	{
+		return 0;
+	}
+
+	return pStream->Queue.Enqueue (static_cast<const u8 *> (pBuffer), nBytes);
+}
+
+unsigned CSoundMixer::GetQueueFramesAvail (unsigned nStream) const
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+	TStream *pStream = m_pStream[nStream];
+	assert (pStream != 0);
+
+	return pStream->Queue.GetCount () / pStream->nFrameSize;
+}
+
+void CSoundMixer::RegisterNeedDataCallback (unsigned nStream, TSoundDataCallback *pCallback,
+					    void *pParam)
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+	TStream *pStream = m_pStream[nStream];
+	assert (pStream != 0);
+
+	m_SpinLock.Acquire ();
+
+	pStream->pCallbackParam = pParam;
+	pStream->pCallback = pCallback;
+
+	m_SpinLock.Release ();
+}
+
+unsigned CSoundMixer::GetUnderruns (unsigned nStream) const
+{
+	assert (nStream < SOUND_MIXER_MAX_STREAMS);
+	TStream *pStream = m_pStream[nStream];
+	assert (pStream != 0);
+
+	return pStream->nUnderruns;
+}
+
+unsigned CSoundMixer::GetDeviceUnderruns (void) const
+{
+	assert (m_pDevice != 0);
+
+	return m_pDevice->GetUnderruns ();
+}
+
+void CSoundMixer::Mix (void)
+{
+	assert (m_pDevice != 0);
+
+	m_SpinLock.Acquire ();
+
+	while (1)
+	{
+		unsigned nFrames =   m_pDevice->GetQueueSizeFrames ()
+				   - m_pDevice->GetQueueFramesAvail ();
+		if (nFrames == 0)
+		{
+			break;
+		}
+
+		if (nFrames > SOUND_MIXER_CHUNK_FRAMES)
+		{
+			nFrames = SOUND_MIXER_CHUNK_FRAMES;
+		}
+
+		memset (m_MixBuffer, 0, nFrames * 2 * sizeof (s32));
+
+		for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+		{
+			if (m_pStream[i] != 0)
+			{
+				MixStream (m_pStream[i], nFrames);
+			}
+		}
+
+		ConvertToFormat (m_WriteBuffer, m_MixBuffer, nFrames * 2, m_WriteFormat);
+
+		unsigned nBytes = nFrames * m_nWriteFrameSize;
+		if (m_pDevice->Write (m_WriteBuffer, nBytes) != (int) nBytes)
+		{
+			break;
+		}
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CSoundMixer::MixStream (TStream *pStream, unsigned nFrames)
+{
+	assert (pStream != 0);
+	assert (nFrames <= SOUND_MIXER_CHUNK_FRAMES);
+
+	unsigned nDone = 0;
+	while (nDone < nFrames)
+	{
+		s32 *pOut = &m_StreamBuffer[nDone * 2];
+		unsigned nOut = nFrames - nDone;
+
+		// number of input frames, which will be fetched for nOut output frames
+		unsigned nIn = nOut;
+		if (pStream->nStep != PHASE_ONE)
+		{
+			u64 ullEnd = pStream->nPhase + (u64) (nOut-1) * pStream->nStep;
+			if (ullEnd >> 16 > SOUND_MIXER_CHUNK_FRAMES)
+			{
+				ullEnd = (SOUND_MIXER_CHUNK_FRAMES << 16) | 0xFFFF;
+				assert (ullEnd >= pStream->nPhase);
+				nOut = (ullEnd - pStream->nPhase) / pStream->nStep + 1;
+
+				ullEnd = pStream->nPhase + (u64) (nOut-1) * pStream->nStep;
+			}
+
+			nIn = ullEnd >> 16;
+		}
+
+		boolean bShort = FALSE;
+		unsigned nAvail = pStream->Queue.GetCount () / pStream->nFrameSize;
+		if (nIn > nAvail)
+		{
+			nIn = nAvail;
+			bShort = TRUE;
+		}
+
+		if (nIn > 0)
+		{
+			u8 *pRaw = reinterpret_cast<u8 *> (m_RawBuffer);
+			unsigned nResult = pStream->Queue.Dequeue (pRaw, nIn * pStream->nFrameSize);
+			assert (nResult == nIn * pStream->nFrameSize);
+			(void) nResult;
+		}
+
+		if (pStream->nStep == PHASE_ONE)
+		{
+			// same sample rate, no conversion needed
+			ConvertFromFormat (pOut, m_RawBuffer, nIn, pStream->Format, pStream->nChannels);
+
+			nDone += nIn;
+		}
+		else
+		{
+			ConvertFromFormat (m_InputBuffer, m_RawBuffer, nIn, pStream->Format,
+					   pStream->nChannels);
+
+			// linear interpolation between the input frames Prev and Next
+			const s32 *pIn = m_InputBuffer;
+			u32 nPhase = pStream->nPhase;
+			unsigned i;
+			for (i = 0; i < nOut; i++)
+			{
+				while (   nPhase >= PHASE_ONE
+				       && nIn > 0)
+				{
+					pStream->Prev[0] = pStream->Next[0];
+					pStream->Prev[1] = pStream->Next[1];
+					pStream->Next[0] = *pIn++;
+					pStream->Next[1] = *pIn++;
+					nIn--;
+
+					nPhase -= PHASE_ONE;
+				}
+
+				if (nPhase >= PHASE_ONE)
+				{
+					break;		// input exhausted
+				}
+
+				*pOut++ = pStream->Prev[0] + (s32) (((s64) pStream->Next[0] - pStream->Prev[0])
+								    * nPhase >> 16);
+				*pOut++ = pStream->Prev[1] + (s32) (((s64) pStream->Next[1] - pStream->Prev[1])
+								    * nPhase >> 16);
+
+				nPhase += pStream->nStep;
+			}
+
+			pStream->nPhase = nPhase;
+			assert (nIn == 0);
+
+			nDone += i;
+		}
+
+		if (bShort)
+		{
+			break;
+		}
+	}
+
+	MixSamples (m_MixBuffer, m_StreamBuffer, nDone * 2, pStream->nGain);
+
+	// count it once, when the stream runs dry while playing
+	if (nDone < nFrames)
+	{
+		if (!pStream->bStarved)
+		{
+			pStream->nUnderruns++;
+
+			pStream->bStarved = TRUE;
+		}
+	}
+	else
+	{
+		pStream->bStarved = FALSE;
+	}
+
+	if (   pStream->pCallback != 0
+	    && pStream->Queue.GetCount () < pStream->nNeedDataThreshold)
+	{
+		(*pStream->pCallback) (pStream->pCallbackParam);
+	}
+}
+
+void CSoundMixer::NeedDataHandler (void *pParam)
+{
+	CSoundMixer *pThis = static_cast<CSoundMixer *> (pParam);
+	assert (pThis != 0);
+
+	pThis->Mix ();
+}
+
+// Samples are converted to full scale s32 values, like in CSoundBaseDevice.
+static void ConvertFromFormat (s32 *pTo, const void *pFrom, unsigned nFrames,
+			       TSoundFormat Format, unsigned nChannels)
+{
+	assert (pTo != 0);
+	assert (pFrom != 0);
+	assert (nChannels == 1 || nChannels == 2);
+
+	switch (Format)
+	{
+	case SoundFormatUnsigned8: {
+		const u8 *pSample = static_cast<const u8 *> (pFrom);
+		for (; nFrames > 0; nFrames--)
+		{
+			s32 nLeft = ((s32) *pSample++ - 128) << 24;
+			*pTo++ = nLeft;
+			*pTo++ = nChannels == 2 ? ((s32) *pSample++ - 128) << 24 : nLeft;
+		}
+		} break;
+
+	case SoundFormatSigned16: {
+		const s16 *pSample = static_cast<const s16 *> (pFrom);
+		if (nChannels == 2)
+		{
+#ifdef MIXER_NEON
+			for (; nFrames >= 4; nFrames -= 4, pSample += 8, pTo += 8)
+			{
+				int16x8_t Samples = vld1q_s16 (pSample);
+
+				vst1q_s32 (pTo,     vshll_n_s16 (vget_low_s16 (Samples), 16));
+				vst1q_s32 (pTo + 4, vshll_n_s16 (vget_high_s16 (Samples), 16));
+			}
+#endif
+			for (; nFrames > 0; nFrames--)
+			{
+				*pTo++ = (s32) *pSample++ << 16;
+				*pTo++ = (s32) *pSample++ << 16;
+			}
+		}
+		else
+		{
+#ifdef MIXER_NEON
+			for (; nFrames >= 4; nFrames -= 4, pSample += 4, pTo += 8)
+			{
+				int32x4_t Samples = vshll_n_s16 (vld1_s16 (pSample), 16);
+				int32x4x2_t Frames = vzipq_s32 (Samples, Samples);
+
+				vst1q_s32 (pTo,     Frames.val[0]);
+				vst1q_s32 (pTo + 4, Frames.val[1]);
+			}
+#endif
+			for (; nFrames > 0; nFrames--)
+			{
+				s32 nValue = (s32) *pSample++ << 16;
+				*pTo++ = nValue;
+				*pTo++ = nValue;
+			}
+		}
+		} break;
+
+	case SoundFormatSigned24: {
+		const u8 *pSample = static_cast<const u8 *> (pFrom);
+		for (unsigned i = nFrames * nChannels; i > 0; i--, pSample += 3)
+		{
+			s32 nValue = (pSample[0] | pSample[1] << 8 | (u32) pSample[2] << 16) << 8;
+			*pTo++ = nValue;
+			if (nChannels == 1)
+			{
+				*pTo++ = nValue;
+			}
+		}
+		} break;
+
+	case SoundFormatSigned24_32: {
+		const u32 *pSample = static_cast<const u32 *> (pFrom);
+		for (unsigned i = nFrames * nChannels; i > 0; i--)
+		{
+			s32 nValue = (*pSample++ & 0xFFFFFF) << 8;
+			*pTo++ = nValue;
+			if (nChannels == 1)
+			{
+				*pTo++ = nValue;
+			}
+		}
+		} break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+static void ConvertToFormat (void *pTo, const s32 *pFrom, unsigned nSamples, TSoundFormat Format)
+{
+	assert (pTo != 0);
+	assert (pFrom != 0);
+
+	if (Format == SoundFormatSigned16)
+	{
+		s16 *pSample = static_cast<s16 *> (pTo);
+
+#ifdef MIXER_NEON
+		for (; nSamples >= 8; nSamples -= 8, pFrom += 8, pSample += 8)
+		{
+			int16x4_t Low = vshrn_n_s32 (vld1q_s32 (pFrom), 16);
+			int16x4_t High = vshrn_n_s32 (vld1q_s32 (pFrom + 4), 16);
+
+			vst1q_s16 (pSample, vcombine_s16 (Low, High));
+		}
+#endif
+
+		while (nSamples--)
+		{
+			*pSample++ = *pFrom++ >> 16;
+		}
+	}
+	else
+	{
+		assert (Format == SoundFormatSigned24_32);
+		s32 *pSample = static_cast<s32 *> (pTo);
+
+#ifdef MIXER_NEON
+		for (; nSamples >= 4; nSamples -= 4, pFrom += 4, pSample += 4)
+		{
+			vst1q_s32 (pSample, vshrq_n_s32 (vld1q_s32 (pFrom), 8));
+		}
+#endif
+
+		while (nSamples--)
+		{
+			*pSample++ = *pFrom++ >> 8;
+		}
+	}
+}
+
+// pMix[i] += pSamples[i] * nGain (Q31), saturated
+static void MixSamples (s32 *pMix, const s32 *pSamples, unsigned nSamples, s32 nGain)
+{
+	assert (pMix != 0);
+	assert (pSamples != 0);
+	assert (nGain >= 0);
+
+#ifdef MIXER_NEON
+	int32x4_t Gain = vdupq_n_s32 (nGain);
+
+	for (; nSamples >= 4; nSamples -= 4, pMix += 4, pSamples += 4)
+	{
+		int32x4_t Samples = vqdmulhq_s32 (vld1q_s32 (pSamples), Gain);
+
+		vst1q_s32 (pMix, vqaddq_s32 (vld1q_s32 (pMix), Samples));
+	}
+#endif
+
+	for (; nSamples > 0; nSamples--, pMix++)
+	{
+		s64 nValue = *pMix + ((s64) *pSamples++ * nGain >> 31);
+		if (nValue > 0x7FFFFFFF)
+		{
+			nValue = 0x7FFFFFFF;
+		}
+		else if (nValue < -0x7FFFFFFF-1)
+		{
+			nValue = -0x7FFFFFFF-1;
+		}
+
+		*pMix = (s32) nValue;
+	}
+}
@@ -2,7 +2,7 @@
 // timer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,24 +24,67 @@
 #include <circle/synchronize.h>
 #include <circle/logger.h>
 #include <circle/debug.h>
+#ifdef ARM_ALLOW_MULTI_CORE
+	#include <circle/multicore.h>
+#endif
 #include <assert.h>
 
 #if RASPPI >= 4 && !defined (USE_PHYSICAL_COUNTER)
 	#error USE_PHYSICAL_COUNTER is required on Raspberry Pi 4!
 #endif
 
+#if defined (TIMER_TICKLESS) && defined (ARM_ALLOW_MULTI_CORE)
+	#error TIMER_TICKLESS cannot be used with ARM_ALLOW_MULTI_CORE!
+#endif
+
+#define WHEEL_SLOT_MASK		(KERNEL_TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELAY		((1U << (KERNEL_TIMER_WHEEL_LEVELS * KERNEL_TIMER_WHEEL_BITS)) - 1)
+
+enum TKernelTimerState
+{
+	KernelTimerFree,
+	KernelTimerWheel,
+	KernelTimerHighRes,
+	KernelTimerRunning
+};
+
 struct TKernelTimer
 {
 #ifndef NDEBUG
 	unsigned	     m_nMagic;
 #define KERNEL_TIMER_MAGIC	0x4B544D43
 #endif
+	TKernelTimerState    m_State;
+	TKernelTimerHandle   m_hTimer;			// changes each time the object is freed
 	TKernelTimerHandler *m_pHandler;
-	unsigned	     m_nElapsesAt;
+	unsigned	     m_nElapsesAt;		// in ticks
+	u64		     m_nCounterElapsesAt;	// high-resolution timer only
 	void 		    *m_pParam;
 	void 		    *m_pContext;
+
+	TKernelTimer	    *m_pNext;			// in wheel slot, high-res or free list
+	TKernelTimer	   **m_ppPrev;			// pointer to the link, which points to us
+	unsigned	     m_nLevel;			// wheel slot
+	unsigned	     m_nIndex;
+};
+
+struct TKernelTimerBlock
+{
+	TKernelTimerBlock   *m_pNext;
+	unsigned	     m_nFirst;			// number of m_Timer[0]
+	TKernelTimer	     m_Timer[KERNEL_TIMERS];
 };
 
+// A timer handle consists of the number of the timer object (plus 1, so that it cannot
+// be 0) and a generation counter, which is incremented, when the object is freed.
+// This way a stale handle does not cancel a timer, which was started afterwards.
+#define TIMER_HANDLE_NUMBER_BITS	16
+#define TIMER_HANDLE_NUMBER_MASK	((1U << TIMER_HANDLE_NUMBER_BITS) - 1)
+#define TIMER_HANDLE_MAX_TIMERS		TIMER_HANDLE_NUMBER_MASK
+#define TIMER_HANDLE_GENERATION(h)	((h) >> TIMER_HANDLE_NUMBER_BITS)
+#define TIMER_HANDLE(num, gen)		(  (TKernelTimerHandle) ((num) + 1) \
+					 | (TKernelTimerHandle) (gen) << TIMER_HANDLE_NUMBER_BITS)
+
 static const char FromTimer[] = "timer";
 
 const unsigned CTimer::s_nDaysOfMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
@@ -52,10 +95,18 @@ CTimer *CTimer::s_pThis = 0;
 
 CTimer::CTimer (CInterruptSystem *pInterruptSystem)
 :	m_pInterruptSystem (pInterruptSystem),
+	m_nCounterFrequency (CLOCKHZ),
+	m_nCounterTicksPerHZTick (CLOCKHZ / HZ),
+	m_nNextTickAt (0),
+	m_nCompareAt (0),
 	m_nTicks (0),
 	m_nUptime (0),
 	m_nTime (0),
 	m_nMinutesDiff (0),
+	m_nWheelTicks (1),
+	m_pHighResList (0),
+	m_pTimerBlocks (0),
+	m_pFreeTimers (0),
 	m_nMsDelay (200000),
 	m_nusDelay (m_nMsDelay / 1000),
 	m_pUpdateTimeHandler (0),
@@ -63,6 +114,24 @@ CTimer::CTimer (CInterruptSystem *pInterruptSystem)
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
+
+	for (unsigned nLevel = 0; nLevel < KERNEL_TIMER_WHEEL_LEVELS; nLevel++)
+	{
+		for (unsigned nIndex = 0; nIndex < KERNEL_TIMER_WHEEL_SLOTS; nIndex++)
+		{
+			m_pWheel[nLevel][nIndex] = 0;
+		}
+
+		m_nWheelMask[nLevel] = 0;
+	}
+
+	// preallocate the timer objects, so that starting a timer does not use the heap
+	m_KernelTimerSpinLock.Acquire ();
+
+	TKernelTimer *pTimer = AllocateKernelTimer ();
+	FreeKernelTimer (pTimer);
+
+	m_KernelTimerSpinLock.Release ();
 }
 
 CTimer::~CTimer (void)
@@ -80,18 +149,17 @@ CTimer::~CTimer (void)
 	m_pInterruptSystem->DisconnectIRQ (ARM_IRQLOCAL0_CNTPNS);
 #endif
 
-	TPtrListElement *pElement;
-	while ((pElement = m_KernelTimerList.GetFirst ()) != 0)
+	while (m_pTimerBlocks != 0)
 	{
-		TKernelTimer *pTimer = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer != 0);
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
-
-		m_KernelTimerList.Remove (pElement);
+		TKernelTimerBlock *pBlock = m_pTimerBlocks;
+		m_pTimerBlocks = pBlock->m_pNext;
 
-		delete pTimer;
+		delete pBlock;
 	}
 
+	m_pFreeTimers = 0;
+	m_pHighResList = 0;
+
 	s_pThis = 0;
 }
 
@@ -104,30 +172,29 @@ boolean CTimer::Initialize (void)
 	PeripheralEntry ();
 
 	write32 (ARM_SYSTIMER_CLO, -(30 * CLOCKHZ));	// timer wraps soon, to check for problems
-
-	write32 (ARM_SYSTIMER_C3, read32 (ARM_SYSTIMER_CLO) + CLOCKHZ / HZ);
 #else
 	m_pInterruptSystem->ConnectIRQ (ARM_IRQLOCAL0_CNTPNS, InterruptHandler, this);
 
-#if AARCH == 32
-	u32 nCNTPCTLow, nCNTPCTHigh;
-	asm volatile ("mrrc p15, 0, %0, %1, c14" : "=r" (nCNTPCTLow), "=r" (nCNTPCTHigh));
-
-	u64 nCNTP_CVAL = ((u64) nCNTPCTHigh << 32 | nCNTPCTLow) + CLOCKHZ / HZ;
-	asm volatile ("mcrr p15, 2, %0, %1, c14" :: "r" (nCNTP_CVAL & 0xFFFFFFFFU),
-						    "r" (nCNTP_CVAL >> 32));
-
-	asm volatile ("mcr p15, 0, %0, c14, c2, 1" :: "r" (1));
-#else
+#if AARCH == 64
 	u64 nCNTFRQ;
 	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ));
 	assert (nCNTFRQ % HZ == 0);
-	m_nClockTicksPerHZTick = nCNTFRQ / HZ;
+	m_nCounterFrequency = nCNTFRQ;
+	m_nCounterTicksPerHZTick = nCNTFRQ / HZ;
+#endif
+#endif
 
-	u64 nCNTPCT;
-	asm volatile ("mrs %0, CNTPCT_EL0" : "=r" (nCNTPCT));
-	asm volatile ("msr CNTP_CVAL_EL0, %0" :: "r" (nCNTPCT + m_nClockTicksPerHZTick));
+	m_KernelTimerSpinLock.Acquire ();
+
+	m_nNextTickAt = GetCounter () + m_nCounterTicksPerHZTick;
+	ScheduleInterrupt ();
 
+	m_KernelTimerSpinLock.Release ();
+
+#ifdef USE_PHYSICAL_COUNTER
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c14, c2, 1" :: "r" (1));
+#else
 	asm volatile ("msr CNTP_CTL_EL0, %0" :: "r" (1UL));
 #endif
 #endif
@@ -241,7 +308,17 @@ unsigned CTimer::GetClockTicks (void)
 
 unsigned CTimer::GetTicks (void) const
 {
+#ifndef TIMER_TICKLESS
 	return m_nTicks;
+#else
+	EnterCritical ();
+
+	unsigned nTicks = m_nTicks + GetPendingTicks ();
+
+	LeaveCritical ();
+
+	return nTicks;
+#endif
 }
 
 unsigned CTimer::GetUptime (void) const
@@ -260,6 +337,9 @@ boolean CTimer::GetLocalTime (unsigned *pSeconds, unsigned *pMicroSeconds)
 
 	unsigned nTime = m_nTime;
 	unsigned nTicks = m_nTicks;
+#ifdef TIMER_TICKLESS
+	nTicks += GetPendingTicks ();
+#endif
 
 	m_TimeSpinLock.Release ();
 
@@ -291,6 +371,9 @@ boolean CTimer::GetUniversalTime (unsigned *pSeconds, unsigned *pMicroSeconds)
 
 	unsigned nTime = m_nTime;
 	unsigned nTicks = m_nTicks;
+#ifdef TIMER_TICKLESS
+	nTicks += GetPendingTicks ();
+#endif
 
 	m_TimeSpinLock.Release ();
 
@@ -315,6 +398,9 @@ CString *CTimer::GetTimeString (void)
 
 	unsigned nTime = m_nTime;
 	unsigned nTicks = m_nTicks;
+#ifdef TIMER_TICKLESS
+	nTicks += GetPendingTicks ();
+#endif
 
 	m_TimeSpinLock.Release ();
 
@@ -385,165 +471,534 @@ TKernelTimerHandle CTimer::StartKernelTimer (unsigned nDelay,
 					     void *pParam,
 					     void *pContext)
 {
-	TKernelTimer *pTimer = new TKernelTimer;
-	assert (pTimer != 0);
+	unsigned nElapsesAt = GetTicks () + (nDelay > 0 ? nDelay : 1);	// on the next tick at least
 
-	unsigned nElapsesAt = m_nTicks + nDelay;
+	m_KernelTimerSpinLock.Acquire ();
+
+	TKernelTimer *pTimer = AllocateKernelTimer ();
+	assert (pTimer != 0);
 
 	assert (pHandler != 0);
-#ifndef NDEBUG
-	pTimer->m_nMagic     = KERNEL_TIMER_MAGIC;
-#endif
 	pTimer->m_pHandler   = pHandler;
 	pTimer->m_nElapsesAt = nElapsesAt;
 	pTimer->m_pParam     = pParam;
 	pTimer->m_pContext   = pContext;
 
-	m_KernelTimerSpinLock.Acquire ();
+	InsertKernelTimer (pTimer);
 
-	TPtrListElement *pPrevElement = 0;
-	TPtrListElement *pElement = m_KernelTimerList.GetFirst ();
-	while (pElement != 0)
-	{
-		TKernelTimer *pTimer2 = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer2 != 0);
-		assert (pTimer2->m_nMagic == KERNEL_TIMER_MAGIC);
+#ifdef TIMER_TICKLESS
+	ScheduleInterrupt ();
+#endif
 
-		if ((int) (pTimer2->m_nElapsesAt-nElapsesAt) > 0)
-		{
-			break;
-		}
+	TKernelTimerHandle hTimer = pTimer->m_hTimer;
+
+	m_KernelTimerSpinLock.Release ();
+
+	return hTimer;
+}
+
+TKernelTimerHandle CTimer::StartHighResTimer (unsigned nMicroSeconds,
+					      TKernelTimerHandler *pHandler,
+					      void *pParam,
+					      void *pContext)
+{
+	u64 nElapsesAt = GetCounter () + (u64) nMicroSeconds * m_nCounterFrequency / 1000000;
+
+	m_KernelTimerSpinLock.Acquire ();
+
+	TKernelTimer *pTimer = AllocateKernelTimer ();
+	assert (pTimer != 0);
 
-		pPrevElement = pElement;
-		pElement = m_KernelTimerList.GetNext (pElement);
+	assert (pHandler != 0);
+	pTimer->m_State		    = KernelTimerHighRes;
+	pTimer->m_pHandler	    = pHandler;
+	pTimer->m_nCounterElapsesAt = nElapsesAt;
+	pTimer->m_pParam	    = pParam;
+	pTimer->m_pContext	    = pContext;
+
+	// the list is sorted and normally short
+	TKernelTimer **ppLink = &m_pHighResList;
+	while (   *ppLink != 0
+	       && (s64) ((*ppLink)->m_nCounterElapsesAt - nElapsesAt) <= 0)
+	{
+		ppLink = &(*ppLink)->m_pNext;
 	}
 
-	if (pElement != 0)
+	pTimer->m_pNext = *ppLink;
+	if (pTimer->m_pNext != 0)
 	{
-		m_KernelTimerList.InsertBefore (pElement, pTimer);
+		pTimer->m_pNext->m_ppPrev = &pTimer->m_pNext;
 	}
-	else
+	pTimer->m_ppPrev = ppLink;
+	*ppLink = pTimer;
+
+	// the compare register of the generic timer can be accessed on core 0 only
+	if (   m_pHighResList == pTimer
+#if defined (USE_PHYSICAL_COUNTER) && defined (ARM_ALLOW_MULTI_CORE)
+	    && CMultiCoreSupport::ThisCore () == 0
+#endif
+	    && (s64) (nElapsesAt - m_nCompareAt) < 0)
 	{
-		m_KernelTimerList.InsertAfter (pPrevElement, pTimer);
+		ScheduleInterrupt ();
 	}
 
+	TKernelTimerHandle hTimer = pTimer->m_hTimer;
+
 	m_KernelTimerSpinLock.Release ();
 
-	return (TKernelTimerHandle) pTimer;
+	return hTimer;
 }
 
 void CTimer::CancelKernelTimer (TKernelTimerHandle hTimer)
 {
-	TKernelTimer *pTimer = (TKernelTimer *) hTimer;
-	assert (pTimer != 0);
+	assert (hTimer != 0);
 
 	m_KernelTimerSpinLock.Acquire ();
 
-	TPtrListElement *pElement = m_KernelTimerList.Find (pTimer);
-	if (pElement != 0)
+	TKernelTimer *pTimer = GetKernelTimer (hTimer);
+	assert (pTimer != 0);
+	assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+
+	// the timer may have elapsed already (and the object may have been reused for
+	// another timer, which has another handle), the interrupt may remain scheduled
+	if (   pTimer->m_hTimer == hTimer
+	    && (   pTimer->m_State == KernelTimerWheel
+	        || pTimer->m_State == KernelTimerHighRes))
 	{
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+		RemoveKernelTimer (pTimer);
 
-		m_KernelTimerList.Remove (pElement);
+		FreeKernelTimer (pTimer);
+	}
+
+	m_KernelTimerSpinLock.Release ();
+}
+
+TKernelTimer *CTimer::AllocateKernelTimer (void)
+{
+	if (m_pFreeTimers == 0)
+	{
+		unsigned nFirst = m_pTimerBlocks != 0 ? m_pTimerBlocks->m_nFirst + KERNEL_TIMERS : 0;
+		if (nFirst + KERNEL_TIMERS > TIMER_HANDLE_MAX_TIMERS)
+		{
+			CLogger::Get ()->Write (FromTimer, LogPanic, "Too many kernel timers");
+		}
+
+		TKernelTimerBlock *pBlock = new TKernelTimerBlock;
+		assert (pBlock != 0);
+
+		pBlock->m_pNext = m_pTimerBlocks;
+		pBlock->m_nFirst = nFirst;
+		m_pTimerBlocks = pBlock;
+
+		for (unsigned i = 0; i < KERNEL_TIMERS; i++)
+		{
+			TKernelTimer *pTimer = &pBlock->m_Timer[i];
 
 #ifndef NDEBUG
-		pTimer->m_nMagic = 0;
+			pTimer->m_nMagic = KERNEL_TIMER_MAGIC;
 #endif
-		delete pTimer;
+			pTimer->m_State = KernelTimerFree;
+			pTimer->m_hTimer = TIMER_HANDLE (nFirst + i, 0);
+			pTimer->m_pNext = m_pFreeTimers;
+			m_pFreeTimers = pTimer;
+		}
 	}
 
-	m_KernelTimerSpinLock.Release ();
+	TKernelTimer *pTimer = m_pFreeTimers;
+	assert (pTimer != 0);
+	assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+	assert (pTimer->m_State == KernelTimerFree);
+	m_pFreeTimers = pTimer->m_pNext;
+
+	return pTimer;
+}
+
+void CTimer::FreeKernelTimer (TKernelTimer *pTimer)
+{
+	assert (pTimer != 0);
+	assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+
+	// invalidate the handle
+	TKernelTimerHandle hTimer = pTimer->m_hTimer;
+	pTimer->m_hTimer = TIMER_HANDLE ((hTimer & TIMER_HANDLE_NUMBER_MASK) - 1,
+					 TIMER_HANDLE_GENERATION (hTimer) + 1);
+
+	pTimer->m_State = KernelTimerFree;
+	pTimer->m_pNext = m_pFreeTimers;
+	m_pFreeTimers = pTimer;
+}
+
+TKernelTimer *CTimer::GetKernelTimer (TKernelTimerHandle hTimer)
+{
+	unsigned nNumber = (hTimer & TIMER_HANDLE_NUMBER_MASK) - 1;
+
+	// blocks are added in front of the list, normally there is only one
+	for (TKernelTimerBlock *pBlock = m_pTimerBlocks; pBlock != 0; pBlock = pBlock->m_pNext)
+	{
+		if (nNumber >= pBlock->m_nFirst)
+		{
+			assert (nNumber - pBlock->m_nFirst < KERNEL_TIMERS);
+
+			return &pBlock->m_Timer[nNumber - pBlock->m_nFirst];
+		}
+	}
+
+	return 0;
+}
+
+void CTimer::InsertKernelTimer (TKernelTimer *pTimer)
+{
+	assert (pTimer != 0);
+
+	unsigned nElapsesAt = pTimer->m_nElapsesAt;
+	unsigned nDelay = nElapsesAt - m_nWheelTicks;
+	if ((int) nDelay < 0)
+	{
+		nElapsesAt = m_nWheelTicks;
+		nDelay = 0;
+	}
+	else if (nDelay > WHEEL_MAX_DELAY)
+	{
+		nElapsesAt = m_nWheelTicks + WHEEL_MAX_DELAY;	// will be cascaded again
+		nDelay = WHEEL_MAX_DELAY;
+	}
+
+	unsigned nLevel = 0;
+	while (nDelay >= 1U << ((nLevel+1) * KERNEL_TIMER_WHEEL_BITS))
+	{
+		nLevel++;
+	}
+	assert (nLevel < KERNEL_TIMER_WHEEL_LEVELS);
+
+	unsigned nIndex = (nElapsesAt >> (nLevel * KERNEL_TIMER_WHEEL_BITS)) & WHEEL_SLOT_MASK;
+
+	pTimer->m_State  = KernelTimerWheel;
+	pTimer->m_nLevel = nLevel;
+	pTimer->m_nIndex = nIndex;
+
+	TKernelTimer **ppSlot = &m_pWheel[nLevel][nIndex];
+	pTimer->m_pNext = *ppSlot;
+	if (pTimer->m_pNext != 0)
+	{
+		pTimer->m_pNext->m_ppPrev = &pTimer->m_pNext;
+	}
+	pTimer->m_ppPrev = ppSlot;
+	*ppSlot = pTimer;
+
+	m_nWheelMask[nLevel] |= (u64) 1 << nIndex;
+}
+
+void CTimer::RemoveKernelTimer (TKernelTimer *pTimer)
+{
+	assert (pTimer != 0);
+	assert (pTimer->m_ppPrev != 0);
+
+	*pTimer->m_ppPrev = pTimer->m_pNext;
+	if (pTimer->m_pNext != 0)
+	{
+		pTimer->m_pNext->m_ppPrev = pTimer->m_ppPrev;
+	}
+
+	if (pTimer->m_State == KernelTimerWheel)
+	{
+		unsigned nLevel = pTimer->m_nLevel;
+		unsigned nIndex = pTimer->m_nIndex;
+
+		if (m_pWheel[nLevel][nIndex] == 0)
+		{
+			m_nWheelMask[nLevel] &= ~((u64) 1 << nIndex);
+		}
+	}
+
+	pTimer->m_pNext = 0;
+	pTimer->m_ppPrev = 0;
+}
+
+void CTimer::CascadeKernelTimers (unsigned nLevel, unsigned nIndex)
+{
+	TKernelTimer *pList = m_pWheel[nLevel][nIndex];
+	m_pWheel[nLevel][nIndex] = 0;
+	m_nWheelMask[nLevel] &= ~((u64) 1 << nIndex);
+
+	while (pList != 0)
+	{
+		TKernelTimer *pTimer = pList;
+		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+		pList = pTimer->m_pNext;
+
+		InsertKernelTimer (pTimer);
+	}
 }
 
 void CTimer::PollKernelTimers (void)
 {
 	m_KernelTimerSpinLock.Acquire ();
 
-	TPtrListElement *pElement = m_KernelTimerList.GetFirst ();
-	while (pElement != 0)
+	while ((int) (m_nTicks - m_nWheelTicks) >= 0)
 	{
-		TKernelTimer *pTimer = (TKernelTimer *) m_KernelTimerList.GetPtr (pElement);
-		assert (pTimer != 0);
-		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+		unsigned nIndex = m_nWheelTicks & WHEEL_SLOT_MASK;
 
-		if ((int) (pTimer->m_nElapsesAt-m_nTicks) > 0)
+		// move the timers of the next slot of the upper level(s) down on wrap
+		for (unsigned nLevel = 1; nIndex == 0 && nLevel < KERNEL_TIMER_WHEEL_LEVELS; nLevel++)
 		{
-			break;
+			nIndex = (m_nWheelTicks >> (nLevel * KERNEL_TIMER_WHEEL_BITS)) & WHEEL_SLOT_MASK;
+
+			CascadeKernelTimers (nLevel, nIndex);
 		}
 
-		TPtrListElement *pNextElement = m_KernelTimerList.GetNext (pElement);
-		m_KernelTimerList.Remove (pElement);
-		pElement = pNextElement;
+		nIndex = m_nWheelTicks & WHEEL_SLOT_MASK;
+
+		TKernelTimer *pList = m_pWheel[0][nIndex];
+		m_pWheel[0][nIndex] = 0;
+		m_nWheelMask[0] &= ~((u64) 1 << nIndex);
+		if (pList != 0)
+		{
+			pList->m_ppPrev = &pList;
+		}
+
+		m_nWheelTicks++;
+
+		// a handler may cancel other timers in pList
+		TKernelTimer *pTimer;
+		while ((pTimer = pList) != 0)
+		{
+			assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+			assert (pTimer->m_State == KernelTimerWheel);
+
+			RemoveKernelTimer (pTimer);
+			pTimer->m_State = KernelTimerRunning;
+
+			m_KernelTimerSpinLock.Release ();
+
+			TKernelTimerHandler *pHandler = pTimer->m_pHandler;
+			assert (pHandler != 0);
+			(*pHandler) (pTimer->m_hTimer, pTimer->m_pParam, pTimer->m_pContext);
+
+			m_KernelTimerSpinLock.Acquire ();
+
+			FreeKernelTimer (pTimer);
+		}
+	}
+
+	m_KernelTimerSpinLock.Release ();
+}
+
+void CTimer::PollHighResTimers (void)
+{
+	m_KernelTimerSpinLock.Acquire ();
+
+	TKernelTimer *pTimer;
+	while (   (pTimer = m_pHighResList) != 0
+	       && (s64) (pTimer->m_nCounterElapsesAt - GetCounter ()) <= 0)
+	{
+		assert (pTimer->m_nMagic == KERNEL_TIMER_MAGIC);
+		assert (pTimer->m_State == KernelTimerHighRes);
+
+		RemoveKernelTimer (pTimer);
+		pTimer->m_State = KernelTimerRunning;
 
 		m_KernelTimerSpinLock.Release ();
 
 		TKernelTimerHandler *pHandler = pTimer->m_pHandler;
 		assert (pHandler != 0);
-		(*pHandler) ((TKernelTimerHandle) pTimer, pTimer->m_pParam, pTimer->m_pContext);
-
-#ifndef NDEBUG
-		pTimer->m_nMagic = 0;
-#endif
-		delete pTimer;
+		(*pHandler) (pTimer->m_hTimer, pTimer->m_pParam, pTimer->m_pContext);
 
 		m_KernelTimerSpinLock.Acquire ();
+
+		FreeKernelTimer (pTimer);
 	}
 
 	m_KernelTimerSpinLock.Release ();
 }
 
-void CTimer::InterruptHandler (void)
+u64 CTimer::GetCounter (void) const
 {
 #ifndef USE_PHYSICAL_COUNTER
 	PeripheralEntry ();
 
-	u32 nCompare = read32 (ARM_SYSTIMER_C3);
+	u32 nHigh, nLow;
 	do
 	{
-		nCompare += CLOCKHZ / HZ;
+		nHigh = read32 (ARM_SYSTIMER_CHI);
+		nLow = read32 (ARM_SYSTIMER_CLO);
+	}
+	while (nHigh != read32 (ARM_SYSTIMER_CHI));
+
+	PeripheralExit ();
 
-		write32 (ARM_SYSTIMER_C3, nCompare);
+	return (u64) nHigh << 32 | nLow;
+#else
+	InstructionSyncBarrier ();
+
+#if AARCH == 32
+	u32 nCNTPCTLow, nCNTPCTHigh;
+	asm volatile ("mrrc p15, 0, %0, %1, c14" : "=r" (nCNTPCTLow), "=r" (nCNTPCTHigh));
+
+	return (u64) nCNTPCTHigh << 32 | nCNTPCTLow;
+#else
+	u64 nCNTPCT;
+	asm volatile ("mrs %0, CNTPCT_EL0" : "=r" (nCNTPCT));
+
+	return nCNTPCT;
+#endif
+#endif
+}
+
+void CTimer::SetCompare (u64 nCompare)
+{
+#ifndef USE_PHYSICAL_COUNTER
+	PeripheralEntry ();
+
+	// the system timer fires on equality only, the compare value must not be in the past
+	u32 nCounter = read32 (ARM_SYSTIMER_CLO);
+	if ((int) ((u32) nCompare - nCounter) < 2)
+	{
+		nCompare = GetCounter () + 2;
 	}
-	while ((int) (nCompare - read32 (ARM_SYSTIMER_CLO)) < 2);	// time may drift
 
-	write32 (ARM_SYSTIMER_CS, 1 << 3);
+	write32 (ARM_SYSTIMER_C3, (u32) nCompare);
 
 	PeripheralExit ();
 #else
 #if AARCH == 32
-	u32 nCNTP_CVALLow, nCNTP_CVALHigh;
-	asm volatile ("mrrc p15, 2, %0, %1, c14" : "=r" (nCNTP_CVALLow), "=r" (nCNTP_CVALHigh));
-
-	u64 nCNTP_CVAL = ((u64) nCNTP_CVALHigh << 32 | nCNTP_CVALLow) + CLOCKHZ / HZ;
-	asm volatile ("mcrr p15, 2, %0, %1, c14" :: "r" (nCNTP_CVAL & 0xFFFFFFFFU),
-						    "r" (nCNTP_CVAL >> 32));
+	asm volatile ("mcrr p15, 2, %0, %1, c14" :: "r" (nCompare & 0xFFFFFFFFU),
+						    "r" (nCompare >> 32));
 #else
-	u64 nCNTP_CVAL;
-	asm volatile ("mrs %0, CNTP_CVAL_EL0" : "=r" (nCNTP_CVAL));
-	asm volatile ("msr CNTP_CVAL_EL0, %0" :: "r" (nCNTP_CVAL + m_nClockTicksPerHZTick));
+	asm volatile ("msr CNTP_CVAL_EL0, %0" :: "r" (nCompare));
 #endif
 #endif
 
-#ifndef NDEBUG
-	//debug_click ();
+	m_nCompareAt = nCompare;
+}
+
+void CTimer::ScheduleInterrupt (void)
+{
+	u64 nNextEvent = m_nNextTickAt;
+
+#ifdef TIMER_TICKLESS
+	// skip the ticks, on which nothing has to be done
+	if (m_nPeriodicHandlers == 0)
+	{
+		unsigned nTicks = m_nWheelTicks;
+
+		// the time of day is updated each second
+		unsigned nSkip = (HZ - nTicks % HZ) % HZ;
+
+		// upper levels of the wheel are cascaded every KERNEL_TIMER_WHEEL_SLOTS ticks
+		for (unsigned nLevel = 1; nLevel < KERNEL_TIMER_WHEEL_LEVELS; nLevel++)
+		{
+			if (m_nWheelMask[nLevel] != 0)
+			{
+				unsigned nCascade = -nTicks & WHEEL_SLOT_MASK;
+				if (nSkip > nCascade)
+				{
+					nSkip = nCascade;
+				}
+
+				break;
+			}
+		}
+
+		u64 nMask = m_nWheelMask[0];
+		if (nMask != 0)
+		{
+			unsigned nShift = nTicks & WHEEL_SLOT_MASK;
+			if (nShift != 0)
+			{
+				nMask = nMask >> nShift | nMask << (KERNEL_TIMER_WHEEL_SLOTS - nShift);
+			}
+
+			unsigned nNextSlot = __builtin_ctzll (nMask);
+			if (nSkip > nNextSlot)
+			{
+				nSkip = nNextSlot;
+			}
+		}
+
+		nNextEvent += (u64) nSkip * m_nCounterTicksPerHZTick;
+	}
 #endif
 
-	m_TimeSpinLock.Acquire ();
+	if (   m_pHighResList != 0
+	    && (s64) (m_pHighResList->m_nCounterElapsesAt - nNextEvent) < 0)
+	{
+		nNextEvent = m_pHighResList->m_nCounterElapsesAt;
+	}
 
-	if (++m_nTicks % HZ == 0)
+	SetCompare (nNextEvent);
+}
+
+unsigned CTimer::GetPendingTicks (void) const
+{
+#ifdef TIMER_TICKLESS
+	// the ticks, which have not been counted yet, because the tick was stopped,
+	// the next second is always counted in the interrupt handler
+	u64 nCounter = GetCounter ();
+	if ((s64) (nCounter - m_nNextTickAt) < 0)
 	{
-		m_nUptime++;
-		m_nTime++;
+		return 0;
 	}
 
-	m_TimeSpinLock.Release ();
+	unsigned nTicks = 1 + (nCounter - m_nNextTickAt) / m_nCounterTicksPerHZTick;
+
+	unsigned nMaxTicks = HZ - 1 - m_nTicks % HZ;
+	if (nTicks > nMaxTicks)
+	{
+		nTicks = nMaxTicks;
+	}
 
-	PollKernelTimers ();
+	return nTicks;
+#else
+	return 0;
+#endif
+}
 
-	for (unsigned i = 0; i < m_nPeriodicHandlers; i++)
+void CTimer::InterruptHandler (void)
+{
+#ifndef USE_PHYSICAL_COUNTER
+	PeripheralEntry ();
+
+	write32 (ARM_SYSTIMER_CS, 1 << 3);
+
+	PeripheralExit ();
+#endif
+
+#ifndef NDEBUG
+	//debug_click ();
+#endif
+
+	// the interrupt may be triggered by a high-resolution timer before the next tick,
+	// with TIMER_TICKLESS several ticks may have elapsed
+	u64 nCounter = GetCounter ();
+	while ((s64) (nCounter - m_nNextTickAt) >= 0)
 	{
-		(*m_pPeriodicHandler[i]) ();
+		m_TimeSpinLock.Acquire ();
+
+		m_nNextTickAt += m_nCounterTicksPerHZTick;
+
+		if (++m_nTicks % HZ == 0)
+		{
+			m_nUptime++;
+			m_nTime++;
+		}
+
+		m_TimeSpinLock.Release ();
+
+		PollKernelTimers ();
+
+		for (unsigned i = 0; i < m_nPeriodicHandlers; i++)
+		{
+			(*m_pPeriodicHandler[i]) ();
+		}
 	}
+
+	PollHighResTimers ();
+
+	m_KernelTimerSpinLock.Acquire ();
+
+	ScheduleInterrupt ();
+
+	m_KernelTimerSpinLock.Release ();
 }
 
 void CTimer::InterruptHandler (void *pParam)
@@ -586,6 +1041,14 @@ void CTimer::RegisterPeriodicHandler (TPeriodicTimerHandler *pHandler)
 	DataSyncBarrier ();
 
 	m_nPeriodicHandlers++;
+
+#ifdef TIMER_TICKLESS
+	m_KernelTimerSpinLock.Acquire ();
+
+	ScheduleInterrupt ();		// restart the tick
+
+	m_KernelTimerSpinLock.Release ();
+#endif
 }
 
 void CTimer::SimpleMsDelay (unsigned nMilliSeconds)
@@ -2,7 +2,7 @@
 // translationtable64.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2024  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,6 +26,12 @@
 
 // Granule size is 64KB. Only EL1 stage 1 translation is enabled with 32 bits IPA
 // (= PA) size (4GB).
+//
+// Level 2 entries, which cover 512MB with the same attributes (e.g. high memory
+// or peripherals), are mapped with a block descriptor and do not get a level 3
+// table. In the level 3 tables each 32 adjacent pages (2MB) with the same
+// attributes are marked as contiguous. Both reduces the number of TLB misses
+// on large buffers.
 
 #if RASPPI == 3
 // We create one level 2 (first lookup level) translation table with 3 table
@@ -61,6 +67,31 @@ CTranslationTable::CTranslationTable (size_t nMemSize)
 		}
 #endif
 
+		if (IsUniformBlock (nBaseAddress))
+		{
+			TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR Page;
+			SetPageDescriptor (&Page, nBaseAddress);
+
+			TARMV8MMU_LEVEL2_BLOCK_DESCRIPTOR *pDesc = &m_pTable[nEntry].Block;
+
+			pDesc->Value01	     = 1;
+			pDesc->AttrIndx	     = Page.AttrIndx;
+			pDesc->NS	     = 0;
+			pDesc->AP	     = Page.AP;
+			pDesc->SH	     = Page.SH;
+			pDesc->AF	     = 1;
+			pDesc->nG	     = 0;
+			pDesc->Reserved0_1   = 0;
+			pDesc->OutputAddress = ARMV8MMUL2BLOCKADDR (nBaseAddress);
+			pDesc->Reserved0_2   = 0;
+			pDesc->Continous     = 0;
+			pDesc->PXN	     = Page.PXN;
+			pDesc->UXN	     = Page.UXN;
+			pDesc->Ignored	     = 0;
+
+			continue;
+		}
+
 		TARMV8MMU_LEVEL3_DESCRIPTOR *pTable = CreateLevel3Table (nBaseAddress);
 		assert (pTable != 0);
 
@@ -99,49 +130,106 @@ TARMV8MMU_LEVEL3_DESCRIPTOR *CTranslationTable::CreateLevel3Table (uintptr nBase
 
 	for (unsigned nPage = 0; nPage < ARMV8MMU_TABLE_ENTRIES; nPage++)	// 8192 entries a 64KB
 	{
-		TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc = &pTable[nPage].Page;
-
-		pDesc->Value11	     = 3;
-		pDesc->AttrIndx	     = ATTRINDX_NORMAL;
-		pDesc->NS	     = 0;
-		pDesc->AP	     = ATTRIB_AP_RW_EL1;
-		pDesc->SH	     = ATTRIB_SH_INNER_SHAREABLE;
-		pDesc->AF	     = 1;
-		pDesc->nG	     = 0;
-		pDesc->Reserved0_1   = 0;
-		pDesc->OutputAddress = ARMV8MMUL3PAGEADDR (nBaseAddress);
-		pDesc->Reserved0_2   = 0;
-		pDesc->Continous     = 0;
-		pDesc->PXN	     = 0;
-		pDesc->UXN	     = 1;
-		pDesc->Ignored	     = 0;
-
-		extern u8 _etext;
-		if (nBaseAddress >= (u64) &_etext)
-		{
-			pDesc->PXN = 1;
+		SetPageDescriptor (&pTable[nPage].Page, nBaseAddress);
 
-#if RASPPI >= 4
-			if (   (   nBaseAddress >= m_nMemSize
-			        && nBaseAddress < MEM_HIGHMEM_START)
-			    || nBaseAddress > MEM_HIGHMEM_END)
-#else
-			if (nBaseAddress >= m_nMemSize)
-#endif
-			{
-				pDesc->AttrIndx = ATTRINDX_DEVICE;
-				pDesc->SH	= ATTRIB_SH_OUTER_SHAREABLE;
-			}
-			else if (   nBaseAddress >= MEM_COHERENT_REGION
-				 && nBaseAddress <  MEM_HEAP_START)
+		nBaseAddress += ARMV8MMU_LEVEL3_PAGE_SIZE;
+	}
+
+	// mark groups of pages with the same attributes as contiguous
+	for (unsigned nPage = 0; nPage < ARMV8MMU_TABLE_ENTRIES;
+	     nPage += ARMV8MMU_LEVEL3_CONTIGUOUS_ENTRIES)
+	{
+		unsigned i;
+		for (i = 1; i < ARMV8MMU_LEVEL3_CONTIGUOUS_ENTRIES; i++)
+		{
+			if (!HasSameAttributes (&pTable[nPage].Page, &pTable[nPage + i].Page))
 			{
-				pDesc->AttrIndx = ATTRINDX_COHERENT;
-				pDesc->SH	= ATTRIB_SH_OUTER_SHAREABLE;
+				break;
 			}
 		}
 
-		nBaseAddress += ARMV8MMU_LEVEL3_PAGE_SIZE;
+		if (i < ARMV8MMU_LEVEL3_CONTIGUOUS_ENTRIES)
+		{
+			continue;
+		}
+
+		for (i = 0; i < ARMV8MMU_LEVEL3_CONTIGUOUS_ENTRIES; i++)
+		{
+			pTable[nPage + i].Page.Continous = 1;
+		}
 	}
 
 	return pTable;
 }
+
+boolean CTranslationTable::IsUniformBlock (uintptr nBaseAddress) const
+{
+	TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR First;
+	SetPageDescriptor (&First, nBaseAddress);
+
+	for (unsigned nPage = 1; nPage < ARMV8MMU_TABLE_ENTRIES; nPage++)
+	{
+		TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR Page;
+		SetPageDescriptor (&Page, nBaseAddress + nPage * ARMV8MMU_LEVEL3_PAGE_SIZE);
+
+		if (!HasSameAttributes (&First, &Page))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+void CTranslationTable::SetPageDescriptor (TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc,
+					   uintptr nBaseAddress) const
+{
+	pDesc->Value11	     = 3;
+	pDesc->AttrIndx	     = ATTRINDX_NORMAL;
+	pDesc->NS	     = 0;
+	pDesc->AP	     = ATTRIB_AP_RW_EL1;
+	pDesc->SH	     = ATTRIB_SH_INNER_SHAREABLE;
+	pDesc->AF	     = 1;
+	pDesc->nG	     = 0;
+	pDesc->Reserved0_1   = 0;
+	pDesc->OutputAddress = ARMV8MMUL3PAGEADDR (nBaseAddress);
+	pDesc->Reserved0_2   = 0;
+	pDesc->Continous     = 0;
+	pDesc->PXN	     = 0;
+	pDesc->UXN	     = 1;
+	pDesc->Ignored	     = 0;
+
+	extern u8 _etext;
+	if (nBaseAddress >= (u64) &_etext)
+	{
+		pDesc->PXN = 1;
+
+#if RASPPI >= 4
+		if (   (   nBaseAddress >= m_nMemSize
+		        && nBaseAddress < MEM_HIGHMEM_START)
+		    || nBaseAddress > MEM_HIGHMEM_END)
+#else
+		if (nBaseAddress >= m_nMemSize)
+#endif
+		{
+			pDesc->AttrIndx = ATTRINDX_DEVICE;
+			pDesc->SH	= ATTRIB_SH_OUTER_SHAREABLE;
+		}
+		else if (   nBaseAddress >= MEM_COHERENT_REGION
+			 && nBaseAddress <  MEM_HEAP_START)
+		{
+			pDesc->AttrIndx = ATTRINDX_COHERENT;
+			pDesc->SH	= ATTRIB_SH_OUTER_SHAREABLE;
+		}
+	}
+}
+
+boolean CTranslationTable::HasSameAttributes (const TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc1,
+					      const TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR *pDesc2)
+{
+	return    pDesc1->AttrIndx == pDesc2->AttrIndx
+	       && pDesc1->AP	   == pDesc2->AP
+	       && pDesc1->SH	   == pDesc2->SH
+	       && pDesc1->PXN	   == pDesc2->PXN
+	       && pDesc1->UXN	   == pDesc2->UXN;
+}
@@ -2,7 +2,7 @@
 // usbmassdevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -206,6 +206,7 @@ CUSBBulkOnlyMassStorageDevice::CUSBBulkOnlyMassStorageDevice (CUSBFunction *pFun
 	m_nCWBTag (0),
 	m_nBlockCount (0),
 	m_ullOffset (0),
+	m_RequestQueue (UMSD_BLOCK_SIZE, UMSD_MAX_MERGE_SIZE, TransferHandler, this),
 	m_pPartitionManager (0),
 	m_nDeviceNumber (0)
 {
@@ -423,6 +424,41 @@ boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 }
 
 int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
+{
+	return m_RequestQueue.Transfer (BlockRequestRead, pBuffer, nCount, m_ullOffset);
+}
+
+int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
+{
+	return m_RequestQueue.Transfer (BlockRequestWrite, (void *) pBuffer, nCount, m_ullOffset);
+}
+
+u64 CUSBBulkOnlyMassStorageDevice::Seek (u64 ullOffset)
+{
+	m_ullOffset = ullOffset;
+
+	return m_ullOffset;
+}
+
+boolean CUSBBulkOnlyMassStorageDevice::SubmitRequest (CBlockRequest *pRequest)
+{
+	return m_RequestQueue.Submit (pRequest);
+}
+
+u64 CUSBBulkOnlyMassStorageDevice::GetSize (void) const
+{
+	assert (m_nBlockCount > 0);
+	assert (m_nBlockCount < (u32) -1);
+
+	return (u64) m_nBlockCount << UMSD_BLOCK_SHIFT;
+}
+
+unsigned CUSBBulkOnlyMassStorageDevice::GetCapacity (void) const
+{
+	return m_nBlockCount;
+}
+
+int CUSBBulkOnlyMassStorageDevice::DoRead (void *pBuffer, size_t nCount, u64 ullOffset)
 {
 	unsigned nTries = MAX_TRIES;
 
@@ -430,7 +466,7 @@ int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
 
 	do
 	{
-		nResult = TryRead (pBuffer, nCount);
+		nResult = TryRead (pBuffer, nCount, ullOffset);
 
 		if (nResult != (int) nCount)
 		{
@@ -447,7 +483,7 @@ int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
 	return nResult;
 }
 
-int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
+int CUSBBulkOnlyMassStorageDevice::DoWrite (const void *pBuffer, size_t nCount, u64 ullOffset)
 {
 	unsigned nTries = MAX_TRIES;
 
@@ -455,7 +491,7 @@ int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
 
 	do
 	{
-		nResult = TryWrite (pBuffer, nCount);
+		nResult = TryWrite (pBuffer, nCount, ullOffset);
 
 		if (nResult != (int) nCount)
 		{
@@ -472,36 +508,30 @@ int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
 	return nResult;
 }
 
-u64 CUSBBulkOnlyMassStorageDevice::Seek (u64 ullOffset)
-{
-	m_ullOffset = ullOffset;
-
-	return m_ullOffset;
-}
-
-u64 CUSBBulkOnlyMassStorageDevice::GetSize (void) const
+int CUSBBulkOnlyMassStorageDevice::TransferHandler (TBlockRequestType Type, void *pBuffer,
+						    size_t nCount, u64 ullOffset, void *pParam)
 {
-	assert (m_nBlockCount > 0);
-	assert (m_nBlockCount < (u32) -1);
+	CUSBBulkOnlyMassStorageDevice *pThis = (CUSBBulkOnlyMassStorageDevice *) pParam;
+	assert (pThis != 0);
 
-	return (u64) m_nBlockCount << UMSD_BLOCK_SHIFT;
-}
+	if (Type == BlockRequestRead)
+	{
+		return pThis->DoRead (pBuffer, nCount, ullOffset);
+	}
 
-unsigned CUSBBulkOnlyMassStorageDevice::GetCapacity (void) const
-{
-	return m_nBlockCount;
+	return pThis->DoWrite (pBuffer, nCount, ullOffset);
 }
 
-int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
+int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount, u64 ullOffset)
 {
 	assert (pBuffer != 0);
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
+	if (   (ullOffset & UMSD_BLOCK_MASK) != 0
+	    || ullOffset > UMSD_MAX_OFFSET)
 	{
 		return -1;
 	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
+	u32 nBlockAddress = (u32) (ullOffset >> UMSD_BLOCK_SHIFT);
 
 	if ((nCount & UMSD_BLOCK_MASK) != 0)
 	{
@@ -529,16 +559,16 @@ int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
 	return nCount;
 }
 
-int CUSBBulkOnlyMassStorageDevice::TryWrite (const void *pBuffer, size_t nCount)
+int CUSBBulkOnlyMassStorageDevice::TryWrite (const void *pBuffer, size_t nCount, u64 ullOffset)
 {
 	assert (pBuffer != 0);
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
+	if (   (ullOffset & UMSD_BLOCK_MASK) != 0
+	    || ullOffset > UMSD_MAX_OFFSET)
 	{
 		return -1;
 	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
+	u32 nBlockAddress = (u32) (ullOffset >> UMSD_BLOCK_SHIFT);
 
 	if ((nCount & UMSD_BLOCK_MASK) != 0)
 	{
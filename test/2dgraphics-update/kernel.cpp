@@ -0,0 +1,294 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <assert.h>
+
+#define IMAGE_WIDTH		64
+#define IMAGE_HEIGHT		48
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_2DGraphics (m_Options.GetWidth (), m_Options.GetHeight (), FALSE),	// no VSync
+	m_pDrawBuffer (0),
+	m_pVisibleBuffer (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Logger.Initialize (&m_Serial);	// the screen is tested
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_2DGraphics.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Screen %ux%u, DEPTH %u",
+			m_2DGraphics.GetWidth (), m_2DGraphics.GetHeight (), DEPTH);
+
+	// Without VSync the drawing buffer follows the visible buffer in the frame buffer.
+	// Raw writes are reported with MarkDirty() here, so that the dirty rectangles work.
+	m_pDrawBuffer = m_2DGraphics.GetBuffer (TRUE);
+	m_pVisibleBuffer = m_pDrawBuffer - m_2DGraphics.GetWidth () * m_2DGraphics.GetHeight ();
+
+	boolean bOK = TestDirtyRects ();
+
+	if (bOK)
+	{
+		bOK = TestBlendedBlit ();
+	}
+
+	// must be the last test, because the whole screen is copied from now on
+	if (bOK)
+	{
+		bOK = TestRawAccess ();
+	}
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::TestDirtyRects (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 1: Dirty rectangles");
+
+	unsigned nWidth = m_2DGraphics.GetWidth ();
+	unsigned nHeight = m_2DGraphics.GetHeight ();
+
+	m_2DGraphics.ClearScreen (BLACK_COLOR);
+	unsigned nFullUpdate = MeasureUpdate ();
+
+	if (!CheckArea (0, 0, nWidth, nHeight, BLACK_COLOR, "Clear screen"))
+	{
+		return FALSE;
+	}
+
+	// raw writes to the drawing buffer are not tracked and must not be copied yet
+	for (unsigned i = 0; i < 10 * nWidth; i++)
+	{
+		m_pDrawBuffer[i] = RED_COLOR;
+	}
+
+	m_2DGraphics.DrawRect (100, 100, 50, 40, GREEN_COLOR);
+	unsigned nRectUpdate = MeasureUpdate ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Update full screen %u us, one rectangle %u us",
+			nFullUpdate, nRectUpdate);
+
+	if (   !CheckArea (100, 100, 50, 40, GREEN_COLOR, "Rectangle")
+	    || !CheckArea (0, 0, nWidth, 10, BLACK_COLOR, "Untracked area"))
+	{
+		return FALSE;
+	}
+
+	if (nRectUpdate >= nFullUpdate)
+	{
+		m_Logger.Write (FromKernel, LogError, "Rectangle update is not faster");
+
+		return FALSE;
+	}
+
+	// more rectangles than C2DGRAPHICS_MAX_DIRTY_RECTS have to be merged
+	const unsigned nRects = 3 * C2DGRAPHICS_MAX_DIRTY_RECTS;
+	for (unsigned i = 0; i < nRects; i++)
+	{
+		m_2DGraphics.DrawRect (20 + (i % 8) * 40, 200 + (i / 8) * 30, 20, 10, BLUE_COLOR);
+	}
+
+	m_2DGraphics.UpdateDisplay ();
+
+	for (unsigned i = 0; i < nRects; i++)
+	{
+		if (!CheckArea (20 + (i % 8) * 40, 200 + (i / 8) * 30, 20, 10, BLUE_COLOR,
+				"Merged rectangles"))
+		{
+			return FALSE;
+		}
+	}
+
+	m_2DGraphics.MarkDirty (0, 0, nWidth, 10);
+	m_2DGraphics.UpdateDisplay ();
+
+	return CheckArea (0, 0, nWidth, 10, RED_COLOR, "Raw writes after MarkDirty()");
+}
+
+boolean CKernel::TestBlendedBlit (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 2: Blended blit");
+
+	static TScreenColor Image[IMAGE_WIDTH * IMAGE_HEIGHT];
+	for (unsigned i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+	{
+		Image[i] = WHITE_COLOR;
+	}
+
+	static const u8 Alpha[] = {0, 64, 128, 192, 255};
+	const unsigned nTests = sizeof Alpha / sizeof Alpha[0];
+
+	m_2DGraphics.ClearScreen (BLUE_COLOR);
+
+	for (unsigned i = 0; i < nTests; i++)
+	{
+		// with an odd X position the NEON kernels have to handle an unaligned tail
+		m_2DGraphics.DrawImageBlended (21 + i * (IMAGE_WIDTH + 10), 50,
+					       IMAGE_WIDTH, IMAGE_HEIGHT, Image, Alpha[i]);
+	}
+
+	m_2DGraphics.UpdateDisplay ();
+
+	for (unsigned i = 0; i < nTests; i++)
+	{
+		// expected result of the (Source*nAlpha + Dest*(256-nAlpha)) / 256 blending
+#if DEPTH == 8
+		TScreenColor Expected = Alpha[i] >= 128 ? WHITE_COLOR : BLUE_COLOR;
+#else
+		unsigned nAlpha = Alpha[i] + (Alpha[i] >> 7);
+		TScreenColor Source = WHITE_COLOR;
+		TScreenColor Dest = BLUE_COLOR;
+	#if DEPTH == 16
+		TScreenColor Expected =
+			  (((Source >> 11)         * nAlpha + (Dest >> 11)         * (256-nAlpha)) >> 8) << 11
+			| (((Source >> 5) & 0x3F)  * nAlpha + ((Dest >> 5) & 0x3F) * (256-nAlpha)) >> 8 << 5
+			| (((Source & 0x1F)        * nAlpha + (Dest & 0x1F)        * (256-nAlpha)) >> 8);
+	#else
+		TScreenColor Expected = 0;
+		for (unsigned nShift = 0; nShift < 32; nShift += 8)
+		{
+			u32 nChannel = (  ((Source >> nShift) & 0xFF) * nAlpha
+					+ ((Dest >> nShift) & 0xFF) * (256-nAlpha)) >> 8;
+			Expected |= nChannel << nShift;
+		}
+	#endif
+#endif
+
+		if (!CheckArea (21 + i * (IMAGE_WIDTH + 10), 50, IMAGE_WIDTH, IMAGE_HEIGHT,
+				Expected, "Blended image"))
+		{
+			m_Logger.Write (FromKernel, LogError, "Alpha %u", Alpha[i]);
+
+			return FALSE;
+		}
+	}
+
+	// the area around the images must be unchanged
+	return CheckArea (0, 50 + IMAGE_HEIGHT, m_2DGraphics.GetWidth (), 10, BLUE_COLOR,
+			  "Area below images");
+}
+
+boolean CKernel::TestRawAccess (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 3: Raw access");
+
+	unsigned nWidth = m_2DGraphics.GetWidth ();
+
+	// the pointer is kept by the caller, changes must be copied on each update
+	TScreenColor *pBuffer = m_2DGraphics.GetBuffer ();
+	assert (pBuffer == m_pDrawBuffer);
+
+	static const TScreenColor Colors[] = {GREEN_COLOR, YELLOW_COLOR, CYAN_COLOR};
+	for (unsigned i = 0; i < sizeof Colors / sizeof Colors[0]; i++)
+	{
+		for (unsigned j = 0; j < 10 * nWidth; j++)
+		{
+			pBuffer[j] = Colors[i];
+		}
+
+		m_2DGraphics.UpdateDisplay ();
+
+		if (!CheckArea (0, 0, nWidth, 10, Colors[i], "Raw writes with cached pointer"))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CheckArea (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight,
+			    TScreenColor Color, const char *pWhat)
+{
+	unsigned nScreenWidth = m_2DGraphics.GetWidth ();
+	assert (nX + nWidth <= nScreenWidth);
+	assert (nY + nHeight <= m_2DGraphics.GetHeight ());
+
+	for (unsigned y = nY; y < nY + nHeight; y++)
+	{
+		for (unsigned x = nX; x < nX + nWidth; x++)
+		{
+			TScreenColor Pixel = m_pVisibleBuffer[y * nScreenWidth + x];
+			if (Pixel != Color)
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"%s: Pixel (%u, %u) is 0x%X (expected 0x%X)",
+						pWhat, x, y, (unsigned) Pixel, (unsigned) Color);
+
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+unsigned CKernel::MeasureUpdate (void)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	m_2DGraphics.UpdateDisplay ();
+
+	return CTimer::GetClockTicks () - nStartTicks;
+}
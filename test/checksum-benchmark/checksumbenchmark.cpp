@@ -0,0 +1,270 @@
+//
+// checksumbenchmark.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "checksumbenchmark.h"
+#include <circle/net/checksumcalculator.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define MAX_BLOCK_SIZE		0x10000
+#define BUFFER_SIZE		(MAX_BLOCK_SIZE + 64)	// room for misalignment
+
+#define DURATION_MSECS		1000
+#define VERIFY_ROUNDS		20000
+
+enum TFunction
+{
+	FunctionOld,
+	FunctionSum,
+	FunctionMemcpy,
+	FunctionCopySum,
+	FunctionUnknown
+};
+
+static const char *s_pFunctionName[FunctionUnknown] = {"old", "sum", "memcpy", "copysum"};
+
+static const unsigned s_BlockSize[] = {20, 64, 576, 1460, MAX_BLOCK_SIZE};
+
+static const char FromBenchmark[] = "bench";
+
+static u32 s_nSeed = 0x12345678;
+
+static u32 Random (void)		// xorshift32
+{
+	s_nSeed ^= s_nSeed << 13;
+	s_nSeed ^= s_nSeed >> 17;
+	s_nSeed ^= s_nSeed << 5;
+
+	return s_nSeed;
+}
+
+CChecksumBenchmark::CChecksumBenchmark (CCPUThrottle *pCPUThrottle)
+:	m_pCPUThrottle (pCPUThrottle),
+	m_pSource (new u8[BUFFER_SIZE]),
+	m_pDest (new u8[BUFFER_SIZE])
+{
+	assert (m_pSource != 0);
+	assert (m_pDest != 0);
+
+	for (unsigned i = 0; i < BUFFER_SIZE; i++)
+	{
+		m_pSource[i] = (u8) Random ();
+	}
+}
+
+CChecksumBenchmark::~CChecksumBenchmark (void)
+{
+	delete [] m_pDest;
+	delete [] m_pSource;
+}
+
+void CChecksumBenchmark::Run (void)
+{
+	assert (m_pCPUThrottle != 0);
+	CLogger::Get ()->Write (FromBenchmark, LogNotice, "CPU clock rate is %u MHz",
+				m_pCPUThrottle->GetClockRate () / 1000000);
+
+	if (!Verify ())
+	{
+		return;
+	}
+
+	for (unsigned nFunction = 0; nFunction < FunctionUnknown; nFunction++)
+	{
+		for (unsigned i = 0; i < sizeof s_BlockSize / sizeof s_BlockSize[0]; i++)
+		{
+			Measure (s_pFunctionName[nFunction], s_BlockSize[i], nFunction);
+		}
+	}
+
+	// incremental update of a 16-bit field (RFC 1624)
+	unsigned nUpdates = 0;
+	u16 nChecksum = OldCalculate (m_pSource, 1460);
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (CTimer::GetClockTicks () - nStartTicks < DURATION_MSECS * (CLOCKHZ / 1000))
+	{
+		for (unsigned i = 0; i < 1000; i++)
+		{
+			nChecksum = CChecksumCalculator::Update (nChecksum, (u16) i, (u16) (i+1));
+		}
+
+		nUpdates += 1000;
+	}
+	m_nResult = nChecksum;
+
+	CLogger::Get ()->Write (FromBenchmark, LogNotice, "update: %u updates/s", nUpdates);
+
+	CLogger::Get ()->Write (FromBenchmark, LogNotice, "Finished");
+}
+
+boolean CChecksumBenchmark::Verify (void)
+{
+	for (unsigned nRound = 0; nRound < VERIFY_ROUNDS; nRound++)
+	{
+		unsigned nLength = Random () % 2048 + 1;
+		unsigned nOffset = Random () % 32;
+		unsigned nDestOffset = Random () % 32;
+
+		u16 nExpected = OldCalculate (m_pSource + nOffset, nLength);
+
+		u16 nChecksum = CChecksumCalculator::SimpleCalculate (m_pSource + nOffset, nLength);
+		if (nChecksum != nExpected)
+		{
+			CLogger::Get ()->Write (FromBenchmark, LogError,
+						"Sum failed (length %u, offset %u)", nLength, nOffset);
+
+			return FALSE;
+		}
+
+		// copy and sum in two blocks with an odd or even split point
+		unsigned nSplit = Random () % nLength;
+		u32 nSum = CChecksumCalculator::CopyAndSum (m_pDest + nDestOffset,
+							    m_pSource + nOffset, nSplit);
+		u32 nBlockSum = CChecksumCalculator::CopyAndSum (m_pDest + nDestOffset + nSplit,
+								 m_pSource + nOffset + nSplit,
+								 nLength - nSplit);
+		nSum = CChecksumCalculator::AddSum (nSum, nBlockSum, nSplit);
+
+		if (   (u16) ~nSum != nExpected
+		    || memcmp (m_pDest + nDestOffset, m_pSource + nOffset, nLength) != 0)
+		{
+			CLogger::Get ()->Write (FromBenchmark, LogError,
+						"CopyAndSum failed (length %u, offset %u, split %u)",
+						nLength, nOffset, nSplit);
+
+			return FALSE;
+		}
+
+		// incremental update of a 16-bit word at an even offset
+		if (nLength >= 2)
+		{
+			unsigned nPos = (Random () % (nLength / 2)) * 2;
+			u16 *pWord = (u16 *) (m_pDest + nDestOffset + nPos);
+
+			u16 nOldValue, nNewValue = (u16) Random ();
+			memcpy (&nOldValue, pWord, sizeof nOldValue);
+			memcpy (pWord, &nNewValue, sizeof nNewValue);
+
+			nChecksum = CChecksumCalculator::Update (nExpected, nOldValue, nNewValue);
+			if (nChecksum != OldCalculate (m_pDest + nDestOffset, nLength))
+			{
+				CLogger::Get ()->Write (FromBenchmark, LogError,
+							"Update failed (length %u, position %u)",
+							nLength, nPos);
+
+				return FALSE;
+			}
+		}
+	}
+
+	CLogger::Get ()->Write (FromBenchmark, LogNotice, "Verification passed");
+
+	return TRUE;
+}
+
+void CChecksumBenchmark::Measure (const char *pName, unsigned nBlockSize, unsigned nFunction)
+{
+	assert (nBlockSize <= MAX_BLOCK_SIZE);
+
+	u64 ulBytes = 0;
+	u32 nResult = 0;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	unsigned nTicks;
+	do
+	{
+		for (unsigned i = 0; i < 16; i++)
+		{
+			switch (nFunction)
+			{
+			case FunctionOld:
+				nResult += OldCalculate (m_pSource, nBlockSize);
+				break;
+
+			case FunctionSum:
+				nResult += CChecksumCalculator::SimpleCalculate (m_pSource, nBlockSize);
+				break;
+
+			case FunctionMemcpy:
+				memcpy (m_pDest, m_pSource, nBlockSize);
+				break;
+
+			case FunctionCopySum:
+				nResult += CChecksumCalculator::CopyAndSum (m_pDest, m_pSource, nBlockSize);
+				break;
+
+			default:
+				assert (0);
+				break;
+			}
+		}
+
+		ulBytes += 16 * nBlockSize;
+
+		nTicks = CTimer::GetClockTicks () - nStartTicks;
+	}
+	while (nTicks < DURATION_MSECS * (CLOCKHZ / 1000));
+
+	m_nResult = nResult;
+
+	// bytes per microsecond is equal to MBytes per second
+	unsigned nMBytesPerSec = (unsigned) (ulBytes / nTicks);
+
+	// bytes per cycle in 1/100
+	u64 ulCycles = (u64) nTicks * (m_pCPUThrottle->GetClockRate () / 1000000);
+	unsigned nBytesPerCycle100 = (unsigned) (ulBytes * 100 / ulCycles);
+
+	CLogger::Get ()->Write (FromBenchmark, LogNotice, "%-8s %5u bytes: %5u MBytes/s, %u.%02u bytes/cycle",
+				pName, nBlockSize, nMBytesPerSec,
+				nBytesPerCycle100 / 100, nBytesPerCycle100 % 100);
+}
+
+// this is the checksum calculation, which was used before
+u16 CChecksumBenchmark::OldCalculate (const void *pBuffer, unsigned nLength)
+{
+	u16 *pBuffer16 = (u16 *) pBuffer;
+	assert (pBuffer16 != 0);
+	assert (nLength > 0);
+
+	u32 nChecksum = 0;
+	while (nLength >= 2)
+	{
+		nChecksum += *pBuffer16++;
+		nLength -= 2;
+	}
+
+	assert (nLength <= 1);
+	if (nLength != 0)
+	{
+		nChecksum += *(u8 *) pBuffer16;
+	}
+
+	u16 nHigh = nChecksum >> 16;
+	while (nHigh != 0)
+	{
+		nChecksum &= 0xFFFF;
+		nChecksum += nHigh;
+
+		nHigh = nChecksum >> 16;
+	}
+
+	return ~(u16) nChecksum;
+}
@@ -0,0 +1,50 @@
+//
+// checksumbenchmark.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _checksumbenchmark_h
+#define _checksumbenchmark_h
+
+#include <circle/cputhrottle.h>
+#include <circle/types.h>
+
+class CChecksumBenchmark
+{
+public:
+	CChecksumBenchmark (CCPUThrottle *pCPUThrottle);
+	~CChecksumBenchmark (void);
+
+	void Run (void);
+
+private:
+	boolean Verify (void);
+
+	void Measure (const char *pName, unsigned nBlockSize, unsigned nFunction);
+
+	static u16 OldCalculate (const void *pBuffer, unsigned nLength);
+
+private:
+	CCPUThrottle *m_pCPUThrottle;
+
+	u8 *m_pSource;
+	u8 *m_pDest;
+
+	volatile u32 m_nResult;		// prevents, that the calculation is optimized away
+};
+
+#endif
@@ -0,0 +1,275 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/fs/fat/fatfsdef.h>
+#include <circle/fs/fsdef.h>
+#include <assert.h>
+
+#define PARTITION	"emmc1-1"
+#define FILENAME	"fatcache.tst"
+
+#define FILE_SIZE	(3 * FAT_CACHE_SIZE + 1234)	// larger than the cache, not aligned
+#define CHUNK_SIZE	3000				// not aligned to sectors too
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_EMMC.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	if (!Mount ())
+	{
+		return ShutdownHalt;
+	}
+
+	boolean bOK = WriteFile ();
+
+	// write back all dirty sectors and drop the cache contents
+	m_FileSystem.Synchronize ();
+	ShowStatistics ("Write");
+	m_FileSystem.UnMount ();
+
+	if (bOK)
+	{
+		if (!Mount ())
+		{
+			return ShutdownHalt;
+		}
+
+		bOK = VerifyFile ();
+		ShowStatistics ("Verify");
+
+		if (m_FileSystem.FileDelete (FILENAME) <= 0)
+		{
+			m_Logger.Write (FromKernel, LogWarning, "Cannot delete file: %s", FILENAME);
+		}
+
+		m_FileSystem.UnMount ();
+	}
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::Mount (void)
+{
+	CDevice *pPartition = m_DeviceNameService.GetDevice (PARTITION, TRUE);
+	if (pPartition == 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Partition not found: %s", PARTITION);
+
+		return FALSE;
+	}
+
+	if (!m_FileSystem.Mount (pPartition))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot mount partition: %s", PARTITION);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::WriteFile (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Writing %u bytes to %s", FILE_SIZE, FILENAME);
+
+	unsigned hFile = m_FileSystem.FileCreate (FILENAME);
+	if (hFile == 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot create file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	boolean bOK = TRUE;
+
+	u8 Buffer[CHUNK_SIZE];
+	for (unsigned nOffset = 0; bOK && nOffset < FILE_SIZE; nOffset += CHUNK_SIZE)
+	{
+		unsigned nCount = FILE_SIZE - nOffset;
+		if (nCount > CHUNK_SIZE)
+		{
+			nCount = CHUNK_SIZE;
+		}
+
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			Buffer[i] = GetPattern (nOffset + i);
+		}
+
+		if (m_FileSystem.FileWrite (hFile, Buffer, nCount) != nCount)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error at offset %u", nOffset);
+
+			bOK = FALSE;
+		}
+	}
+
+	if (!m_FileSystem.FileClose (hFile))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot close file");
+
+		bOK = FALSE;
+	}
+
+	return bOK;
+}
+
+boolean CKernel::VerifyFile (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Verifying %s", FILENAME);
+
+	unsigned hFile = m_FileSystem.FileOpen (FILENAME);
+	if (hFile == 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot open file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	boolean bOK = TRUE;
+
+	unsigned nOffset = 0;
+	u8 Buffer[CHUNK_SIZE];
+	unsigned nResult;
+	while (   bOK
+	       && (nResult = m_FileSystem.FileRead (hFile, Buffer, sizeof Buffer)) > 0)
+	{
+		if (nResult == FS_ERROR)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error at offset %u", nOffset);
+
+			bOK = FALSE;
+
+			break;
+		}
+
+		for (unsigned i = 0; i < nResult; i++)
+		{
+			if (Buffer[i] != GetPattern (nOffset + i))
+			{
+				m_Logger.Write (FromKernel, LogError, "Data mismatch at offset %u",
+						nOffset + i);
+
+				bOK = FALSE;
+
+				break;
+			}
+		}
+
+		nOffset += nResult;
+	}
+
+	if (bOK && nOffset != FILE_SIZE)
+	{
+		m_Logger.Write (FromKernel, LogError, "File size is %u (expected %u)",
+				nOffset, FILE_SIZE);
+
+		bOK = FALSE;
+	}
+
+	if (!m_FileSystem.FileClose (hFile))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot close file");
+
+		bOK = FALSE;
+	}
+
+	return bOK;
+}
+
+void CKernel::ShowStatistics (const char *pWhen)
+{
+	TFATCacheStatistics Statistics;
+	m_FileSystem.GetCacheStatistics (&Statistics);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%s: %u hits, %u misses, %u read-aheads, %u reads (%u sectors), "
+			"%u writes (%u sectors)", pWhen,
+			Statistics.nHits, Statistics.nMisses, Statistics.nReadAheads,
+			Statistics.nReads, Statistics.nSectorsRead,
+			Statistics.nWrites, Statistics.nSectorsWritten);
+}
+
+// depends on the offset, so that misplaced sectors are detected
+u8 CKernel::GetPattern (unsigned nOffset)
+{
+	return (u8) (nOffset ^ (nOffset >> 8) ^ (nOffset >> 16) ^ (nOffset >> 24));
+}
@@ -0,0 +1,127 @@
+//
+// heapbenchmark.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "heapbenchmark.h"
+#include <circle/atomic.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/alloc.h>
+#include <assert.h>
+
+#define DURATION_MSECS		2000
+#define BLOCKS_PER_ROUND	16
+
+static const size_t BlockSizes[] = {64, 1024};
+
+static const char FromBenchmark[] = "heapbench";
+
+CHeapBenchmark::CHeapBenchmark (CMemorySystem *pMemorySystem)
+:
+#ifdef ARM_ALLOW_MULTI_CORE
+	CMultiCoreSupport (pMemorySystem),
+#endif
+	m_nArrived (0),
+	m_nGeneration (0)
+{
+}
+
+CHeapBenchmark::~CHeapBenchmark (void)
+{
+}
+
+void CHeapBenchmark::Run (unsigned nCore)
+{
+	assert (nCore < BENCH_CORES);
+
+	for (unsigned i = 0; i < sizeof BlockSizes / sizeof BlockSizes[0]; i++)
+	{
+		for (unsigned nActiveCores = 1; nActiveCores <= BENCH_CORES; nActiveCores++)
+		{
+			Barrier ();
+
+			m_nAllocs[nCore] = nCore < nActiveCores ? AllocFreeLoop (BlockSizes[i]) : 0;
+
+			Barrier ();
+
+			if (nCore == 0)
+			{
+				unsigned nTotal = 0;
+				for (unsigned j = 0; j < nActiveCores; j++)
+				{
+					nTotal += m_nAllocs[j];
+				}
+
+				nTotal /= DURATION_MSECS / 1000;
+
+				CLogger::Get ()->Write (FromBenchmark, LogNotice,
+							"%lu bytes, %u core(s): %u allocs/sec (%u per core)",
+							BlockSizes[i], nActiveCores, nTotal,
+							nTotal / nActiveCores);
+			}
+		}
+	}
+
+	if (nCore == 0)
+	{
+		CLogger::Get ()->Write (FromBenchmark, LogNotice, "Finished");
+	}
+}
+
+unsigned CHeapBenchmark::AllocFreeLoop (size_t nBlockSize)
+{
+	void *pBlock[BLOCKS_PER_ROUND];
+	unsigned nAllocs = 0;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (CTimer::GetClockTicks () - nStartTicks < DURATION_MSECS * (CLOCKHZ / 1000))
+	{
+		for (unsigned i = 0; i < BLOCKS_PER_ROUND; i++)
+		{
+			pBlock[i] = malloc (nBlockSize);
+			assert (pBlock[i] != 0);
+		}
+
+		for (unsigned i = 0; i < BLOCKS_PER_ROUND; i++)
+		{
+			free (pBlock[i]);
+		}
+
+		nAllocs += BLOCKS_PER_ROUND;
+	}
+
+	return nAllocs;
+}
+
+void CHeapBenchmark::Barrier (void)
+{
+	int nGeneration = AtomicGet (&m_nGeneration);
+
+	if (AtomicIncrement (&m_nArrived) == BENCH_CORES)
+	{
+		AtomicSet (&m_nArrived, 0);
+		AtomicIncrement (&m_nGeneration);
+	}
+	else
+	{
+		while (AtomicGet (&m_nGeneration) == nGeneration)
+		{
+			// just wait
+		}
+	}
+}
@@ -0,0 +1,190 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define I2C_MASTER_DEVICE	1		// 0 on Raspberry Pi 1 Rev. 1 boards
+
+#define TEST_ADDRESS		0x50		// any slave with a readable register 0
+#define NACK_ADDRESS		0x7F		// reserved address, nobody answers
+
+#define TEST_REGISTER		0
+#define TEST_COUNT		4
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_I2CMaster (I2C_MASTER_DEVICE, FALSE, 0, &m_Interrupt),
+	m_nCompleted (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_I2CMaster.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	static const u8 Register[] = {TEST_REGISTER};
+	u8 ReadBuffer[TEST_COUNT];
+	u8 RepeatedStartBuffer[TEST_COUNT];
+	u8 NACKBuffer[TEST_COUNT];
+
+	// set the register pointer, read from it, read it again with repeated start
+	// and access a not existing slave, all transactions are queued at once
+	CI2CTransaction Write (TEST_ADDRESS, Register, sizeof Register);
+	CI2CTransaction Read (TEST_ADDRESS, 0, 0, ReadBuffer, sizeof ReadBuffer);
+	CI2CTransaction RepeatedStart (TEST_ADDRESS, Register, sizeof Register,
+				       RepeatedStartBuffer, sizeof RepeatedStartBuffer);
+	CI2CTransaction NACK (NACK_ADDRESS, 0, 0, NACKBuffer, sizeof NACKBuffer);
+
+	CI2CTransaction *Transactions[] = {&Write, &Read, &RepeatedStart, &NACK};
+	static const char *Names[] = {"Write", "Read", "Repeated start", "NACK"};
+	static const int ExpectedResults[] = {sizeof Register, TEST_COUNT, TEST_COUNT,
+					      -I2C_MASTER_ERROR_NACK};
+
+	for (unsigned i = 0; i < 4; i++)
+	{
+		Transactions[i]->SetCompletionRoutine (CompletionRoutine, this);
+
+		if (!m_I2CMaster.Submit (Transactions[i]))
+		{
+			m_Logger.Write (FromKernel, LogPanic, "%s: Submit failed", Names[i]);
+		}
+	}
+
+	boolean bOK = TRUE;
+
+	for (unsigned i = 0; i < 4; i++)
+	{
+		int nResult = Transactions[i]->Wait ();
+
+		m_Logger.Write (FromKernel, nResult == ExpectedResults[i] ? LogNotice : LogError,
+				"%s: Result %d (expected %d)", Names[i], nResult, ExpectedResults[i]);
+
+		if (nResult != ExpectedResults[i])
+		{
+			bOK = FALSE;
+		}
+	}
+
+	// the transactions must have been completed in submission order
+	assert (m_nCompleted == 4);
+	for (unsigned i = 0; i < 4; i++)
+	{
+		if (m_pCompleted[i] != Transactions[i])
+		{
+			m_Logger.Write (FromKernel, LogError, "Completion order is wrong");
+
+			bOK = FALSE;
+
+			break;
+		}
+	}
+
+	if (   bOK
+	    && memcmp (ReadBuffer, RepeatedStartBuffer, TEST_COUNT) != 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Read data differs");
+
+		bOK = FALSE;
+	}
+
+	// the synchronous interface uses the same queue
+	if (   bOK
+	    && m_I2CMaster.Read (NACK_ADDRESS, NACKBuffer, sizeof NACKBuffer)
+		!= -I2C_MASTER_ERROR_NACK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Synchronous read: NACK not detected");
+
+		bOK = FALSE;
+	}
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+void CKernel::CompletionRoutine (CI2CTransaction *pTransaction, void *pParam)
+{
+	CKernel *pThis = (CKernel *) pParam;
+	assert (pThis != 0);
+
+	assert (pTransaction != 0);
+	assert (pTransaction->IsCompleted ());
+
+	if (pThis->m_nCompleted < 4)
+	{
+		pThis->m_pCompleted[pThis->m_nCompleted] = pTransaction;
+	}
+
+	pThis->m_nCompleted++;
+}
@@ -0,0 +1,194 @@
+//
+// demuxbenchmark.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "demuxbenchmark.h"
+#include <circle/net/transportlayer.h>
+#include <circle/net/linklayer.h>
+#include <circle/net/networklayer.h>
+#include <circle/net/checksumcalculator.h>
+#include <circle/net/in.h>
+#include <circle/sched/scheduler.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <circle/macros.h>
+#include <assert.h>
+
+#define MAX_CONNECTIONS		1000
+#define TOTAL_FRAMES		100000
+
+#define OWN_PORT_BASE		20000
+#define FOREIGN_PORT_BASE	30000
+#define BOUND_PORT		10000
+#define UNBOUND_PORT		10001
+
+#define PAYLOAD_SIZE		18
+
+struct TUDPFrame
+{
+	TEthernetHeader	Ethernet;
+	TIPHeader	IP;
+	u16		nSourcePort;
+	u16		nDestPort;
+	u16		nLength;
+	u16		nChecksum;
+	u8		Payload[PAYLOAD_SIZE];
+}
+PACKED;
+
+static const unsigned s_nConnections[] = {1, 10, 100, MAX_CONNECTIONS};
+
+static const u8 ForeignIPAddress[] = {192, 168, 0, 100};
+static const u8 ForeignMACAddress[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x64};
+
+static const char From[] = "demux";
+
+CDemuxBenchmark::CDemuxBenchmark (CNetSubSystem *pNet, CFrameSourceDevice *pDevice)
+:	m_pNet (pNet),
+	m_pDevice (pDevice),
+	m_ForeignIP (ForeignIPAddress),
+	m_pFrames (new TSourceFrame[MAX_CONNECTIONS]),
+	m_pHandle (new int[MAX_CONNECTIONS])
+{
+	assert (m_pFrames != 0);
+	assert (m_pHandle != 0);
+}
+
+CDemuxBenchmark::~CDemuxBenchmark (void)
+{
+	delete [] m_pHandle;
+	m_pHandle = 0;
+
+	delete [] m_pFrames;
+	m_pFrames = 0;
+}
+
+void CDemuxBenchmark::Run (void)
+{
+	CLogger::Get ()->Write (From, LogNotice, "Delivering %u UDP frames per measurement",
+				TOTAL_FRAMES);
+
+	for (unsigned i = 0; i < sizeof s_nConnections / sizeof s_nConnections[0]; i++)
+	{
+		Measure (s_nConnections[i]);
+	}
+
+	CLogger::Get ()->Write (From, LogNotice, "Done");
+}
+
+void CDemuxBenchmark::Measure (unsigned nConnections)
+{
+	assert (nConnections <= MAX_CONNECTIONS);
+
+	CTransportLayer *pTransportLayer = m_pNet->GetTransportLayer ();
+	assert (pTransportLayer != 0);
+
+	for (unsigned i = 0; i < nConnections; i++)
+	{
+		m_pHandle[i] = pTransportLayer->Connect (m_ForeignIP, FOREIGN_PORT_BASE + i,
+							 OWN_PORT_BASE + i, IPPROTO_UDP);
+		assert (m_pHandle[i] >= 0);
+	}
+
+	int hBound = pTransportLayer->Bind (BOUND_PORT, IPPROTO_UDP);
+	assert (hBound >= 0);
+
+	// to connected sockets, one frame per connection
+	for (unsigned i = 0; i < nConnections; i++)
+	{
+		BuildFrame (&m_pFrames[i], FOREIGN_PORT_BASE + i, OWN_PORT_BASE + i);
+	}
+	unsigned nConnected = Deliver (nConnections, TOTAL_FRAMES);
+
+	// to a bound socket from different foreign ports
+	for (unsigned i = 0; i < nConnections; i++)
+	{
+		BuildFrame (&m_pFrames[i], FOREIGN_PORT_BASE + MAX_CONNECTIONS + i, BOUND_PORT);
+	}
+	unsigned nBound = Deliver (nConnections, TOTAL_FRAMES);
+
+	// to a port, which is not in use
+	BuildFrame (&m_pFrames[0], FOREIGN_PORT_BASE, UNBOUND_PORT);
+	unsigned nUnbound = Deliver (1, TOTAL_FRAMES);
+
+	CLogger::Get ()->Write (From, LogNotice,
+				"%4u connections: connected %5u ns, bound %5u ns, unbound %5u ns per frame",
+				nConnections,
+				nConnected * 10 / (TOTAL_FRAMES / 100),
+				nBound * 10 / (TOTAL_FRAMES / 100),
+				nUnbound * 10 / (TOTAL_FRAMES / 100));
+
+	pTransportLayer->Disconnect (hBound);
+	for (unsigned i = 0; i < nConnections; i++)
+	{
+		pTransportLayer->Disconnect (m_pHandle[i]);
+	}
+
+	// wait for the connections to be removed
+	CScheduler::Get ()->MsSleep (100);
+}
+
+unsigned CDemuxBenchmark::Deliver (unsigned nFrames, unsigned nTotal)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	assert (m_pDevice != 0);
+	m_pDevice->Start (m_pFrames, nFrames, nTotal);
+
+	// the net task processes all frames, which it has fetched, before it yields
+	while (!m_pDevice->IsFinished ())
+	{
+		CScheduler::Get ()->Yield ();
+	}
+
+	return CTimer::GetClockTicks () - nStartTicks;
+}
+
+void CDemuxBenchmark::BuildFrame (TSourceFrame *pFrame, u16 nForeignPort, u16 nOwnPort)
+{
+	assert (pFrame != 0);
+	assert (sizeof (TUDPFrame) <= FRAME_SOURCE_MAX_LENGTH);
+	TUDPFrame *pUDPFrame = (TUDPFrame *) pFrame->Data;
+	memset (pUDPFrame, 0, sizeof (TUDPFrame));
+
+	assert (m_pDevice != 0);
+	m_pDevice->GetMACAddress ()->CopyTo (pUDPFrame->Ethernet.MACReceiver);
+	memcpy (pUDPFrame->Ethernet.MACSender, ForeignMACAddress, MAC_ADDRESS_SIZE);
+	pUDPFrame->Ethernet.nProtocolType = BE (ETH_PROT_IP);
+
+	TIPHeader *pIPHeader = &pUDPFrame->IP;
+	pIPHeader->nVersionIHL = IP_VERSION << 4 | IP_HEADER_LENGTH_DWORD_MIN;
+	pIPHeader->nTypeOfService = IP_TOS_ROUTINE;
+	pIPHeader->nTotalLength = le2be16 (sizeof (TUDPFrame) - sizeof (TEthernetHeader));
+	pIPHeader->nTTL = IP_TTL_DEFAULT;
+	pIPHeader->nProtocol = IPPROTO_UDP;
+	m_ForeignIP.CopyTo (pIPHeader->SourceAddress);
+	m_pNet->GetConfig ()->GetIPAddress ()->CopyTo (pIPHeader->DestinationAddress);
+	pIPHeader->nHeaderChecksum = CChecksumCalculator::SimpleCalculate (pIPHeader,
+									    sizeof (TIPHeader));
+
+	pUDPFrame->nSourcePort = le2be16 (nForeignPort);
+	pUDPFrame->nDestPort = le2be16 (nOwnPort);
+
+	// the UDP length exceeds the datagram, so that the frame is dropped by the
+	// receiving connection after demultiplexing and does not fill its queue
+	pUDPFrame->nLength = le2be16 (8 + PAYLOAD_SIZE + 1);
+
+	pFrame->nLength = sizeof (TUDPFrame);
+}
@@ -0,0 +1,54 @@
+//
+// demuxbenchmark.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _demuxbenchmark_h
+#define _demuxbenchmark_h
+
+#include <circle/net/netsubsystem.h>
+#include <circle/net/ipaddress.h>
+#include <circle/types.h>
+#include "framesourcedevice.h"
+
+class CDemuxBenchmark
+{
+public:
+	CDemuxBenchmark (CNetSubSystem *pNet, CFrameSourceDevice *pDevice);
+	~CDemuxBenchmark (void);
+
+	void Run (void);
+
+private:
+	void Measure (unsigned nConnections);
+
+	// returns the time in microseconds for nTotal frames
+	unsigned Deliver (unsigned nFrames, unsigned nTotal);
+
+	void BuildFrame (TSourceFrame *pFrame, u16 nForeignPort, u16 nOwnPort);
+
+private:
+	CNetSubSystem *m_pNet;
+	CFrameSourceDevice *m_pDevice;
+
+	CIPAddress m_ForeignIP;
+
+	TSourceFrame *m_pFrames;
+	int *m_pHandle;
+};
+
+#endif
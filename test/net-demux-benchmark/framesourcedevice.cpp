@@ -0,0 +1,102 @@
+//
+// framesourcedevice.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "framesourcedevice.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define BATCH_SIZE	32		// return "nothing received" after this number of frames
+
+static const u8 OwnMACAddress[MAC_ADDRESS_SIZE] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+CFrameSourceDevice::CFrameSourceDevice (void)
+:	m_MACAddress (OwnMACAddress),
+	m_pFrames (0),
+	m_nFrames (0),
+	m_nRemaining (0),
+	m_nNext (0),
+	m_nBatch (0)
+{
+	AddNetDevice ();
+}
+
+CFrameSourceDevice::~CFrameSourceDevice (void)
+{
+	m_pFrames = 0;
+}
+
+const CMACAddress *CFrameSourceDevice::GetMACAddress (void) const
+{
+	return &m_MACAddress;
+}
+
+boolean CFrameSourceDevice::SendFrame (const void *pBuffer, unsigned nLength)
+{
+	return TRUE;
+}
+
+boolean CFrameSourceDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
+{
+	if (m_nRemaining == 0)
+	{
+		return FALSE;
+	}
+
+	// limit the number of frames, which are queued by the net stack at once
+	if (++m_nBatch > BATCH_SIZE)
+	{
+		m_nBatch = 0;
+
+		return FALSE;
+	}
+
+	assert (m_pFrames != 0);
+	const TSourceFrame *pFrame = &m_pFrames[m_nNext];
+	if (++m_nNext == m_nFrames)
+	{
+		m_nNext = 0;
+	}
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, pFrame->Data, pFrame->nLength);
+
+	assert (pResultLength != 0);
+	*pResultLength = pFrame->nLength;
+
+	m_nRemaining--;
+
+	return TRUE;
+}
+
+void CFrameSourceDevice::Start (const TSourceFrame *pFrames, unsigned nFrames, unsigned nTotal)
+{
+	assert (pFrames != 0);
+	assert (nFrames > 0);
+
+	m_pFrames = pFrames;
+	m_nFrames = nFrames;
+	m_nNext = 0;
+	m_nBatch = 0;
+	m_nRemaining = nTotal;
+}
+
+boolean CFrameSourceDevice::IsFinished (void) const
+{
+	return m_nRemaining == 0;
+}
@@ -0,0 +1,62 @@
+//
+// framesourcedevice.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _framesourcedevice_h
+#define _framesourcedevice_h
+
+#include <circle/netdevice.h>
+#include <circle/macaddress.h>
+#include <circle/types.h>
+
+#define FRAME_SOURCE_MAX_LENGTH	128
+
+struct TSourceFrame
+{
+	u8	Data[FRAME_SOURCE_MAX_LENGTH];
+	unsigned nLength;
+};
+
+class CFrameSourceDevice : public CNetDevice	/// Feeds prepared frames into the net stack
+{
+public:
+	CFrameSourceDevice (void);
+	~CFrameSourceDevice (void);
+
+	const CMACAddress *GetMACAddress (void) const;
+
+	// sent frames are discarded
+	boolean SendFrame (const void *pBuffer, unsigned nLength);
+
+	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
+
+	// deliver nTotal frames, taken round robin from pFrames[0..nFrames-1]
+	void Start (const TSourceFrame *pFrames, unsigned nFrames, unsigned nTotal);
+	boolean IsFinished (void) const;
+
+private:
+	CMACAddress m_MACAddress;
+
+	const TSourceFrame *m_pFrames;
+	unsigned m_nFrames;
+	volatile unsigned m_nRemaining;
+	unsigned m_nNext;
+	unsigned m_nBatch;
+};
+
+#endif
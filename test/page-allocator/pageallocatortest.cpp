@@ -0,0 +1,318 @@
+//
+// pageallocatortest.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "pageallocatortest.h"
+#include <circle/atomic.h>
+#include <circle/logger.h>
+#include <circle/alloc.h>
+#include <assert.h>
+
+#define MULTI_CORE_ROUNDS	1000
+
+static const char FromTest[] = "pagetest";
+
+CPageAllocatorTest::CPageAllocatorTest (CMemorySystem *pMemorySystem)
+:
+#ifdef ARM_ALLOW_MULTI_CORE
+	CMultiCoreSupport (pMemorySystem),
+#endif
+	m_bOK (TRUE),
+	m_nArrived (0),
+	m_nGeneration (0)
+{
+	// the test region is aligned to its size, so that it is one buddy block
+	m_pRegionBuffer = new u8[2 * TEST_REGION_SIZE];
+	assert (m_pRegionBuffer != 0);
+	m_nRegion = ((uintptr) m_pRegionBuffer + TEST_REGION_SIZE-1) & ~(TEST_REGION_SIZE-1);
+
+	m_pAllocator = new CPageAllocator;
+	assert (m_pAllocator != 0);
+	m_pAllocator->Setup (m_nRegion, TEST_REGION_SIZE);
+}
+
+CPageAllocatorTest::~CPageAllocatorTest (void)
+{
+	delete m_pAllocator;
+	m_pAllocator = 0;
+
+	delete [] m_pRegionBuffer;
+	m_pRegionBuffer = 0;
+}
+
+void CPageAllocatorTest::Run (unsigned nCore)
+{
+	assert (nCore < TEST_CORES);
+
+	if (nCore == 0)
+	{
+		TestContiguous ();
+		TestCoalesce ();
+		TestCoreCacheSingle ();
+	}
+
+	Barrier ();
+
+	TestCoreCacheMulti (nCore);
+
+	Barrier ();
+
+	if (nCore == 0)
+	{
+		CLogger::Get ()->Write (FromTest, m_bOK ? LogNotice : LogError,
+					m_bOK ? "All tests passed" : "Test failed");
+	}
+}
+
+// Blocks are naturally aligned to their (rounded up) size and to the requested alignment.
+void CPageAllocatorTest::TestContiguous (void)
+{
+	CLogger::Get ()->Write (FromTest, LogNotice, "Test 1: Contiguous allocation");
+
+	static const struct
+	{
+		unsigned nPages;
+		unsigned nAlignPages;
+		unsigned nBlockPages;		// expected (rounded up) block size
+	}
+	Requests[] =
+	{
+		{2, 0, 2},
+		{3, 0, 4},
+		{2, 8, 8},
+		{5, 4, 8},
+		{16, 0, 16}
+	};
+	const unsigned nRequests = sizeof Requests / sizeof Requests[0];
+
+	size_t nFreeSpace = m_pAllocator->GetFreeSpace ();
+	Check (nFreeSpace == TEST_REGION_SIZE, "Initial free space");
+
+	void *pBlock[nRequests];
+	size_t nAllocated = 0;
+	for (unsigned i = 0; i < nRequests; i++)
+	{
+		size_t nBlockSize = Requests[i].nBlockPages * PAGE_SIZE;
+
+		pBlock[i] = m_pAllocator->Allocate (Requests[i].nPages * PAGE_SIZE,
+						    Requests[i].nAlignPages * PAGE_SIZE);
+		Check (pBlock[i] != 0, "Allocate contiguous");
+		Check (((uintptr) pBlock[i] & (nBlockSize-1)) == 0, "Block alignment");
+
+		nAllocated += nBlockSize;
+		Check (m_pAllocator->GetFreeSpace () == nFreeSpace - nAllocated, "Block size");
+	}
+
+	// blocks must not overlap
+	for (unsigned i = 0; i < nRequests; i++)
+	{
+		for (unsigned j = i+1; j < nRequests; j++)
+		{
+			uintptr nStart1 = (uintptr) pBlock[i];
+			uintptr nEnd1 = nStart1 + Requests[i].nBlockPages * PAGE_SIZE;
+			uintptr nStart2 = (uintptr) pBlock[j];
+			uintptr nEnd2 = nStart2 + Requests[j].nBlockPages * PAGE_SIZE;
+
+			Check (nEnd1 <= nStart2 || nEnd2 <= nStart1, "Blocks overlap");
+		}
+	}
+
+	for (unsigned i = 0; i < nRequests; i++)
+	{
+		m_pAllocator->Free (pBlock[i]);
+	}
+
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace, "Free space after free");
+
+	// the same for the system page allocator
+	void *pPages = palloc_contiguous (3 * PAGE_SIZE, 8 * PAGE_SIZE);
+	Check (pPages != 0, "palloc_contiguous()");
+	Check (((uintptr) pPages & (8 * PAGE_SIZE - 1)) == 0, "palloc_contiguous() alignment");
+	pfree (pPages);
+}
+
+// Splitting the region completely into the smallest non-cached blocks and freeing them
+// in a different order must coalesce them into the original block again.
+void CPageAllocatorTest::TestCoalesce (void)
+{
+	CLogger::Get ()->Write (FromTest, LogNotice, "Test 2: Split and coalesce");
+
+	size_t nFreeSpace = m_pAllocator->GetFreeSpace ();
+	Check (nFreeSpace == TEST_REGION_SIZE, "Initial free space");
+
+	const unsigned nBlocks = TEST_REGION_PAGES / 2;
+	void *pBlock[nBlocks];
+	for (unsigned i = 0; i < nBlocks; i++)
+	{
+		pBlock[i] = m_pAllocator->Allocate (2 * PAGE_SIZE);
+		Check (pBlock[i] != 0, "Allocate 2 pages");
+	}
+
+	Check (m_pAllocator->GetFreeSpace () == 0, "Region exhausted");
+	Check (m_pAllocator->Allocate (2 * PAGE_SIZE) == 0, "Allocate beyond region");
+
+	// free odd blocks first, so that no buddy can be merged before the second pass
+	for (unsigned nPass = 0; nPass < 2; nPass++)
+	{
+		for (unsigned i = 1 - nPass; i < nBlocks; i += 2)
+		{
+			m_pAllocator->Free (pBlock[i]);
+		}
+	}
+
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace, "Free space after free");
+
+	void *pRegion = m_pAllocator->Allocate (TEST_REGION_SIZE);
+	Check (pRegion == (void *) m_nRegion, "Region coalesced");
+	m_pAllocator->Free (pRegion);
+
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace, "Free space at end");
+}
+
+// With the per-core cache single pages are taken from the buddy allocator in batches
+// of half of the cache size, and at most one full cache is held back on free.
+void CPageAllocatorTest::TestCoreCacheSingle (void)
+{
+	CLogger::Get ()->Write (FromTest, LogNotice, "Test 3: Per-core cache refill and drain");
+
+	size_t nFreeSpace = m_pAllocator->GetFreeSpace ();
+	Check (nFreeSpace == TEST_REGION_SIZE, "Initial free space");
+
+	void *pPage = m_pAllocator->Allocate ();
+	Check (pPage != 0, "Allocate single page");
+#ifdef PAGE_CORE_CACHE
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace - PAGE_CORE_CACHE_PAGES/2 * PAGE_SIZE,
+	       "Cache refill");
+#else
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace - PAGE_SIZE, "Single page");
+#endif
+	m_pAllocator->Free (pPage);
+
+	const unsigned nPages = TEST_REGION_PAGES / 2;
+	void *pPages[nPages];
+	for (unsigned i = 0; i < nPages; i++)
+	{
+		pPages[i] = m_pAllocator->Allocate ();
+		Check (pPages[i] != 0, "Allocate single page");
+	}
+
+	Check (m_pAllocator->GetFreeSpace () <= nFreeSpace - nPages * PAGE_SIZE, "Pages allocated");
+
+	for (unsigned i = 0; i < nPages; i++)
+	{
+		m_pAllocator->Free (pPages[i]);
+	}
+
+#ifdef PAGE_CORE_CACHE
+	Check (m_pAllocator->GetFreeSpace () >= nFreeSpace - PAGE_CORE_CACHE_PAGES * PAGE_SIZE,
+	       "Cache drain");
+#else
+	Check (m_pAllocator->GetFreeSpace () == nFreeSpace, "Free space after free");
+#endif
+}
+
+// Each core allocates a batch of single pages and tags them. After a barrier each core
+// checks the tags of the pages of the next core and frees them, so that pages move
+// between the per-core caches. A page, which is handed out twice, has a wrong tag.
+void CPageAllocatorTest::TestCoreCacheMulti (unsigned nCore)
+{
+	if (nCore == 0)
+	{
+		CLogger::Get ()->Write (FromTest, LogNotice,
+					"Test 4: Allocate and free on %u core(s)", TEST_CORES);
+	}
+
+	unsigned nNextCore = (nCore + 1) % TEST_CORES;
+
+	for (unsigned nRound = 0; nRound < MULTI_CORE_ROUNDS; nRound++)
+	{
+		for (unsigned i = 0; i < TEST_BATCH_PAGES; i++)
+		{
+			u32 *pPage = (u32 *) m_pAllocator->Allocate ();
+			Check (pPage != 0, "Allocate single page");
+			if (pPage != 0)
+			{
+				pPage[0] = nCore;
+				pPage[1] = nRound;
+				pPage[2] = i;
+			}
+
+			m_pPages[nCore][i] = pPage;
+		}
+
+		Barrier ();
+
+		for (unsigned i = 0; i < TEST_BATCH_PAGES; i++)
+		{
+			u32 *pPage = (u32 *) m_pPages[nNextCore][i];
+			if (pPage != 0)
+			{
+				Check (   pPage[0] == nNextCore
+				       && pPage[1] == nRound
+				       && pPage[2] == i, "Page tag");
+
+				m_pAllocator->Free (pPage);
+			}
+		}
+
+		Barrier ();
+	}
+
+	Barrier ();
+
+	if (nCore == 0)
+	{
+		size_t nFreeSpace = m_pAllocator->GetFreeSpace ();
+
+		Check (nFreeSpace % PAGE_SIZE == 0, "Free space granularity");
+#ifdef PAGE_CORE_CACHE
+		Check (nFreeSpace >= TEST_REGION_SIZE - TEST_CORES * PAGE_CORE_CACHE_PAGES * PAGE_SIZE,
+		       "Pages held in caches");
+#else
+		Check (nFreeSpace == TEST_REGION_SIZE, "Free space at end");
+#endif
+	}
+}
+
+void CPageAllocatorTest::Check (boolean bCondition, const char *pWhat)
+{
+	if (!bCondition)
+	{
+		CLogger::Get ()->Write (FromTest, LogError, "%s failed", pWhat);
+
+		m_bOK = FALSE;
+	}
+}
+
+void CPageAllocatorTest::Barrier (void)
+{
+	int nGeneration = AtomicGet (&m_nGeneration);
+
+	if (AtomicIncrement (&m_nArrived) == TEST_CORES)
+	{
+		AtomicSet (&m_nArrived, 0);
+		AtomicIncrement (&m_nGeneration);
+	}
+	else
+	{
+		while (AtomicGet (&m_nGeneration) == nGeneration)
+		{
+			// just wait
+		}
+	}
+}
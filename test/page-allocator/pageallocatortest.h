@@ -0,0 +1,80 @@
+//
+// pageallocatortest.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pageallocatortest_h
+#define _pageallocatortest_h
+
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <circle/memorymap.h>
+#include <circle/pageallocator.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define TEST_CORES	CORES
+#else
+	#define TEST_CORES	1
+#endif
+
+#define TEST_REGION_PAGES	64		// must be a power of 2
+#define TEST_REGION_SIZE	(TEST_REGION_PAGES * PAGE_SIZE)
+
+// per core and round, the pages in use and in the per-core caches must fit into the region
+#define TEST_BATCH_PAGES	6
+
+class CPageAllocatorTest
+#ifdef ARM_ALLOW_MULTI_CORE
+	: public CMultiCoreSupport
+#endif
+{
+public:
+	CPageAllocatorTest (CMemorySystem *pMemorySystem);
+	~CPageAllocatorTest (void);
+
+#ifndef ARM_ALLOW_MULTI_CORE
+	boolean Initialize (void)	{ return TRUE; }
+#endif
+
+	void Run (unsigned nCore);
+
+private:
+	void TestContiguous (void);
+	void TestCoalesce (void);
+	void TestCoreCacheSingle (void);
+	void TestCoreCacheMulti (unsigned nCore);
+
+	void Check (boolean bCondition, const char *pWhat);
+
+	void Barrier (void);
+
+private:
+	u8 *m_pRegionBuffer;
+	uintptr m_nRegion;			// aligned to TEST_REGION_SIZE
+	CPageAllocator *m_pAllocator;		// private instance, manages m_nRegion
+
+	void *m_pPages[TEST_CORES][TEST_BATCH_PAGES];
+
+	volatile boolean m_bOK;
+
+	volatile int m_nArrived;
+	volatile int m_nGeneration;
+};
+
+#endif
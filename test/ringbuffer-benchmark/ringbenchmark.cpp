@@ -0,0 +1,265 @@
+//
+// ringbenchmark.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "ringbenchmark.h"
+#include <circle/atomic.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+#define DURATION_MSECS		2000
+#define ITEMS_PER_ROUND		16
+
+static const char *RingTypeName[] = {"spin lock", "SPSC", "MPSC"};
+
+static const char FromBenchmark[] = "ringbench";
+
+CSpinLockRingBuffer::CSpinLockRingBuffer (void)
+:	m_nInPtr (0),
+	m_nOutPtr (0)
+{
+}
+
+unsigned CSpinLockRingBuffer::Enqueue (const unsigned *pItems, unsigned nCount)
+{
+	unsigned nResult = 0;
+
+	m_SpinLock.Acquire ();
+
+	while (   nResult < nCount
+	       && ((m_nInPtr+1) & (RING_SIZE-1)) != m_nOutPtr)
+	{
+		m_Buffer[m_nInPtr] = pItems[nResult++];
+
+		m_nInPtr = (m_nInPtr+1) & (RING_SIZE-1);
+	}
+
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+unsigned CSpinLockRingBuffer::Dequeue (unsigned *pItems, unsigned nCount)
+{
+	unsigned nResult = 0;
+
+	m_SpinLock.Acquire ();
+
+	while (   nResult < nCount
+	       && m_nInPtr != m_nOutPtr)
+	{
+		pItems[nResult++] = m_Buffer[m_nOutPtr];
+
+		m_nOutPtr = (m_nOutPtr+1) & (RING_SIZE-1);
+	}
+
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+CRingBenchmark::CRingBenchmark (CMemorySystem *pMemorySystem)
+:
+#ifdef ARM_ALLOW_MULTI_CORE
+	CMultiCoreSupport (pMemorySystem),
+#endif
+	m_SPSCRing (RING_SIZE),
+	m_MPSCRing (RING_SIZE),
+	m_nStop (0),
+	m_nArrived (0),
+	m_nGeneration (0)
+{
+}
+
+CRingBenchmark::~CRingBenchmark (void)
+{
+}
+
+void CRingBenchmark::Run (unsigned nCore)
+{
+	assert (nCore < BENCH_CORES);
+
+	for (unsigned i = RingSpinLock; i < RingTypeUnknown; i++)
+	{
+		TRingType Type = (TRingType) i;
+
+		// enqueue and dequeue on one core
+
+		Barrier ();
+
+		if (nCore == 0)
+		{
+			unsigned nItems = SingleCoreLoop (Type) / (DURATION_MSECS / 1000);
+
+			CLogger::Get ()->Write (FromBenchmark, LogNotice,
+						"%s, 1 core: %u items/sec", RingTypeName[Type], nItems);
+		}
+
+		if (BENCH_CORES == 1)
+		{
+			continue;
+		}
+
+		// producer(s) on core(s) 1.., consumer on core 0
+
+		unsigned nProducers = Type == RingSPSC ? 1 : BENCH_CORES-1;
+
+		Barrier ();
+
+		unsigned nItems = 0;
+		if (nCore == 0)
+		{
+			nItems = ConsumerLoop (Type);
+		}
+		else if (nCore <= nProducers)
+		{
+			ProducerLoop (Type);
+		}
+
+		Barrier ();
+
+		if (nCore == 0)
+		{
+			// drain the ring buffer for the next test
+			unsigned Items[ITEMS_PER_ROUND];
+			while (Dequeue (Type, Items, ITEMS_PER_ROUND) > 0)
+			{
+				// just drain
+			}
+
+			AtomicSet (&m_nStop, 0);
+
+			nItems /= DURATION_MSECS / 1000;
+
+			CLogger::Get ()->Write (FromBenchmark, LogNotice,
+						"%s, %u producer(s) + 1 consumer: %u items/sec",
+						RingTypeName[Type], nProducers, nItems);
+		}
+	}
+
+	Barrier ();
+
+	if (nCore == 0)
+	{
+		CLogger::Get ()->Write (FromBenchmark, LogNotice, "Finished");
+	}
+}
+
+unsigned CRingBenchmark::SingleCoreLoop (TRingType Type)
+{
+	unsigned Items[ITEMS_PER_ROUND];
+	for (unsigned i = 0; i < ITEMS_PER_ROUND; i++)
+	{
+		Items[i] = i;
+	}
+
+	unsigned nItems = 0;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (CTimer::GetClockTicks () - nStartTicks < DURATION_MSECS * (CLOCKHZ / 1000))
+	{
+		for (unsigned i = 0; i < ITEMS_PER_ROUND; i++)
+		{
+			Enqueue (Type, &Items[i], 1);
+		}
+
+		for (unsigned i = 0; i < ITEMS_PER_ROUND; i++)
+		{
+			nItems += Dequeue (Type, &Items[i], 1);
+		}
+	}
+
+	return nItems;
+}
+
+unsigned CRingBenchmark::ConsumerLoop (TRingType Type)
+{
+	unsigned Items[ITEMS_PER_ROUND];
+	unsigned nItems = 0;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (CTimer::GetClockTicks () - nStartTicks < DURATION_MSECS * (CLOCKHZ / 1000))
+	{
+		nItems += Dequeue (Type, Items, ITEMS_PER_ROUND);
+	}
+
+	AtomicSet (&m_nStop, 1);
+
+	return nItems;
+}
+
+void CRingBenchmark::ProducerLoop (TRingType Type)
+{
+	unsigned Items[ITEMS_PER_ROUND];
+	for (unsigned i = 0; i < ITEMS_PER_ROUND; i++)
+	{
+		Items[i] = i;
+	}
+
+	while (!AtomicGet (&m_nStop))
+	{
+		Enqueue (Type, Items, ITEMS_PER_ROUND);
+	}
+}
+
+unsigned CRingBenchmark::Enqueue (TRingType Type, const unsigned *pItems, unsigned nCount)
+{
+	switch (Type)
+	{
+	case RingSpinLock:	return m_SpinLockRing.Enqueue (pItems, nCount);
+	case RingSPSC:		return m_SPSCRing.Enqueue (pItems, nCount);
+	case RingMPSC:		return m_MPSCRing.Enqueue (pItems, nCount);
+
+	default:
+		assert (0);
+		return 0;
+	}
+}
+
+unsigned CRingBenchmark::Dequeue (TRingType Type, unsigned *pItems, unsigned nCount)
+{
+	switch (Type)
+	{
+	case RingSpinLock:	return m_SpinLockRing.Dequeue (pItems, nCount);
+	case RingSPSC:		return m_SPSCRing.Dequeue (pItems, nCount);
+	case RingMPSC:		return m_MPSCRing.Dequeue (pItems, nCount);
+
+	default:
+		assert (0);
+		return 0;
+	}
+}
+
+void CRingBenchmark::Barrier (void)
+{
+	int nGeneration = AtomicGet (&m_nGeneration);
+
+	if (AtomicIncrement (&m_nArrived) == BENCH_CORES)
+	{
+		AtomicSet (&m_nArrived, 0);
+		AtomicIncrement (&m_nGeneration);
+	}
+	else
+	{
+		while (AtomicGet (&m_nGeneration) == nGeneration)
+		{
+			// just wait
+		}
+	}
+}
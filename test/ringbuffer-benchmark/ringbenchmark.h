@@ -0,0 +1,98 @@
+//
+// ringbenchmark.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _ringbenchmark_h
+#define _ringbenchmark_h
+
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <circle/ringbuffer.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define BENCH_CORES	CORES
+#else
+	#define BENCH_CORES	1
+#endif
+
+#define RING_SIZE		256		// must be a power of 2
+
+class CSpinLockRingBuffer	// ring buffer as it was used before, for comparison
+{
+public:
+	CSpinLockRingBuffer (void);
+
+	unsigned Enqueue (const unsigned *pItems, unsigned nCount);
+	unsigned Dequeue (unsigned *pItems, unsigned nCount);
+
+private:
+	unsigned m_Buffer[RING_SIZE];
+	unsigned m_nInPtr;
+	unsigned m_nOutPtr;
+
+	CSpinLock m_SpinLock;
+};
+
+enum TRingType
+{
+	RingSpinLock,
+	RingSPSC,
+	RingMPSC,
+	RingTypeUnknown
+};
+
+class CRingBenchmark
+#ifdef ARM_ALLOW_MULTI_CORE
+	: public CMultiCoreSupport
+#endif
+{
+public:
+	CRingBenchmark (CMemorySystem *pMemorySystem);
+	~CRingBenchmark (void);
+
+#ifndef ARM_ALLOW_MULTI_CORE
+	boolean Initialize (void)	{ return TRUE; }
+#endif
+
+	void Run (unsigned nCore);
+
+private:
+	unsigned SingleCoreLoop (TRingType Type);	// returns number of items transferred
+	unsigned ConsumerLoop (TRingType Type);		// returns number of items transferred
+	void ProducerLoop (TRingType Type);
+
+	unsigned Enqueue (TRingType Type, const unsigned *pItems, unsigned nCount);
+	unsigned Dequeue (TRingType Type, unsigned *pItems, unsigned nCount);
+
+	void Barrier (void);
+
+private:
+	CSpinLockRingBuffer m_SpinLockRing;
+	CSPSCRingBuffer<unsigned> m_SPSCRing;
+	CMPSCRingBuffer<unsigned> m_MPSCRing;
+
+	volatile int m_nStop;
+
+	volatile int m_nArrived;
+	volatile int m_nGeneration;
+};
+
+#endif
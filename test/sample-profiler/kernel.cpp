@@ -0,0 +1,216 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+
+#if RASPPI == 1 || defined (USE_TIMER_SOURCE)
+	#define SAMPLE_SOURCE	SampleSourceTimer
+	#define SAMPLE_PERIOD	100		// microseconds
+#else
+	#define SAMPLE_SOURCE	SampleSourcePMU
+	#define SAMPLE_PERIOD	100000		// CPU cycles
+#endif
+
+#define BUFFER_SIZE	0x100000
+#define SORT_ELEMENTS	4000
+#define PROFILE_ROUNDS	20
+
+static const char FromKernel[] = "kernel";
+
+static u8 s_Buffer[BUFFER_SIZE];
+static unsigned s_SortArray[SORT_ELEMENTS];
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_Profiler (&m_Interrupt, SAMPLE_SOURCE)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_PMU.Initialize ();
+	m_Logger.Write (FromKernel, LogNotice, "PMU has %u event counters",
+			m_PMU.GetEventCounters ());
+
+	Measure ("Sequential walk", SequentialWalk);
+	Measure ("Strided walk", StridedWalk);
+	Measure ("Insertion sort", InsertionSort);
+
+	m_Logger.Write (FromKernel, LogNotice, "Profiling");
+
+	if (!m_Profiler.Start (SAMPLE_PERIOD))
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot start profiler");
+
+		return ShutdownHalt;
+	}
+
+	for (unsigned i = 0; i < PROFILE_ROUNDS; i++)
+	{
+		Workload ();
+	}
+
+	m_Profiler.Stop ();
+
+	m_Logger.Write (FromKernel, LogNotice, "%u samples taken (%u outside of code)",
+			m_Profiler.GetSamples (0), m_Profiler.GetMissed (0));
+
+	static const char Begin[] = "--- PROFILE BEGIN ---\n";
+	static const char End[] = "--- PROFILE END ---\n";
+
+	m_Serial.Write (Begin, sizeof Begin-1);
+	m_Profiler.Dump (&m_Serial);
+	m_Serial.Write (End, sizeof End-1);
+
+	m_Logger.Write (FromKernel, LogNotice, "Profile written to serial interface");
+
+	return ShutdownHalt;
+}
+
+void CKernel::Measure (const char *pName, void (*pWorkload) (void))
+{
+	unsigned nEventCounters = m_PMU.GetEventCounters ();
+
+	static const TPerfEvent Events[] =
+	{
+		PerfEventInstructions,
+		PerfEventL1DCacheMiss,
+		PerfEventBranchMiss
+	};
+
+	boolean bEventValid[3];
+	for (unsigned i = 0; i < 3; i++)
+	{
+		bEventValid[i] = i < nEventCounters && m_PMU.SetEvent (i, Events[i]);
+	}
+
+	m_PMU.Reset ();
+	m_PMU.Start ();
+
+	(*pWorkload) ();
+
+	m_PMU.Stop ();
+
+	u32 nCount[3];
+	for (unsigned i = 0; i < 3; i++)
+	{
+		nCount[i] = bEventValid[i] ? m_PMU.GetEventCount (i) : 0;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%s: %llu cycles, %u instructions, %u L1D misses, %u branch misses",
+			pName, m_PMU.GetCycleCount (), nCount[0], nCount[1], nCount[2]);
+}
+
+void CKernel::Workload (void)
+{
+	SequentialWalk ();
+	StridedWalk ();
+	InsertionSort ();
+}
+
+void CKernel::SequentialWalk (void)
+{
+	for (unsigned i = 0; i < BUFFER_SIZE; i++)
+	{
+		s_Buffer[i]++;
+	}
+}
+
+void CKernel::StridedWalk (void)
+{
+	const unsigned nStride = 64;		// one access per cache line
+	for (unsigned nOffset = 0; nOffset < nStride; nOffset++)
+	{
+		for (unsigned i = nOffset; i < BUFFER_SIZE; i += nStride)
+		{
+			s_Buffer[i]++;
+		}
+	}
+}
+
+void CKernel::InsertionSort (void)
+{
+	u32 nSeed = 12345;
+	for (unsigned i = 0; i < SORT_ELEMENTS; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		s_SortArray[i] = nSeed >> 8;
+	}
+
+	for (unsigned i = 1; i < SORT_ELEMENTS; i++)
+	{
+		unsigned nValue = s_SortArray[i];
+
+		unsigned j;
+		for (j = i; j > 0 && s_SortArray[j-1] > nValue; j--)
+		{
+			s_SortArray[j] = s_SortArray[j-1];
+		}
+
+		s_SortArray[j] = nValue;
+	}
+}
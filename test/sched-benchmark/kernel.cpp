@@ -0,0 +1,244 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/sched/task.h>
+#include <circle/sysconfig.h>
+#include <assert.h>
+
+#define TEST_DURATION_MSECS	2000
+#define SMALL_STACK_SIZE	0x4000
+
+static const unsigned SleepingTasks[] = {0, 10, 16, 100, 400};
+
+static const char FromKernel[] = "kernel";
+
+class CYieldTask : public CTask
+{
+public:
+	CYieldTask (volatile boolean *pRun)
+	:	CTask (SMALL_STACK_SIZE),
+		m_pRun (pRun),
+		m_nCount (0)
+	{
+	}
+
+	void Run (void)
+	{
+		while (*m_pRun)
+		{
+			m_nCount++;
+
+			CScheduler::Get ()->Yield ();
+		}
+	}
+
+	unsigned GetCount (void) const
+	{
+		return m_nCount;
+	}
+
+private:
+	volatile boolean *m_pRun;
+	unsigned m_nCount;
+};
+
+class CSleepingTask : public CTask
+{
+public:
+	CSleepingTask (volatile boolean *pRun, unsigned nMilliSeconds)
+	:	CTask (SMALL_STACK_SIZE),
+		m_pRun (pRun),
+		m_nMilliSeconds (nMilliSeconds),
+		m_nCount (0)
+	{
+	}
+
+	void Run (void)
+	{
+		while (*m_pRun)
+		{
+			m_nCount++;
+
+			CScheduler::Get ()->MsSleep (m_nMilliSeconds);
+		}
+	}
+
+	unsigned GetCount (void) const
+	{
+		return m_nCount;
+	}
+
+private:
+	volatile boolean *m_pRun;
+	unsigned m_nMilliSeconds;
+	unsigned m_nCount;
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+#ifdef SCHED_READY_QUEUES
+	m_Logger.Write (FromKernel, LogNotice, "Scheduler uses ready queues");
+#else
+	m_Logger.Write (FromKernel, LogNotice, "Scheduler uses round-robin policy");
+#endif
+
+	for (unsigned i = 0; i < sizeof SleepingTasks / sizeof SleepingTasks[0]; i++)
+	{
+		RunYieldTest (SleepingTasks[i]);
+	}
+
+	RunPriorityTest ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Finished");
+
+	return ShutdownHalt;
+}
+
+void CKernel::RunYieldTest (unsigned nSleepingTasks)
+{
+#ifndef SCHED_READY_QUEUES
+	if (nSleepingTasks + 3 > MAX_TASKS)	// main and two yielding tasks
+	{
+		m_Logger.Write (FromKernel, LogNotice, "%u sleeping tasks: exceeds MAX_TASKS",
+				nSleepingTasks);
+
+		return;
+	}
+#endif
+
+	volatile boolean bRun = TRUE;
+
+	CTask **ppSleeping = new CTask *[nSleepingTasks+1];
+	assert (ppSleeping != 0);
+	for (unsigned i = 0; i < nSleepingTasks; i++)
+	{
+		ppSleeping[i] = new CSleepingTask (&bRun, TEST_DURATION_MSECS * 2);
+		assert (ppSleeping[i] != 0);
+	}
+
+	CYieldTask *pYield1 = new CYieldTask (&bRun);
+	CYieldTask *pYield2 = new CYieldTask (&bRun);
+	assert (pYield1 != 0 && pYield2 != 0);
+
+	m_Scheduler.MsSleep (TEST_DURATION_MSECS);
+
+	unsigned nSwitches = pYield1->GetCount () + pYield2->GetCount ();
+
+	bRun = FALSE;
+
+	pYield1->WaitForTermination ();
+	pYield2->WaitForTermination ();
+	for (unsigned i = 0; i < nSleepingTasks; i++)
+	{
+		ppSleeping[i]->WaitForTermination ();
+	}
+
+	delete [] ppSleeping;
+
+	m_Scheduler.Yield ();		// let the scheduler delete the terminated tasks
+
+	unsigned nSwitchesPerSec = nSwitches / (TEST_DURATION_MSECS / 1000);
+	m_Logger.Write (FromKernel, LogNotice,
+			"%u sleeping tasks: %u switches/sec, %u ns per switch",
+			nSleepingTasks, nSwitchesPerSec,
+			nSwitchesPerSec > 0 ? 1000000000U / nSwitchesPerSec : 0);
+}
+
+void CKernel::RunPriorityTest (void)
+{
+#ifdef SCHED_READY_QUEUES
+	volatile boolean bRun = TRUE;
+
+	CSleepingTask *pHigh = new CSleepingTask (&bRun, 10);
+	assert (pHigh != 0);
+	pHigh->SetPriority (TASK_PRIORITY_HIGHEST);
+
+	CYieldTask *pYield1 = new CYieldTask (&bRun);
+	CYieldTask *pYield2 = new CYieldTask (&bRun);
+	assert (pYield1 != 0 && pYield2 != 0);
+
+	m_Scheduler.MsSleep (TEST_DURATION_MSECS);
+
+	unsigned nWakeups = pHigh->GetCount ();
+
+	bRun = FALSE;
+
+	pHigh->WaitForTermination ();
+	pYield1->WaitForTermination ();
+	pYield2->WaitForTermination ();
+
+	m_Scheduler.Yield ();
+
+	m_Logger.Write (FromKernel, LogNotice, "High priority task: %u wakeups/sec (expected 100)",
+			nWakeups / (TEST_DURATION_MSECS / 1000));
+#endif
+}
@@ -0,0 +1,342 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/sched/task.h>
+#include <circle/sched/mutex.h>
+#include <circle/sched/semaphore.h>
+#include <circle/sched/synchronizationevent.h>
+#include <assert.h>
+
+#define TASKS			8
+#define ROUNDS			200
+#define CALC_LOOPS		100000
+#define SMALL_STACK_SIZE	0x4000
+
+#define WAKE_ROUNDS		50
+#define WAKE_DELAY		MSEC2HZ (20)
+#define WAKE_TIMEOUT_US		1000000
+
+#ifdef SCHED_MULTI_CORE
+	#define TEST_CORES	CORES
+#else
+	#define TEST_CORES	1
+#endif
+
+static const char FromKernel[] = "kernel";
+
+class CWorkerTask : public CTask
+{
+public:
+	CWorkerTask (CMutex *pMutex, volatile unsigned *pMutexCounter,
+		     CSemaphore *pSemaphore, volatile unsigned *pSemaphoreCounter,
+		     unsigned *pRounds)
+	:	CTask (SMALL_STACK_SIZE),
+		m_pMutex (pMutex),
+		m_pMutexCounter (pMutexCounter),
+		m_pSemaphore (pSemaphore),
+		m_pSemaphoreCounter (pSemaphoreCounter),
+		m_pRounds (pRounds),
+		m_nResult (1)
+	{
+		for (unsigned i = 0; i < TEST_CORES; i++)
+		{
+			m_nRounds[i] = 0;
+		}
+	}
+
+	void Run (void)
+	{
+		for (unsigned i = 0; i < ROUNDS; i++)
+		{
+			for (unsigned j = 0; j < CALC_LOOPS; j++)
+			{
+				m_nResult = m_nResult * 1103515245 + 12345;
+			}
+
+			// another task tries to increment the counter, while we yield here
+			m_pMutex->Acquire ();
+			unsigned nCounter = *m_pMutexCounter;
+			CScheduler::Get ()->Yield ();
+			*m_pMutexCounter = nCounter + 1;
+			m_pMutex->Release ();
+
+			m_pSemaphore->Down ();
+			nCounter = *m_pSemaphoreCounter;
+			CScheduler::Get ()->Yield ();
+			*m_pSemaphoreCounter = nCounter + 1;
+			m_pSemaphore->Up ();
+
+			m_nRounds[ThisCore ()]++;
+
+			CScheduler::Get ()->Yield ();
+		}
+
+		// the task object is deleted after termination, so report the result here
+		m_pMutex->Acquire ();
+		for (unsigned i = 0; i < TEST_CORES; i++)
+		{
+			m_pRounds[i] += m_nRounds[i];
+		}
+		m_pMutex->Release ();
+	}
+
+private:
+	static unsigned ThisCore (void)
+	{
+#ifdef SCHED_MULTI_CORE
+		return CMultiCoreSupport::ThisCore ();
+#else
+		return 0;
+#endif
+	}
+
+private:
+	CMutex *m_pMutex;
+	volatile unsigned *m_pMutexCounter;
+	CSemaphore *m_pSemaphore;
+	volatile unsigned *m_pSemaphoreCounter;
+	unsigned *m_pRounds;
+
+	volatile unsigned m_nResult;
+	unsigned m_nRounds[TEST_CORES];
+};
+
+// The task waits for an event, which is set from a kernel timer handler (IRQ on core 0).
+// Nothing else is ready on its core meanwhile, so that the scheduler idles in Yield().
+class CWakeTask : public CTask
+{
+public:
+	CWakeTask (unsigned *pWoken)
+	:	CTask (SMALL_STACK_SIZE),
+		m_pWoken (pWoken)
+	{
+	}
+
+	void Run (void)
+	{
+		unsigned nWoken = 0;
+		for (unsigned i = 0; i < WAKE_ROUNDS; i++)
+		{
+			m_Event.Clear ();
+
+			CTimer::Get ()->StartKernelTimer (WAKE_DELAY, TimerHandler, &m_Event);
+
+			// wait with and without timeout in turn (TaskStateBlockedWithTimeout/Blocked)
+			if (i & 1)
+			{
+				if (   m_Event.WaitWithTimeout (WAKE_TIMEOUT_US)
+				    && !m_Event.GetState ())
+				{
+					continue;
+				}
+			}
+			else
+			{
+				m_Event.Wait ();
+			}
+
+			nWoken++;
+		}
+
+		*m_pWoken = nWoken;
+	}
+
+private:
+	static void TimerHandler (TKernelTimerHandle hTimer, void *pParam, void *pContext)
+	{
+		CSynchronizationEvent *pEvent = (CSynchronizationEvent *) pParam;
+		assert (pEvent != 0);
+
+		pEvent->Set ();
+	}
+
+private:
+	unsigned *m_pWoken;
+
+	CSynchronizationEvent m_Event;
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+#ifdef SCHED_MULTI_CORE
+	, m_SchedulerCores (CMemorySystem::Get ())
+#endif
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+#ifdef SCHED_MULTI_CORE
+	if (bOK)
+	{
+		bOK = m_SchedulerCores.Initialize ();
+	}
+#endif
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	boolean bOK = RunWakeTest ();
+
+	if (bOK)
+	{
+		bOK = RunTest (0);
+	}
+
+#ifdef SCHED_MULTI_CORE
+	if (bOK)
+	{
+		bOK = RunTest (TASK_AFFINITY_ANY);
+	}
+#else
+	m_Logger.Write (FromKernel, LogNotice, "SCHED_MULTI_CORE is not defined");
+#endif
+
+	m_Logger.Write (FromKernel, LogNotice, bOK ? "Test passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::RunWakeTest (void)
+{
+	boolean bOK = TRUE;
+
+	for (unsigned nCore = 0; nCore < TEST_CORES; nCore++)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Waking the only task on core %u from IRQ",
+				nCore);
+
+		unsigned nWoken = 0;
+		CWakeTask *pTask = new CWakeTask (&nWoken);
+		assert (pTask != 0);
+
+		pTask->SetAffinity (nCore);
+
+		// blocks the main task, a lost wake-up lets the test hang here
+		pTask->WaitForTermination ();
+
+		m_Logger.Write (FromKernel, LogNotice, "Task woken %u times (expected %u)",
+				nWoken, WAKE_ROUNDS);
+
+		if (nWoken != WAKE_ROUNDS)
+		{
+			bOK = FALSE;
+		}
+	}
+
+	return bOK;
+}
+
+boolean CKernel::RunTest (unsigned nAffinity)
+{
+	if (nAffinity == TASK_AFFINITY_ANY)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Running %u tasks on all cores", TASKS);
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Running %u tasks on core %u", TASKS, nAffinity);
+	}
+
+	CMutex Mutex;
+	volatile unsigned nMutexCounter = 0;
+	CSemaphore Semaphore (1);
+	volatile unsigned nSemaphoreCounter = 0;
+
+	unsigned nRounds[TEST_CORES];
+	for (unsigned i = 0; i < TEST_CORES; i++)
+	{
+		nRounds[i] = 0;
+	}
+
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+
+	CWorkerTask *pTask[TASKS];
+	for (unsigned i = 0; i < TASKS; i++)
+	{
+		pTask[i] = new CWorkerTask (&Mutex, &nMutexCounter, &Semaphore, &nSemaphoreCounter,
+					    nRounds);
+		assert (pTask[i] != 0);
+
+		pTask[i]->SetAffinity (nAffinity);
+	}
+
+	for (unsigned i = 0; i < TASKS; i++)
+	{
+		pTask[i]->WaitForTermination ();
+	}
+
+	unsigned nMsecs = (m_Timer.GetClockTicks () - nStartTicks) / (CLOCKHZ / 1000);
+
+	m_Logger.Write (FromKernel, LogNotice, "Elapsed time %u ms, counters %u/%u (expected %u)",
+			nMsecs, nMutexCounter, nSemaphoreCounter, TASKS * ROUNDS);
+
+	for (unsigned i = 0; i < TEST_CORES; i++)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Core %u: %u rounds", i, nRounds[i]);
+	}
+
+	return    nMutexCounter == TASKS * ROUNDS
+	       && nSemaphoreCounter == TASKS * ROUNDS;
+}
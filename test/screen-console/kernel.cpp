@@ -0,0 +1,230 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/string.h>
+#include <circle/stdarg.h>
+#include <circle/util.h>
+#include <circle/sysconfig.h>
+#include <assert.h>
+
+#define REGION_START		5		// scroll region (starting at 1)
+#define REGION_END		10
+#define REGION_LINES		8		// written into the scroll region
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_nRows (0),
+	m_nLines (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Logger.Initialize (&m_Serial);	// the screen is tested
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+#ifndef SCREEN_CONSOLE_MODE
+	m_Logger.Write (FromKernel, LogWarning,
+			"SCREEN_CONSOLE_MODE is not defined, testing the normal mode");
+#endif
+
+	m_nRows = m_Screen.GetRows ();
+	if (m_nRows < REGION_END + 2)
+	{
+		m_Logger.Write (FromKernel, LogError, "Screen is too small");
+
+		return ShutdownHalt;
+	}
+
+	Print ("\x1b[H\x1b[J\x1b[?25l");	// clear screen, hide cursor
+
+	boolean bOK = TestScroll ();
+
+	if (bOK)
+	{
+		bOK = TestScrollRegion ();
+	}
+
+	Print ("\x1b[?25h");
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+// Writes several screens of lines, so that the whole screen is scrolled (in console mode
+// by moving the visible window) and wraps around in the virtual frame buffer.
+boolean CKernel::TestScroll (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 1: Scroll");
+
+	m_nLines = 3 * m_nRows + 5;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	for (unsigned i = 1; i <= m_nLines; i++)
+	{
+		Print ("Line %04u\n", i);
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks () - nStartTicks;
+	m_Logger.Write (FromKernel, LogNotice, "%u lines in %u us", m_nLines, nTicks);
+
+	// the last line is empty (cursor row), the lines before are the last written ones
+	boolean bOK = TRUE;
+	for (unsigned nRow = 0; bOK && nRow < m_nRows-1; nRow++)
+	{
+		CString Expected;
+		Expected.Format ("Line %04u", m_nLines - (m_nRows-1) + nRow + 1);
+
+		bOK = CheckRow (nRow, Expected);
+	}
+
+	if (bOK)
+	{
+		bOK = CheckRow (m_nRows-1, "");
+	}
+
+	return bOK;
+}
+
+// Writes lines into a scroll region, the rows outside of it must not be touched.
+boolean CKernel::TestScrollRegion (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 2: Scroll region (rows %u-%u)",
+			REGION_START, REGION_END);
+
+	Print ("\x1b[%u;%ur", REGION_START, REGION_END);
+	Print ("\x1b[%u;1H", REGION_END);
+
+	for (unsigned i = 1; i <= REGION_LINES; i++)
+	{
+		Print ("Region %u\n", i);
+	}
+
+	Print ("\x1b[1;%ur", m_nRows);		// reset scroll region
+
+	boolean bOK = TRUE;
+	for (unsigned nRow = 0; bOK && nRow < m_nRows-1; nRow++)
+	{
+		CString Expected;
+		if (nRow < REGION_START-1 || nRow >= REGION_END)
+		{
+			Expected.Format ("Line %04u", m_nLines - (m_nRows-1) + nRow + 1);
+		}
+		else if (nRow < REGION_END-1)
+		{
+			// the region has been scrolled, its last row is the empty cursor row
+			Expected.Format ("Region %u", REGION_LINES - (REGION_END-1 - nRow) + 1);
+		}
+
+		bOK = CheckRow (nRow, Expected);
+	}
+
+	return bOK;
+}
+
+void CKernel::Print (const char *pFormat, ...)
+{
+	va_list var;
+	va_start (var, pFormat);
+
+	CString Message;
+	Message.FormatV (pFormat, var);
+
+	va_end (var);
+
+	m_Screen.Write (Message, Message.GetLength ());
+}
+
+boolean CKernel::CheckRow (unsigned nRow, const char *pText)
+{
+	assert (pText != 0);
+
+	unsigned nCharWidth = m_CharGen.GetCharWidth ();
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
+
+	size_t nLength = strlen (pText);
+	for (unsigned nColumn = 0; nColumn < m_Screen.GetColumns (); nColumn++)
+	{
+		char chChar = nColumn < nLength ? pText[nColumn] : ' ';
+
+		for (unsigned y = 0; y < nCharHeight; y++)
+		{
+			for (unsigned x = 0; x < nCharWidth; x++)
+			{
+				boolean bSet =    m_Screen.GetPixel (nColumn * nCharWidth + x,
+								 nRow * nCharHeight + y)
+					       != BLACK_COLOR;
+				if (bSet != m_CharGen.GetPixel (chChar, x, y))
+				{
+					m_Logger.Write (FromKernel, LogError,
+							"Row %u, column %u: '%c' expected",
+							nRow+1, nColumn+1, chChar);
+
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,265 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/sched/task.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DRIVE		"SD:"
+#define FILENAME	"/bench.bin"
+
+#define FILE_SIZE	(32 * MEGABYTE)
+#define MAX_REQUEST	MEGABYTE
+
+static const unsigned RequestSize[] = {4096, 65536, MEGABYTE};
+
+static const char FromKernel[] = "kernel";
+
+// counts, how often it gets the CPU, while the main task is waiting for I/O
+class CBackgroundTask : public CTask
+{
+public:
+	CBackgroundTask (void)
+	:	m_nCount (0)
+	{
+	}
+
+	void Run (void)
+	{
+		while (TRUE)
+		{
+			m_nCount++;
+
+			CScheduler::Get ()->Yield ();
+		}
+	}
+
+	unsigned GetCount (void) const
+	{
+		return m_nCount;
+	}
+
+private:
+	volatile unsigned m_nCount;
+};
+
+static CBackgroundTask *s_pBackgroundTask = 0;
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
+	m_pBuffer (new u8[MAX_REQUEST])
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+	delete [] m_pBuffer;
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = m_pBuffer != 0;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_EMMC.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	FRESULT Result = f_mount (&m_FileSystem, DRIVE, 1);
+	if (Result != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Mount error (%u)", Result);
+
+		return ShutdownHalt;
+	}
+
+	s_pBackgroundTask = new CBackgroundTask;
+	assert (s_pBackgroundTask != 0);
+
+	for (unsigned i = 0; i < sizeof RequestSize / sizeof RequestSize[0]; i++)
+	{
+		if (   !WriteTest (RequestSize[i])
+		    || !ReadTest (RequestSize[i]))
+		{
+			break;
+		}
+	}
+
+	f_unlink (DRIVE FILENAME);
+
+	m_Logger.Write (FromKernel, LogNotice, "Finished");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::WriteTest (unsigned nRequestSize)
+{
+	FIL File;
+	if (f_open (&File, DRIVE FILENAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot create file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	StartMeasurement ();
+
+	for (unsigned nOffset = 0; nOffset < FILE_SIZE; nOffset += nRequestSize)
+	{
+		// the first word of each request is its file offset
+		memcpy (m_pBuffer, &nOffset, sizeof nOffset);
+
+		UINT nBytesWritten;
+		if (   f_write (&File, m_pBuffer, nRequestSize, &nBytesWritten) != FR_OK
+		    || nBytesWritten != nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Write error");
+
+			f_close (&File);
+
+			return FALSE;
+		}
+	}
+
+	if (f_close (&File) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot close file");
+
+		return FALSE;
+	}
+
+	StopMeasurement ("Write", nRequestSize);
+
+	return TRUE;
+}
+
+boolean CKernel::ReadTest (unsigned nRequestSize)
+{
+	FIL File;
+	if (f_open (&File, DRIVE FILENAME, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot open file: %s", FILENAME);
+
+		return FALSE;
+	}
+
+	StartMeasurement ();
+
+	for (unsigned nOffset = 0; nOffset < FILE_SIZE; nOffset += nRequestSize)
+	{
+		UINT nBytesRead;
+		if (   f_read (&File, m_pBuffer, nRequestSize, &nBytesRead) != FR_OK
+		    || nBytesRead != nRequestSize)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read error");
+
+			f_close (&File);
+
+			return FALSE;
+		}
+
+		unsigned nData;
+		memcpy (&nData, m_pBuffer, sizeof nData);
+		if (nData != nOffset)
+		{
+			m_Logger.Write (FromKernel, LogError, "Data mismatch at offset %u", nOffset);
+
+			f_close (&File);
+
+			return FALSE;
+		}
+	}
+
+	f_close (&File);
+
+	StopMeasurement ("Read", nRequestSize);
+
+	return TRUE;
+}
+
+void CKernel::StartMeasurement (void)
+{
+	assert (s_pBackgroundTask != 0);
+	m_nStartCount = s_pBackgroundTask->GetCount ();
+
+	m_nStartTicks = CTimer::GetClockTicks ();
+}
+
+void CKernel::StopMeasurement (const char *pOperation, unsigned nRequestSize)
+{
+	unsigned nTicks = CTimer::GetClockTicks () - m_nStartTicks;
+	if (nTicks == 0)
+	{
+		nTicks = 1;
+	}
+
+	assert (s_pBackgroundTask != 0);
+	unsigned nCount = s_pBackgroundTask->GetCount () - m_nStartCount;
+
+	// bytes per millisecond is equal to KBytes per second
+	unsigned nKBytesPerSec = (unsigned) ((u64) FILE_SIZE * 1000 / nTicks);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%-5s %4u KBytes requests: %3u.%02u MBytes/s, background task ran %u times",
+			pOperation, nRequestSize / 1024, nKBytesPerSec / 1000,
+			nKBytesPerSec % 1000 / 10, nCount);
+}
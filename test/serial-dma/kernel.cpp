@@ -0,0 +1,261 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define BAUDRATE		115200
+#define BUFFER_SIZE		16384
+
+#define SHORT_MESSAGE		"Hello DMA!"	// shorter than a receive DMA segment
+#define BULK_SIZE		10000		// wraps the receive DMA buffer several times
+
+static const char FromKernel[] = "kernel";
+
+volatile boolean CKernel::s_bMagicReceived = FALSE;
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_Serial (&m_Interrupt)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Logger.Initialize (&m_Screen);	// the serial device is tested
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		m_Serial.Configure (BUFFER_SIZE, BUFFER_SIZE, TRUE);
+
+		bOK = m_Serial.Initialize (BAUDRATE);
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Connect GPIO14 (TXD) with GPIO15 (RXD)");
+
+	m_Serial.SetOptions (0);		// no NL translation
+
+	// discard characters, which may have been received before
+	u8 Buffer[256];
+	m_Timer.MsDelay (100);
+	while (m_Serial.Read (Buffer, sizeof Buffer) > 0)
+	{
+		// just drain
+	}
+
+	boolean bOK = TestShortMessage ();
+
+	if (bOK)
+	{
+		bOK = TestBulkTransfer ();
+	}
+
+	TSerialStatistics Statistics;
+	m_Serial.GetStatistics (&Statistics);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"FIFO overruns %u, buffer overruns %u, breaks %u, framing errors %u, "
+			"parity errors %u, dropped %u",
+			Statistics.nFIFOOverruns, Statistics.nBufferOverruns, Statistics.nBreaks,
+			Statistics.nFramingErrors, Statistics.nParityErrors, Statistics.nTxDropped);
+
+	if (   Statistics.nFIFOOverruns != 0
+	    || Statistics.nBufferOverruns != 0
+	    || Statistics.nTxDropped != 0)
+	{
+		bOK = FALSE;
+	}
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+// The message is shorter than a receive DMA segment, so that it can only be delivered,
+// when the partially filled segment is flushed on the receive timeout (idle line).
+// Read() would flush the segment itself, so it is not called, before the magic string
+// has been detected in the interrupt handler.
+boolean CKernel::TestShortMessage (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 1: Short message (idle line flush)");
+
+	static const char Message[] = SHORT_MESSAGE;
+	unsigned nCount = sizeof Message - 1;
+
+	m_Serial.RegisterMagicReceivedHandler (Message, MagicReceivedHandler);
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	if (m_Serial.Write (Message, nCount) != (int) nCount)
+	{
+		m_Logger.Write (FromKernel, LogError, "Write failed");
+
+		return FALSE;
+	}
+
+	while (!s_bMagicReceived)
+	{
+		if (CTimer::GetClockTicks () - nStartTicks > 1000 * (CLOCKHZ / 1000))
+		{
+			m_Logger.Write (FromKernel, LogError, "Receive timeout interrupt missing");
+
+			return FALSE;
+		}
+	}
+
+	return ReceiveAndCompare ((const u8 *) Message, nCount, 1000);
+}
+
+// The data is larger than the cyclic receive DMA buffer, so that the read position
+// wraps several times in SyncRxDMA(), and it needs several send DMA transfers.
+boolean CKernel::TestBulkTransfer (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Test 2: Bulk transfer of %u bytes", BULK_SIZE);
+
+	u8 *pData = new u8[BULK_SIZE];
+	assert (pData != 0);
+
+	u32 nSeed = 0x12345678;
+	for (unsigned i = 0; i < BULK_SIZE; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		pData[i] = (u8) (nSeed >> 16);
+	}
+
+	boolean bOK = TRUE;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	if (m_Serial.Write (pData, BULK_SIZE) != BULK_SIZE)
+	{
+		m_Logger.Write (FromKernel, LogError, "Write failed");
+
+		bOK = FALSE;
+	}
+
+	// 10 bits per character, plus one second reserve
+	if (   bOK
+	    && ReceiveAndCompare (pData, BULK_SIZE, BULK_SIZE * 10 * 1000 / BAUDRATE + 1000))
+	{
+		unsigned nTicks = CTimer::GetClockTicks () - nStartTicks;
+
+		m_Logger.Write (FromKernel, LogNotice, "%u bytes/s",
+				(unsigned) ((u64) BULK_SIZE * CLOCKHZ / nTicks));
+	}
+	else
+	{
+		bOK = FALSE;
+	}
+
+	delete [] pData;
+
+	return bOK;
+}
+
+boolean CKernel::ReceiveAndCompare (const u8 *pExpected, unsigned nCount, unsigned nTimeoutMs)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	unsigned nReceived = 0;
+	while (nReceived < nCount)
+	{
+		u8 Buffer[256];
+		unsigned nBytes = nCount - nReceived;
+		if (nBytes > sizeof Buffer)
+		{
+			nBytes = sizeof Buffer;
+		}
+
+		int nResult = m_Serial.Read (Buffer, nBytes);
+		if (nResult < 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Receive error %d at offset %u",
+					-nResult, nReceived);
+
+			return FALSE;
+		}
+
+		if (nResult == 0)
+		{
+			if (CTimer::GetClockTicks () - nStartTicks > nTimeoutMs * (CLOCKHZ / 1000))
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"Timeout (%u of %u bytes received)", nReceived, nCount);
+
+				return FALSE;
+			}
+
+			continue;
+		}
+
+		if (memcmp (Buffer, pExpected + nReceived, nResult) != 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Data mismatch at offset %u", nReceived);
+
+			return FALSE;
+		}
+
+		nReceived += nResult;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "%u bytes received correctly", nReceived);
+
+	return TRUE;
+}
+
+void CKernel::MagicReceivedHandler (void)
+{
+	s_bMagicReceived = TRUE;
+}
@@ -0,0 +1,247 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <assert.h>
+
+#define DEVICE_SAMPLE_RATE	48000
+#define LATENCY_MSECS		50
+
+#define WARMUP_MSECS		1000
+#define MEASURE_MSECS		5000
+
+#define RATE_TOLERANCE		2		// percent
+
+// the sample rates of both streams differ from the device, so they are converted
+static const struct
+{
+	unsigned nSampleRate;
+	unsigned nChannels;
+	unsigned nPeriod;			// frames per period of the triangle wave
+	unsigned nGain;
+}
+Streams[TEST_STREAMS] =
+{
+	{44100, 2, 100, SOUND_MIXER_GAIN_UNITY / 2},	// 441 Hz
+	{22050, 1,  35, SOUND_MIXER_GAIN_UNITY / 4}	// 630 Hz
+};
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_PWMSound (&m_Interrupt, DEVICE_SAMPLE_RATE),
+	m_Mixer (&m_PWMSound, LATENCY_MSECS)
+{
+	m_ActLED.Blink (5);	// show we are alive
+
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		m_nStream[i] = -1;
+		m_pWave[i] = 0;
+		m_nWaveOffset[i] = 0;
+		m_nFramesWritten[i] = 0;
+	}
+}
+
+CKernel::~CKernel (void)
+{
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		delete [] m_pWave[i];
+	}
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		m_nStream[i] = m_Mixer.AddStream (SoundFormatSigned16, Streams[i].nChannels,
+						  Streams[i].nSampleRate);
+		if (m_nStream[i] < 0)
+		{
+			m_Logger.Write (FromKernel, LogPanic, "Cannot add stream %u", i);
+		}
+
+		m_Mixer.SetGain (m_nStream[i], Streams[i].nGain);
+
+		// triangle wave, integer only
+		unsigned nPeriod = Streams[i].nPeriod;
+		m_pWave[i] = new s16[nPeriod * Streams[i].nChannels];
+		assert (m_pWave[i] != 0);
+
+		for (unsigned nFrame = 0; nFrame < nPeriod; nFrame++)
+		{
+			int nPhase = (int) (nFrame * 4 * 32767 / nPeriod);	// 0..4*32767
+			int nLevel = nPhase < 2 * 32767 ? nPhase - 32767 : 3 * 32767 - nPhase;
+
+			for (unsigned nChannel = 0; nChannel < Streams[i].nChannels; nChannel++)
+			{
+				m_pWave[i][nFrame * Streams[i].nChannels + nChannel] = (s16) nLevel;
+			}
+		}
+	}
+
+	FeedStreams ();
+
+	if (!m_Mixer.Start ())
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot start sound device");
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Playing two tones (441 Hz, 630 Hz)");
+
+	// feed the streams from task level, until the warm-up time has elapsed
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (CTimer::GetClockTicks () - nStartTicks < WARMUP_MSECS * (CLOCKHZ / 1000))
+	{
+		FeedStreams ();
+	}
+
+	unsigned nUnderruns[TEST_STREAMS];
+	u64 nConsumed[TEST_STREAMS];
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		nUnderruns[i] = m_Mixer.GetUnderruns (m_nStream[i]);
+		nConsumed[i] = GetConsumedFrames (i);
+	}
+	unsigned nDeviceUnderruns = m_Mixer.GetDeviceUnderruns ();
+
+	nStartTicks = CTimer::GetClockTicks ();
+	unsigned nTicks;
+	while ((nTicks = CTimer::GetClockTicks () - nStartTicks) < MEASURE_MSECS * (CLOCKHZ / 1000))
+	{
+		FeedStreams ();
+	}
+
+	boolean bOK = TRUE;
+
+	// each stream must be consumed with its own sample rate
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		u64 nFrames = GetConsumedFrames (i) - nConsumed[i];
+		unsigned nRate = (unsigned) (nFrames * CLOCKHZ / nTicks);
+		unsigned nStreamUnderruns = m_Mixer.GetUnderruns (m_nStream[i]) - nUnderruns[i];
+
+		unsigned nExpected = Streams[i].nSampleRate;
+		boolean bRateOK =    nRate * 100 >= nExpected * (100 - RATE_TOLERANCE)
+				  && nRate * 100 <= nExpected * (100 + RATE_TOLERANCE);
+
+		m_Logger.Write (FromKernel, bRateOK && nStreamUnderruns == 0 ? LogNotice : LogError,
+				"Stream %u: %u Hz consumed (expected %u Hz), %u underruns",
+				i, nRate, nExpected, nStreamUnderruns);
+
+		if (!bRateOK || nStreamUnderruns != 0)
+		{
+			bOK = FALSE;
+		}
+	}
+
+	nDeviceUnderruns = m_Mixer.GetDeviceUnderruns () - nDeviceUnderruns;
+	m_Logger.Write (FromKernel, nDeviceUnderruns == 0 ? LogNotice : LogError,
+			"Device: %u underruns", nDeviceUnderruns);
+	if (nDeviceUnderruns != 0)
+	{
+		bOK = FALSE;
+	}
+
+	m_Mixer.Cancel ();
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			bOK ? "All tests passed" : "Test failed");
+
+	return ShutdownHalt;
+}
+
+// Writes as much of the wave as possible into the stream queues.
+void CKernel::FeedStreams (void)
+{
+	for (unsigned i = 0; i < TEST_STREAMS; i++)
+	{
+		unsigned nFrameSize = Streams[i].nChannels * sizeof (s16);
+		unsigned nWaveSize = Streams[i].nPeriod * nFrameSize;
+
+		int nResult;
+		do
+		{
+			nResult = m_Mixer.Write (m_nStream[i], (u8 *) m_pWave[i] + m_nWaveOffset[i],
+						 nWaveSize - m_nWaveOffset[i]);
+			assert (nResult >= 0);
+			assert (nResult % nFrameSize == 0);
+
+			m_nFramesWritten[i] += nResult / nFrameSize;
+
+			m_nWaveOffset[i] += nResult;
+			if (m_nWaveOffset[i] == nWaveSize)
+			{
+				m_nWaveOffset[i] = 0;
+			}
+		}
+		while (nResult > 0);
+	}
+}
+
+u64 CKernel::GetConsumedFrames (unsigned nIndex) const
+{
+	assert (nIndex < TEST_STREAMS);
+
+	return m_nFramesWritten[nIndex] - m_Mixer.GetQueueFramesAvail (m_nStream[nIndex]);
+}
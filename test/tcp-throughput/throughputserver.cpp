@@ -0,0 +1,179 @@
+//
+// throughputserver.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "throughputserver.h"
+#include <circle/net/in.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+static const char FromServer[] = "server";
+
+CThroughputServer::CThroughputServer (CNetSubSystem *pNetSubSystem, boolean bSource,
+				      unsigned nSendWindow, unsigned nReceiveWindow,
+				      TTCPCongestionControl CongestionControl)
+:	m_pNetSubSystem (pNetSubSystem),
+	m_bSource (bSource),
+	m_nSendWindow (nSendWindow),
+	m_nReceiveWindow (nReceiveWindow),
+	m_CongestionControl (CongestionControl)
+{
+	for (unsigned i = 0; i < sizeof m_Buffer; i++)
+	{
+		m_Buffer[i] = (u8) i;
+	}
+}
+
+CThroughputServer::~CThroughputServer (void)
+{
+	m_pNetSubSystem = 0;
+}
+
+void CThroughputServer::Run (void)
+{
+	u16 nPort = m_bSource ? SOURCE_PORT : SINK_PORT;
+
+	assert (m_pNetSubSystem != 0);
+	CSocket Socket (m_pNetSubSystem, IPPROTO_TCP);
+
+	if (   Socket.SetOptionSendWindow (m_nSendWindow) < 0
+	    || Socket.SetOptionReceiveWindow (m_nReceiveWindow) < 0
+	    || Socket.SetOptionCongestionControl (m_CongestionControl) < 0)
+	{
+		CLogger::Get ()->Write (FromServer, LogError, "Cannot set socket options");
+
+		return;
+	}
+
+	if (   Socket.Bind (nPort) < 0
+	    || Socket.Listen (1) < 0)
+	{
+		CLogger::Get ()->Write (FromServer, LogError, "Cannot listen on port %u", nPort);
+
+		return;
+	}
+
+	while (1)
+	{
+		CIPAddress ForeignIP;
+		u16 nForeignPort;
+		CSocket *pConnection = Socket.Accept (&ForeignIP, &nForeignPort);
+		if (pConnection == 0)
+		{
+			CLogger::Get ()->Write (FromServer, LogWarning, "Cannot accept connection");
+
+			continue;
+		}
+
+		CString IPString;
+		ForeignIP.Format (&IPString);
+		CLogger::Get ()->Write (FromServer, LogNotice, "Connection from %s on port %u",
+					(const char *) IPString, nPort);
+
+		if (m_bSource)
+		{
+			Source (pConnection);
+		}
+		else
+		{
+			Sink (pConnection);
+		}
+
+		ReportStatistics (pConnection);
+
+		delete pConnection;		// closes connection
+	}
+}
+
+void CThroughputServer::Sink (CSocket *pConnection)
+{
+	assert (pConnection != 0);
+
+	u64 nBytes = 0;
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	int nResult;
+	while ((nResult = pConnection->Receive (m_Buffer, sizeof m_Buffer, 0)) > 0)
+	{
+		nBytes += nResult;
+	}
+
+	Report ("Received", nBytes, CTimer::GetClockTicks () - nStartTicks);
+}
+
+void CThroughputServer::Source (CSocket *pConnection)
+{
+	assert (pConnection != 0);
+
+	u64 nBytes = 0;
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	while (nBytes < SOURCE_BYTES)
+	{
+		if (pConnection->Send (m_Buffer, sizeof m_Buffer, 0) != (int) sizeof m_Buffer)
+		{
+			CLogger::Get ()->Write (FromServer, LogWarning, "Cannot send data");
+
+			break;
+		}
+
+		nBytes += sizeof m_Buffer;
+	}
+
+	Report ("Sent", nBytes, CTimer::GetClockTicks () - nStartTicks);
+}
+
+void CThroughputServer::Report (const char *pWhat, u64 nBytes, unsigned nMicroSeconds)
+{
+	if (nMicroSeconds == 0)
+	{
+		nMicroSeconds = 1;
+	}
+
+	unsigned nKBytesPerSecond = (unsigned) (nBytes * CLOCKHZ / 1024 / nMicroSeconds);
+
+	CLogger::Get ()->Write (FromServer, LogNotice, "%s %u KBytes in %u.%03u s (%u KBytes/s)",
+				pWhat, (unsigned) (nBytes / 1024),
+				nMicroSeconds / CLOCKHZ, nMicroSeconds % CLOCKHZ / 1000,
+				nKBytesPerSecond);
+}
+
+void CThroughputServer::ReportStatistics (CSocket *pConnection)
+{
+	assert (pConnection != 0);
+
+	TTCPStatistics Stats;
+	if (pConnection->GetStatistics (&Stats) < 0)
+	{
+		return;
+	}
+
+	CLogger::Get ()->Write (FromServer, LogNotice,
+				"cwnd %u, ssthresh %u, srtt %u ms, rto %u ms",
+				Stats.nCongestionWindow, Stats.nSlowStartThreshold,
+				Stats.nSmoothedRTT, Stats.nRTO);
+
+	CLogger::Get ()->Write (FromServer, LogNotice,
+				"%u segments sent, %u received, %u retransmitted, "
+				"%u fast retransmits, %u timeouts, %u dup ACKs",
+				Stats.nSegmentsSent, Stats.nSegmentsReceived, Stats.nRetransmissions,
+				Stats.nFastRetransmits, Stats.nTimeouts, Stats.nDuplicateACKs);
+}
@@ -0,0 +1,61 @@
+//
+// throughputserver.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _throughputserver_h
+#define _throughputserver_h
+
+#include <circle/sched/task.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/types.h>
+
+#define SINK_PORT	5001		// receives data from the host
+#define SOURCE_PORT	5002		// sends data to the host
+
+#define SOURCE_BYTES	(64 * 0x100000)	// bytes sent per connection
+
+class CThroughputServer : public CTask
+{
+public:
+	// nSendWindow, nReceiveWindow and CongestionControl are the socket options
+	CThroughputServer (CNetSubSystem *pNetSubSystem, boolean bSource,
+			   unsigned nSendWindow, unsigned nReceiveWindow,
+			   TTCPCongestionControl CongestionControl);
+	~CThroughputServer (void);
+
+	void Run (void);
+
+private:
+	void Sink (CSocket *pConnection);
+	void Source (CSocket *pConnection);
+
+	static void Report (const char *pWhat, u64 nBytes, unsigned nMicroSeconds);
+	static void ReportStatistics (CSocket *pConnection);
+
+private:
+	CNetSubSystem *m_pNetSubSystem;
+	boolean m_bSource;
+	unsigned m_nSendWindow;
+	unsigned m_nReceiveWindow;
+	TTCPCongestionControl m_CongestionControl;
+
+	u8 m_Buffer[0x4000];
+};
+
+#endif